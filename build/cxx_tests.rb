@@ -55,10 +55,19 @@
 
   "#{TEST_OUTPUT_DIR}cxx/Core/ResponseCacheTest.o" =>
     "test/cxx/Core/ResponseCacheTest.cpp",
+  "#{TEST_OUTPUT_DIR}cxx/Core/StaticFileCacheTest.o" =>
+    "test/cxx/Core/StaticFileCacheTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/Core/SecurityUpdateCheckerTest.o" =>
       "test/cxx/Core/SecurityUpdateCheckerTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/Core/ControllerTest.o" =>
     "test/cxx/Core/ControllerTest.cpp",
+  "#{TEST_OUTPUT_DIR}cxx/Core/ServerSocketChangesTest.o" =>
+    "test/cxx/Core/ServerSocketChangesTest.cpp",
+
+  "#{TEST_OUTPUT_DIR}cxx/Watchdog/AgentWatcherTest.o" =>
+    "test/cxx/Watchdog/AgentWatcherTest.cpp",
+  "#{TEST_OUTPUT_DIR}cxx/Watchdog/ProcessFdKeeperTest.o" =>
+    "test/cxx/Watchdog/ProcessFdKeeperTest.cpp",
 
   "#{TEST_OUTPUT_DIR}cxx/SpawnEnvSetupperTest.o" =>
     "test/cxx/SpawnEnvSetupperTest.cpp",
@@ -67,14 +76,20 @@
     "test/cxx/ServerKit/ChannelTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/ServerKit/FileBufferedChannelTest.o" =>
     "test/cxx/ServerKit/FileBufferedChannelTest.cpp",
+  "#{TEST_OUTPUT_DIR}cxx/ServerKit/IoUringTest.o" =>
+    "test/cxx/ServerKit/IoUringTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/ServerKit/HeaderTableTest.o" =>
     "test/cxx/ServerKit/HeaderTableTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/ServerKit/ServerTest.o" =>
     "test/cxx/ServerKit/ServerTest.cpp",
+  "#{TEST_OUTPUT_DIR}cxx/ServerKit/AcceptLoadBalancerTest.o" =>
+    "test/cxx/ServerKit/AcceptLoadBalancerTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/ServerKit/HttpServerTest.o" =>
     "test/cxx/ServerKit/HttpServerTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/ServerKit/CookieUtilsTest.o" =>
     "test/cxx/ServerKit/CookieUtilsTest.cpp",
+  "#{TEST_OUTPUT_DIR}cxx/ServerKit/AsyncHttpClientTest.o" =>
+    "test/cxx/ServerKit/AsyncHttpClientTest.cpp",
 
   "#{TEST_OUTPUT_DIR}cxx/ConfigKit/SchemaTest.o" =>
     "test/cxx/ConfigKit/SchemaTest.cpp",
@@ -90,8 +105,12 @@
     "test/cxx/MemoryKit/MbufTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/MemoryKit/PallocTest.o" =>
     "test/cxx/MemoryKit/PallocTest.cpp",
+  "#{TEST_OUTPUT_DIR}cxx/Algorithms/LatencyHistogramTest.o" =>
+    "test/cxx/Algorithms/LatencyHistogramTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/DataStructures/LStringTest.o" =>
     "test/cxx/DataStructures/LStringTest.cpp",
+  "#{TEST_OUTPUT_DIR}cxx/DataStructures/MpscQueueTest.o" =>
+    "test/cxx/DataStructures/MpscQueueTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/DataStructures/StringKeyTableTest.o" =>
     "test/cxx/DataStructures/StringKeyTableTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/FileTools/PathSecurityCheckTest.o" =>
@@ -126,6 +145,8 @@
     "test/cxx/UtilsTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/Utils/StrIntUtilsTest.o" =>
     "test/cxx/Utils/StrIntUtilsTest.cpp",
+  "#{TEST_OUTPUT_DIR}cxx/Utils/CpuAffinityTest.o" =>
+    "test/cxx/Utils/CpuAffinityTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/IOUtilsTest.o" =>
     "test/cxx/IOUtilsTest.cpp",
   "#{TEST_OUTPUT_DIR}cxx/TemplateTest.o" =>
@@ -282,3 +303,125 @@
     ].flatten
   )
 end
+
+
+### C++ microbenchmarks ###
+
+TEST_CXX_BENCH_TARGET = "#{TEST_OUTPUT_DIR}cxx_bench/main"
+TEST_CXX_BENCH_OBJECTS = {
+  "#{TEST_OUTPUT_DIR}cxx_bench/BenchMain.o" =>
+    "test/cxx_bench/BenchMain.cpp",
+  "#{TEST_OUTPUT_DIR}cxx_bench/DataStructures/StringKeyTableBench.o" =>
+    "test/cxx_bench/DataStructures/StringKeyTableBench.cpp",
+  "#{TEST_OUTPUT_DIR}cxx_bench/MemoryKit/PallocBench.o" =>
+    "test/cxx_bench/MemoryKit/PallocBench.cpp",
+  "#{TEST_OUTPUT_DIR}cxx_bench/MemoryKit/MbufBench.o" =>
+    "test/cxx_bench/MemoryKit/MbufBench.cpp",
+  "#{TEST_OUTPUT_DIR}cxx_bench/ServerKit/HeaderTableBench.o" =>
+    "test/cxx_bench/ServerKit/HeaderTableBench.cpp",
+  "#{TEST_OUTPUT_DIR}cxx_bench/ServerKit/HttpParserBench.o" =>
+    "test/cxx_bench/ServerKit/HttpParserBench.cpp",
+  "#{TEST_OUTPUT_DIR}cxx_bench/Core/ResponseCacheBench.o" =>
+    "test/cxx_bench/Core/ResponseCacheBench.cpp"
+}
+
+let(:test_cxx_bench_include_paths) do
+  ['test/cxx_bench'] + test_cxx_include_paths
+end
+
+# The benchmarks themselves are always optimized. The code under test is
+# only optimized when the build is run with OPTIMIZE=1, so we tell the
+# benchmarks about that explicitly: __OPTIMIZE__ is always defined for them.
+let(:test_cxx_bench_flags) do
+  flags = ['-O2', basic_test_cxx_flags]
+  flags << '-DPASSENGER_BENCH_LIBRARY_OPTIMIZED' if OPTIMIZE
+  flags.flatten
+end
+
+TEST_CXX_BENCH_OBJECTS.each_pair do |object, source|
+  define_cxx_object_compilation_task(
+    object,
+    source,
+    lambda { {
+      :include_paths => test_cxx_bench_include_paths,
+      :flags => test_cxx_bench_flags
+    } }
+  )
+end
+
+dependencies = [
+  TEST_CXX_BENCH_OBJECTS.keys,
+  LIBEV_TARGET,
+  LIBUV_TARGET,
+  TEST_BOOST_OXT_LIBRARY,
+  TEST_COMMON_LIBRARY.link_objects,
+  AGENT_OBJECTS.keys - [AGENT_MAIN_OBJECT]
+].flatten.compact
+file(TEST_CXX_BENCH_TARGET => dependencies) do
+  create_cxx_executable(
+    TEST_CXX_BENCH_TARGET,
+    TEST_CXX_BENCH_OBJECTS.keys + AGENT_OBJECTS.keys - [AGENT_MAIN_OBJECT],
+    :flags => test_cxx_ldflags
+  )
+end
+
+desc "Run the C++ microbenchmarks (use OPTIMIZE=1 for meaningful results)"
+task 'test:cxx:bench' => TEST_CXX_BENCH_TARGET do
+  # FILTER: semicolon-separated substrings of benchmark names to run.
+  # OUTPUT: file to write the JSON results to. Default: stdout.
+  args = ENV['FILTER'].to_s.split(";").map { |name| "-f #{shesc(name)}" }
+  args << "-t #{ENV['MIN_TIME'].to_f}" if ENV['MIN_TIME']
+  args << "-r #{ENV['REPETITIONS'].to_i}" if ENV['REPETITIONS']
+  args << "-o #{shesc(File.expand_path(ENV['OUTPUT']))}" if ENV['OUTPUT']
+  sh "#{File.expand_path(TEST_CXX_BENCH_TARGET)} #{args.join(' ')}".strip
+end
+
+TEST_CXX_LOAD_BENCH_TARGET = "#{TEST_OUTPUT_DIR}cxx_bench/load_bench"
+TEST_CXX_LOAD_BENCH_OBJECTS = {
+  "#{TEST_OUTPUT_DIR}cxx_bench/LoadBench/LoadBenchMain.o" =>
+    "test/cxx_bench/LoadBench/LoadBenchMain.cpp"
+}
+
+TEST_CXX_LOAD_BENCH_OBJECTS.each_pair do |object, source|
+  define_cxx_object_compilation_task(
+    object,
+    source,
+    lambda { {
+      :include_paths => test_cxx_bench_include_paths,
+      :flags => test_cxx_bench_flags
+    } }
+  )
+end
+
+dependencies = [
+  TEST_CXX_LOAD_BENCH_OBJECTS.keys,
+  LIBEV_TARGET,
+  LIBUV_TARGET,
+  TEST_BOOST_OXT_LIBRARY,
+  TEST_COMMON_LIBRARY.link_objects,
+  AGENT_OBJECTS.keys - [AGENT_MAIN_OBJECT]
+].flatten.compact
+file(TEST_CXX_LOAD_BENCH_TARGET => dependencies) do
+  create_cxx_executable(
+    TEST_CXX_LOAD_BENCH_TARGET,
+    TEST_CXX_LOAD_BENCH_OBJECTS.keys + AGENT_OBJECTS.keys - [AGENT_MAIN_OBJECT],
+    :flags => test_cxx_ldflags
+  )
+end
+
+desc "Run the end-to-end Core load benchmark (use OPTIMIZE=1 for meaningful results)"
+task 'test:cxx:bench:load' => TEST_CXX_LOAD_BENCH_TARGET do
+  # MODES: comma-separated benchmark modes to run (none, after_accept, ...).
+  # SCENARIOS: comma-separated scenarios to run (keepalive, pipelining, ...).
+  # PROTOCOL: protocol that the stub app speaks: session or http.
+  # OUTPUT: file to write the JSON results to. Default: stdout.
+  args = ["-R #{shesc(SOURCE_ROOT)}"]
+  args << "-m #{shesc(ENV['MODES'])}" if ENV['MODES']
+  args << "-s #{shesc(ENV['SCENARIOS'])}" if ENV['SCENARIOS']
+  args << "-p #{shesc(ENV['PROTOCOL'])}" if ENV['PROTOCOL']
+  args << "-T #{ENV['THREADS'].to_i}" if ENV['THREADS']
+  args << "-c #{ENV['CONCURRENCY'].to_i}" if ENV['CONCURRENCY']
+  args << "-d #{ENV['DURATION'].to_f}" if ENV['DURATION']
+  args << "-o #{shesc(File.expand_path(ENV['OUTPUT']))}" if ENV['OUTPUT']
+  sh "#{File.expand_path(TEST_CXX_LOAD_BENCH_TARGET)} #{args.join(' ')}"
+end
@@ -3332,6 +3332,7 @@
    "src/agent/Core/Controller/TurboCaching.h",
    "src/agent/Core/ResponseCache.h",
    "src/agent/Core/SecurityUpdateChecker.h",
+   "src/agent/Core/ServerSocketChanges.h",
    "src/agent/Core/SpawningKit/Config.h",
    "src/agent/Core/SpawningKit/Config/AutoGeneratedCode.h",
    "src/agent/Core/SpawningKit/Context.h",
@@ -5796,6 +5797,7 @@
    "src/agent/Core/OptionParser.h",
    "src/agent/Core/ResponseCache.h",
    "src/agent/Core/SecurityUpdateChecker.h",
+   "src/agent/Core/ServerSocketChanges.h",
    "src/agent/Core/SpawningKit/Config.h",
    "src/agent/Core/SpawningKit/Config/AutoGeneratedCode.h",
    "src/agent/Core/SpawningKit/Context.h",
@@ -7201,7 +7203,7 @@
    "src/cxx_supportlib/oxt/tracable_exception.hpp"],
  "src/agent/TempDirToucher/TempDirToucherMain.cpp"=>
   ["src/cxx_supportlib/Constants.h"],
- "src/agent/Watchdog/AgentWatcher.cpp"=>
+ "src/agent/Watchdog/AgentWatcher.h"=>
   [],
  "src/agent/Watchdog/ApiServer.h"=>
   ["src/agent/Shared/ApiAccountUtils.h",
@@ -7519,7 +7521,7 @@
    "src/agent/Shared/Fundamentals/AbortHandler.h",
    "src/agent/Shared/Fundamentals/Initialization.h",
    "src/agent/Shared/Fundamentals/Utils.h",
-   "src/agent/Watchdog/AgentWatcher.cpp",
+   "src/agent/Watchdog/AgentWatcher.h",
    "src/agent/Watchdog/ApiServer.h",
    "src/agent/Watchdog/Config.h",
    "src/agent/Watchdog/CoreWatcher.cpp",
@@ -41,6 +41,7 @@
 #include <Core/Controller.h>
 #include <Core/ConfigChange.h>
 #include <Core/ApplicationPool/Pool.h>
+#include <Core/SpawningKit/Context.h>
 #include <Shared/ApiServerUtils.h>
 #include <Shared/ApiAccountUtils.h>
 #include <ServerKit/HttpServer.h>
@@ -53,6 +54,7 @@
 #include <Utils/StrIntUtils.h>
 #include <Utils/BufferedIO.h>
 #include <Utils/MessageIO.h>
+#include <Utils/CpuAffinity.h>
 
 namespace Passenger {
 namespace Core {
@@ -70,6 +72,7 @@ using namespace std;
  *   authorizations                 array              -   default("[FILTERED]"),secret
  *   client_freelist_limit          unsigned integer   -   default(0)
  *   instance_dir                   string             -   -
+ *   max_pipelined_requests         unsigned integer   -   default(0)
  *   min_spare_clients              unsigned integer   -   default(0)
  *   request_freelist_limit         unsigned integer   -   default(1024)
  *   start_reading_after_accept     boolean            -   default(true)
@@ -117,6 +120,7 @@ public:
 	Authorization authorization;
 	unsigned int controllerStatesGathered;
 	vector<Json::Value> controllerStates;
+	vector<RequestLatencySnapshotPtr> controllerLatencies;
 
 	DEFINE_SERVER_KIT_BASE_HTTP_REQUEST_FOOTER(Passenger::Core::ApiServer::Request);
 };
@@ -132,6 +136,7 @@ public:
 private:
 	ApiAccountUtils::ApiAccountDatabase apiAccountDatabase;
 	boost::regex serverConnectionPath;
+	ServerKit::AsyncHttpClient httpClient;
 
 	bool regex_match(const StaticString &str, const boost::regex &e) const {
 		return boost::regex_match(str.data(), str.data() + str.size(), e);
@@ -157,6 +162,8 @@ private:
 	void route(Client *client, Request *req, const StaticString &path) {
 		if (path == P_STATIC_STRING("/server.json")) {
 			processServerStatus(client, req);
+		} else if (path == P_STATIC_STRING("/request_latencies.json")) {
+			processRequestLatencies(client, req);
 		} else if (regex_match(path, serverConnectionPath)) {
 			processServerConnectionOperation(client, req);
 		} else if (path == P_STATIC_STRING("/pool.xml")) {
@@ -185,7 +192,8 @@ private:
 		} else if (path == P_STATIC_STRING("/reinherit_logs.json")) {
 			apiServerProcessReinheritLogs(this, client, req,
 				config["instance_dir"].asString(),
-				config["watchdog_fd_passing_password"].asString());
+				config["watchdog_fd_passing_password"].asString(),
+				&httpClient);
 		} else if (path == P_STATIC_STRING("/reopen_logs.json")) {
 			apiServerProcessReopenLogs(this, client, req);
 		} else {
@@ -237,6 +245,10 @@ private:
 		Controller *controller, unsigned int i)
 	{
 		Json::Value state = controller->inspectStateAsJson();
+		#ifdef PASSENGER_SUPPORTS_CPU_AFFINITY
+			// We're running in the controller's thread.
+			state["cpu_affinity"] = getCurrentThreadCpuAffinity();
+		#endif
 		getContext()->libev->runLater(boost::bind(&ApiServer::controllerStateGathered,
 			this, client, req, i, state));
 	}
@@ -264,6 +276,12 @@ private:
 				response[key] = req->controllerStates[i];
 			}
 
+			const vector<unsigned int> &appProcessCpus =
+				appPool->getSpawningKitContext()->appProcessCpus;
+			if (!appProcessCpus.empty()) {
+				response["app_process_cpus"] = formatCpuList(appProcessCpus);
+			}
+
 			writeSimpleResponse(client, 200, &headers,
 				psg_pstrdup(req->pool, response.toStyledString()));
 			if (!req->ended()) {
@@ -289,6 +307,68 @@ private:
 		}
 	}
 
+	void gatherControllerLatencies(Client *client, Request *req,
+		Controller *controller, unsigned int i)
+	{
+		RequestLatencySnapshotPtr snapshot = controller->snapshotRequestLatencies();
+		getContext()->libev->runLater(boost::bind(&ApiServer::controllerLatenciesGathered,
+			this, client, req, i, snapshot));
+	}
+
+	void controllerLatenciesGathered(Client *client, Request *req,
+		unsigned int i, RequestLatencySnapshotPtr snapshot)
+	{
+		if (req->ended()) {
+			unrefRequest(req, __FILE__, __LINE__);
+			return;
+		}
+
+		req->controllerStatesGathered++;
+		req->controllerLatencies[i] = snapshot;
+
+		if (req->controllerStatesGathered == controllers.size()) {
+			HeaderTable headers;
+			headers.insert(req->pool, "Content-Type", "application/json");
+
+			RequestLatencySnapshot merged;
+			Json::Value response;
+			response["threads"] = (Json::UInt) controllers.size();
+
+			for (unsigned int i = 0; i < controllers.size(); i++) {
+				string key = "thread" + toString(i + 1);
+				response[key] = req->controllerLatencies[i]->inspectAsJson();
+				merged.merge(*req->controllerLatencies[i]);
+			}
+
+			Json::Value mergedDoc = merged.inspectAsJson();
+			response["overall"] = mergedDoc["overall"];
+			response["groups"] = mergedDoc["groups"];
+
+			writeSimpleResponse(client, 200, &headers,
+				psg_pstrdup(req->pool, response.toStyledString()));
+			if (!req->ended()) {
+				Request *req2 = req;
+				endRequest(&client, &req2);
+			}
+		}
+
+		unrefRequest(req, __FILE__, __LINE__);
+	}
+
+	void processRequestLatencies(Client *client, Request *req) {
+		if (authorizeStateInspectionOperation(this, client, req)) {
+			req->controllerLatencies.resize(controllers.size());
+			for (unsigned int i = 0; i < controllers.size(); i++) {
+				refRequest(req, __FILE__, __LINE__);
+				controllers[i]->getContext()->libev->runLater(boost::bind(
+					&ApiServer::gatherControllerLatencies, this,
+					client, req, controllers[i], i));
+			}
+		} else {
+			apiServerRespondWith401(this, client, req);
+		}
+	}
+
 	void processPoolStatusXml(Client *client, Request *req) {
 		Authorization auth(authorize(this, client, req));
 		if (auth.canReadPool) {
@@ -674,6 +754,7 @@ protected:
 		}
 		req->authorization = Authorization();
 		req->controllerStates.clear();
+		req->controllerLatencies.clear();
 		ParentClass::deinitializeRequest(client, req);
 	}
 
@@ -690,6 +771,7 @@ public:
 		const ConfigKit::Translator &translator = ConfigKit::DummyTranslator())
 		: ParentClass(context, schema, initialConfig, translator),
 		  serverConnectionPath("^/server/(.+)\\.json$"),
+		  httpClient(context),
 		  exitEvent(NULL)
 	{
 		apiAccountDatabase = ApiAccountUtils::ApiAccountDatabase(
@@ -59,6 +59,14 @@ public:
 
 	virtual void requestOOBW() { /* Do nothing */ }
 
+	/**
+	 * Sets the time (in microseconds) from which the process's response
+	 * time is measured for this session, or 0 to not measure it. Used
+	 * for sessions that were checked out before the request that uses
+	 * them began.
+	 */
+	virtual void resetCheckoutTime(unsigned long long time) { /* Do nothing */ }
+
 	/**
 	 * This Session object becomes fully unsable after closing.
 	 */
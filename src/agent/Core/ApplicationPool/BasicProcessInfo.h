@@ -92,14 +92,12 @@ public:
 		const Json::Value &json)
 		: process(_process),
 		  groupInfo(_groupInfo),
-		  pid(getJsonIntField(json, "pid"))
-		  // We initialize this in Process::initializeStickySessionId(),
-		  // called from Group::attach().
-		  // We should probably some day refactor this. The reason we do
-		  // it the way we do right now is because some day we want to be able
-		  // to attach external processes, so the best place to initialize this
-		  // information is in Group::attach().
-		  //stickySessionId(getJsonUintField(json, "sticky_session_id", 0))
+		  pid(getJsonIntField(json, "pid")),
+		  // Group::attach() generates a new sticky session ID if this is
+		  // 0 or if it's already taken. Processes that are re-adopted after
+		  // a Core restart pass their old ID, so that sticky sessions
+		  // keep working.
+		  stickySessionId(getJsonUintField(json, Json::StaticString("sticky_session_id"), 0u))
 	{
 		StaticString gupid = getJsonStaticStringField(json, "gupid");
 		assert(gupid.size() <= GUPID_MAX_SIZE);
@@ -111,8 +109,9 @@ public:
 		const SpawningKit::Result &skResult)
 		: process(_process),
 		  groupInfo(_groupInfo),
-		  pid(skResult.pid)
+		  pid(skResult.pid),
 		  // See above comment about the 'stickySessionId' field
+		  stickySessionId(0)
 	{
 		assert(skResult.gupid.size() <= GUPID_MAX_SIZE);
 		memcpy(gupid, skResult.gupid.data(), skResult.gupid.size());
@@ -161,6 +161,37 @@ enum RestartMethod {
 	RM_ROLLING
 };
 
+/**
+ * Determines how Group::route() picks a process among the enabled processes.
+ * Parsed from Options::routingPolicy.
+ */
+enum RoutingPolicy {
+	// Route to the process with the lowest busyness.
+	RP_LEAST_BUSY,
+	// Route to the process with the lowest busyness, weighted by the process's
+	// recent response time. Steers requests away from processes that are
+	// temporarily slow, e.g. because of a GC pause or a noisy neighbor.
+	RP_RESPONSE_TIME,
+	// Sample two random enabled processes and route to the less busy one
+	// ("power of two choices"). Avoids scanning all processes and spreads
+	// load more evenly when many requests arrive at once.
+	RP_TWO_RANDOM_CHOICES,
+	RP_UNKNOWN
+};
+
+inline RoutingPolicy
+parseRoutingPolicy(const StaticString &policy) {
+	if (policy.empty() || policy == "least_busy") {
+		return RP_LEAST_BUSY;
+	} else if (policy == "response_time") {
+		return RP_RESPONSE_TIME;
+	} else if (policy == "two_random_choices") {
+		return RP_TWO_RANDOM_CHOICES;
+	} else {
+		return RP_UNKNOWN;
+	}
+}
+
 typedef boost::shared_ptr<Pool> PoolPtr;
 typedef boost::shared_ptr<Group> GroupPtr;
 typedef boost::intrusive_ptr<Process> ProcessPtr;
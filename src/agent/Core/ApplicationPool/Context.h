@@ -26,6 +26,7 @@
 #ifndef _PASSENGER_APPLICATION_POOL2_CONTEXT_H_
 #define _PASSENGER_APPLICATION_POOL2_CONTEXT_H_
 
+#include <string>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
 #include <boost/pool/object_pool.hpp>
@@ -41,6 +42,7 @@ using namespace boost;
 
 class Session;
 class Process;
+class ProcessFdKeeperClient;
 
 
 /**
@@ -67,6 +69,21 @@ public:
 
 	SpawningKit::FactoryPtr spawningKitFactory;
 	Json::Value agentConfig;
+	/**
+	 * The Watchdog's keeper of application process pipes. May be NULL, in
+	 * which case application processes won't survive a Core crash.
+	 */
+	boost::shared_ptr<ProcessFdKeeperClient> processFdKeeper;
+
+
+	/****** Configuration ******/
+
+	/**
+	 * Where the Pool periodically writes a snapshot of its groups and
+	 * processes, so that a restarted Core can re-adopt the processes.
+	 * Empty if snapshotting is disabled.
+	 */
+	std::string poolSnapshotPath;
 
 
 	Context()
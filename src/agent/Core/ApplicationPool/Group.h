@@ -225,6 +225,9 @@ public:
 	Process *findProcessWithStickySessionIdOrLowestBusyness(unsigned int id) const;
 	Process *findProcessWithLowestBusyness(const ProcessList &processes) const;
 	Process *findEnabledProcessWithLowestBusyness() const;
+	Process *findEnabledProcessByTwoRandomChoices() const;
+	OXT_FORCE_INLINE int getRoutingBusyness(const Process *process) const;
+	void refreshRoutingBusynessLevels(unsigned long long now);
 
 	void addProcessToList(const ProcessPtr &process, ProcessList &destination);
 	void removeProcessFromList(const ProcessPtr &process, ProcessList &source);
@@ -264,9 +267,12 @@ public:
 	unsigned int generateStickySessionId();
 	ProcessPtr createNullProcessObject();
 	ProcessPtr createProcessObject(const SpawningKit::Spawner &spawner, const SpawningKit::Result &spawnResult);
+	ProcessPtr createAdoptedProcessObject(const Json::Value &args,
+		const FileDescriptor &input, const FileDescriptor &output);
 	bool poolAtFullCapacity() const;
 	ProcessPtr poolForceFreeCapacity(const Group *exclude, boost::container::vector<Callback> &postLockActions);
 	void wakeUpGarbageCollector();
+	void wakeUpSnapshotWriter();
 	bool anotherGroupIsWaitingForCapacity() const;
 	Group *findOtherGroupWaitingForCapacity() const;
 	bool pushGetWaiter(const Options &newOptions, const GetCallback &callback,
@@ -292,6 +298,13 @@ public:
 	 * restarts. This information is public.
 	 */
 	string uuid;
+	/** The parsed form of `options.routingPolicy`. Never RP_UNKNOWN. */
+	RoutingPolicy routingPolicy;
+	/**
+	 * When `enabledProcessBusynessLevels` was last recalculated by
+	 * `refreshRoutingBusynessLevels()`.
+	 */
+	unsigned long long lastRoutingBusynessRefresh;
 
 	/**
 	 * Processes are categorized as enabled, disabling or disabled.
@@ -362,9 +375,9 @@ public:
 	ProcessList detachedProcesses;
 
 	/**
-	 * A cache of the processes' busyness. It's in a compact structure
-	 * so that `findProcessWithLowestBusyness()` can work very quickly
-	 * when there are a large number of processes.
+	 * A cache of the processes' busyness, as calculated by `getRoutingBusyness()`.
+	 * It's in a compact structure so that `findProcessWithLowestBusyness()` can
+	 * work very quickly when there are a large number of processes.
 	 */
 	boost::container::vector<int> enabledProcessBusynessLevels;
 
@@ -474,14 +487,14 @@ public:
 	bool processLowerLimitsSatisfied() const;
 	bool processUpperLimitsReached() const;
 	bool allEnabledProcessesAreTotallyBusy() const;
+	bool canRouteImmediately(const Options &options) const;
 
 	unsigned int capacityUsed() const;
 	bool isWaitingForCapacity() const;
 	bool garbageCollectable(unsigned long long now = 0) const;
 
-	void inspectXml(std::ostream &stream, bool includeSecrets = true) const;
-	void inspectPropertiesInAdminPanelFormat(Json::Value &result) const;
-	void inspectConfigInAdminPanelFormat(Json::Value &result) const;
+	void captureInspectionSnapshot(GroupInspectionSnapshot &snapshot,
+		bool includeProcesses = true, bool includeSecrets = false) const;
 
 	/****** Out-of-band work ******/
 
@@ -98,7 +98,9 @@ Group::finishShutdown(boost::container::vector<Callback> &postLockActions) {
 
 Group::Group(Pool *_pool, const Options &_options)
 	: pool(_pool),
-	  uuid(generateUuid(_pool))
+	  uuid(generateUuid(_pool)),
+	  routingPolicy(RP_LEAST_BUSY),
+	  lastRoutingBusynessRefresh(0)
 {
 	info.context = _pool->getContext();
 	info.group   = this;
@@ -77,6 +77,21 @@ Group::resetOptions(const Options &newOptions, Options *destination) {
 	destination->clearPerRequestFields();
 	destination->apiKey    = getApiKey().toStaticString();
 	destination->groupUuid = uuid;
+
+	if (destination == &this->options) {
+		RoutingPolicy newRoutingPolicy = parseRoutingPolicy(options.routingPolicy);
+		if (newRoutingPolicy == RP_UNKNOWN) {
+			P_WARN("Group " << info.name << ": unknown routing policy '"
+				<< options.routingPolicy << "', using 'least_busy' instead");
+			newRoutingPolicy = RP_LEAST_BUSY;
+		}
+		if (newRoutingPolicy != routingPolicy) {
+			routingPolicy = newRoutingPolicy;
+			for (unsigned int i = 0; i < enabledProcessBusynessLevels.size(); i++) {
+				enabledProcessBusynessLevels[i] = getRoutingBusyness(enabledProcesses[i].get());
+			}
+		}
+	}
 }
 
 /**
@@ -220,6 +235,46 @@ Group::createProcessObject(const SpawningKit::Spawner &spawner,
 	return ProcessPtr(process, false);
 }
 
+/**
+ * Recreates a Process object for an application process that was spawned by
+ * a previous Core instance. `args` is in the format returned by
+ * Process::inspectForSnapshot().
+ */
+ProcessPtr
+Group::createAdoptedProcessObject(const Json::Value &args,
+	const FileDescriptor &input, const FileDescriptor &output)
+{
+	struct Guard {
+		Context *context;
+		Process *process;
+
+		Guard(Context *c, Process *s)
+			: context(c),
+			  process(s)
+			{ }
+
+		~Guard() {
+			if (process != NULL) {
+				context->processObjectPool.free(process);
+			}
+		}
+
+		void clear() {
+			process = NULL;
+		}
+	};
+
+	Context *context = getContext();
+	LockGuard l(context->memoryManagementSyncher);
+	Process *process = context->processObjectPool.malloc();
+	Guard guard(context, process);
+	process = new (process) Process(&info, args);
+	guard.clear();
+	ProcessPtr result(process, false);
+	result->adoptPipes(input, output, args);
+	return result;
+}
+
 bool
 Group::poolAtFullCapacity() const {
 	return getPool()->atFullCapacityUnlocked();
@@ -237,6 +292,11 @@ Group::wakeUpGarbageCollector() {
 	getPool()->garbageCollectionCond.notify_all();
 }
 
+void
+Group::wakeUpSnapshotWriter() {
+	getPool()->wakeupSnapshotWriter();
+}
+
 bool
 Group::anotherGroupIsWaitingForCapacity() const {
 	return findOtherGroupWaitingForCapacity() != NULL;
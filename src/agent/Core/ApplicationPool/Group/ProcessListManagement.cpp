@@ -125,6 +125,71 @@ Group::findEnabledProcessWithLowestBusyness() const {
 	return enabledProcesses[leastBusyProcessIndex].get();
 }
 
+/**
+ * Picks two distinct enabled processes at random and returns the less busy
+ * one. Falls back to `findEnabledProcessWithLowestBusyness()` when there are
+ * too few processes to choose from, or when the chosen process is totally
+ * busy, so that we only report "all processes busy" if that is actually true.
+ */
+Process *
+Group::findEnabledProcessByTwoRandomChoices() const {
+	unsigned int size = enabledProcessBusynessLevels.size();
+	if (size <= 2) {
+		return findEnabledProcessWithLowestBusyness();
+	}
+
+	unsigned int i = rand() % size;
+	unsigned int j = rand() % (size - 1);
+	if (j >= i) {
+		j++;
+	}
+	if (enabledProcessBusynessLevels[j] < enabledProcessBusynessLevels[i]) {
+		i = j;
+	}
+
+	Process *process = enabledProcesses[i].get();
+	if (process->isTotallyBusy()) {
+		return findEnabledProcessWithLowestBusyness();
+	} else {
+		return process;
+	}
+}
+
+/**
+ * Returns the busyness value by which `route()` compares enabled processes,
+ * which depends on the routing policy.
+ */
+OXT_FORCE_INLINE int
+Group::getRoutingBusyness(const Process *process) const {
+	if (routingPolicy == RP_RESPONSE_TIME) {
+		return process->responseTimeWeightedBusyness(SystemTime::getUsec());
+	} else {
+		return process->busyness();
+	}
+}
+
+/**
+ * With the 'response_time' routing policy, a process's busyness level decays
+ * over time, but its cached value in `enabledProcessBusynessLevels` is only
+ * updated when one of its sessions is opened or closed. So an idle process
+ * that was slow once would never be picked again. This recalculates the
+ * levels of all enabled processes, at most once every 100 ms.
+ */
+void
+Group::refreshRoutingBusynessLevels(unsigned long long now) {
+	if (routingPolicy != RP_RESPONSE_TIME
+	 || now < lastRoutingBusynessRefresh + 100000)
+	{
+		return;
+	}
+
+	lastRoutingBusynessRefresh = now;
+	for (unsigned int i = 0; i < enabledProcessBusynessLevels.size(); i++) {
+		enabledProcessBusynessLevels[i] =
+			enabledProcesses[i]->responseTimeWeightedBusyness(now);
+	}
+}
+
 /**
  * Adds a process to the given list (enabledProcess, disablingProcesses, disabledProcesses)
  * and sets the process->enabled flag accordingly.
@@ -138,7 +203,7 @@ Group::addProcessToList(const ProcessPtr &process, ProcessList &destination) {
 	if (&destination == &enabledProcesses) {
 		process->enabled = Process::ENABLED;
 		enabledCount++;
-		enabledProcessBusynessLevels.push_back(process->busyness());
+		enabledProcessBusynessLevels.push_back(getRoutingBusyness(process.get()));
 		if (process->isTotallyBusy()) {
 			nEnabledProcessesTotallyBusy++;
 		}
@@ -153,7 +218,9 @@ Group::addProcessToList(const ProcessPtr &process, ProcessList &destination) {
 		assert(process->isAlive());
 		process->enabled = Process::DETACHED;
 
-		if (!this->options.abortWebsocketsOnProcessShutdown && this->options.appType == P_STATIC_STRING("node")) {
+		if (!this->options.abortWebsocketsOnProcessShutdown && this->options.appType == P_STATIC_STRING("node")
+		 && !process->handedOver)
+		{
 			// When Passenger is not allowed to abort websockets the application needs a way to know graceful shutdown
 			// is in progress. The solution for the most common use (Node.js) is to send a SIGINT. This is the general
 			// termination signal for Node; later versions of pm2 also use it (with a 1.6 sec grace period, Passenger just waits)
@@ -212,7 +279,7 @@ Group::removeProcessFromList(const ProcessPtr &process, ProcessList &source) {
 		enabledProcessBusynessLevels.clear();
 		for (it = source.begin(); it != end; it++, i++) {
 			const ProcessPtr &process = *it;
-			enabledProcessBusynessLevels.push_back(process->busyness());
+			enabledProcessBusynessLevels.push_back(getRoutingBusyness(process.get()));
 		}
 		enabledProcessBusynessLevels.shrink_to_fit();
 	}
@@ -417,13 +484,22 @@ Group::attach(const ProcessPtr &process,
 		return AR_ANOTHER_GROUP_IS_WAITING_FOR_CAPACITY;
 	}
 
-	process->initializeStickySessionId(generateStickySessionId());
+	// Re-adopted processes keep their old sticky session ID if possible.
+	if (process->getStickySessionId() == 0
+	 || findProcessWithStickySessionId(process->getStickySessionId()) != NULL)
+	{
+		process->initializeStickySessionId(generateStickySessionId());
+	}
 	if (options.forceMaxConcurrentRequestsPerProcess != -1) {
 		process->forceMaxConcurrency(options.forceMaxConcurrentRequestsPerProcess);
 	}
 
 	P_DEBUG("Attaching process " << process->inspect());
 	addProcessToList(process, enabledProcesses);
+	// This only queues a message to the Watchdog. It's done under the
+	// lock so that it's always queued before the release in
+	// Process::triggerShutdown().
+	process->keepPipes();
 
 	/* Now that there are enough resources, relevant processes in
 	 * 'disableWaitlist' can be disabled.
@@ -455,6 +531,7 @@ Group::attach(const ProcessPtr &process,
 
 	// Update GC sleep timer.
 	wakeUpGarbageCollector();
+	wakeUpSnapshotWriter();
 
 	postLockActions.push_back(boost::bind(&Group::runAttachHooks, this, process));
 
@@ -498,6 +575,7 @@ Group::detach(const ProcessPtr &process, boost::container::vector<Callback> &pos
 
 	addProcessToList(process, detachedProcesses);
 	startCheckingDetachedProcesses(false);
+	wakeUpSnapshotWriter();
 
 	postLockActions.push_back(boost::bind(&Group::runDetachHooks, this, process));
 }
@@ -531,6 +609,7 @@ Group::detachAll(boost::container::vector<Callback> &postLockActions) {
 	nEnabledProcessesTotallyBusy = 0;
 	clearDisableWaitlist(DR_NOOP, postLockActions);
 	startCheckingDetachedProcesses(false);
+	wakeUpSnapshotWriter();
 }
 
 /**
@@ -53,12 +53,21 @@ using namespace boost;
  * If there are no enabled process, then waiting for one to spawn is too
  * expensive. The next best thing is to route to disabling processes
  * until more processes have been spawned.
+ *
+ * Which enabled process is considered the least busy depends on the
+ * routing policy; see `getRoutingBusyness()`. With the 'two_random_choices'
+ * policy we only compare two randomly sampled enabled processes.
  */
 Group::RouteResult
 Group::route(const Options &options) const {
 	if (OXT_LIKELY(enabledCount > 0)) {
 		if (options.stickySessionId == 0) {
-			Process *process = findEnabledProcessWithLowestBusyness();
+			Process *process;
+			if (routingPolicy == RP_TWO_RANDOM_CHOICES) {
+				process = findEnabledProcessByTwoRandomChoices();
+			} else {
+				process = findEnabledProcessWithLowestBusyness();
+			}
 			if (process->canBeRoutedTo()) {
 				return RouteResult(process);
 			} else {
@@ -94,7 +103,7 @@ Group::newSession(Process *process, unsigned long long now) {
 	session->onInitiateFailure = _onSessionInitiateFailure;
 	session->onClose   = _onSessionClose;
 	if (process->enabled == Process::ENABLED) {
-		enabledProcessBusynessLevels[process->getIndex()] = process->busyness();
+		enabledProcessBusynessLevels[process->getIndex()] = getRoutingBusyness(process);
 		if (!wasTotallyBusy && process->isTotallyBusy()) {
 			nEnabledProcessesTotallyBusy++;
 		}
@@ -159,7 +168,7 @@ Group::onSessionClose(Process *process, Session *session) {
 		|| process->enabled == Process::DISABLING
 		|| process->enabled == Process::DETACHED);
 	if (process->enabled == Process::ENABLED) {
-		enabledProcessBusynessLevels[process->getIndex()] = process->busyness();
+		enabledProcessBusynessLevels[process->getIndex()] = getRoutingBusyness(process);
 		if (wasTotallyBusy) {
 			assert(nEnabledProcessesTotallyBusy >= 1);
 			nEnabledProcessesTotallyBusy--;
@@ -316,6 +325,9 @@ Group::get(const Options &newOptions, const GetCallback &callback,
 		}
 		return SessionPtr();
 	} else {
+		refreshRoutingBusynessLevels(newOptions.currentTime != 0
+			? newOptions.currentTime
+			: SystemTime::getUsec());
 		RouteResult result = route(newOptions);
 		if (result.process == NULL) {
 			/* Looks like all processes are totally busy.
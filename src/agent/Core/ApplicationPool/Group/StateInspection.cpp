@@ -85,6 +85,20 @@ Group::allEnabledProcessesAreTotallyBusy() const {
 	return nEnabledProcessesTotallyBusy == enabledCount && enabledCount > 0;
 }
 
+/**
+ * Returns whether a get() action with the given options would currently be
+ * satisfied right away by an enabled process, instead of being put on the
+ * wait list. This is only a hint: the answer may be outdated by the time
+ * the get() action is performed.
+ */
+bool
+Group::canRouteImmediately(const Options &options) const {
+	return enabledCount > 0
+		&& getWaitlist.empty()
+		&& !restarting()
+		&& route(options).process != NULL;
+}
+
 /**
  * Returns the number of processes in this group that should be part of the
  * ApplicationPool process limits calculations.
@@ -120,47 +134,92 @@ Group::garbageCollectable(unsigned long long now) const {
 	return false;
 }
 
+/**
+ * Copies the state that the state inspection functions render. The caller
+ * must hold the pool lock; rendering may happen after releasing it.
+ * Process socket addresses are only included if `includeSecrets` is true.
+ */
 void
-Group::inspectXml(std::ostream &stream, bool includeSecrets) const {
+Group::captureInspectionSnapshot(GroupInspectionSnapshot &snapshot,
+	bool includeProcesses, bool includeSecrets) const
+{
 	ProcessList::const_iterator it;
 
-	stream << "<name>" << escapeForXml(info.name) << "</name>";
-	stream << "<component_name>" << escapeForXml(info.name) << "</component_name>";
+	snapshot.name = info.name;
+	snapshot.uuid = uuid;
+	snapshot.enabledCount = enabledCount;
+	snapshot.disablingCount = disablingCount;
+	snapshot.disabledCount = disabledCount;
+	snapshot.capacityUsed = capacityUsed();
+	snapshot.getWaitlistSize = getWaitlist.size();
+	snapshot.disableWaitlistSize = disableWaitlist.size();
+	snapshot.processesBeingSpawned = processesBeingSpawned;
+	snapshot.spawning = m_spawning;
+	snapshot.restarting = restarting();
+	snapshot.apiKey = getApiKey().toStaticString();
+
+	LifeStatus lifeStatus = (LifeStatus) this->lifeStatus.load(boost::memory_order_relaxed);
+	switch (lifeStatus) {
+	case ALIVE:
+		snapshot.lifeStatus = P_STATIC_STRING("ALIVE");
+		break;
+	case SHUTTING_DOWN:
+		snapshot.lifeStatus = P_STATIC_STRING("SHUTTING_DOWN");
+		break;
+	case SHUT_DOWN:
+		snapshot.lifeStatus = P_STATIC_STRING("SHUT_DOWN");
+		break;
+	default:
+		P_BUG("Unknown 'lifeStatus' state " << lifeStatus);
+	}
+
+	snapshot.options = options.copyAndPersist();
+	snapshot.resourceLocator = &getResourceLocator();
+
+	if (includeProcesses) {
+		const ProcessList *lists[] = { &enabledProcesses, &disablingProcesses,
+			&disabledProcesses, &detachedProcesses };
+
+		snapshot.processes.reserve(enabledProcesses.size() + disablingProcesses.size()
+			+ disabledProcesses.size() + detachedProcesses.size());
+		for (unsigned int i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) {
+			for (it = lists[i]->begin(); it != lists[i]->end(); it++) {
+				snapshot.processes.push_back(ProcessInspectionSnapshot());
+				(*it)->captureInspectionSnapshot(snapshot.processes.back(),
+					includeSecrets);
+			}
+		}
+	}
+}
+
+void
+GroupInspectionSnapshot::toXml(std::ostream &stream, bool includeSecrets) const {
+	vector<ProcessInspectionSnapshot>::const_iterator it;
+
+	stream << "<name>" << escapeForXml(name) << "</name>";
+	stream << "<component_name>" << escapeForXml(name) << "</component_name>";
 	stream << "<app_root>" << escapeForXml(options.appRoot) << "</app_root>";
 	stream << "<app_type>" << escapeForXml(options.appType) << "</app_type>";
 	stream << "<environment>" << escapeForXml(options.environment) << "</environment>";
-	stream << "<uuid>" << toString(uuid) << "</uuid>";
+	stream << "<uuid>" << uuid << "</uuid>";
 	stream << "<enabled_process_count>" << enabledCount << "</enabled_process_count>";
 	stream << "<disabling_process_count>" << disablingCount << "</disabling_process_count>";
 	stream << "<disabled_process_count>" << disabledCount << "</disabled_process_count>";
-	stream << "<capacity_used>" << capacityUsed() << "</capacity_used>";
-	stream << "<get_wait_list_size>" << getWaitlist.size() << "</get_wait_list_size>";
-	stream << "<disable_wait_list_size>" << disableWaitlist.size() << "</disable_wait_list_size>";
+	stream << "<capacity_used>" << capacityUsed << "</capacity_used>";
+	stream << "<get_wait_list_size>" << getWaitlistSize << "</get_wait_list_size>";
+	stream << "<disable_wait_list_size>" << disableWaitlistSize << "</disable_wait_list_size>";
 	stream << "<processes_being_spawned>" << processesBeingSpawned << "</processes_being_spawned>";
-	if (m_spawning) {
+	if (spawning) {
 		stream << "<spawning/>";
 	}
-	if (restarting()) {
+	if (restarting) {
 		stream << "<restarting/>";
 	}
 	if (includeSecrets) {
-		stream << "<secret>" << escapeForXml(getApiKey().toStaticString()) << "</secret>";
-		stream << "<api_key>" << escapeForXml(getApiKey().toStaticString()) << "</api_key>";
-	}
-	LifeStatus lifeStatus = (LifeStatus) this->lifeStatus.load(boost::memory_order_relaxed);
-	switch (lifeStatus) {
-	case ALIVE:
-		stream << "<life_status>ALIVE</life_status>";
-		break;
-	case SHUTTING_DOWN:
-		stream << "<life_status>SHUTTING_DOWN</life_status>";
-		break;
-	case SHUT_DOWN:
-		stream << "<life_status>SHUT_DOWN</life_status>";
-		break;
-	default:
-		P_BUG("Unknown 'lifeStatus' state " << lifeStatus);
+		stream << "<secret>" << escapeForXml(apiKey) << "</secret>";
+		stream << "<api_key>" << escapeForXml(apiKey) << "</api_key>";
 	}
+	stream << "<life_status>" << lifeStatus << "</life_status>";
 
 	SpawningKit::UserSwitchingInfo usInfo(SpawningKit::prepareUserSwitching(options));
 	stream << "<user>" << escapeForXml(usInfo.username) << "</user>";
@@ -169,40 +228,23 @@ Group::inspectXml(std::ostream &stream, bool includeSecrets) const {
 	stream << "<gid>" << usInfo.gid << "</gid>";
 
 	stream << "<options>";
-	options.toXml(stream, getResourceLocator());
+	options.toXml(stream, *resourceLocator);
 	stream << "</options>";
 
 	stream << "<processes>";
-
-	for (it = enabledProcesses.begin(); it != enabledProcesses.end(); it++) {
+	for (it = processes.begin(); it != processes.end(); it++) {
 		stream << "<process>";
-		(*it)->inspectXml(stream, includeSecrets);
+		it->toXml(stream);
 		stream << "</process>";
 	}
-	for (it = disablingProcesses.begin(); it != disablingProcesses.end(); it++) {
-		stream << "<process>";
-		(*it)->inspectXml(stream, includeSecrets);
-		stream << "</process>";
-	}
-	for (it = disabledProcesses.begin(); it != disabledProcesses.end(); it++) {
-		stream << "<process>";
-		(*it)->inspectXml(stream, includeSecrets);
-		stream << "</process>";
-	}
-	for (it = detachedProcesses.begin(); it != detachedProcesses.end(); it++) {
-		stream << "<process>";
-		(*it)->inspectXml(stream, includeSecrets);
-		stream << "</process>";
-	}
-
 	stream << "</processes>";
 }
 
 void
-Group::inspectPropertiesInAdminPanelFormat(Json::Value &result) const {
+GroupInspectionSnapshot::inspectPropertiesInAdminPanelFormat(Json::Value &result) const {
 	result["path"] = absolutizePath(options.appRoot);
 	result["startup_file"] = absolutizePath(options.getStartupFile(), absolutizePath(options.appRoot));
-	result["start_command"] = options.getStartCommand(getResourceLocator());
+	result["start_command"] = options.getStartCommand(*resourceLocator);
 
 	if (options.appType == "rack") {
 		result["type"] = "ruby";
@@ -226,13 +268,13 @@ Group::inspectPropertiesInAdminPanelFormat(Json::Value &result) const {
 }
 
 void
-Group::inspectConfigInAdminPanelFormat(Json::Value &result) const {
+GroupInspectionSnapshot::inspectConfigInAdminPanelFormat(Json::Value &result) const {
 	#define VAL Pool::makeSingleValueJsonConfigFormat
 	#define SVAL Pool::makeSingleStrValueJsonConfigFormat
 	#define NON_EMPTY_SVAL Pool::makeSingleNonEmptyStrValueJsonConfigFormat
 
 	result["app_root"] = NON_EMPTY_SVAL(absolutizePath(options.appRoot));
-	result["app_group_name"] = NON_EMPTY_SVAL(info.name);
+	result["app_group_name"] = NON_EMPTY_SVAL(name);
 	result["default_user"] = NON_EMPTY_SVAL(options.defaultUser);
 	result["default_group"] = NON_EMPTY_SVAL(options.defaultGroup);
 	result["enabled"] = VAL(true, false);
@@ -255,6 +297,7 @@ Group::inspectConfigInAdminPanelFormat(Json::Value &result) const {
 		(Json::UInt) DEFAULT_MAX_PRELOADER_IDLE_TIME);
 	result["max_out_of_band_work_instances"] = VAL(options.maxOutOfBandWorkInstances,
 		(Json::UInt) 1);
+	result["routing_policy"] = SVAL(options.routingPolicy, DEFAULT_ROUTING_POLICY);
 	result["base_uri"] = SVAL(options.baseURI, P_STATIC_STRING("/"));
 	result["user"] = SVAL(options.user, options.defaultUser);
 	result["group"] = SVAL(options.group, options.defaultGroup);
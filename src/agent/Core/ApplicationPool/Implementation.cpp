@@ -53,6 +53,7 @@
 #include <Core/ApplicationPool/Pool/ProcessUtils.cpp>
 #include <Core/ApplicationPool/Pool/StateInspection.cpp>
 #include <Core/ApplicationPool/Pool/Miscellaneous.cpp>
+#include <Core/ApplicationPool/Pool/ProcessAdoption.cpp>
 #include <Core/ApplicationPool/Group/InitializationAndShutdown.cpp>
 #include <Core/ApplicationPool/Group/LifetimeAndBasics.cpp>
 #include <Core/ApplicationPool/Group/SessionManagement.cpp>
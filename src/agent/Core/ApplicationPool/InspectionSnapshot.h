@@ -0,0 +1,200 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2018 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_APPLICATION_POOL2_INSPECTION_SNAPSHOT_H_
+#define _PASSENGER_APPLICATION_POOL2_INSPECTION_SNAPSHOT_H_
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <sys/types.h>
+#include <StaticString.h>
+#include <ResourceLocator.h>
+#include <Utils.h>
+#include <Utils/StrIntUtils.h>
+#include <Utils/ProcessMetricsCollector.h>
+#include <Core/ApplicationPool/Options.h>
+
+namespace Passenger {
+namespace ApplicationPool2 {
+
+using namespace std;
+
+
+/*
+ * Copies of the pool, group and process state that the state inspection
+ * functions render. They are captured while holding the pool lock, but
+ * rendered after releasing it: formatting hundreds of processes (and
+ * looking up usernames) would otherwise block checkouts for milliseconds.
+ *
+ * Capturing only copies plain values and strings. Anything that is
+ * expensive to compute is derived while rendering.
+ */
+
+
+struct SocketInspectionSnapshot {
+	string address;
+	string protocol;
+	string description;
+	int concurrency;
+	bool acceptHttpRequests;
+	int sessions;
+
+	template<typename Stream>
+	void toXml(Stream &stream) const {
+		stream << "<socket>";
+		stream << "<address>" << escapeForXml(address) << "</address>";
+		stream << "<protocol>" << escapeForXml(protocol) << "</protocol>";
+		if (!description.empty()) {
+			stream << "<description>" << escapeForXml(description) << "</description>";
+		}
+		stream << "<concurrency>" << concurrency << "</concurrency>";
+		stream << "<accept_http_requests>" << acceptHttpRequests << "</accept_http_requests>";
+		stream << "<sessions>" << sessions << "</sessions>";
+		stream << "</socket>";
+	}
+};
+
+/** Captured by `Process::captureInspectionSnapshot()`. */
+struct ProcessInspectionSnapshot {
+	pid_t pid;
+	unsigned int stickySessionId;
+	string gupid;
+	int concurrency;
+	int sessions;
+	int busyness;
+	unsigned int processed;
+	bool responseTimeAverageAvailable;
+	unsigned long long responseTimeAverage;
+	unsigned long long spawnerCreationTime;
+	unsigned long long spawnStartTime;
+	unsigned long long spawnEndTime;
+	unsigned long long lastUsed;
+	string codeRevision;
+	/** Points to a string literal. */
+	StaticString lifeStatus;
+	/** Points to a string literal. */
+	StaticString enabled;
+	ProcessMetrics metrics;
+	bool includeSockets;
+	vector<SocketInspectionSnapshot> sockets;
+
+	template<typename Stream>
+	void toXml(Stream &stream) const {
+		stream << "<pid>" << pid << "</pid>";
+		stream << "<sticky_session_id>" << stickySessionId << "</sticky_session_id>";
+		stream << "<gupid>" << gupid << "</gupid>";
+		stream << "<concurrency>" << concurrency << "</concurrency>";
+		stream << "<sessions>" << sessions << "</sessions>";
+		stream << "<busyness>" << busyness << "</busyness>";
+		stream << "<processed>" << processed << "</processed>";
+		if (responseTimeAverageAvailable) {
+			stream << "<response_time_average>" << responseTimeAverage
+				<< "</response_time_average>";
+		}
+		stream << "<spawner_creation_time>" << spawnerCreationTime << "</spawner_creation_time>";
+		stream << "<spawn_start_time>" << spawnStartTime << "</spawn_start_time>";
+		stream << "<spawn_end_time>" << spawnEndTime << "</spawn_end_time>";
+		stream << "<last_used>" << lastUsed << "</last_used>";
+		stream << "<last_used_desc>" << distanceOfTimeInWords(lastUsed / 1000000).c_str() << " ago</last_used_desc>";
+		stream << "<uptime>" << distanceOfTimeInWords(spawnEndTime / 1000000) << "</uptime>";
+		if (!codeRevision.empty()) {
+			stream << "<code_revision>" << escapeForXml(codeRevision) << "</code_revision>";
+		}
+		stream << "<life_status>" << lifeStatus << "</life_status>";
+		stream << "<enabled>" << enabled << "</enabled>";
+		if (metrics.isValid()) {
+			stream << "<has_metrics>true</has_metrics>";
+			stream << "<cpu>" << (int) metrics.cpu << "</cpu>";
+			stream << "<rss>" << metrics.rss << "</rss>";
+			stream << "<pss>" << metrics.pss << "</pss>";
+			stream << "<private_dirty>" << metrics.privateDirty << "</private_dirty>";
+			stream << "<swap>" << metrics.swap << "</swap>";
+			stream << "<real_memory>" << metrics.realMemory() << "</real_memory>";
+			stream << "<vmsize>" << metrics.vmsize << "</vmsize>";
+			stream << "<process_group_id>" << metrics.processGroupId << "</process_group_id>";
+			stream << "<command>" << escapeForXml(metrics.command) << "</command>";
+		}
+		if (includeSockets) {
+			vector<SocketInspectionSnapshot>::const_iterator it;
+
+			stream << "<sockets>";
+			for (it = sockets.begin(); it != sockets.end(); it++) {
+				it->toXml(stream);
+			}
+			stream << "</sockets>";
+		}
+	}
+};
+
+/** Captured by `Group::captureInspectionSnapshot()`. */
+struct GroupInspectionSnapshot {
+	string name;
+	string uuid;
+	unsigned int enabledCount;
+	unsigned int disablingCount;
+	unsigned int disabledCount;
+	unsigned int capacityUsed;
+	unsigned int getWaitlistSize;
+	unsigned int disableWaitlistSize;
+	unsigned int processesBeingSpawned;
+	bool spawning;
+	bool restarting;
+	string apiKey;
+	/** Points to a string literal. */
+	StaticString lifeStatus;
+	/** A persisted copy of the group's options. */
+	Options options;
+	const ResourceLocator *resourceLocator;
+	/** Enabled, disabling, disabled and detached processes, in that order. */
+	vector<ProcessInspectionSnapshot> processes;
+
+	// Implemented in Group/StateInspection.cpp.
+	void toXml(std::ostream &stream, bool includeSecrets) const;
+	void inspectPropertiesInAdminPanelFormat(Json::Value &result) const;
+	void inspectConfigInAdminPanelFormat(Json::Value &result) const;
+};
+
+/** Captured by `Pool::captureInspectionSnapshot()`. */
+struct PoolInspectionSnapshot {
+	unsigned int groupCount;
+	unsigned int processCount;
+	unsigned int max;
+	unsigned int capacityUsed;
+	unsigned int getWaitlistSize;
+	/** Only filled if secrets were requested. */
+	vector<string> getWaitlistAppGroupNames;
+	/** Only the groups that the inspecting party is authorized to see. */
+	vector<GroupInspectionSnapshot> groups;
+
+	// Implemented in Pool/StateInspection.cpp.
+	void toXml(std::ostream &stream, bool includeSecrets) const;
+};
+
+
+} // namespace ApplicationPool2
+} // namespace Passenger
+
+#endif /* _PASSENGER_APPLICATION_POOL2_INSPECTION_SNAPSHOT_H_ */
@@ -30,9 +30,11 @@
 #include <vector>
 #include <utility>
 #include <boost/shared_array.hpp>
+#include <jsoncpp/json.h>
 #include <AppTypes.h>
 #include <DataStructures/HashedStaticString.h>
 #include <Constants.h>
+#include <Exceptions.h>
 #include <ResourceLocator.h>
 #include <StaticString.h>
 #include <FileTools/PathManip.h>
@@ -103,6 +105,7 @@ private:
 		result.push_back(&options.postexecChroot);
 
 		result.push_back(&options.integrationMode);
+		result.push_back(&options.routingPolicy);
 
 		result.push_back(&options.ruby);
 		result.push_back(&options.python);
@@ -353,6 +356,15 @@ public:
 	 */
 	bool abortWebsocketsOnProcessShutdown;
 
+	/**
+	 * How get() requests are routed among the Group's processes. Either
+	 * "least_busy" (route to the process with the fewest sessions relative
+	 * to its concurrency) or "response_time" (like "least_busy", but weighted
+	 * by each process's recent response time) or "two_random_choices"
+	 * (compare two randomly sampled processes and pick the less busy one).
+	 */
+	StaticString routingPolicy;
+
 	/*-----------------*/
 
 
@@ -453,6 +465,7 @@ public:
 		  maxOutOfBandWorkInstances(1),
 		  maxRequestQueueSize(DEFAULT_MAX_REQUEST_QUEUE_SIZE),
 		  abortWebsocketsOnProcessShutdown(true),
+		  routingPolicy(DEFAULT_ROUTING_POLICY, sizeof(DEFAULT_ROUTING_POLICY) - 1),
 
 		  stickySessionId(0),
 		  statThrottleRate(DEFAULT_STAT_THROTTLE_RATE),
@@ -524,6 +537,85 @@ public:
 		return *this;
 	}
 
+	/**
+	 * Serializes the options that a Group persists into a JSON document, for
+	 * use in pool snapshots (see Pool::createSnapshot()). The string fields
+	 * are stored in the order that getStringFields() returns them.
+	 */
+	Json::Value inspectForSnapshot() const {
+		Json::Value doc, strings(Json::arrayValue);
+		const vector<const StaticString *> fields =
+			getStringFields<const Options, const StaticString>(*this);
+		vector<const StaticString *>::const_iterator it;
+
+		for (it = fields.begin(); it != fields.end(); it++) {
+			strings.append((*it)->toString());
+		}
+		doc["strings"] = strings;
+		doc["log_level"] = logLevel;
+		doc["start_timeout"] = startTimeout;
+		doc["lve_min_uid"] = lveMinUid;
+		doc["file_descriptor_ulimit"] = fileDescriptorUlimit;
+		doc["force_max_concurrent_requests_per_process"] = forceMaxConcurrentRequestsPerProcess;
+		doc["debugger"] = debugger;
+		doc["load_shell_envvars"] = loadShellEnvvars;
+		doc["user_switching"] = userSwitching;
+		doc["min_processes"] = minProcesses;
+		doc["max_processes"] = maxProcesses;
+		doc["max_preloader_idle_time"] = (Json::Int64) maxPreloaderIdleTime;
+		doc["max_out_of_band_work_instances"] = maxOutOfBandWorkInstances;
+		doc["max_request_queue_size"] = maxRequestQueueSize;
+		doc["abort_websockets_on_process_shutdown"] = abortWebsocketsOnProcessShutdown;
+		doc["stat_throttle_rate"] = (Json::UInt64) statThrottleRate;
+		doc["max_requests"] = (Json::UInt64) maxRequests;
+		return doc;
+	}
+
+	/**
+	 * The inverse of inspectForSnapshot(). The string fields are persisted.
+	 *
+	 * @throws RuntimeException The document is not a valid snapshot.
+	 */
+	static Options createFromSnapshot(const Json::Value &doc) {
+		Options options;
+		const Json::Value &strings = doc["strings"];
+		vector<StaticString *> fields = getStringFields<Options, StaticString>(options);
+		vector<string> values;
+
+		if (!strings.isArray() || strings.size() != fields.size()) {
+			throw RuntimeException("Invalid options in pool snapshot");
+		}
+		values.reserve(fields.size());
+		for (unsigned int i = 0; i < fields.size(); i++) {
+			values.push_back(strings[i].asString());
+			*fields[i] = values.back();
+		}
+		// Assigning through StaticString pointers doesn't update the hashes.
+		options.appRoot = HashedStaticString(StaticString(options.appRoot));
+		options.appGroupName = HashedStaticString(StaticString(options.appGroupName));
+
+		options.logLevel = doc["log_level"].asInt();
+		options.startTimeout = doc["start_timeout"].asUInt();
+		options.lveMinUid = doc["lve_min_uid"].asUInt();
+		options.fileDescriptorUlimit = doc["file_descriptor_ulimit"].asUInt();
+		options.forceMaxConcurrentRequestsPerProcess =
+			doc["force_max_concurrent_requests_per_process"].asInt();
+		options.debugger = doc["debugger"].asBool();
+		options.loadShellEnvvars = doc["load_shell_envvars"].asBool();
+		options.userSwitching = doc["user_switching"].asBool();
+		options.minProcesses = doc["min_processes"].asUInt();
+		options.maxProcesses = doc["max_processes"].asUInt();
+		options.maxPreloaderIdleTime = (long) doc["max_preloader_idle_time"].asInt64();
+		options.maxOutOfBandWorkInstances = doc["max_out_of_band_work_instances"].asUInt();
+		options.maxRequestQueueSize = doc["max_request_queue_size"].asUInt();
+		options.abortWebsocketsOnProcessShutdown =
+			doc["abort_websockets_on_process_shutdown"].asBool();
+		options.statThrottleRate = (unsigned long) doc["stat_throttle_rate"].asUInt64();
+		options.maxRequests = (unsigned long) doc["max_requests"].asUInt64();
+
+		return options.copyAndPersist();
+	}
+
 	Options &clearPerRequestFields() {
 		hostName = StaticString();
 		uri      = StaticString();
@@ -582,6 +674,7 @@ public:
 			appendKeyValue3(vec, "max_processes",       maxProcesses);
 			appendKeyValue2(vec, "max_preloader_idle_time", maxPreloaderIdleTime);
 			appendKeyValue3(vec, "max_out_of_band_work_instances", maxOutOfBandWorkInstances);
+			appendKeyValue (vec, "routing_policy",      routingPolicy);
 		}
 
 		/*********************************/
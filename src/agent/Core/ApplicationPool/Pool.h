@@ -64,7 +64,9 @@
 #include <Core/ApplicationPool/Process.h>
 #include <Core/ApplicationPool/Group.h>
 #include <Core/ApplicationPool/Session.h>
+#include <Core/ApplicationPool/InspectionSnapshot.h>
 #include <Core/ApplicationPool/Options.h>
+#include <Core/ApplicationPool/ProcessFdKeeperClient.h>
 #include <Core/SpawningKit/Factory.h>
 #include <Shared/ApplicationPoolApiKey.h>
 
@@ -203,6 +205,7 @@ public:
 public:
 	friend class Group;
 	friend class Process;
+	friend struct GroupInspectionSnapshot;
 	friend struct tut::ApplicationPool2_PoolTest;
 
 	mutable boost::mutex syncher;
@@ -346,6 +349,34 @@ public:
 	void wakeupGarbageCollector();
 
 
+	/****** Process adoption ******/
+
+	boost::condition_variable snapshotWriterCond;
+	bool snapshotDirty;
+	/**
+	 * Set by prepareForReplacement(). From then on, the snapshot belongs to
+	 * the Core instance that replaces us, so we no longer write it.
+	 */
+	bool replaced;
+	/**
+	 * Held while creating and writing a snapshot, so that an older snapshot
+	 * can never overwrite a newer one. Acquired before `syncher`.
+	 */
+	boost::mutex snapshotFileSyncher;
+
+	void initializeSnapshotting();
+	static void snapshotWriterMain(PoolPtr self);
+	static void addProcessesToSnapshot(const ProcessList &processes, Json::Value &doc);
+	void writeSnapshot(const Json::Value &doc) const;
+	bool readSnapshot(Json::Value &doc) const;
+	static bool socketIsConnectable(const StaticString &address);
+	bool processIsAdoptable(const Json::Value &processDoc,
+		const ProcessFdKeeperClient::Entry &entry) const;
+	bool adoptProcess(const Json::Value &groupDoc, const Options &options,
+		const Json::Value &processDoc, const ProcessFdKeeperClient::Entry &entry);
+	void wakeupSnapshotWriter();
+
+
 	/****** General utilities ******/
 
 	static const char *maybeColorize(const InspectOptions &options, const char *color);
@@ -426,6 +457,10 @@ public:
 	bool atFullCapacityUnlocked() const;
 	void inspectProcessList(const InspectOptions &options, stringstream &result,
 		const Group *group, const ProcessList &processes) const;
+	void captureInspectionSnapshot(const ToXmlOptions &options,
+		PoolInspectionSnapshot &snapshot) const;
+	void captureInspectionSnapshot(const ToJsonOptions &options,
+		vector<GroupInspectionSnapshot> &groupSnapshots) const;
 
 public:
 	typedef void (*AbortLongRunningConnectionsCallback)(const ProcessPtr &process);
@@ -496,8 +531,17 @@ public:
 	void setMaxIdleTime(unsigned long long value);
 	void enableSelfChecking(bool enabled);
 	bool isSpawning(bool lock = true) const;
+	bool canRouteImmediately(const Options &options, bool lock = true) const;
 	bool authorizeByApiKey(const ApiKey &key, bool lock = true) const;
 	bool authorizeByUid(uid_t uid, bool lock = true) const;
+
+
+	/****** Process adoption ******/
+
+	Json::Value createSnapshot(bool lock = true) const;
+	unsigned int adoptProcesses();
+	void prepareForReplacement();
+	void abortReplacement();
 };
 
 
@@ -52,6 +52,8 @@ Pool::Pool(Context *_context)
 	max          = 6;
 	maxIdleTime  = 60 * 1000000;
 	selfchecking = true;
+	snapshotDirty = false;
+	replaced     = false;
 	palloc       = psg_create_pool(PSG_DEFAULT_POOL_SIZE);
 
 	// The following code only serve to instantiate certain inline methods
@@ -74,6 +76,9 @@ Pool::initialize() {
 	LockGuard l(syncher);
 	initializeAnalyticsCollection();
 	initializeGarbageCollection();
+	if (!context->poolSnapshotPath.empty()) {
+		initializeSnapshotting();
+	}
 }
 
 void
@@ -128,6 +133,10 @@ Pool::destroy() {
 	P_DEBUG("Shutting down ApplicationPool background threads...");
 	interruptableThreads.interrupt_and_join_all();
 	nonInterruptableThreads.join_all();
+	// We don't delete the pool snapshot here: after a graceful restart it
+	// belongs to the Core instance that replaced us. The processes that we
+	// didn't hand over to that instance have released their pipes, so they
+	// won't be re-adopted anyway.
 	lock.lock();
 
 	lifeStatus = SHUT_DOWN;
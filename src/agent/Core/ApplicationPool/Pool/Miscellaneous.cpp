@@ -224,6 +224,22 @@ Pool::isSpawning(bool lock) const {
 	return false;
 }
 
+/**
+ * Checks whether a get() action with the given options would currently be
+ * satisfied right away, without spawning a process or queueing the request.
+ * See `Group::canRouteImmediately()`.
+ */
+bool
+Pool::canRouteImmediately(const Options &options, bool lock) const {
+	DynamicScopedLock l(syncher, lock);
+	const GroupPtr *group;
+	if (groups.lookup(options.getAppGroupName(), &group)) {
+		return (*group)->canRouteImmediately(options);
+	} else {
+		return false;
+	}
+}
+
 bool
 Pool::authorizeByApiKey(const ApiKey &key, bool lock) const {
 	return key.isSuper() || findGroupByApiKey(key.toStaticString(), lock) != NULL;
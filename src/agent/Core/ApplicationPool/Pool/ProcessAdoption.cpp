@@ -0,0 +1,488 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2018 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#include <Core/ApplicationPool/Pool.h>
+#include <FileTools/FileManip.h>
+
+/*************************************************************************
+ *
+ * Pool snapshots and re-adoption of application processes after a Core
+ * restart, for ApplicationPool2::Pool
+ *
+ * While the Core runs, a background thread writes a snapshot of all groups
+ * and processes to Context::poolSnapshotPath whenever processes are
+ * attached or detached. The Watchdog holds on to the processes' stdin and
+ * output pipes (see ProcessFdKeeperClient), so application processes
+ * survive a Core crash. When the Watchdog restarts the Core, the Core reads
+ * the snapshot and re-adopts the processes that are still alive and whose
+ * sockets still accept connections, instead of spawning all of them anew.
+ * A graceful restart works the same way, except that the old Core writes a
+ * final snapshot and hands its processes over first (see
+ * prepareForReplacement()).
+ *
+ *************************************************************************/
+
+namespace Passenger {
+namespace ApplicationPool2 {
+
+using namespace std;
+using namespace boost;
+
+
+/****************************
+ *
+ * Private methods
+ *
+ ****************************/
+
+
+void
+Pool::initializeSnapshotting() {
+	interruptableThreads.create_thread(
+		boost::bind(snapshotWriterMain, shared_from_this()),
+		"Pool snapshot writer",
+		POOL_HELPER_THREAD_STACK_SIZE
+	);
+}
+
+void
+Pool::snapshotWriterMain(PoolPtr self) {
+	TRACE_POINT();
+	while (!this_thread::interruption_requested()) {
+		try {
+			UPDATE_TRACE_POINT();
+			{
+				ScopedLock lock(self->syncher);
+				while (!self->snapshotDirty) {
+					self->snapshotWriterCond.wait(lock);
+				}
+				self->snapshotDirty = false;
+			}
+
+			UPDATE_TRACE_POINT();
+			{
+				boost::lock_guard<boost::mutex> fileLock(self->snapshotFileSyncher);
+				Json::Value doc;
+				{
+					ScopedLock lock(self->syncher);
+					if (self->lifeStatus != ALIVE || self->replaced) {
+						continue;
+					}
+					doc = self->createSnapshot(false);
+				}
+				self->writeSnapshot(doc);
+			}
+
+			// Write at most 10 snapshots per second, even if many
+			// processes are being spawned or shut down.
+			this_thread::sleep(posix_time::milliseconds(100));
+		} catch (const thread_interrupted &) {
+			break;
+		} catch (const tracable_exception &e) {
+			P_WARN("ERROR: " << e.what() << "\n  Backtrace:\n" << e.backtrace());
+		}
+	}
+}
+
+void
+Pool::addProcessesToSnapshot(const ProcessList &processes, Json::Value &doc) {
+	ProcessList::const_iterator it, end = processes.end();
+	for (it = processes.begin(); it != end; it++) {
+		doc.append((*it)->inspectForSnapshot());
+	}
+}
+
+/**
+ * Writes the snapshot to a temporary file first, so that a crash in the
+ * middle of writing never leaves a truncated snapshot behind. The temporary
+ * file is named after our PID because during a graceful restart, two Core
+ * instances share the instance directory.
+ */
+void
+Pool::writeSnapshot(const Json::Value &doc) const {
+	string tmpPath = context->poolSnapshotPath + "." + toString(getpid()) + ".tmp";
+	createFile(tmpPath, doc.toStyledString(), S_IRUSR | S_IWUSR);
+	if (syscalls::rename(tmpPath.c_str(), context->poolSnapshotPath.c_str()) == -1) {
+		int e = errno;
+		throw FileSystemException("Cannot rename " + tmpPath + " to "
+			+ context->poolSnapshotPath, e, context->poolSnapshotPath);
+	}
+}
+
+bool
+Pool::readSnapshot(Json::Value &doc) const {
+	Json::Reader reader;
+	string contents;
+
+	try {
+		contents = unsafeReadFile(context->poolSnapshotPath);
+	} catch (const FileSystemException &e) {
+		if (e.code() != ENOENT) {
+			P_WARN("Cannot read the pool snapshot: " << e.what());
+		}
+		return false;
+	}
+
+	if (!reader.parse(contents, doc, false)) {
+		P_WARN("Cannot parse the pool snapshot " << context->poolSnapshotPath
+			<< ": " << reader.getFormattedErrorMessages());
+		return false;
+	} else if (!doc.isObject() || doc["version"].asUInt() != 1
+		|| !doc["groups"].isArray())
+	{
+		P_WARN("The pool snapshot " << context->poolSnapshotPath
+			<< " is in an unsupported format");
+		return false;
+	} else {
+		return true;
+	}
+}
+
+bool
+Pool::socketIsConnectable(const StaticString &address) {
+	NConnect_State state;
+	unsigned long long timeout = 1000000;
+	int fd;
+
+	try {
+		setupNonBlockingSocket(state, address, __FILE__, __LINE__);
+		if (connectToServer(state)) {
+			return true;
+		}
+
+		if (state.type == SAT_UNIX) {
+			fd = state.s_unix.fd;
+		} else {
+			fd = state.s_tcp.fd;
+		}
+		return waitUntilWritable(fd, &timeout) && connectToServer(state);
+	} catch (const SystemException &) {
+		return false;
+	} catch (const RuntimeException &) {
+		return false;
+	} catch (const ArgumentException &) {
+		return false;
+	}
+}
+
+/**
+ * Checks whether the process described by `processDoc` (from the snapshot)
+ * is the same one whose pipes the keeper gave us, whether it's still alive,
+ * and whether it still accepts connections.
+ */
+bool
+Pool::processIsAdoptable(const Json::Value &processDoc,
+	const ProcessFdKeeperClient::Entry &entry) const
+{
+	pid_t pid = (pid_t) processDoc["pid"].asInt();
+	const Json::Value &sockets = processDoc["sockets"];
+	Json::Value::const_iterator it;
+
+	if (pid != entry.pid) {
+		return false;
+	}
+	if (syscalls::kill(pid, 0) == -1 && errno == ESRCH) {
+		P_DEBUG("Not re-adopting process " << pid << ": it has exited");
+		return false;
+	}
+
+	// The const_cast here works around a jsoncpp bug.
+	for (it = const_cast<const Json::Value &>(sockets).begin(); it != sockets.end(); it++) {
+		if ((*it)["accept_http_requests"].asBool()
+		 && !socketIsConnectable((*it)["address"].asString()))
+		{
+			P_DEBUG("Not re-adopting process " << pid << ": its socket "
+				<< (*it)["address"].asString() << " does not accept connections");
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool
+Pool::adoptProcess(const Json::Value &groupDoc, const Options &options,
+	const Json::Value &processDoc, const ProcessFdKeeperClient::Entry &entry)
+{
+	TRACE_POINT();
+	boost::container::vector<Callback> actions;
+	ScopedLock lock(syncher);
+	GroupPtr group;
+	ProcessPtr process;
+
+	Group *existingGroup = findMatchingGroup(options);
+	if (existingGroup == NULL) {
+		group = createGroup(options);
+		// The app processes were given the old API key and group UUID
+		// when they were spawned.
+		try {
+			group->info.apiKey = ApiKey(groupDoc["api_key"].asString());
+		} catch (const ArgumentException &) {
+			// Keep the newly generated API key.
+		}
+		group->uuid = groupDoc["uuid"].asString();
+		group->resetOptions(group->options.copyAndPersist());
+	} else {
+		group = existingGroup->shared_from_this();
+	}
+
+	try {
+		process = group->createAdoptedProcessObject(processDoc, entry.input, entry.output);
+	} catch (const std::exception &e) {
+		P_WARN("Cannot re-adopt process " << entry.pid << ": " << e.what());
+		return false;
+	}
+
+	AttachResult result = group->attach(process, actions);
+	if (result != AR_OK) {
+		P_WARN("Cannot re-adopt process " << process->inspect()
+			<< ": the pool is at its capacity");
+		lock.unlock();
+		Process::forceTriggerShutdownAndCleanup(process);
+		return false;
+	}
+
+	P_DEBUG("Re-adopted process " << process->inspect());
+	fullVerifyInvariants();
+	lock.unlock();
+	runAllActions(actions);
+	return true;
+}
+
+
+/****************************
+ *
+ * Public methods
+ *
+ ****************************/
+
+
+/**
+ * Returns a compact description of all groups and their (non-detached)
+ * processes, from which a restarted Core can re-adopt the processes.
+ */
+Json::Value
+Pool::createSnapshot(bool lock) const {
+	DynamicScopedLock l(syncher, lock);
+	Json::Value doc, groupsDoc(Json::arrayValue);
+
+	GroupMap::ConstIterator g_it(groups);
+	while (*g_it != NULL) {
+		const GroupPtr &group = g_it.getValue();
+		Json::Value groupDoc, processesDoc(Json::arrayValue);
+
+		groupDoc["name"] = group->getName().toString();
+		groupDoc["uuid"] = group->uuid;
+		groupDoc["api_key"] = group->getApiKey().toStaticString().toString();
+		groupDoc["options"] = group->options.inspectForSnapshot();
+		addProcessesToSnapshot(group->enabledProcesses, processesDoc);
+		addProcessesToSnapshot(group->disablingProcesses, processesDoc);
+		addProcessesToSnapshot(group->disabledProcesses, processesDoc);
+		groupDoc["processes"] = processesDoc;
+		groupsDoc.append(groupDoc);
+
+		g_it.next();
+	}
+
+	doc["version"] = 1;
+	doc["groups"] = groupsDoc;
+	return doc;
+}
+
+/**
+ * Re-adopts the application processes that were spawned by the previous
+ * Core instance, based on the pool snapshot and on the pipes that the
+ * Watchdog held on to. Processes that can't be re-adopted are released,
+ * which makes them exit. Should be called right after initialize(), before
+ * the pool is used. Returns the number of re-adopted processes.
+ */
+unsigned int
+Pool::adoptProcesses() {
+	TRACE_POINT();
+	ProcessFdKeeperClient *keeper = context->processFdKeeper.get();
+	if (keeper == NULL || context->poolSnapshotPath.empty()) {
+		return 0;
+	}
+
+	vector<ProcessFdKeeperClient::Entry> entries = keeper->fetch();
+	map<string, const ProcessFdKeeperClient::Entry *> entriesByGupid;
+	map<string, const ProcessFdKeeperClient::Entry *>::iterator e_it;
+	Json::Value snapshot;
+	unsigned int adopted = 0;
+
+	if (entries.empty()) {
+		return 0;
+	}
+	foreach (const ProcessFdKeeperClient::Entry &entry, entries) {
+		entriesByGupid.insert(make_pair(entry.gupid, &entry));
+	}
+
+	UPDATE_TRACE_POINT();
+	if (readSnapshot(snapshot)) {
+		Json::Value::const_iterator g_it, g_end = snapshot["groups"].end();
+		for (g_it = snapshot["groups"].begin(); g_it != g_end; g_it++) {
+			const Json::Value &groupDoc = *g_it;
+			Options options;
+
+			try {
+				options = Options::createFromSnapshot(groupDoc["options"]);
+			} catch (const RuntimeException &e) {
+				P_WARN("Cannot re-adopt the processes in group "
+					<< groupDoc["name"].asString() << ": " << e.what());
+				continue;
+			}
+
+			Json::Value::const_iterator p_it, p_end = groupDoc["processes"].end();
+			for (p_it = groupDoc["processes"].begin(); p_it != p_end; p_it++) {
+				const Json::Value &processDoc = *p_it;
+				e_it = entriesByGupid.find(processDoc["gupid"].asString());
+				if (e_it == entriesByGupid.end()) {
+					continue;
+				}
+
+				const ProcessFdKeeperClient::Entry &entry = *e_it->second;
+				if (processIsAdoptable(processDoc, entry)
+				 && adoptProcess(groupDoc, options, processDoc, entry))
+				{
+					adopted++;
+					entriesByGupid.erase(e_it);
+				}
+			}
+		}
+	}
+
+	UPDATE_TRACE_POINT();
+	for (e_it = entriesByGupid.begin(); e_it != entriesByGupid.end(); e_it++) {
+		P_DEBUG("Releasing process " << e_it->second->pid
+			<< ", which could not be re-adopted");
+		keeper->release(e_it->first);
+	}
+
+	if (adopted > 0) {
+		P_NOTICE("Re-adopted " << adopted << " application "
+			<< maybePluralize(adopted, "process", "processes")
+			<< " from the previous " SHORT_PROGRAM_NAME " core instance");
+	}
+	if (!entriesByGupid.empty()) {
+		P_NOTICE(entriesByGupid.size() << " application "
+			<< maybePluralize(entriesByGupid.size(), "process", "processes")
+			<< " from the previous " SHORT_PROGRAM_NAME " core instance could not "
+			"be re-adopted; they will shut down");
+	}
+	return adopted;
+}
+
+/**
+ * Called when a new Core instance is about to replace this one by a graceful
+ * restart. Writes a final snapshot and stops writing snapshots, so that we
+ * don't overwrite the new instance's snapshot while we're draining our
+ * clients. Then tells the Watchdog's fd keeper that we're done, after all
+ * keep and release commands that are still queued.
+ *
+ * The processes in the final snapshot are handed over: the new instance
+ * adopts them, so from then on both instances route requests to them until
+ * we have drained. We no longer shut them down when we detach them. Processes
+ * that we spawn after this point remain ours.
+ */
+void
+Pool::prepareForReplacement() {
+	TRACE_POINT();
+	boost::lock_guard<boost::mutex> fileLock(snapshotFileSyncher);
+	ProcessFdKeeperClient *keeper = context->processFdKeeper.get();
+	Json::Value doc;
+
+	{
+		ScopedLock lock(syncher);
+		if (replaced) {
+			return;
+		}
+		replaced = true;
+		doc = createSnapshot(false);
+
+		vector<ProcessPtr> processes = getProcesses(false);
+		vector<ProcessPtr>::const_iterator it, end = processes.end();
+		for (it = processes.begin(); it != end; it++) {
+			(*it)->handedOver = true;
+		}
+	}
+
+	if (!context->poolSnapshotPath.empty()) {
+		UPDATE_TRACE_POINT();
+		try {
+			writeSnapshot(doc);
+		} catch (const tracable_exception &e) {
+			P_WARN("Cannot write the pool snapshot: " << e.what());
+		}
+	}
+	if (keeper != NULL) {
+		keeper->preparedForReplacement();
+	}
+}
+
+/**
+ * Undoes prepareForReplacement() if the new Core instance could not be
+ * started after all.
+ */
+void
+Pool::abortReplacement() {
+	TRACE_POINT();
+	ScopedLock lock(syncher);
+	if (!replaced) {
+		return;
+	}
+	replaced = false;
+
+	GroupMap::ConstIterator g_it(groups);
+	while (*g_it != NULL) {
+		const GroupPtr &group = g_it.getValue();
+		ProcessList::const_iterator p_it;
+
+		for (p_it = group->enabledProcesses.begin(); p_it != group->enabledProcesses.end(); p_it++) {
+			(*p_it)->handedOver = false;
+		}
+		for (p_it = group->disablingProcesses.begin(); p_it != group->disablingProcesses.end(); p_it++) {
+			(*p_it)->handedOver = false;
+		}
+		for (p_it = group->disabledProcesses.begin(); p_it != group->disabledProcesses.end(); p_it++) {
+			(*p_it)->handedOver = false;
+		}
+		for (p_it = group->detachedProcesses.begin(); p_it != group->detachedProcesses.end(); p_it++) {
+			(*p_it)->handedOver = false;
+		}
+
+		g_it.next();
+	}
+	wakeupSnapshotWriter();
+}
+
+void
+Pool::wakeupSnapshotWriter() {
+	snapshotDirty = true;
+	snapshotWriterCond.notify_all();
+}
+
+
+} // namespace ApplicationPool2
+} // namespace Passenger
@@ -189,87 +189,54 @@ Pool::inspect(const InspectOptions &options, bool lock) const {
 	return result.str();
 }
 
-string
-Pool::toXml(const ToXmlOptions &options, bool lock) const {
-	DynamicScopedLock l(syncher, lock);
-	stringstream result;
+/**
+ * Copies the state that `toXml()` renders. The caller must hold the lock.
+ */
+void
+Pool::captureInspectionSnapshot(const ToXmlOptions &options,
+	PoolInspectionSnapshot &snapshot) const
+{
 	GroupMap::ConstIterator g_it(groups);
-	ProcessList::const_iterator p_it;
 
-	if (!authorizeByUid(options.uid, false)
-	 && !authorizeByApiKey(options.apiKey, false))
-	{
-		throw SecurityException("Operation unauthorized");
-	}
-
-	result << "<?xml version=\"1.0\" encoding=\"iso8859-1\" ?>\n";
-	result << "<info version=\"3\">";
-
-	result << "<passenger_version>" << PASSENGER_VERSION << "</passenger_version>";
-	result << "<group_count>" << groups.size() << "</group_count>";
-	result << "<process_count>" << getProcessCount(false) << "</process_count>";
-	result << "<max>" << max << "</max>";
-	result << "<capacity_used>" << capacityUsedUnlocked() << "</capacity_used>";
-	result << "<get_wait_list_size>" << getWaitlist.size() << "</get_wait_list_size>";
+	snapshot.groupCount = groups.size();
+	snapshot.processCount = getProcessCount(false);
+	snapshot.max = max;
+	snapshot.capacityUsed = capacityUsedUnlocked();
+	snapshot.getWaitlistSize = getWaitlist.size();
 
 	if (options.secrets) {
 		vector<GetWaiter>::const_iterator w_it, w_end = getWaitlist.end();
 
-		result << "<get_wait_list>";
+		snapshot.getWaitlistAppGroupNames.reserve(getWaitlist.size());
 		for (w_it = getWaitlist.begin(); w_it != w_end; w_it++) {
-			const GetWaiter &waiter = *w_it;
-			result << "<item>";
-			result << "<app_group_name>" << escapeForXml(waiter.options.getAppGroupName()) << "</app_group_name>";
-			result << "</item>";
+			snapshot.getWaitlistAppGroupNames.push_back(
+				w_it->options.getAppGroupName());
 		}
-		result << "</get_wait_list>";
 	}
 
-	result << "<supergroups>";
+	snapshot.groups.reserve(groups.size());
 	while (*g_it != NULL) {
 		const GroupPtr &group = g_it.getValue();
-		if (!group->authorizeByUid(options.uid)
-		 && !group->authorizeByApiKey(options.apiKey))
+		if (group->authorizeByUid(options.uid)
+		 || group->authorizeByApiKey(options.apiKey))
 		{
-			g_it.next();
-			continue;
+			snapshot.groups.push_back(GroupInspectionSnapshot());
+			group->captureInspectionSnapshot(snapshot.groups.back(), true,
+				options.secrets);
 		}
-
-		result << "<supergroup>";
-		result << "<name>" << escapeForXml(group->getName()) << "</name>";
-		result << "<state>READY</state>";
-		result << "<get_wait_list_size>0</get_wait_list_size>";
-		result << "<capacity_used>" << group->capacityUsed() << "</capacity_used>";
-		if (options.secrets) {
-			result << "<secret>" << escapeForXml(group->getApiKey().toStaticString()) << "</secret>";
-		}
-
-		result << "<group default=\"true\">";
-		group->inspectXml(result, options.secrets);
-		result << "</group>";
-
-		result << "</supergroup>";
-
 		g_it.next();
 	}
-	result << "</supergroups>";
-
-	result << "</info>";
-	return result.str();
 }
 
-Json::Value
-Pool::inspectPropertiesInAdminPanelFormat(const ToJsonOptions &options) const {
-	ScopedLock l(syncher);
-	Json::Value result(Json::objectValue);
+/**
+ * Copies the group state that the admin panel inspection functions render.
+ * The caller must hold the lock.
+ */
+void
+Pool::captureInspectionSnapshot(const ToJsonOptions &options,
+	vector<GroupInspectionSnapshot> &groupSnapshots) const
+{
 	GroupMap::ConstIterator g_it(groups);
-	ProcessList::const_iterator p_it;
-
-	if (!authorizeByUid(options.uid, false)
-	 && !authorizeByApiKey(options.apiKey, false))
-	{
-		throw SecurityException("Operation unauthorized");
-	}
 
 	while (*g_it != NULL) {
 		const GroupPtr &group = g_it.getValue();
@@ -289,52 +256,138 @@ Pool::inspectPropertiesInAdminPanelFormat(const ToJsonOptions &options) const {
 			continue;
 		}
 
-		Json::Value groupDoc(Json::objectValue);
-		group->inspectPropertiesInAdminPanelFormat(groupDoc);
-		result[group->info.name] = groupDoc;
+		groupSnapshots.push_back(GroupInspectionSnapshot());
+		group->captureInspectionSnapshot(groupSnapshots.back(), false);
 
 		g_it.next();
 	}
+}
 
-	return result;
+/**
+ * Only holds the lock while capturing a snapshot of the state. The XML is
+ * rendered after releasing the lock, so that inspecting a large pool does
+ * not block checkouts.
+ */
+string
+Pool::toXml(const ToXmlOptions &options, bool lock) const {
+	PoolInspectionSnapshot snapshot;
+	stringstream result;
+
+	{
+		DynamicScopedLock l(syncher, lock);
+
+		if (!authorizeByUid(options.uid, false)
+		 && !authorizeByApiKey(options.apiKey, false))
+		{
+			throw SecurityException("Operation unauthorized");
+		}
+
+		captureInspectionSnapshot(options, snapshot);
+	}
+
+	snapshot.toXml(result, options.secrets);
+	return result.str();
+}
+
+void
+PoolInspectionSnapshot::toXml(std::ostream &stream, bool includeSecrets) const {
+	vector<GroupInspectionSnapshot>::const_iterator it;
+
+	stream << "<?xml version=\"1.0\" encoding=\"iso8859-1\" ?>\n";
+	stream << "<info version=\"3\">";
+
+	stream << "<passenger_version>" << PASSENGER_VERSION << "</passenger_version>";
+	stream << "<group_count>" << groupCount << "</group_count>";
+	stream << "<process_count>" << processCount << "</process_count>";
+	stream << "<max>" << max << "</max>";
+	stream << "<capacity_used>" << capacityUsed << "</capacity_used>";
+	stream << "<get_wait_list_size>" << getWaitlistSize << "</get_wait_list_size>";
+
+	if (includeSecrets) {
+		vector<string>::const_iterator w_it, w_end = getWaitlistAppGroupNames.end();
+
+		stream << "<get_wait_list>";
+		for (w_it = getWaitlistAppGroupNames.begin(); w_it != w_end; w_it++) {
+			stream << "<item>";
+			stream << "<app_group_name>" << escapeForXml(*w_it) << "</app_group_name>";
+			stream << "</item>";
+		}
+		stream << "</get_wait_list>";
+	}
+
+	stream << "<supergroups>";
+	for (it = groups.begin(); it != groups.end(); it++) {
+		const GroupInspectionSnapshot &group = *it;
+
+		stream << "<supergroup>";
+		stream << "<name>" << escapeForXml(group.name) << "</name>";
+		stream << "<state>READY</state>";
+		stream << "<get_wait_list_size>0</get_wait_list_size>";
+		stream << "<capacity_used>" << group.capacityUsed << "</capacity_used>";
+		if (includeSecrets) {
+			stream << "<secret>" << escapeForXml(group.apiKey) << "</secret>";
+		}
+
+		stream << "<group default=\"true\">";
+		group.toXml(stream, includeSecrets);
+		stream << "</group>";
+
+		stream << "</supergroup>";
+	}
+	stream << "</supergroups>";
+
+	stream << "</info>";
 }
 
 Json::Value
-Pool::inspectConfigInAdminPanelFormat(const ToJsonOptions &options) const {
-	ScopedLock l(syncher);
+Pool::inspectPropertiesInAdminPanelFormat(const ToJsonOptions &options) const {
+	vector<GroupInspectionSnapshot> groupSnapshots;
+	vector<GroupInspectionSnapshot>::const_iterator it;
 	Json::Value result(Json::objectValue);
-	GroupMap::ConstIterator g_it(groups);
-	ProcessList::const_iterator p_it;
 
-	if (!authorizeByUid(options.uid, false)
-	 && !authorizeByApiKey(options.apiKey, false))
 	{
-		throw SecurityException("Operation unauthorized");
+		ScopedLock l(syncher);
+
+		if (!authorizeByUid(options.uid, false)
+		 && !authorizeByApiKey(options.apiKey, false))
+		{
+			throw SecurityException("Operation unauthorized");
+		}
+
+		captureInspectionSnapshot(options, groupSnapshots);
 	}
 
-	while (*g_it != NULL) {
-		const GroupPtr &group = g_it.getValue();
+	for (it = groupSnapshots.begin(); it != groupSnapshots.end(); it++) {
+		Json::Value groupDoc(Json::objectValue);
+		it->inspectPropertiesInAdminPanelFormat(groupDoc);
+		result[it->name] = groupDoc;
+	}
 
-		if (options.hasApplicationIdsFilter) {
-			const bool *tmp;
-			if (!options.applicationIdsFilter.lookup(group->info.name, &tmp)) {
-				g_it.next();
-				continue;
-			}
-		}
+	return result;
+}
 
-		if (!group->authorizeByUid(options.uid)
-		 && !group->authorizeByApiKey(options.apiKey))
+Json::Value
+Pool::inspectConfigInAdminPanelFormat(const ToJsonOptions &options) const {
+	vector<GroupInspectionSnapshot> groupSnapshots;
+	vector<GroupInspectionSnapshot>::const_iterator it;
+	Json::Value result(Json::objectValue);
+
+	{
+		ScopedLock l(syncher);
+
+		if (!authorizeByUid(options.uid, false)
+		 && !authorizeByApiKey(options.apiKey, false))
 		{
-			g_it.next();
-			continue;
+			throw SecurityException("Operation unauthorized");
 		}
 
-		Json::Value groupDoc(Json::objectValue);
-		group->inspectConfigInAdminPanelFormat(groupDoc);
-		result[group->info.name] = groupDoc;
+		captureInspectionSnapshot(options, groupSnapshots);
+	}
 
-		g_it.next();
+	for (it = groupSnapshots.begin(); it != groupSnapshots.end(); it++) {
+		Json::Value groupDoc(Json::objectValue);
+		it->inspectConfigInAdminPanelFormat(groupDoc);
+		result[it->name] = groupDoc;
 	}
 
 	return result;
@@ -42,6 +42,7 @@
 #include <cstring>
 #include <Constants.h>
 #include <FileDescriptor.h>
+#include <Algorithms/MovingAverage.h>
 #include <LoggingKit/LoggingKit.h>
 #include <Utils/SystemTime.h>
 #include <Utils/StrIntUtils.h>
@@ -49,8 +50,10 @@
 #include <Utils/ProcessMetricsCollector.h>
 #include <Core/ApplicationPool/Common.h>
 #include <Core/ApplicationPool/Socket.h>
+#include <Core/ApplicationPool/InspectionSnapshot.h>
 #include <Core/ApplicationPool/Session.h>
 #include <Core/SpawningKit/PipeWatcher.h>
+#include <Core/ApplicationPool/ProcessFdKeeperClient.h>
 #include <Core/SpawningKit/Result.h>
 #include <Shared/ApplicationPoolApiKey.h>
 
@@ -95,6 +98,11 @@ typedef boost::container::vector<ProcessPtr> ProcessList;
  * OS process telling it to shut down. Once the OS process is gone, `cleanup()` is
  * called, and the Process object is removed from the collection.
  *
+ * After a graceful Core restart, the OS process may outlive the Process object:
+ * processes that were handed over to the new Core instance (see
+ * Pool::prepareForReplacement()) are left running when the old instance
+ * shuts them down.
+ *
  * This means that a Group outlives all its Processes, a Process outlives all
  * its Sessions, and a Process also outlives the OS process.
  */
@@ -300,6 +308,19 @@ private:
 		}
 	}
 
+	void watchOutputPipe(const Json::Value &args) {
+		if (outputPipe != -1) {
+			SpawningKit::PipeWatcherPtr watcher = boost::make_shared<SpawningKit::PipeWatcher>(
+				outputPipe, "output", getAppGroupName(info.groupInfo),
+				getAppLogFile(info.groupInfo), info.pid);
+			if (!args["log_file"].isNull()) {
+				watcher->setLogFile(args["log_file"].asString());
+			}
+			watcher->initialize();
+			watcher->start();
+		}
+	}
+
 	void indexSocketsAcceptingHttpRequests() {
 		SocketList::iterator it;
 
@@ -395,6 +416,9 @@ public:
 	int sessions;
 	/** Number of sessions opened so far. */
 	unsigned int processed;
+	/** Moving average of the time (in microseconds) that sessions stay open,
+	 * i.e. of this process's response time. Updated by sessionClosed(). */
+	DiscExpMovingAverage<500> responseTimeAverage;
 	/** Do not access directly, always use `isAlive()`/`isDead()`/`getLifeStatus()` or
 	 * through `lifetimeSyncher`. */
 	enum LifeStatus {
@@ -446,6 +470,13 @@ public:
 	/** Caches whether or not the OS process still exists. */
 	mutable bool m_osProcessExists: 1;
 	bool longRunningConnectionsAborted: 1;
+	/**
+	 * Whether this process was handed over to the Core instance that
+	 * replaces us by a graceful restart. If so, then shutting it down only
+	 * means that we stop using it; the new instance keeps it running.
+	 * Protected by the pool lock.
+	 */
+	bool handedOver;
 	/** Time at which shutdown began. */
 	time_t shutdownStartTime;
 	/** Collected by Pool::collectAnalytics(). */
@@ -470,6 +501,7 @@ public:
 		  oobwStatus(OOBW_NOT_ACTIVE),
 		  m_osProcessExists(true),
 		  longRunningConnectionsAborted(false),
+		  handedOver(false),
 		  shutdownStartTime(0)
 	{
 		initializeSocketsAndStringFields(args);
@@ -495,6 +527,7 @@ public:
 		  oobwStatus(OOBW_NOT_ACTIVE),
 		  m_osProcessExists(true),
 		  longRunningConnectionsAborted(false),
+		  handedOver(false),
 		  shutdownStartTime(0)
 	{
 		initializeSocketsAndStringFields(skResult);
@@ -502,17 +535,7 @@ public:
 
 		inputPipe = skResult.stdinFd;
 		outputPipe = skResult.stdoutAndErrFd;
-
-		if (outputPipe != -1) {
-			SpawningKit::PipeWatcherPtr watcher = boost::make_shared<SpawningKit::PipeWatcher>(
-				outputPipe, "output", getAppGroupName(groupInfo),
-				getAppLogFile(groupInfo), skResult.pid);
-			if (!args["log_file"].isNull()) {
-				watcher->setLogFile(args["log_file"].asString());
-			}
-			watcher->initialize();
-			watcher->start();
-		}
+		watchOutputPipe(args);
 	}
 
 	~Process() {
@@ -538,6 +561,30 @@ public:
 		requiresShutdown = false;
 	}
 
+	/**
+	 * Gives a process that's being re-adopted after a Core restart (see
+	 * Pool::adoptProcesses()) its stdin and output pipes back.
+	 */
+	void adoptPipes(const FileDescriptor &input, const FileDescriptor &output,
+		const Json::Value &args)
+	{
+		inputPipe = input;
+		outputPipe = output;
+		watchOutputPipe(args);
+	}
+
+	/**
+	 * Hands copies of the stdin and output pipes to the Watchdog, so that
+	 * this process survives a Core crash. This doesn't block: the pipes are
+	 * sent in the background. See ProcessFdKeeperClient.
+	 */
+	void keepPipes() const {
+		ProcessFdKeeperClient *keeper = getContext()->processFdKeeper.get();
+		if (keeper != NULL && inputPipe != -1 && outputPipe != -1) {
+			keeper->keep(getGupid(), getPid(), inputPipe, outputPipe);
+		}
+	}
+
 
 	/****** Memory and life time management ******/
 
@@ -604,8 +651,18 @@ public:
 			shutdownStartTime = now;
 		}
 		if (inputPipe != -1) {
+			ProcessFdKeeperClient *keeper = getContext()->processFdKeeper.get();
+			if (keeper != NULL) {
+				// Only queues a message to the Watchdog.
+				keeper->release(getGupid());
+			}
 			inputPipe.close();
 		}
+		if (handedOver) {
+			// The Core instance that replaced us keeps the OS process
+			// running, so there's nothing to wait for or to kill.
+			m_osProcessExists = false;
+		}
 	}
 
 	bool shutdownTimeoutExpired() const {
@@ -623,7 +680,7 @@ public:
 		if (!dummy) {
 			SocketList::iterator it, end = sockets.end();
 			for (it = sockets.begin(); it != end; it++) {
-				if (getSocketAddressType(it->address) == SAT_UNIX) {
+				if (!handedOver && getSocketAddressType(it->address) == SAT_UNIX) {
 					string filename = parseUnixSocketAddress(it->address);
 					syscalls::unlink(filename.c_str());
 				}
@@ -765,6 +822,42 @@ public:
 		}
 	}
 
+	/**
+	 * Like busyness(), but weighted by this process's recent response time.
+	 * The result approximates how long a new session would take to complete,
+	 * so that processes which are temporarily slow (e.g. because of a GC pause
+	 * or a noisy neighbor) are picked less often than processes which are
+	 * equally busy but fast.
+	 *
+	 * Just like with busyness(), a totally busy process has the highest
+	 * possible value, so that if the process with the lowest value is totally
+	 * busy, then all processes are.
+	 *
+	 * The response time average is decayed towards zero based on how long ago
+	 * `now` is since the last response. Otherwise a process that was slow once
+	 * would never be routed to again, and thus never get a chance to show that
+	 * it's fast again.
+	 */
+	int responseTimeWeightedBusyness(unsigned long long now) const {
+		if (isTotallyBusy()) {
+			return INT_MAX;
+		}
+
+		// Processes for which no response time is known yet are treated
+		// as if they respond in 1 ms.
+		double responseTime = 1000;
+		if (responseTimeAverage.available()) {
+			responseTime += responseTimeAverage.average(now);
+		}
+		double result = (sessions + 1) * responseTime
+			/ (concurrency > 1 ? concurrency : 1);
+		if (result >= INT_MAX - 1) {
+			return INT_MAX - 1;
+		} else {
+			return (int) result;
+		}
+	}
+
 	/**
 	 * Whether we've reached the maximum number of concurrent sessions for this
 	 * process.
@@ -806,7 +899,9 @@ public:
 			} else {
 				lastUsed = SystemTime::getUsec();
 			}
-			return createSessionObject(socket);
+			SessionPtr session = createSessionObject(socket);
+			session->checkoutTime = lastUsed;
+			return session;
 		}
 	}
 
@@ -850,6 +945,11 @@ public:
 		this->sessions--;
 		processed++;
 		assert(!isTotallyBusy());
+
+		unsigned long long now = SystemTime::getUsec();
+		if (session->checkoutTime != 0 && now > session->checkoutTime) {
+			responseTimeAverage.update(now - session->checkoutTime, now);
+		}
 	}
 
 	/**
@@ -866,83 +966,109 @@ public:
 		return result.str();
 	}
 
-	template<typename Stream>
-	void inspectXml(Stream &stream, bool includeSockets = true) const {
-		stream << "<pid>" << getPid() << "</pid>";
-		stream << "<sticky_session_id>" << getStickySessionId() << "</sticky_session_id>";
-		stream << "<gupid>" << getGupid() << "</gupid>";
-		stream << "<concurrency>" << concurrency << "</concurrency>";
-		stream << "<sessions>" << sessions << "</sessions>";
-		stream << "<busyness>" << busyness() << "</busyness>";
-		stream << "<processed>" << processed << "</processed>";
-		stream << "<spawner_creation_time>" << spawnerCreationTime << "</spawner_creation_time>";
-		stream << "<spawn_start_time>" << spawnStartTime << "</spawn_start_time>";
-		stream << "<spawn_end_time>" << spawnEndTime << "</spawn_end_time>";
-		stream << "<last_used>" << lastUsed << "</last_used>";
-		stream << "<last_used_desc>" << distanceOfTimeInWords(lastUsed / 1000000).c_str() << " ago</last_used_desc>";
-		stream << "<uptime>" << uptime() << "</uptime>";
+	/**
+	 * Describes this process in the format that the JSON constructor accepts,
+	 * so that a restarted Core can recreate it. See Pool::createSnapshot().
+	 */
+	Json::Value inspectForSnapshot() const {
+		Json::Value doc, socketsDoc(Json::arrayValue);
+		SocketList::const_iterator it;
+
+		doc["pid"] = (Json::Int) getPid();
+		doc["gupid"] = getGupid().toString();
+		doc["sticky_session_id"] = getStickySessionId();
+		doc["spawner_creation_time"] = (Json::UInt64) spawnerCreationTime;
+		doc["spawn_start_time"] = (Json::UInt64) spawnStartTime;
+		if (dummy) {
+			doc["type"] = "dummy";
+		}
 		if (!codeRevision.empty()) {
-			stream << "<code_revision>" << escapeForXml(codeRevision) << "</code_revision>";
+			doc["code_revision"] = codeRevision.toString();
 		}
+
+		for (it = sockets.begin(); it != sockets.end(); it++) {
+			Json::Value socketDoc;
+			socketDoc["address"] = it->address.toString();
+			socketDoc["protocol"] = it->protocol.toString();
+			socketDoc["description"] = it->description.toString();
+			socketDoc["concurrency"] = it->concurrency;
+			socketDoc["accept_http_requests"] = it->acceptHttpRequests;
+			socketsDoc.append(socketDoc);
+		}
+		doc["sockets"] = socketsDoc;
+
+		return doc;
+	}
+
+	/**
+	 * Copies the state that `Pool::toXml()` renders. The caller must hold
+	 * the pool lock; rendering may happen after releasing it.
+	 */
+	void captureInspectionSnapshot(ProcessInspectionSnapshot &snapshot,
+		bool includeSockets = true) const
+	{
+		snapshot.pid = getPid();
+		snapshot.stickySessionId = getStickySessionId();
+		snapshot.gupid = getGupid();
+		snapshot.concurrency = concurrency;
+		snapshot.sessions = sessions;
+		snapshot.busyness = busyness();
+		snapshot.processed = processed;
+		snapshot.responseTimeAverageAvailable = responseTimeAverage.available();
+		snapshot.responseTimeAverage = snapshot.responseTimeAverageAvailable
+			? (unsigned long long) responseTimeAverage.average()
+			: 0;
+		snapshot.spawnerCreationTime = spawnerCreationTime;
+		snapshot.spawnStartTime = spawnStartTime;
+		snapshot.spawnEndTime = spawnEndTime;
+		snapshot.lastUsed = lastUsed;
+		snapshot.codeRevision = codeRevision;
 		switch (lifeStatus) {
 		case ALIVE:
-			stream << "<life_status>ALIVE</life_status>";
+			snapshot.lifeStatus = P_STATIC_STRING("ALIVE");
 			break;
 		case SHUTDOWN_TRIGGERED:
-			stream << "<life_status>SHUTDOWN_TRIGGERED</life_status>";
+			snapshot.lifeStatus = P_STATIC_STRING("SHUTDOWN_TRIGGERED");
 			break;
 		case DEAD:
-			stream << "<life_status>DEAD</life_status>";
+			snapshot.lifeStatus = P_STATIC_STRING("DEAD");
 			break;
 		default:
 			P_BUG("Unknown 'lifeStatus' state " << (int) lifeStatus);
 		}
 		switch (enabled) {
 		case ENABLED:
-			stream << "<enabled>ENABLED</enabled>";
+			snapshot.enabled = P_STATIC_STRING("ENABLED");
 			break;
 		case DISABLING:
-			stream << "<enabled>DISABLING</enabled>";
+			snapshot.enabled = P_STATIC_STRING("DISABLING");
 			break;
 		case DISABLED:
-			stream << "<enabled>DISABLED</enabled>";
+			snapshot.enabled = P_STATIC_STRING("DISABLED");
 			break;
 		case DETACHED:
-			stream << "<enabled>DETACHED</enabled>";
+			snapshot.enabled = P_STATIC_STRING("DETACHED");
 			break;
 		default:
 			P_BUG("Unknown 'enabled' state " << (int) enabled);
 		}
-		if (metrics.isValid()) {
-			stream << "<has_metrics>true</has_metrics>";
-			stream << "<cpu>" << (int) metrics.cpu << "</cpu>";
-			stream << "<rss>" << metrics.rss << "</rss>";
-			stream << "<pss>" << metrics.pss << "</pss>";
-			stream << "<private_dirty>" << metrics.privateDirty << "</private_dirty>";
-			stream << "<swap>" << metrics.swap << "</swap>";
-			stream << "<real_memory>" << metrics.realMemory() << "</real_memory>";
-			stream << "<vmsize>" << metrics.vmsize << "</vmsize>";
-			stream << "<process_group_id>" << metrics.processGroupId << "</process_group_id>";
-			stream << "<command>" << escapeForXml(metrics.command) << "</command>";
-		}
+		snapshot.metrics = metrics;
+		snapshot.includeSockets = includeSockets;
 		if (includeSockets) {
 			SocketList::const_iterator it;
 
-			stream << "<sockets>";
+			snapshot.sockets.reserve(sockets.size());
 			for (it = sockets.begin(); it != sockets.end(); it++) {
 				const Socket &socket = *it;
-				stream << "<socket>";
-				stream << "<address>" << escapeForXml(socket.address) << "</address>";
-				stream << "<protocol>" << escapeForXml(socket.protocol) << "</protocol>";
-				if (!socket.description.empty()) {
-					stream << "<description>" << escapeForXml(socket.description) << "</description>";
-				}
-				stream << "<concurrency>" << socket.concurrency << "</concurrency>";
-				stream << "<accept_http_requests>" << socket.acceptHttpRequests << "</accept_http_requests>";
-				stream << "<sessions>" << socket.sessions << "</sessions>";
-				stream << "</socket>";
+				snapshot.sockets.push_back(SocketInspectionSnapshot());
+				SocketInspectionSnapshot &socketSnapshot = snapshot.sockets.back();
+				socketSnapshot.address = socket.address;
+				socketSnapshot.protocol = socket.protocol;
+				socketSnapshot.description = socket.description;
+				socketSnapshot.concurrency = socket.concurrency;
+				socketSnapshot.acceptHttpRequests = socket.acceptHttpRequests;
+				socketSnapshot.sessions = socket.sessions;
 			}
-			stream << "</sockets>";
 		}
 	}
 };
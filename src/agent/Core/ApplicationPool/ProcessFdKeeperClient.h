@@ -0,0 +1,529 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2018 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_APPLICATION_POOL2_PROCESS_FD_KEEPER_CLIENT_H_
+#define _PASSENGER_APPLICATION_POOL2_PROCESS_FD_KEEPER_CLIENT_H_
+
+#include <boost/thread.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/bind.hpp>
+#include <oxt/thread.hpp>
+#include <oxt/system_calls.hpp>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <cerrno>
+#include <sys/types.h>
+#include <unistd.h>
+#include <jsoncpp/json.h>
+#include <FileDescriptor.h>
+#include <StaticString.h>
+#include <Exceptions.h>
+#include <Constants.h>
+#include <LoggingKit/LoggingKit.h>
+#include <Utils/IOUtils.h>
+#include <Utils/JsonUtils.h>
+#include <Utils/MessageIO.h>
+#include <Utils/StrIntUtils.h>
+
+namespace Passenger {
+namespace ApplicationPool2 {
+
+using namespace std;
+
+
+/**
+ * Talks to the Watchdog's ProcessFdKeeper, which holds on to copies of the
+ * application processes' stdin and output pipes. Application processes exit
+ * as soon as their stdin is closed, so without the keeper every Core crash
+ * takes all application processes down with it. The keeper also holds on
+ * to the Core's server sockets, so that a restarted Core can take them over.
+ * See the Watchdog's ProcessFdKeeper.h for the protocol.
+ *
+ * Talking to the keeper is best-effort: if anything goes wrong then we log a
+ * warning and stop using the keeper, and application processes simply
+ * won't survive a Core crash anymore.
+ *
+ * `keep()` and `release()` are called while the pool lock is held, so they
+ * don't talk to the keeper themselves: they put a command on a queue, which
+ * a background thread sends to the keeper in order. Because the commands
+ * are queued under the pool lock, a release can never overtake the keep of
+ * the same process. `preparedForReplacement()` is queued too, so that it
+ * arrives after all keeps and releases before it. The other methods are
+ * synchronous.
+ *
+ * This class is thread-safe.
+ */
+class ProcessFdKeeperClient {
+public:
+	struct Entry {
+		string gupid;
+		pid_t pid;
+		FileDescriptor input;
+		FileDescriptor output;
+
+		Entry()
+			: pid(0)
+			{ }
+	};
+
+private:
+	struct Command {
+		enum Type {
+			KEEP,
+			RELEASE,
+			PREPARED_FOR_REPLACEMENT
+		};
+
+		Type type;
+		string gupid;
+		pid_t pid;
+		// Duplicates of the process's pipes, so that they stay valid even
+		// if the Process object closes its own copies in the meantime.
+		FileDescriptor input;
+		FileDescriptor output;
+
+		Command()
+			: type(KEEP),
+			  pid(0)
+			{ }
+	};
+
+	/** Maximum time that we spend on a single message, in microseconds. */
+	static const unsigned long long TIMEOUT = 5000000;
+
+	const string address;
+	const string password;
+	/** Protects `fd`. Held for as long as a message exchange takes. */
+	mutable boost::mutex syncher;
+	FileDescriptor fd;
+
+	/** Protects the fields below. Never held while talking to the keeper. */
+	mutable boost::mutex queueSyncher;
+	boost::condition_variable queueCond;
+	std::deque<Command> queue;
+	bool enabled;
+	bool sendingCommand;
+	bool quit;
+	oxt::thread *thr;
+
+	void disable(const char *action, const std::exception &e) {
+		P_WARN("Could not " << action << " the Watchdog's application process fd keeper ("
+			<< e.what() << "). Application processes will not survive a "
+			SHORT_PROGRAM_NAME " core crash anymore");
+		fd.close(false);
+
+		boost::lock_guard<boost::mutex> l(queueSyncher);
+		enabled = false;
+		queue.clear();
+		queueCond.notify_all();
+	}
+
+	bool isEnabled() const {
+		boost::lock_guard<boost::mutex> l(queueSyncher);
+		return enabled;
+	}
+
+	void enqueue(const Command &command) {
+		boost::lock_guard<boost::mutex> l(queueSyncher);
+		if (enabled) {
+			queue.push_back(command);
+			queueCond.notify_all();
+		}
+	}
+
+	void threadMain() {
+		boost::this_thread::disable_interruption di;
+		boost::this_thread::disable_syscall_interruption dsi;
+
+		while (true) {
+			Command command;
+			{
+				boost::unique_lock<boost::mutex> l(queueSyncher);
+				while (queue.empty() && !quit) {
+					queueCond.wait(l);
+				}
+				if (queue.empty()) {
+					return;
+				}
+				command = queue.front();
+				queue.pop_front();
+				sendingCommand = true;
+			}
+
+			if (command.type == Command::KEEP) {
+				sendKeep(command);
+			} else if (command.type == Command::RELEASE) {
+				sendRelease(command);
+			} else {
+				sendPreparedForReplacement();
+			}
+			// Close our duplicates of the pipes before flush() returns.
+			command = Command();
+
+			boost::lock_guard<boost::mutex> l(queueSyncher);
+			sendingCommand = false;
+			queueCond.notify_all();
+		}
+	}
+
+	void sendKeep(const Command &command) {
+		boost::lock_guard<boost::mutex> l(syncher);
+		unsigned long long timeout = TIMEOUT;
+
+		if (fd == -1) {
+			return;
+		}
+
+		try {
+			string pidStr = toString(command.pid);
+			StaticString args[] = { P_STATIC_STRING("keep"), command.gupid, pidStr };
+			writeArrayMessage(fd, args, 3, &timeout);
+			writeFileDescriptorWithNegotiation(fd, command.input, &timeout);
+			writeFileDescriptorWithNegotiation(fd, command.output, &timeout);
+		} catch (const std::exception &e) {
+			disable("pass application process pipes to", e);
+		}
+	}
+
+	void sendRelease(const Command &command) {
+		boost::lock_guard<boost::mutex> l(syncher);
+		unsigned long long timeout = TIMEOUT;
+
+		if (fd == -1) {
+			return;
+		}
+
+		try {
+			StaticString args[] = { P_STATIC_STRING("release"), command.gupid };
+			writeArrayMessage(fd, args, 2, &timeout);
+		} catch (const std::exception &e) {
+			disable("release application process pipes in", e);
+		}
+	}
+
+	void sendPreparedForReplacement() {
+		boost::lock_guard<boost::mutex> l(syncher);
+		unsigned long long timeout = TIMEOUT;
+
+		if (fd == -1) {
+			return;
+		}
+
+		try {
+			writeArrayMessage(fd, &timeout, "prepared_for_replacement", NULL);
+		} catch (const std::exception &e) {
+			disable("notify", e);
+		}
+	}
+
+	static FileDescriptor duplicate(int fd) {
+		int result = ::dup(fd);
+		if (result == -1) {
+			int e = errno;
+			throw SystemException("Cannot duplicate a file descriptor", e);
+		}
+		return FileDescriptor(result, __FILE__, __LINE__);
+	}
+
+	static FileDescriptor receiveFd(int fd, unsigned long long *timeout) {
+		return FileDescriptor(readFileDescriptorWithNegotiation(fd, timeout),
+			__FILE__, __LINE__);
+	}
+
+public:
+	ProcessFdKeeperClient(const string &_address, const string &_password)
+		: address(_address),
+		  password(_password),
+		  enabled(false),
+		  sendingCommand(false),
+		  quit(false),
+		  thr(NULL)
+		{ }
+
+	/**
+	 * Sends the commands that are still queued before returning, so that
+	 * e.g. processes that were shut down get released.
+	 */
+	~ProcessFdKeeperClient() {
+		if (thr != NULL) {
+			{
+				boost::lock_guard<boost::mutex> l(queueSyncher);
+				quit = true;
+				queueCond.notify_all();
+			}
+			thr->join();
+			delete thr;
+		}
+	}
+
+	/**
+	 * @throws SystemException
+	 * @throws IOException
+	 * @throws TimeoutException
+	 */
+	void connect() {
+		boost::this_thread::disable_interruption di;
+		boost::this_thread::disable_syscall_interruption dsi;
+		boost::lock_guard<boost::mutex> l(syncher);
+		unsigned long long timeout = TIMEOUT;
+
+		fd.assign(connectToServer(address, __FILE__, __LINE__), NULL, 0);
+		try {
+			vector<string> args;
+			writeArrayMessage(fd, &timeout, "authenticate", password.c_str(), NULL);
+			if (!readArrayMessage(fd, args, &timeout) || args.size() != 1
+			 || args[0] != "ok")
+			{
+				throw IOException("Authentication with the Watchdog's "
+					"application process fd keeper failed");
+			}
+		} catch (...) {
+			fd.close(false);
+			throw;
+		}
+
+		boost::lock_guard<boost::mutex> l2(queueSyncher);
+		enabled = true;
+		if (thr == NULL) {
+			thr = new oxt::thread(boost::bind(&ProcessFdKeeperClient::threadMain, this),
+				"Application process fd keeper client", 128 * 1024);
+		}
+	}
+
+	bool isConnected() const {
+		boost::lock_guard<boost::mutex> l(syncher);
+		return fd != -1;
+	}
+
+	/**
+	 * Fetches all pipes that the keeper holds on to. The keeper keeps holding
+	 * on to them until they're released.
+	 */
+	vector<Entry> fetch() {
+		boost::this_thread::disable_interruption di;
+		boost::this_thread::disable_syscall_interruption dsi;
+		boost::lock_guard<boost::mutex> l(syncher);
+		vector<Entry> result;
+		vector<string> args;
+		unsigned long long timeout = TIMEOUT;
+
+		if (fd == -1) {
+			return result;
+		}
+
+		try {
+			writeArrayMessage(fd, &timeout, "fetch", NULL);
+			if (!readArrayMessage(fd, args, &timeout) || args.size() != 2
+			 || args[0] != "count")
+			{
+				throw IOException("Invalid reply to the 'fetch' command");
+			}
+
+			unsigned int count = stringToUint(args[1]);
+			result.reserve(count);
+			for (unsigned int i = 0; i < count; i++) {
+				if (!readArrayMessage(fd, args, &timeout) || args.size() != 2) {
+					throw IOException("Invalid entry in reply to the 'fetch' command");
+				}
+
+				result.push_back(Entry());
+				Entry &entry = result.back();
+				entry.gupid = args[0];
+				entry.pid = (pid_t) stringToInt(args[1]);
+				entry.input = receiveFd(fd, &timeout);
+				entry.output = receiveFd(fd, &timeout);
+			}
+		} catch (const std::exception &e) {
+			disable("fetch application process pipes from", e);
+			result.clear();
+		}
+
+		return result;
+	}
+
+	/**
+	 * Asynchronously hands copies of a process's stdin and output pipes
+	 * to the keeper.
+	 */
+	void keep(const StaticString &gupid, pid_t pid, int input, int output) {
+		Command command;
+
+		if (!isEnabled()) {
+			return;
+		}
+		command.type = Command::KEEP;
+		command.gupid = gupid;
+		command.pid = pid;
+		try {
+			command.input = duplicate(input);
+			command.output = duplicate(output);
+		} catch (const SystemException &e) {
+			P_WARN("Could not pass the pipes of process " << pid << " to the "
+				"Watchdog's application process fd keeper (" << e.what() << "). "
+				"This process will not survive a " SHORT_PROGRAM_NAME " core crash");
+			return;
+		}
+		enqueue(command);
+	}
+
+	/**
+	 * Fetches the server sockets that the keeper holds on to, keyed by
+	 * address.
+	 */
+	map<string, FileDescriptor> fetchServerSockets() {
+		boost::this_thread::disable_interruption di;
+		boost::this_thread::disable_syscall_interruption dsi;
+		boost::lock_guard<boost::mutex> l(syncher);
+		map<string, FileDescriptor> result;
+		vector<string> args;
+		unsigned long long timeout = TIMEOUT;
+
+		if (fd == -1) {
+			return result;
+		}
+
+		try {
+			writeArrayMessage(fd, &timeout, "fetch_server_sockets", NULL);
+			if (!readArrayMessage(fd, args, &timeout) || args.size() != 2
+			 || args[0] != "count")
+			{
+				throw IOException("Invalid reply to the 'fetch_server_sockets' command");
+			}
+
+			unsigned int count = stringToUint(args[1]);
+			for (unsigned int i = 0; i < count; i++) {
+				if (!readArrayMessage(fd, args, &timeout) || args.size() != 1) {
+					throw IOException("Invalid entry in reply to the "
+						"'fetch_server_sockets' command");
+				}
+				result[args[0]] = receiveFd(fd, &timeout);
+			}
+		} catch (const std::exception &e) {
+			disable("fetch server sockets from", e);
+			result.clear();
+		}
+
+		return result;
+	}
+
+	void keepServerSocket(const string &address, int serverFd) {
+		boost::this_thread::disable_interruption di;
+		boost::this_thread::disable_syscall_interruption dsi;
+		boost::lock_guard<boost::mutex> l(syncher);
+		unsigned long long timeout = TIMEOUT;
+
+		if (fd == -1) {
+			return;
+		}
+
+		try {
+			writeArrayMessage(fd, &timeout, "keep_server_socket", address.c_str(), NULL);
+			writeFileDescriptorWithNegotiation(fd, serverFd, &timeout);
+		} catch (const std::exception &e) {
+			disable("pass server sockets to", e);
+		}
+	}
+
+	void releaseServerSocket(const string &address) {
+		boost::this_thread::disable_interruption di;
+		boost::this_thread::disable_syscall_interruption dsi;
+		boost::lock_guard<boost::mutex> l(syncher);
+		unsigned long long timeout = TIMEOUT;
+
+		if (fd == -1) {
+			return;
+		}
+
+		try {
+			writeArrayMessage(fd, &timeout, "release_server_socket", address.c_str(), NULL);
+		} catch (const std::exception &e) {
+			disable("release server sockets in", e);
+		}
+	}
+
+	/**
+	 * Tells the keeper which addresses we listen on, after they were changed
+	 * at runtime. The Watchdog passes them to a restarted Core.
+	 */
+	void setServerAddresses(const Json::Value &controllerAddresses,
+		const Json::Value &apiServerAddresses)
+	{
+		boost::this_thread::disable_interruption di;
+		boost::this_thread::disable_syscall_interruption dsi;
+		boost::lock_guard<boost::mutex> l(syncher);
+		unsigned long long timeout = TIMEOUT;
+
+		if (fd == -1) {
+			return;
+		}
+
+		try {
+			writeArrayMessage(fd, &timeout, "set_server_addresses",
+				stringifyJson(controllerAddresses).c_str(),
+				stringifyJson(apiServerAddresses).c_str(),
+				NULL);
+		} catch (const std::exception &e) {
+			disable("pass server addresses to", e);
+		}
+	}
+
+	/** Asynchronously tells the keeper to close its copies of a process's pipes. */
+	void release(const StaticString &gupid) {
+		Command command;
+
+		command.type = Command::RELEASE;
+		command.gupid = gupid;
+		enqueue(command);
+	}
+
+	/**
+	 * Asynchronously tells the keeper that we're ready to be replaced by a
+	 * graceful restart. See Pool::prepareForReplacement().
+	 */
+	void preparedForReplacement() {
+		Command command;
+
+		command.type = Command::PREPARED_FOR_REPLACEMENT;
+		enqueue(command);
+	}
+
+	/** Waits until all queued `keep()` and `release()` commands have been sent. */
+	void flush() {
+		boost::unique_lock<boost::mutex> l(queueSyncher);
+		while (!queue.empty() || sendingCommand) {
+			queueCond.wait(l);
+		}
+	}
+};
+
+typedef boost::shared_ptr<ProcessFdKeeperClient> ProcessFdKeeperClientPtr;
+
+
+} // namespace ApplicationPool2
+} // namespace Passenger
+
+#endif /* _PASSENGER_APPLICATION_POOL2_PROCESS_FD_KEEPER_CLIENT_H_ */
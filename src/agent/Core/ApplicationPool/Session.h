@@ -117,6 +117,10 @@ private:
 public:
 	Callback onInitiateFailure;
 	Callback onClose;
+	/** The time (in microseconds) at which this session was checked out
+	 * from its Process. Used for tracking the Process's response time.
+	 */
+	unsigned long long checkoutTime;
 
 	Session(Context *_context, const BasicProcessInfo *_processInfo, Socket *_socket)
 		: context(_context),
@@ -125,7 +129,8 @@ public:
 		  refcount(1),
 		  closed(false),
 		  onInitiateFailure(NULL),
-		  onClose(NULL)
+		  onClose(NULL),
+		  checkoutTime(0)
 		{ }
 
 	~Session() {
@@ -225,6 +230,10 @@ public:
 
 	virtual void requestOOBW();
 
+	virtual void resetCheckoutTime(unsigned long long time) {
+		checkoutTime = time;
+	}
+
 
 	virtual void ref() const {
 		refcount.fetch_add(1, boost::memory_order_relaxed);
@@ -29,6 +29,7 @@
 #include <boost/thread.hpp>
 #include <string>
 #include <cassert>
+#include <sys/socket.h>
 #include <Utils/IOUtils.h>
 #include <Utils/BufferedIO.h>
 #include <Core/ApplicationPool/AbstractSession.h>
@@ -54,6 +55,7 @@ private:
 	SocketPair connection;
 	BufferedIO peerBufferedIO;
 	unsigned int stickySessionId;
+	int sendBufferSize;
 	mutable bool closed;
 	mutable bool success;
 	mutable bool wantKeepAlive;
@@ -65,6 +67,7 @@ public:
 		  gupid("gupid-123"),
 		  protocol("session"),
 		  stickySessionId(0),
+		  sendBufferSize(0),
 		  closed(false),
 		  success(false),
 		  wantKeepAlive(false)
@@ -119,6 +122,15 @@ public:
 		protocol = v;
 	}
 
+	/**
+	 * Sets the size of the Core side's socket send buffer, so that tests
+	 * can make writes to the application block early. 0 means the OS default.
+	 */
+	void setSendBufferSize(int size) {
+		boost::lock_guard<boost::mutex> l(syncher);
+		sendBufferSize = size;
+	}
+
 	virtual unsigned int getStickySessionId() const {
 		boost::lock_guard<boost::mutex> l(syncher);
 		return stickySessionId;
@@ -167,6 +179,10 @@ public:
 		boost::lock_guard<boost::mutex> l(syncher);
 		connection = createUnixSocketPair(__FILE__, __LINE__);
 		peerBufferedIO = BufferedIO(connection.second);
+		if (sendBufferSize > 0) {
+			setsockopt(connection.first, SOL_SOCKET, SO_SNDBUF,
+				&sendBufferSize, sizeof(sendBufferSize));
+		}
 		if (!blocking) {
 			setNonBlocking(connection.first);
 		}
@@ -49,6 +49,7 @@
 #include <Constants.h>
 #include <Utils.h>
 #include <Utils/IOUtils.h>
+#include <Utils/CpuAffinity.h>
 
 namespace Passenger {
 namespace Core {
@@ -61,6 +62,7 @@ using namespace std;
  * (do not edit: following text is automatically generated
  * by 'rake configkit_schemas_inline_comments')
  *
+ *   adaptive_request_body_buffering                                 boolean            -          default(false)
  *   admin_panel_auth_type                                           string             -          default("basic")
  *   admin_panel_close_timeout                                       float              -          default(10.0)
  *   admin_panel_connect_timeout                                     float              -          default(30.0)
@@ -79,33 +81,47 @@ using namespace std;
  *   admin_panel_websocketpp_debug_access                            boolean            -          default(false)
  *   admin_panel_websocketpp_debug_error                             boolean            -          default(false)
  *   api_server_accept_burst_count                                   unsigned integer   -          default(32)
- *   api_server_addresses                                            array of strings   -          default([]),read_only
+ *   api_server_addresses                                            array of strings   -          default([])
  *   api_server_authorizations                                       array              -          default("[FILTERED]"),secret
  *   api_server_client_freelist_limit                                unsigned integer   -          default(0)
  *   api_server_file_buffered_channel_auto_start_mover               boolean            -          default(true)
  *   api_server_file_buffered_channel_auto_truncate_file             boolean            -          default(true)
  *   api_server_file_buffered_channel_buffer_dir                     string             -          default
  *   api_server_file_buffered_channel_delay_in_file_mode_switching   unsigned integer   -          default(0)
+ *   api_server_file_buffered_channel_io_uring                       boolean            -          default(false),read_only
+ *   api_server_file_buffered_channel_io_uring_entries               unsigned integer   -          default(64),read_only
  *   api_server_file_buffered_channel_max_disk_chunk_read_size       unsigned integer   -          default(0)
+ *   api_server_file_buffered_channel_max_disk_chunk_write_size      unsigned integer   -          default(0)
  *   api_server_file_buffered_channel_threshold                      unsigned integer   -          default(131072)
+ *   api_server_max_pipelined_requests                               unsigned integer   -          default(0)
  *   api_server_mbuf_block_chunk_size                                unsigned integer   -          default(4096),read_only
+ *   api_server_mbuf_spare_memory_high_watermark                     unsigned integer   -          default(8388608)
  *   api_server_min_spare_clients                                    unsigned integer   -          default(0)
  *   api_server_request_freelist_limit                               unsigned integer   -          default(1024)
  *   api_server_start_reading_after_accept                           boolean            -          default(true)
+ *   app_numa_affine                                                 boolean            -          default(false),read_only
  *   app_output_log_level                                            string             -          default("notice")
+ *   app_process_fd_keeper_address                                   string             -          read_only
  *   benchmark_mode                                                  string             -          -
  *   config_manifest                                                 object             -          read_only
+ *   config_profiles                                                 object             -          read_only
  *   controller_accept_burst_count                                   unsigned integer   -          default(32)
- *   controller_addresses                                            array of strings   -          default(["tcp://127.0.0.1:3000"]),read_only
+ *   controller_addresses                                            array of strings   -          default(["tcp://127.0.0.1:3000"])
  *   controller_client_freelist_limit                                unsigned integer   -          default(0)
  *   controller_cpu_affine                                           boolean            -          default(false),read_only
+ *   controller_cpus                                                 string             -          read_only
  *   controller_file_buffered_channel_auto_start_mover               boolean            -          default(true)
  *   controller_file_buffered_channel_auto_truncate_file             boolean            -          default(true)
  *   controller_file_buffered_channel_buffer_dir                     string             -          default
  *   controller_file_buffered_channel_delay_in_file_mode_switching   unsigned integer   -          default(0)
+ *   controller_file_buffered_channel_io_uring                       boolean            -          default(false),read_only
+ *   controller_file_buffered_channel_io_uring_entries               unsigned integer   -          default(64),read_only
  *   controller_file_buffered_channel_max_disk_chunk_read_size       unsigned integer   -          default(0)
+ *   controller_file_buffered_channel_max_disk_chunk_write_size      unsigned integer   -          default(0)
  *   controller_file_buffered_channel_threshold                      unsigned integer   -          default(131072)
+ *   controller_max_pipelined_requests                               unsigned integer   -          default(8)
  *   controller_mbuf_block_chunk_size                                unsigned integer   -          default(4096),read_only
+ *   controller_mbuf_spare_memory_high_watermark                     unsigned integer   -          default(8388608)
  *   controller_min_spare_clients                                    unsigned integer   -          default(0)
  *   controller_request_freelist_limit                               unsigned integer   -          default(1024)
  *   controller_secure_headers_password                              any                -          secret
@@ -126,6 +142,7 @@ using namespace std;
  *   default_min_instances                                           unsigned integer   -          default(1)
  *   default_nodejs                                                  string             -          default("node")
  *   default_python                                                  string             -          default("python")
+ *   default_routing_policy                                          string             -          default("least_busy")
  *   default_ruby                                                    string             -          default("ruby")
  *   default_server_name                                             string             -          default
  *   default_server_port                                             unsigned integer   -          default
@@ -142,6 +159,7 @@ using namespace std;
  *   log_target                                                      any                -          default({"stderr": true})
  *   max_instances_per_app                                           unsigned integer   -          read_only
  *   max_pool_size                                                   unsigned integer   -          default(6)
+ *   max_request_body_buffer_size                                    unsigned integer   -          default(0)
  *   multi_app                                                       boolean            -          default(false),read_only
  *   passenger_root                                                  string             required   read_only
  *   pid_file                                                        string             -          read_only
@@ -149,11 +167,13 @@ using namespace std;
  *   pool_selfchecks                                                 boolean            -          default(false)
  *   prestart_urls                                                   array of strings   -          default([]),read_only
  *   response_buffer_high_watermark                                  unsigned integer   -          default(134217728)
+ *   response_compression                                            boolean            -          default(false)
  *   security_update_checker_certificate_path                        string             -          -
  *   security_update_checker_disabled                                boolean            -          default(false)
  *   security_update_checker_interval                                unsigned integer   -          default(86400)
  *   security_update_checker_proxy_url                               string             -          -
  *   security_update_checker_url                                     string             -          default("https://securitycheck.phusionpassenger.com/v1/check.json")
+ *   serve_static_files                                              boolean            -          default(false)
  *   server_software                                                 string             -          default("Phusion_Passenger/5.3.2")
  *   show_version_in_header                                          boolean            -          default(true)
  *   single_app_mode_app_root                                        string             -          default,read_only
@@ -161,7 +181,7 @@ using namespace std;
  *   single_app_mode_startup_file                                    string             -          read_only
  *   standalone_engine                                               string             -          default
  *   stat_throttle_rate                                              unsigned integer   -          default(10)
- *   turbocaching                                                    boolean            -          default(true),read_only
+ *   turbocaching                                                    boolean            -          default(true)
  *   user_switching                                                  boolean            -          default(true)
  *   vary_turbocache_by_cookie                                       string             -          -
  *   watchdog_fd_passing_password                                    string             -          secret
@@ -290,6 +310,13 @@ private:
 		if (config["controller_threads"].asUInt() < 1) {
 			errors.push_back(Error("'{{controller_threads}}' must be at least 1"));
 		}
+
+		vector<unsigned int> cpus;
+		if (!config["controller_cpus"].isNull()
+		 && !parseCpuList(config["controller_cpus"].asString(), cpus))
+		{
+			errors.push_back(Error("'{{controller_cpus}}' must be a CPU list, such as \"0-3,8\""));
+		}
 	}
 
 	static void validateAddresses(const ConfigKit::Store &config, vector<ConfigKit::Error> &errors) {
@@ -439,6 +466,7 @@ public:
 		add("passenger_root", STRING_TYPE, REQUIRED | READ_ONLY);
 		add("config_manifest", OBJECT_TYPE, OPTIONAL | READ_ONLY);
 		add("pid_file", STRING_TYPE, OPTIONAL | READ_ONLY);
+		add("app_process_fd_keeper_address", STRING_TYPE, OPTIONAL | READ_ONLY);
 		add("web_server_version", STRING_TYPE, OPTIONAL | READ_ONLY);
 		addWithDynamicDefault("controller_threads", UINT_TYPE, OPTIONAL | READ_ONLY, getDefaultThreads);
 		add("max_pool_size", UINT_TYPE, OPTIONAL, DEFAULT_MAX_POOL_SIZE);
@@ -447,9 +475,11 @@ public:
 		add("prestart_urls", STRING_ARRAY_TYPE, OPTIONAL | READ_ONLY, Json::arrayValue);
 		add("controller_secure_headers_password", ANY_TYPE, OPTIONAL | SECRET);
 		add("controller_socket_backlog", UINT_TYPE, OPTIONAL | READ_ONLY, DEFAULT_SOCKET_BACKLOG);
-		add("controller_addresses", STRING_ARRAY_TYPE, OPTIONAL | READ_ONLY, getDefaultControllerAddresses());
-		add("api_server_addresses", STRING_ARRAY_TYPE, OPTIONAL | READ_ONLY, Json::arrayValue);
+		add("controller_addresses", STRING_ARRAY_TYPE, OPTIONAL, getDefaultControllerAddresses());
+		add("api_server_addresses", STRING_ARRAY_TYPE, OPTIONAL, Json::arrayValue);
 		add("controller_cpu_affine", BOOL_TYPE, OPTIONAL | READ_ONLY, false);
+		add("controller_cpus", STRING_TYPE, OPTIONAL | READ_ONLY);
+		add("app_numa_affine", BOOL_TYPE, OPTIONAL | READ_ONLY, false);
 		add("file_descriptor_ulimit", UINT_TYPE, OPTIONAL | READ_ONLY, 0);
 
 		addValidator(validateMultiAppMode);
@@ -27,11 +27,15 @@
 #include <boost/thread.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <vector>
+#include <string>
 #include <cassert>
+#include <cstring>
+#include <unistd.h>
 
 #include <LoggingKit/LoggingKit.h>
 #include <Core/ConfigChange.h>
 #include <Core/Config.h>
+#include <Core/ServerSocketChanges.h>
 
 namespace Passenger {
 namespace Core {
@@ -55,11 +59,33 @@ struct ConfigChangeRequest {
 	ApiServer::ConfigChangeRequest forApiServer;
 	AdminPanelConnector::ConfigChangeRequest forAdminPanelConnector;
 
+	/**
+	 * Sockets for added addresses are created while preparing, so that
+	 * errors such as an address already being in use can be reported
+	 * before anything is committed. Sockets for removed addresses are
+	 * closed once every server has stopped listening on them.
+	 */
+	int serverFds[SERVER_KIT_MAX_SERVER_ENDPOINTS];
+	int apiServerFds[SERVER_KIT_MAX_SERVER_ENDPOINTS];
+	vector<ServerSocketChange> addedServerSockets, removedServerSockets;
+	vector<ServerSocketChange> addedApiServerSockets, removedApiServerSockets;
+	bool serverSocketsCommitted;
+
 	ConfigChangeRequest()
-		: counter(0)
-		{ }
+		: counter(0),
+		  serverSocketsCommitted(false)
+	{
+		for (unsigned int i = 0; i < SERVER_KIT_MAX_SERVER_ENDPOINTS; i++) {
+			serverFds[i] = -1;
+			apiServerFds[i] = -1;
+		}
+	}
 
 	~ConfigChangeRequest() {
+		if (!serverSocketsCommitted) {
+			closeServerSockets(addedServerSockets);
+			closeServerSockets(addedApiServerSockets);
+		}
 		{
 			vector<ServerKit::ConfigChangeRequest *>::iterator it;
 			for (it = forControllerServerKit.begin(); it != forControllerServerKit.end(); it++) {
@@ -73,12 +99,45 @@ struct ConfigChangeRequest {
 			}
 		}
 	}
+
+	static void closeServerSockets(const vector<ServerSocketChange> &sockets) {
+		vector<ServerSocketChange>::const_iterator it;
+		for (it = sockets.begin(); it != sockets.end(); it++) {
+			close(it->fd);
+			P_LOG_FILE_DESCRIPTOR_CLOSE(it->fd);
+		}
+	}
 };
 
 
 /**************** Functions: prepare config change ****************/
 
 
+static void
+prepareServerSocketChanges(ConfigChangeRequest *req) {
+	WorkingObjects *wo = workingObjects;
+
+	if (wo->apiWorkingObjects.apiServer == NULL
+	 && !req->config->get("api_server_addresses").empty())
+	{
+		req->errors.push_back(ConfigKit::Error("'{{api_server_addresses}}' can only be"
+			" changed at runtime if the API server was enabled at startup"));
+		return;
+	}
+
+	prepareServerSocketChanges(coreConfig->get("controller_addresses"), wo->serverFds,
+		req->config->get("controller_addresses"), req->serverFds,
+		createControllerServerSocket, "controller_addresses",
+		req->addedServerSockets, req->removedServerSockets,
+		req->errors);
+	prepareServerSocketChanges(coreConfig->get("api_server_addresses"), wo->apiServerFds,
+		req->config->get("api_server_addresses"), req->apiServerFds,
+		createApiServerSocket, "api_server_addresses",
+		req->addedApiServerSockets, req->removedApiServerSockets,
+		req->errors);
+}
+
+
 static void
 asyncPrepareConfigChangeCompletedOne(ConfigChangeRequest *req) {
 	assert(req->counter > 0);
@@ -178,6 +237,12 @@ asyncPrepareConfigChange(const Json::Value &updates, ConfigChangeRequest *req,
 		return;
 	}
 
+	prepareServerSocketChanges(req);
+	if (!req->errors.empty()) {
+		asyncPrepareConfigChangeCompletedOne(req);
+		return;
+	}
+
 	ConfigKit::prepareConfigChangeForSubComponent(
 		*LoggingKit::context, coreSchema->loggingKit.translator,
 		manipulateLoggingKitConfig(*req->config,
@@ -223,11 +288,75 @@ asyncPrepareConfigChange(const Json::Value &updates, ConfigChangeRequest *req,
 /**************** Functions: commit config change ****************/
 
 
+template<typename Server>
+static void
+applyServerSocketChanges(Server *server, const vector<ServerSocketChange> &added,
+	const vector<ServerSocketChange> &removed)
+{
+	vector<ServerSocketChange>::const_iterator it;
+
+	for (it = removed.begin(); it != removed.end(); it++) {
+		P_NOTICE("No longer listening on " << it->address);
+		server->unlisten(it->fd);
+	}
+	for (it = added.begin(); it != added.end(); it++) {
+		P_NOTICE("Now listening on " << it->address);
+		server->listen(it->fd);
+	}
+}
+
+template<typename Server>
+static void
+applyServerSocketChanges(Server *server, const ConfigChangeRequest &req) {
+	applyServerSocketChanges(server, req.addedServerSockets,
+		req.removedServerSockets);
+}
+
+static void
+commitServerSocketChanges(ConfigChangeRequest *req) {
+	WorkingObjects *wo = workingObjects;
+	vector<ServerSocketChange>::const_iterator it;
+
+	memcpy(wo->serverFds, req->serverFds, sizeof(wo->serverFds));
+	memcpy(wo->apiServerFds, req->apiServerFds, sizeof(wo->apiServerFds));
+	req->serverSocketsCommitted = true;
+
+	for (it = req->removedServerSockets.begin(); it != req->removedServerSockets.end(); it++) {
+		releaseServerSocket(it->address);
+	}
+	for (it = req->removedApiServerSockets.begin(); it != req->removedApiServerSockets.end(); it++) {
+		releaseServerSocket(it->address);
+	}
+	for (it = req->addedServerSockets.begin(); it != req->addedServerSockets.end(); it++) {
+		keepServerSocket(it->address, it->fd);
+	}
+	for (it = req->addedApiServerSockets.begin(); it != req->addedApiServerSockets.end(); it++) {
+		keepServerSocket(it->address, it->fd);
+	}
+	if (!req->addedServerSockets.empty() || !req->removedServerSockets.empty()
+	 || !req->addedApiServerSockets.empty() || !req->removedApiServerSockets.empty())
+	{
+		reportServerAddresses();
+	}
+
+	if (wo->threadWorkingObjects.size() > 1) {
+		// The load balancer waits until its thread has picked up
+		// the change, so removed sockets may be closed afterwards.
+		applyServerSocketChanges(&wo->loadBalancer, *req);
+	}
+}
+
+
 static void
 asyncCommitConfigChangeCompletedOne(ConfigChangeRequest *req) {
 	assert(req->counter > 0);
 	req->counter--;
 	if (req->counter == 0) {
+		// No server listens on the removed sockets anymore.
+		ConfigChangeRequest::closeServerSockets(req->removedServerSockets);
+		ConfigChangeRequest::closeServerSockets(req->removedApiServerSockets);
+		req->removedServerSockets.clear();
+		req->removedApiServerSockets.clear();
 		oxt::thread(boost::bind(req->commitCallback, req),
 			"Core config callback thread",
 			128 * 1024);
@@ -241,6 +370,12 @@ asyncCommitConfigChangeForController(unsigned int i, ConfigChangeRequest *req) {
 	two->serverKitContext->commitConfigChange(*req->forControllerServerKit[i]);
 	two->controller->commitConfigChange(*req->forController[i]);
 
+	if (workingObjects->threadWorkingObjects.size() == 1) {
+		// With a single thread there is no load balancer: the
+		// controller listens on the server sockets directly.
+		applyServerSocketChanges(two->controller, *req);
+	}
+
 	boost::lock_guard<boost::mutex> l(workingObjects->configSyncher);
 	P_DEBUG("asyncCommitConfigChangeForController(" << i << "): counter "
 		<< req->counter << " -> " << (req->counter - 1));
@@ -253,6 +388,8 @@ asyncCommitConfigChangeForApiServer(ConfigChangeRequest *req) {
 
 	awo->serverKitContext->commitConfigChange(req->forApiServerKit);
 	awo->apiServer->commitConfigChange(req->forApiServer);
+	applyServerSocketChanges(awo->apiServer, req->addedApiServerSockets,
+		req->removedApiServerSockets);
 
 	boost::lock_guard<boost::mutex> l(workingObjects->configSyncher);
 	P_DEBUG("asyncCommitConfigChangeForApiServer: counter "
@@ -295,6 +432,7 @@ asyncCommitConfigChange(ConfigChangeRequest *req, const CommitConfigChangeCallba
 		LockGuard l(wo->appPoolContext->agentConfigSyncher);
 		wo->appPoolContext->agentConfig = coreConfig->inspectEffectiveValues();
 	}
+	commitServerSocketChanges(req);
 
 	for (unsigned int i = 0; i < wo->threadWorkingObjects.size(); i++) {
 		ThreadWorkingObjects *two = &wo->threadWorkingObjects[i];
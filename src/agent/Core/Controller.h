@@ -82,6 +82,10 @@
 #include <Core/Controller/Client.h>
 #include <Core/Controller/AppResponse.h>
 #include <Core/Controller/TurboCaching.h>
+#include <Core/Controller/LatencyStats.h>
+#include <Core/Controller/SessionProtocolV2.h>
+#include <Core/Controller/ResponseHeaderCache.h>
+#include <Core/Controller/StaticFileCache.h>
 
 namespace Passenger {
 
@@ -111,12 +115,20 @@ private:
 	// If you change this value, make sure that Request::sessionCheckoutTry
 	// has enough bits.
 	static const unsigned int MAX_SESSION_CHECKOUT_TRY = 10;
+	// Response bodies smaller than this are not worth compressing.
+	// Same value as the gzip_min_length in the Standalone Nginx config.
+	static const unsigned int MIN_COMPRESSIBLE_RESPONSE_BODY_SIZE = 150;
+	static const int RESPONSE_COMPRESSION_LEVEL = 3;
+	// How much of a static file to send in one go before giving other
+	// clients on the same thread a chance.
+	static const unsigned int MAX_STATIC_FILE_BURST_SIZE = 1024 * 1024;
 
 	ControllerMainConfig mainConfig;
 	ControllerRequestConfigPtr requestConfig;
 	StringKeyTable< boost::shared_ptr<Options> > poolOptionsCache;
 
 	HashedStaticString PASSENGER_APP_GROUP_NAME;
+	HashedStaticString PASSENGER_CONFIG_PROFILE;
 	HashedStaticString PASSENGER_ENV_VARS;
 	HashedStaticString PASSENGER_MAX_REQUESTS;
 	HashedStaticString PASSENGER_SHOW_VERSION_IN_HEADER;
@@ -127,12 +139,16 @@ private:
 	HashedStaticString REMOTE_PORT;
 	HashedStaticString REMOTE_USER;
 	HashedStaticString FLAGS;
+	HashedStaticString HTTP_ACCEPT_ENCODING;
 	HashedStaticString HTTP_COOKIE;
 	HashedStaticString HTTP_DATE;
 	HashedStaticString HTTP_HOST;
+	HashedStaticString HTTP_CONTENT_ENCODING;
 	HashedStaticString HTTP_CONTENT_LENGTH;
 	HashedStaticString HTTP_CONTENT_TYPE;
 	HashedStaticString HTTP_EXPECT;
+	HashedStaticString HTTP_IF_MODIFIED_SINCE;
+	HashedStaticString HTTP_IF_NONE_MATCH;
 	HashedStaticString HTTP_CONNECTION;
 	HashedStaticString HTTP_STATUS;
 	HashedStaticString HTTP_TRANSFER_ENCODING;
@@ -141,6 +157,9 @@ private:
 	friend class ResponseCache<Request>;
 	struct ev_check checkWatcher;
 	TurboCaching<Request> turboCaching;
+	ResponseHeaderCache responseHeaderCache;
+	StaticFileCache staticFileCache;
+	RequestLatencyStats latencyStats;
 	ConfigKit::Store *singleAppModeConfig;
 
 	#ifdef DEBUG_CC_EVENT_LOOP_BLOCKING
@@ -159,7 +178,13 @@ private:
 	struct RequestAnalysis;
 
 	void initializeFlags(Client *client, Request *req, RequestAnalysis &analysis);
+	void initializeResponseCompression(Client *client, Request *req,
+		RequestAnalysis &analysis);
+	static bool acceptEncodingAllows(const LString *value, const StaticString &coding,
+		psg_pool_t *pool);
+	static bool qualityValueIsZero(const char *params, const char *end);
 	bool respondFromTurboCache(Client *client, Request *req);
+	void initializeConfigProfile(Client *client, Request *req);
 	void initializePoolOptions(Client *client, Request *req, RequestAnalysis &analysis);
 	void fillPoolOptionsFromConfigCaches(Options &options, psg_pool_t *pool,
 		const ControllerRequestConfigPtr &requestConfigCache);
@@ -183,21 +208,49 @@ private:
 	const LString *getStickySessionCookieName(Request *req);
 
 
+	/****** Stage: serve static file ******/
+
+	bool serveStaticFile(Client *client, Request *req);
+	bool lookupStaticFile(Request *req, time_t now, StaticFileCache::EntryPtr &file,
+		StaticString &filename);
+	bool lookupStaticFileCandidate(time_t now, const char *path, size_t size,
+		StaticFileCache::EntryPtr &file);
+	StaticFileCache::EntryPtr lookupStaticFileVariant(time_t now,
+		const StaticString &filename, const StaticString &suffix);
+	static char *percentDecodeStaticFilePath(const StaticString &path, char *output);
+	static bool staticFilePathHasDotSegments(const char *path, const char *end);
+	bool staticFileNotModified(Request *req, const StaticFileCache::Entry &file);
+	static bool etagListMatches(const LString *value, const StaticString &etag,
+		psg_pool_t *pool);
+	void sendStaticFileBody(Client *client, Request *req);
+	ssize_t sendStaticFileChunk(Client *client, Request *req, size_t maxSize);
+	static void sendStaticFileBodyLater(Request *req);
+	static void _staticFileOutputDataFlushed(FileBufferedChannel *_channel);
+	void staticFileOutputDataFlushed(Client *client, Request *req);
+
+
 	/****** Stage: buffering body ******/
 
 	void beginBufferingBody(Client *client, Request *req);
 	Channel::Result whenBufferingBody_onRequestBody(Client *client, Request *req,
 		const MemoryKit::mbuf &buffer, int errcode);
 	static void _bodyBufferFlushed(FileBufferedChannel *_channel);
+	static void _bodyBufferDataFlushed(FileBufferedChannel *_channel);
 
 
 	/****** Stage: checkout session ******/
 
 	void checkoutSession(Client *client, Request *req);
+	void prefetchSession(Client *client, Request *req);
+	static void sessionPrefetched(const AbstractSessionPtr &session,
+		const ExceptionPtr &e, void *userData);
+	static void sessionPrefetchedFromAnotherThread(SafeLibev::Task *task);
+	void sessionPrefetchedFromEventLoopThread(Client *client, Request *req,
+		const AbstractSessionPtr &session, const ExceptionPtr &e);
+	bool usePrefetchedSession(Client *client, Request *req);
 	static void sessionCheckedOut(const AbstractSessionPtr &session,
 		const ExceptionPtr &e, void *userData);
-	void sessionCheckedOutFromAnotherThread(Client *client, Request *req,
-		AbstractSessionPtr session, ExceptionPtr e);
+	static void sessionCheckedOutFromAnotherThread(SafeLibev::Task *task);
 	void sessionCheckedOutFromEventLoopThread(Client *client, Request *req,
 		const AbstractSessionPtr &session, const ExceptionPtr &e);
 	void maybeSend100Continue(Client *client, Request *req);
@@ -232,10 +285,6 @@ private:
 	bool constructHeaderBuffersForHttpProtocol(Request *req, struct iovec *buffers,
 		unsigned int maxbuffers, unsigned int & restrict_ref nbuffers,
 		unsigned int & restrict_ref dataSize, HttpHeaderConstructionCache &cache);
-	bool sendHeaderToAppWithHttpProtocolAndWritev(Request *req, ssize_t &bytesWritten,
-		HttpHeaderConstructionCache &cache);
-	void sendHeaderToAppWithHttpProtocolWithBuffering(Request *req, unsigned int offset,
-		HttpHeaderConstructionCache &cache);
 	void sendBodyToApp(Client *client, Request *req);
 	void maybeHalfCloseAppSinkBecauseRequestBodyEndReached(Client *client, Request *req);
 	Channel::Result whenSendingRequest_onRequestBody(Client *client, Request *req,
@@ -255,13 +304,14 @@ private:
 		const MemoryKit::mbuf &buffer, int errcode);
 	void onAppResponseBegin(Client *client, Request *req);
 	void prepareAppResponseCaching(Client *client, Request *req);
+	void prepareAppResponseCompression(Client *client, Request *req);
+	static bool contentTypeIsCompressible(const LString *contentType,
+		psg_pool_t *pool);
 	void onAppResponse100Continue(Client *client, Request *req);
 	bool constructHeaderBuffersForResponse(Request *req, struct iovec *buffers,
 		unsigned int maxbuffers, unsigned int & restrict_ref nbuffers,
 		unsigned int & restrict_ref dataSize,
 		unsigned int & restrict_ref nCacheableBuffers);
-	unsigned int constructDateHeaderBuffersForResponse(char *dateStr,
-		unsigned int bufsize);
 	bool sendResponseHeaderWithWritev(Client *client, Request *req,
 		ssize_t &bytesWritten);
 	void sendResponseHeaderWithBuffering(Client *client, Request *req,
@@ -279,6 +329,8 @@ private:
 	void prepareAppResponseChunkedBodyParsing(Client *client, Request *req);
 	void writeResponseAndMarkForTurboCaching(Client *client, Request *req,
 		const MemoryKit::mbuf &buffer);
+	void writeCompressedResponse(Client *client, Request *req,
+		const char *data, unsigned int size, int flush);
 	void markResponsePartForTurboCaching(Client *client, Request *req,
 		const MemoryKit::mbuf &buffer);
 	void maybeThrottleAppSource(Client *client, Request *req);
@@ -325,6 +377,7 @@ private:
 	static LString *resolveSymlink(const StaticString &path, psg_pool_t *pool);
 	void parseCookieHeader(psg_pool_t *pool, const LString *headerValue,
 		vector< pair<StaticString, StaticString> > &cookies) const;
+	void recordRequestLatencies(Request *req);
 	#ifdef DEBUG_CC_EVENT_LOOP_BLOCKING
 		void reportLargeTimeDiff(Client *client, const char *name,
 			ev_tstamp fromTime, ev_tstamp toTime);
@@ -349,6 +402,7 @@ protected:
 	virtual Channel::Result onRequestBody(Client *client, Request *req,
 		const MemoryKit::mbuf &buffer, int errcode);
 	virtual void onNextRequestEarlyReadError(Client *client, Request *req, int errcode);
+	virtual void onRequestPipelined(Client *client, Request *req);
 	virtual bool shouldDisconnectClientOnShutdown(Client *client);
 	virtual bool supportsUpgrade(Client *client, Request *req);
 
@@ -357,6 +411,7 @@ protected:
 
 	virtual void asyncGetFromApplicationPool(Request *req,
 		ApplicationPool2::GetCallback callback);
+	virtual bool canRouteImmediately(Request *req);
 
 
 public:
@@ -420,6 +475,7 @@ public:
 	virtual Json::Value inspectStateAsJson() const;
 	virtual Json::Value inspectClientStateAsJson(const Client *client) const;
 	virtual Json::Value inspectRequestStateAsJson(const Request *req) const;
+	RequestLatencySnapshotPtr snapshotRequestLatencies() const;
 
 
 	/****** Miscellaneous *******/
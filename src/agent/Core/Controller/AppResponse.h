@@ -30,6 +30,7 @@
 #include <boost/cstdint.hpp>
 #include <boost/atomic.hpp>
 #include <sys/uio.h>
+#include <zlib.h>
 #include <ServerKit/http_parser.h>
 #include <ServerKit/Hooks.h>
 #include <ServerKit/Client.h>
@@ -90,6 +91,11 @@ public:
 	HttpState httpState: 5;
 	bool wantKeepAlive: 1;
 	bool oneHundredContinueSent: 1;
+	/** Whether response compression applies to this response, i.e. whether
+	 * it would be compressed for clients that accept gzip. */
+	bool compressible: 1;
+	/** Whether the Controller gzips the body before sending it to the client. */
+	bool compressed: 1;
 	BodyType bodyType;
 
 	boost::uint16_t statusCode;
@@ -140,6 +146,11 @@ public:
 	 */
 	LString bodyCacheBuffer;
 
+	/* If `compressed` is true, the zlib stream that compresses the body.
+	 * Created by the Controller when the body begins.
+	 */
+	z_stream *deflateStream;
+
 
 	AppResponse()
 		: headers(16),
@@ -68,9 +68,31 @@ Controller::_bodyBufferFlushed(FileBufferedChannel *channel) {
 	req->bodyChannel.start();
 }
 
+/**
+ * Relevant when our body data source (bodyChannel) was throttled because
+ * `config->maxRequestBodyBufferSize` bytes are buffered (see
+ * whenBufferingBody_onRequestBody). Called when the app has consumed everything
+ * in bodyBuffer, whether in-memory or on-disk.
+ */
+void
+Controller::_bodyBufferDataFlushed(FileBufferedChannel *channel) {
+	Request *req = static_cast<Request *>(static_cast<
+		ServerKit::BaseHttpRequest *>(channel->getHooks()->userData));
+
+	req->bodyBuffer.clearDataFlushedCallback();
+	req->bodyChannel.start();
+}
+
 /**
  * Receives data (buffer) originating from the bodyChannel, to be passed on to the bodyBuffer.
  * Backpressure is applied when the bodyBuffer in-memory part exceeds a threshold.
+ *
+ * If `config->maxRequestBodyBufferSize` is set and that many bytes have been
+ * buffered, then we check out a session without waiting for the end of the body.
+ * From then on this method keeps feeding bodyBuffer, which forwards to the app,
+ * but never lets it hold more than that many bytes. This doesn't apply to
+ * chunked bodies, which must be buffered completely so that they can be
+ * forwarded with a Content-Length header.
  */
 ServerKit::Channel::Result
 Controller::whenBufferingBody_onRequestBody(Client *client, Request *req,
@@ -87,6 +109,29 @@ Controller::whenBufferingBody_onRequestBody(Client *client, Request *req,
 			"\"; " << req->bodyBytesBuffered << " bytes buffered so far");
 		req->bodyBuffer.feed(buffer);
 
+		unsigned int limit = req->config->maxRequestBodyBufferSize;
+		if (req->bodyBufferLimitReached) {
+			if (req->bodyBuffer.getTotalBytesBuffered() >= limit) {
+				// Apply backpressure until the app has consumed everything.
+				req->bodyChannel.stop();
+				req->bodyBuffer.setDataFlushedCallback(_bodyBufferDataFlushed);
+				return Channel::Result(buffer.size(), false);
+			}
+		} else if (limit > 0 && req->bodyBytesBuffered >= limit
+			&& req->bodyType != Request::RBT_CHUNKED)
+		{
+			SKC_DEBUG(client, "Buffered " << req->bodyBytesBuffered << " bytes of "
+				"client request body, which is more than the limit of " << limit <<
+				" bytes. Checking out a session before the end of the body is reached");
+			P_ASSERT_EQ(req->state, Request::BUFFERING_REQUEST_BODY);
+			req->bodyBufferLimitReached = true;
+			req->bodyChannel.stop();
+			req->bodyBuffer.clearBuffersFlushedCallback();
+			req->bodyBuffer.setDataFlushedCallback(_bodyBufferDataFlushed);
+			checkoutSession(client, req);
+			return Channel::Result(buffer.size(), false);
+		}
+
 		if (req->bodyBuffer.passedThreshold()) {
 			// Apply backpressure..
 			req->bodyChannel.stop();
@@ -100,6 +145,12 @@ Controller::whenBufferingBody_onRequestBody(Client *client, Request *req,
 		// EOF
 		SKC_TRACE(client, 2, "End of request body encountered");
 		req->bodyBuffer.feed(MemoryKit::mbuf());
+		if (req->bodyBufferLimitReached) {
+			// The session has already been checked out, and the app has
+			// already received the headers. bodyBuffer passes the EOF on.
+			req->bodyBuffer.clearDataFlushedCallback();
+			return Channel::Result(0, true);
+		}
 		if (req->bodyType == Request::RBT_CHUNKED) {
 			// The data that we've stored in the body buffer is dechunked, so when forwarding
 			// the buffered body to the app we must advertise it as being a fixed-length,
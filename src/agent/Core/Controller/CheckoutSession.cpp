@@ -62,15 +62,20 @@ Controller::checkoutSession(Client *client, Request *req) {
 		assert(!req->bodyChannel.isStarted());
 	}
 
+	if (usePrefetchedSession(client, req)) {
+		return;
+	}
+
 	callback.func = sessionCheckedOut;
 	callback.userData = req;
 
 	options.currentTime = SystemTime::getUsec();
 
 	refRequest(req, __FILE__, __LINE__);
-	#ifdef DEBUG_CC_EVENT_LOOP_BLOCKING
+	if (req->timeBeforeAccessingApplicationPool == 0) {
+		// Checkouts may be retried. We measure from the first attempt.
 		req->timeBeforeAccessingApplicationPool = ev_now(getLoop());
-	#endif
+	}
 	asyncGetFromApplicationPool(req, callback);
 	#ifdef DEBUG_CC_EVENT_LOOP_BLOCKING
 		if (!req->timedAppPoolGet) {
@@ -87,6 +92,11 @@ Controller::asyncGetFromApplicationPool(Request *req, ApplicationPool2::GetCallb
 	appPool->asyncGet(req->options, callback, true);
 }
 
+bool
+Controller::canRouteImmediately(Request *req) {
+	return appPool->canRouteImmediately(req->options);
+}
+
 void
 Controller::sessionCheckedOut(const AbstractSessionPtr &session, const ExceptionPtr &e,
 	void *userData)
@@ -99,19 +109,191 @@ Controller::sessionCheckedOut(const AbstractSessionPtr &session, const Exception
 		self->sessionCheckedOutFromEventLoopThread(client, req, session, e);
 		self->unrefRequest(req, __FILE__, __LINE__);
 	} else {
-		self->getContext()->libev->runLater(
-			boost::bind(&Controller::sessionCheckedOutFromAnotherThread,
-				self, client, req, session, e));
+		// We still hold the reference that checkoutSession() took, so
+		// nobody else is using the request's eventLoopThreadTask.
+		req->checkedOutSession = session;
+		req->checkoutException = e;
+		req->eventLoopThreadTask.callback = sessionCheckedOutFromAnotherThread;
+		req->eventLoopThreadTask.data = req;
+		self->getContext()->libev->runLater(&req->eventLoopThreadTask);
 	}
 }
 
 void
-Controller::sessionCheckedOutFromAnotherThread(Client *client, Request *req,
-	AbstractSessionPtr session, ExceptionPtr e)
+Controller::sessionCheckedOutFromAnotherThread(SafeLibev::Task *task) {
+	Request *req = static_cast<Request *>(task->data);
+	Client *client = static_cast<Client *>(req->client);
+	Controller *self = static_cast<Controller *>(
+		Controller::getServerFromClient(client));
+	SKC_LOG_EVENT_FROM_STATIC(self, Controller, client, "sessionCheckedOutFromAnotherThread");
+
+	AbstractSessionPtr session;
+	ExceptionPtr e;
+	session.swap(req->checkedOutSession);
+	e.swap(req->checkoutException);
+	self->sessionCheckedOutFromEventLoopThread(client, req, session, e);
+	self->unrefRequest(req, __FILE__, __LINE__);
+}
+
+/**
+ * Checks out a session for `req`, the first request that is queued
+ * behind the current request on the same connection, so that `req`
+ * doesn't have to wait for the application pool once it begins.
+ *
+ * The session occupies a slot in its process until `req` is done, so we
+ * only do this if `req` is routed to the same app group as the current
+ * request (the only one whose options we know before `req` begins), and
+ * if that group can handle another request right away. We never want to
+ * queue in the pool on behalf of a request that hasn't begun yet.
+ */
+void
+Controller::prefetchSession(Client *client, Request *req) {
+	Request *current = client->currentRequest;
+	GetCallback callback;
+
+	if (req->httpState != Request::COMPLETE
+	 || req->prefetchingSession
+	 || req->prefetchedSession != NULL
+	 || current == NULL
+	 || current->ended()
+	 || current->session == NULL
+	 || current->stickySession)
+	{
+		return;
+	}
+	if (!mainConfig.singleAppMode) {
+		// Config profiles are only looked up when the request begins,
+		// so we can only compare app group names that the request
+		// carries itself.
+		const LString *appGroupName = req->secureHeaders.lookup(PASSENGER_APP_GROUP_NAME);
+		if (appGroupName == NULL
+		 || !psg_lstr_cmp(appGroupName, current->options.getAppGroupName()))
+		{
+			return;
+		}
+	}
+	if (!canRouteImmediately(current)) {
+		return;
+	}
+
+	SKC_TRACE(client, 2, "Checking out session for pipelined request: appGroupName="
+		<< current->options.getAppGroupName());
+	req->prefetchingSession = true;
+	req->prefetchedAppGroupName = current->options.getAppGroupName();
+
+	callback.func = sessionPrefetched;
+	callback.userData = req;
+
+	current->options.currentTime = SystemTime::getUsec();
+
+	refRequest(req, __FILE__, __LINE__);
+	asyncGetFromApplicationPool(current, callback);
+}
+
+void
+Controller::sessionPrefetched(const AbstractSessionPtr &session, const ExceptionPtr &e,
+	void *userData)
 {
-	SKC_LOG_EVENT(Controller, client, "sessionCheckedOutFromAnotherThread");
-	sessionCheckedOutFromEventLoopThread(client, req, session, e);
-	unrefRequest(req, __FILE__, __LINE__);
+	Request *req = static_cast<Request *>(userData);
+	Client *client = static_cast<Client *>(req->client);
+	Controller *self = static_cast<Controller *>(getServerFromClient(client));
+
+	if (self->getContext()->libev->onEventLoopThread()) {
+		self->sessionPrefetchedFromEventLoopThread(client, req, session, e);
+		self->unrefRequest(req, __FILE__, __LINE__);
+	} else {
+		// We still hold the reference that prefetchSession() took, and
+		// the request doesn't check out another session until this one
+		// has arrived, so nobody else is using its eventLoopThreadTask.
+		req->checkedOutSession = session;
+		req->checkoutException = e;
+		req->eventLoopThreadTask.callback = sessionPrefetchedFromAnotherThread;
+		req->eventLoopThreadTask.data = req;
+		self->getContext()->libev->runLater(&req->eventLoopThreadTask);
+	}
+}
+
+void
+Controller::sessionPrefetchedFromAnotherThread(SafeLibev::Task *task) {
+	Request *req = static_cast<Request *>(task->data);
+	Client *client = static_cast<Client *>(req->client);
+	Controller *self = static_cast<Controller *>(
+		Controller::getServerFromClient(client));
+	SKC_LOG_EVENT_FROM_STATIC(self, Controller, client, "sessionPrefetchedFromAnotherThread");
+
+	AbstractSessionPtr session;
+	ExceptionPtr e;
+	session.swap(req->checkedOutSession);
+	e.swap(req->checkoutException);
+	self->sessionPrefetchedFromEventLoopThread(client, req, session, e);
+	self->unrefRequest(req, __FILE__, __LINE__);
+}
+
+void
+Controller::sessionPrefetchedFromEventLoopThread(Client *client, Request *req,
+	const AbstractSessionPtr &session, const ExceptionPtr &e)
+{
+	bool waiting = req->waitingForPrefetchedSession;
+
+	req->prefetchingSession = false;
+	req->waitingForPrefetchedSession = false;
+
+	if (req->ended()) {
+		if (session != NULL) {
+			session->resetCheckoutTime(0);
+		}
+		return;
+	}
+
+	if (e == NULL) {
+		SKC_DEBUG(client, "Session checked out for pipelined request: pid=" <<
+			session->getPid() << ", gupid=" << session->getGupid());
+		req->prefetchedSession = session;
+	} else {
+		// The request checks out a session the normal way once it
+		// begins, and reports the error then if there still is one.
+		SKC_DEBUG(client, "Could not check out a session for pipelined request");
+	}
+	if (waiting) {
+		checkoutSession(client, req);
+	}
+}
+
+/**
+ * Called when `req` is about to check out a session. If a session has
+ * been (or is being) checked out for it while it was queued, then we
+ * use that instead, and return true.
+ */
+bool
+Controller::usePrefetchedSession(Client *client, Request *req) {
+	if (req->prefetchingSession) {
+		SKC_TRACE(client, 2, "Waiting for the session that is being checked out"
+			" for this pipelined request");
+		req->waitingForPrefetchedSession = true;
+		return true;
+	} else if (req->prefetchedSession == NULL) {
+		return false;
+	}
+
+	AbstractSessionPtr session;
+	session.swap(req->prefetchedSession);
+	if (req->stickySession
+	 || req->options.getAppGroupName() != StaticString(req->prefetchedAppGroupName))
+	{
+		SKC_DEBUG(client, "Not using the session that was checked out for"
+			" this pipelined request, because the request is routed differently");
+		session->resetCheckoutTime(0);
+		return false;
+	}
+
+	// Don't count the time that the session spent waiting for the
+	// previous request as response time.
+	session->resetCheckoutTime(SystemTime::getUsec());
+	if (req->timeBeforeAccessingApplicationPool == 0) {
+		req->timeBeforeAccessingApplicationPool = ev_now(getLoop());
+	}
+	sessionCheckedOutFromEventLoopThread(client, req, session, ExceptionPtr());
+	return true;
 }
 
 void
@@ -125,6 +307,8 @@ Controller::sessionCheckedOutFromEventLoopThread(Client *client, Request *req,
 	TRACE_POINT();
 	CC_BENCHMARK_POINT(client, req, BM_AFTER_CHECKOUT);
 
+	req->timeOnSessionCheckedOut = ev_now(getLoop());
+
 	#ifdef DEBUG_CC_EVENT_LOOP_BLOCKING
 		if (!req->timedAppPoolGet) {
 			req->timedAppPoolGet = true;
@@ -138,6 +322,9 @@ Controller::sessionCheckedOutFromEventLoopThread(Client *client, Request *req,
 		SKC_DEBUG(client, "Session checked out: pid=" << session->getPid() <<
 			", gupid=" << session->getGupid());
 		req->session = session;
+		if (!STAILQ_EMPTY(&client->pipelinedRequests)) {
+			prefetchSession(client, STAILQ_FIRST(&client->pipelinedRequests));
+		}
 		UPDATE_TRACE_POINT();
 		maybeSend100Continue(client, req);
 		UPDATE_TRACE_POINT();
@@ -152,12 +339,12 @@ void
 Controller::maybeSend100Continue(Client *client, Request *req) {
 	int httpVersion = req->httpMajor * 1000 + req->httpMinor * 10;
 	if (httpVersion >= 1010 && req->hasBody() && !req->strip100ContinueHeader) {
-		// Apps with the "session" protocol don't respond with 100-Continue,
+		// Apps with the "session" protocols don't respond with 100-Continue,
 		// so we do it for them.
 		const LString *value = req->headers.lookup(HTTP_EXPECT);
 		if (value != NULL
 		 && psg_lstr_cmp(value, P_STATIC_STRING("100-continue"))
-		 && req->session->getProtocol() == P_STATIC_STRING("session"))
+		 && isSessionProtocol(req->session->getProtocol()))
 		{
 			const unsigned int BUFSIZE = 32;
 			char *buf = (char *) psg_pnalloc(req->pool, BUFSIZE);
@@ -247,7 +434,7 @@ Controller::writeRequestQueueFullExceptionErrorResponse(Client *client, Request
 	const boost::shared_ptr<RequestQueueFullException> &e)
 {
 	TRACE_POINT();
-	const LString *value = req->secureHeaders.lookup(
+	const LString *value = req->lookupSecureHeader(
 		"!~PASSENGER_REQUEST_QUEUE_OVERFLOW_STATUS_CODE");
 	int requestQueueOverflowStatusCode = 503;
 	if (value != NULL && value->size > 0) {
@@ -38,6 +38,8 @@
 #include <ConfigKit/SchemaUtils.h>
 #include <MemoryKit/palloc.h>
 #include <ServerKit/HttpServer.h>
+#include <ServerKit/HeaderTable.h>
+#include <DataStructures/StringKeyTable.h>
 #include <AppTypes.h>
 #include <Constants.h>
 #include <Exceptions.h>
@@ -82,8 +84,10 @@ parseControllerBenchmarkMode(const StaticString &mode) {
  * by 'rake configkit_schemas_inline_comments')
  *
  *   accept_burst_count                                  unsigned integer   -          default(32)
+ *   adaptive_request_body_buffering                     boolean            -          default(false)
  *   benchmark_mode                                      string             -          -
  *   client_freelist_limit                               unsigned integer   -          default(0)
+ *   config_profiles                                     object             -          read_only
  *   default_abort_websockets_on_process_shutdown        boolean            -          default(true)
  *   default_app_file_descriptor_ulimit                  unsigned integer   -          -
  *   default_environment                                 string             -          default("production")
@@ -98,6 +102,7 @@ parseControllerBenchmarkMode(const StaticString &mode) {
  *   default_min_instances                               unsigned integer   -          default(1)
  *   default_nodejs                                      string             -          default("node")
  *   default_python                                      string             -          default("python")
+ *   default_routing_policy                              string             -          default("least_busy")
  *   default_ruby                                        string             -          default("ruby")
  *   default_server_name                                 string             required   -
  *   default_server_port                                 unsigned integer   required   -
@@ -108,16 +113,20 @@ parseControllerBenchmarkMode(const StaticString &mode) {
  *   graceful_exit                                       boolean            -          default(true)
  *   integration_mode                                    string             -          default("standalone"),read_only
  *   max_instances_per_app                               unsigned integer   -          read_only
+ *   max_pipelined_requests                              unsigned integer   -          default(8)
+ *   max_request_body_buffer_size                        unsigned integer   -          default(0)
  *   min_spare_clients                                   unsigned integer   -          default(0)
  *   multi_app                                           boolean            -          default(true),read_only
  *   request_freelist_limit                              unsigned integer   -          default(1024)
  *   response_buffer_high_watermark                      unsigned integer   -          default(134217728)
+ *   response_compression                                boolean            -          default(false)
+ *   serve_static_files                                  boolean            -          default(false)
  *   server_software                                     string             -          default("Phusion_Passenger/5.3.2")
  *   show_version_in_header                              boolean            -          default(true)
  *   start_reading_after_accept                          boolean            -          default(true)
  *   stat_throttle_rate                                  unsigned integer   -          default(10)
  *   thread_number                                       unsigned integer   required   read_only
- *   turbocaching                                        boolean            -          default(true),read_only
+ *   turbocaching                                        boolean            -          default(true)
  *   user_switching                                      boolean            -          default(true)
  *   vary_turbocache_by_cookie                           string             -          -
  *
@@ -132,15 +141,23 @@ private:
 
 		add("thread_number", UINT_TYPE, REQUIRED | READ_ONLY);
 		add("multi_app", BOOL_TYPE, OPTIONAL | READ_ONLY, true);
-		add("turbocaching", BOOL_TYPE, OPTIONAL | READ_ONLY, true);
+		add("turbocaching", BOOL_TYPE, OPTIONAL, true);
 		add("integration_mode", STRING_TYPE, OPTIONAL | READ_ONLY, DEFAULT_INTEGRATION_MODE);
+		add("config_profiles", OBJECT_TYPE, OPTIONAL | READ_ONLY);
 
 		add("user_switching", BOOL_TYPE, OPTIONAL, true);
 		add("stat_throttle_rate", UINT_TYPE, OPTIONAL, DEFAULT_STAT_THROTTLE_RATE);
 		add("show_version_in_header", BOOL_TYPE, OPTIONAL, true);
 		add("response_buffer_high_watermark", UINT_TYPE, OPTIONAL, DEFAULT_RESPONSE_BUFFER_HIGH_WATERMARK);
+		add("response_compression", BOOL_TYPE, OPTIONAL, false);
+		add("adaptive_request_body_buffering", BOOL_TYPE, OPTIONAL, false);
+		add("max_request_body_buffer_size", UINT_TYPE, OPTIONAL, 0);
+		add("serve_static_files", BOOL_TYPE, OPTIONAL, false);
 		add("graceful_exit", BOOL_TYPE, OPTIONAL, true);
 		add("benchmark_mode", STRING_TYPE, OPTIONAL);
+		// Sessions are checked out for pipelined requests while earlier
+		// requests are still being processed; see onRequestPipelined().
+		override("max_pipelined_requests", UINT_TYPE, OPTIONAL, 8);
 
 		add("default_ruby", STRING_TYPE, OPTIONAL, DEFAULT_RUBY);
 		add("default_python", STRING_TYPE, OPTIONAL, DEFAULT_PYTHON);
@@ -167,6 +184,7 @@ private:
 		add("default_max_request_queue_size", UINT_TYPE, OPTIONAL, DEFAULT_MAX_REQUEST_QUEUE_SIZE);
 		add("default_force_max_concurrent_requests_per_process", INT_TYPE, OPTIONAL, -1);
 		add("default_abort_websockets_on_process_shutdown", BOOL_TYPE, OPTIONAL, true);
+		add("default_routing_policy", STRING_TYPE, OPTIONAL, DEFAULT_ROUTING_POLICY);
 		add("default_max_requests", UINT_TYPE, OPTIONAL, 0);
 
 
@@ -199,6 +217,23 @@ private:
 			errors.push_back(Error("'{{benchmark_mode}}' is not set to a valid value"));
 		}
 
+		string routingPolicy = config["default_routing_policy"].asString();
+		if (routingPolicy != "least_busy" && routingPolicy != "response_time"
+		 && routingPolicy != "two_random_choices")
+		{
+			errors.push_back(Error("'{{default_routing_policy}}' must be either 'least_busy', 'response_time' or 'two_random_choices'"));
+		}
+
+		Json::Value configProfiles = config["config_profiles"];
+		Json::Value::const_iterator it, end = configProfiles.end();
+		for (it = configProfiles.begin(); it != end; it++) {
+			if (!it->isString() || it.name().size() > StringKeyTable<int>::MAX_KEY_LENGTH) {
+				errors.push_back(Error("'{{config_profiles}}' must map profile IDs"
+					" (of at most 255 characters) to strings"));
+				break;
+			}
+		}
+
 		/*******************/
 	}
 
@@ -400,16 +435,29 @@ public:
 	StaticString defaultEnvironment;
 	StaticString defaultSpawnMethod;
 	StaticString defaultMeteorAppSettings;
+	StaticString defaultRoutingPolicy;
 	unsigned int defaultAppFileDescriptorUlimit;
 	unsigned int defaultMinInstances;
 	unsigned int defaultMaxPreloaderIdleTime;
 	unsigned int defaultMaxRequestQueueSize;
 	unsigned int defaultMaxRequests;
+	unsigned int maxRequestBodyBufferSize;
 	int defaultForceMaxConcurrentRequestsPerProcess;
 	bool showVersionInHeader: 1;
+	bool responseCompression: 1;
+	bool adaptiveRequestBodyBuffering: 1;
+	bool serveStaticFiles: 1;
 	bool defaultAbortWebsocketsOnProcessShutdown;
 	bool defaultLoadShellEnvvars;
 
+	/**
+	 * The option sets that the web server registered through the
+	 * `config_profiles` option, indexed by profile ID. Each table contains
+	 * the secure headers that the web server would otherwise have to send
+	 * along with every request. See `Request::configProfile`.
+	 */
+	StringKeyTable<ServerKit::HeaderTable *> configProfiles;
+
 	/*******************/
 	/*******************/
 
@@ -432,22 +480,89 @@ public:
 		  defaultEnvironment(psg_pstrdup(pool, config["default_environment"].asString())),
 		  defaultSpawnMethod(psg_pstrdup(pool, config["default_spawn_method"].asString())),
 		  defaultMeteorAppSettings(psg_pstrdup(pool, config["default_meteor_app_settings"].asString())),
+		  defaultRoutingPolicy(psg_pstrdup(pool, config["default_routing_policy"].asString())),
 		  defaultAppFileDescriptorUlimit(config["default_app_file_descriptor_ulimit"].asUInt()),
 		  defaultMinInstances(config["default_min_instances"].asUInt()),
 		  defaultMaxPreloaderIdleTime(config["default_max_preloader_idle_time"].asUInt()),
 		  defaultMaxRequestQueueSize(config["default_max_request_queue_size"].asUInt()),
 		  defaultMaxRequests(config["default_max_requests"].asUInt()),
+		  maxRequestBodyBufferSize(config["max_request_body_buffer_size"].asUInt()),
 		  defaultForceMaxConcurrentRequestsPerProcess(config["default_force_max_concurrent_requests_per_process"].asInt()),
 		  showVersionInHeader(config["show_version_in_header"].asBool()),
+		  responseCompression(config["response_compression"].asBool()),
+		  adaptiveRequestBodyBuffering(config["adaptive_request_body_buffering"].asBool()),
+		  serveStaticFiles(config["serve_static_files"].asBool()),
 		  defaultAbortWebsocketsOnProcessShutdown(config["default_abort_websockets_on_process_shutdown"].asBool()),
 		  defaultLoadShellEnvvars(config["default_load_shell_envvars"].asBool())
 
 		  /*******************/
-		{ }
+	{
+		loadConfigProfiles(config["config_profiles"]);
+	}
 
 	~ControllerRequestConfig() {
+		StringKeyTable<ServerKit::HeaderTable *>::Iterator it(configProfiles);
+		while (*it != NULL) {
+			delete it.getValue();
+			it.next();
+		}
 		psg_destroy_pool(pool);
 	}
+
+private:
+	void loadConfigProfiles(const Json::Value &doc) {
+		Json::Value::const_iterator it, end = doc.end();
+		for (it = doc.begin(); it != end; it++) {
+			ServerKit::HeaderTable *table = new ServerKit::HeaderTable();
+			parseConfigProfile(it->asString(), *table);
+			configProfiles.insert(it.name(), table);
+		}
+	}
+
+	/**
+	 * Parses a config profile, which is formatted as a block of
+	 * "!~NAME: value\r\n" lines, into the given table.
+	 */
+	void parseConfigProfile(const string &data, ServerKit::HeaderTable &table) {
+		string::size_type pos = 0;
+
+		while (pos < data.size()) {
+			string::size_type lineEnd = data.find("\r\n", pos);
+			if (lineEnd == string::npos) {
+				lineEnd = data.size();
+			}
+
+			string::size_type sep = data.find(": ", pos);
+			if (sep != string::npos && sep < lineEnd) {
+				insertConfigProfileHeader(table,
+					StaticString(data.data() + pos, sep - pos),
+					StaticString(data.data() + sep + 2, lineEnd - sep - 2));
+			}
+
+			pos = lineEnd + 2;
+		}
+	}
+
+	void insertConfigProfileHeader(ServerKit::HeaderTable &table,
+		const StaticString &name, const StaticString &value)
+	{
+		// Unlike HeaderTable::insert(pool, name, value), we don't downcase
+		// the key: secure header names are case-sensitive.
+		StaticString storedName = psg_pstrdup(pool, name);
+		StaticString storedValue = psg_pstrdup(pool, value);
+		ServerKit::Header *header = (ServerKit::Header *) psg_palloc(pool,
+			sizeof(ServerKit::Header));
+
+		psg_lstr_init(&header->key);
+		psg_lstr_append(&header->key, pool, storedName.data(), storedName.size());
+		psg_lstr_init(&header->origKey);
+		psg_lstr_append(&header->origKey, pool, storedName.data(), storedName.size());
+		psg_lstr_init(&header->val);
+		psg_lstr_append(&header->val, pool, storedValue.data(), storedValue.size());
+		header->hash = HashedStaticString(storedName).hash();
+
+		table.insert(&header, pool);
+	}
 };
 
 typedef boost::intrusive_ptr<ControllerRequestConfig> ControllerRequestConfigPtr;
@@ -208,7 +208,7 @@ Controller::onAppSourceData(Client *client, Request *req, const MemoryKit::mbuf
 				.feed(buffer));
 			resp->bodyAlreadyRead += event.consumed;
 
-			if (req->dechunkResponse) {
+			if (req->dechunkResponse || resp->compressed) {
 				UPDATE_TRACE_POINT();
 				switch (event.type) {
 				case ServerKit::HttpChunkedEvent::NONE:
@@ -297,6 +297,9 @@ Controller::onAppSourceData(Client *client, Request *req, const MemoryKit::mbuf
 			SKC_TRACE(client, 2, "Application sent EOF");
 			SKC_TRACE(client, 2, "Not keep-aliving application session connection");
 			req->session->close(true, false);
+			if (resp->compressed) {
+				writeCompressedResponse(client, req, NULL, 0, Z_FINISH);
+			}
 			endRequest(&client, &req);
 			return Channel::Result(0, false);
 		} else {
@@ -319,12 +322,12 @@ Controller::onAppResponseBegin(Client *client, Request *req) {
 	ssize_t bytesWritten;
 	bool oobw;
 
+	req->timeOnResponseBegun = ev_now(getLoop());
 	#ifdef DEBUG_CC_EVENT_LOOP_BLOCKING
-		req->timeOnRequestHeaderSent = ev_now(getLoop());
 		reportLargeTimeDiff(client,
 			"Headers sent until response begun",
 			req->timeOnRequestHeaderSent,
-			ev_now(getLoop()));
+			req->timeOnResponseBegun);
 	#endif
 
 	// Localize hash table operations for better CPU caching.
@@ -368,6 +371,9 @@ Controller::onAppResponseBegin(Client *client, Request *req) {
 		req->wantKeepAlive = false;
 	}
 
+	if (req->config->responseCompression) {
+		prepareAppResponseCompression(client, req);
+	}
 	prepareAppResponseCaching(client, req);
 
 	if (OXT_UNLIKELY(oobw)) {
@@ -406,6 +412,7 @@ Controller::prepareAppResponseCaching(Client *client, Request *req) {
 		 && turboCaching.responseCache.prepareRequestForStoring(req))
 		{
 			if (resp->bodyType == AppResponse::RBT_CONTENT_LENGTH
+			 && !resp->compressed
 			 && resp->aux.bodyInfo.contentLength > ResponseCache<Request>::MAX_BODY_SIZE)
 			{
 				SKC_DEBUG(client, "Response body larger than " <<
@@ -429,6 +436,96 @@ Controller::prepareAppResponseCaching(Client *client, Request *req) {
 	}
 }
 
+/**
+ * Decides whether the app response body should be gzipped before it is
+ * sent to the client, and if so, sets up the compression stream.
+ * Bodies that are small or that are not of a compressible content type
+ * (e.g. images, which are typically compressed already) are left alone.
+ */
+void
+Controller::prepareAppResponseCompression(Client *client, Request *req) {
+	TRACE_POINT();
+	AppResponse *resp = &req->appResponse;
+
+	if (!resp->hasBody()
+	 || (resp->bodyType == AppResponse::RBT_CONTENT_LENGTH
+	     && resp->aux.bodyInfo.contentLength < MIN_COMPRESSIBLE_RESPONSE_BODY_SIZE)
+	 // Byte ranges refer to the uncompressed body.
+	 || resp->statusCode == 206
+	 || resp->headers.lookup(HTTP_CONTENT_ENCODING) != NULL)
+	{
+		return;
+	}
+
+	const LString *contentType = resp->headers.lookup(HTTP_CONTENT_TYPE);
+	if (contentType == NULL || !contentTypeIsCompressible(contentType, req->pool)) {
+		return;
+	}
+
+	resp->compressible = true;
+	if (!req->acceptsGzip) {
+		return;
+	}
+
+	z_stream *stream = new z_stream();
+	// A window size of 15 + 16 makes zlib emit a gzip header and trailer.
+	int ret = deflateInit2(stream, RESPONSE_COMPRESSION_LEVEL, Z_DEFLATED,
+		15 + 16, 8, Z_DEFAULT_STRATEGY);
+	if (ret != Z_OK) {
+		SKC_WARN(client, "Cannot initialize response compression (zlib error "
+			<< ret << "); sending response uncompressed");
+		delete stream;
+		return;
+	}
+
+	SKC_TRACE(client, 2, "Compressing app response body with gzip");
+	resp->deflateStream = stream;
+	resp->compressed = true;
+}
+
+bool
+Controller::contentTypeIsCompressible(const LString *contentType, psg_pool_t *pool) {
+	// Same list as the gzip_types in the Standalone Nginx config,
+	// plus text/html which Nginx always compresses.
+	static const char * const types[] = {
+		"text/html",
+		"text/plain",
+		"text/css",
+		"text/json",
+		"text/javascript",
+		"text/xml",
+		"application/javascript",
+		"application/x-javascript",
+		"application/json",
+		"application/rss+xml",
+		"application/vnd.ms-fontobject",
+		"application/x-font-ttf",
+		"application/xml",
+		"font/opentype",
+		"image/svg+xml"
+	};
+
+	if (contentType->size == 0) {
+		return false;
+	}
+
+	contentType = psg_lstr_make_contiguous(contentType, pool);
+	const char *begin = contentType->start->data;
+	const char *end = (const char *) memchr(begin, ';', contentType->size);
+	if (end == NULL) {
+		end = begin + contentType->size;
+	}
+	skipTrailingWhitespaces(begin, &end);
+
+	size_t size = end - begin;
+	for (unsigned int i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+		if (size == strlen(types[i]) && strncasecmp(begin, types[i], size) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
 void
 Controller::onAppResponse100Continue(Client *client, Request *req) {
 	TRACE_POINT();
@@ -497,95 +594,108 @@ Controller::constructHeaderBuffersForResponse(Request *req, struct iovec *buffer
 	ServerKit::HeaderTable::Iterator it(resp->headers);
 	const LString::Part *part;
 	const char *statusAndReason;
+	StaticString statusLine, dateHeader;
 	unsigned int i = 0;
 
 	nbuffers = 0;
 	dataSize = 0;
 
-	PUSH_STATIC_BUFFER("HTTP/");
-
-	if (buffers != NULL) {
-		BEGIN_PUSH_NEXT_BUFFER();
-		const unsigned int BUFSIZE = 16;
-		char *buf = (char *) psg_pnalloc(req->pool, BUFSIZE);
-		const char *end = buf + BUFSIZE;
-		char *pos = buf;
-		pos += uintToString(req->httpMajor, pos, end - pos);
-		pos = appendData(pos, end, ".", 1);
-		pos += uintToString(req->httpMinor, pos, end - pos);
-		buffers[i].iov_base = (void *) buf;
-		buffers[i].iov_len  = pos - buf;
-		dataSize += pos - buf;
-	} else {
-		char buf[16];
-		const char *end = buf + sizeof(buf);
-		char *pos = buf;
-		pos += uintToString(req->httpMajor, pos, end - pos);
-		pos = appendData(pos, end, ".", 1);
-		pos += uintToString(req->httpMinor, pos, end - pos);
-		dataSize += pos - buf;
-	}
-	INC_BUFFER_ITER(i);
-
-	PUSH_STATIC_BUFFER(" ");
-
-	statusAndReason = getStatusCodeAndReasonPhrase(resp->statusCode);
-	if (statusAndReason != NULL) {
-		size_t len = strlen(statusAndReason);
-		BEGIN_PUSH_NEXT_BUFFER();
+	statusLine = responseHeaderCache.getStatusLine(req->httpMajor,
+		req->httpMinor, resp->statusCode);
+	if (OXT_LIKELY(!statusLine.empty())) {
 		if (buffers != NULL) {
 			BEGIN_PUSH_NEXT_BUFFER();
-			buffers[i].iov_base = (void *) statusAndReason;
-			buffers[i].iov_len  = len;
+			buffers[i].iov_base = (void *) statusLine.data();
+			buffers[i].iov_len  = statusLine.size();
 		}
 		INC_BUFFER_ITER(i);
-		dataSize += len;
-
-		PUSH_STATIC_BUFFER("\r\nStatus: ");
-		if (buffers != NULL) {
-			BEGIN_PUSH_NEXT_BUFFER();
-			buffers[i].iov_base = (void *) statusAndReason;
-			buffers[i].iov_len  = len;
-		}
-		INC_BUFFER_ITER(i);
-		dataSize += len;
-
-		PUSH_STATIC_BUFFER("\r\n");
+		dataSize += statusLine.size();
 	} else {
+		PUSH_STATIC_BUFFER("HTTP/");
+
 		if (buffers != NULL) {
 			BEGIN_PUSH_NEXT_BUFFER();
-			const unsigned int BUFSIZE = 8;
+			const unsigned int BUFSIZE = 16;
 			char *buf = (char *) psg_pnalloc(req->pool, BUFSIZE);
 			const char *end = buf + BUFSIZE;
 			char *pos = buf;
-			unsigned int size = uintToString(resp->statusCode, pos, end - pos);
+			pos += uintToString(req->httpMajor, pos, end - pos);
+			pos = appendData(pos, end, ".", 1);
+			pos += uintToString(req->httpMinor, pos, end - pos);
 			buffers[i].iov_base = (void *) buf;
-			buffers[i].iov_len  = size;
-			INC_BUFFER_ITER(i);
-			dataSize += size;
+			buffers[i].iov_len  = pos - buf;
+			dataSize += pos - buf;
+		} else {
+			char buf[16];
+			const char *end = buf + sizeof(buf);
+			char *pos = buf;
+			pos += uintToString(req->httpMajor, pos, end - pos);
+			pos = appendData(pos, end, ".", 1);
+			pos += uintToString(req->httpMinor, pos, end - pos);
+			dataSize += pos - buf;
+		}
+		INC_BUFFER_ITER(i);
 
-			PUSH_STATIC_BUFFER(" Unknown Reason-Phrase\r\nStatus: ");
+		PUSH_STATIC_BUFFER(" ");
+
+		statusAndReason = getStatusCodeAndReasonPhrase(resp->statusCode);
+		if (statusAndReason != NULL) {
+			size_t len = strlen(statusAndReason);
 			BEGIN_PUSH_NEXT_BUFFER();
-			buffers[i].iov_base = (void *) buf;
-			buffers[i].iov_len  = size;
+			if (buffers != NULL) {
+				BEGIN_PUSH_NEXT_BUFFER();
+				buffers[i].iov_base = (void *) statusAndReason;
+				buffers[i].iov_len  = len;
+			}
 			INC_BUFFER_ITER(i);
-			dataSize += size;
+			dataSize += len;
+
+			PUSH_STATIC_BUFFER("\r\nStatus: ");
+			if (buffers != NULL) {
+				BEGIN_PUSH_NEXT_BUFFER();
+				buffers[i].iov_base = (void *) statusAndReason;
+				buffers[i].iov_len  = len;
+			}
+			INC_BUFFER_ITER(i);
+			dataSize += len;
 
 			PUSH_STATIC_BUFFER("\r\n");
 		} else {
-			char buf[8];
-			const char *end = buf + sizeof(buf);
-			char *pos = buf;
-			unsigned int size = uintToString(resp->statusCode, pos, end - pos);
-			INC_BUFFER_ITER(i);
-			dataSize += size;
+			if (buffers != NULL) {
+				BEGIN_PUSH_NEXT_BUFFER();
+				const unsigned int BUFSIZE = 8;
+				char *buf = (char *) psg_pnalloc(req->pool, BUFSIZE);
+				const char *end = buf + BUFSIZE;
+				char *pos = buf;
+				unsigned int size = uintToString(resp->statusCode, pos, end - pos);
+				buffers[i].iov_base = (void *) buf;
+				buffers[i].iov_len  = size;
+				INC_BUFFER_ITER(i);
+				dataSize += size;
 
-			dataSize += sizeof(" Unknown Reason-Phrase\r\nStatus: ") - 1;
-			INC_BUFFER_ITER(i);
-			dataSize += size;
-			INC_BUFFER_ITER(i);
-			dataSize += sizeof("\r\n");
-			INC_BUFFER_ITER(i);
+				PUSH_STATIC_BUFFER(" Unknown Reason-Phrase\r\nStatus: ");
+				BEGIN_PUSH_NEXT_BUFFER();
+				buffers[i].iov_base = (void *) buf;
+				buffers[i].iov_len  = size;
+				INC_BUFFER_ITER(i);
+				dataSize += size;
+
+				PUSH_STATIC_BUFFER("\r\n");
+			} else {
+				char buf[8];
+				const char *end = buf + sizeof(buf);
+				char *pos = buf;
+				unsigned int size = uintToString(resp->statusCode, pos, end - pos);
+				INC_BUFFER_ITER(i);
+				dataSize += size;
+
+				dataSize += sizeof(" Unknown Reason-Phrase\r\nStatus: ") - 1;
+				INC_BUFFER_ITER(i);
+				dataSize += size;
+				INC_BUFFER_ITER(i);
+				dataSize += sizeof("\r\n");
+				INC_BUFFER_ITER(i);
+			}
 		}
 	}
 
@@ -632,23 +742,20 @@ Controller::constructHeaderBuffersForResponse(Request *req, struct iovec *buffer
 
 	// Add Date header. https://code.google.com/p/phusion-passenger/issues/detail?id=485
 	if (resp->date == NULL) {
-		unsigned int size;
-
+		dateHeader = responseHeaderCache.getDateHeader(
+			(time_t) ev_now(getContext()->libev->getLoop()));
 		if (buffers != NULL) {
+			// The cached Date header is overwritten when the second changes,
+			// but these buffers may be gathered much later by
+			// storeAppResponseInTurboCache(), so we copy it.
 			BEGIN_PUSH_NEXT_BUFFER();
-			const unsigned int BUFSIZE = 60;
-			char *dateStr = (char *) psg_pnalloc(req->pool, BUFSIZE);
-			size = constructDateHeaderBuffersForResponse(dateStr, BUFSIZE);
-			buffers[i].iov_base = dateStr;
-			buffers[i].iov_len  = size;
-		} else {
-			char dateStr[60];
-			size = constructDateHeaderBuffersForResponse(dateStr, sizeof(dateStr));
+			char *date = (char *) psg_pnalloc(req->pool, dateHeader.size());
+			memcpy(date, dateHeader.data(), dateHeader.size());
+			buffers[i].iov_base = (void *) date;
+			buffers[i].iov_len  = dateHeader.size();
 		}
 		INC_BUFFER_ITER(i);
-		dataSize += size;
-
-		PUSH_STATIC_BUFFER("\r\n");
+		dataSize += dateHeader.size();
 	}
 
 	if (resp->setCookie != NULL) {
@@ -672,9 +779,19 @@ Controller::constructHeaderBuffersForResponse(Request *req, struct iovec *buffer
 		PUSH_STATIC_BUFFER("\r\n");
 	}
 
+	if (resp->compressed) {
+		PUSH_STATIC_BUFFER("Content-Encoding: gzip\r\n");
+	}
+	if (resp->compressible) {
+		PUSH_STATIC_BUFFER("Vary: Accept-Encoding\r\n");
+	}
+
 	nCacheableBuffers = i;
 
-	if (resp->bodyType == AppResponse::RBT_CONTENT_LENGTH) {
+	if (resp->compressed) {
+		// The compressed body size is not known in advance.
+		PUSH_STATIC_BUFFER("Transfer-Encoding: chunked\r\n");
+	} else if (resp->bodyType == AppResponse::RBT_CONTENT_LENGTH) {
 		PUSH_STATIC_BUFFER("Content-Length: ");
 		if (buffers != NULL) {
 			BEGIN_PUSH_NEXT_BUFFER();
@@ -789,19 +906,6 @@ Controller::constructHeaderBuffersForResponse(Request *req, struct iovec *buffer
 	#undef PUSH_STATIC_BUFFER
 }
 
-unsigned int
-Controller::constructDateHeaderBuffersForResponse(char *dateStr, unsigned int bufsize) {
-	char *pos = dateStr;
-	const char *end = dateStr + bufsize - 1;
-	time_t the_time = (time_t) ev_now(getContext()->libev->getLoop());
-	struct tm the_tm;
-
-	pos = appendData(pos, end, "Date: ");
-	gmtime_r(&the_time, &the_tm);
-	pos += strftime(pos, end - pos, "%a, %d %b %Y %H:%M:%S GMT", &the_tm);
-	return pos - dateStr;
-}
-
 bool
 Controller::sendResponseHeaderWithWritev(Client *client, Request *req,
 	ssize_t &bytesWritten)
@@ -814,7 +918,7 @@ Controller::sendResponseHeaderWithWritev(Client *client, Request *req,
 	}
 
 	unsigned int maxbuffers = std::min<unsigned int>(
-		8 + req->appResponse.headers.size() * 4 + 11, IOV_MAX);
+		8 + req->appResponse.headers.size() * 4 + 13, IOV_MAX);
 	struct iovec *buffers = (struct iovec *) psg_palloc(req->pool,
 		sizeof(struct iovec) * maxbuffers);
 	unsigned int nbuffers, dataSize, nCacheableBuffers;
@@ -956,12 +1060,94 @@ void
 Controller::writeResponseAndMarkForTurboCaching(Client *client, Request *req,
 	const MemoryKit::mbuf &buffer)
 {
+	if (req->appResponse.compressed) {
+		// Compressed data is only flushed at the end of fixed-size
+		// bodies, which are unlikely to be streamed.
+		writeCompressedResponse(client, req, buffer.start, buffer.size(),
+			(req->appResponse.bodyType == AppResponse::RBT_CONTENT_LENGTH)
+				? Z_NO_FLUSH
+				: Z_SYNC_FLUSH);
+		return;
+	}
 	if (OXT_LIKELY(mainConfig.benchmarkMode != BM_RESPONSE_BEGIN)) {
 		writeResponse(client, buffer);
 	}
 	markResponsePartForTurboCaching(client, req, buffer);
 }
 
+/**
+ * Feeds the given part of the app response body into the response's gzip
+ * stream, and sends the compressed output to the client as chunks of the
+ * chunked transfer encoding. The compressed output (not the chunk framing)
+ * is also marked for turbocaching. Pass `Z_FINISH` as `flush` at the end of
+ * the body, which also sends the terminating chunk.
+ */
+void
+Controller::writeCompressedResponse(Client *client, Request *req,
+	const char *data, unsigned int size, int flush)
+{
+	// Leave room in front of the compressed data for the chunk size line,
+	// and after it for the chunk's CRLF and the terminating chunk.
+	const unsigned int CHUNK_HEADER_MAX_SIZE = sizeof(unsigned int) * 2 + 2;
+	const unsigned int CHUNK_TRAILER_MAX_SIZE = sizeof("\r\n0\r\n\r\n") - 1;
+	MemoryKit::mbuf_pool &mbuf_pool = getContext()->mbuf_pool;
+	const unsigned int MBUF_MAX_SIZE = mbuf_pool_data_size(&mbuf_pool);
+	z_stream *stream = req->appResponse.deflateStream;
+	bool done;
+
+	stream->next_in = (Bytef *) data;
+	stream->avail_in = size;
+
+	do {
+		MemoryKit::mbuf buffer(MemoryKit::mbuf_get(&mbuf_pool));
+		char *output = buffer.start + CHUNK_HEADER_MAX_SIZE;
+		const char *bufferEnd = buffer.start + MBUF_MAX_SIZE;
+		unsigned int outputSize = MBUF_MAX_SIZE - CHUNK_HEADER_MAX_SIZE
+			- CHUNK_TRAILER_MAX_SIZE;
+
+		stream->next_out = (Bytef *) output;
+		stream->avail_out = outputSize;
+		int ret = deflate(stream, flush);
+		if (OXT_UNLIKELY(ret == Z_STREAM_ERROR)) {
+			P_BUG("zlib deflate() returned Z_STREAM_ERROR");
+		}
+		if (flush == Z_FINISH) {
+			done = ret == Z_STREAM_END;
+		} else {
+			// deflate() has consumed all input and flushed as much as
+			// requested if it didn't run out of output space.
+			done = stream->avail_out != 0;
+		}
+
+		unsigned int compressedSize = outputSize - stream->avail_out;
+		char *begin = output;
+		char *end = output + compressedSize;
+		if (compressedSize > 0) {
+			char sizeStr[sizeof(unsigned int) * 2 + 1];
+			unsigned int sizeStrLen = integerToOtherBase<unsigned int, 16>(
+				compressedSize, sizeStr, sizeof(sizeStr));
+			begin -= sizeStrLen + 2;
+			memcpy(begin, sizeStr, sizeStrLen);
+			memcpy(output - 2, "\r\n", 2);
+			end = appendData(end, bufferEnd, "\r\n", 2);
+
+			markResponsePartForTurboCaching(client, req,
+				MemoryKit::mbuf(buffer, CHUNK_HEADER_MAX_SIZE, compressedSize));
+		}
+		if (flush == Z_FINISH && done) {
+			end = appendData(end, bufferEnd, "0\r\n\r\n", 5);
+		}
+
+		if (end > begin && OXT_LIKELY(mainConfig.benchmarkMode != BM_RESPONSE_BEGIN)) {
+			writeResponse(client, MemoryKit::mbuf(buffer, begin - buffer.start,
+				end - begin));
+			if (req->ended()) {
+				return;
+			}
+		}
+	} while (!done);
+}
+
 void
 Controller::markResponsePartForTurboCaching(Client *client, Request *req,
 	const MemoryKit::mbuf &buffer)
@@ -1054,6 +1240,12 @@ Controller::outputDataFlushed(Client *client, Request *req) {
 void
 Controller::handleAppResponseBodyEnd(Client *client, Request *req) {
 	keepAliveAppConnection(client, req);
+	if (req->appResponse.compressed) {
+		writeCompressedResponse(client, req, NULL, 0, Z_FINISH);
+		if (req->ended()) {
+			return;
+		}
+	}
 	storeAppResponseInTurboCache(client, req);
 	assert(!req->ended());
 }
@@ -129,24 +129,32 @@ Controller::reinitializeRequest(Client *client, Request *req) {
 	req->requestBodyBuffering = false;
 	req->https = false;
 	req->stickySession = false;
+	req->acceptsGzip = false;
 	req->sessionCheckoutTry = 0;
 	req->halfClosePolicy = Request::HALF_CLOSE_POLICY_UNINITIALIZED;
 	req->appResponseInitialized = false;
 	req->strip100ContinueHeader = false;
 	req->hasPragmaHeader = false;
+	req->staticFileSendfile = true;
+	req->bodyBufferLimitReached = false;
+	req->prefetchingSession = false;
+	req->waitingForPrefetchedSession = false;
 	req->host = NULL;
 	req->config = requestConfig;
 	req->bodyBytesBuffered = 0;
+	req->staticFileOffset = 0;
 	req->cacheKey = HashedStaticString();
 	req->cacheControl = NULL;
 	req->varyCookie = NULL;
 	req->envvars = NULL;
+	req->configProfile = NULL;
+	req->timeBeforeAccessingApplicationPool = 0;
+	req->timeOnSessionCheckedOut = 0;
+	req->timeOnRequestHeaderSent = 0;
+	req->timeOnResponseBegun = 0;
 
 	#ifdef DEBUG_CC_EVENT_LOOP_BLOCKING
 		req->timedAppPoolGet = false;
-		req->timeBeforeAccessingApplicationPool = 0;
-		req->timeOnRequestHeaderSent = 0;
-		req->timeOnResponseBegun = 0;
 	#endif
 
 	/***************/
@@ -154,13 +162,24 @@ Controller::reinitializeRequest(Client *client, Request *req) {
 
 void
 Controller::deinitializeRequest(Client *client, Request *req) {
+	if (req->startedAt != 0) {
+		recordRequestLatencies(req);
+		req->startedAt = 0;
+	}
+
 	req->session.reset();
+	if (req->prefetchedSession != NULL) {
+		req->prefetchedSession->resetCheckoutTime(0);
+		req->prefetchedSession.reset();
+	}
 	req->config.reset();
+	req->staticFile.reset();
 
 	req->appSink.setConsumedCallback(NULL);
 	req->appSink.deinitialize();
 	req->appSource.deinitialize();
 	req->bodyBuffer.clearBuffersFlushedCallback();
+	req->bodyBuffer.clearDataFlushedCallback();
 	req->bodyBuffer.deinitialize();
 
 	/***************/
@@ -185,6 +204,8 @@ Controller::reinitializeAppResponse(Client *client, Request *req) {
 	resp->bodyType  = AppResponse::RBT_NO_BODY;
 	resp->wantKeepAlive = false;
 	resp->oneHundredContinueSent = false;
+	resp->compressible = false;
+	resp->compressed = false;
 	resp->statusCode = 0;
 	resp->parserState.headerParser = getHeaderParserStatePool().construct();
 	createAppResponseHeaderParser(getContext(), req).initialize();
@@ -199,6 +220,7 @@ Controller::reinitializeAppResponse(Client *client, Request *req) {
 	resp->headerCacheBuffers = NULL;
 	resp->nHeaderCacheBuffers = 0;
 	psg_lstr_init(&resp->bodyCacheBuffer);
+	resp->deflateStream = NULL;
 }
 
 void
@@ -237,6 +259,12 @@ Controller::deinitializeAppResponse(Client *client, Request *req) {
 		psg_lstr_deinit(resp->setCookie);
 	}
 	psg_lstr_deinit(&resp->bodyCacheBuffer);
+
+	if (resp->deflateStream != NULL) {
+		deflateEnd(resp->deflateStream);
+		delete resp->deflateStream;
+		resp->deflateStream = NULL;
+	}
 }
 
 ServerKit::Channel::Result
@@ -247,7 +275,19 @@ Controller::onRequestBody(Client *client, Request *req, const MemoryKit::mbuf &b
 	case Request::BUFFERING_REQUEST_BODY:
 		return whenBufferingBody_onRequestBody(client, req, buffer, errcode);
 	case Request::FORWARDING_BODY_TO_APP:
-		return whenSendingRequest_onRequestBody(client, req, buffer, errcode);
+	case Request::WAITING_FOR_APP_OUTPUT:
+		if (req->requestBodyBuffering) {
+			// The session was checked out before the end of the body was
+			// buffered (see `Request::bodyBufferLimitReached`). The rest of
+			// the body still passes through bodyBuffer.
+			assert(req->bodyBufferLimitReached);
+			return whenBufferingBody_onRequestBody(client, req, buffer, errcode);
+		} else if (req->state == Request::FORWARDING_BODY_TO_APP) {
+			return whenSendingRequest_onRequestBody(client, req, buffer, errcode);
+		} else {
+			P_BUG("Unknown state " << req->state);
+			return Channel::Result(0, false);
+		}
 	default:
 		P_BUG("Unknown state " << req->state);
 		return Channel::Result(0, false);
@@ -267,6 +307,18 @@ Controller::onNextRequestEarlyReadError(Client *client, Request *req, int errcod
 	}
 }
 
+void
+Controller::onRequestPipelined(Client *client, Request *req) {
+	ParentClass::onRequestPipelined(client, req);
+	// Later queued requests are taken care of in
+	// sessionCheckedOutFromEventLoopThread(), once the request in front
+	// of them has become the current request. That way each client holds
+	// at most one session ahead of time.
+	if (STAILQ_FIRST(&client->pipelinedRequests) == req) {
+		prefetchSession(client, req);
+	}
+}
+
 bool
 Controller::shouldDisconnectClientOnShutdown(Client *client) {
 	return ParentClass::shouldDisconnectClientOnShutdown(client)
@@ -48,7 +48,8 @@ using namespace boost;
 
 struct Controller::RequestAnalysis {
 	const LString *flags;
-	ServerKit::HeaderTable::Cell *appGroupNameCell;
+	const ServerKit::HeaderTable::Cell *appGroupNameCell;
+	const LString *acceptEncoding;
 };
 
 
@@ -98,6 +99,117 @@ Controller::initializeFlags(Client *client, Request *req, RequestAnalysis &analy
 	}
 }
 
+void
+Controller::initializeResponseCompression(Client *client, Request *req,
+	RequestAnalysis &analysis)
+{
+	// Compressed responses are sent with the chunked transfer encoding,
+	// which HTTP/1.0 clients and dechunking web servers don't support.
+	unsigned int httpVersion = req->httpMajor * 1000 + req->httpMinor * 10;
+	if (analysis.acceptEncoding != NULL
+	 && httpVersion >= 1010
+	 && !req->dechunkResponse
+	 && acceptEncodingAllows(analysis.acceptEncoding, P_STATIC_STRING("gzip"), req->pool))
+	{
+		SKC_TRACE(client, 2, "Client accepts gzip-encoded responses");
+		req->acceptsGzip = true;
+	}
+}
+
+/**
+ * Checks whether the given Accept-Encoding header value allows the given
+ * content coding: either explicitly, or through "*" if it is not listed.
+ * "x-gzip" is treated as an alias of "gzip".
+ */
+bool
+Controller::acceptEncodingAllows(const LString *value, const StaticString &coding,
+	psg_pool_t *pool)
+{
+	if (value->size == 0) {
+		return false;
+	}
+
+	value = psg_lstr_make_contiguous(value, pool);
+	const char *pos = value->start->data;
+	const char *end = value->start->data + value->size;
+	bool isGzip = coding == "gzip";
+	int listed = -1, wildcard = -1;
+
+	while (pos < end) {
+		const char *itemEnd = (const char *) memchr(pos, ',', end - pos);
+		if (itemEnd == NULL) {
+			itemEnd = end;
+		}
+		const char *codingEnd = (const char *) memchr(pos, ';', itemEnd - pos);
+		if (codingEnd == NULL) {
+			codingEnd = itemEnd;
+		}
+		const char *params = codingEnd;
+
+		skipLeadingWhitespaces(&pos, codingEnd);
+		skipTrailingWhitespaces(pos, &codingEnd);
+		StaticString item(pos, codingEnd - pos);
+		bool allowed = !qualityValueIsZero(params, itemEnd);
+
+		if ((item.size() == coding.size()
+		  && strncasecmp(item.data(), coding.data(), coding.size()) == 0)
+		 || (isGzip && item.size() == 6 && strncasecmp(item.data(), "x-gzip", 6) == 0))
+		{
+			listed = allowed;
+		} else if (item == "*") {
+			wildcard = allowed;
+		}
+
+		pos = itemEnd + 1;
+	}
+
+	if (listed != -1) {
+		return listed == 1;
+	} else {
+		return wildcard == 1;
+	}
+}
+
+/**
+ * Given the parameters of an Accept-Encoding item (e.g. ";q=0.5"),
+ * checks whether they contain a quality value of zero, which means
+ * "not acceptable".
+ */
+bool
+Controller::qualityValueIsZero(const char *params, const char *end) {
+	const char *pos = params;
+
+	while (pos < end) {
+		// Skip the ';'.
+		pos++;
+		skipLeadingWhitespaces(&pos, end);
+		const char *paramEnd = (const char *) memchr(pos, ';', end - pos);
+		if (paramEnd == NULL) {
+			paramEnd = end;
+		}
+
+		if (paramEnd - pos >= 2 && (pos[0] == 'q' || pos[0] == 'Q') && pos[1] == '=') {
+			const char *value = pos + 2;
+			const char *valueEnd = paramEnd;
+			skipTrailingWhitespaces(value, &valueEnd);
+			// A zero quality value is "0", optionally followed by '.' and zeroes.
+			if (value == valueEnd || *value != '0') {
+				return false;
+			}
+			for (value++; value < valueEnd; value++) {
+				if (*value != '.' && *value != '0') {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		pos = paramEnd;
+	}
+
+	return false;
+}
+
 bool
 Controller::respondFromTurboCache(Client *client, Request *req) {
 	if (!turboCaching.isEnabled() || !turboCaching.responseCache.prepareRequest(this, req)) {
@@ -131,6 +243,33 @@ Controller::respondFromTurboCache(Client *client, Request *req) {
 	}
 }
 
+/**
+ * If the web server refers to a config profile that it registered at startup
+ * (see the `config_profiles` option), then it doesn't send the options in that
+ * profile as secure headers. Look up the profile so that the rest of the
+ * request handling code can find those options through
+ * `Request::lookupSecureHeader()`.
+ */
+void
+Controller::initializeConfigProfile(Client *client, Request *req) {
+	const LString *profileId = req->secureHeaders.lookup(PASSENGER_CONFIG_PROFILE);
+	if (profileId == NULL || profileId->size == 0) {
+		return;
+	}
+
+	profileId = psg_lstr_make_contiguous(profileId, req->pool);
+	ServerKit::HeaderTable **profile;
+	if (req->config->configProfiles.lookup(
+		HashedStaticString(profileId->start->data, profileId->size),
+		&profile))
+	{
+		req->configProfile = *profile;
+	} else {
+		disconnectWithError(&client, "the !~PASSENGER_CONFIG_PROFILE header refers"
+			" to an unknown config profile");
+	}
+}
+
 void
 Controller::initializePoolOptions(Client *client, Request *req, RequestAnalysis &analysis) {
 	boost::shared_ptr<Options> *options;
@@ -140,7 +279,7 @@ Controller::initializePoolOptions(Client *client, Request *req, RequestAnalysis
 		poolOptionsCache.lookupRandom(NULL, &options);
 		req->options = **options;
 	} else {
-		ServerKit::HeaderTable::Cell *appGroupNameCell = analysis.appGroupNameCell;
+		const ServerKit::HeaderTable::Cell *appGroupNameCell = analysis.appGroupNameCell;
 		if (appGroupNameCell != NULL && appGroupNameCell->header->val.size > 0) {
 			const LString *appGroupName = psg_lstr_make_contiguous(
 				&appGroupNameCell->header->val,
@@ -163,7 +302,7 @@ Controller::initializePoolOptions(Client *client, Request *req, RequestAnalysis
 	if (!req->ended()) {
 		// See comment for req->envvars to learn how it is different
 		// from req->options.environmentVariables.
-		req->envvars = req->secureHeaders.lookup(PASSENGER_ENV_VARS);
+		req->envvars = req->lookupSecureHeader(PASSENGER_ENV_VARS);
 		if (req->envvars != NULL && req->envvars->size > 0) {
 			req->envvars = psg_lstr_make_contiguous(req->envvars, req->pool);
 			req->options.environmentVariables = StaticString(
@@ -195,6 +334,7 @@ Controller::fillPoolOptionsFromConfigCaches(Options &options,
 	options.maxPreloaderIdleTime = requestConfig->defaultMaxPreloaderIdleTime;
 	options.maxRequestQueueSize = requestConfig->defaultMaxRequestQueueSize;
 	options.abortWebsocketsOnProcessShutdown = requestConfig->defaultAbortWebsocketsOnProcessShutdown;
+	options.routingPolicy = requestConfig->defaultRoutingPolicy;
 	options.forceMaxConcurrentRequestsPerProcess = requestConfig->defaultForceMaxConcurrentRequestsPerProcess;
 	options.environment = requestConfig->defaultEnvironment;
 	options.spawnMethod = requestConfig->defaultSpawnMethod;
@@ -209,7 +349,7 @@ void
 Controller::fillPoolOption(Request *req, StaticString &field,
 	const HashedStaticString &name)
 {
-	const LString *value = req->secureHeaders.lookup(name);
+	const LString *value = req->lookupSecureHeader(name);
 	if (value != NULL && value->size > 0) {
 		value = psg_lstr_make_contiguous(value, req->pool);
 		field = StaticString(value->start->data, value->size);
@@ -220,7 +360,7 @@ void
 Controller::fillPoolOption(Request *req, bool &field,
 	const HashedStaticString &name)
 {
-	const LString *value = req->secureHeaders.lookup(name);
+	const LString *value = req->lookupSecureHeader(name);
 	if (value != NULL && value->size > 0) {
 		field = psg_lstr_first_byte(value) == 't';
 	}
@@ -230,7 +370,7 @@ void
 Controller::fillPoolOption(Request *req, int &field,
 	const HashedStaticString &name)
 {
-	const LString *value = req->secureHeaders.lookup(name);
+	const LString *value = req->lookupSecureHeader(name);
 	if (value != NULL && value->size > 0) {
 		value = psg_lstr_make_contiguous(value, req->pool);
 		field = stringToInt(StaticString(value->start->data, value->size));
@@ -241,7 +381,7 @@ void
 Controller::fillPoolOption(Request *req, unsigned int &field,
 	const HashedStaticString &name)
 {
-	const LString *value = req->secureHeaders.lookup(name);
+	const LString *value = req->lookupSecureHeader(name);
 	if (value != NULL && value->size > 0) {
 		value = psg_lstr_make_contiguous(value, req->pool);
 		field = stringToUint(StaticString(value->start->data, value->size));
@@ -252,7 +392,7 @@ void
 Controller::fillPoolOption(Request *req, unsigned long &field,
 	const HashedStaticString &name)
 {
-	const LString *value = req->secureHeaders.lookup(name);
+	const LString *value = req->lookupSecureHeader(name);
 	if (value != NULL && value->size > 0) {
 		value = psg_lstr_make_contiguous(value, req->pool);
 		field = stringToUint(StaticString(value->start->data, value->size));
@@ -263,7 +403,7 @@ void
 Controller::fillPoolOption(Request *req, long &field,
 	const HashedStaticString &name)
 {
-	const LString *value = req->secureHeaders.lookup(name);
+	const LString *value = req->lookupSecureHeader(name);
 	if (value != NULL && value->size > 0) {
 		value = psg_lstr_make_contiguous(value, req->pool);
 		field = stringToInt(StaticString(value->start->data, value->size));
@@ -274,7 +414,7 @@ void
 Controller::fillPoolOptionSecToMsec(Request *req, unsigned int &field,
 	const HashedStaticString &name)
 {
-	const LString *value = req->secureHeaders.lookup(name);
+	const LString *value = req->lookupSecureHeader(name);
 	if (value != NULL && value->size > 0) {
 		value = psg_lstr_make_contiguous(value, req->pool);
 		field = stringToInt(StaticString(value->start->data, value->size)) * 1000;
@@ -285,18 +425,17 @@ void
 Controller::createNewPoolOptions(Client *client, Request *req,
 	const HashedStaticString &appGroupName)
 {
-	ServerKit::HeaderTable &secureHeaders = req->secureHeaders;
 	Options &options = req->options;
 
 	SKC_TRACE(client, 2, "Creating new pool options: app group name=" << appGroupName);
 
 	options = Options();
 
-	const LString *scriptName = secureHeaders.lookup("!~SCRIPT_NAME");
-	const LString *appRoot = secureHeaders.lookup("!~PASSENGER_APP_ROOT");
+	const LString *scriptName = req->lookupSecureHeader("!~SCRIPT_NAME");
+	const LString *appRoot = req->lookupSecureHeader("!~PASSENGER_APP_ROOT");
 	if (scriptName == NULL || scriptName->size == 0) {
 		if (appRoot == NULL || appRoot->size == 0) {
-			const LString *documentRoot = secureHeaders.lookup("!~DOCUMENT_ROOT");
+			const LString *documentRoot = req->lookupSecureHeader("!~DOCUMENT_ROOT");
 			if (OXT_UNLIKELY(documentRoot == NULL || documentRoot->size == 0)) {
 				disconnectWithError(&client, "client did not send a !~PASSENGER_APP_ROOT or a !~DOCUMENT_ROOT header");
 				return;
@@ -312,7 +451,7 @@ Controller::createNewPoolOptions(Client *client, Request *req,
 		options.appRoot = HashedStaticString(appRoot->start->data, appRoot->size);
 	} else {
 		if (appRoot == NULL || appRoot->size == 0) {
-			const LString *documentRoot = secureHeaders.lookup("!~DOCUMENT_ROOT");
+			const LString *documentRoot = req->lookupSecureHeader("!~DOCUMENT_ROOT");
 			if (OXT_UNLIKELY(documentRoot == NULL || documentRoot->size == 0)) {
 				disconnectWithError(&client, "client did not send a !~DOCUMENT_ROOT header");
 				return;
@@ -334,7 +473,7 @@ Controller::createNewPoolOptions(Client *client, Request *req,
 
 	fillPoolOptionsFromConfigCaches(options, req->pool, req->config);
 
-	const LString *appType = secureHeaders.lookup("!~PASSENGER_APP_TYPE");
+	const LString *appType = req->lookupSecureHeader("!~PASSENGER_APP_TYPE");
 	if (appType == NULL || appType->size == 0) {
 		AppTypeDetector detector;
 		PassengerAppType type = detector.checkAppRoot(options.appRoot);
@@ -364,6 +503,7 @@ Controller::createNewPoolOptions(Client *client, Request *req,
 	fillPoolOption(req, options.maxPreloaderIdleTime, "!~PASSENGER_MAX_PRELOADER_IDLE_TIME");
 	fillPoolOption(req, options.maxRequestQueueSize, "!~PASSENGER_MAX_REQUEST_QUEUE_SIZE");
 	fillPoolOption(req, options.abortWebsocketsOnProcessShutdown, "!~PASSENGER_ABORT_WEBSOCKETS_ON_PROCESS_SHUTDOWN");
+	fillPoolOption(req, options.routingPolicy, "!~PASSENGER_ROUTING_POLICY");
 	fillPoolOption(req, options.forceMaxConcurrentRequestsPerProcess, "!~PASSENGER_FORCE_MAX_CONCURRENT_REQUESTS_PER_PROCESS");
 	fillPoolOption(req, options.restartDir, "!~PASSENGER_RESTART_DIR");
 	fillPoolOption(req, options.startupFile, "!~PASSENGER_STARTUP_FILE");
@@ -438,13 +578,20 @@ Controller::onRequestBegin(Client *client, Request *req) {
 		// Perform hash table operations as close to header parsing as possible,
 		// and localize them as much as possible, for better CPU caching.
 		RequestAnalysis analysis;
+		initializeConfigProfile(client, req);
+		if (OXT_UNLIKELY(req->ended())) {
+			return;
+		}
 		analysis.flags = req->secureHeaders.lookup(FLAGS);
 		analysis.appGroupNameCell = mainConfig.singleAppMode
 			? NULL
-			: req->secureHeaders.lookupCell(PASSENGER_APP_GROUP_NAME);
+			: req->lookupSecureHeaderCell(PASSENGER_APP_GROUP_NAME);
 		req->stickySession = getBoolOption(req, PASSENGER_STICKY_SESSIONS,
 			mainConfig.defaultStickySessions);
 		req->host = req->headers.lookup(HTTP_HOST);
+		analysis.acceptEncoding = req->config->responseCompression
+			? req->headers.lookup(HTTP_ACCEPT_ENCODING)
+			: NULL;
 
 		/***************/
 		/***************/
@@ -454,6 +601,7 @@ Controller::onRequestBegin(Client *client, Request *req) {
 		req->bodyChannel.stop();
 
 		initializeFlags(client, req, analysis);
+		initializeResponseCompression(client, req, analysis);
 		if (respondFromTurboCache(client, req)) {
 			return;
 		}
@@ -461,12 +609,29 @@ Controller::onRequestBegin(Client *client, Request *req) {
 		if (req->ended()) {
 			return;
 		}
-		if (req->ended()) {
+		if (serveStaticFile(client, req)) {
 			return;
 		}
 		setStickySessionId(client, req);
 	}
 
+	if (req->requestBodyBuffering && req->hasBody()
+	 && req->bodyType != Request::RBT_CHUNKED
+	 && req->config->adaptiveRequestBodyBuffering
+	 && canRouteImmediately(req))
+	{
+		// Buffering protects the app against slow clients, but costs
+		// a round trip through the buffer dir for large bodies. It isn't
+		// worth it if a process can start handling the request right
+		// away. The pool may have changed by the time we check out a
+		// session, in which case the request is queued as usual.
+		// Chunked bodies are always buffered: the web server asks for
+		// buffering so that the app receives them with a Content-Length.
+		SKC_TRACE(client, 2, "A process is available right away; streaming "
+			"the request body to the application instead of buffering it");
+		req->requestBodyBuffering = false;
+	}
+
 	if (!req->hasBody() || !req->requestBodyBuffering) {
 		req->requestBodyBuffering = false;
 		checkoutSession(client, req);
@@ -65,6 +65,7 @@ Controller::preinitialize() {
 	#endif
 
 	PASSENGER_APP_GROUP_NAME = "!~PASSENGER_APP_GROUP_NAME";
+	PASSENGER_CONFIG_PROFILE = "!~PASSENGER_CONFIG_PROFILE";
 	PASSENGER_ENV_VARS = "!~PASSENGER_ENV_VARS";
 	PASSENGER_MAX_REQUESTS = "!~PASSENGER_MAX_REQUESTS";
 	PASSENGER_SHOW_VERSION_IN_HEADER = "!~PASSENGER_SHOW_VERSION_IN_HEADER";
@@ -75,12 +76,16 @@ Controller::preinitialize() {
 	REMOTE_PORT = "!~REMOTE_PORT";
 	REMOTE_USER = "!~REMOTE_USER";
 	FLAGS = "!~FLAGS";
+	HTTP_ACCEPT_ENCODING = "accept-encoding";
 	HTTP_COOKIE = "cookie";
 	HTTP_DATE = "date";
 	HTTP_HOST = "host";
+	HTTP_CONTENT_ENCODING = "content-encoding";
 	HTTP_CONTENT_LENGTH = "content-length";
 	HTTP_CONTENT_TYPE = "content-type";
 	HTTP_EXPECT = "expect";
+	HTTP_IF_MODIFIED_SINCE = "if-modified-since";
+	HTTP_IF_NONE_MATCH = "if-none-match";
 	HTTP_CONNECTION = "connection";
 	HTTP_STATUS = "status";
 	HTTP_TRANSFER_ENCODING = "transfer-encoding";
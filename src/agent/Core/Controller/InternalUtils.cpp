@@ -173,7 +173,7 @@ bool
 Controller::getBoolOption(Request *req, const HashedStaticString &name,
 	bool defaultValue)
 {
-	const LString *value = req->secureHeaders.lookup(name);
+	const LString *value = req->lookupSecureHeader(name);
 	if (value != NULL && value->size > 0) {
 		return psg_lstr_first_byte(value) == 't';
 	} else {
@@ -296,6 +296,48 @@ Controller::parseCookieHeader(psg_pool_t *pool, const LString *headerValue,
 	}
 }
 
+static void
+recordLatency(LatencyHistogram &histogram, ev_tstamp fromTime, ev_tstamp toTime) {
+	if (fromTime != 0 && toTime >= fromTime) {
+		histogram.record((boost::uint64_t) ((toTime - fromTime) * 1000000));
+	}
+}
+
+static void
+recordLatencies(RequestLatencyHistograms &histograms, const Request *req,
+	ev_tstamp now)
+{
+	recordLatency(histograms.queueTime, req->startedAt,
+		req->timeBeforeAccessingApplicationPool);
+	recordLatency(histograms.checkoutTime, req->timeBeforeAccessingApplicationPool,
+		req->timeOnSessionCheckedOut);
+	recordLatency(histograms.appTimeToFirstByte, req->timeOnRequestHeaderSent,
+		req->timeOnResponseBegun);
+	recordLatency(histograms.totalTime, req->startedAt, now);
+}
+
+void
+Controller::recordRequestLatencies(Request *req) {
+	ev_tstamp now = ev_now(getLoop());
+
+	recordLatencies(latencyStats.getOverallHistograms(), req, now);
+
+	// The pool options (and thus the app group name) are only
+	// initialized once the request has been analyzed. Requests served
+	// from the turbocache never get that far. Static files are served
+	// without involving the application, so they don't count towards
+	// its latencies.
+	if (req->state != Request::ANALYZING_REQUEST
+	 && req->state != Request::SERVING_STATIC_FILE)
+	{
+		RequestLatencyHistograms *groupHistograms =
+			latencyStats.getGroupHistograms(req->options.getAppGroupName());
+		if (groupHistograms != NULL) {
+			recordLatencies(*groupHistograms, req, now);
+		}
+	}
+}
+
 #ifdef DEBUG_CC_EVENT_LOOP_BLOCKING
 	void
 	Controller::reportLargeTimeDiff(Client *client, const char *name,
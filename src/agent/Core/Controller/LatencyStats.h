@@ -0,0 +1,196 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2018 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_CORE_CONTROLLER_LATENCY_STATS_H_
+#define _PASSENGER_CORE_CONTROLLER_LATENCY_STATS_H_
+
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/cstdint.hpp>
+#include <oxt/macros.hpp>
+#include <map>
+#include <string>
+
+#include <jsoncpp/json.h>
+#include <Algorithms/LatencyHistogram.h>
+#include <DataStructures/StringKeyTable.h>
+#include <StaticString.h>
+#include <Utils/JsonUtils.h>
+
+namespace Passenger {
+namespace Core {
+
+using namespace std;
+
+
+/**
+ * Latency histograms for the different phases that a request goes through
+ * inside the Controller. All values are in microseconds.
+ */
+struct RequestLatencyHistograms {
+	/** From the moment the request header has been parsed, until the
+	 * ApplicationPool is asked for a session. This includes request body
+	 * buffering.
+	 */
+	LatencyHistogram queueTime;
+	/** From the moment the ApplicationPool is asked for a session, until
+	 * a session is checked out. This includes waiting in the group's
+	 * request queue and waiting for processes to be spawned.
+	 */
+	LatencyHistogram checkoutTime;
+	/** From the moment the request header has been sent to the application,
+	 * until the application's response header has been received.
+	 */
+	LatencyHistogram appTimeToFirstByte;
+	/** From the moment the request header has been parsed, until the
+	 * request has ended.
+	 */
+	LatencyHistogram totalTime;
+
+	void merge(const RequestLatencyHistograms &other) {
+		queueTime.merge(other.queueTime);
+		checkoutTime.merge(other.checkoutTime);
+		appTimeToFirstByte.merge(other.appTimeToFirstByte);
+		totalTime.merge(other.totalTime);
+	}
+
+	static Json::Value inspectHistogramAsJson(const LatencyHistogram &histogram) {
+		Json::Value doc;
+		doc["count"] = (Json::UInt64) histogram.getTotalCount();
+		if (histogram.getTotalCount() > 0) {
+			doc["min"] = durationToJson(histogram.getMin());
+			doc["mean"] = durationToJson((unsigned long long) histogram.getMean());
+			doc["p50"] = durationToJson(histogram.getValueAtPercentile(50));
+			doc["p90"] = durationToJson(histogram.getValueAtPercentile(90));
+			doc["p99"] = durationToJson(histogram.getValueAtPercentile(99));
+			doc["p99.9"] = durationToJson(histogram.getValueAtPercentile(99.9));
+			doc["max"] = durationToJson(histogram.getMax());
+		}
+		return doc;
+	}
+
+	Json::Value inspectAsJson() const {
+		Json::Value doc;
+		doc["queue_time"] = inspectHistogramAsJson(queueTime);
+		doc["checkout_time"] = inspectHistogramAsJson(checkoutTime);
+		doc["app_time_to_first_byte"] = inspectHistogramAsJson(appTimeToFirstByte);
+		doc["total_time"] = inspectHistogramAsJson(totalTime);
+		return doc;
+	}
+};
+
+typedef boost::shared_ptr<RequestLatencyHistograms> RequestLatencyHistogramsPtr;
+
+/**
+ * A copy of a RequestLatencyStats object, which may be passed to other threads
+ * and merged with copies from other Controller threads.
+ */
+struct RequestLatencySnapshot {
+	RequestLatencyHistograms overall;
+	map<string, RequestLatencyHistograms> groups;
+
+	void merge(const RequestLatencySnapshot &other) {
+		map<string, RequestLatencyHistograms>::const_iterator it, end = other.groups.end();
+
+		overall.merge(other.overall);
+		for (it = other.groups.begin(); it != end; it++) {
+			groups[it->first].merge(it->second);
+		}
+	}
+
+	Json::Value inspectAsJson() const {
+		Json::Value doc;
+		Json::Value groupsDoc(Json::objectValue);
+		map<string, RequestLatencyHistograms>::const_iterator it, end = groups.end();
+
+		doc["overall"] = overall.inspectAsJson();
+		for (it = groups.begin(); it != end; it++) {
+			groupsDoc[it->first] = it->second.inspectAsJson();
+		}
+		doc["groups"] = groupsDoc;
+		return doc;
+	}
+};
+
+typedef boost::shared_ptr<RequestLatencySnapshot> RequestLatencySnapshotPtr;
+
+/**
+ * Per-Controller-thread request latency statistics, both overall and per
+ * application group. Not thread-safe: it must only be accessed from the
+ * Controller's event loop thread.
+ */
+class RequestLatencyStats {
+private:
+	RequestLatencyHistograms overall;
+	StringKeyTable<RequestLatencyHistogramsPtr> groups;
+
+public:
+	RequestLatencyStats()
+		: groups(4)
+		{ }
+
+	/**
+	 * Returns the histograms for the given application group, creating
+	 * them if necessary. Returns NULL if the group name is too long to be
+	 * tracked separately.
+	 */
+	RequestLatencyHistograms *getGroupHistograms(const HashedStaticString &appGroupName) {
+		RequestLatencyHistogramsPtr *histograms;
+
+		if (OXT_UNLIKELY(appGroupName.size() > StringKeyTable<RequestLatencyHistogramsPtr>::MAX_KEY_LENGTH)) {
+			return NULL;
+		}
+		if (groups.lookup(appGroupName, &histograms)) {
+			return histograms->get();
+		} else {
+			RequestLatencyHistogramsPtr newHistograms =
+				boost::make_shared<RequestLatencyHistograms>();
+			groups.insert(appGroupName, newHistograms);
+			return newHistograms.get();
+		}
+	}
+
+	RequestLatencyHistograms &getOverallHistograms() {
+		return overall;
+	}
+
+	RequestLatencySnapshotPtr snapshot() const {
+		RequestLatencySnapshotPtr result = boost::make_shared<RequestLatencySnapshot>();
+		StringKeyTable<RequestLatencyHistogramsPtr>::ConstIterator it(groups);
+
+		result->overall = overall;
+		while (*it != NULL) {
+			result->groups[it.getKey().toString()] = *it.getValue();
+			it.next();
+		}
+		return result;
+	}
+};
+
+
+} // namespace Core
+} // namespace Passenger
+
+#endif /* _PASSENGER_CORE_CONTROLLER_LATENCY_STATS_H_ */
@@ -37,6 +37,7 @@
 #include <Core/ApplicationPool/Pool.h>
 #include <Core/Controller/Config.h>
 #include <Core/Controller/AppResponse.h>
+#include <Core/Controller/StaticFileCache.h>
 
 namespace Passenger {
 namespace Core {
@@ -54,7 +55,8 @@ public:
 		CHECKING_OUT_SESSION,
 		SENDING_HEADER_TO_APP,
 		FORWARDING_BODY_TO_APP,
-		WAITING_FOR_APP_OUTPUT
+		WAITING_FOR_APP_OUTPUT,
+		SERVING_STATIC_FILE
 	};
 
 	enum HalfClosePolicy {
@@ -71,6 +73,9 @@ public:
 	bool requestBodyBuffering: 1;
 	bool https: 1;
 	bool stickySession: 1;
+	// Whether response compression is enabled and the client accepts
+	// gzip-encoded responses.
+	bool acceptsGzip: 1;
 
 	// Range: 0..MAX_SESSION_CHECKOUT_TRY
 	boost::uint8_t sessionCheckoutTry: 4;
@@ -78,9 +83,33 @@ public:
 	bool appResponseInitialized: 1;
 	bool strip100ContinueHeader: 1;
 	bool hasPragmaHeader: 1;
+	// Whether the static file body may be sent with sendfile(). Cleared
+	// when sendfile() turns out not to support the client socket.
+	bool staticFileSendfile: 1;
+	// Whether more than `config->maxRequestBodyBufferSize` bytes of the
+	// request body were buffered, and the session was checked out
+	// before the end of the body was reached. From then on, bodyBuffer
+	// only holds the part of the body that the app hasn't consumed yet.
+	bool bodyBufferLimitReached: 1;
+	// Whether a session is being checked out for this request while it is
+	// queued behind an earlier pipelined request; see
+	// Controller::onRequestPipelined().
+	bool prefetchingSession: 1;
+	// Whether the request has begun while that checkout is still in
+	// progress, so that it must continue once the checkout completes.
+	bool waitingForPrefetchedSession: 1;
 
 	Options options;
 	AbstractSessionPtr session;
+	// Result of a session checkout that completed on another thread, while
+	// it is being handed over to the event loop thread. Empty otherwise.
+	AbstractSessionPtr checkedOutSession;
+	ExceptionPtr checkoutException;
+	// Session that was checked out before this request began, and the
+	// name of the app group that it was checked out from. The request
+	// only uses it if it is routed to the same app group.
+	AbstractSessionPtr prefetchedSession;
+	string prefetchedAppGroupName;
 	const LString *host;
 	ControllerRequestConfigPtr config;
 
@@ -91,6 +120,11 @@ public:
 	ServerKit::FileBufferedChannel bodyBuffer;
 	boost::uint64_t bodyBytesBuffered; // After dechunking
 
+	// If state == SERVING_STATIC_FILE: the file whose body is being sent,
+	// and how much of it has been sent so far.
+	StaticFileCache::EntryPtr staticFile;
+	boost::uint64_t staticFileOffset;
+
 	HashedStaticString cacheKey;
 	LString *cacheControl;
 	LString *varyCookie;
@@ -100,13 +134,22 @@ public:
 	// `options.environmentVariables` retains a previous value.
 	//
 	// This value is guaranteed to be contiguous.
-	LString *envvars;
+	const LString *envvars;
+	// The config profile that the web server referred to through the
+	// `!~PASSENGER_CONFIG_PROFILE` header, or NULL. Owned by `config`.
+	// Secure headers that the request did not carry itself are looked
+	// up in here; see `lookupSecureHeader()`.
+	const ServerKit::HeaderTable *configProfile;
+
+	// Timestamps of the various request phases, used for latency
+	// statistics. They are 0 if the request did not reach that phase.
+	ev_tstamp timeBeforeAccessingApplicationPool;
+	ev_tstamp timeOnSessionCheckedOut;
+	ev_tstamp timeOnRequestHeaderSent;
+	ev_tstamp timeOnResponseBegun;
 
 	#ifdef DEBUG_CC_EVENT_LOOP_BLOCKING
 		bool timedAppPoolGet;
-		ev_tstamp timeBeforeAccessingApplicationPool;
-		ev_tstamp timeOnRequestHeaderSent;
-		ev_tstamp timeOnResponseBegun;
 	#endif
 
 
@@ -114,6 +157,25 @@ public:
 		: BaseHttpRequest()
 		{ }
 
+	const ServerKit::HeaderTable::Cell *lookupSecureHeaderCell(
+		const HashedStaticString &name) const
+	{
+		const ServerKit::HeaderTable::Cell *cell = secureHeaders.lookupCell(name);
+		if (cell == NULL && configProfile != NULL) {
+			cell = configProfile->lookupCell(name);
+		}
+		return cell;
+	}
+
+	const LString *lookupSecureHeader(const HashedStaticString &name) const {
+		const ServerKit::HeaderTable::Cell *cell = lookupSecureHeaderCell(name);
+		if (cell != NULL) {
+			return &cell->header->val;
+		} else {
+			return NULL;
+		}
+	}
+
 	const char *getStateString() const {
 		switch (state) {
 		case ANALYZING_REQUEST:
@@ -128,6 +190,8 @@ public:
 			return "FORWARDING_BODY_TO_APP";
 		case WAITING_FOR_APP_OUTPUT:
 			return "WAITING_FOR_APP_OUTPUT";
+		case SERVING_STATIC_FILE:
+			return "SERVING_STATIC_FILE";
 		default:
 			return "UNKNOWN";
 		}
@@ -0,0 +1,174 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2018 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_CORE_CONTROLLER_RESPONSE_HEADER_CACHE_H_
+#define _PASSENGER_CORE_CONTROLLER_RESPONSE_HEADER_CACHE_H_
+
+#include <boost/noncopyable.hpp>
+#include <oxt/macros.hpp>
+#include <ctime>
+#include <cstdlib>
+#include <cstring>
+
+#include <StaticString.h>
+#include <Utils/StrIntUtils.h>
+#include <Utils/HttpConstants.h>
+
+namespace Passenger {
+namespace Core {
+
+using namespace std;
+
+
+/**
+ * Preformatted fragments of response headers, so that the Controller
+ * doesn't have to format them again for every response:
+ *
+ *  - The status line plus the "Status" header, e.g.
+ *    "HTTP/1.1 200 OK\r\nStatus: 200 OK\r\n", for HTTP/1.0 and HTTP/1.1
+ *    responses with a status code that has a known reason phrase.
+ *    These are formatted the first time a status code is used.
+ *  - The "Date" header. It is only reformatted when the second changes.
+ *
+ * Each Controller (and thus each thread) has its own instance, so no
+ * locking is necessary. Status lines stay valid until the cache is
+ * destroyed. The Date header is overwritten by the next call with a
+ * different time, so callers that keep a reference to it beyond the
+ * current event loop iteration (e.g. for the turbocache) must copy it.
+ */
+class ResponseHeaderCache: public boost::noncopyable {
+private:
+	static const int MIN_STATUS_CODE = 100;
+	static const int MAX_STATUS_CODE = 599;
+	static const unsigned int STATUS_CODE_COUNT = MAX_STATUS_CODE - MIN_STATUS_CODE + 1;
+
+	struct StatusLine {
+		char *data;
+		unsigned int size;
+	};
+
+	// Index 0: HTTP/1.0, index 1: HTTP/1.1.
+	StatusLine statusLines[2][STATUS_CODE_COUNT];
+
+	time_t dateTime;
+	char dateHeader[64];
+	unsigned int dateHeaderSize;
+
+	StaticString formatStatusLine(StatusLine &line, unsigned int httpMinor,
+		int statusCode)
+	{
+		const char *statusAndReason = getStatusCodeAndReasonPhrase(statusCode);
+		if (statusAndReason == NULL) {
+			return StaticString();
+		}
+
+		size_t len = strlen(statusAndReason);
+		size_t size = sizeof("HTTP/1.x ") - 1 + len
+			+ sizeof("\r\nStatus: ") - 1 + len
+			+ sizeof("\r\n") - 1;
+		char *data = (char *) malloc(size);
+		if (OXT_UNLIKELY(data == NULL)) {
+			return StaticString();
+		}
+
+		char *pos = data;
+		const char *end = data + size;
+		pos = appendData(pos, end, (httpMinor == 0)
+			? P_STATIC_STRING("HTTP/1.0 ")
+			: P_STATIC_STRING("HTTP/1.1 "));
+		pos = appendData(pos, end, statusAndReason, len);
+		pos = appendData(pos, end, P_STATIC_STRING("\r\nStatus: "));
+		pos = appendData(pos, end, statusAndReason, len);
+		pos = appendData(pos, end, P_STATIC_STRING("\r\n"));
+
+		line.data = data;
+		line.size = pos - data;
+		return StaticString(line.data, line.size);
+	}
+
+public:
+	ResponseHeaderCache()
+		: dateTime(0),
+		  dateHeaderSize(0)
+	{
+		memset(statusLines, 0, sizeof(statusLines));
+	}
+
+	~ResponseHeaderCache() {
+		for (unsigned int i = 0; i < 2; i++) {
+			for (unsigned int j = 0; j < STATUS_CODE_COUNT; j++) {
+				free(statusLines[i][j].data);
+			}
+		}
+	}
+
+	/**
+	 * Returns the status line plus the "Status" header for the given HTTP
+	 * version and status code, or an empty string if that combination is
+	 * not cached. In that case, the caller must format it by itself.
+	 */
+	StaticString getStatusLine(unsigned int httpMajor, unsigned int httpMinor,
+		int statusCode)
+	{
+		if (OXT_UNLIKELY(httpMajor != 1 || httpMinor > 1
+			|| statusCode < MIN_STATUS_CODE || statusCode > MAX_STATUS_CODE))
+		{
+			return StaticString();
+		}
+
+		StatusLine &line = statusLines[httpMinor][statusCode - MIN_STATUS_CODE];
+		if (OXT_LIKELY(line.data != NULL)) {
+			return StaticString(line.data, line.size);
+		} else {
+			return formatStatusLine(line, httpMinor, statusCode);
+		}
+	}
+
+	/**
+	 * Returns the "Date" header for the given time, including the
+	 * trailing CRLF.
+	 */
+	StaticString getDateHeader(time_t now) {
+		if (OXT_UNLIKELY(now != dateTime || dateHeaderSize == 0)) {
+			char *pos = dateHeader;
+			const char *end = dateHeader + sizeof(dateHeader) - 1;
+			struct tm the_tm;
+
+			pos = appendData(pos, end, P_STATIC_STRING("Date: "));
+			gmtime_r(&now, &the_tm);
+			pos += strftime(pos, end - pos, "%a, %d %b %Y %H:%M:%S GMT", &the_tm);
+			pos = appendData(pos, end, P_STATIC_STRING("\r\n"));
+			dateHeaderSize = pos - dateHeader;
+			dateTime = now;
+		}
+		return StaticString(dateHeader, dateHeaderSize);
+	}
+};
+
+
+} // namespace Core
+} // namespace Passenger
+
+#endif /* _PASSENGER_CORE_CONTROLLER_RESPONSE_HEADER_CACHE_H_ */
@@ -63,9 +63,12 @@ struct Controller::SessionProtocolWorkingState {
 	char *environmentVariablesData;
 	size_t environmentVariablesSize;
 	bool hasBaseURI;
+	/** Whether to encode the header with version 2 of the protocol. */
+	bool binary;
 
 	SessionProtocolWorkingState()
-		: environmentVariablesData(NULL)
+		: environmentVariablesData(NULL),
+		  binary(false)
 		{ }
 
 	~SessionProtocolWorkingState() {
@@ -89,7 +92,7 @@ Controller::sendHeaderToApp(Client *client, Request *req) {
 	req->state = Request::SENDING_HEADER_TO_APP;
 	P_ASSERT_EQ(req->halfClosePolicy, Request::HALF_CLOSE_POLICY_UNINITIALIZED);
 
-	if (req->session->getProtocol() == "session") {
+	if (isSessionProtocol(req->session->getProtocol())) {
 		UPDATE_TRACE_POINT();
 		if (req->bodyType == Request::RBT_NO_BODY) {
 			// When there is no request body we will try to keep-alive the
@@ -155,6 +158,7 @@ void
 Controller::sendHeaderToAppWithSessionProtocol(Client *client, Request *req) {
 	TRACE_POINT();
 	SessionProtocolWorkingState state;
+	state.binary = req->session->getProtocol() == P_STATIC_STRING("session2");
 
 	// Workaround for Ruby < 2.1 support.
 	std::string deltaMonotonic;
@@ -171,32 +175,41 @@ Controller::sendHeaderToAppWithSessionProtocol(Client *client, Request *req) {
 		state, deltaMonotonic);
 	MemoryKit::mbuf_pool &mbuf_pool = getContext()->mbuf_pool;
 	const unsigned int MBUF_MAX_SIZE = mbuf_pool_data_size(&mbuf_pool);
+	MemoryKit::mbuf buffer;
 	bool ok;
 
 	if (bufferSize <= MBUF_MAX_SIZE) {
-		MemoryKit::mbuf buffer(MemoryKit::mbuf_get(&mbuf_pool));
+		buffer = MemoryKit::mbuf_get(&mbuf_pool);
 		bufferSize = MBUF_MAX_SIZE;
-
-		ok = constructHeaderForSessionProtocol(req, buffer.start,
-			bufferSize, state, deltaMonotonic);
-		assert(ok);
-		buffer = MemoryKit::mbuf(buffer, 0, bufferSize);
-		SKC_TRACE(client, 3, "Header data: \"" << cEscapeString(
-			StaticString(buffer.start, bufferSize)) << "\"");
-		req->appSink.feedWithoutRefGuard(boost::move(buffer));
 	} else {
-		char *buffer = (char *) psg_pnalloc(req->pool, bufferSize);
-
-		ok = constructHeaderForSessionProtocol(req, buffer,
-			bufferSize, state, deltaMonotonic);
-		assert(ok);
-		SKC_TRACE(client, 3, "Header data: \"" << cEscapeString(
-			StaticString(buffer, bufferSize)) << "\"");
-		req->appSink.feedWithoutRefGuard(MemoryKit::mbuf(
-			buffer, bufferSize));
+		buffer = MemoryKit::mbuf((const char *) psg_pnalloc(req->pool, bufferSize),
+			bufferSize);
 	}
 
+	ok = constructHeaderForSessionProtocol(req, buffer.start,
+		bufferSize, state, deltaMonotonic);
+	assert(ok);
 	(void) ok; // Shut up compiler warning
+	buffer = MemoryKit::mbuf(buffer, 0, bufferSize);
+	SKC_TRACE(client, 3, "Header data: \"" << cEscapeString(
+		StaticString(buffer.start, bufferSize)) << "\"");
+
+	if (state.environmentVariablesData != NULL && !state.binary) {
+		// The environment variables data is already in the protocol's
+		// format, so write it straight from where it was decoded instead
+		// of copying it into the header buffer.
+		struct iovec buffers[2];
+		buffers[0].iov_base = buffer.start;
+		buffers[0].iov_len = buffer.size();
+		buffers[1].iov_base = state.environmentVariablesData;
+		buffers[1].iov_len = state.environmentVariablesSize;
+		SKC_TRACE(client, 3, "Environment variables data: \"" << cEscapeString(
+			StaticString(state.environmentVariablesData,
+				state.environmentVariablesSize)) << "\"");
+		req->appSink.feedvWithoutRefGuard(buffers, 2);
+	} else {
+		req->appSink.feedWithoutRefGuard(boost::move(buffer));
+	}
 }
 
 void
@@ -316,6 +329,84 @@ httpHeaderToScgiUpperCase(unsigned char *data, unsigned int size) {
 	}
 }
 
+static char *
+appendSessionField(char *pos, const char *end, bool binary,
+	SessionProtocolV2::FieldId id, const StaticString &name,
+	const StaticString &value)
+{
+	if (binary) {
+		return SessionProtocolV2::appendEntry(pos, end, id, name, value);
+	} else {
+		pos = appendData(pos, end, name);
+		pos = appendData(pos, end, "", 1);
+		pos = appendData(pos, end, value);
+		return appendData(pos, end, "", 1);
+	}
+}
+
+static char *
+appendSessionField(char *pos, const char *end, bool binary,
+	SessionProtocolV2::FieldId id, const StaticString &name,
+	const LString *value)
+{
+	if (binary) {
+		return SessionProtocolV2::appendEntry(pos, end, id, name, value);
+	} else {
+		pos = appendData(pos, end, name);
+		pos = appendData(pos, end, "", 1);
+		pos = appendData(pos, end, value);
+		return appendData(pos, end, "", 1);
+	}
+}
+
+/**
+ * Re-encodes the NUL-separated name/value pairs of the environment
+ * variables data as version 2 entries.
+ */
+static char *
+appendEnvironmentVariablesAsSessionV2Entries(char *pos, const char *end,
+	const char *data, size_t size)
+{
+	const char *dataEnd = data + size;
+
+	while (data < dataEnd) {
+		const char *nameEnd = (const char *) memchr(data, '\0', dataEnd - data);
+		if (nameEnd == NULL) {
+			break;
+		}
+		const char *valueEnd = (const char *) memchr(nameEnd + 1, '\0',
+			dataEnd - nameEnd - 1);
+		if (valueEnd == NULL) {
+			break;
+		}
+
+		StaticString name(data, nameEnd - data);
+		if (name.size() <= SessionProtocolV2::MAX_NAME_SIZE) {
+			pos = SessionProtocolV2::appendEntry(pos, end,
+				SessionProtocolV2::FIELD_UNKNOWN, name,
+				StaticString(nameEnd + 1, valueEnd - nameEnd - 1));
+		}
+		data = valueEnd + 1;
+	}
+	return pos;
+}
+
+static unsigned int
+countNulBytes(const char *data, size_t size) {
+	const char *end = data + size;
+	unsigned int result = 0;
+
+	while (data < end) {
+		data = (const char *) memchr(data, '\0', end - data);
+		if (data == NULL) {
+			break;
+		}
+		result++;
+		data++;
+	}
+	return result;
+}
+
 unsigned int
 Controller::determineHeaderSizeForSessionProtocol(Request *req,
 	SessionProtocolWorkingState &state, string delta_monotonic)
@@ -458,8 +549,16 @@ Controller::determineHeaderSizeForSessionProtocol(Request *req,
 		it.next();
 	}
 
-	if (state.environmentVariablesData != NULL) {
-		dataSize += state.environmentVariablesSize;
+	if (state.binary) {
+		// The version byte, plus the worst-case growth of every entry.
+		// 17 is the maximum number of non-header entries above.
+		unsigned int entries = 17 + req->headers.size();
+		if (state.environmentVariablesData != NULL) {
+			dataSize += state.environmentVariablesSize;
+			entries += countNulBytes(state.environmentVariablesData,
+				state.environmentVariablesSize) / 2;
+		}
+		dataSize += 1 + entries * SessionProtocolV2::MAX_ENTRY_OVERHEAD;
 	}
 
 	return dataSize + 1;
@@ -469,96 +568,81 @@ bool
 Controller::constructHeaderForSessionProtocol(Request *req, char * restrict buffer,
 	unsigned int &size, const SessionProtocolWorkingState &state, string delta_monotonic)
 {
+	using namespace SessionProtocolV2;
 	char *pos = buffer;
 	const char *end = buffer + size;
+	const bool binary = state.binary;
 
 	pos += sizeof(boost::uint32_t);
 
-	pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL("REQUEST_URI"));
-	pos = appendData(pos, end, req->path.start->data, req->path.size);
-	pos = appendData(pos, end, "", 1);
-
-	pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL("PATH_INFO"));
-	pos = appendData(pos, end, state.path.data(), state.path.size());
-	pos = appendData(pos, end, "", 1);
-
-	pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL("SCRIPT_NAME"));
-	if (state.hasBaseURI) {
-		pos = appendData(pos, end, req->options.baseURI);
-		pos = appendData(pos, end, "", 1);
-	} else {
-		pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL(""));
+	if (binary) {
+		const char version = (char) SessionProtocolV2::VERSION;
+		pos = appendData(pos, end, &version, 1);
 	}
 
-	pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL("QUERY_STRING"));
-	pos = appendData(pos, end, state.queryString.data(), state.queryString.size());
-	pos = appendData(pos, end, "", 1);
-
-	pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL("REQUEST_METHOD"));
-	pos = appendData(pos, end, state.methodStr);
-	pos = appendData(pos, end, "", 1);
-
-	pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL("SERVER_NAME"));
-	pos = appendData(pos, end, state.serverName);
-	pos = appendData(pos, end, "", 1);
-
-	pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL("SERVER_PORT"));
-	pos = appendData(pos, end, state.serverPort);
-	pos = appendData(pos, end, "", 1);
-
-	pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL("SERVER_SOFTWARE"));
-	pos = appendData(pos, end, req->config->serverSoftware);
-	pos = appendData(pos, end, "", 1);
+	pos = appendSessionField(pos, end, binary, FIELD_REQUEST_URI,
+		P_STATIC_STRING("REQUEST_URI"), &req->path);
+	pos = appendSessionField(pos, end, binary, FIELD_PATH_INFO,
+		P_STATIC_STRING("PATH_INFO"), state.path);
+	pos = appendSessionField(pos, end, binary, FIELD_SCRIPT_NAME,
+		P_STATIC_STRING("SCRIPT_NAME"),
+		state.hasBaseURI ? req->options.baseURI : StaticString());
+	pos = appendSessionField(pos, end, binary, FIELD_QUERY_STRING,
+		P_STATIC_STRING("QUERY_STRING"), state.queryString);
+	pos = appendSessionField(pos, end, binary, FIELD_REQUEST_METHOD,
+		P_STATIC_STRING("REQUEST_METHOD"), state.methodStr);
+	pos = appendSessionField(pos, end, binary, FIELD_SERVER_NAME,
+		P_STATIC_STRING("SERVER_NAME"), state.serverName);
+	pos = appendSessionField(pos, end, binary, FIELD_SERVER_PORT,
+		P_STATIC_STRING("SERVER_PORT"), state.serverPort);
+	pos = appendSessionField(pos, end, binary, FIELD_SERVER_SOFTWARE,
+		P_STATIC_STRING("SERVER_SOFTWARE"), req->config->serverSoftware);
+	pos = appendSessionField(pos, end, binary, FIELD_SERVER_PROTOCOL,
+		P_STATIC_STRING("SERVER_PROTOCOL"), P_STATIC_STRING("HTTP/1.1"));
 
-	pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL("SERVER_PROTOCOL"));
-	pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL("HTTP/1.1"));
-
-	pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL("REMOTE_ADDR"));
 	if (state.remoteAddr != NULL) {
-		pos = appendData(pos, end, state.remoteAddr);
-		pos = appendData(pos, end, "", 1);
+		pos = appendSessionField(pos, end, binary, FIELD_REMOTE_ADDR,
+			P_STATIC_STRING("REMOTE_ADDR"), state.remoteAddr);
 	} else {
-		pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL("127.0.0.1"));
+		pos = appendSessionField(pos, end, binary, FIELD_REMOTE_ADDR,
+			P_STATIC_STRING("REMOTE_ADDR"), P_STATIC_STRING("127.0.0.1"));
 	}
 
-	pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL("REMOTE_PORT"));
 	if (state.remotePort != NULL) {
-		pos = appendData(pos, end, state.remotePort);
-		pos = appendData(pos, end, "", 1);
+		pos = appendSessionField(pos, end, binary, FIELD_REMOTE_PORT,
+			P_STATIC_STRING("REMOTE_PORT"), state.remotePort);
 	} else {
-		pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL("0"));
+		pos = appendSessionField(pos, end, binary, FIELD_REMOTE_PORT,
+			P_STATIC_STRING("REMOTE_PORT"), P_STATIC_STRING("0"));
 	}
 
 	if (state.remoteUser != NULL) {
-		pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL("REMOTE_USER"));
-		pos = appendData(pos, end, state.remoteUser);
-		pos = appendData(pos, end, "", 1);
+		pos = appendSessionField(pos, end, binary, FIELD_REMOTE_USER,
+			P_STATIC_STRING("REMOTE_USER"), state.remoteUser);
 	}
 
 	if (state.contentType != NULL) {
-		pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL("CONTENT_TYPE"));
-		pos = appendData(pos, end, state.contentType);
-		pos = appendData(pos, end, "", 1);
+		pos = appendSessionField(pos, end, binary, FIELD_CONTENT_TYPE,
+			P_STATIC_STRING("CONTENT_TYPE"), state.contentType);
 	}
 
 	if (state.contentLength != NULL) {
-		pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL("CONTENT_LENGTH"));
-		pos = appendData(pos, end, state.contentLength);
-		pos = appendData(pos, end, "", 1);
+		pos = appendSessionField(pos, end, binary, FIELD_CONTENT_LENGTH,
+			P_STATIC_STRING("CONTENT_LENGTH"), state.contentLength);
 	}
 
-	pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL("PASSENGER_CONNECT_PASSWORD"));
-	pos = appendData(pos, end, req->session->getApiKey().toStaticString());
-	pos = appendData(pos, end, "", 1);
+	pos = appendSessionField(pos, end, binary, FIELD_PASSENGER_CONNECT_PASSWORD,
+		P_STATIC_STRING("PASSENGER_CONNECT_PASSWORD"),
+		req->session->getApiKey().toStaticString());
 
 	if (req->https) {
-		pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL("HTTPS"));
-		pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL("on"));
+		pos = appendSessionField(pos, end, binary, FIELD_HTTPS,
+			P_STATIC_STRING("HTTPS"), P_STATIC_STRING("on"));
 	}
 
 	if (req->upgraded()) {
-		pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL("HTTP_CONNECTION"));
-		pos = appendData(pos, end, P_STATIC_STRING_WITH_NULL("upgrade"));
+		pos = appendSessionField(pos, end, binary, FIELD_HTTP_CONNECTION,
+			P_STATIC_STRING("HTTP_CONNECTION"), P_STATIC_STRING("upgrade"));
 	}
 
 	ServerKit::HeaderTable::Iterator it(req->headers);
@@ -580,6 +664,24 @@ Controller::constructHeaderForSessionProtocol(Request *req, char * restrict buff
 			continue;
 		}
 
+		if (binary) {
+			FieldId id = lookupHeaderField(it->header);
+			if (id != FIELD_UNKNOWN) {
+				pos = appendSessionField(pos, end, binary, id,
+					StaticString(), &it->header->val);
+				it.next();
+				continue;
+			}
+
+			size_t nameSize = sizeof("HTTP_") - 1 + it->header->key.size;
+			if (nameSize > MAX_NAME_SIZE) {
+				it.next();
+				continue;
+			}
+			pos = appendData(pos, end, "", 1); // FIELD_UNKNOWN
+			pos = appendUint16(pos, end, (boost::uint16_t) nameSize);
+		}
+
 		pos = appendData(pos, end, P_STATIC_STRING("HTTP_"));
 		const LString::Part *part = it->header->key.start;
 		while (part != NULL) {
@@ -588,23 +690,34 @@ Controller::constructHeaderForSessionProtocol(Request *req, char * restrict buff
 			httpHeaderToScgiUpperCase((unsigned char *) start, pos - start);
 			part = part->next;
 		}
-		pos = appendData(pos, end, "", 1);
 
-		part = it->header->val.start;
-		while (part != NULL) {
-			pos = appendData(pos, end, part->data, part->size);
-			part = part->next;
+		if (binary) {
+			pos = appendValueSize(pos, end, it->header->val.size);
+			pos = appendData(pos, end, &it->header->val);
+		} else {
+			pos = appendData(pos, end, "", 1);
+			pos = appendData(pos, end, &it->header->val);
+			pos = appendData(pos, end, "", 1);
 		}
-		pos = appendData(pos, end, "", 1);
 
 		it.next();
 	}
 
+	// In version 1 of the protocol, the environment variables data is not
+	// copied into the buffer, but sent right after it by
+	// sendHeaderToAppWithSessionProtocol(). It must still be accounted for
+	// in the size field.
+	size_t trailerSize = 0;
 	if (state.environmentVariablesData != NULL) {
-		pos = appendData(pos, end, state.environmentVariablesData, state.environmentVariablesSize);
+		if (binary) {
+			pos = appendEnvironmentVariablesAsSessionV2Entries(pos, end,
+				state.environmentVariablesData, state.environmentVariablesSize);
+		} else {
+			trailerSize = state.environmentVariablesSize;
+		}
 	}
 
-	Uint32Message::generate(buffer, pos - buffer - sizeof(boost::uint32_t));
+	Uint32Message::generate(buffer, pos - buffer - sizeof(boost::uint32_t) + trailerSize);
 
 	size = pos - buffer;
 	return pos < end;
@@ -612,14 +725,17 @@ Controller::constructHeaderForSessionProtocol(Request *req, char * restrict buff
 
 void
 Controller::sendHeaderToAppWithHttpProtocol(Client *client, Request *req) {
-	ssize_t bytesWritten;
 	HttpHeaderConstructionCache cache;
+	unsigned int maxbuffers = 5 + req->headers.size() * 4 + 4;
+	struct iovec *buffers = (struct iovec *) psg_palloc(req->pool,
+		sizeof(struct iovec) * maxbuffers);
+	unsigned int nbuffers, dataSize;
 
 	cache.cached = false;
 
-	if (OXT_UNLIKELY(LoggingKit::getLevel() >= LoggingKit::DEBUG3)) {
-		struct iovec *buffers;
-		unsigned int nbuffers, dataSize;
+	if (!constructHeaderBuffersForHttpProtocol(req, buffers, maxbuffers,
+		nbuffers, dataSize, cache))
+	{
 		bool ok;
 
 		ok = constructHeaderBuffersForHttpProtocol(req, NULL, 0,
@@ -632,21 +748,18 @@ Controller::sendHeaderToAppWithHttpProtocol(Client *client, Request *req) {
 			nbuffers, dataSize, cache);
 		assert(ok);
 		(void) ok; // Shut up compiler warning
+	}
 
+	if (OXT_UNLIKELY(LoggingKit::getLevel() >= LoggingKit::DEBUG3)) {
 		char *buffer = (char *) psg_pnalloc(req->pool, dataSize);
 		gatherBuffers(buffer, dataSize, buffers, nbuffers);
 		SKC_TRACE(client, 3, "Header data: \"" <<
 			cEscapeString(StaticString(buffer, dataSize)) << "\"");
 	}
 
-	if (!sendHeaderToAppWithHttpProtocolAndWritev(req, bytesWritten, cache)) {
-		if (bytesWritten >= 0 || errno == EAGAIN || errno == EWOULDBLOCK) {
-			sendHeaderToAppWithHttpProtocolWithBuffering(req, bytesWritten, cache);
-		} else {
-			int e = errno;
-			P_ASSERT_EQ(bytesWritten, -1);
-			disconnectWithAppSocketWriteError(&client, e);
-		}
+	req->appSink.feedvWithoutRefGuard(buffers, nbuffers);
+	if (req->appSink.hasError()) {
+		disconnectWithAppSocketWriteError(&client, req->appSink.getErrcode());
 	}
 }
 
@@ -855,71 +968,12 @@ Controller::constructHeaderBuffersForHttpProtocol(Request *req, struct iovec *bu
 	#undef PUSH_STATIC_BUFFER
 }
 
-bool
-Controller::sendHeaderToAppWithHttpProtocolAndWritev(Request *req, ssize_t &bytesWritten,
-	HttpHeaderConstructionCache &cache)
-{
-	unsigned int maxbuffers = std::min<unsigned int>(
-		5 + req->headers.size() * 4 + 4, IOV_MAX);
-	struct iovec *buffers = (struct iovec *) psg_palloc(req->pool,
-		sizeof(struct iovec) * maxbuffers);
-	unsigned int nbuffers, dataSize;
-
-	if (constructHeaderBuffersForHttpProtocol(req, buffers,
-		maxbuffers, nbuffers, dataSize, cache))
-	{
-		ssize_t ret;
-		do {
-			ret = writev(req->session->fd(), buffers, nbuffers);
-		} while (ret == -1 && errno == EINTR);
-		bytesWritten = ret;
-		return ret == (ssize_t) dataSize;
-	} else {
-		bytesWritten = 0;
-		return false;
-	}
-}
-
-void
-Controller::sendHeaderToAppWithHttpProtocolWithBuffering(Request *req,
-	unsigned int offset, HttpHeaderConstructionCache &cache)
-{
-	struct iovec *buffers;
-	unsigned int nbuffers, dataSize;
-	bool ok;
-
-	ok = constructHeaderBuffersForHttpProtocol(req, NULL, 0, nbuffers,
-		dataSize, cache);
-	assert(ok);
-
-	buffers = (struct iovec *) psg_palloc(req->pool,
-		sizeof(struct iovec) * nbuffers);
-	ok = constructHeaderBuffersForHttpProtocol(req, buffers, nbuffers,
-		nbuffers, dataSize, cache);
-	assert(ok);
-	(void) ok; // Shut up compiler warning
-
-	MemoryKit::mbuf_pool &mbuf_pool = getContext()->mbuf_pool;
-	const unsigned int MBUF_MAX_SIZE = mbuf_pool_data_size(&mbuf_pool);
-	if (dataSize <= MBUF_MAX_SIZE) {
-		MemoryKit::mbuf buffer(MemoryKit::mbuf_get(&mbuf_pool));
-		gatherBuffers(buffer.start, MBUF_MAX_SIZE, buffers, nbuffers);
-		buffer = MemoryKit::mbuf(buffer, offset, dataSize - offset);
-		req->appSink.feedWithoutRefGuard(boost::move(buffer));
-	} else {
-		char *buffer = (char *) psg_pnalloc(req->pool, dataSize);
-		gatherBuffers(buffer, dataSize, buffers, nbuffers);
-		req->appSink.feedWithoutRefGuard(MemoryKit::mbuf(
-			buffer + offset, dataSize - offset));
-	}
-}
-
 void
 Controller::sendBodyToApp(Client *client, Request *req) {
 	TRACE_POINT();
 	assert(req->appSink.acceptingInput());
+	req->timeOnRequestHeaderSent = ev_now(getLoop());
 	#ifdef DEBUG_CC_EVENT_LOOP_BLOCKING
-		req->timeOnRequestHeaderSent = ev_now(getLoop());
 		reportLargeTimeDiff(client,
 			"ApplicationPool get until headers sent",
 			req->timeBeforeAccessingApplicationPool,
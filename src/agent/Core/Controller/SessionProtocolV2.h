@@ -0,0 +1,238 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2018 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_CORE_CONTROLLER_SESSION_PROTOCOL_V2_H_
+#define _PASSENGER_CORE_CONTROLLER_SESSION_PROTOCOL_V2_H_
+
+#include <boost/cstdint.hpp>
+#include <cstddef>
+
+#include <StaticString.h>
+#include <DataStructures/LString.h>
+#include <DataStructures/HashedStaticString.h>
+#include <ServerKit/HeaderTable.h>
+#include <Utils/StrIntUtils.h>
+
+/*************************************************************************
+ *
+ * Encoding helpers for version 2 of the "session" protocol, which is
+ * advertised by application sockets as "session2".
+ *
+ * Like version 1, a request header is a single frame that starts with a
+ * 32-bit big-endian size. But instead of NUL-separated name/value strings,
+ * the frame body is binary:
+ *
+ *   version    1 byte, always 2
+ *   entries    repeated until the end of the frame:
+ *     id       1 byte. Nonzero: index + 1 into the static field name
+ *              table below. Zero: the name is sent literally, prefixed
+ *              with a 16-bit big-endian size.
+ *     size     16-bit big-endian value size. If it's 0xFFFF, then the
+ *              real size follows as a 32-bit big-endian integer.
+ *     value    the value bytes.
+ *
+ * Names of well-known CGI variables and headers are thus sent as a
+ * single byte, and values never have to be scanned for delimiters.
+ *
+ * The field name table must be kept in sync with
+ * PhusionPassenger::RequestHandler::ThreadHandler::SESSION2_FIELD_NAMES.
+ *
+ *************************************************************************/
+
+namespace Passenger {
+namespace Core {
+
+
+/**
+ * Returns whether the given application socket protocol is a version
+ * of the "session" protocol.
+ */
+inline bool
+isSessionProtocol(const StaticString &protocol) {
+	return protocol == P_STATIC_STRING("session")
+		|| protocol == P_STATIC_STRING("session2");
+}
+
+namespace SessionProtocolV2 {
+
+
+enum FieldId {
+	FIELD_UNKNOWN = 0,
+	FIELD_REQUEST_URI,
+	FIELD_PATH_INFO,
+	FIELD_SCRIPT_NAME,
+	FIELD_QUERY_STRING,
+	FIELD_REQUEST_METHOD,
+	FIELD_SERVER_NAME,
+	FIELD_SERVER_PORT,
+	FIELD_SERVER_SOFTWARE,
+	FIELD_SERVER_PROTOCOL,
+	FIELD_REMOTE_ADDR,
+	FIELD_REMOTE_PORT,
+	FIELD_REMOTE_USER,
+	FIELD_CONTENT_TYPE,
+	FIELD_CONTENT_LENGTH,
+	FIELD_PASSENGER_CONNECT_PASSWORD,
+	FIELD_HTTPS,
+	FIELD_HTTP_CONNECTION,
+
+	// HTTP headers. Keep in the same order as in lookupHeaderField().
+	FIELD_HTTP_HOST,
+	FIELD_HTTP_USER_AGENT,
+	FIELD_HTTP_ACCEPT,
+	FIELD_HTTP_ACCEPT_ENCODING,
+	FIELD_HTTP_ACCEPT_LANGUAGE,
+	FIELD_HTTP_COOKIE,
+	FIELD_HTTP_REFERER,
+	FIELD_HTTP_CACHE_CONTROL,
+	FIELD_HTTP_X_FORWARDED_FOR,
+	FIELD_HTTP_X_FORWARDED_PROTO,
+	FIELD_HTTP_X_REQUEST_ID,
+	FIELD_HTTP_IF_NONE_MATCH,
+	FIELD_HTTP_IF_MODIFIED_SINCE,
+	FIELD_HTTP_AUTHORIZATION,
+	FIELD_HTTP_ORIGIN,
+	FIELD_HTTP_UPGRADE,
+	FIELD_HTTP_X_REQUESTED_WITH,
+
+	FIELD_COUNT
+};
+
+const boost::uint8_t VERSION = 2;
+const boost::uint16_t LONG_VALUE_SIZE_MARKER = 0xFFFF;
+const size_t MAX_NAME_SIZE = 0xFFFF;
+
+/**
+ * The maximum number of bytes by which an encoded entry may be larger than
+ * the same entry in version 1 of the protocol. Well-known names are at
+ * least 5 bytes long, so they never make an entry larger. An entry with a
+ * literal name costs 1 (id) + 2 (name size) + 6 (long value size) bytes of
+ * overhead, versus 2 NUL terminators in version 1.
+ */
+const unsigned int MAX_ENTRY_OVERHEAD = 7;
+
+
+/**
+ * Returns the field ID of the given (lowercase) HTTP request header, or
+ * FIELD_UNKNOWN if it isn't in the table.
+ */
+inline FieldId
+lookupHeaderField(const ServerKit::Header *header) {
+	static const HashedStaticString names[] = {
+		"host",
+		"user-agent",
+		"accept",
+		"accept-encoding",
+		"accept-language",
+		"cookie",
+		"referer",
+		"cache-control",
+		"x-forwarded-for",
+		"x-forwarded-proto",
+		"x-request-id",
+		"if-none-match",
+		"if-modified-since",
+		"authorization",
+		"origin",
+		"upgrade",
+		"x-requested-with"
+	};
+	const unsigned int count = sizeof(names) / sizeof(HashedStaticString);
+
+	for (unsigned int i = 0; i < count; i++) {
+		if (header->hash == names[i].hash() && psg_lstr_cmp(&header->key, names[i])) {
+			return (FieldId) (FIELD_HTTP_HOST + i);
+		}
+	}
+	return FIELD_UNKNOWN;
+}
+
+inline char *
+appendUint16(char *pos, const char *end, boost::uint16_t value) {
+	char data[2];
+	data[0] = (char) (value >> 8);
+	data[1] = (char) (value & 0xFF);
+	return appendData(pos, end, data, 2);
+}
+
+inline char *
+appendUint32(char *pos, const char *end, boost::uint32_t value) {
+	char data[4];
+	data[0] = (char) (value >> 24);
+	data[1] = (char) ((value >> 16) & 0xFF);
+	data[2] = (char) ((value >> 8) & 0xFF);
+	data[3] = (char) (value & 0xFF);
+	return appendData(pos, end, data, 4);
+}
+
+/**
+ * Appends the name part of an entry. `name` is only used if `id` is
+ * FIELD_UNKNOWN, in which case its size must not exceed MAX_NAME_SIZE.
+ */
+inline char *
+appendName(char *pos, const char *end, FieldId id, const StaticString &name) {
+	char idByte = (char) id;
+	pos = appendData(pos, end, &idByte, 1);
+	if (id == FIELD_UNKNOWN) {
+		pos = appendUint16(pos, end, (boost::uint16_t) name.size());
+		pos = appendData(pos, end, name);
+	}
+	return pos;
+}
+
+inline char *
+appendValueSize(char *pos, const char *end, size_t size) {
+	if (size < LONG_VALUE_SIZE_MARKER) {
+		return appendUint16(pos, end, (boost::uint16_t) size);
+	} else {
+		pos = appendUint16(pos, end, LONG_VALUE_SIZE_MARKER);
+		return appendUint32(pos, end, (boost::uint32_t) size);
+	}
+}
+
+inline char *
+appendEntry(char *pos, const char *end, FieldId id, const StaticString &name,
+	const StaticString &value)
+{
+	pos = appendName(pos, end, id, name);
+	pos = appendValueSize(pos, end, value.size());
+	return appendData(pos, end, value);
+}
+
+inline char *
+appendEntry(char *pos, const char *end, FieldId id, const StaticString &name,
+	const LString *value)
+{
+	pos = appendName(pos, end, id, name);
+	pos = appendValueSize(pos, end, value->size);
+	return appendData(pos, end, value);
+}
+
+
+} // namespace SessionProtocolV2
+} // namespace Core
+} // namespace Passenger
+
+#endif /* _PASSENGER_CORE_CONTROLLER_SESSION_PROTOCOL_V2_H_ */
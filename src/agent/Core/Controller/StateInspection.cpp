@@ -67,6 +67,11 @@ Controller::inspectStateAsJson() const {
 	return doc;
 }
 
+RequestLatencySnapshotPtr
+Controller::snapshotRequestLatencies() const {
+	return latencyStats.snapshot();
+}
+
 Json::Value
 Controller::inspectClientStateAsJson(const Client *client) const {
 	Json::Value doc = ParentClass::inspectClientStateAsJson(client);
@@ -92,7 +97,10 @@ Controller::inspectRequestStateAsJson(const Request *req) const {
 
 	flags["dechunk_response"] = req->dechunkResponse;
 	flags["request_body_buffering"] = req->requestBodyBuffering;
+	flags["body_buffer_limit_reached"] = req->bodyBufferLimitReached;
 	flags["https"] = req->https;
+	flags["accepts_gzip"] = req->acceptsGzip;
+	flags["prefetching_session"] = req->prefetchingSession;
 	doc["flags"] = flags;
 
 	if (req->requestBodyBuffering) {
@@ -111,6 +119,10 @@ Controller::inspectRequestStateAsJson(const Request *req) const {
 		}
 	}
 
+	if (req->prefetchedSession != NULL) {
+		doc["prefetched_session_pid"] = (Json::Int64) req->prefetchedSession->getPid();
+	}
+
 	if (req->appResponseInitialized) {
 		doc["app_response_http_state"] = resp->getHttpStateString();
 		if (resp->begun()) {
@@ -118,6 +130,7 @@ Controller::inspectRequestStateAsJson(const Request *req) const {
 			doc["app_response_http_minor"] = resp->httpMinor;
 			doc["app_response_want_keep_alive"] = resp->wantKeepAlive;
 			doc["app_response_body_type"] = resp->getBodyTypeString();
+			doc["app_response_compressed"] = resp->compressed;
 			doc["app_response_body_fully_read"] = resp->bodyFullyRead();
 			doc["app_response_body_already_read"] = byteSizeToJson(
 				resp->bodyAlreadyRead);
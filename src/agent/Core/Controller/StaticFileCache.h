@@ -0,0 +1,359 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2018 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_CORE_CONTROLLER_STATIC_FILE_CACHE_H_
+#define _PASSENGER_CORE_CONTROLLER_STATIC_FILE_CACHE_H_
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/cstdint.hpp>
+#include <oxt/macros.hpp>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <ctime>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <FileDescriptor.h>
+#include <StaticString.h>
+#include <DataStructures/StringKeyTable.h>
+#include <Utils/StrIntUtils.h>
+
+namespace Passenger {
+namespace Core {
+
+using namespace std;
+
+
+/**
+ * Caches open file descriptors and metadata of files in application
+ * `public` directories, so that the Controller can serve static files
+ * without opening and stat()ing them for every request. Lookups of
+ * paths that do not refer to a regular file are cached too: these are
+ * done for every request that ends up going to the application.
+ *
+ * Entries for existing files and entries for missing paths are kept in
+ * separate tables, each with its own size limit. When a table is full,
+ * its least recently used entries are evicted. This way a client that
+ * requests many different nonexistent URLs (e.g. a crawler or a scanner)
+ * can't push the files that are actually being served out of the cache.
+ *
+ * An entry is revalidated with stat() when it's older than
+ * REVALIDATION_INTERVAL seconds. If the file changed, the entry is
+ * replaced, not modified: requests that are still sending the old file
+ * keep a reference to the old entry and thus to the old file descriptor.
+ *
+ * Each Controller (and thus each thread) has its own instance, so no
+ * locking is necessary.
+ */
+class StaticFileCache: public boost::noncopyable {
+public:
+	struct Entry {
+		// -1 if the path does not refer to a readable regular file.
+		FileDescriptor fd;
+		boost::uint64_t size;
+		time_t mtime;
+		dev_t dev;
+		ino_t ino;
+		time_t lastChecked;
+		// Value of StaticFileCache::useCounter when the entry was last looked up.
+		boost::uint64_t lastUsed;
+		// Points to static data.
+		StaticString contentType;
+		// Including the quotes.
+		string etag;
+		string lastModified;
+
+		Entry()
+			: size(0),
+			  mtime(0),
+			  dev(0),
+			  ino(0),
+			  lastChecked(0),
+			  lastUsed(0)
+			{ }
+
+		bool exists() const {
+			return fd != -1;
+		}
+	};
+
+	typedef boost::shared_ptr<Entry> EntryPtr;
+
+	// Per table.
+	static const unsigned int MAX_ENTRIES = 1024;
+	static const time_t REVALIDATION_INTERVAL = 1;
+	// StringKeyTable limitation.
+	static const unsigned int MAX_PATH_SIZE = 255;
+
+private:
+	/** Entries for readable regular files. */
+	StringKeyTable<EntryPtr> entries;
+	/** Entries for paths that do not refer to a readable regular file. */
+	StringKeyTable<EntryPtr> missingEntries;
+	boost::uint64_t useCounter;
+
+	static bool sameFile(const Entry &entry, const struct stat &buf) {
+		return entry.exists()
+			&& S_ISREG(buf.st_mode)
+			&& entry.dev == buf.st_dev
+			&& entry.ino == buf.st_ino
+			&& entry.size == (boost::uint64_t) buf.st_size
+			&& entry.mtime == buf.st_mtime;
+	}
+
+	static EntryPtr createEntry(const char *path, time_t now) {
+		EntryPtr entry(boost::make_shared<Entry>());
+		struct stat buf;
+		int fd, ret;
+
+		entry->lastChecked = now;
+
+		// Only open regular files: opening a FIFO would block.
+		do {
+			ret = stat(path, &buf);
+		} while (OXT_UNLIKELY(ret == -1 && errno == EINTR));
+		if (ret == -1 || !S_ISREG(buf.st_mode)) {
+			return entry;
+		}
+
+		do {
+			fd = open(path, O_RDONLY | O_NONBLOCK);
+		} while (OXT_UNLIKELY(fd == -1 && errno == EINTR));
+		if (fd == -1) {
+			return entry;
+		}
+		FileDescriptor guard(fd, __FILE__, __LINE__);
+
+		do {
+			ret = fstat(fd, &buf);
+		} while (OXT_UNLIKELY(ret == -1 && errno == EINTR));
+		if (ret == -1 || !S_ISREG(buf.st_mode)) {
+			return entry;
+		}
+
+		entry->fd = guard;
+		entry->size = buf.st_size;
+		entry->mtime = buf.st_mtime;
+		entry->dev = buf.st_dev;
+		entry->ino = buf.st_ino;
+		entry->contentType = getContentType(path);
+		entry->etag = formatEtag(buf);
+		entry->lastModified = formatHttpDate(buf.st_mtime);
+		return entry;
+	}
+
+	/**
+	 * Evicts the least recently used quarter of the entries in the given
+	 * table. The table is rebuilt instead of erased from, because
+	 * StringKeyTable doesn't reclaim the storage of erased keys.
+	 */
+	static void makeRoom(StringKeyTable<EntryPtr> &table) {
+		StringKeyTable<EntryPtr>::Iterator it(table);
+		vector<boost::uint64_t> useTimes;
+		unsigned int keep = MAX_ENTRIES * 3 / 4;
+
+		useTimes.reserve(table.size());
+		while (*it != NULL) {
+			useTimes.push_back(it.getValue()->lastUsed);
+			it.next();
+		}
+		if (useTimes.size() <= keep) {
+			return;
+		}
+
+		vector<boost::uint64_t>::iterator threshold = useTimes.end() - keep;
+		std::nth_element(useTimes.begin(), threshold, useTimes.end());
+
+		StringKeyTable<EntryPtr> newTable(table.arraySize());
+		StringKeyTable<EntryPtr>::Iterator it2(table);
+		while (*it2 != NULL) {
+			if (it2.getValue()->lastUsed >= *threshold) {
+				newTable.insert(it2.getKey(), it2.getValue());
+			}
+			it2.next();
+		}
+		table.swap(newTable);
+	}
+
+	static string formatEtag(const struct stat &buf) {
+		// Same format as Nginx.
+		char etag[2 * 16 + 4];
+		int size = snprintf(etag, sizeof(etag), "\"%llx-%llx\"",
+			(unsigned long long) buf.st_mtime,
+			(unsigned long long) buf.st_size);
+		return string(etag, size);
+	}
+
+	static string formatHttpDate(time_t time) {
+		char date[64];
+		struct tm the_tm;
+		gmtime_r(&time, &the_tm);
+		size_t size = strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT",
+			&the_tm);
+		return string(date, size);
+	}
+
+public:
+	StaticFileCache()
+		: entries(64),
+		  missingEntries(64),
+		  useCounter(0)
+		{ }
+
+	/**
+	 * Looks up the file at the given absolute path, opening it or
+	 * revalidating the cached entry if necessary. `path` must be
+	 * NUL-terminated and at most MAX_PATH_SIZE bytes.
+	 *
+	 * Never returns NULL; check `Entry::exists()`.
+	 */
+	EntryPtr lookup(const HashedStaticString &path, time_t now) {
+		EntryPtr *cached;
+		bool found;
+
+		useCounter++;
+		found = entries.lookup(path, &cached) || missingEntries.lookup(path, &cached);
+		if (found) {
+			Entry &entry = **cached;
+			entry.lastUsed = useCounter;
+			if (entry.lastChecked + REVALIDATION_INTERVAL > now) {
+				return *cached;
+			}
+
+			struct stat buf;
+			int ret;
+			do {
+				ret = stat(path.data(), &buf);
+			} while (OXT_UNLIKELY(ret == -1 && errno == EINTR));
+			if ((ret == 0 && sameFile(entry, buf))
+			 || (ret == -1 && !entry.exists()))
+			{
+				entry.lastChecked = now;
+				return *cached;
+			}
+		}
+
+		EntryPtr entry(createEntry(path.data(), now));
+		entry->lastUsed = useCounter;
+		if (found && (*cached)->exists() == entry->exists()) {
+			*cached = entry;
+			return entry;
+		}
+
+		StringKeyTable<EntryPtr> &table = entry->exists() ? entries : missingEntries;
+		if (found) {
+			// The path appeared or disappeared, so its entry moves to the other table.
+			(entry->exists() ? missingEntries : entries).erase(path);
+		}
+		if (table.size() >= MAX_ENTRIES) {
+			makeRoom(table);
+		}
+		table.insert(path, entry);
+		return entry;
+	}
+
+	void clear() {
+		entries.clear();
+		missingEntries.clear();
+	}
+
+	unsigned int size() const {
+		return entries.size() + missingEntries.size();
+	}
+
+	/**
+	 * Returns the Content-Type for the given filename, based on its extension.
+	 */
+	static StaticString getContentType(const StaticString &filename) {
+		static const struct {
+			const char *extension;
+			const char *contentType;
+		} types[] = {
+			{ "html", "text/html" },
+			{ "htm", "text/html" },
+			{ "css", "text/css" },
+			{ "js", "application/javascript" },
+			{ "mjs", "application/javascript" },
+			{ "json", "application/json" },
+			{ "map", "application/json" },
+			{ "xml", "text/xml" },
+			{ "txt", "text/plain" },
+			{ "csv", "text/csv" },
+			{ "svg", "image/svg+xml" },
+			{ "png", "image/png" },
+			{ "jpg", "image/jpeg" },
+			{ "jpeg", "image/jpeg" },
+			{ "gif", "image/gif" },
+			{ "ico", "image/x-icon" },
+			{ "webp", "image/webp" },
+			{ "bmp", "image/x-ms-bmp" },
+			{ "woff", "font/woff" },
+			{ "woff2", "font/woff2" },
+			{ "ttf", "font/ttf" },
+			{ "otf", "font/otf" },
+			{ "eot", "application/vnd.ms-fontobject" },
+			{ "wasm", "application/wasm" },
+			{ "pdf", "application/pdf" },
+			{ "zip", "application/zip" },
+			{ "mp3", "audio/mpeg" },
+			{ "ogg", "audio/ogg" },
+			{ "wav", "audio/wav" },
+			{ "mp4", "video/mp4" },
+			{ "webm", "video/webm" }
+		};
+
+		const char *begin = filename.data();
+		const char *pos = filename.data() + filename.size();
+		while (pos > begin && pos[-1] != '.' && pos[-1] != '/') {
+			pos--;
+		}
+		if (pos > begin && pos[-1] == '.') {
+			StaticString extension(pos, filename.data() + filename.size() - pos);
+			for (unsigned int i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+				if (extension.size() == strlen(types[i].extension)
+				 && strncasecmp(extension.data(), types[i].extension,
+					extension.size()) == 0)
+				{
+					return types[i].contentType;
+				}
+			}
+		}
+		return P_STATIC_STRING("application/octet-stream");
+	}
+};
+
+
+} // namespace Core
+} // namespace Passenger
+
+#endif /* _PASSENGER_CORE_CONTROLLER_STATIC_FILE_CACHE_H_ */
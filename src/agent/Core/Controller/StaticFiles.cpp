@@ -0,0 +1,514 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2018 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#include <Core/Controller.h>
+#ifdef __linux__
+	#include <sys/sendfile.h>
+#endif
+
+/*************************************************************************
+ *
+ * Implements Core::Controller methods pertaining serving files in the
+ * application's public directory, without involving the application.
+ *
+ *************************************************************************/
+
+namespace Passenger {
+namespace Core {
+
+using namespace std;
+using namespace boost;
+
+
+/****************************
+ *
+ * Private methods
+ *
+ ****************************/
+
+
+/**
+ * Serves the request from the application's public directory if it
+ * refers to a file in there. Like the Nginx module, this also maps
+ * "/foo/" to "/foo/index.html" and "/foo" to "/foo.html" (Rails page
+ * caching). Precompressed ".br" and ".gz" variants are served to clients
+ * that accept them.
+ *
+ * Returns whether the request is being served. If not, nothing has been
+ * written and the request should be passed to the application.
+ */
+bool
+Controller::serveStaticFile(Client *client, Request *req) {
+	if (!req->config->serveStaticFiles
+	 || (req->method != HTTP_GET && req->method != HTTP_HEAD)
+	 || req->hasBody()
+	 || req->upgraded())
+	{
+		return false;
+	}
+
+	time_t now = (time_t) ev_now(getLoop());
+	StaticFileCache::EntryPtr file;
+	StaticString filename;
+	if (!lookupStaticFile(req, now, file, filename)) {
+		return false;
+	}
+
+	StaticFileCache::EntryPtr body = file;
+	StaticString contentEncoding;
+	StaticFileCache::EntryPtr brotli = lookupStaticFileVariant(now, filename,
+		P_STATIC_STRING(".br"));
+	StaticFileCache::EntryPtr gzip = lookupStaticFileVariant(now, filename,
+		P_STATIC_STRING(".gz"));
+	bool hasVariants = brotli->exists() || gzip->exists();
+	if (hasVariants) {
+		const LString *acceptEncoding = req->headers.lookup(HTTP_ACCEPT_ENCODING);
+		if (acceptEncoding == NULL) {
+			// Use the uncompressed file.
+		} else if (brotli->exists()
+			&& acceptEncodingAllows(acceptEncoding, P_STATIC_STRING("br"), req->pool))
+		{
+			body = brotli;
+			contentEncoding = P_STATIC_STRING("br");
+		} else if (gzip->exists()
+			&& acceptEncodingAllows(acceptEncoding, P_STATIC_STRING("gzip"), req->pool))
+		{
+			body = gzip;
+			contentEncoding = P_STATIC_STRING("gzip");
+		}
+	}
+
+	bool notModified = staticFileNotModified(req, *body);
+	StaticString statusLine = responseHeaderCache.getStatusLine(req->httpMajor,
+		req->httpMinor, notModified ? 304 : 200);
+	if (OXT_UNLIKELY(statusLine.empty())) {
+		// Unusual HTTP version. Let the application deal with it.
+		return false;
+	}
+	StaticString dateHeader = responseHeaderCache.getDateHeader(now);
+
+	SKC_DEBUG(client, "Serving static file " << filename <<
+		(contentEncoding.empty() ? "" : " (") << contentEncoding <<
+		(contentEncoding.empty() ? "" : ")") <<
+		(notModified ? ": not modified" : ""));
+
+	unsigned int headerBufSize = statusLine.size() + dateHeader.size()
+		+ file->contentType.size() + body->etag.size() + body->lastModified.size()
+		+ 256;
+	char *header = (char *) psg_pnalloc(req->pool, headerBufSize);
+	char *pos = header;
+	const char *end = header + headerBufSize;
+
+	pos = appendData(pos, end, statusLine);
+	pos = appendData(pos, end, dateHeader);
+	if (!notModified) {
+		pos = appendData(pos, end, P_STATIC_STRING("Content-Type: "));
+		pos = appendData(pos, end, file->contentType);
+		pos = appendData(pos, end, P_STATIC_STRING("\r\nContent-Length: "));
+		pos += integerToOtherBase<boost::uint64_t, 10>(body->size, pos, end - pos);
+		pos = appendData(pos, end, P_STATIC_STRING("\r\n"));
+		if (!contentEncoding.empty()) {
+			pos = appendData(pos, end, P_STATIC_STRING("Content-Encoding: "));
+			pos = appendData(pos, end, contentEncoding);
+			pos = appendData(pos, end, P_STATIC_STRING("\r\n"));
+		}
+	}
+	pos = appendData(pos, end, P_STATIC_STRING("Last-Modified: "));
+	pos = appendData(pos, end, body->lastModified);
+	pos = appendData(pos, end, P_STATIC_STRING("\r\nETag: "));
+	pos = appendData(pos, end, body->etag);
+	pos = appendData(pos, end, P_STATIC_STRING("\r\n"));
+	if (hasVariants) {
+		pos = appendData(pos, end, P_STATIC_STRING("Vary: Accept-Encoding\r\n"));
+	}
+
+	unsigned int httpVersion = req->httpMajor * 1000 + req->httpMinor * 10;
+	if (canKeepAlive(req)) {
+		if (httpVersion < 1010) {
+			// HTTP < 1.1 defaults to "Connection: close"
+			pos = appendData(pos, end, P_STATIC_STRING("Connection: keep-alive\r\n"));
+		}
+	} else if (httpVersion >= 1010) {
+		// HTTP 1.1 defaults to "Connection: keep-alive"
+		pos = appendData(pos, end, P_STATIC_STRING("Connection: close\r\n"));
+	}
+	pos = appendData(pos, end, P_STATIC_STRING("\r\n"));
+
+	req->state = Request::SERVING_STATIC_FILE;
+	writeResponse(client, header, pos - header);
+	if (req->ended()) {
+		return true;
+	}
+
+	if (notModified || req->method == HTTP_HEAD || body->size == 0) {
+		endRequest(&client, &req);
+	} else {
+		req->staticFile = body;
+		req->staticFileOffset = 0;
+		sendStaticFileBody(client, req);
+	}
+	return true;
+}
+
+/**
+ * Maps the request URI to a file in the application's public directory.
+ * On success, `file` is set to the (existing) cache entry and `filename`
+ * to its path. `filename` is NUL-terminated and has room for appending
+ * a 3-byte suffix.
+ */
+bool
+Controller::lookupStaticFile(Request *req, time_t now,
+	StaticFileCache::EntryPtr &file, StaticString &filename)
+{
+	StaticString appRoot = req->options.appRoot;
+	StaticString baseURI = req->options.baseURI;
+	StaticString path = req->getPathWithoutQueryString();
+
+	if (!baseURI.empty() && baseURI != "/") {
+		if (!startsWith(path, baseURI)
+		 || (path.size() > baseURI.size() && path[baseURI.size()] != '/'))
+		{
+			return false;
+		}
+		path = path.substr(baseURI.size());
+		if (path.empty()) {
+			path = P_STATIC_STRING("/");
+		}
+	}
+	if (path.empty() || path[0] != '/' || appRoot.empty()) {
+		return false;
+	}
+
+	// Percent-decoding only makes the path shorter.
+	size_t bufSize = appRoot.size() + sizeof("/public") - 1 + path.size()
+		+ sizeof("index.html") + sizeof(".gz") - 1;
+	char *buf = (char *) psg_pnalloc(req->pool, bufSize);
+	char *pos = buf;
+	const char *end = buf + bufSize;
+
+	pos = appendData(pos, end, appRoot);
+	pos = appendData(pos, end, P_STATIC_STRING("/public"));
+	char *decodedPath = pos;
+	pos = percentDecodeStaticFilePath(path, pos);
+	if (pos == NULL || staticFilePathHasDotSegments(decodedPath, pos)) {
+		return false;
+	}
+
+	if (pos[-1] == '/') {
+		pos = appendData(pos, end, P_STATIC_STRING("index.html"));
+	} else {
+		*pos = '\0';
+		if (lookupStaticFileCandidate(now, buf, pos - buf, file)) {
+			filename = StaticString(buf, pos - buf);
+			return true;
+		}
+		pos = appendData(pos, end, P_STATIC_STRING(".html"));
+	}
+
+	*pos = '\0';
+	if (lookupStaticFileCandidate(now, buf, pos - buf, file)) {
+		filename = StaticString(buf, pos - buf);
+		return true;
+	} else {
+		return false;
+	}
+}
+
+bool
+Controller::lookupStaticFileCandidate(time_t now, const char *path,
+	size_t size, StaticFileCache::EntryPtr &file)
+{
+	if (size > StaticFileCache::MAX_PATH_SIZE) {
+		return false;
+	}
+	file = staticFileCache.lookup(HashedStaticString(path, size), now);
+	return file->exists();
+}
+
+StaticFileCache::EntryPtr
+Controller::lookupStaticFileVariant(time_t now, const StaticString &filename,
+	const StaticString &suffix)
+{
+	// lookupStaticFile() left room for the suffix.
+	char *path = const_cast<char *>(filename.data());
+	memcpy(path + filename.size(), suffix.data(), suffix.size());
+	path[filename.size() + suffix.size()] = '\0';
+
+	StaticFileCache::EntryPtr variant;
+	lookupStaticFileCandidate(now, path, filename.size() + suffix.size(), variant);
+	path[filename.size()] = '\0';
+	if (variant == NULL) {
+		variant = boost::make_shared<StaticFileCache::Entry>();
+	}
+	return variant;
+}
+
+/**
+ * Percent-decodes `path` into `output`. Returns the end of the output,
+ * or NULL if `path` contains an invalid escape sequence or a NUL byte.
+ */
+char *
+Controller::percentDecodeStaticFilePath(const StaticString &path, char *output) {
+	const char *pos = path.data();
+	const char *end = path.data() + path.size();
+
+	while (pos < end) {
+		if (*pos == '%') {
+			if (end - pos < 3 || !isxdigit(pos[1]) || !isxdigit(pos[2])) {
+				return NULL;
+			}
+			char ch = (char) hexToUint(StaticString(pos + 1, 2));
+			if (ch == '\0') {
+				return NULL;
+			}
+			*output = ch;
+			pos += 3;
+		} else if (*pos == '\0') {
+			return NULL;
+		} else {
+			*output = *pos;
+			pos++;
+		}
+		output++;
+	}
+
+	return output;
+}
+
+/**
+ * Checks whether the given (decoded) path contains a "." or ".."
+ * segment, which could otherwise be used to escape the public directory.
+ */
+bool
+Controller::staticFilePathHasDotSegments(const char *path, const char *end) {
+	const char *segment = path;
+
+	while (segment < end) {
+		// Skip the slash.
+		segment++;
+		const char *segmentEnd = (const char *) memchr(segment, '/', end - segment);
+		if (segmentEnd == NULL) {
+			segmentEnd = end;
+		}
+		size_t size = segmentEnd - segment;
+		if ((size == 1 && segment[0] == '.')
+		 || (size == 2 && segment[0] == '.' && segment[1] == '.'))
+		{
+			return true;
+		}
+		segment = segmentEnd;
+	}
+
+	return false;
+}
+
+bool
+Controller::staticFileNotModified(Request *req, const StaticFileCache::Entry &file) {
+	const LString *value = req->headers.lookup(HTTP_IF_NONE_MATCH);
+	if (value != NULL) {
+		// If-None-Match takes precedence over If-Modified-Since.
+		return etagListMatches(value, file.etag, req->pool);
+	}
+
+	value = req->headers.lookup(HTTP_IF_MODIFIED_SINCE);
+	if (value != NULL) {
+		// Same as Nginx's default "if_modified_since exact".
+		return psg_lstr_cmp(value, file.lastModified);
+	}
+
+	return false;
+}
+
+/**
+ * Checks whether an If-None-Match header value matches the given ETag,
+ * using the weak comparison function.
+ */
+bool
+Controller::etagListMatches(const LString *value, const StaticString &etag,
+	psg_pool_t *pool)
+{
+	value = psg_lstr_make_contiguous(value, pool);
+	const char *pos = value->start->data;
+	const char *end = value->start->data + value->size;
+
+	while (pos < end) {
+		const char *itemEnd = (const char *) memchr(pos, ',', end - pos);
+		if (itemEnd == NULL) {
+			itemEnd = end;
+		}
+		const char *tagEnd = itemEnd;
+
+		skipLeadingWhitespaces(&pos, tagEnd);
+		skipTrailingWhitespaces(pos, &tagEnd);
+		StaticString tag(pos, tagEnd - pos);
+		if (startsWith(tag, P_STATIC_STRING("W/"))) {
+			tag = tag.substr(2);
+		}
+		if (tag == "*" || tag == etag) {
+			return true;
+		}
+
+		pos = itemEnd + 1;
+	}
+
+	return false;
+}
+
+/**
+ * Sends the rest of the static file body. The file is sent directly to the
+ * client socket with sendfile() while the client keeps up. Otherwise, one
+ * chunk is copied into the client output channel, and sending resumes once
+ * the client has received it.
+ */
+void
+Controller::sendStaticFileBody(Client *client, Request *req) {
+	boost::uint64_t fileSize = req->staticFile->size;
+	boost::uint64_t sent = 0;
+
+	while (req->staticFileOffset < fileSize) {
+		if (client->output.getTotalBytesBuffered() > 0) {
+			SKC_TRACE(client, 3, "Waiting until the client has received the "
+				"buffered response data");
+			client->output.setDataFlushedCallback(_staticFileOutputDataFlushed);
+			return;
+		}
+		if (sent >= MAX_STATIC_FILE_BURST_SIZE) {
+			// Give other clients on this thread a chance.
+			refRequest(req, __FILE__, __LINE__);
+			getContext()->libev->runLater(boost::bind(sendStaticFileBodyLater, req));
+			return;
+		}
+
+		ssize_t ret = sendStaticFileChunk(client, req, MAX_STATIC_FILE_BURST_SIZE - sent);
+		if (ret == -1) {
+			return;
+		}
+		sent += ret;
+	}
+
+	SKC_TRACE(client, 2, "Static file sent");
+	endRequest(&client, &req);
+}
+
+/**
+ * Sends up to `maxSize` bytes of the static file. Returns the number of
+ * bytes sent or buffered, or -1 if the client has been disconnected.
+ */
+ssize_t
+Controller::sendStaticFileChunk(Client *client, Request *req, size_t maxSize) {
+	const StaticFileCache::Entry *file = req->staticFile.get();
+	size_t count = (size_t) std::min<boost::uint64_t>(
+		file->size - req->staticFileOffset, maxSize);
+	ssize_t ret;
+
+	#ifdef __linux__
+		if (req->staticFileSendfile) {
+			off_t offset = req->staticFileOffset;
+			do {
+				ret = sendfile(client->getFd(), file->fd, &offset, count);
+			} while (OXT_UNLIKELY(ret == -1 && errno == EINTR));
+			if (ret > 0) {
+				req->staticFileOffset += ret;
+				req->lastDataSendTime = ev_now(getLoop());
+				return ret;
+			} else if (ret == 0) {
+				disconnectWithError(&client, "static file was truncated while sending it");
+				return -1;
+			} else if (errno == EINVAL || errno == ENOSYS) {
+				SKC_DEBUG(client, "sendfile() not supported for this client socket");
+				req->staticFileSendfile = false;
+			} else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				disconnectWithClientSocketWriteError(&client, errno);
+				return -1;
+			}
+			// Let the output channel wait until the socket is writable.
+		}
+	#endif
+
+	MemoryKit::mbuf buffer(MemoryKit::mbuf_get(&getContext()->mbuf_pool));
+	count = std::min<size_t>(count, buffer.size());
+	do {
+		ret = pread(file->fd, buffer.start, count, req->staticFileOffset);
+	} while (OXT_UNLIKELY(ret == -1 && errno == EINTR));
+	if (ret == -1) {
+		int e = errno;
+		stringstream message;
+		message << "error reading static file: " << strerror(e) <<
+			" (errno=" << e << ")";
+		disconnectWithError(&client, message.str());
+		return -1;
+	} else if (ret == 0) {
+		disconnectWithError(&client, "static file was truncated while sending it");
+		return -1;
+	}
+
+	req->staticFileOffset += ret;
+	writeResponse(client, MemoryKit::mbuf(buffer, 0, ret));
+	if (req->ended()) {
+		return -1;
+	}
+	return ret;
+}
+
+void
+Controller::sendStaticFileBodyLater(Request *req) {
+	Client *client = static_cast<Client *>(req->client);
+	Controller *self = static_cast<Controller *>(
+		Controller::getServerFromClient(client));
+	SKC_LOG_EVENT_FROM_STATIC(self, Controller, client, "sendStaticFileBodyLater");
+
+	if (!req->ended()) {
+		self->sendStaticFileBody(client, req);
+	}
+	self->unrefRequest(req, __FILE__, __LINE__);
+}
+
+void
+Controller::_staticFileOutputDataFlushed(FileBufferedChannel *_channel) {
+	FileBufferedFdSinkChannel *channel = reinterpret_cast<FileBufferedFdSinkChannel *>(_channel);
+	Client *client = static_cast<Client *>(static_cast<
+		ServerKit::BaseClient *>(channel->getHooks()->userData));
+	Request *req = static_cast<Request *>(client->currentRequest);
+	Controller *self = static_cast<Controller *>(getServerFromClient(client));
+
+	getClientOutputDataFlushedCallback()(_channel);
+	if (client->connected() && req != NULL) {
+		self->staticFileOutputDataFlushed(client, req);
+	}
+}
+
+void
+Controller::staticFileOutputDataFlushed(Client *client, Request *req) {
+	client->output.setDataFlushedCallback(getClientOutputDataFlushedCallback());
+	if (!req->ended() && req->state == Request::SERVING_STATIC_FILE
+	 && req->staticFile != NULL)
+	{
+		sendStaticFileBody(client, req);
+	}
+}
+
+
+} // namespace Core
+} // namespace Passenger
@@ -208,6 +208,20 @@ public:
 		return state == ENABLED;
 	}
 
+	/**
+	 * Permanently enables or disables turbocaching, e.g. because the
+	 * configuration changed. Enabling has no effect if turbocaching is
+	 * already (temporarily) enabled.
+	 */
+	void setEnabled(bool enabled) {
+		if (enabled && state == DISABLED) {
+			initialize(true);
+		} else if (!enabled && state != DISABLED) {
+			state = DISABLED;
+			responseCache.clear();
+		}
+	}
+
 	// Call when the event loop multiplexer returns.
 	void updateState(ev_tstamp now) {
 		if (OXT_UNLIKELY(state == DISABLED)) {
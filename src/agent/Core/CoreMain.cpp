@@ -27,11 +27,6 @@
 #ifndef _GNU_SOURCE
 	#define _GNU_SOURCE
 #endif
-#ifdef __linux__
-	#define SUPPORTS_PER_THREAD_CPU_AFFINITY
-	#include <sched.h>
-	#include <pthread.h>
-#endif
 #ifdef USE_SELINUX
 	#include <selinux/selinux.h>
 #endif
@@ -51,10 +46,12 @@
 #include <unistd.h>
 #include <limits.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <pwd.h>
 #include <grp.h>
 
 #include <set>
+#include <map>
 #include <vector>
 #include <string>
 #include <algorithm>
@@ -93,6 +90,7 @@
 #include <Utils/Timer.h>
 #include <Utils/MessageIO.h>
 #include <Utils/VariantMap.h>
+#include <Utils/CpuAffinity.h>
 #include <Core/OptionParser.h>
 #include <Core/Controller.h>
 #include <Core/ApiServer.h>
@@ -149,6 +147,7 @@ namespace Core {
 		SpawningKit::Context::Schema spawningKitContextSchema;
 		SpawningKit::ContextPtr spawningKitContext;
 		ApplicationPool2::ContextPtr appPoolContext;
+		ApplicationPool2::ProcessFdKeeperClientPtr processFdKeeper;
 		PoolPtr appPool;
 		Json::Value singleAppModeConfig;
 
@@ -157,9 +156,17 @@ namespace Core {
 		struct ev_signal sigintWatcher;
 		struct ev_signal sigtermWatcher;
 		struct ev_signal sigquitWatcher;
+		struct ev_signal sigusr1Watcher;
+		struct ev_signal sigusr2Watcher;
 
 		ApiWorkingObjects apiWorkingObjects;
 
+		/**
+		 * Controller thread N is pinned to CPU `controllerCpus[N % size]`.
+		 * Empty if controller threads aren't pinned.
+		 */
+		vector<unsigned int> controllerCpus;
+
 		EventFd exitEvent;
 		EventFd allClientsDisconnectedEvent;
 		unsigned int terminationCount;
@@ -217,6 +224,12 @@ static Schema *coreSchema;
 static ConfigKit::Store *coreConfig;
 static WorkingObjects *workingObjects;
 
+static int createControllerServerSocket(const string &address);
+static int createApiServerSocket(const string &address);
+static void keepServerSocket(const string &address, int fd);
+static void releaseServerSocket(const string &address);
+static void reportServerAddresses();
+
 #include <Core/ConfigChange.cpp>
 
 
@@ -259,7 +272,7 @@ initializeSingleAppMode() {
 
 	if (coreConfig->get("single_app_mode_app_type").isNull()) {
 		P_DEBUG("Autodetecting application type...");
-		AppTypeDetector detector(NULL, 0);
+		AppTypeDetector detector;
 		PassengerAppType appTypeEnum = detector.checkAppRoot(appRoot);
 		if (appTypeEnum == PAT_NONE || appTypeEnum == PAT_ERROR) {
 			fprintf(stderr, "ERROR: unable to autodetect what kind of application "
@@ -406,15 +419,145 @@ makeFileWorldReadableAndWritable(const string &path) {
 	}
 #endif
 
+/**
+ * Connects to the Watchdog's application process fd keeper, which allows
+ * application processes to survive a Core crash, and which allows a new Core
+ * to take over our server sockets. Only available when running under the
+ * Watchdog.
+ */
+static void
+initializeProcessFdKeeperClient() {
+	TRACE_POINT();
+	WorkingObjects *wo = workingObjects;
+	const Json::Value address = coreConfig->get("app_process_fd_keeper_address");
+
+	if (address.isNull() || coreConfig->get("instance_dir").asString().empty()) {
+		return;
+	}
+
+	ApplicationPool2::ProcessFdKeeperClientPtr client =
+		boost::make_shared<ApplicationPool2::ProcessFdKeeperClient>(
+			address.asString(),
+			coreConfig->get("watchdog_fd_passing_password").asString());
+	try {
+		client->connect();
+	} catch (const std::exception &e) {
+		P_WARN("Cannot connect to the Watchdog's application process fd keeper ("
+			<< e.what() << "). Application processes will not survive a "
+			SHORT_PROGRAM_NAME " core crash");
+		return;
+	}
+
+	wo->processFdKeeper = client;
+}
+
+/**
+ * Returns the server socket for the given address that the Watchdog's fd
+ * keeper held on to for a previous Core instance, or -1 if there is none.
+ * The previous Core may still be draining its clients: taking over its
+ * socket, instead of binding a new one, means that no connection is refused
+ * while the Core restarts.
+ */
+static int
+takeOverServerSocket(map<string, FileDescriptor> &keptServerSockets,
+	const string &address)
+{
+	map<string, FileDescriptor>::iterator it = keptServerSockets.find(address);
+	if (it == keptServerSockets.end()) {
+		return -1;
+	} else {
+		P_INFO("Taking over the server socket for " << address
+			<< " from the previous " SHORT_PROGRAM_NAME " core instance");
+		int fd = it->second.detach();
+		keptServerSockets.erase(it);
+		return fd;
+	}
+}
+
+/**
+ * Tells the Watchdog's fd keeper to stop holding on to the server sockets
+ * that we didn't take over, e.g. because the previous Core listened on an
+ * address that isn't configured for us. Otherwise the kernel would keep
+ * queueing connections on them that nobody accepts.
+ */
+static void
+releaseServerSocketsNotTakenOver(const map<string, FileDescriptor> &keptServerSockets) {
+	map<string, FileDescriptor>::const_iterator it;
+
+	for (it = keptServerSockets.begin(); it != keptServerSockets.end(); it++) {
+		P_NOTICE("No longer listening on " << it->first
+			<< ", on which the previous " SHORT_PROGRAM_NAME " core instance listened");
+		workingObjects->processFdKeeper->releaseServerSocket(it->first);
+	}
+}
+
+static void
+keepServerSocket(const string &address, int fd) {
+	if (workingObjects->processFdKeeper != NULL) {
+		workingObjects->processFdKeeper->keepServerSocket(address, fd);
+	}
+}
+
+static void
+releaseServerSocket(const string &address) {
+	if (workingObjects->processFdKeeper != NULL) {
+		workingObjects->processFdKeeper->releaseServerSocket(address);
+	}
+}
+
+/**
+ * Tells the Watchdog which addresses we listen on after they were changed at
+ * runtime, so that a restarted Core listens on the same addresses.
+ */
+static void
+reportServerAddresses() {
+	if (workingObjects->processFdKeeper != NULL) {
+		workingObjects->processFdKeeper->setServerAddresses(
+			coreConfig->get("controller_addresses"),
+			coreConfig->get("api_server_addresses"));
+	}
+}
+
+/**
+ * Creates a server socket for one of the controller addresses. Called at
+ * startup, and when a configuration change adds an address.
+ */
+static int
+createControllerServerSocket(const string &address) {
+	int fd = createServer(address,
+		coreConfig->get("controller_socket_backlog").asUInt(), true,
+		__FILE__, __LINE__);
+	P_LOG_FILE_DESCRIPTOR_PURPOSE(fd, "Server address: " << address);
+	if (getSocketAddressType(address) == SAT_UNIX) {
+		makeFileWorldReadableAndWritable(parseUnixSocketAddress(address));
+	}
+	return fd;
+}
+
+static int
+createApiServerSocket(const string &address) {
+	int fd = createServer(address, 0, true, __FILE__, __LINE__);
+	P_LOG_FILE_DESCRIPTOR_PURPOSE(fd, "ApiServer address: " << address);
+	if (getSocketAddressType(address) == SAT_UNIX) {
+		makeFileWorldReadableAndWritable(parseUnixSocketAddress(address));
+	}
+	return fd;
+}
+
 static void
 startListening() {
 	TRACE_POINT();
 	WorkingObjects *wo = workingObjects;
 	const Json::Value addresses = coreConfig->get("controller_addresses");
 	const Json::Value apiAddresses = coreConfig->get("api_server_addresses");
+	map<string, FileDescriptor> keptServerSockets;
 	Json::Value::const_iterator it;
 	unsigned int i;
 
+	if (wo->processFdKeeper != NULL) {
+		keptServerSockets = wo->processFdKeeper->fetchServerSockets();
+	}
+
 	#ifdef USE_SELINUX
 		// Set SELinux context on the first socket that we create
 		// so that the web server can access it.
@@ -422,9 +565,13 @@ startListening() {
 	#endif
 
 	for (it = addresses.begin(), i = 0; it != addresses.end(); it++, i++) {
-		wo->serverFds[i] = createServer(it->asString(),
-			coreConfig->get("controller_socket_backlog").asUInt(), true,
-			__FILE__, __LINE__);
+		wo->serverFds[i] = takeOverServerSocket(keptServerSockets, it->asString());
+		if (wo->serverFds[i] == -1) {
+			wo->serverFds[i] = createControllerServerSocket(it->asString());
+		} else {
+			P_LOG_FILE_DESCRIPTOR_PURPOSE(wo->serverFds[i],
+				"Server address: " << it->asString());
+		}
 		#ifdef USE_SELINUX
 			resetSelinuxSocketContext();
 			if (i == 0 && getSocketAddressType(it->asString()) == SAT_UNIX) {
@@ -435,21 +582,20 @@ startListening() {
 					"passenger_instance_httpd_socket_t");
 			}
 		#endif
-		P_LOG_FILE_DESCRIPTOR_PURPOSE(wo->serverFds[i],
-			"Server address: " << it->asString());
-		if (getSocketAddressType(it->asString()) == SAT_UNIX) {
-			makeFileWorldReadableAndWritable(parseUnixSocketAddress(it->asString()));
-		}
+		keepServerSocket(it->asString(), wo->serverFds[i]);
 	}
 	for (it = apiAddresses.begin(), i = 0; it != apiAddresses.end(); it++, i++) {
-		wo->apiServerFds[i] = createServer(it->asString(), 0, true,
-			__FILE__, __LINE__);
-		P_LOG_FILE_DESCRIPTOR_PURPOSE(wo->apiServerFds[i],
-			"ApiServer address: " << it->asString());
-		if (getSocketAddressType(it->asString()) == SAT_UNIX) {
-			makeFileWorldReadableAndWritable(parseUnixSocketAddress(it->asString()));
+		wo->apiServerFds[i] = takeOverServerSocket(keptServerSockets, it->asString());
+		if (wo->apiServerFds[i] == -1) {
+			wo->apiServerFds[i] = createApiServerSocket(it->asString());
+		} else {
+			P_LOG_FILE_DESCRIPTOR_PURPOSE(wo->apiServerFds[i],
+				"ApiServer address: " << it->asString());
 		}
+		keepServerSocket(it->asString(), wo->apiServerFds[i]);
 	}
+
+	releaseServerSocketsNotTakenOver(keptServerSockets);
 }
 
 static void
@@ -485,6 +631,26 @@ printInfo(EV_P_ struct ev_signal *watcher, int revents) {
 	oxt::thread(printInfoInThread, "Information printer");
 }
 
+/**
+ * The Watchdog sends SIGUSR2 right before it starts a new Core instance that
+ * replaces us (see AgentWatcher::restartGracefully()), and SIGUSR1 if
+ * starting that instance failed after all.
+ */
+static void
+onReplacementSignal(EV_P_ struct ev_signal *watcher, int revents) {
+	if (watcher->signum == SIGUSR2) {
+		P_NOTICE("Preparing to be replaced by a new " SHORT_PROGRAM_NAME
+			" core instance...");
+		oxt::thread(boost::bind(&Pool::prepareForReplacement, workingObjects->appPool),
+			"Replacement preparer");
+	} else {
+		P_NOTICE("The new " SHORT_PROGRAM_NAME " core instance could not be started;"
+			" continuing as normal");
+		oxt::thread(boost::bind(&Pool::abortReplacement, workingObjects->appPool),
+			"Replacement preparer");
+	}
+}
+
 static void
 inspectControllerStateAsJson(Controller *controller, string *result) {
 	*result = controller->inspectStateAsJson().toStyledString();
@@ -631,6 +797,77 @@ initializeCurl() {
 	}
 }
 
+static void
+initializeCpuPlacement() {
+	TRACE_POINT();
+	#ifdef PASSENGER_SUPPORTS_CPU_AFFINITY
+		WorkingObjects *wo = workingObjects;
+		unsigned int nthreads = coreConfig->get("controller_threads").asUInt();
+
+		if (!coreConfig->get("controller_cpus").isNull()) {
+			// Already validated by the config schema.
+			parseCpuList(coreConfig->get("controller_cpus").asString(),
+				wo->controllerCpus);
+		} else if (coreConfig->get("controller_cpu_affine").asBool()) {
+			unsigned int maxCpus = boost::thread::hardware_concurrency();
+			for (unsigned int i = 0; i < maxCpus && i < CPU_SETSIZE; i++) {
+				wo->controllerCpus.push_back(i);
+			}
+		}
+
+		// Only keep the CPUs that threads will actually be pinned to,
+		// so that the load balancer thread and the NUMA node selection
+		// don't consider unused CPUs.
+		if (wo->controllerCpus.size() > nthreads) {
+			wo->controllerCpus.resize(nthreads);
+		}
+	#endif
+}
+
+static vector<unsigned int>
+determineAppProcessCpus() {
+	TRACE_POINT();
+	WorkingObjects *wo = workingObjects;
+	vector<unsigned int> result;
+
+	if (!coreConfig->get("app_numa_affine").asBool()) {
+		return result;
+	}
+	if (wo->controllerCpus.empty()) {
+		P_WARN("Option 'app_numa_affine' has no effect because controller threads "
+			"are not pinned to CPUs. Please also set 'controller_cpu_affine' "
+			"or 'controller_cpus'");
+		return result;
+	}
+
+	map< unsigned int, vector<unsigned int> > nodes = getNumaNodeCpus();
+	map< unsigned int, vector<unsigned int> >::const_iterator it;
+	vector<unsigned int> selectedNodes;
+
+	for (it = nodes.begin(); it != nodes.end(); it++) {
+		const vector<unsigned int> &nodeCpus = it->second;
+		vector<unsigned int>::const_iterator cpuIt;
+
+		for (cpuIt = wo->controllerCpus.begin(); cpuIt != wo->controllerCpus.end(); cpuIt++) {
+			if (std::binary_search(nodeCpus.begin(), nodeCpus.end(), *cpuIt)) {
+				selectedNodes.push_back(it->first);
+				result.insert(result.end(), nodeCpus.begin(), nodeCpus.end());
+				break;
+			}
+		}
+	}
+
+	if (result.empty()) {
+		P_WARN("Cannot determine this system's NUMA topology, so application "
+			"processes will not be restricted to NUMA nodes");
+	} else {
+		std::sort(result.begin(), result.end());
+		P_INFO("Application processes will run on NUMA node(s) "
+			<< formatCpuList(selectedNodes) << " (CPUs " << formatCpuList(result) << ")");
+	}
+	return result;
+}
+
 static void
 initializeNonPrivilegedWorkingObjects() {
 	TRACE_POINT();
@@ -651,6 +888,9 @@ initializeNonPrivilegedWorkingObjects() {
 			"It doesn't seem to be returning random data. Please fix this.");
 	}
 
+	UPDATE_TRACE_POINT();
+	initializeCpuPlacement();
+
 	UPDATE_TRACE_POINT();
 	wo->spawningKitContext = boost::make_shared<SpawningKit::Context>(
 		wo->spawningKitContextSchema);
@@ -662,6 +902,7 @@ initializeNonPrivilegedWorkingObjects() {
 		wo->spawningKitContext->instanceDir = absolutizePath(
 			wo->spawningKitContext->instanceDir);
 	}
+	wo->spawningKitContext->appProcessCpus = determineAppProcessCpus();
 	wo->spawningKitContext->finalize();
 
 	UPDATE_TRACE_POINT();
@@ -669,6 +910,11 @@ initializeNonPrivilegedWorkingObjects() {
 	wo->appPoolContext->spawningKitFactory = boost::make_shared<SpawningKit::Factory>(
 		wo->spawningKitContext.get());
 	wo->appPoolContext->agentConfig = coreConfig->inspectEffectiveValues();
+	if (wo->processFdKeeper != NULL) {
+		wo->appPoolContext->processFdKeeper = wo->processFdKeeper;
+		wo->appPoolContext->poolSnapshotPath = wo->spawningKitContext->instanceDir
+			+ "/pool_snapshot.json";
+	}
 	wo->appPoolContext->finalize();
 	wo->appPool = boost::make_shared<Pool>(wo->appPoolContext.get());
 	wo->appPool->initialize();
@@ -676,6 +922,7 @@ initializeNonPrivilegedWorkingObjects() {
 	wo->appPool->setMaxIdleTime(coreConfig->get("pool_idle_time").asInt() * 1000000ULL);
 	wo->appPool->enableSelfChecking(coreConfig->get("pool_selfchecks").asBool());
 	wo->appPool->abortLongRunningConnectionsCallback = abortLongRunningConnections;
+	wo->appPool->adoptProcesses();
 
 	UPDATE_TRACE_POINT();
 	unsigned int nthreads = coreConfig->get("controller_threads").asUInt();
@@ -730,6 +977,10 @@ initializeNonPrivilegedWorkingObjects() {
 	ev_signal_start(firstLoop->libev_loop, &wo->sigintWatcher);
 	ev_signal_init(&wo->sigtermWatcher, onTerminationSignal, SIGTERM);
 	ev_signal_start(firstLoop->libev_loop, &wo->sigtermWatcher);
+	ev_signal_init(&wo->sigusr1Watcher, onReplacementSignal, SIGUSR1);
+	ev_signal_start(firstLoop->libev_loop, &wo->sigusr1Watcher);
+	ev_signal_init(&wo->sigusr2Watcher, onReplacementSignal, SIGUSR2);
+	ev_signal_start(firstLoop->libev_loop, &wo->sigusr2Watcher);
 
 	UPDATE_TRACE_POINT();
 	if (!apiAddresses.empty()) {
@@ -974,11 +1225,6 @@ static void
 mainLoop() {
 	TRACE_POINT();
 	WorkingObjects *wo = workingObjects;
-	#ifdef SUPPORTS_PER_THREAD_CPU_AFFINITY
-		unsigned int maxCpus = boost::thread::hardware_concurrency();
-		bool cpuAffine = coreConfig->get("controller_cpu_affine").asBool()
-			&& maxCpus <= CPU_SETSIZE;
-	#endif
 
 	Agent::Fundamentals::context->abortHandlerConfig.diagnosticsDumper = dumpDiagnosticsOnCrash;
 	Agent::Fundamentals::abortHandlerConfigChanged();
@@ -986,17 +1232,15 @@ mainLoop() {
 	for (unsigned int i = 0; i < wo->threadWorkingObjects.size(); i++) {
 		ThreadWorkingObjects *two = &wo->threadWorkingObjects[i];
 		two->bgloop->start("Main event loop: thread " + toString(i + 1), 0);
-		#ifdef SUPPORTS_PER_THREAD_CPU_AFFINITY
-			if (cpuAffine) {
-				cpu_set_t cpus;
+		#ifdef PASSENGER_SUPPORTS_CPU_AFFINITY
+			if (!wo->controllerCpus.empty()) {
+				unsigned int cpu = wo->controllerCpus[i % wo->controllerCpus.size()];
 				int result;
 
-				CPU_ZERO(&cpus);
-				CPU_SET(i % maxCpus, &cpus);
 				P_DEBUG("Setting CPU affinity of core thread " << (i + 1)
-					<< " to CPU " << (i % maxCpus + 1));
-				result = pthread_setaffinity_np(two->bgloop->getNativeHandle(),
-					maxCpus, &cpus);
+					<< " to CPU " << cpu);
+				result = setThreadCpuAffinity(two->bgloop->getNativeHandle(),
+					vector<unsigned int>(1, cpu));
 				if (result != 0) {
 					P_WARN("Cannot set CPU affinity on core thread " << (i + 1)
 						<< ": " << strerror(result) << " (errno=" << result << ")");
@@ -1009,6 +1253,20 @@ mainLoop() {
 	}
 	if (wo->threadWorkingObjects.size() > 1) {
 		wo->loadBalancer.start();
+		#ifdef PASSENGER_SUPPORTS_CPU_AFFINITY
+			if (!wo->controllerCpus.empty()) {
+				// Keep the load balancer on the controller threads' CPUs,
+				// so that accepted clients are handed over without
+				// crossing NUMA nodes.
+				vector<unsigned int> cpus = wo->controllerCpus;
+				std::sort(cpus.begin(), cpus.end());
+				int result = setThreadCpuAffinity(wo->loadBalancer.getNativeHandle(), cpus);
+				if (result != 0) {
+					P_WARN("Cannot set CPU affinity on the load balancer thread: "
+						<< strerror(result) << " (errno=" << result << ")");
+				}
+			}
+		#endif
 	}
 	waitForExitEvent();
 }
@@ -1192,6 +1450,15 @@ deletePidFile() {
 	TRACE_POINT();
 	Json::Value pidFile = coreConfig->get("pid_file");
 	if (!pidFile.isNull()) {
+		// After a graceful restart, the PID file belongs to the
+		// Core instance that replaced us.
+		try {
+			if (stringToLL(unsafeReadFile(pidFile.asString())) != (long long) getpid()) {
+				return;
+			}
+		} catch (const SystemException &) {
+			return;
+		}
 		syscalls::unlink(pidFile.asCString());
 	}
 }
@@ -1201,11 +1468,17 @@ runCore() {
 	TRACE_POINT();
 	P_NOTICE("Starting " SHORT_PROGRAM_NAME " core...");
 
+	// Until the event loop handles them (see onReplacementSignal()), the
+	// Watchdog's graceful restart signals must not kill us.
+	signal(SIGUSR1, SIG_IGN);
+	signal(SIGUSR2, SIG_IGN);
+
 	try {
 		UPDATE_TRACE_POINT();
 		initializePrivilegedWorkingObjects();
 		initializeSingleAppMode();
 		setUlimits();
+		initializeProcessFdKeeperClient();
 		startListening();
 		createPidFile();
 		lowerPrivilege();
@@ -161,6 +161,10 @@ coreUsage() {
 	printf("      --max-request-queue-size NUMBER\n");
 	printf("                            Specify request queue size. Default: %d\n",
 		DEFAULT_MAX_REQUEST_QUEUE_SIZE);
+	printf("      --routing-policy NAME How to route requests among an app's processes.\n");
+	printf("                            Either 'least_busy', 'response_time' or\n");
+	printf("                            'two_random_choices'.\n");
+	printf("                            Default: " DEFAULT_ROUTING_POLICY "\n");
 	printf("      --sticky-sessions     Enable sticky sessions\n");
 	printf("      --sticky-sessions-cookie-name NAME\n");
 	printf("                            Cookie name to use for sticky sessions.\n");
@@ -183,11 +187,31 @@ coreUsage() {
 	printf("      --no-show-version-in-header\n");
 	printf("                            Do not show " PROGRAM_NAME " version number in\n");
 	printf("                            HTTP headers.\n");
+	printf("      --response-compression\n");
+	printf("                            Compress compressible response bodies with gzip\n");
+	printf("                            if the client supports it\n");
+	printf("      --serve-static-files\n");
+	printf("                            Serve files in the application's public\n");
+	printf("                            directory directly, without involving the\n");
+	printf("                            application\n");
+	printf("      --adaptive-request-body-buffering\n");
+	printf("                            Stream request bodies that would otherwise be\n");
+	printf("                            buffered directly to the application, if a\n");
+	printf("                            process is available to handle them right away\n");
+	printf("      --max-request-body-buffer-size BYTES\n");
+	printf("                            Buffer at most this many bytes of a request body\n");
+	printf("                            before passing it to the application. 0 means\n");
+	printf("                            unlimited. Default: 0\n");
 	printf("      --data-buffer-dir PATH\n");
 	printf("                            Directory to store data buffers in. Default:\n");
 	printf("                            %s\n", getSystemTempDir());
+	printf("      --data-buffer-io-uring\n");
+	printf("                            Use io_uring instead of a thread pool to write\n");
+	printf("                            and read data buffers. Only supported on Linux\n");
+	printf("                            5.6 and later\n");
 	printf("      --no-graceful-exit    When exiting, exit immediately instead of waiting\n");
-	printf("                            for all connections to terminate\n");
+	printf("                            for all requests to finish. Idle keep-alive\n");
+	printf("                            connections are always closed immediately\n");
 	printf("      --benchmark MODE      Enable benchmark mode. Available modes:\n");
 	printf("                            after_accept,before_checkout,after_checkout,\n");
 	printf("                            response_begin\n");
@@ -198,6 +222,11 @@ coreUsage() {
 	printf("                            Default: number of CPU cores (%d)\n",
 		boost::thread::hardware_concurrency());
 	printf("      --cpu-affine          Enable per-thread CPU affinity (Linux only)\n");
+	printf("      --cpus LIST           Pin request handling threads to these CPUs, e.g.\n");
+	printf("                            \"0-3,8\". Implies --cpu-affine (Linux only)\n");
+	printf("      --app-numa-affine     Run application processes on the NUMA nodes of\n");
+	printf("                            the request handling threads' CPUs. Requires\n");
+	printf("                            --cpu-affine or --cpus (Linux only)\n");
 	printf("      --core-file-descriptor-ulimit NUMBER\n");
 	printf("                            Set custom file descriptor ulimit for the core\n");
 	printf("      --admin-panel-url URL\n");
@@ -327,6 +356,9 @@ parseCoreOption(int argc, const char *argv[], int &i, Json::Value &updates) {
 	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--max-request-queue-size")) {
 		updates["default_max_request_queue_size"] = atoi(argv[i + 1]);
 		i += 2;
+	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--routing-policy")) {
+		updates["default_routing_policy"] = argv[i + 1];
+		i += 2;
 	} else if (p.isFlag(argv[i], '\0', "--sticky-sessions")) {
 		updates["default_sticky_sessions"] = true;
 		i++;
@@ -372,9 +404,24 @@ parseCoreOption(int argc, const char *argv[], int &i, Json::Value &updates) {
 	} else if (p.isFlag(argv[i], '\0', "--no-show-version-in-header")) {
 		updates["show_version_in_header"] = false;
 		i++;
+	} else if (p.isFlag(argv[i], '\0', "--response-compression")) {
+		updates["response_compression"] = true;
+		i++;
+	} else if (p.isFlag(argv[i], '\0', "--serve-static-files")) {
+		updates["serve_static_files"] = true;
+		i++;
+	} else if (p.isFlag(argv[i], '\0', "--adaptive-request-body-buffering")) {
+		updates["adaptive_request_body_buffering"] = true;
+		i++;
+	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--max-request-body-buffer-size")) {
+		updates["max_request_body_buffer_size"] = atoi(argv[i + 1]);
+		i += 2;
 	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--data-buffer-dir")) {
 		updates["controller_file_buffered_channel_buffer_dir"] = atoi(argv[i + 1]);
 		i += 2;
+	} else if (p.isFlag(argv[i], '\0', "--data-buffer-io-uring")) {
+		updates["controller_file_buffered_channel_io_uring"] = true;
+		i++;
 	} else if (p.isFlag(argv[i], '\0', "--no-graceful-exit")) {
 		updates["graceful_exit"] = false;
 		i++;
@@ -390,6 +437,12 @@ parseCoreOption(int argc, const char *argv[], int &i, Json::Value &updates) {
 	} else if (p.isFlag(argv[i], '\0', "--cpu-affine")) {
 		updates["controller_cpu_affine"] = true;
 		i++;
+	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--cpus")) {
+		updates["controller_cpus"] = argv[i + 1];
+		i += 2;
+	} else if (p.isFlag(argv[i], '\0', "--app-numa-affine")) {
+		updates["app_numa_affine"] = true;
+		i++;
 	} else if (p.isValueFlag(argc, i, argv[i], '\0', "--core-file-descriptor-ulimit")) {
 		updates["file_descriptor_ulimit"] = atoi(argv[i + 1]);
 		i += 2;
@@ -151,6 +151,7 @@ private:
 	{
 		unsigned int size =
 			1  // protocol flag
+			+ 1  // content coding flag
 			+ ((host != NULL) ? host->size : 0)
 			+ 1  // '\n'
 			+ path.size()
@@ -162,7 +163,7 @@ private:
 		}
 	}
 
-	void generateKey(bool https, const StaticString &path,
+	void generateKey(bool https, bool gzip, const StaticString &path,
 		const LString * restrict host,
 		const LString * restrict varyCookie,
 		char * restrict output,
@@ -178,6 +179,14 @@ private:
 			pos = appendData(pos, end, "H", 1);
 		}
 
+		// Responses to clients that accept gzip may have been compressed
+		// by the Controller, so they are cached separately.
+		if (gzip) {
+			pos = appendData(pos, end, "G", 1);
+		} else {
+			pos = appendData(pos, end, "I", 1);
+		}
+
 		if (host != NULL) {
 			part = host->start;
 			while (part != NULL) {
@@ -228,6 +237,22 @@ private:
 		return Entry();
 	}
 
+	/**
+	 * Invalidates the entries for both content coding variants of the
+	 * given key. `key` is modified in the process.
+	 */
+	void invalidateAllContentCodings(char *key, unsigned int keySize) {
+		static const char flags[] = { 'I', 'G' };
+
+		for (unsigned int i = 0; i < sizeof(flags); i++) {
+			key[1] = flags[i];
+			Entry entry(lookup(StaticString(key, keySize)));
+			if (entry.valid()) {
+				entry.header->valid = false;
+			}
+		}
+	}
+
 	Entry lookupInvalidOrOldest() {
 		int oldest = -1;
 
@@ -400,12 +425,9 @@ private:
 		}
 
 		char *key = (char *) psg_pnalloc(req->pool, keySize);
-		generateKey(https, path, req->host, req->varyCookie, key, keySize);
-
-		Entry entry(lookup(StaticString(key, keySize)));
-		if (entry.valid()) {
-			entry.header->valid = false;
-		}
+		generateKey(https, req->acceptsGzip, path, req->host, req->varyCookie,
+			key, keySize);
+		invalidateAllContentCodings(key, keySize);
 	}
 
 public:
@@ -491,13 +513,14 @@ public:
 			return false;
 		}
 
-		LString *varyCookieName = req->secureHeaders.lookup(PASSENGER_VARY_TURBOCACHE_BY_COOKIE);
+		const LString *varyCookieName = req->lookupSecureHeader(PASSENGER_VARY_TURBOCACHE_BY_COOKIE);
 		if (varyCookieName == NULL && !req->config->defaultVaryTurbocacheByCookie.empty()) {
-			varyCookieName = (LString *) psg_palloc(req->pool, sizeof(LString));
-			psg_lstr_init(varyCookieName);
-			psg_lstr_append(varyCookieName, req->pool,
+			LString *defaultVaryCookieName = (LString *) psg_palloc(req->pool, sizeof(LString));
+			psg_lstr_init(defaultVaryCookieName);
+			psg_lstr_append(defaultVaryCookieName, req->pool,
 				req->config->defaultVaryTurbocacheByCookie.data(),
 				req->config->defaultVaryTurbocacheByCookie.size());
+			varyCookieName = defaultVaryCookieName;
 		}
 		if (varyCookieName != NULL) {
 			LString *cookieHeader = req->headers.lookup(COOKIE);
@@ -523,7 +546,8 @@ public:
 		}
 
 		char *key = (char *) psg_pnalloc(req->pool, size);
-		generateKey(req->https, StaticString(req->path.start->data, req->path.size),
+		generateKey(req->https, req->acceptsGzip,
+			StaticString(req->path.start->data, req->path.size),
 			req->host, req->varyCookie, key, size);
 		req->cacheKey = HashedStaticString(key, size);
 		return true;
@@ -670,10 +694,9 @@ public:
 
 	// @pre requestAllowsInvalidating()
 	void invalidate(Request *req) {
-		Entry entry(lookup(req->cacheKey));
-		if (entry.valid()) {
-			entry.header->valid = false;
-		}
+		char *key = (char *) psg_pnalloc(req->pool, req->cacheKey.size());
+		memcpy(key, req->cacheKey.data(), req->cacheKey.size());
+		invalidateAllContentCodings(key, req->cacheKey.size());
 
 		invalidateLocation(req, LOCATION);
 		invalidateLocation(req, CONTENT_LOCATION);
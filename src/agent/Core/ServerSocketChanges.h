@@ -0,0 +1,117 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2018 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_CORE_SERVER_SOCKET_CHANGES_H_
+#define _PASSENGER_CORE_SERVER_SOCKET_CHANGES_H_
+
+#include <boost/function.hpp>
+#include <string>
+#include <vector>
+#include <jsoncpp/json.h>
+#include <ConfigKit/Common.h>
+
+namespace Passenger {
+namespace Core {
+
+using namespace std;
+
+
+/**
+ * A server socket that is added or removed because `controller_addresses`
+ * or `api_server_addresses` changed.
+ */
+struct ServerSocketChange {
+	string address;
+	int fd;
+
+	ServerSocketChange(const string &_address, int _fd)
+		: address(_address),
+		  fd(_fd)
+		{ }
+};
+
+/**
+ * Figures out which server sockets must be added and removed to go from
+ * `oldAddresses` to `newAddresses`, and creates sockets for the added ones
+ * with `createServerSocket`. Addresses that stay keep their existing socket,
+ * so their clients are not affected at all.
+ *
+ * Upon return, `newFds` contains a socket for every address in
+ * `newAddresses`. If a socket cannot be created then an error is added to
+ * `errors`; the sockets in `added` must then be closed by the caller.
+ */
+inline void
+prepareServerSocketChanges(const Json::Value &oldAddresses, const int *oldFds,
+	const Json::Value &newAddresses, int *newFds,
+	const boost::function<int (const string &address)> &createServerSocket,
+	const char *optionName,
+	vector<ServerSocketChange> &added, vector<ServerSocketChange> &removed,
+	vector<ConfigKit::Error> &errors)
+{
+	Json::Value::ArrayIndex i, j;
+
+	for (i = 0; i < newAddresses.size(); i++) {
+		string address = newAddresses[i].asString();
+
+		for (j = 0; j < oldAddresses.size(); j++) {
+			if (oldAddresses[j].asString() == address) {
+				break;
+			}
+		}
+
+		if (j < oldAddresses.size()) {
+			newFds[i] = oldFds[j];
+			continue;
+		}
+
+		try {
+			newFds[i] = createServerSocket(address);
+			added.push_back(ServerSocketChange(address, newFds[i]));
+		} catch (const std::exception &e) {
+			errors.push_back(ConfigKit::Error("Cannot listen on " + address
+				+ " ('{{" + optionName + "}}'): " + e.what()));
+		}
+	}
+
+	for (j = 0; j < oldAddresses.size(); j++) {
+		string address = oldAddresses[j].asString();
+
+		for (i = 0; i < newAddresses.size(); i++) {
+			if (newAddresses[i].asString() == address) {
+				break;
+			}
+		}
+
+		if (i == newAddresses.size()) {
+			removed.push_back(ServerSocketChange(address, oldFds[j]));
+		}
+	}
+}
+
+
+} // namespace Core
+} // namespace Passenger
+
+#endif /* _PASSENGER_CORE_SERVER_SOCKET_CHANGES_H_ */
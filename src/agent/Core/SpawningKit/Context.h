@@ -30,6 +30,7 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/make_shared.hpp>
 #include <string>
+#include <vector>
 #include <algorithm>
 #include <cstddef>
 
@@ -93,11 +94,18 @@ public:
 		unsigned int dummyConcurrency;
 		unsigned long long dummySpawnDelay;
 		unsigned long long spawnerCreationSleepTime;
+		// The socket that dummy processes claim to listen on. Nothing
+		// listens there unless the user (e.g. a benchmark) sets up a
+		// server on that address.
+		string dummySocketAddress;
+		string dummySocketProtocol;
 
 		DebugSupport()
 			: dummyConcurrency(1),
 			  dummySpawnDelay(0),
-			  spawnerCreationSleepTime(0)
+			  spawnerCreationSleepTime(0),
+			  dummySocketAddress("tcp://127.0.0.1:1234"),
+			  dummySocketProtocol("session")
 			{ }
 	};
 
@@ -138,6 +146,12 @@ public:
 	RandomGeneratorPtr randomGenerator;
 	string integrationMode;
 	string instanceDir;
+	/**
+	 * The CPUs that spawned processes are restricted to. Processes forked
+	 * by preloaders inherit this restriction. Empty means no restriction.
+	 * Only supported on Linux.
+	 */
+	vector<unsigned int> appProcessCpus;
 	DebugSupport *debugSupport;
 	//UnionStation::ContextPtr unionStationContext;
 
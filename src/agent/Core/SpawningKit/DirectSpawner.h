@@ -38,6 +38,7 @@
 #include <LveLoggingDecorator.h>
 #include <Utils/IOUtils.h>
 #include <Utils/AsyncSignalSafeUtils.h>
+#include <Utils/CpuAffinity.h>
 
 #include <limits.h>  // for PTHREAD_STACK_MIN
 #include <pthread.h>
@@ -150,6 +151,11 @@ private:
 		session.journey.setStepInProgress(SUBPROCESS_BEFORE_FIRST_EXEC);
 		stepToMarkAsErrored = SPAWNING_KIT_FORK_SUBPROCESS;
 
+		#ifdef PASSENGER_SUPPORTS_CPU_AFFINITY
+			cpu_set_t appProcessCpuSet;
+			cpuListToCpuSet(context->appProcessCpus, appProcessCpuSet);
+		#endif
+
 		pid_t pid = syscalls::fork();
 		if (pid == 0) {
 			int e;
@@ -159,6 +165,13 @@ private:
 
 			resetSignalHandlersAndMask();
 			disableMallocDebugging();
+			#ifdef PASSENGER_SUPPORTS_CPU_AFFINITY
+				if (!context->appProcessCpus.empty()) {
+					// Best-effort: if this fails then the process simply
+					// runs on any CPU.
+					sched_setaffinity(0, sizeof(appProcessCpuSet), &appProcessCpuSet);
+				}
+			#endif
 			int stdinCopy = dup2(stdinChannel.first, 3);
 			int stdoutAndErrCopy = dup2(stdoutAndErrChannel.second, 4);
 			dup2(stdinCopy, 0);
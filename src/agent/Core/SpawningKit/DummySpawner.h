@@ -84,6 +84,8 @@ public:
 		socket.concurrency = 1;
 		socket.acceptHttpRequests = true;
 		if (context->debugSupport != NULL) {
+			socket.address = context->debugSupport->dummySocketAddress;
+			socket.protocol = context->debugSupport->dummySocketProtocol;
 			socket.concurrency = context->debugSupport->dummyConcurrency;
 		}
 
@@ -270,6 +270,8 @@ private:
 		args["integration_mode"] = context->integrationMode;
 		args["gupid"] = session.result.gupid;
 		args["UNIX_PATH_MAX"] = (Json::UInt64) sizeof(addr.sun_path) - 1;
+		args["supported_session_protocols"].append("session2");
+		args["supported_session_protocols"].append("session");
 		if (config->genericApp || config->findFreePort) {
 			args["expected_start_port"] = session.expectedStartPort;
 		}
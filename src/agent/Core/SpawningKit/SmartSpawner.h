@@ -57,6 +57,7 @@
 #include <Utils/ScopeGuard.h>
 #include <Utils/ProcessMetricsCollector.h>
 #include <Utils/AsyncSignalSafeUtils.h>
+#include <Utils/CpuAffinity.h>
 #include <LveLoggingDecorator.h>
 #include <Core/SpawningKit/Spawner.h>
 #include <Core/SpawningKit/Exceptions.h>
@@ -360,6 +361,11 @@ private:
 		session.journey.setStepInProgress(SPAWNING_KIT_FORK_SUBPROCESS);
 		session.journey.setStepInProgress(SUBPROCESS_BEFORE_FIRST_EXEC);
 
+		#ifdef PASSENGER_SUPPORTS_CPU_AFFINITY
+			cpu_set_t appProcessCpuSet;
+			cpuListToCpuSet(context->appProcessCpus, appProcessCpuSet);
+		#endif
+
 		pid_t pid = syscalls::fork();
 		if (pid == 0) {
 			int e;
@@ -369,6 +375,13 @@ private:
 
 			resetSignalHandlersAndMask();
 			disableMallocDebugging();
+			#ifdef PASSENGER_SUPPORTS_CPU_AFFINITY
+				if (!context->appProcessCpus.empty()) {
+					// Best-effort: if this fails then the process simply
+					// runs on any CPU.
+					sched_setaffinity(0, sizeof(appProcessCpuSet), &appProcessCpuSet);
+				}
+			#endif
 			int stdinCopy = dup2(stdinChannel.first, 3);
 			int stdoutAndErrCopy = dup2(stdoutAndErrChannel.second, 4);
 			dup2(stdinCopy, 0);
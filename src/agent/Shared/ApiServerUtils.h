@@ -51,7 +51,6 @@
 
 #include <boost/foreach.hpp>
 #include <boost/bind.hpp>
-#include <boost/regex.hpp>
 #include <oxt/macros.hpp>
 #include <oxt/backtrace.hpp>
 #include <oxt/thread.hpp>
@@ -69,11 +68,11 @@
 #include <DataStructures/StringKeyTable.h>
 #include <ServerKit/Server.h>
 #include <ServerKit/HeaderTable.h>
+#include <ServerKit/AsyncHttpClient.h>
 #include <LoggingKit/LoggingKit.h>
 #include <LoggingKit/Context.h>
 #include <Utils.h>
 #include <Utils/IOUtils.h>
-#include <Utils/BufferedIO.h>
 #include <Utils/StrIntUtils.h>
 #include <Utils/VariantMap.h>
 #include <Shared/ApplicationPoolApiKey.h>
@@ -265,17 +264,23 @@ struct ApiServerInternalHttpResponse {
 	static const int ERROR_INVALID_HEADER = -1;
 	static const int ERROR_INVALID_BODY = -2;
 	static const int ERROR_INTERNAL = -3;
+	static const int ERROR_TIMEOUT = -4;
 
 	Server *server;
 	Client *client;
 	Request *req;
 	int status;
+	/** Header names are lowercase. */
 	StringKeyTable<string> headers;
 	string body;
+	/**
+	 * If the request has `receiveFileDescriptor` set and status is 200,
+	 * the file descriptor that the server passed.
+	 */
+	FileDescriptor fd;
 
 	vector<string> debugLogs;
 	string errorLogs;
-	BufferedIO io;
 };
 
 template<typename Server, typename Client, typename Request>
@@ -291,18 +296,31 @@ struct ApiServerInternalHttpRequest {
 	boost::function<void (ApiServerInternalHttpResponse<Server, Client, Request>)> callback;
 
 	unsigned long long timeout;
-	boost::function<
-		void (ApiServerInternalHttpRequest<Server, Client, Request> &req,
-			ApiServerInternalHttpResponse<Server, Client, Request> &resp,
-			BufferedIO &io
-		)> bodyProcessor;
+	/**
+	 * If set, the response body is passed to this function as it arrives,
+	 * instead of being buffered into the response's `body`.
+	 */
+	ServerKit::AsyncHttpClient::DataCallback dataCallback;
+	/**
+	 * If true, the server passes a file descriptor after the response
+	 * headers instead of sending a body. See
+	 * `ServerKit::AsyncHttpClient::Request::receiveFileDescriptor`.
+	 */
+	bool receiveFileDescriptor;
+	/**
+	 * The client to make the request through, on the API server's event
+	 * loop. It reuses connections to the same address. Required.
+	 */
+	ServerKit::AsyncHttpClient *httpClient;
 
 	ApiServerInternalHttpRequest()
 		: server(NULL),
 		  client(NULL),
 		  req(NULL),
 		  method(HTTP_GET),
-		  timeout(60 * 1000000)
+		  timeout(60 * 1000000),
+		  receiveFileDescriptor(false),
+		  httpClient(NULL)
 		{ }
 };
 
@@ -326,174 +344,77 @@ apiServerMakeInternalHttpRequestCallbackWrapper(
 
 template<typename Server, typename Client, typename Request>
 inline void
-apiServerMakeInternalHttpRequestThreadMain(ApiServerInternalHttpRequest<Server, Client, Request> req) {
-	typedef ApiServerInternalHttpRequest<Server, Client, Request> InternalRequest;
+apiServerMakeInternalHttpRequestDone(
+	boost::function<void (ApiServerInternalHttpResponse<Server, Client, Request>)> callback,
+	ApiServerInternalHttpResponse<Server, Client, Request> resp,
+	const ServerKit::AsyncHttpClient::Response &clientResp)
+{
 	typedef ApiServerInternalHttpResponse<Server, Client, Request> InternalResponse;
 
-	struct Guard {
-		InternalRequest &req;
-		InternalResponse &resp;
-		SafeLibevPtr libev;
-		bool cleared;
-
-		Guard(InternalRequest &_req, InternalResponse &_resp, const SafeLibevPtr &_libev)
-			: req(_req),
-			  resp(_resp),
-			  libev(_libev),
-			  cleared(false)
-			{ }
-
-		~Guard() {
-			if (!cleared) {
-				resp.status = InternalResponse::ERROR_INTERNAL;
-				resp.headers.clear();
-				resp.body.clear();
-				libev->runLater(boost::bind(
-					apiServerMakeInternalHttpRequestCallbackWrapper<Server, Client, Request>,
-					req.callback, resp));
-			}
-		}
-
-		void clear() {
-			cleared = true;
-		}
-	};
-
-	InternalResponse resp;
-	SafeLibevPtr libev = req.server->getContext()->libev;
-
-	resp.server = req.server;
-	resp.client = req.client;
-	resp.req    = req.req;
-	resp.status = InternalResponse::ERROR_INTERNAL;
-
-	Guard guard(req, resp, libev);
-
-
-	try {
-		FileDescriptor conn(connectToServer(req.address, NULL, 0), __FILE__, __LINE__);
-		BufferedIO io(conn);
-
-		string header;
-		header.append(http_method_str(req.method));
-		header.append(" ", 1);
-		header.append(req.uri);
-		header.append(" HTTP/1.1\r\n");
-
-		StringKeyTable<string>::ConstIterator it(req.headers);
-		while (*it != NULL) {
-			header.append(it.getKey());
-			header.append(": ", 2);
-			header.append(it.getValue());
-			header.append("\r\n", 2);
-			it.next();
-		}
-		header.append("Connection: close\r\n\r\n");
-
-		writeExact(conn, header, &req.timeout);
-
-
-		string statusLine = io.readLine();
-		resp.debugLogs.push_back("Internal request response data: \"" + cEscapeString(statusLine) + "\"");
-		boost::regex statusLineRegex("^HTTP/.*? ([0-9]+) (.*)$");
-		boost::smatch results;
-		if (!boost::regex_match(statusLine, results, statusLineRegex)) {
-			guard.clear();
-			resp.status = InternalResponse::ERROR_INVALID_HEADER;
-			libev->runLater(boost::bind(
-				apiServerMakeInternalHttpRequestCallbackWrapper<Server, Client, Request>,
-				req.callback, resp));
-			return;
-		}
-		resp.status = (int) stringToUint(results.str(1));
-		if (resp.status <= 0 || resp.status >= 1000) {
-			guard.clear();
-			resp.status = InternalResponse::ERROR_INVALID_HEADER;
-			libev->runLater(boost::bind(
-				apiServerMakeInternalHttpRequestCallbackWrapper<Server, Client, Request>,
-				req.callback, resp));
-			return;
-		}
-
-		string response;
-		while (true) {
-			response = io.readLine();
-			resp.debugLogs.push_back("Internal request response data: \"" + cEscapeString(response) + "\"");
-			if (response.empty()) {
-				guard.clear();
-				resp.status = InternalResponse::ERROR_INVALID_HEADER;
-				libev->runLater(boost::bind(
-					apiServerMakeInternalHttpRequestCallbackWrapper<Server, Client, Request>,
-					req.callback, resp));
-				return;
-			} else if (response == "\r\n") {
-				break;
-			} else {
-				const char *pos = (const char *) memchr(response.data(), ':', response.size());
-				if (pos == NULL) {
-					guard.clear();
-					resp.status = InternalResponse::ERROR_INVALID_HEADER;
-					libev->runLater(boost::bind(
-						apiServerMakeInternalHttpRequestCallbackWrapper<Server, Client, Request>,
-						req.callback, resp));
-					return;
-				}
-
-				string key(strip(response.substr(0, pos - response.data())));
-				string value(response.substr(pos - response.data()));
-				value.erase(0, 1);
-				value = strip(value);
-				if (!value.empty() && value[value.size() - 1] == '\r') {
-					value.erase(value.size() - 1, 1);
-				}
-
-				if (key.empty() || value.empty()) {
-					guard.clear();
-					resp.status = InternalResponse::ERROR_INVALID_HEADER;
-					libev->runLater(boost::bind(
-						apiServerMakeInternalHttpRequestCallbackWrapper<Server, Client, Request>,
-						req.callback, resp));
-					return;
-				}
-
-				resp.headers.insert(key, value);
-			}
-		}
-
-		if (req.bodyProcessor != NULL) {
-			req.bodyProcessor(req, resp, io);
-		} else {
-			resp.body = io.readAll(&req.timeout);
-		}
-		guard.clear();
-		libev->runLater(boost::bind(
-			apiServerMakeInternalHttpRequestCallbackWrapper<Server, Client, Request>,
-			req.callback, resp));
-	} catch (const oxt::tracable_exception &e) {
-		resp.errorLogs.append("Exception: ");
-		resp.errorLogs.append(e.what());
-		resp.errorLogs.append("\n");
-		resp.errorLogs.append(e.backtrace());
+	switch (clientResp.status) {
+	case ServerKit::AsyncHttpClient::ERROR_INVALID_HEADER:
+		resp.status = InternalResponse::ERROR_INVALID_HEADER;
+		break;
+	case ServerKit::AsyncHttpClient::ERROR_INVALID_BODY:
+		resp.status = InternalResponse::ERROR_INVALID_BODY;
+		break;
+	case ServerKit::AsyncHttpClient::ERROR_TIMEOUT:
+		resp.status = InternalResponse::ERROR_TIMEOUT;
+		break;
+	case ServerKit::AsyncHttpClient::ERROR_IO:
+		resp.status = InternalResponse::ERROR_INTERNAL;
+		break;
+	default:
+		resp.status = clientResp.status;
+		break;
+	}
+	if (clientResp.status < 0) {
+		resp.errorLogs = "Internal request failed: " + clientResp.errorMessage;
 	}
+	resp.headers = clientResp.headers;
+	resp.body = clientResp.body;
+	resp.fd = clientResp.fd;
+	apiServerMakeInternalHttpRequestCallbackWrapper<Server, Client, Request>(
+		callback, resp);
 }
 
 /**
  * Utility function for API servers for making an internal HTTP request,
- * usually to another agent. The request is made in a background thread.
- * When done, the callback is called on the event loop. While the request
- * is being made, a reference to the ServerKit request object is held.
+ * usually to another agent. The request is made on the event loop through
+ * `params.httpClient`, which keeps connections alive. When done, the
+ * callback is called on the event loop. While the request is being made,
+ * a reference to the ServerKit request object is held.
  *
- * This is not a fully featured HTTP client and doesn't fully correctly
- * parse HTTP, so it can't be used with arbitrary servers. It doesn't
- * support keep-alive and chunked transfer-encodings.
+ * AsyncHttpClient is not a fully featured HTTP client, so this can't be
+ * used with arbitrary servers.
  */
 template<typename Server, typename Client, typename Request>
 inline void
 apiServerMakeInternalHttpRequest(const ApiServerInternalHttpRequest<Server, Client, Request> &params) {
+	typedef ApiServerInternalHttpResponse<Server, Client, Request> InternalResponse;
+
+	ServerKit::AsyncHttpClient::Request clientReq;
+	InternalResponse resp;
+
+	P_ASSERT_EQ(params.httpClient != NULL, true);
 	params.server->refRequest(params.req, __FILE__, __LINE__);
-	oxt::thread(boost::bind(
-		apiServerMakeInternalHttpRequestThreadMain<Server, Client, Request>,
-		params), "Internal HTTP request", 1024 * 128);
+
+	resp.server = params.server;
+	resp.client = params.client;
+	resp.req    = params.req;
+	resp.status = InternalResponse::ERROR_INTERNAL;
+
+	clientReq.address = params.address;
+	clientReq.method  = params.method;
+	clientReq.uri     = params.uri;
+	clientReq.headers = params.headers;
+	clientReq.timeout = params.timeout;
+	clientReq.dataCallback = params.dataCallback;
+	clientReq.receiveFileDescriptor = params.receiveFileDescriptor;
+	clientReq.callback = boost::bind(
+		apiServerMakeInternalHttpRequestDone<Server, Client, Request>,
+		params.callback, resp, boost::placeholders::_1);
+	params.httpClient->request(clientReq);
 }
 
 
@@ -743,23 +664,17 @@ apiServerProcessReopenLogs(Server *server, Client *client, Request *req) {
 
 template<typename Server, typename Client, typename Request>
 inline void
-_apiServerProcessReinheritLogsResponseBody(
-	ApiServerInternalHttpRequest<Server, Client, Request> &req,
-	ApiServerInternalHttpResponse<Server, Client, Request> &resp,
-	BufferedIO &io)
-{
+_apiServerReinheritLogFile(ApiServerInternalHttpResponse<Server, Client, Request> &resp) {
 	typedef ApiServerInternalHttpResponse<Server, Client, Request> InternalResponse;
 
-	string logFilePath = resp.headers.lookupCopy("Filename");
-	if (logFilePath.empty()) {
+	if (resp.headers.lookupCopy("filename").empty()) {
 		resp.status = InternalResponse::ERROR_INVALID_BODY;
 		resp.errorLogs.append("Error communicating with Watchdog process: "
 			"no log filename received in response");
 		return;
 	}
 
-	int fd = readFileDescriptorWithNegotiation(io.getFd(), &req.timeout);
-	FdGuard guard(fd, __FILE__, __LINE__);
+	int fd = resp.fd;
 	P_LOG_FILE_DESCRIPTOR_PURPOSE(fd, "Reinherited log file handle");
 
 	ConfigKit::Store oldConfig = LoggingKit::context->getConfig();
@@ -788,7 +703,8 @@ _apiServerProcessReinheritLogsResponseBody(
 	}
 
 	LoggingKit::context->commitConfigChange(configReq);
-	guard.clear();
+	// The logging system owns the file descriptor now.
+	resp.fd.detach();
 	P_NOTICE("All log file(s) reinherited.");
 }
 
@@ -803,6 +719,14 @@ _apiServerProcessReinheritLogsDone(ApiServerInternalHttpResponse<Server, Client,
 	int status;
 	StaticString body;
 
+	if (resp.status == 200) {
+		// The Watchdog passed the log file descriptor.
+		_apiServerReinheritLogFile(resp);
+		if (!resp.errorLogs.empty()) {
+			SKC_ERROR_FROM_STATIC(server, client, resp.errorLogs);
+		}
+	}
+
 	if (req->ended()) {
 		return;
 	}
@@ -858,7 +782,8 @@ _apiServerProcessReinheritLogsDone(ApiServerInternalHttpResponse<Server, Client,
 template<typename Server, typename Client, typename Request>
 inline void
 apiServerProcessReinheritLogs(Server *server, Client *client, Request *req,
-	const StaticString &instanceDir, const StaticString &fdPassingPassword)
+	const StaticString &instanceDir, const StaticString &fdPassingPassword,
+	ServerKit::AsyncHttpClient *httpClient)
 {
 	if (req->method != HTTP_POST) {
 		apiServerRespondWith405(server, client, req);
@@ -887,7 +812,8 @@ apiServerProcessReinheritLogs(Server *server, Client *client, Request *req,
 		params.uri    = "/config/log_file.fd";
 		params.headers.insert("Fd-Passing-Password", fdPassingPassword);
 		params.callback = _apiServerProcessReinheritLogsDone<Server, Client, Request>;
-		params.bodyProcessor = _apiServerProcessReinheritLogsResponseBody<Server, Client, Request>;
+		params.receiveFileDescriptor = true;
+		params.httpClient = httpClient;
 		apiServerMakeInternalHttpRequest(params);
 	} else {
 		apiServerRespondWith401(server, client, req);
@@ -546,6 +546,10 @@ dumpConfigForDebugging(const ConfigKit::Store &config) {
 		// The config manifest is too large so we omit it from the debug output.
 		result["config_manifest"] = "[OMITTED]";
 	}
+	if (!result["config_profiles"].isNull()) {
+		// Config profiles may contain application environment variables.
+		result["config_profiles"] = "[OMITTED]";
+	}
 	return result.toStyledString();
 }
 
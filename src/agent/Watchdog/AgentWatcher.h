@@ -23,6 +23,45 @@
  *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
  *  THE SOFTWARE.
  */
+#ifndef _PASSENGER_WATCHDOG_AGENT_WATCHER_H_
+#define _PASSENGER_WATCHDOG_AGENT_WATCHER_H_
+
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/thread.hpp>
+#include <oxt/thread.hpp>
+#include <oxt/system_calls.hpp>
+#include <oxt/backtrace.hpp>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <jsoncpp/json.h>
+#include <Constants.h>
+#include <Exceptions.h>
+#include <FileDescriptor.h>
+#include <LoggingKit/LoggingKit.h>
+#include <ProcessManagement/Utils.h>
+#include <Utils.h>
+#include <Utils/Timer.h>
+#include <Utils/ScopeGuard.h>
+#include <Utils/StrIntUtils.h>
+#include <Utils/IOUtils.h>
+#include <Utils/MessageIO.h>
+
+namespace Passenger {
+namespace Watchdog {
+
+using namespace std;
+using namespace oxt;
+
 
 /**
  * Abstract base class for watching agent processes.
@@ -32,6 +71,12 @@ private:
 	/** The watcher thread. */
 	oxt::thread *thr;
 
+	/**
+	 * During a graceful restart, the watcher thread of the process that is
+	 * being replaced. It exits once that process has exited.
+	 */
+	oxt::thread *replacedThr;
+
 	void threadMain(boost::shared_ptr<AgentWatcher> self) {
 		try {
 			pid_t pid, ret;
@@ -66,7 +111,19 @@ private:
 				}
 
 				{
-					boost::lock_guard<boost::mutex> l(lock);
+					boost::unique_lock<boost::mutex> l(lock);
+					while (restarting) {
+						restartFinishedCond.wait(l);
+					}
+					if (this->pid != pid) {
+						// This is the old process of a graceful restart. The
+						// new process has a watcher thread of its own.
+						P_NOTICE(name() << " (pid=" << pid << ") exited after "
+							"being replaced by pid " << this->pid);
+						replacedPid = 0;
+						replacedFeedbackFd = FileDescriptor();
+						return;
+					}
 					this->pid = 0;
 				}
 
@@ -107,15 +164,15 @@ private:
 			boost::lock_guard<boost::mutex> l(lock);
 			threadExceptionMessage = e.what();
 			threadExceptionBacktrace = e.backtrace();
-			wo->errorEvent.notify();
+			errorEvent->notify();
 		} catch (const std::exception &e) {
 			boost::lock_guard<boost::mutex> l(lock);
 			threadExceptionMessage = e.what();
-			wo->errorEvent.notify();
+			errorEvent->notify();
 		} catch (...) {
 			boost::lock_guard<boost::mutex> l(lock);
 			threadExceptionMessage = "Unknown error";
-			wo->errorEvent.notify();
+			errorEvent->notify();
 		}
 	}
 
@@ -133,13 +190,32 @@ protected:
 	/** The agent process's feedback fd. */
 	FileDescriptor feedbackFd;
 
+	/**
+	 * During a graceful restart, the PID of the process that is being
+	 * replaced. 0 if no graceful restart is in progress.
+	 */
+	pid_t replacedPid;
+
+	/**
+	 * During a graceful restart, the feedback fd of the process that is
+	 * being replaced. Agents treat the closing of their feedback fd as a
+	 * sign that the watchdog was killed, so we keep it open until that
+	 * process has exited.
+	 */
+	FileDescriptor replacedFeedbackFd;
+
+	/** Whether restartGracefully() is in progress. */
+	bool restarting;
+	boost::condition_variable restartFinishedCond;
+
 	/**
 	 * Lock for protecting the exchange of data between the main thread and
 	 * the watcher thread.
 	 */
 	mutable boost::mutex lock;
 
-	WorkingObjectsPtr wo;
+	/** Notified when the watcher thread encounters an error. */
+	EventFd *errorEvent;
 
 	/**
 	 * Returns the filename of the agent process's executable. This method may be
@@ -173,6 +249,19 @@ protected:
 	 */
 	virtual bool processStartupInfo(pid_t pid, FileDescriptor &fd, const vector<string> &args) = 0;
 
+	/**
+	 * Called by restartGracefully() right before the new agent process is
+	 * started, e.g. to tell the old process to stop writing files that the
+	 * new process will own. May block for a limited amount of time.
+	 */
+	virtual void prepareForReplacement(pid_t oldPid) { }
+
+	/**
+	 * Called by restartGracefully() if starting the new agent process failed
+	 * after prepareForReplacement() was called. The old process keeps running.
+	 */
+	virtual void replacementAborted(pid_t oldPid) { }
+
 	/**
 	 * Kill a process (but not its children) with SIGTERM.
 	 * Does not wait until it has quit.
@@ -217,6 +306,12 @@ protected:
 		return 0; // timed out
 	}
 
+	void finishRestarting() {
+		boost::lock_guard<boost::mutex> l(lock);
+		restarting = false;
+		restartFinishedCond.notify_all();
+	}
+
 	static void waitpidUsingKillPolling(pid_t pid) {
 		bool done = false;
 
@@ -230,14 +325,18 @@ protected:
 	}
 
 public:
-	AgentWatcher(const WorkingObjectsPtr &wo) {
+	AgentWatcher(EventFd *errorEvent) {
 		thr = NULL;
+		replacedThr = NULL;
 		pid = 0;
-		this->wo = wo;
+		replacedPid = 0;
+		restarting = false;
+		this->errorEvent = errorEvent;
 	}
 
 	virtual ~AgentWatcher() {
 		delete thr;
+		delete replacedThr;
 	}
 
 	/**
@@ -462,17 +561,24 @@ public:
 	static void stopWatching(vector< boost::shared_ptr<AgentWatcher> > &watchers) {
 		vector< boost::shared_ptr<AgentWatcher> >::const_iterator it;
 		vector<oxt::thread *> threads;
-		unsigned int i = 0;
 
-		for (it = watchers.begin(); it != watchers.end(); it++, i++) {
-			threads.push_back((*it)->thr);
-			threads[i] = (*it)->thr;
+		for (it = watchers.begin(); it != watchers.end(); it++) {
+			if ((*it)->thr != NULL) {
+				threads.push_back((*it)->thr);
+			}
+			if ((*it)->replacedThr != NULL) {
+				threads.push_back((*it)->replacedThr);
+			}
 		}
 
-		oxt::thread::interrupt_and_join_multiple(&threads[0], threads.size());
-		for (it = watchers.begin(); it != watchers.end(); it++, i++) {
+		if (!threads.empty()) {
+			oxt::thread::interrupt_and_join_multiple(&threads[0], threads.size());
+		}
+		for (it = watchers.begin(); it != watchers.end(); it++) {
 			delete (*it)->thr;
 			(*it)->thr = NULL;
+			delete (*it)->replacedThr;
+			(*it)->replacedThr = NULL;
 		}
 	}
 
@@ -490,12 +596,83 @@ public:
 		}
 	}
 
+	/**
+	 * Replaces the agent process by a new one without downtime, e.g. to
+	 * activate an upgraded agent executable. The new process is started
+	 * first, while the old one keeps serving. The old process is then told
+	 * to gracefully shut down, which it does after it has finished serving
+	 * its clients.
+	 *
+	 * The current watcher thread keeps waiting for the old process, while
+	 * the new process gets a watcher thread of its own, so that a crash of
+	 * the new process is noticed while the old one is still draining.
+	 *
+	 * Returns false if no agent process was running or if a graceful restart
+	 * is already in progress. If starting the new process fails then an
+	 * exception is thrown and the old process keeps running.
+	 *
+	 * @pre beginWatching() has been called.
+	 */
+	virtual bool restartGracefully() {
+		pid_t oldPid;
+		FileDescriptor oldFeedbackFd;
+
+		{
+			boost::lock_guard<boost::mutex> l(lock);
+			if (pid == 0 || restarting || replacedPid != 0) {
+				return false;
+			}
+			oldPid = pid;
+			oldFeedbackFd = feedbackFd;
+			restarting = true;
+		}
+		ScopeGuard guard(boost::bind(&AgentWatcher::finishRestarting, this));
+
+		if (replacedThr != NULL) {
+			// Left over from the previous graceful restart. It has
+			// already exited or is about to.
+			replacedThr->join();
+			delete replacedThr;
+			replacedThr = NULL;
+		}
+
+		P_NOTICE("Gracefully restarting " << name() << " (pid=" << oldPid << ")...");
+		prepareForReplacement(oldPid);
+		pid_t newPid;
+		try {
+			newPid = start();
+		} catch (...) {
+			replacementAborted(oldPid);
+			throw;
+		}
+		oxt::thread *newThr = new oxt::thread(
+			boost::bind(&AgentWatcher::threadMain, this, shared_from_this()),
+			name(), 256 * 1024);
+
+		{
+			boost::lock_guard<boost::mutex> l(lock);
+			replacedPid = oldPid;
+			replacedFeedbackFd = oldFeedbackFd;
+			replacedThr = thr;
+			thr = newThr;
+		}
+		killAndDontWait(oldPid);
+		P_NOTICE(name() << " (pid=" << newPid << ") started; the old process "
+			"(pid=" << oldPid << ") is shutting down after finishing its requests");
+		return true;
+	}
+
 	/**
 	 * Force the agent process to shut down. Returns true if it was shut down,
 	 * or false if it wasn't started.
 	 */
 	virtual bool forceShutdown() {
 		boost::lock_guard<boost::mutex> l(lock);
+		if (replacedPid != 0) {
+			killProcessGroupAndWait(replacedPid);
+			replacedPid = 0;
+			replacedFeedbackFd = FileDescriptor();
+		}
 		if (pid == 0) {
 			return false;
 		} else {
@@ -535,3 +712,9 @@ public:
 };
 
 typedef boost::shared_ptr<AgentWatcher> AgentWatcherPtr;
+
+
+} // namespace Watchdog
+} // namespace Passenger
+
+#endif /* _PASSENGER_WATCHDOG_AGENT_WATCHER_H_ */
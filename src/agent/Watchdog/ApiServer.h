@@ -26,6 +26,7 @@
 #ifndef _PASSENGER_WATCHDOG_API_SERVER_H_
 #define _PASSENGER_WATCHDOG_API_SERVER_H_
 
+#include <boost/thread.hpp>
 #include <string>
 #include <exception>
 #include <cstring>
@@ -59,6 +60,7 @@ using namespace std;
  *   authorizations               array              -          default("[FILTERED]"),secret
  *   client_freelist_limit        unsigned integer   -          default(0)
  *   fd_passing_password          string             required   secret
+ *   max_pipelined_requests       unsigned integer   -          default(0)
  *   min_spare_clients            unsigned integer   -          default(0)
  *   request_freelist_limit       unsigned integer   -          default(1024)
  *   start_reading_after_accept   boolean            -          default(true)
@@ -115,6 +117,9 @@ public:
 
 private:
 	ApiAccountUtils::ApiAccountDatabase apiAccountDatabase;
+	boost::mutex restartCoreConfigSyncher;
+	/** Core config changes requested through "/restart_core.json". */
+	Json::Value restartCoreConfig;
 
 	void route(Client *client, Request *req, const StaticString &path) {
 		if (path == P_STATIC_STRING("/status.txt")) {
@@ -128,6 +133,8 @@ private:
 			apiServerProcessInfo(this, client, req);
 		} else if (path == P_STATIC_STRING("/shutdown.json")) {
 			apiServerProcessShutdown(this, client, req);
+		} else if (path == P_STATIC_STRING("/restart_core.json")) {
+			processRestartCore(client, req);
 		} else if (path == P_STATIC_STRING("/backtraces.txt")) {
 			apiServerProcessBacktraces(this, client, req);
 		} else if (path == P_STATIC_STRING("/config.json")) {
@@ -156,6 +163,67 @@ private:
 		}
 	}
 
+	void processRestartCore(Client *client, Request *req) {
+		if (req->method != HTTP_POST) {
+			apiServerRespondWith405(this, client, req);
+		} else if (!authorizeAdminOperation(this, client, req)) {
+			apiServerRespondWith401(this, client, req);
+		} else if (!req->hasBody()) {
+			HeaderTable headers;
+			headers.insert(req->pool, "Content-Type", "application/json");
+			restartCoreEvent->notify();
+			writeSimpleResponse(client, 200, &headers, "{ \"status\": \"ok\" }");
+			if (!req->ended()) {
+				endRequest(&client, &req);
+			}
+		}
+		// Else continue in processRestartCoreBody()
+	}
+
+	/**
+	 * The body may change Core config options that can't be changed at
+	 * runtime. Currently only "controller_threads" is supported.
+	 */
+	void processRestartCoreBody(Client *client, Request *req) {
+		const Json::Value &json = req->jsonBody;
+		Json::Value::const_iterator it, end = json.end();
+
+		if (!json.isObject()) {
+			apiServerRespondWith422(this, client, req, "Body must be a JSON object");
+			return;
+		}
+		for (it = json.begin(); it != end; it++) {
+			if (it.name() != "controller_threads") {
+				apiServerRespondWith422(this, client, req,
+					"Unsupported option: " + it.name());
+				return;
+			}
+		}
+		if (json.isMember("controller_threads")
+		 && (!json["controller_threads"].isConvertibleTo(Json::uintValue)
+		  || json["controller_threads"].asUInt() < 1))
+		{
+			apiServerRespondWith422(this, client, req,
+				"'controller_threads' must be an integer that is at least 1");
+			return;
+		}
+
+		{
+			boost::lock_guard<boost::mutex> l(restartCoreConfigSyncher);
+			for (it = json.begin(); it != end; it++) {
+				restartCoreConfig[it.name()] = *it;
+			}
+		}
+
+		HeaderTable headers;
+		headers.insert(req->pool, "Content-Type", "application/json");
+		restartCoreEvent->notify();
+		writeSimpleResponse(client, 200, &headers, "{ \"status\": \"ok\" }");
+		if (!req->ended()) {
+			endRequest(&client, &req);
+		}
+	}
+
 	void processConfig(Client *client, Request *req) {
 		if (req->method == HTTP_GET) {
 			if (!authorizeStateInspectionOperation(this, client, req)) {
@@ -299,8 +367,15 @@ protected:
 			// EOF
 			Json::Reader reader;
 			if (reader.parse(req->body, req->jsonBody)) {
+				StaticString path = req->getPathWithoutQueryString();
 				try {
-					processConfigBody(client, req);
+					if (path == P_STATIC_STRING("/restart_core.json")) {
+						processRestartCoreBody(client, req);
+					} else if (path == P_STATIC_STRING("/config.json")) {
+						processConfigBody(client, req);
+					} else {
+						P_BUG("Unknown path for body processing: " << path);
+					}
 				} catch (const oxt::tracable_exception &e) {
 					SKC_ERROR(client, "Exception: " << e.what() << "\n" << e.backtrace());
 					if (!req->ended()) {
@@ -331,12 +406,15 @@ public:
 
 	// Dependencies
 	EventFd *exitEvent;
+	EventFd *restartCoreEvent;
 
 	ApiServer(ServerKit::Context *context, const Schema &schema,
 		const Json::Value &initialConfig,
 		const ConfigKit::Translator &translator = ConfigKit::DummyTranslator())
 		: ParentClass(context, schema, initialConfig, translator),
-		  exitEvent(NULL)
+		  restartCoreConfig(Json::objectValue),
+		  exitEvent(NULL),
+		  restartCoreEvent(NULL)
 	{
 		apiAccountDatabase = ApiAccountUtils::ApiAccountDatabase(
 			config["authorizations"]);
@@ -346,6 +424,9 @@ public:
 		if (exitEvent == NULL) {
 			throw RuntimeException("exitEvent must be non-NULL");
 		}
+		if (restartCoreEvent == NULL) {
+			throw RuntimeException("restartCoreEvent must be non-NULL");
+		}
 		ParentClass::initialize();
 	}
 
@@ -357,6 +438,17 @@ public:
 		return ParentClass::getClientName(client, buf, size);
 	}
 
+	/**
+	 * Returns the Core config changes that were requested through
+	 * "/restart_core.json" since the last call. Thread-safe.
+	 */
+	Json::Value takeRestartCoreConfig() {
+		boost::lock_guard<boost::mutex> l(restartCoreConfigSyncher);
+		Json::Value result = restartCoreConfig;
+		restartCoreConfig = Json::Value(Json::objectValue);
+		return result;
+	}
+
 	const ApiAccountUtils::ApiAccountDatabase &getApiAccountDatabase() const {
 		return apiAccountDatabase;
 	}
@@ -46,6 +46,7 @@ using namespace std;
  * (do not edit: following text is automatically generated
  * by 'rake configkit_schemas_inline_comments')
  *
+ *   adaptive_request_body_buffering                                          boolean            -          default(false)
  *   admin_panel_auth_type                                                    string             -          default("basic")
  *   admin_panel_close_timeout                                                float              -          default(10.0)
  *   admin_panel_connect_timeout                                              float              -          default(30.0)
@@ -63,20 +64,28 @@ using namespace std;
  *   admin_panel_username                                                     string             -          -
  *   admin_panel_websocketpp_debug_access                                     boolean            -          default(false)
  *   admin_panel_websocketpp_debug_error                                      boolean            -          default(false)
+ *   app_numa_affine                                                          boolean            -          default(false),read_only
  *   app_output_log_level                                                     string             -          default("notice")
  *   benchmark_mode                                                           string             -          -
  *   config_manifest                                                          object             -          read_only
+ *   config_profiles                                                          object             -          read_only
  *   controller_accept_burst_count                                            unsigned integer   -          default(32)
  *   controller_addresses                                                     array of strings   -          default,read_only
  *   controller_client_freelist_limit                                         unsigned integer   -          default(0)
  *   controller_cpu_affine                                                    boolean            -          default(false),read_only
+ *   controller_cpus                                                          string             -          read_only
  *   controller_file_buffered_channel_auto_start_mover                        boolean            -          default(true)
  *   controller_file_buffered_channel_auto_truncate_file                      boolean            -          default(true)
  *   controller_file_buffered_channel_buffer_dir                              string             -          default
  *   controller_file_buffered_channel_delay_in_file_mode_switching            unsigned integer   -          default(0)
+ *   controller_file_buffered_channel_io_uring                                boolean            -          default(false),read_only
+ *   controller_file_buffered_channel_io_uring_entries                        unsigned integer   -          default(64),read_only
  *   controller_file_buffered_channel_max_disk_chunk_read_size                unsigned integer   -          default(0)
+ *   controller_file_buffered_channel_max_disk_chunk_write_size               unsigned integer   -          default(0)
  *   controller_file_buffered_channel_threshold                               unsigned integer   -          default(131072)
+ *   controller_max_pipelined_requests                                        unsigned integer   -          default(8)
  *   controller_mbuf_block_chunk_size                                         unsigned integer   -          default(4096),read_only
+ *   controller_mbuf_spare_memory_high_watermark                              unsigned integer   -          default(8388608)
  *   controller_min_spare_clients                                             unsigned integer   -          default(0)
  *   controller_pid_file                                                      string             -          default,read_only
  *   controller_request_freelist_limit                                        unsigned integer   -          default(1024)
@@ -92,9 +101,14 @@ using namespace std;
  *   core_api_server_file_buffered_channel_auto_truncate_file                 boolean            -          default(true)
  *   core_api_server_file_buffered_channel_buffer_dir                         string             -          default
  *   core_api_server_file_buffered_channel_delay_in_file_mode_switching       unsigned integer   -          default(0)
+ *   core_api_server_file_buffered_channel_io_uring                           boolean            -          default(false),read_only
+ *   core_api_server_file_buffered_channel_io_uring_entries                   unsigned integer   -          default(64),read_only
  *   core_api_server_file_buffered_channel_max_disk_chunk_read_size           unsigned integer   -          default(0)
+ *   core_api_server_file_buffered_channel_max_disk_chunk_write_size          unsigned integer   -          default(0)
  *   core_api_server_file_buffered_channel_threshold                          unsigned integer   -          default(131072)
+ *   core_api_server_max_pipelined_requests                                   unsigned integer   -          default(0)
  *   core_api_server_mbuf_block_chunk_size                                    unsigned integer   -          default(4096),read_only
+ *   core_api_server_mbuf_spare_memory_high_watermark                         unsigned integer   -          default(8388608)
  *   core_api_server_min_spare_clients                                        unsigned integer   -          default(0)
  *   core_api_server_request_freelist_limit                                   unsigned integer   -          default(1024)
  *   core_api_server_start_reading_after_accept                               boolean            -          default(true)
@@ -115,6 +129,7 @@ using namespace std;
  *   default_min_instances                                                    unsigned integer   -          default(1)
  *   default_nodejs                                                           string             -          default("node")
  *   default_python                                                           string             -          default("python")
+ *   default_routing_policy                                                   string             -          default("least_busy")
  *   default_ruby                                                             string             -          default("ruby")
  *   default_server_name                                                      string             -          default
  *   default_server_port                                                      unsigned integer   -          default
@@ -134,6 +149,7 @@ using namespace std;
  *   log_target                                                               any                -          default({"stderr": true})
  *   max_instances_per_app                                                    unsigned integer   -          read_only
  *   max_pool_size                                                            unsigned integer   -          default(6)
+ *   max_request_body_buffer_size                                             unsigned integer   -          default(0)
  *   multi_app                                                                boolean            -          default(false),read_only
  *   passenger_root                                                           string             required   read_only
  *   pidfiles_to_delete_on_exit                                               array of strings   -          default([])
@@ -141,11 +157,13 @@ using namespace std;
  *   pool_selfchecks                                                          boolean            -          default(false)
  *   prestart_urls                                                            array of strings   -          default([]),read_only
  *   response_buffer_high_watermark                                           unsigned integer   -          default(134217728)
+ *   response_compression                                                     boolean            -          default(false)
  *   security_update_checker_certificate_path                                 string             -          -
  *   security_update_checker_disabled                                         boolean            -          default(false)
  *   security_update_checker_interval                                         unsigned integer   -          default(86400)
  *   security_update_checker_proxy_url                                        string             -          -
  *   security_update_checker_url                                              string             -          default("https://securitycheck.phusionpassenger.com/v1/check.json")
+ *   serve_static_files                                                       boolean            -          default(false)
  *   server_software                                                          string             -          default("Phusion_Passenger/5.3.2")
  *   setsid                                                                   boolean            -          default(false)
  *   show_version_in_header                                                   boolean            -          default(true)
@@ -155,7 +173,7 @@ using namespace std;
  *   standalone_engine                                                        string             -          default
  *   startup_report_file                                                      string             -          -
  *   stat_throttle_rate                                                       unsigned integer   -          default(10)
- *   turbocaching                                                             boolean            -          default(true),read_only
+ *   turbocaching                                                             boolean            -          default(true)
  *   user                                                                     string             -          default,read_only
  *   user_switching                                                           boolean            -          default(true)
  *   vary_turbocache_by_cookie                                                string             -          -
@@ -167,9 +185,14 @@ using namespace std;
  *   watchdog_api_server_file_buffered_channel_auto_truncate_file             boolean            -          default(true)
  *   watchdog_api_server_file_buffered_channel_buffer_dir                     string             -          default
  *   watchdog_api_server_file_buffered_channel_delay_in_file_mode_switching   unsigned integer   -          default(0)
+ *   watchdog_api_server_file_buffered_channel_io_uring                       boolean            -          default(false),read_only
+ *   watchdog_api_server_file_buffered_channel_io_uring_entries               unsigned integer   -          default(64),read_only
  *   watchdog_api_server_file_buffered_channel_max_disk_chunk_read_size       unsigned integer   -          default(0)
+ *   watchdog_api_server_file_buffered_channel_max_disk_chunk_write_size      unsigned integer   -          default(0)
  *   watchdog_api_server_file_buffered_channel_threshold                      unsigned integer   -          default(131072)
+ *   watchdog_api_server_max_pipelined_requests                               unsigned integer   -          default(0)
  *   watchdog_api_server_mbuf_block_chunk_size                                unsigned integer   -          default(4096),read_only
+ *   watchdog_api_server_mbuf_spare_memory_high_watermark                     unsigned integer   -          default(8388608)
  *   watchdog_api_server_min_spare_clients                                    unsigned integer   -          default(0)
  *   watchdog_api_server_request_freelist_limit                               unsigned integer   -          default(1024)
  *   watchdog_api_server_start_reading_after_accept                           boolean            -          default(true)
@@ -280,6 +303,7 @@ public:
 		addSubSchema(core.schema, core.translator);
 		erase("instance_dir");
 		erase("watchdog_fd_passing_password");
+		erase("app_process_fd_keeper_address");
 		/***********/
 		/***********/
 
@@ -29,6 +29,8 @@
 
 class CoreWatcher: public AgentWatcher {
 protected:
+	WorkingObjectsPtr wo;
+	ProcessFdKeeperPtr processFdKeeper;
 	string agentFilename;
 
 	virtual const char *name() const {
@@ -63,9 +65,21 @@ protected:
 
 		config["pid_file"] = wo->corePidFile;
 		config["watchdog_fd_passing_password"] = wo->fdPassingPassword;
+		config["app_process_fd_keeper_address"] = wo->processFdKeeperAddress;
 		config["controller_addresses"] = wo->controllerAddresses;
 		config["api_server_addresses"] = wo->coreApiServerAddresses;
+		// If the previous Core instance changed its addresses at runtime,
+		// then keep listening on those.
+		processFdKeeper->getServerAddresses(config["controller_addresses"],
+			config["api_server_addresses"]);
 		config["api_server_authorizations"] = wo->coreApiServerAuthorizations;
+		{
+			boost::lock_guard<boost::mutex> l(wo->coreConfigChangesSyncher);
+			end = wo->coreConfigChanges.end();
+			for (it = wo->coreConfigChanges.begin(); it != end; it++) {
+				config[it.name()] = *it;
+			}
+		}
 
 		// The special value "-" means "don't set a controller secure headers password".
 		if (config["controller_secure_headers_password"].asString() == "-") {
@@ -80,9 +94,28 @@ protected:
 		return args[0] == "initialized";
 	}
 
+	/**
+	 * Tells the old Core to stop writing the pool snapshot, and waits until
+	 * it has written its final one. Otherwise the two instances would
+	 * overwrite each other's snapshots while the old one drains.
+	 */
+	virtual void prepareForReplacement(pid_t oldPid) {
+		syscalls::kill(oldPid, SIGUSR2);
+		if (!processFdKeeper->waitForReplacementPrepared(5000)) {
+			P_WARN(name() << " (pid=" << oldPid << ") did not prepare "
+				"for being replaced in time; starting the new one anyway");
+		}
+	}
+
+	virtual void replacementAborted(pid_t oldPid) {
+		syscalls::kill(oldPid, SIGUSR1);
+	}
+
 public:
-	CoreWatcher(const WorkingObjectsPtr &wo)
-		: AgentWatcher(wo)
+	CoreWatcher(const WorkingObjectsPtr &wo, const ProcessFdKeeperPtr &processFdKeeper)
+		: AgentWatcher(&wo->errorEvent),
+		  wo(wo),
+		  processFdKeeper(processFdKeeper)
 	{
 		agentFilename = Agent::Fundamentals::context->
 			resourceLocator->findSupportBinary(AGENT_EXE);
@@ -0,0 +1,502 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2018 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_WATCHDOG_PROCESS_FD_KEEPER_H_
+#define _PASSENGER_WATCHDOG_PROCESS_FD_KEEPER_H_
+
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <oxt/thread.hpp>
+#include <oxt/dynamic_thread_group.hpp>
+#include <oxt/system_calls.hpp>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <cerrno>
+#include <cstring>
+#include <jsoncpp/json.h>
+#include <FileDescriptor.h>
+#include <Exceptions.h>
+#include <LoggingKit/LoggingKit.h>
+#include <Utils/IOUtils.h>
+#include <Utils/ScopeGuard.h>
+#include <Utils/MessageIO.h>
+#include <Utils/StrIntUtils.h>
+
+namespace Passenger {
+namespace Watchdog {
+
+using namespace std;
+
+
+/**
+ * Holds on to the stdin and stdout/stderr pipes of application processes on
+ * behalf of the Core. Application processes exit as soon as their stdin is
+ * closed, so if the Core were the only one holding the pipes, then every Core
+ * crash would take all application processes down with it. The restarted
+ * Core fetches the pipes back and re-adopts the application processes that
+ * are still alive (see Pool::adoptProcesses()).
+ *
+ * We also hold on to the Core's server sockets, so that the kernel keeps
+ * queueing connections while the Core restarts, and so that a new Core can
+ * take over the sockets while the old one is still draining its clients
+ * (see AgentWatcher::restartGracefully()). During such a graceful restart,
+ * the old Core hands its application processes over to the new one (see
+ * Pool::prepareForReplacement()).
+ *
+ * The Core talks to us with array messages over a Unix domain socket. It must
+ * authenticate with the Watchdog's fd passing password first:
+ *
+ *   ["authenticate", password]        replied to with ["ok"]
+ *   ["keep", gupid, pid]              followed by the stdin and output pipes
+ *   ["release", gupid]
+ *   ["fetch"]                         replied to with ["count", n], followed by n
+ *                                     times [gupid, pid] plus both pipes
+ *   ["keep_server_socket", address]   followed by the socket
+ *   ["release_server_socket", address]
+ *   ["fetch_server_sockets"]          replied to with ["count", n], followed by n
+ *                                     times [address] plus the socket
+ *   ["set_server_addresses", controllerAddresses, apiServerAddresses]
+ *                                     both JSON arrays; sent when the Core's
+ *                                     addresses were changed at runtime, so
+ *                                     that a restarted Core listens on them too
+ *   ["prepared_for_replacement"]      sent by a Core that is being replaced by
+ *                                     a graceful restart, once it has written
+ *                                     its final pool snapshot; hands over the
+ *                                     processes that it kept until then
+ */
+class ProcessFdKeeper {
+private:
+	struct Entry {
+		pid_t pid;
+		/** ID of the client (i.e. the Core instance) that sent us the pipes. */
+		unsigned int owner;
+		/**
+		 * Whether the owner, which is being replaced by a graceful restart,
+		 * has handed this process over to the Core that replaces it.
+		 */
+		bool handedOver;
+		/** Whether the owner released this process after handing it over. */
+		bool releasedByOwner;
+		FileDescriptor input;
+		FileDescriptor output;
+	};
+
+	string address;
+	string password;
+	FileDescriptor serverFd;
+	boost::mutex syncher;
+	/** Notified when a replaced client is prepared or disconnects. */
+	boost::condition_variable replacementCond;
+	map<string, Entry> entries;
+	map<string, FileDescriptor> serverSockets;
+	/** Null until the Core has sent "set_server_addresses". */
+	Json::Value controllerAddresses;
+	Json::Value apiServerAddresses;
+	bool releasedAll;
+	unsigned int nextClientId;
+	set<unsigned int> connectedClients;
+	/** Clients that are being replaced by a graceful restart. */
+	set<unsigned int> replacedClients;
+	/** Clients that were marked as replaced by the last beginGracefulRestart(). */
+	set<unsigned int> lastReplacedClients;
+	/** Replaced clients that have sent "prepared_for_replacement". */
+	set<unsigned int> preparedClients;
+	oxt::dynamic_thread_group clientThreads;
+	oxt::thread *thr;
+
+	void sendEntries(int fd) {
+		map<string, Entry> entriesCopy;
+		map<string, Entry>::const_iterator it;
+
+		{
+			boost::lock_guard<boost::mutex> l(syncher);
+			// The application processes of a Core that is being replaced
+			// by a graceful restart still belong to that Core, which will
+			// shut them down, unless it handed them over.
+			for (it = entries.begin(); it != entries.end(); it++) {
+				if (it->second.handedOver
+				 || replacedClients.find(it->second.owner) == replacedClients.end())
+				{
+					entriesCopy.insert(*it);
+				}
+			}
+		}
+
+		writeArrayMessage(fd, "count", toString(entriesCopy.size()).c_str(), NULL);
+		for (it = entriesCopy.begin(); it != entriesCopy.end(); it++) {
+			writeArrayMessage(fd, it->first.c_str(), toString(it->second.pid).c_str(),
+				NULL);
+			writeFileDescriptorWithNegotiation(fd, it->second.input);
+			writeFileDescriptorWithNegotiation(fd, it->second.output);
+		}
+	}
+
+	void sendServerSockets(int fd) {
+		map<string, FileDescriptor> serverSocketsCopy;
+		map<string, FileDescriptor>::const_iterator it;
+
+		{
+			boost::lock_guard<boost::mutex> l(syncher);
+			serverSocketsCopy = serverSockets;
+		}
+
+		writeArrayMessage(fd, "count", toString(serverSocketsCopy.size()).c_str(), NULL);
+		for (it = serverSocketsCopy.begin(); it != serverSocketsCopy.end(); it++) {
+			writeArrayMessage(fd, it->first.c_str(), NULL);
+			writeFileDescriptorWithNegotiation(fd, it->second);
+		}
+	}
+
+	void releaseEntry(const string &gupid, unsigned int clientId) {
+		map<string, Entry>::iterator it = entries.find(gupid);
+		if (it == entries.end()) {
+			return;
+		}
+
+		Entry &entry = it->second;
+		if (entry.owner == clientId && entry.handedOver) {
+			// The Core that replaces this client has adopted the process,
+			// or will do so. We only need to remember the release in case
+			// the graceful restart is aborted.
+			entry.releasedByOwner = true;
+		} else if (entry.owner != clientId && !entry.handedOver
+			&& connectedClients.find(entry.owner) != connectedClients.end())
+		{
+			// A replaced Core released a process that the new Core has
+			// adopted in the meantime.
+		} else {
+			entries.erase(it);
+		}
+	}
+
+	void handOverEntries(unsigned int clientId) {
+		map<string, Entry>::iterator it;
+		for (it = entries.begin(); it != entries.end(); it++) {
+			if (it->second.owner == clientId) {
+				it->second.handedOver = true;
+			}
+		}
+	}
+
+	void clientDisconnected(unsigned int clientId) {
+		boost::lock_guard<boost::mutex> l(syncher);
+		connectedClients.erase(clientId);
+		preparedClients.erase(clientId);
+		replacementCond.notify_all();
+		if (replacedClients.erase(clientId) == 0) {
+			// The Core may have crashed. Keep its application processes
+			// around so that the restarted Core can re-adopt them.
+			return;
+		}
+
+		// This Core was replaced by a graceful restart and has now exited.
+		// Any application processes that it didn't release or hand over
+		// are orphans.
+		map<string, Entry>::iterator it = entries.begin();
+		unsigned int count = 0;
+		while (it != entries.end()) {
+			if (it->second.owner == clientId && !it->second.handedOver) {
+				entries.erase(it++);
+				count++;
+			} else {
+				it++;
+			}
+		}
+		if (count > 0) {
+			P_NOTICE("Application process fd keeper: released the pipes of "
+				<< count << " process(es) of a replaced Core");
+		}
+	}
+
+	void clientThreadMain(FileDescriptor fd, unsigned int clientId) {
+		ScopeGuard guard(boost::bind(&ProcessFdKeeper::clientDisconnected,
+			this, clientId));
+		vector<string> args;
+
+		try {
+			if (!readArrayMessage(fd, args)
+			 || args.size() != 2
+			 || args[0] != "authenticate"
+			 || !constantTimeCompare(args[1], password))
+			{
+				P_WARN("Application process fd keeper: client failed to authenticate");
+				return;
+			}
+			writeArrayMessage(fd, "ok", NULL);
+
+			while (readArrayMessage(fd, args)) {
+				if (args.size() == 3 && args[0] == "keep") {
+					Entry entry;
+					entry.pid = (pid_t) stringToInt(args[2]);
+					entry.owner = clientId;
+					entry.handedOver = false;
+					entry.releasedByOwner = false;
+					entry.input.assign(readFileDescriptorWithNegotiation(fd),
+						__FILE__, __LINE__);
+					entry.output.assign(readFileDescriptorWithNegotiation(fd),
+						__FILE__, __LINE__);
+					P_DEBUG("Application process fd keeper: keeping pipes of process "
+						<< entry.pid << " (gupid " << args[1] << ")");
+
+					boost::lock_guard<boost::mutex> l(syncher);
+					if (!releasedAll) {
+						entries[args[1]] = entry;
+					}
+				} else if (args.size() == 2 && args[0] == "release") {
+					P_DEBUG("Application process fd keeper: releasing pipes of gupid "
+						<< args[1]);
+					boost::lock_guard<boost::mutex> l(syncher);
+					releaseEntry(args[1], clientId);
+				} else if (args.size() == 1 && args[0] == "fetch") {
+					sendEntries(fd);
+				} else if (args.size() == 2 && args[0] == "keep_server_socket") {
+					FileDescriptor serverSocket(readFileDescriptorWithNegotiation(fd),
+						__FILE__, __LINE__);
+					P_DEBUG("Application process fd keeper: keeping server socket "
+						<< args[1]);
+
+					boost::lock_guard<boost::mutex> l(syncher);
+					if (!releasedAll) {
+						serverSockets[args[1]] = serverSocket;
+					}
+				} else if (args.size() == 2 && args[0] == "release_server_socket") {
+					P_DEBUG("Application process fd keeper: releasing server socket "
+						<< args[1]);
+					boost::lock_guard<boost::mutex> l(syncher);
+					serverSockets.erase(args[1]);
+				} else if (args.size() == 1 && args[0] == "fetch_server_sockets") {
+					sendServerSockets(fd);
+				} else if (args.size() == 1 && args[0] == "prepared_for_replacement") {
+					boost::lock_guard<boost::mutex> l(syncher);
+					if (replacedClients.find(clientId) != replacedClients.end()) {
+						P_DEBUG("Application process fd keeper: the replaced "
+							"Core is prepared for replacement");
+						handOverEntries(clientId);
+						preparedClients.insert(clientId);
+						replacementCond.notify_all();
+					}
+				} else if (args.size() == 3 && args[0] == "set_server_addresses") {
+					Json::Reader reader;
+					Json::Value newControllerAddresses, newApiServerAddresses;
+					if (!reader.parse(args[1], newControllerAddresses, false)
+					 || !reader.parse(args[2], newApiServerAddresses, false)
+					 || !newControllerAddresses.isArray()
+					 || !newApiServerAddresses.isArray())
+					{
+						P_WARN("Application process fd keeper: invalid server addresses received");
+						return;
+					}
+					P_DEBUG("Application process fd keeper: server addresses changed to "
+						<< args[1] << " and " << args[2]);
+
+					boost::lock_guard<boost::mutex> l(syncher);
+					controllerAddresses = newControllerAddresses;
+					apiServerAddresses = newApiServerAddresses;
+				} else {
+					P_WARN("Application process fd keeper: invalid message received");
+					return;
+				}
+			}
+		} catch (const SystemException &e) {
+			P_WARN("Application process fd keeper: " << e.what());
+		} catch (const IOException &e) {
+			P_WARN("Application process fd keeper: " << e.what());
+		}
+	}
+
+	void threadMain() {
+		while (!boost::this_thread::interruption_requested()) {
+			int fd = syscalls::accept(serverFd, NULL, NULL);
+			if (fd == -1) {
+				int e = errno;
+				P_WARN("Application process fd keeper: cannot accept client: "
+					<< strerror(e) << " (errno=" << e << ")");
+				syscalls::usleep(100000);
+				continue;
+			}
+
+			FileDescriptor clientFd(fd, __FILE__, __LINE__);
+			unsigned int clientId;
+			{
+				boost::lock_guard<boost::mutex> l(syncher);
+				clientId = nextClientId++;
+				connectedClients.insert(clientId);
+			}
+			clientThreads.create_thread(
+				boost::bind(&ProcessFdKeeper::clientThreadMain, this, clientFd, clientId),
+				"Application process fd keeper client", 128 * 1024);
+		}
+	}
+
+public:
+	/**
+	 * @param address The Unix domain socket address to listen on.
+	 * @param password The password that clients must authenticate with.
+	 */
+	ProcessFdKeeper(const string &_address, const string &_password)
+		: address(_address),
+		  password(_password),
+		  releasedAll(false),
+		  nextClientId(0)
+	{
+		serverFd.assign(createServer(address, 0, true, __FILE__, __LINE__), NULL, 0);
+		thr = new oxt::thread(boost::bind(&ProcessFdKeeper::threadMain, this),
+			"Application process fd keeper", 128 * 1024);
+	}
+
+	~ProcessFdKeeper() {
+		thr->interrupt_and_join();
+		delete thr;
+		clientThreads.interrupt_and_join_all();
+	}
+
+	const string &getAddress() const {
+		return address;
+	}
+
+	/**
+	 * Closes all pipes and server sockets. Called when the Watchdog is about
+	 * to shut down all agents, so that application processes aren't kept
+	 * alive by us.
+	 */
+	void releaseAll() {
+		boost::lock_guard<boost::mutex> l(syncher);
+		entries.clear();
+		serverSockets.clear();
+		releasedAll = true;
+	}
+
+	/**
+	 * If the Core changed its controller and API server addresses at runtime,
+	 * then stores them in the given arguments and returns true. Otherwise
+	 * leaves the arguments alone and returns false.
+	 */
+	bool getServerAddresses(Json::Value &controllerAddresses,
+		Json::Value &apiServerAddresses)
+	{
+		boost::lock_guard<boost::mutex> l(syncher);
+		if (this->controllerAddresses.isNull()) {
+			return false;
+		} else {
+			controllerAddresses = this->controllerAddresses;
+			apiServerAddresses = this->apiServerAddresses;
+			return true;
+		}
+	}
+
+	/**
+	 * Marks the currently connected Core as being replaced by a graceful
+	 * restart. From now on, "fetch" only replies with the application
+	 * processes that it kept if it hands them over by sending
+	 * "prepared_for_replacement", so that the new Core (or a restart of it
+	 * after a crash) doesn't re-adopt the processes that the old one spawns
+	 * while draining. Once the old Core has exited, we release whatever
+	 * processes it didn't release or hand over itself.
+	 */
+	void beginGracefulRestart() {
+		boost::lock_guard<boost::mutex> l(syncher);
+		set<unsigned int>::const_iterator it;
+
+		lastReplacedClients.clear();
+		for (it = connectedClients.begin(); it != connectedClients.end(); it++) {
+			if (replacedClients.insert(*it).second) {
+				lastReplacedClients.insert(*it);
+			}
+		}
+	}
+
+	/**
+	 * Waits until every Core that was marked as replaced by the last
+	 * beginGracefulRestart() has sent "prepared_for_replacement" or has
+	 * disconnected. Returns false if that took longer than `timeout`
+	 * milliseconds.
+	 */
+	bool waitForReplacementPrepared(unsigned long long timeout) {
+		boost::unique_lock<boost::mutex> l(syncher);
+		boost::system_time deadline = boost::get_system_time()
+			+ boost::posix_time::milliseconds(timeout);
+
+		while (true) {
+			set<unsigned int>::const_iterator it;
+			bool done = true;
+
+			for (it = lastReplacedClients.begin(); it != lastReplacedClients.end(); it++) {
+				if (connectedClients.find(*it) != connectedClients.end()
+				 && preparedClients.find(*it) == preparedClients.end())
+				{
+					done = false;
+					break;
+				}
+			}
+			if (done) {
+				return true;
+			} else if (!replacementCond.timed_wait(l, deadline)) {
+				return false;
+			}
+		}
+	}
+
+	/**
+	 * Undoes beginGracefulRestart() if the new Core could not be started.
+	 */
+	void abortGracefulRestart() {
+		boost::lock_guard<boost::mutex> l(syncher);
+		set<unsigned int>::const_iterator it;
+
+		for (it = lastReplacedClients.begin(); it != lastReplacedClients.end(); it++) {
+			replacedClients.erase(*it);
+			preparedClients.erase(*it);
+		}
+
+		// Take back the processes that were handed over, and give up the
+		// ones that their owner released in the meantime.
+		map<string, Entry>::iterator e_it = entries.begin();
+		while (e_it != entries.end()) {
+			Entry &entry = e_it->second;
+			if (entry.handedOver
+			 && lastReplacedClients.find(entry.owner) != lastReplacedClients.end())
+			{
+				if (entry.releasedByOwner) {
+					entries.erase(e_it++);
+					continue;
+				}
+				entry.handedOver = false;
+			}
+			e_it++;
+		}
+		lastReplacedClients.clear();
+	}
+};
+
+typedef boost::shared_ptr<ProcessFdKeeper> ProcessFdKeeperPtr;
+
+
+} // namespace Watchdog
+} // namespace Passenger
+
+#endif /* _PASSENGER_WATCHDOG_PROCESS_FD_KEEPER_H_ */
@@ -30,6 +30,7 @@
 #include <oxt/system_calls.hpp>
 #include <boost/function.hpp>
 #include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include <boost/make_shared.hpp>
 #include <boost/foreach.hpp>
 #include <boost/enable_shared_from_this.hpp>
@@ -67,6 +68,8 @@
 #include <Core/OptionParser.h>
 #include <Watchdog/Config.h>
 #include <Watchdog/ApiServer.h>
+#include <Watchdog/ProcessFdKeeper.h>
+#include <Watchdog/AgentWatcher.h>
 #include <JsonTools/Autocast.h>
 #include <Constants.h>
 #include <InstanceDirectory.h>
@@ -102,7 +105,6 @@ enum OomFileType {
 #define REQUEST_SOCKET_PASSWORD_SIZE     64
 
 class InstanceDirToucher;
-class AgentWatcher;
 
 
 /***** Working objects *****/
@@ -113,6 +115,7 @@ namespace Watchdog {
 		RandomGenerator randomGenerator;
 		EventFd errorEvent;
 		EventFd exitEvent;
+		EventFd restartCoreEvent;
 		uid_t defaultUid;
 		gid_t defaultGid;
 		InstanceDirectoryPtr instanceDir;
@@ -123,12 +126,20 @@ namespace Watchdog {
 		bool pidFileCleanedUp;
 		string corePidFile;
 		string fdPassingPassword;
+		string processFdKeeperAddress;
 		Json::Value extraConfigToPassToSubAgents;
 		Json::Value controllerAddresses;
 		Json::Value coreApiServerAddresses;
 		Json::Value coreApiServerAuthorizations;
 		Json::Value watchdogApiServerAddresses;
 		Json::Value watchdogApiServerAuthorizations;
+		/**
+		 * Core config changes that were requested through the API server's
+		 * "/restart_core.json". Applied to every Core that we start from then
+		 * on, including restarts after crashes.
+		 */
+		boost::mutex coreConfigChangesSyncher;
+		Json::Value coreConfigChanges;
 
 		int apiServerFds[SERVER_KIT_MAX_SERVER_ENDPOINTS];
 		BackgroundEventLoop *bgloop;
@@ -139,6 +150,7 @@ namespace Watchdog {
 		WorkingObjects()
 			: errorEvent(__FILE__, __LINE__, "WorkingObjects: errorEvent"),
 			  exitEvent(__FILE__, __LINE__, "WorkingObjects: exitEvent"),
+			  restartCoreEvent(__FILE__, __LINE__, "WorkingObjects: restartCoreEvent"),
 			  startupReportFile(-1),
 			  pidsCleanedUp(false),
 			  pidFileCleanedUp(false),
@@ -148,6 +160,7 @@ namespace Watchdog {
 			  coreApiServerAuthorizations(Json::arrayValue),
 			  watchdogApiServerAddresses(Json::arrayValue),
 			  watchdogApiServerAuthorizations(Json::arrayValue),
+			  coreConfigChanges(Json::objectValue),
 			  bgloop(NULL),
 			  serverKitContext(NULL),
 			  apiServer(NULL)
@@ -170,7 +183,6 @@ static WorkingObjects *workingObjects;
 
 static void cleanup(const WorkingObjectsPtr &wo);
 
-#include "AgentWatcher.cpp"
 #include "InstanceDirToucher.cpp"
 #include "CoreWatcher.cpp"
 
@@ -259,20 +271,70 @@ terminationHandler(int signo) {
 	(void) ret; // Don't care about the result.
 }
 
+/**
+ * Replaces the Core by a new instance without downtime. The new Core takes
+ * over the server sockets that the ProcessFdKeeper holds on to, and adopts
+ * the application processes of the old Core, while the old Core finishes its
+ * requests and then exits. `configChanges` is applied to the new Core, and is
+ * forgotten again if it can't be started.
+ */
+static void
+restartCoreGracefully(const WorkingObjectsPtr &wo,
+	const ProcessFdKeeperPtr &processFdKeeper, vector<AgentWatcherPtr> &watchers,
+	const Json::Value &configChanges)
+{
+	TRACE_POINT();
+	bool restarted = false;
+	Json::Value oldConfigChanges;
+
+	{
+		boost::lock_guard<boost::mutex> l(wo->coreConfigChangesSyncher);
+		Json::Value::const_iterator it, end = configChanges.end();
+
+		oldConfigChanges = wo->coreConfigChanges;
+		for (it = configChanges.begin(); it != end; it++) {
+			wo->coreConfigChanges[it.name()] = *it;
+		}
+	}
+
+	processFdKeeper->beginGracefulRestart();
+	foreach (AgentWatcherPtr watcher, watchers) {
+		try {
+			if (watcher->restartGracefully()) {
+				restarted = true;
+			} else {
+				P_WARN("Cannot gracefully restart the " << watcher->name()
+					<< ": it isn't running, or it's already being restarted");
+			}
+		} catch (const std::exception &e) {
+			P_ERROR("Cannot gracefully restart the " << watcher->name()
+				<< "; keeping the current process: " << e.what());
+		}
+	}
+	if (!restarted) {
+		processFdKeeper->abortGracefulRestart();
+		boost::lock_guard<boost::mutex> l(wo->coreConfigChangesSyncher);
+		wo->coreConfigChanges = oldConfigChanges;
+	}
+}
+
 /**
  * Wait until the starter process has exited or sent us an exit command,
  * or until one of the watcher threads encounter an error. If a thread
- * encountered an error then the error message will be printed.
+ * encountered an error then the error message will be printed. Meanwhile,
+ * handles requests to gracefully restart the Core.
  *
  * Returns whether this watchdog should exit gracefully, which is only the
  * case if the web server sent us an exit command and no thread encountered
  * an error.
  */
 static bool
-waitForStarterProcessOrWatchers(const WorkingObjectsPtr &wo, vector<AgentWatcherPtr> &watchers) {
+waitForStarterProcessOrWatchers(const WorkingObjectsPtr &wo,
+	const ProcessFdKeeperPtr &processFdKeeper, vector<AgentWatcherPtr> &watchers)
+{
 	TRACE_POINT();
 	fd_set fds;
-	int max = -1, ret;
+	int max, ret;
 	char x;
 
 	wo->bgloop->start("Main event loop", 0);
@@ -284,22 +346,39 @@ waitForStarterProcessOrWatchers(const WorkingObjectsPtr &wo, vector<AgentWatcher
 	sigaction(SIGINT, &action, NULL);
 	sigaction(SIGTERM, &action, NULL);
 
-	FD_ZERO(&fds);
-	if (feedbackFdAvailable()) {
-		FD_SET(FEEDBACK_FD, &fds);
-		max = std::max(max, FEEDBACK_FD);
-	}
-	FD_SET(wo->errorEvent.fd(), &fds);
-	max = std::max(max, wo->errorEvent.fd());
-	FD_SET(wo->exitEvent.fd(), &fds);
-	max = std::max(max, wo->exitEvent.fd());
+	while (true) {
+		FD_ZERO(&fds);
+		max = -1;
+		if (feedbackFdAvailable()) {
+			FD_SET(FEEDBACK_FD, &fds);
+			max = std::max(max, FEEDBACK_FD);
+		}
+		FD_SET(wo->errorEvent.fd(), &fds);
+		max = std::max(max, wo->errorEvent.fd());
+		FD_SET(wo->exitEvent.fd(), &fds);
+		max = std::max(max, wo->exitEvent.fd());
+		FD_SET(wo->restartCoreEvent.fd(), &fds);
+		max = std::max(max, wo->restartCoreEvent.fd());
 
-	UPDATE_TRACE_POINT();
-	ret = syscalls::select(max + 1, &fds, NULL, NULL, NULL);
-	if (ret == -1) {
-		int e = errno;
-		P_ERROR("select() failed: " << strerror(e));
-		return false;
+		UPDATE_TRACE_POINT();
+		ret = syscalls::select(max + 1, &fds, NULL, NULL, NULL);
+		if (ret == -1) {
+			int e = errno;
+			P_ERROR("select() failed: " << strerror(e));
+			return false;
+		}
+
+		if (FD_ISSET(wo->restartCoreEvent.fd(), &fds)
+		 && !FD_ISSET(wo->errorEvent.fd(), &fds)
+		 && !FD_ISSET(wo->exitEvent.fd(), &fds))
+		{
+			UPDATE_TRACE_POINT();
+			ret = syscalls::read(wo->restartCoreEvent.fd(), &x, 1);
+			restartCoreGracefully(wo, processFdKeeper, watchers,
+				wo->apiServer->takeRestartCoreConfig());
+		} else {
+			break;
+		}
 	}
 
 	action.sa_handler = SIG_DFL;
@@ -1109,9 +1188,20 @@ initializeWorkingObjects(const WorkingObjectsPtr &wo, InstanceDirToucherPtr &ins
 }
 
 static void
-initializeAgentWatchers(const WorkingObjectsPtr &wo, vector<AgentWatcherPtr> &watchers) {
+initializeProcessFdKeeper(const WorkingObjectsPtr &wo, ProcessFdKeeperPtr &processFdKeeper) {
+	TRACE_POINT();
+	processFdKeeper = boost::make_shared<ProcessFdKeeper>(
+		"unix:" + wo->instanceDir->getPath() + "/agents.s/app_process_fd_keeper",
+		wo->fdPassingPassword);
+	wo->processFdKeeperAddress = processFdKeeper->getAddress();
+}
+
+static void
+initializeAgentWatchers(const WorkingObjectsPtr &wo, const ProcessFdKeeperPtr &processFdKeeper,
+	vector<AgentWatcherPtr> &watchers)
+{
 	TRACE_POINT();
-	watchers.push_back(boost::make_shared<CoreWatcher>(wo));
+	watchers.push_back(boost::make_shared<CoreWatcher>(wo, processFdKeeper));
 }
 
 static void
@@ -1183,6 +1273,7 @@ initializeApiServer(const WorkingObjectsPtr &wo) {
 		apiServerConfig,
 		watchdogSchema->apiServer.translator);
 	wo->apiServer->exitEvent = &wo->exitEvent;
+	wo->apiServer->restartCoreEvent = &wo->restartCoreEvent;
 	wo->apiServer->initialize();
 	for (unsigned int i = 0; i < wo->watchdogApiServerAddresses.size(); i++) {
 		wo->apiServer->listen(wo->apiServerFds[i]);
@@ -1296,6 +1387,7 @@ watchdogMain(int argc, char *argv[]) {
 	initializeBareEssentials(argc, argv, wo);
 	P_NOTICE("Starting " SHORT_PROGRAM_NAME " watchdog...");
 	InstanceDirToucherPtr instanceDirToucher;
+	ProcessFdKeeperPtr processFdKeeper;
 	vector<AgentWatcherPtr> watchers;
 	uid_t uidBeforeLoweringPrivilege = geteuid();
 
@@ -1308,7 +1400,8 @@ watchdogMain(int argc, char *argv[]) {
 		chdirToTmpDir();
 		lowerPrivilege();
 		initializeWorkingObjects(wo, instanceDirToucher, uidBeforeLoweringPrivilege);
-		initializeAgentWatchers(wo, watchers);
+		initializeProcessFdKeeper(wo, processFdKeeper);
+		initializeAgentWatchers(wo, processFdKeeper, watchers);
 		initializeApiServer(wo);
 		UPDATE_TRACE_POINT();
 		runHookScriptAndThrowOnError("before_watchdog_initialization");
@@ -1347,7 +1440,8 @@ watchdogMain(int argc, char *argv[]) {
 		UPDATE_TRACE_POINT();
 		boost::this_thread::disable_interruption di;
 		boost::this_thread::disable_syscall_interruption dsi;
-		bool shouldExitGracefully = waitForStarterProcessOrWatchers(wo, watchers);
+		bool shouldExitGracefully = waitForStarterProcessOrWatchers(wo,
+			processFdKeeper, watchers);
 		if (shouldExitGracefully) {
 			/* Fork a child process which cleans up all the agent processes in
 			 * the background and exit this watchdog process so that we don't block
@@ -1360,6 +1454,8 @@ watchdogMain(int argc, char *argv[]) {
 		UPDATE_TRACE_POINT();
 		runHookScriptAndThrowOnError("before_watchdog_shutdown");
 		UPDATE_TRACE_POINT();
+		// Application processes must not outlive the Core anymore.
+		processFdKeeper->releaseAll();
 		AgentWatcher::stopWatching(watchers);
 		if (shouldExitGracefully) {
 			UPDATE_TRACE_POINT();
@@ -333,6 +333,11 @@ AP_INIT_TAKE1("PassengerRoot",
 	NULL,
 	RSRC_CONF,
 	"The Phusion Passenger root folder."),
+AP_INIT_TAKE1("PassengerRoutingPolicy",
+	(Take1Func) cmd_passenger_routing_policy,
+	NULL,
+	RSRC_CONF | ACCESS_CONF,
+	"How to route requests among the application's processes: 'least_busy', 'response_time' or 'two_random_choices'."),
 AP_INIT_TAKE1("PassengerRuby",
 	(Take1Func) cmd_passenger_ruby,
 	NULL,
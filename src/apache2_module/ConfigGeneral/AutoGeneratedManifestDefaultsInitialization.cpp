@@ -224,6 +224,11 @@ ConfigManifestGenerator::autoGenerated_setAppConfigDefaults() {
 		"PassengerRestartDir",
 		P_STATIC_STRING("tmp"));
 
+	addOptionsContainerStaticDefaultStr(
+		defaultAppConfigContainer,
+		"PassengerRoutingPolicy",
+		P_STATIC_STRING("least_busy"));
+
 	addOptionsContainerStaticDefaultStr(
 		defaultAppConfigContainer,
 		"PassengerRuby",
@@ -695,6 +695,21 @@ cmd_passenger_root(cmd_parms *cmd, void *pcfg, const char *arg) {
 	return NULL;
 }
 
+static const char *
+cmd_passenger_routing_policy(cmd_parms *cmd, void *pcfg, const char *arg) {
+	const char *err = ap_check_cmd_context(cmd, NOT_IN_FILES);
+	if (err != NULL) {
+		return err;
+	}
+
+	DirConfig *config = (DirConfig *) pcfg;
+	config->mRoutingPolicySourceFile = cmd->directive->filename;
+	config->mRoutingPolicySourceLine = cmd->directive->line_num;
+	config->mRoutingPolicyExplicitlySet = true;
+	config->mRoutingPolicy = arg;
+	return NULL;
+}
+
 static const char *
 cmd_passenger_ruby(cmd_parms *cmd, void *pcfg, const char *arg) {
 	const char *err = ap_check_cmd_context(cmd, NOT_IN_FILES);
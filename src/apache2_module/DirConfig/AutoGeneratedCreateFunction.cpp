@@ -92,6 +92,9 @@ createDirConfig_autoGenerated(DirConfig *config) {
 	/*
 	 * config->mRestartDir: default initialized
 	 */
+	/*
+	 * config->mRoutingPolicy: default initialized
+	 */
 	/*
 	 * config->mRuby: default initialized
 	 */
@@ -136,6 +139,7 @@ createDirConfig_autoGenerated(DirConfig *config) {
 	config->mNodejsSourceLine = 0;
 	config->mPythonSourceLine = 0;
 	config->mRestartDirSourceLine = 0;
+	config->mRoutingPolicySourceLine = 0;
 	config->mRubySourceLine = 0;
 	config->mSpawnMethodSourceLine = 0;
 	config->mStartTimeoutSourceLine = 0;
@@ -170,6 +174,7 @@ createDirConfig_autoGenerated(DirConfig *config) {
 	config->mNodejsExplicitlySet = false;
 	config->mPythonExplicitlySet = false;
 	config->mRestartDirExplicitlySet = false;
+	config->mRoutingPolicyExplicitlySet = false;
 	config->mRubyExplicitlySet = false;
 	config->mSpawnMethodExplicitlySet = false;
 	config->mStartTimeoutExplicitlySet = false;
@@ -91,6 +91,9 @@ constructRequestHeaders_autoGenerated(request_rec *r, Passenger::Apache2Module::
 	addHeader(result, StaticString("!~PASSENGER_RESTART_DIR",
 			sizeof("!~PASSENGER_RESTART_DIR") - 1),
 		config->mRestartDir);
+	addHeader(result, StaticString("!~PASSENGER_ROUTING_POLICY",
+			sizeof("!~PASSENGER_ROUTING_POLICY") - 1),
+		config->mRoutingPolicy);
 	addHeader(result, StaticString("!~PASSENGER_RUBY",
 			sizeof("!~PASSENGER_RUBY") - 1),
 		config->mRuby.empty() ? serverConfig.defaultRuby : config->mRuby);
@@ -356,6 +356,19 @@ ConfigManifestGenerator::autoGenerated_generateConfigManifestForDirConfig(server
 			pdconf->mRestartDir.data(),
 			pdconf->mRestartDir.data() + pdconf->mRestartDir.size());
 	}
+	if (pdconf->mRoutingPolicyExplicitlySet) {
+		findOrCreateAppAndLocOptionsContainers(serverRec, csconf, cdconf,
+			pdconf, context, &appOptionsContainer, &locOptionsContainer);
+		Json::Value &optionContainer = findOrCreateOptionContainer(*appOptionsContainer,
+			"PassengerRoutingPolicy",
+			sizeof("PassengerRoutingPolicy") - 1);
+		Json::Value &hierarchyMember = addOptionContainerHierarchyMember(optionContainer,
+			pdconf->mRoutingPolicySourceFile,
+			pdconf->mRoutingPolicySourceLine);
+		hierarchyMember["value"] = Json::Value(
+			pdconf->mRoutingPolicy.data(),
+			pdconf->mRoutingPolicy.data() + pdconf->mRoutingPolicy.size());
+	}
 	if (pdconf->mRubyExplicitlySet) {
 		findOrCreateAppAndLocOptionsContainers(serverRec, csconf, cdconf,
 			pdconf, context, &appOptionsContainer, &locOptionsContainer);
@@ -146,6 +146,10 @@ mergeDirConfig_autoGenerated(DirConfig *config, DirConfig *base, DirConfig *add)
 		(!add->mRestartDir.empty())
 		? add->mRestartDir
 		: base->mRestartDir;
+	config->mRoutingPolicy =
+		(!add->mRoutingPolicy.empty())
+		? add->mRoutingPolicy
+		: base->mRoutingPolicy;
 	config->mRuby =
 		(!add->mRuby.empty())
 		? add->mRuby
@@ -201,6 +205,7 @@ mergeDirConfig_autoGenerated(DirConfig *config, DirConfig *base, DirConfig *add)
 	config->mNodejsSourceFile = add->mNodejsSourceFile;
 	config->mPythonSourceFile = add->mPythonSourceFile;
 	config->mRestartDirSourceFile = add->mRestartDirSourceFile;
+	config->mRoutingPolicySourceFile = add->mRoutingPolicySourceFile;
 	config->mRubySourceFile = add->mRubySourceFile;
 	config->mSpawnMethodSourceFile = add->mSpawnMethodSourceFile;
 	config->mStartTimeoutSourceFile = add->mStartTimeoutSourceFile;
@@ -235,6 +240,7 @@ mergeDirConfig_autoGenerated(DirConfig *config, DirConfig *base, DirConfig *add)
 	config->mNodejsSourceLine = add->mNodejsSourceLine;
 	config->mPythonSourceLine = add->mPythonSourceLine;
 	config->mRestartDirSourceLine = add->mRestartDirSourceLine;
+	config->mRoutingPolicySourceLine = add->mRoutingPolicySourceLine;
 	config->mRubySourceLine = add->mRubySourceLine;
 	config->mSpawnMethodSourceLine = add->mSpawnMethodSourceLine;
 	config->mStartTimeoutSourceLine = add->mStartTimeoutSourceLine;
@@ -269,6 +275,7 @@ mergeDirConfig_autoGenerated(DirConfig *config, DirConfig *base, DirConfig *add)
 	config->mNodejsExplicitlySet = add->mNodejsExplicitlySet;
 	config->mPythonExplicitlySet = add->mPythonExplicitlySet;
 	config->mRestartDirExplicitlySet = add->mRestartDirExplicitlySet;
+	config->mRoutingPolicyExplicitlySet = add->mRoutingPolicyExplicitlySet;
 	config->mRubyExplicitlySet = add->mRubyExplicitlySet;
 	config->mSpawnMethodExplicitlySet = add->mSpawnMethodExplicitlySet;
 	config->mStartTimeoutExplicitlySet = add->mStartTimeoutExplicitlySet;
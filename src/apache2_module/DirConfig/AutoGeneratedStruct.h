@@ -169,6 +169,11 @@ struct AutoGeneratedDirConfig {
 	 */
 	StaticString mRestartDir;
 
+	/*
+	 * How to route requests among the application's processes: 'least_busy', 'response_time' or 'two_random_choices'.
+	 */
+	StaticString mRoutingPolicy;
+
 	/*
 	 * The Ruby interpreter to use.
 	 */
@@ -231,6 +236,7 @@ struct AutoGeneratedDirConfig {
 	StaticString mNodejsSourceFile;
 	StaticString mPythonSourceFile;
 	StaticString mRestartDirSourceFile;
+	StaticString mRoutingPolicySourceFile;
 	StaticString mRubySourceFile;
 	StaticString mSpawnMethodSourceFile;
 	StaticString mStartupFileSourceFile;
@@ -265,6 +271,7 @@ struct AutoGeneratedDirConfig {
 	unsigned int mNodejsSourceLine;
 	unsigned int mPythonSourceLine;
 	unsigned int mRestartDirSourceLine;
+	unsigned int mRoutingPolicySourceLine;
 	unsigned int mRubySourceLine;
 	unsigned int mSpawnMethodSourceLine;
 	unsigned int mStartupFileSourceLine;
@@ -299,6 +306,7 @@ struct AutoGeneratedDirConfig {
 	bool mNodejsExplicitlySet: 1;
 	bool mPythonExplicitlySet: 1;
 	bool mRestartDirExplicitlySet: 1;
+	bool mRoutingPolicyExplicitlySet: 1;
 	bool mRubyExplicitlySet: 1;
 	bool mSpawnMethodExplicitlySet: 1;
 	bool mStartupFileExplicitlySet: 1;
@@ -514,6 +522,15 @@ struct AutoGeneratedDirConfig {
 		}
 	}
 
+	StaticString
+	getRoutingPolicy() const {
+		if (mRoutingPolicy.empty()) {
+			return P_STATIC_STRING("least_busy");
+		} else {
+			return mRoutingPolicy;
+		}
+	}
+
 	StaticString
 	getRuby() const {
 		if (mRuby.empty()) {
@@ -75,7 +75,6 @@ private:
 	DirConfig *config;
 	request_rec *r;
 	CachedFileStat *cstat;
-	boost::mutex *cstatMutex;
 	const char *baseURI;
 	string publicDir;
 	string appRoot;
@@ -146,7 +145,7 @@ private:
 		}
 
 		UPDATE_TRACE_POINT();
-		AppTypeDetector detector(cstat, cstatMutex, throttleRate);
+		AppTypeDetector detector(cstat, throttleRate);
 		PassengerAppType appType;
 		string appRoot;
 		if (config->getAppType().empty()) {
@@ -178,18 +177,15 @@ public:
 	 * Create a new DirectoryMapper object.
 	 *
 	 * @param cstat A CachedFileStat object used for statting files.
-	 * @param cstatMutex A mutex for locking CachedFileStat, making its
-	 *                   usage thread-safe.
 	 * @param throttleRate A throttling rate for cstat.
 	 * @warning Do not use this object after the destruction of <tt>r</tt>,
 	 *          <tt>config</tt> or <tt>cstat</tt>.
 	 */
 	DirectoryMapper(request_rec *r, DirConfig *config, CachedFileStat *cstat,
-	                boost::mutex *cstatMutex, unsigned int throttleRate) {
+	                unsigned int throttleRate) {
 		this->r = r;
 		this->config = config;
 		this->cstat = cstat;
-		this->cstatMutex = cstatMutex;
 		this->throttleRate = throttleRate;
 		appType = PAT_NONE;
 		baseURI = NULL;
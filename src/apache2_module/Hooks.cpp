@@ -231,10 +231,15 @@ private:
 
 	enum Threeway { YES, NO, UNKNOWN };
 
+	/**
+	 * Number of lock stripes in `cstat`. Under threaded MPMs, many threads
+	 * map requests concurrently.
+	 */
+	static const unsigned int CSTAT_CONCURRENCY = 16;
+
 	Threeway m_hasModRewrite, m_hasModDir, m_hasModAutoIndex, m_hasModXsendfile;
 	CachedFileStat cstat;
 	WatchdogLauncher watchdogLauncher;
-	boost::mutex cstatMutex;
 
 	static Json::Value strsetToJson(const set<string> &input) {
 		Json::Value result(Json::arrayValue);
@@ -443,7 +448,7 @@ private:
 	bool prepareRequest(request_rec *r, DirConfig *config, const char *filename, bool coreModuleWillBeRun = false) {
 		TRACE_POINT();
 
-		DirectoryMapper mapper(r, config, &cstat, &cstatMutex, serverConfig.statThrottleRate);
+		DirectoryMapper mapper(r, config, &cstat, serverConfig.statThrottleRate);
 		try {
 			if (mapper.getApplicationType() == PAT_NONE) {
 				// (B) is not true.
@@ -1244,7 +1249,7 @@ private:
 
 public:
 	Hooks(apr_pool_t *pconf, apr_pool_t *plog, apr_pool_t *ptemp, server_rec *s)
-	    : cstat(1024),
+	    : cstat(1024, CSTAT_CONCURRENCY),
 	      watchdogLauncher(IM_APACHE)
 	{
 		postprocessConfig(s, pconf, ptemp);
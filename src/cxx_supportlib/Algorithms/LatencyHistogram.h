@@ -0,0 +1,197 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2018 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_ALGORITHMS_LATENCY_HISTOGRAM_H_
+#define _PASSENGER_ALGORITHMS_LATENCY_HISTOGRAM_H_
+
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace Passenger {
+
+using namespace std;
+
+
+/**
+ * A fixed-size, log-linear histogram for recording latencies (in microseconds),
+ * in the spirit of Gil Tene's HdrHistogram. Every power of two is divided into
+ * `SUB_BUCKET_COUNT` linear sub-buckets, so recorded values are accurate to
+ * within 1/SUB_BUCKET_COUNT (~6%) of their real value, regardless of magnitude.
+ *
+ * Recording a value is O(1) and never allocates, which makes this class suitable
+ * for use on hot paths. Histograms can be merged cheaply, so that each thread
+ * can keep its own histogram without any locking, and the results can be
+ * combined on demand.
+ *
+ * Values larger than `MAX_VALUE` (about 19 hours) are clamped.
+ *
+ * This class is not thread-safe.
+ */
+class LatencyHistogram {
+public:
+	static const unsigned int SUB_BUCKET_BITS = 4;
+	static const unsigned int SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+	static const unsigned int MAX_VALUE_BITS = 36;
+	static const unsigned int BUCKET_COUNT =
+		(MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+	static const boost::uint64_t MAX_VALUE = (((boost::uint64_t) 1) << MAX_VALUE_BITS) - 1;
+
+private:
+	boost::uint64_t counts[BUCKET_COUNT];
+	boost::uint64_t totalCount;
+	boost::uint64_t sum;
+	boost::uint64_t minValue;
+	boost::uint64_t maxValue;
+
+	static unsigned int highestBit(boost::uint64_t value) {
+		unsigned int result = 0;
+		if (value >= (((boost::uint64_t) 1) << 32)) { value >>= 32; result += 32; }
+		if (value >= (1u << 16)) { value >>= 16; result += 16; }
+		if (value >= (1u << 8)) { value >>= 8; result += 8; }
+		if (value >= (1u << 4)) { value >>= 4; result += 4; }
+		if (value >= (1u << 2)) { value >>= 2; result += 2; }
+		if (value >= (1u << 1)) { result += 1; }
+		return result;
+	}
+
+public:
+	LatencyHistogram() {
+		reset();
+	}
+
+	static unsigned int bucketIndexFor(boost::uint64_t value) {
+		if (value < SUB_BUCKET_COUNT) {
+			return (unsigned int) value;
+		} else {
+			unsigned int shift = highestBit(value) - SUB_BUCKET_BITS;
+			unsigned int subBucket = (unsigned int) (value >> shift) & (SUB_BUCKET_COUNT - 1);
+			return (shift + 1) * SUB_BUCKET_COUNT + subBucket;
+		}
+	}
+
+	/**
+	 * Returns the lowest value that maps to the given bucket.
+	 */
+	static boost::uint64_t bucketLowerBound(unsigned int index) {
+		if (index < SUB_BUCKET_COUNT) {
+			return index;
+		} else {
+			unsigned int shift = index / SUB_BUCKET_COUNT - 1;
+			unsigned int subBucket = index % SUB_BUCKET_COUNT;
+			return ((boost::uint64_t) (SUB_BUCKET_COUNT + subBucket)) << shift;
+		}
+	}
+
+	/**
+	 * Returns the highest value that maps to the given bucket.
+	 */
+	static boost::uint64_t bucketUpperBound(unsigned int index) {
+		if (index < SUB_BUCKET_COUNT) {
+			return index;
+		} else {
+			unsigned int shift = index / SUB_BUCKET_COUNT - 1;
+			return bucketLowerBound(index) + (((boost::uint64_t) 1) << shift) - 1;
+		}
+	}
+
+	void record(boost::uint64_t value) {
+		if (value > MAX_VALUE) {
+			value = MAX_VALUE;
+		}
+		counts[bucketIndexFor(value)]++;
+		totalCount++;
+		sum += value;
+		minValue = std::min(minValue, value);
+		maxValue = std::max(maxValue, value);
+	}
+
+	void merge(const LatencyHistogram &other) {
+		if (other.totalCount == 0) {
+			return;
+		}
+		for (unsigned int i = 0; i < BUCKET_COUNT; i++) {
+			counts[i] += other.counts[i];
+		}
+		totalCount += other.totalCount;
+		sum += other.sum;
+		minValue = std::min(minValue, other.minValue);
+		maxValue = std::max(maxValue, other.maxValue);
+	}
+
+	void reset() {
+		memset(counts, 0, sizeof(counts));
+		totalCount = 0;
+		sum = 0;
+		minValue = MAX_VALUE;
+		maxValue = 0;
+	}
+
+	boost::uint64_t getTotalCount() const {
+		return totalCount;
+	}
+
+	boost::uint64_t getMin() const {
+		return (totalCount == 0) ? 0 : minValue;
+	}
+
+	boost::uint64_t getMax() const {
+		return maxValue;
+	}
+
+	double getMean() const {
+		return (totalCount == 0) ? 0 : sum / (double) totalCount;
+	}
+
+	/**
+	 * Returns the value at the given percentile (0-100). The result is the
+	 * highest value that is equivalent to the bucket in which the percentile
+	 * falls, capped by the largest value ever recorded.
+	 */
+	boost::uint64_t getValueAtPercentile(double percentile) const {
+		if (totalCount == 0) {
+			return 0;
+		}
+
+		percentile = std::max(0.0, std::min(percentile, 100.0));
+		boost::uint64_t rank = (boost::uint64_t) ceil(percentile / 100.0 * totalCount);
+		rank = std::max<boost::uint64_t>(rank, 1);
+
+		boost::uint64_t seen = 0;
+		for (unsigned int i = 0; i < BUCKET_COUNT; i++) {
+			seen += counts[i];
+			if (seen >= rank) {
+				return std::max(std::min(bucketUpperBound(i), maxValue), minValue);
+			}
+		}
+		return maxValue;
+	}
+};
+
+
+} // namespace Passenger
+
+#endif /* _PASSENGER_ALGORITHMS_LATENCY_HISTOGRAM_H_ */
@@ -52,7 +52,7 @@ using namespace Passenger;
 PP_AppTypeDetector *
 pp_app_type_detector_new(unsigned int throttleRate) {
 	try {
-		return new AppTypeDetector(NULL, NULL, throttleRate);
+		return new AppTypeDetector(NULL, throttleRate);
 	} catch (const std::bad_alloc &) {
 		return 0;
 	}
@@ -103,7 +103,6 @@ extern const AppTypeDefinition appTypeDefinitions[];
 class AppTypeDetector {
 private:
 	CachedFileStat *cstat;
-	boost::mutex *cstatMutex;
 	unsigned int throttleRate;
 	bool ownsCstat;
 
@@ -117,13 +116,12 @@ private:
 			TRACE_POINT();
 			throw RuntimeException("Not enough buffer space");
 		}
-		return getFileType(StaticString(buf, pos - buf - 1), cstat, cstatMutex, throttleRate) != FT_NONEXISTANT;
+		return getFileType(StaticString(buf, pos - buf - 1), cstat, throttleRate) != FT_NONEXISTANT;
 	}
 
 public:
-	AppTypeDetector(CachedFileStat *_cstat = NULL, boost::mutex *_cstatMutex = NULL, unsigned int _throttleRate = 1)
+	AppTypeDetector(CachedFileStat *_cstat = NULL, unsigned int _throttleRate = 1)
 		: cstat(_cstat),
-		  cstatMutex(_cstatMutex),
 		  throttleRate(_throttleRate),
 		  ownsCstat(false)
 	{
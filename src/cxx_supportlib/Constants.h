@@ -49,6 +49,7 @@
 #define DEFAULT_APP_OUTPUT_LOG_LEVEL_NAME "notice"
 #define DEFAULT_APP_THREAD_COUNT 1
 #define DEFAULT_CONCURRENCY_MODEL "process"
+#define DEFAULT_FILE_BUFFERED_CHANNEL_IO_URING_ENTRIES 64
 #define DEFAULT_FILE_BUFFERED_CHANNEL_THRESHOLD 131072
 #define DEFAULT_HTTP_SERVER_LISTEN_ADDRESS "tcp://127.0.0.1:3000"
 #define DEFAULT_INTEGRATION_MODE "standalone"
@@ -59,10 +60,12 @@
 #define DEFAULT_MAX_PRELOADER_IDLE_TIME 300
 #define DEFAULT_MAX_REQUEST_QUEUE_SIZE 100
 #define DEFAULT_MBUF_CHUNK_SIZE 4096
+#define DEFAULT_MBUF_SPARE_MEMORY_HIGH_WATERMARK 8388608
 #define DEFAULT_NODEJS "node"
 #define DEFAULT_POOL_IDLE_TIME 300
 #define DEFAULT_PYTHON "python"
 #define DEFAULT_RESPONSE_BUFFER_HIGH_WATERMARK 134217728
+#define DEFAULT_ROUTING_POLICY "least_busy"
 #define DEFAULT_RUBY "ruby"
 #define DEFAULT_SOCKET_BACKLOG 2048
 #define DEFAULT_SPAWN_METHOD "smart"
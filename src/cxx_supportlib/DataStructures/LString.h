@@ -437,6 +437,21 @@ psg_lstr_deinit(LString *str) {
 	psg_lstr_init(str);
 }
 
+/**
+ * Like psg_lstr_make_contiguous(), but replaces the contents of `str` with
+ * the contiguous copy instead of returning a new LString. The references
+ * to the old parts' mbuf_blocks are released. Does nothing if `str` is
+ * already contiguous.
+ */
+inline void
+psg_lstr_make_contiguous_in_place(LString *str, psg_pool_t *pool) {
+	if (str->size != 0 && str->start != str->end) {
+		LString *contiguous = psg_lstr_null_terminate(str, pool);
+		psg_lstr_deinit(str);
+		*str = *contiguous;
+	}
+}
+
 inline char *
 appendData(char *pos, const char *end, const LString *str) {
 	const LString::Part *part = str->start;
@@ -0,0 +1,138 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2018 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_DATA_STRUCTURES_MPSC_QUEUE_H_
+#define _PASSENGER_DATA_STRUCTURES_MPSC_QUEUE_H_
+
+#include <boost/atomic.hpp>
+#include <cstddef>
+
+namespace Passenger {
+
+
+/**
+ * A node in an MpscQueue. Embed this in (or inherit from) the objects
+ * that you want to queue. A node may only be in one queue at a time.
+ */
+struct MpscQueueNode {
+	boost::atomic<MpscQueueNode *> mpscNext;
+
+	MpscQueueNode()
+		: mpscNext(NULL)
+		{ }
+};
+
+
+/**
+ * An intrusive, unbounded, multiple-producer single-consumer FIFO queue.
+ * It is based on Dmitry Vyukov's intrusive MPSC node-based queue.
+ *
+ * `push()` may be called from any thread and never blocks or allocates:
+ * it consists of a single atomic exchange plus a store. `pop()` may
+ * only be called from a single consumer thread at a time.
+ *
+ * There is a small window inside `push()` during which the pushed node
+ * (and every node pushed after it) is not yet visible to the consumer.
+ * `pop()` returns NULL in that case, just as if the queue were empty.
+ * Because `push()` only returns after the node has become visible,
+ * a producer that wakes up the consumer after calling `push()` will never
+ * cause the consumer to miss that node.
+ *
+ * The queue does not own the nodes. A node must stay alive until the
+ * consumer has popped it.
+ */
+class MpscQueue {
+private:
+	// Written by producers.
+	boost::atomic<MpscQueueNode *> head;
+	// Keep the producer-side and consumer-side fields on separate
+	// cache lines.
+	char padding[64 - sizeof(boost::atomic<MpscQueueNode *>)];
+	// Only accessed by the consumer.
+	MpscQueueNode *tail;
+	MpscQueueNode stub;
+
+	MpscQueue(const MpscQueue &);
+	MpscQueue &operator=(const MpscQueue &);
+
+public:
+	MpscQueue()
+		: head(&stub),
+		  tail(&stub)
+		{ }
+
+	/** Thread-safe. */
+	void push(MpscQueueNode *node) {
+		node->mpscNext.store(NULL, boost::memory_order_relaxed);
+		MpscQueueNode *prev = head.exchange(node, boost::memory_order_acq_rel);
+		prev->mpscNext.store(node, boost::memory_order_release);
+	}
+
+	/**
+	 * Removes the oldest node from the queue and returns it, or returns
+	 * NULL if there is no node (yet) available.
+	 *
+	 * May only be called by the consumer.
+	 */
+	MpscQueueNode *pop() {
+		MpscQueueNode *tail = this->tail;
+		MpscQueueNode *next = tail->mpscNext.load(boost::memory_order_acquire);
+
+		if (tail == &stub) {
+			if (next == NULL) {
+				return NULL;
+			}
+			this->tail = next;
+			tail = next;
+			next = next->mpscNext.load(boost::memory_order_acquire);
+		}
+
+		if (next != NULL) {
+			this->tail = next;
+			return tail;
+		}
+
+		if (tail != head.load(boost::memory_order_acquire)) {
+			// A producer is in the middle of pushing.
+			return NULL;
+		}
+
+		// `tail` is the last node. We can't pop it without leaving the
+		// queue without any nodes, so push the stub behind it.
+		push(&stub);
+		next = tail->mpscNext.load(boost::memory_order_acquire);
+		if (next != NULL) {
+			this->tail = next;
+			return tail;
+		} else {
+			return NULL;
+		}
+	}
+};
+
+
+} // namespace Passenger
+
+#endif /* _PASSENGER_DATA_STRUCTURES_MPSC_QUEUE_H_ */
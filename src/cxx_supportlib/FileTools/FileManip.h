@@ -82,8 +82,6 @@ struct FileGuard {
  *
  * @param filename The filename to check.
  * @param cstat A CachedFileStat object, if you want to use cached statting.
- * @param cstatMutex A mutex for locking cstat while this function uses it.
- *                   Makes this function thread-safe. May be NULL.
  * @param throttleRate A throttle rate for cstat. Only applicable if cstat is not NULL.
  * @return Whether the file exists.
  * @throws FileSystemException Unable to check because of a filesystem error.
@@ -91,15 +89,13 @@ struct FileGuard {
  * @throws boost::thread_interrupted
  */
 bool fileExists(const StaticString &filename, CachedFileStat *cstat = 0,
-	boost::mutex *cstatMutex = NULL, unsigned int throttleRate = 0);
+	unsigned int throttleRate = 0);
 
 /**
 * Check whether 'filename' exists and what kind of file it is.
 *
 * @param filename The filename to check. It MUST be NULL-terminated.
 * @param cstat A CachedFileStat object, if you want to use cached statting.
-* @param cstatMutex A mutex for locking cstat while this function uses it.
-*                   Makes this function thread-safe. May be NULL.
 * @param throttleRate A throttle rate for cstat. Only applicable if cstat is not NULL.
 * @return The file type.
 * @throws FileSystemException Unable to check because of a filesystem error.
@@ -108,7 +104,7 @@ bool fileExists(const StaticString &filename, CachedFileStat *cstat = 0,
 * @ingroup Support
 */
 FileType getFileType(const StaticString &filename, CachedFileStat *cstat = 0,
-		 boost::mutex *cstatMutex = NULL, unsigned int throttleRate = 0);
+		 unsigned int throttleRate = 0);
 
 /**
 * Create the given file with the given contents, permissions and ownership.
@@ -61,7 +61,8 @@ _mbuf_block_mark_as_active(struct mbuf_pool *pool, struct mbuf_block *mbuf_block
 }
 
 static struct mbuf_block *
-_mbuf_block_init(struct mbuf_pool *pool, char *buf, size_t block_offset)
+_mbuf_block_init(struct mbuf_pool *pool, char *buf, size_t block_offset,
+	unsigned int size_class)
 {
 	struct mbuf_block *mbuf_block;
 
@@ -73,14 +74,15 @@ _mbuf_block_init(struct mbuf_pool *pool, char *buf, size_t block_offset)
 	 * mbuf_block header is at the tail end of the mbuf_block. The data
 	 * precedes the header. This enables us to catch buffer overrun early
 	 * by asserting on the magic value during get or put operations.
-	 * All normal mbuf_blocks in a pool have the same mbuf_block_offset,
-	 * allowing them to be reused through a freelist.
+	 * All normal mbuf_blocks in a size class have the same mbuf_block_offset,
+	 * allowing them to be reused through the size class's freelist.
 	 *
-	 *   <------------ pool->mbuf_block_chunk_size -------------->
+	 *   <-------- size_class->mbuf_block_chunk_size ------------>
 	 *   +-------------------------------------------------------+
 	 *   |       mbuf_block data          |  mbuf_block header   |
 	 *   |                                |                      |
-	 *   |  (pool->mbuf_block_offset)     | (struct mbuf_block)  |
+	 *   |  (size_class->                 | (struct mbuf_block)  |
+	 *   |     mbuf_block_offset)         |                      |
 	 *   +-------------------------------------------------------+
 	 *   ^                                ^
 	 *   |                                |
@@ -114,55 +116,74 @@ _mbuf_block_init(struct mbuf_pool *pool, char *buf, size_t block_offset)
 	mbuf_block->magic = MBUF_BLOCK_MAGIC;
 	mbuf_block->pool  = pool;
 	mbuf_block->offset = 0;
+	mbuf_block->size_class = size_class;
 
 	_mbuf_block_mark_as_active(pool, mbuf_block);
 	return mbuf_block;
 }
 
 static struct mbuf_block *
-_mbuf_block_get(struct mbuf_pool *pool)
+_mbuf_block_get(struct mbuf_pool *pool, unsigned int size_class_index)
 {
+	struct mbuf_size_class *size_class = &pool->size_classes[size_class_index];
 	struct mbuf_block *mbuf_block;
 	char *buf;
 
-	if (!STAILQ_EMPTY(&pool->free_mbuf_blockq)) {
+	if (!STAILQ_EMPTY(&size_class->free_mbuf_blockq)) {
+		assert(size_class->nfree_mbuf_blockq > 0);
 		assert(pool->nfree_mbuf_blockq > 0);
 
-		mbuf_block = STAILQ_FIRST(&pool->free_mbuf_blockq);
+		mbuf_block = STAILQ_FIRST(&size_class->free_mbuf_blockq);
 		ASSERT_MBUF_BLOCK_PROPERTY(mbuf_block, mbuf_block->magic == MBUF_BLOCK_MAGIC);
 		ASSERT_MBUF_BLOCK_PROPERTY(mbuf_block, mbuf_block->refcount == 0);
+		ASSERT_MBUF_BLOCK_PROPERTY(mbuf_block, mbuf_block->size_class == size_class_index);
 
+		size_class->nfree_mbuf_blockq--;
 		pool->nfree_mbuf_blockq--;
-		STAILQ_REMOVE_HEAD(&pool->free_mbuf_blockq, next);
+		pool->nfree_bytes -= size_class->mbuf_block_chunk_size;
+		STAILQ_REMOVE_HEAD(&size_class->free_mbuf_blockq, next);
 		_mbuf_block_mark_as_active(pool, mbuf_block);
+		size_class->nactive_mbuf_blockq++;
 		return mbuf_block;
 	}
 
-	buf = (char *) malloc(pool->mbuf_block_chunk_size);
+	buf = (char *) malloc(size_class->mbuf_block_chunk_size);
 	if (OXT_UNLIKELY(buf == NULL)) {
 		return NULL;
 	}
 
-	return _mbuf_block_init(pool, buf, pool->mbuf_block_offset);
+	mbuf_block = _mbuf_block_init(pool, buf, size_class->mbuf_block_offset,
+		size_class_index);
+	size_class->nactive_mbuf_blockq++;
+	return mbuf_block;
 }
 
 struct mbuf_block *
 mbuf_block_get(struct mbuf_pool *pool)
+{
+	return mbuf_block_get_from_size_class(pool, MBUF_POOL_DEFAULT_SIZE_CLASS);
+}
+
+struct mbuf_block *
+mbuf_block_get_from_size_class(struct mbuf_pool *pool, unsigned int size_class)
 {
 	struct mbuf_block *mbuf_block;
+	size_t block_offset;
 	char *buf;
 
-	mbuf_block = _mbuf_block_get(pool);
+	assert(size_class < MBUF_POOL_SIZE_CLASSES);
+	mbuf_block = _mbuf_block_get(pool, size_class);
 	if (OXT_UNLIKELY(mbuf_block == NULL)) {
 		return NULL;
 	}
 
-	buf = (char *)mbuf_block - pool->mbuf_block_offset;
+	block_offset = pool->size_classes[size_class].mbuf_block_offset;
+	buf = (char *)mbuf_block - block_offset;
 	mbuf_block->start = buf;
-	mbuf_block->end = buf + pool->mbuf_block_offset;
+	mbuf_block->end = buf + block_offset;
 
 	ASSERT_MBUF_BLOCK_PROPERTY(mbuf_block,
-		mbuf_block->end - mbuf_block->start == (int) pool->mbuf_block_offset);
+		mbuf_block->end - mbuf_block->start == (int) block_offset);
 	ASSERT_MBUF_BLOCK_PROPERTY(mbuf_block, mbuf_block->start < mbuf_block->end);
 
 	#ifdef MBUF_DEBUG_REFCOUNTS
@@ -185,7 +206,7 @@ mbuf_block_new_standalone(struct mbuf_pool *pool, size_t size)
 		return NULL;
 	}
 
-	mbuf_block = _mbuf_block_init(pool, buf, block_offset);
+	mbuf_block = _mbuf_block_init(pool, buf, block_offset, 0);
 	mbuf_block->start = buf;
 	mbuf_block->end = buf + size;
 	mbuf_block->offset = block_offset;
@@ -224,7 +245,8 @@ mbuf_block_free(struct mbuf_block *mbuf_block)
 	if (mbuf_block->offset > 0) {
 		buf = (char *) mbuf_block - mbuf_block->offset;
 	} else {
-		buf = (char *) mbuf_block - mbuf_block->pool->mbuf_block_offset;
+		buf = (char *) mbuf_block - mbuf_block->pool->size_classes[
+			mbuf_block->size_class].mbuf_block_offset;
 	}
 	free(buf);
 }
@@ -232,6 +254,9 @@ mbuf_block_free(struct mbuf_block *mbuf_block)
 void
 mbuf_block_put(struct mbuf_block *mbuf_block)
 {
+	struct mbuf_pool *pool = mbuf_block->pool;
+	struct mbuf_size_class *size_class;
+
 	#ifdef MBUF_DEBUG_REFCOUNTS
 		printf("[%p] mbuf_block put %p\n", oxt::thread_signature, mbuf_block);
 	#endif
@@ -239,16 +264,32 @@ mbuf_block_put(struct mbuf_block *mbuf_block)
 	ASSERT_MBUF_BLOCK_PROPERTY(mbuf_block, STAILQ_NEXT(mbuf_block, next) == NULL);
 	ASSERT_MBUF_BLOCK_PROPERTY(mbuf_block, mbuf_block->magic == MBUF_BLOCK_MAGIC);
 	ASSERT_MBUF_BLOCK_PROPERTY(mbuf_block, mbuf_block->refcount == 0);
-	ASSERT_MBUF_BLOCK_PROPERTY(mbuf_block, mbuf_block->pool->nactive_mbuf_blockq > 0);
+	ASSERT_MBUF_BLOCK_PROPERTY(mbuf_block, pool->nactive_mbuf_blockq > 0);
 	ASSERT_MBUF_BLOCK_PROPERTY(mbuf_block, mbuf_block->offset == 0);
+	ASSERT_MBUF_BLOCK_PROPERTY(mbuf_block, mbuf_block->size_class < MBUF_POOL_SIZE_CLASSES);
 
-	mbuf_block->pool->nfree_mbuf_blockq++;
-	mbuf_block->pool->nactive_mbuf_blockq--;
-	STAILQ_INSERT_HEAD(&mbuf_block->pool->free_mbuf_blockq, mbuf_block, next);
+	size_class = &pool->size_classes[mbuf_block->size_class];
+	ASSERT_MBUF_BLOCK_PROPERTY(mbuf_block, size_class->nactive_mbuf_blockq > 0);
+
+	size_class->nfree_mbuf_blockq++;
+	size_class->nactive_mbuf_blockq--;
+	pool->nfree_mbuf_blockq++;
+	pool->nactive_mbuf_blockq--;
+	pool->nfree_bytes += size_class->mbuf_block_chunk_size;
+	STAILQ_INSERT_HEAD(&size_class->free_mbuf_blockq, mbuf_block, next);
 
 	#ifdef MBUF_ENABLE_DEBUGGING
-		TAILQ_REMOVE(&mbuf_block->pool->active_mbuf_blockq, mbuf_block, active_q);
+		TAILQ_REMOVE(&pool->active_mbuf_blockq, mbuf_block, active_q);
 	#endif
+
+	if (OXT_UNLIKELY(pool->spare_memory_high_watermark > 0
+	 && pool->nfree_bytes > pool->spare_memory_high_watermark))
+	{
+		// Compact to half the watermark so that we don't compact again
+		// on the very next put.
+		mbuf_pool_compact_to(pool, pool->spare_memory_high_watermark / 2);
+		pool->ncompactions++;
+	}
 }
 
 /*
@@ -271,15 +312,45 @@ _mbuf_block_assert_refcount_at_least_two(struct mbuf_block *mbuf_block) {
 void
 mbuf_pool_init(struct mbuf_pool *pool)
 {
+	unsigned int i;
+
 	pool->nfree_mbuf_blockq = 0;
 	pool->nactive_mbuf_blockq = 0;
-	STAILQ_INIT(&pool->free_mbuf_blockq);
+	pool->ncompactions = 0;
+	pool->nfree_bytes = 0;
+	pool->spare_memory_high_watermark = 0;
 
 	#ifdef MBUF_ENABLE_DEBUGGING
 		TAILQ_INIT(&pool->active_mbuf_blockq);
 	#endif
 
 	pool->mbuf_block_offset = pool->mbuf_block_chunk_size - MBUF_BLOCK_HSIZE;
+
+	/*
+	 * Each size class is 4 times as large as the previous one. The
+	 * default size class has the configured chunk size. Smaller size
+	 * classes are never smaller than MBUF_BLOCK_MIN_SIZE bytes of data,
+	 * nor larger than the default size class.
+	 */
+	for (i = 0; i < MBUF_POOL_SIZE_CLASSES; i++) {
+		struct mbuf_size_class *size_class = &pool->size_classes[i];
+		size_t chunk_size;
+
+		if (i < MBUF_POOL_DEFAULT_SIZE_CLASS) {
+			chunk_size = pool->mbuf_block_chunk_size >> (2 * (MBUF_POOL_DEFAULT_SIZE_CLASS - i));
+			chunk_size = std::max<size_t>(chunk_size, MBUF_BLOCK_MIN_SIZE + MBUF_BLOCK_HSIZE);
+			chunk_size = std::min<size_t>(chunk_size, pool->mbuf_block_chunk_size);
+		} else {
+			chunk_size = pool->mbuf_block_chunk_size << (2 * (i - MBUF_POOL_DEFAULT_SIZE_CLASS));
+			chunk_size = std::min<size_t>(chunk_size, MBUF_BLOCK_MAX_SIZE + MBUF_BLOCK_HSIZE);
+		}
+
+		size_class->nfree_mbuf_blockq = 0;
+		size_class->nactive_mbuf_blockq = 0;
+		STAILQ_INIT(&size_class->free_mbuf_blockq);
+		size_class->mbuf_block_chunk_size = chunk_size;
+		size_class->mbuf_block_offset = chunk_size - MBUF_BLOCK_HSIZE;
+	}
 }
 
 void
@@ -298,18 +369,68 @@ mbuf_pool_data_size(struct mbuf_pool *pool)
 	return pool->mbuf_block_offset;
 }
 
+/*
+ * Return the data size of mbuf_blocks in the given size class.
+ */
+size_t
+mbuf_pool_size_class_data_size(struct mbuf_pool *pool, unsigned int size_class)
+{
+	assert(size_class < MBUF_POOL_SIZE_CLASSES);
+	return pool->size_classes[size_class].mbuf_block_offset;
+}
+
+/*
+ * Return the smallest size class whose mbuf_blocks can contain `size` bytes
+ * of data, or MBUF_POOL_SIZE_CLASSES if there is no such size class.
+ */
 unsigned int
-mbuf_pool_compact(struct mbuf_pool *pool)
+mbuf_pool_size_class_for(struct mbuf_pool *pool, size_t size)
 {
-	unsigned int count = pool->nfree_mbuf_blockq;
+	unsigned int i;
 
-	while (!STAILQ_EMPTY(&pool->free_mbuf_blockq)) {
-		struct mbuf_block *mbuf_block = STAILQ_FIRST(&pool->free_mbuf_blockq);
-		mbuf_block_remove(&pool->free_mbuf_blockq, mbuf_block);
-		mbuf_block_free(mbuf_block);
-		pool->nfree_mbuf_blockq--;
+	for (i = 0; i < MBUF_POOL_SIZE_CLASSES; i++) {
+		if (size <= pool->size_classes[i].mbuf_block_offset) {
+			return i;
+		}
 	}
+	return MBUF_POOL_SIZE_CLASSES;
+}
+
+unsigned int
+mbuf_pool_compact(struct mbuf_pool *pool)
+{
+	unsigned int count = mbuf_pool_compact_to(pool, 0);
 	assert(pool->nfree_mbuf_blockq == 0);
+	assert(pool->nfree_bytes == 0);
+	return count;
+}
+
+/*
+ * Free free mbuf_blocks, largest size classes first, until the free
+ * mbuf_blocks hold at most `max_spare_memory` bytes. Returns the number
+ * of freed mbuf_blocks.
+ */
+unsigned int
+mbuf_pool_compact_to(struct mbuf_pool *pool, size_t max_spare_memory)
+{
+	unsigned int count = 0;
+	int i;
+
+	for (i = MBUF_POOL_SIZE_CLASSES - 1; i >= 0 && pool->nfree_bytes > max_spare_memory; i--) {
+		struct mbuf_size_class *size_class = &pool->size_classes[i];
+
+		while (!STAILQ_EMPTY(&size_class->free_mbuf_blockq)
+		 && pool->nfree_bytes > max_spare_memory)
+		{
+			struct mbuf_block *mbuf_block = STAILQ_FIRST(&size_class->free_mbuf_blockq);
+			mbuf_block_remove(&size_class->free_mbuf_blockq, mbuf_block);
+			mbuf_block_free(mbuf_block);
+			size_class->nfree_mbuf_blockq--;
+			pool->nfree_mbuf_blockq--;
+			pool->nfree_bytes -= size_class->mbuf_block_chunk_size;
+			count++;
+		}
+	}
 
 	return count;
 }
@@ -379,12 +500,25 @@ mbuf_get(struct mbuf_pool *pool)
 	return mbuf(block, 0, block->end - block->start, mbuf::just_created_t());
 }
 
+mbuf
+mbuf_get_from_size_class(struct mbuf_pool *pool, unsigned int size_class)
+{
+	struct mbuf_block *block = mbuf_block_get_from_size_class(pool, size_class);
+	if (OXT_UNLIKELY(block == NULL)) {
+		return mbuf();
+	}
+
+	ASSERT_MBUF_BLOCK_PROPERTY(block, block->refcount == 1);
+	return mbuf(block, 0, block->end - block->start, mbuf::just_created_t());
+}
+
 mbuf
 mbuf_get_with_size(struct mbuf_pool *pool, size_t size)
 {
 	struct mbuf_block *block;
-	if (size <= mbuf_pool_data_size(pool)) {
-		block = mbuf_block_get(pool);
+	unsigned int size_class = mbuf_pool_size_class_for(pool, size);
+	if (size_class < MBUF_POOL_SIZE_CLASSES) {
+		block = mbuf_block_get_from_size_class(pool, size_class);
 	} else {
 		block = mbuf_block_new_standalone(pool, size);
 	}
@@ -408,6 +542,7 @@ mbuf_block_print(struct mbuf_block *mbuf_block, std::ostream &stream)
 			mbuf_block->end - mbuf_block->start)) << "\"\n"
 		"mbuf_block.refcount: " << mbuf_block->refcount << "\n"
 		"mbuf_block.offset: " << mbuf_block->offset << "\n"
+		"mbuf_block.size_class: " << mbuf_block->size_class << "\n"
 		"mbuf_block.pool: " << (void *) mbuf_block->pool << "\n"
 		"mbuf_block.pool.nfree_mbuf_blockq: " << mbuf_block->pool->nfree_mbuf_blockq << "\n"
 		"mbuf_block.pool.nactive_mbuf_blockq: " << mbuf_block->pool->nactive_mbuf_blockq << "\n"
@@ -54,6 +54,15 @@
  * This approach is similar to how Node.js manages buffer slices.
  * We also got rid of the global variables, and put them in an mbuf_pool
  * struct, which acts like a context structure.
+ *
+ * Furthermore, an mbuf_pool manages multiple size classes of mbuf_blocks,
+ * each with its own freelist. The default size class has the configured
+ * chunk size (`mbuf_block_chunk_size`); the others are 4 times smaller,
+ * 4 times larger and 16 times larger. This allows readers to pick a block
+ * size that matches the amount of data that they expect to receive. When
+ * the amount of memory held by free mbuf_blocks exceeds
+ * `spare_memory_high_watermark`, the pool automatically frees blocks
+ * (largest size classes first) until it is back at half the watermark.
  */
 
 //#define MBUF_ENABLE_DEBUGGING
@@ -86,6 +95,7 @@ struct mbuf_block {
 	struct mbuf_pool  *pool;      /* containing pool (const) */
 	boost::uint32_t    refcount;  /* number of references by mbuf subsets */
 	boost::uint32_t    offset;    /* standalone mbuf_block data size */
+	boost::uint32_t    size_class; /* index into pool->size_classes (const) */
 };
 
 STAILQ_HEAD(mhdr, struct mbuf_block);
@@ -93,16 +103,35 @@ STAILQ_HEAD(mhdr, struct mbuf_block);
 	TAILQ_HEAD(active_mbuf_block_list, struct mbuf_block);
 #endif
 
-struct mbuf_pool {
+#define MBUF_POOL_SIZE_CLASSES       4
+#define MBUF_POOL_DEFAULT_SIZE_CLASS 1
+
+struct mbuf_size_class {
 	boost::uint32_t nfree_mbuf_blockq;   /* # free mbuf_block */
 	boost::uint32_t nactive_mbuf_blockq; /* # active (non-free) mbuf_block */
 	struct mhdr free_mbuf_blockq; /* free mbuf_block q */
+
+	size_t mbuf_block_chunk_size; /* mbuf_block chunk size - header + data (const) */
+	size_t mbuf_block_offset;     /* mbuf_block offset in chunk (const) */
+};
+
+struct mbuf_pool {
+	boost::uint32_t nfree_mbuf_blockq;   /* # free mbuf_block, all size classes */
+	boost::uint32_t nactive_mbuf_blockq; /* # active (non-free) mbuf_block, including standalone */
+	boost::uint32_t ncompactions;        /* # automatic compactions */
+	size_t nfree_bytes;                  /* memory held by free mbuf_blocks */
+	struct mbuf_size_class size_classes[MBUF_POOL_SIZE_CLASSES];
 	#ifdef MBUF_ENABLE_DEBUGGING
 		struct active_mbuf_block_list active_mbuf_blockq; /* active mbuf_block q */
 	#endif
 
-	size_t mbuf_block_chunk_size; /* mbuf_block chunk size - header + data (const) */
-	size_t mbuf_block_offset;     /* mbuf_block offset in chunk (const) */
+	size_t mbuf_block_chunk_size; /* default size class chunk size - header + data (const) */
+	size_t mbuf_block_offset;     /* default size class mbuf_block offset in chunk (const) */
+
+	/* Maximum amount of memory that free mbuf_blocks may hold before the
+	 * pool automatically compacts itself. 0 means unlimited. Set to 0 by
+	 * mbuf_pool_init(); may be changed afterwards. */
+	size_t spare_memory_high_watermark;
 };
 
 #define MBUF_BLOCK_MAGIC      0xdeadbeef
@@ -117,9 +146,14 @@ struct mbuf_pool {
 void mbuf_pool_init(struct mbuf_pool *pool);
 void mbuf_pool_deinit(struct mbuf_pool *pool);
 size_t mbuf_pool_data_size(struct mbuf_pool *pool);
+size_t mbuf_pool_size_class_data_size(struct mbuf_pool *pool, unsigned int size_class);
+unsigned int mbuf_pool_size_class_for(struct mbuf_pool *pool, size_t size);
 unsigned int mbuf_pool_compact(struct mbuf_pool *pool);
+unsigned int mbuf_pool_compact_to(struct mbuf_pool *pool, size_t max_spare_memory);
 
 struct mbuf_block *mbuf_block_get(struct mbuf_pool *pool);
+struct mbuf_block *mbuf_block_get_from_size_class(struct mbuf_pool *pool,
+	unsigned int size_class);
 void mbuf_block_put(struct mbuf_block *mbuf_block);
 
 void mbuf_block_ref(struct mbuf_block *mbuf_block);
@@ -279,6 +313,7 @@ public:
 
 mbuf mbuf_block_subset(struct mbuf_block *mbuf_block, unsigned int start, unsigned int len);
 mbuf mbuf_get(struct mbuf_pool *pool);
+mbuf mbuf_get_from_size_class(struct mbuf_pool *pool, unsigned int size_class);
 mbuf mbuf_get_with_size(struct mbuf_pool *pool, size_t size);
 
 
@@ -35,8 +35,10 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/function.hpp>
 #include <boost/bind.hpp>
+#include <boost/atomic.hpp>
 #include <oxt/thread.hpp>
 #include <LoggingKit/LoggingKit.h>
+#include <DataStructures/MpscQueue.h>
 
 namespace Passenger {
 
@@ -48,6 +50,25 @@ using namespace boost;
  * Class for thread-safely using libev.
  */
 class SafeLibev {
+public:
+	/**
+	 * A unit of work that can be handed to the event loop thread with
+	 * `runLater(Task *)`. Unlike `runLater(const Callback &)`, this
+	 * does not allocate and does not take a lock, so it is meant for
+	 * hot cross-thread hand-offs. The caller owns the Task object: it
+	 * must stay alive, and must not be passed to `runLater()` again,
+	 * until its callback has been called.
+	 */
+	struct Task: public MpscQueueNode {
+		void (*callback)(Task *task);
+		void *data;
+
+		Task()
+			: callback(NULL),
+			  data(NULL)
+			{ }
+	};
+
 private:
 	// 2^28-1. Command IDs are 28-bit so that we can pack DataSource's state and
 	// its planId in 32-bits total.
@@ -76,20 +97,42 @@ private:
 	vector<Command> commands;
 	unsigned int nextCommandId;
 
+	MpscQueue tasks;
+	// Whether an ev_async_send() for `tasks` is outstanding. Producers
+	// only wake up the event loop if nobody else has done so already,
+	// so that a burst of tasks results in a single wakeup.
+	boost::atomic<bool> tasksWakeupPending;
+
 	static void asyncHandler(EV_P_ ev_async *w, int revents) {
 		SafeLibev *self = (SafeLibev *) w->data;
+		self->runTasks();
 		self->runCommands();
 	}
 
+	void runTasks() {
+		// Reset the flag before draining the queue. A task that is pushed
+		// after this point either gets popped below, or its producer
+		// observes that the flag is unset and sends another wakeup.
+		if (!tasksWakeupPending.exchange(false, boost::memory_order_acq_rel)) {
+			return;
+		}
+
+		MpscQueueNode *node;
+		while ((node = tasks.pop()) != NULL) {
+			Task *task = static_cast<Task *>(node);
+			task->callback(task);
+		}
+	}
+
 	static void timeoutHandler(int revents, void *arg) {
 		boost::scoped_ptr<Callback> callback((Callback *) arg);
 		(*callback)();
 	}
 
 	void runCommands() {
+		vector<Command> commands;
 		boost::unique_lock<boost::mutex> l(syncher);
-		vector<Command> commands = this->commands;
-		this->commands.clear();
+		commands.swap(this->commands);
 		l.unlock();
 
 		vector<Command>::const_iterator it, end = commands.end();
@@ -134,7 +177,9 @@ private:
 
 public:
 	/** SafeLibev takes over ownership of the loop object. */
-	SafeLibev(struct ev_loop *loop) {
+	SafeLibev(struct ev_loop *loop)
+		: tasksWakeupPending(false)
+	{
 		this->loop = loop;
 		loopThread = pthread_self();
 		nextCommandId = 1;
@@ -275,6 +320,21 @@ public:
 		return result;
 	}
 
+	/**
+	 * Schedules `task->callback(task)` to be run on the event loop thread.
+	 * Thread-safe, lock-free and allocation-free. Tasks are run in the order
+	 * in which they were scheduled, and before any callbacks scheduled with
+	 * `runLater(const Callback &)` that are pending at the same time.
+	 * Tasks cannot be cancelled.
+	 */
+	void runLater(Task *task) {
+		assert(task->callback != NULL);
+		tasks.push(task);
+		if (!tasksWakeupPending.exchange(true, boost::memory_order_acq_rel)) {
+			ev_async_send(loop, &async);
+		}
+	}
+
 	/**
 	 * Cancels a callback that was scheduled to be run by runLater().
 	 * Returns whether the command has been successfully cancelled or not.
@@ -28,11 +28,16 @@
 
 #include <boost/bind.hpp>
 #include <boost/cstdint.hpp>
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include <oxt/thread.hpp>
 #include <oxt/macros.hpp>
 #include <vector>
 #include <cassert>
 #include <cerrno>
+#include <cstring>
 
 #include <sys/socket.h>
 #include <sys/un.h>
@@ -43,8 +48,11 @@
 
 #include <Constants.h>
 #include <LoggingKit/LoggingKit.h>
+#include <SafeLibev.h>
+#include <ServerKit/Errors.h>
 #include <Utils.h>
 #include <Utils/IOUtils.h>
+#include <Utils/ScopeGuard.h>
 
 namespace Passenger {
 namespace ServerKit {
@@ -84,6 +92,29 @@ class AcceptLoadBalancer {
 private:
 	static const unsigned int ACCEPT_BURST_COUNT = 16;
 
+	/**
+	 * Hands a batch of accepted clients to a single Server, through
+	 * SafeLibev's allocation-free task queue. There is one FeedTask per
+	 * Server. While the Server has not yet consumed a FeedTask, `busy`
+	 * is true and the load balancer does not touch it.
+	 */
+	struct FeedTask {
+		SafeLibev::Task task;
+		Server *server;
+		int fds[ACCEPT_BURST_COUNT];
+		unsigned int count;
+		boost::atomic<bool> busy;
+
+		FeedTask()
+			: server(NULL),
+			  count(0),
+			  busy(false)
+		{
+			task.callback = feedTaskCallback;
+			task.data = this;
+		}
+	};
+
 	int endpoints[SERVER_KIT_MAX_SERVER_ENDPOINTS];
 	struct pollfd pollers[1 + SERVER_KIT_MAX_SERVER_ENDPOINTS];
 	int newClients[ACCEPT_BURST_COUNT];
@@ -94,6 +125,20 @@ private:
 	bool accept4Available;
 	bool quit;
 
+	boost::scoped_array<FeedTask> feedTasks;
+
+	/**
+	 * Endpoint changes requested through `listen()` and `unlisten()` while
+	 * the load balancer thread is running. The thread applies them the
+	 * next time it wakes up; `exitPipe` is used to wake it up.
+	 */
+	boost::mutex endpointsSyncher;
+	boost::condition_variable endpointsChangedCond;
+	int pendingEndpoints[SERVER_KIT_MAX_SERVER_ENDPOINTS];
+	unsigned int nPendingEndpoints;
+	bool endpointsChanged;
+	bool threadExited;
+
 	int exitPipe[2];
 	oxt::thread *thread;
 
@@ -121,6 +166,67 @@ private:
 			|| e == EINTR;
 	}
 
+	/**
+	 * Called when `exitPipe` becomes readable. Applies pending endpoint
+	 * changes, and returns whether we've been asked to quit.
+	 */
+	bool processWakeups() {
+		char buf[32];
+		ssize_t ret;
+		bool quitRequested = false;
+
+		do {
+			ret = read(exitPipe[0], buf, sizeof(buf));
+			for (ssize_t i = 0; i < ret; i++) {
+				if (buf[i] == 'x') {
+					quitRequested = true;
+				}
+			}
+		} while (ret > 0);
+
+		applyPendingEndpoints();
+		return quitRequested;
+	}
+
+	void applyPendingEndpoints() {
+		boost::lock_guard<boost::mutex> l(endpointsSyncher);
+		if (endpointsChanged) {
+			memcpy(endpoints, pendingEndpoints, nPendingEndpoints * sizeof(int));
+			nEndpoints = nPendingEndpoints;
+			endpointsChanged = false;
+			endpointsChangedCond.notify_all();
+		}
+	}
+
+	/**
+	 * Replaces the set of endpoints. If the load balancer thread is running,
+	 * then this waits until the thread has picked up the change, so that
+	 * the caller may safely close removed endpoints afterwards.
+	 */
+	void changeEndpoints(boost::unique_lock<boost::mutex> &l,
+		const int *fds, unsigned int count)
+	{
+		if (thread == NULL || threadExited) {
+			memcpy(endpoints, fds, count * sizeof(int));
+			nEndpoints = count;
+			return;
+		}
+
+		memcpy(pendingEndpoints, fds, count * sizeof(int));
+		nPendingEndpoints = count;
+		endpointsChanged = true;
+		if (write(exitPipe[1], "e", 1) == -1) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				int e = errno;
+				P_WARN("Cannot write to the load balancer's exit pipe: " <<
+					strerror(e) << " (errno=" << e << ")");
+			}
+		}
+		while (endpointsChanged && !threadExited) {
+			endpointsChangedCond.wait(l);
+		}
+	}
+
 	bool acceptNewClients(int endpoint) {
 		bool error = false;
 		int fd, errcode = 0;
@@ -144,7 +250,7 @@ private:
 				"Stop accepting clients for 3 seconds.");
 			pollers[0].fd = exitPipe[0];
 			pollers[0].events = POLLIN;
-			if (poll(pollers, 1, 3000) == 1) {
+			if (poll(pollers, 1, 3000) == 1 && processWakeups()) {
 				quit = true;
 			} else {
 				P_NOTICE("Resuming accepting new clients");
@@ -159,14 +265,29 @@ private:
 		unsigned int i;
 
 		for (i = 0; i < newClientCount; i++) {
-			ServerKit::Context *ctx = servers[nextServer]->getContext();
+			FeedTask *feedTask = &feedTasks[nextServer];
 			P_TRACE(2, "Feeding client to server thread " << (int) nextServer <<
 				": file descriptor " << newClients[i]);
-			ctx->libev->runLater(boost::bind(feedNewClient, servers[nextServer],
-				newClients[i]));
+			if (OXT_LIKELY(!feedTask->busy.load(boost::memory_order_acquire))) {
+				feedTask->fds[feedTask->count] = newClients[i];
+				feedTask->count++;
+			} else {
+				// The server thread hasn't consumed the previous batch yet.
+				ServerKit::Context *ctx = servers[nextServer]->getContext();
+				ctx->libev->runLater(boost::bind(feedNewClient, servers[nextServer],
+					newClients[i]));
+			}
 			nextServer = (nextServer + 1) % servers.size();
 		}
 
+		for (i = 0; i < servers.size(); i++) {
+			FeedTask *feedTask = &feedTasks[i];
+			if (!feedTask->busy.load(boost::memory_order_acquire) && feedTask->count > 0) {
+				feedTask->busy.store(true, boost::memory_order_relaxed);
+				servers[i]->getContext()->libev->runLater(&feedTask->task);
+			}
+		}
+
 		newClientCount = 0;
 	}
 
@@ -174,6 +295,13 @@ private:
 		server->feedNewClients(&fd, 1);
 	}
 
+	static void feedTaskCallback(SafeLibev::Task *task) {
+		FeedTask *feedTask = static_cast<FeedTask *>(task->data);
+		feedTask->server->feedNewClients(feedTask->fds, feedTask->count);
+		feedTask->count = 0;
+		feedTask->busy.store(false, boost::memory_order_release);
+	}
+
 	int acceptNonBlockingSocket(int serverFd) {
 		union {
 			struct sockaddr_in inaddr;
@@ -218,12 +346,19 @@ private:
 	}
 
 	void mainLoop() {
+		ScopeGuard guard(boost::bind(&AcceptLoadBalancer<Server>::onThreadExit, this));
+
 		while (!quit) {
 			pollAllEndpoints();
 			if (OXT_UNLIKELY(pollers[0].revents & POLLIN)) {
-				// Exit pipe signaled.
-				quit = true;
-				break;
+				// Exit pipe signaled. This is either a request to quit,
+				// or to pick up endpoint changes.
+				if (processWakeups()) {
+					quit = true;
+					break;
+				} else {
+					continue;
+				}
 			}
 
 			unsigned int i = 0;
@@ -242,6 +377,12 @@ private:
 		}
 	}
 
+	void onThreadExit() {
+		boost::lock_guard<boost::mutex> l(endpointsSyncher);
+		threadExited = true;
+		endpointsChangedCond.notify_all();
+	}
+
 public:
 	vector<Server *> servers;
 
@@ -251,6 +392,9 @@ public:
 		  nextServer(0),
 		  accept4Available(true),
 		  quit(false),
+		  nPendingEndpoints(0),
+		  endpointsChanged(false),
+		  threadExited(false),
 		  thread(NULL)
 	{
 		if (pipe(exitPipe) == -1) {
@@ -294,18 +438,58 @@ public:
 			P_WARN("Cannot disable Nagle's algorithm on a TCP socket: " <<
 				strerror(e) << " (errno=" << e << ")");
 		}
-		endpoints[nEndpoints] = fd;
-		nEndpoints++;
+
+		boost::unique_lock<boost::mutex> l(endpointsSyncher);
+		int fds[SERVER_KIT_MAX_SERVER_ENDPOINTS];
+		memcpy(fds, endpoints, nEndpoints * sizeof(int));
+		fds[nEndpoints] = fd;
+		changeEndpoints(l, fds, nEndpoints + 1);
 
 		#undef EXTENSION_EOPNOTSUPP
 	}
 
+	/**
+	 * Stops accepting clients on the given server socket, which was earlier
+	 * passed to `listen()`. May be called while the load balancer is running;
+	 * once this method returns, the socket is no longer used and may be closed.
+	 *
+	 * Returns whether the socket was found.
+	 */
+	bool unlisten(int fd) {
+		boost::unique_lock<boost::mutex> l(endpointsSyncher);
+		int fds[SERVER_KIT_MAX_SERVER_ENDPOINTS];
+		unsigned int count = 0;
+
+		for (unsigned int i = 0; i < nEndpoints; i++) {
+			if (endpoints[i] != fd) {
+				fds[count] = endpoints[i];
+				count++;
+			}
+		}
+		if (count == nEndpoints) {
+			return false;
+		} else {
+			changeEndpoints(l, fds, count);
+			return true;
+		}
+	}
+
 	void start() {
+		feedTasks.reset(new FeedTask[servers.size()]);
+		for (unsigned int i = 0; i < servers.size(); i++) {
+			feedTasks[i].server = servers[i];
+		}
+
 		boost::function<void ()> func = boost::bind(&AcceptLoadBalancer<Server>::mainLoop, this);
 		thread = new oxt::thread(boost::bind(runAndPrintExceptions, func, true),
 			"Load balancer");
 	}
 
+	/** May only be called after `start()`. */
+	pthread_t getNativeHandle() const {
+		return thread->native_handle();
+	}
+
 	void shutdown() {
 		if (thread != NULL) {
 			if (write(exitPipe[1], "x", 1) == -1) {
@@ -0,0 +1,831 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2018 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_SERVER_KIT_ASYNC_HTTP_CLIENT_H_
+#define _PASSENGER_SERVER_KIT_ASYNC_HTTP_CLIENT_H_
+
+#include <boost/function.hpp>
+#include <boost/bind.hpp>
+#include <oxt/macros.hpp>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <ev.h>
+#include <jsoncpp/json.h>
+#include <ServerKit/Context.h>
+#include <ServerKit/http_parser.h>
+#include <DataStructures/StringKeyTable.h>
+#include <FileDescriptor.h>
+#include <LoggingKit/LoggingKit.h>
+#include <Exceptions.h>
+#include <StaticString.h>
+#include <Utils/IOUtils.h>
+#include <Utils/StrIntUtils.h>
+
+namespace Passenger {
+namespace ServerKit {
+
+using namespace std;
+
+
+/**
+ * An asynchronous HTTP/1.1 client that runs on a ServerKit Context's event
+ * loop. It is meant for agents talking to each other's API servers (e.g.
+ * the Watchdog talking to the Core), not for talking to arbitrary servers
+ * on the Internet: it does not support proxies, TLS, pipelining or
+ * 1xx responses, and it resolves TCP host names synchronously.
+ *
+ * Connections are kept alive after a response, and are reused by later
+ * requests to the same address. If a reused connection turns out to have
+ * been closed by the server before it sent any response data, then the
+ * request is retried once on a new connection.
+ *
+ * The response body is either buffered and passed to the callback in
+ * `Response::body`, or passed piece by piece to `Request::dataCallback`
+ * as it arrives, so that large responses can be streamed. Alternatively,
+ * with `Request::receiveFileDescriptor`, the server passes a file
+ * descriptor after the response headers instead of sending a body. It is
+ * received with the same negotiation protocol as
+ * `readFileDescriptorWithNegotiation()`, but without blocking.
+ *
+ * All methods, and all callbacks, are called on the event loop thread.
+ * Callbacks are never called from within `request()`. A callback may make
+ * new requests, but may not destroy the AsyncHttpClient. Requests that are
+ * still in progress when the AsyncHttpClient is destroyed fail with
+ * ERROR_IO; those callbacks are called from the destructor, and may not
+ * make new requests.
+ */
+class AsyncHttpClient {
+public:
+	static const int ERROR_INVALID_HEADER = -1;
+	static const int ERROR_INVALID_BODY = -2;
+	static const int ERROR_IO = -3;
+	static const int ERROR_TIMEOUT = -4;
+
+	struct Response {
+		/** The HTTP status code, or one of the ERROR_* constants. */
+		int status;
+		/** Header names are lowercased. */
+		StringKeyTable<string> headers;
+		/** Empty if the request has a `dataCallback`. */
+		string body;
+		/** If status < 0, a description of the error. */
+		string errorMessage;
+		/**
+		 * If the request has `receiveFileDescriptor` set and status is 200,
+		 * the file descriptor that the server passed.
+		 */
+		FileDescriptor fd;
+
+		Response()
+			: status(ERROR_IO)
+			{ }
+	};
+
+	typedef boost::function<void (const Response &resp)> Callback;
+	typedef boost::function<void (const StaticString &data)> DataCallback;
+
+	struct Request {
+		/** An address as accepted by `getSocketAddressType()`. */
+		string address;
+		http_method method;
+		string uri;
+		StringKeyTable<string> headers;
+		string body;
+		/**
+		 * Maximum time, in microseconds, that the request may take,
+		 * including connecting. 0 means no timeout.
+		 */
+		unsigned long long timeout;
+		/** Called when the request is done or has failed. */
+		Callback callback;
+		/** If set, called with each piece of response body data. */
+		DataCallback dataCallback;
+		/**
+		 * If true, and the response status is 200, the server passes a file
+		 * descriptor over the (Unix domain socket) connection after the
+		 * response headers, with `writeFileDescriptorWithNegotiation()`.
+		 * It is passed to the callback in `Response::fd`. The connection
+		 * is not reused afterwards.
+		 */
+		bool receiveFileDescriptor;
+
+		Request()
+			: method(HTTP_GET),
+			  timeout(60 * 1000000),
+			  receiveFileDescriptor(false)
+			{ }
+	};
+
+private:
+	enum ConnectionState {
+		CONNECTING,
+		WRITING,
+		READING,
+		// The states below are for receiving a file descriptor;
+		// see Request::receiveFileDescriptor.
+		WRITING_FD_REQUEST,
+		RECEIVING_FD,
+		WRITING_FD_ACK,
+		IDLE
+	};
+
+	struct Connection {
+		AsyncHttpClient *client;
+		ConnectionState state;
+		bool reused;
+		bool responseBegun;
+		bool responseComplete;
+		bool headersComplete;
+		bool parsingHeaderValue;
+		NConnect_State connectState;
+		ev_io watcher;
+		ev_timer timer;
+		http_parser parser;
+
+		Request req;
+		Response resp;
+		string outgoing;
+		string::size_type outgoingOffset;
+		string headerField, headerValue;
+
+		const FileDescriptor &fd() const {
+			if (connectState.type == SAT_UNIX) {
+				return connectState.s_unix.fd;
+			} else {
+				return connectState.s_tcp.fd;
+			}
+		}
+	};
+
+	typedef std::vector<Connection *> ConnectionList;
+	typedef std::map<string, ConnectionList> IdleConnectionMap;
+
+	Context *ctx;
+	std::set<Connection *> connections;
+	IdleConnectionMap idleConnections;
+	unsigned long totalRequests, totalConnectionsCreated, totalConnectionsReused;
+	char readBuffer[1024 * 16];
+
+
+	struct ev_loop *getLoop() const {
+		return ctx->libev->getLoop();
+	}
+
+	static const http_parser_settings *getParserSettings() {
+		static http_parser_settings settings;
+		static bool initialized = false;
+		if (OXT_UNLIKELY(!initialized)) {
+			memset(&settings, 0, sizeof(settings));
+			settings.on_message_begin = onMessageBegin;
+			settings.on_header_field = onHeaderField;
+			settings.on_header_value = onHeaderValue;
+			settings.on_headers_complete = onHeadersComplete;
+			settings.on_body = onBody;
+			settings.on_message_complete = onMessageComplete;
+			initialized = true;
+		}
+		return &settings;
+	}
+
+
+	/***** Connection management *****/
+
+	Connection *createConnection(const string &address) {
+		Connection *conn = new Connection();
+		bool connected;
+
+		conn->client = this;
+		conn->reused = false;
+		try {
+			setupNonBlockingSocket(conn->connectState, address, __FILE__, __LINE__);
+			connected = connectToServer(conn->connectState);
+		} catch (...) {
+			delete conn;
+			throw;
+		}
+		conn->state = connected ? WRITING : CONNECTING;
+		ev_io_init(&conn->watcher, onEvent, conn->fd(), EV_WRITE);
+		conn->watcher.data = conn;
+		ev_init(&conn->timer, onTimeout);
+		conn->timer.data = conn;
+		connections.insert(conn);
+		totalConnectionsCreated++;
+		return conn;
+	}
+
+	Connection *checkoutIdleConnection(const string &address) {
+		IdleConnectionMap::iterator it = idleConnections.find(address);
+		if (it == idleConnections.end() || it->second.empty()) {
+			return NULL;
+		}
+
+		Connection *conn = it->second.back();
+		it->second.pop_back();
+		P_ASSERT_EQ(conn->state, IDLE);
+		ev_io_stop(getLoop(), &conn->watcher);
+		conn->reused = true;
+		totalConnectionsReused++;
+		return conn;
+	}
+
+	void removeFromIdleList(Connection *conn) {
+		IdleConnectionMap::iterator it = idleConnections.find(conn->req.address);
+		if (it != idleConnections.end()) {
+			ConnectionList::iterator l_it;
+			for (l_it = it->second.begin(); l_it != it->second.end(); l_it++) {
+				if (*l_it == conn) {
+					it->second.erase(l_it);
+					break;
+				}
+			}
+		}
+	}
+
+	void destroyConnection(Connection *conn) {
+		ev_io_stop(getLoop(), &conn->watcher);
+		ev_timer_stop(getLoop(), &conn->timer);
+		connections.erase(conn);
+		delete conn;
+	}
+
+	/**
+	 * Puts a connection on which a response has been fully received
+	 * on the idle list. While idle, the connection is watched for
+	 * readability: that means the server closed it (or sent garbage),
+	 * so that we can get rid of it right away.
+	 */
+	void parkConnection(Connection *conn) {
+		ConnectionList &list = idleConnections[conn->req.address];
+		if (list.size() >= maxIdleConnectionsPerAddress) {
+			destroyConnection(conn);
+			return;
+		}
+
+		ev_timer_stop(getLoop(), &conn->timer);
+		conn->state = IDLE;
+		conn->req.callback = Callback();
+		conn->req.dataCallback = DataCallback();
+		conn->req.body.clear();
+		conn->resp = Response();
+		conn->outgoing.clear();
+		ev_io_stop(getLoop(), &conn->watcher);
+		ev_io_set(&conn->watcher, conn->fd(), EV_READ);
+		ev_io_start(getLoop(), &conn->watcher);
+		list.push_back(conn);
+	}
+
+
+	/***** Request processing *****/
+
+	void startRequest(Connection *conn, const Request &req) {
+		conn->req = req;
+		conn->resp = Response();
+		conn->responseBegun = false;
+		conn->responseComplete = false;
+		conn->headersComplete = false;
+		conn->parsingHeaderValue = false;
+		conn->headerField.clear();
+		conn->headerValue.clear();
+		http_parser_init(&conn->parser, HTTP_RESPONSE);
+		conn->parser.data = conn;
+		buildOutgoingData(conn);
+
+		if (req.timeout > 0) {
+			ev_timer_set(&conn->timer, req.timeout / 1000000.0, 0);
+			ev_timer_start(getLoop(), &conn->timer);
+		}
+
+		if (conn->state == IDLE) {
+			conn->state = WRITING;
+		}
+		// Wait until the socket is connected and/or writable.
+		ev_io_stop(getLoop(), &conn->watcher);
+		ev_io_set(&conn->watcher, conn->fd(), EV_WRITE);
+		ev_io_start(getLoop(), &conn->watcher);
+	}
+
+	void buildOutgoingData(Connection *conn) {
+		const Request &req = conn->req;
+		string &data = conn->outgoing;
+
+		data.clear();
+		data.reserve(256 + req.body.size());
+		data.append(http_method_str(req.method));
+		data.append(" ", 1);
+		data.append(req.uri);
+		data.append(" HTTP/1.1\r\n");
+
+		StringKeyTable<string>::ConstIterator it(req.headers);
+		while (*it != NULL) {
+			data.append(it.getKey().data(), it.getKey().size());
+			data.append(": ", 2);
+			data.append(it.getValue());
+			data.append("\r\n", 2);
+			it.next();
+		}
+		if (!req.headers.contains("Host") && !req.headers.contains("host")) {
+			appendHostHeader(conn, data);
+		}
+		if (!req.body.empty() || req.method == HTTP_POST || req.method == HTTP_PUT) {
+			data.append("Content-Length: ");
+			data.append(toString(req.body.size()));
+			data.append("\r\n", 2);
+		}
+		data.append("\r\n", 2);
+		data.append(req.body);
+		conn->outgoingOffset = 0;
+	}
+
+	/**
+	 * HTTP/1.1 requires a Host header. Unix domain sockets have no host name,
+	 * so we use "localhost" for them, like most HTTP clients do.
+	 */
+	static void appendHostHeader(const Connection *conn, string &data) {
+		data.append("Host: ");
+		if (conn->connectState.type == SAT_TCP) {
+			const NTCP_State &state = conn->connectState.s_tcp;
+			if (state.hostname.find(':') != string::npos) {
+				// IPv6 address
+				data.append("[", 1);
+				data.append(state.hostname);
+				data.append("]", 1);
+			} else {
+				data.append(state.hostname);
+			}
+			data.append(":", 1);
+			data.append(toString(state.port));
+		} else {
+			data.append("localhost");
+		}
+		data.append("\r\n", 2);
+	}
+
+	static void onEvent(EV_P_ ev_io *io, int revents) {
+		Connection *conn = static_cast<Connection *>(io->data);
+		AsyncHttpClient *self = conn->client;
+
+		switch (conn->state) {
+		case CONNECTING:
+			self->onConnectable(conn);
+			break;
+		case WRITING:
+			self->onWritable(conn);
+			break;
+		case READING:
+			self->onReadable(conn);
+			break;
+		case WRITING_FD_REQUEST:
+		case WRITING_FD_ACK:
+			self->onFdNegotiationWritable(conn);
+			break;
+		case RECEIVING_FD:
+			self->onFdReceivable(conn);
+			break;
+		case IDLE:
+			P_DEBUG("[AsyncHttpClient] Idle connection to " << conn->req.address
+				<< " closed by server");
+			self->removeFromIdleList(conn);
+			self->destroyConnection(conn);
+			break;
+		default:
+			P_BUG("Unknown connection state " << (int) conn->state);
+			break;
+		}
+	}
+
+	void onConnectable(Connection *conn) {
+		bool connected;
+
+		try {
+			connected = connectToServer(conn->connectState);
+		} catch (const SystemException &e) {
+			fail(conn, ERROR_IO, e.what());
+			return;
+		} catch (const RuntimeException &e) {
+			fail(conn, ERROR_IO, e.what());
+			return;
+		}
+
+		if (connected) {
+			conn->state = WRITING;
+			onWritable(conn);
+		}
+	}
+
+	/**
+	 * Writes as much of `conn->outgoing` as the socket accepts. Returns
+	 * whether all of it has been written. On error, the request is failed
+	 * and false is returned.
+	 */
+	bool writeOutgoing(Connection *conn, const char *errorMessage) {
+		ssize_t ret;
+
+		do {
+			ret = ::write(conn->fd(), conn->outgoing.data() + conn->outgoingOffset,
+				conn->outgoing.size() - conn->outgoingOffset);
+		} while (OXT_UNLIKELY(ret == -1 && errno == EINTR));
+
+		if (ret == -1) {
+			int e = errno;
+			if (e != EAGAIN && e != EWOULDBLOCK) {
+				failWithIoError(conn, errorMessage, e);
+			}
+			return false;
+		}
+
+		conn->outgoingOffset += ret;
+		if (conn->outgoingOffset == conn->outgoing.size()) {
+			conn->outgoing.clear();
+			return true;
+		} else {
+			return false;
+		}
+	}
+
+	void watchConnection(Connection *conn, int events) {
+		ev_io_stop(getLoop(), &conn->watcher);
+		ev_io_set(&conn->watcher, conn->fd(), events);
+		ev_io_start(getLoop(), &conn->watcher);
+	}
+
+	void onWritable(Connection *conn) {
+		if (writeOutgoing(conn, "Error writing request")) {
+			conn->state = READING;
+			watchConnection(conn, EV_READ);
+		}
+	}
+
+	void onReadable(Connection *conn) {
+		ssize_t ret;
+
+		do {
+			ret = ::read(conn->fd(), readBuffer, sizeof(readBuffer));
+		} while (OXT_UNLIKELY(ret == -1 && errno == EINTR));
+
+		if (ret > 0) {
+			feedParser(conn, readBuffer, ret);
+		} else if (ret == 0) {
+			// Let the parser know about EOF, which ends responses
+			// without a Content-Length or chunked encoding.
+			feedParser(conn, NULL, 0);
+		} else {
+			int e = errno;
+			if (e != EAGAIN && e != EWOULDBLOCK) {
+				failWithIoError(conn, "Error reading response", e);
+			}
+		}
+	}
+
+	void feedParser(Connection *conn, const char *data, size_t size) {
+		size_t ret = http_parser_execute(&conn->parser, getParserSettings(),
+			data, size);
+		http_errno err = HTTP_PARSER_ERRNO(&conn->parser);
+
+		if (conn->headersComplete) {
+			// The parser is paused in onHeadersComplete() and stopped
+			// at the last byte of the headers. The server only passes
+			// the file descriptor after we've asked for it, so it
+			// can't have sent anything else yet.
+			P_ASSERT_EQ(err, HPE_PAUSED);
+			P_ASSERT_EQ(data[ret], '\n');
+			if (ret + 1 < size) {
+				fail(conn, ERROR_INVALID_BODY,
+					"Unexpected data before file descriptor passing");
+			} else {
+				startReceivingFd(conn);
+			}
+		} else if (conn->responseComplete) {
+			// The parser is paused in onMessageComplete(). If the server
+			// sent more data than the response, then we can't reuse the
+			// connection.
+			bool keepAlive = http_should_keep_alive(&conn->parser)
+				&& ret == size;
+			finish(conn, keepAlive);
+		} else if (size == 0) {
+			failWithIoError(conn, "Connection closed before the response was complete", 0);
+		} else if (err != HPE_OK) {
+			string message = string("Error parsing response: ")
+				+ http_errno_description(err);
+			if (conn->resp.status > 0) {
+				fail(conn, ERROR_INVALID_BODY, message);
+			} else {
+				fail(conn, ERROR_INVALID_HEADER, message);
+			}
+		}
+	}
+
+	void finish(Connection *conn, bool keepAlive) {
+		Callback callback;
+		Response resp;
+
+		callback.swap(conn->req.callback);
+		std::swap(resp, conn->resp);
+		if (keepAlive) {
+			parkConnection(conn);
+		} else {
+			destroyConnection(conn);
+		}
+		if (callback) {
+			callback(resp);
+		}
+	}
+
+
+	/***** File descriptor passing *****/
+
+	static void setOutgoingArrayMessage(Connection *conn, const StaticString &item) {
+		// The format that readArrayMessage() expects.
+		boost::uint16_t header = htons(item.size() + 1);
+		conn->outgoing.assign((const char *) &header, sizeof(header));
+		conn->outgoing.append(item.data(), item.size());
+		conn->outgoing.append(1, '\0');
+		conn->outgoingOffset = 0;
+	}
+
+	void startReceivingFd(Connection *conn) {
+		conn->state = WRITING_FD_REQUEST;
+		setOutgoingArrayMessage(conn, P_STATIC_STRING("pass IO"));
+		watchConnection(conn, EV_WRITE);
+	}
+
+	void onFdNegotiationWritable(Connection *conn) {
+		if (!writeOutgoing(conn, "Error negotiating file descriptor passing")) {
+			return;
+		}
+		if (conn->state == WRITING_FD_REQUEST) {
+			conn->state = RECEIVING_FD;
+			watchConnection(conn, EV_READ);
+		} else {
+			finish(conn, false);
+		}
+	}
+
+	void onFdReceivable(Connection *conn) {
+		int fd;
+
+		try {
+			// The socket is non-blocking, so this doesn't block.
+			fd = readFileDescriptor(conn->fd());
+		} catch (const SystemException &e) {
+			if (e.code() != EAGAIN && e.code() != EWOULDBLOCK) {
+				fail(conn, ERROR_IO, e.what());
+			}
+			return;
+		} catch (const IOException &e) {
+			fail(conn, ERROR_INVALID_BODY, e.what());
+			return;
+		}
+
+		conn->resp.fd.assign(fd, __FILE__, __LINE__);
+		conn->state = WRITING_FD_ACK;
+		setOutgoingArrayMessage(conn, P_STATIC_STRING("got IO"));
+		watchConnection(conn, EV_WRITE);
+	}
+
+	void failWithIoError(Connection *conn, const char *message, int e) {
+		if (conn->reused && !conn->responseBegun) {
+			// The server probably closed the idle connection right before
+			// we sent the request. Try again on a new connection.
+			P_DEBUG("[AsyncHttpClient] Reused connection to " << conn->req.address
+				<< " was closed by the server; retrying on a new connection");
+			retry(conn);
+		} else if (e == 0) {
+			fail(conn, ERROR_IO, message);
+		} else {
+			fail(conn, ERROR_IO, string(message) + ": " + strerror(e)
+				+ " (errno=" + toString(e) + ")");
+		}
+	}
+
+	void retry(Connection *conn) {
+		Request req;
+		Connection *newConn;
+
+		std::swap(req, conn->req);
+		destroyConnection(conn);
+		try {
+			newConn = createConnection(req.address);
+		} catch (const oxt::tracable_exception &e) {
+			Response resp;
+			resp.status = ERROR_IO;
+			resp.errorMessage = e.what();
+			if (req.callback) {
+				req.callback(resp);
+			}
+			return;
+		}
+		startRequest(newConn, req);
+	}
+
+	void fail(Connection *conn, int status, const string &message) {
+		Callback callback;
+		Response resp;
+
+		callback.swap(conn->req.callback);
+		resp.status = status;
+		resp.errorMessage = message;
+		destroyConnection(conn);
+		if (callback) {
+			callback(resp);
+		}
+	}
+
+	static void onTimeout(EV_P_ ev_timer *timer, int revents) {
+		Connection *conn = static_cast<Connection *>(timer->data);
+		conn->client->fail(conn, ERROR_TIMEOUT, "Timeout");
+	}
+
+
+	/***** http_parser callbacks *****/
+
+	static int onMessageBegin(http_parser *parser) {
+		Connection *conn = static_cast<Connection *>(parser->data);
+		conn->responseBegun = true;
+		return 0;
+	}
+
+	static void insertCurrentHeader(Connection *conn) {
+		if (!conn->headerField.empty()) {
+			string key = conn->headerField;
+			convertLowerCase((const unsigned char *) key.data(),
+				(unsigned char *) &key[0], key.size());
+			conn->resp.headers.insert(key, conn->headerValue);
+		}
+		conn->headerField.clear();
+		conn->headerValue.clear();
+	}
+
+	static int onHeaderField(http_parser *parser, const char *data, size_t len) {
+		Connection *conn = static_cast<Connection *>(parser->data);
+		if (conn->parsingHeaderValue) {
+			insertCurrentHeader(conn);
+			conn->parsingHeaderValue = false;
+		}
+		conn->headerField.append(data, len);
+		return 0;
+	}
+
+	static int onHeaderValue(http_parser *parser, const char *data, size_t len) {
+		Connection *conn = static_cast<Connection *>(parser->data);
+		conn->parsingHeaderValue = true;
+		conn->headerValue.append(data, len);
+		return 0;
+	}
+
+	static int onHeadersComplete(http_parser *parser) {
+		Connection *conn = static_cast<Connection *>(parser->data);
+		insertCurrentHeader(conn);
+		conn->resp.status = parser->status_code;
+		if (conn->req.receiveFileDescriptor && parser->status_code == 200) {
+			conn->headersComplete = true;
+			http_parser_pause(parser, 1);
+			return 0;
+		}
+		// Responses to HEAD requests have no body.
+		return (conn->req.method == HTTP_HEAD) ? 1 : 0;
+	}
+
+	static int onBody(http_parser *parser, const char *data, size_t len) {
+		Connection *conn = static_cast<Connection *>(parser->data);
+		if (conn->req.dataCallback) {
+			conn->req.dataCallback(StaticString(data, len));
+		} else {
+			conn->resp.body.append(data, len);
+		}
+		return 0;
+	}
+
+	static int onMessageComplete(http_parser *parser) {
+		Connection *conn = static_cast<Connection *>(parser->data);
+		conn->responseComplete = true;
+		http_parser_pause(parser, 1);
+		return 0;
+	}
+
+public:
+	/** The maximum number of idle connections to keep per address. */
+	unsigned int maxIdleConnectionsPerAddress;
+
+	AsyncHttpClient(Context *context)
+		: ctx(context),
+		  totalRequests(0),
+		  totalConnectionsCreated(0),
+		  totalConnectionsReused(0),
+		  maxIdleConnectionsPerAddress(4)
+		{ }
+
+	~AsyncHttpClient() {
+		std::set<Connection *>::iterator it, end = connections.end();
+		std::vector<Callback> callbacks;
+
+		for (it = connections.begin(); it != end; it++) {
+			Connection *conn = *it;
+			ev_io_stop(getLoop(), &conn->watcher);
+			ev_timer_stop(getLoop(), &conn->timer);
+			if (conn->req.callback) {
+				callbacks.push_back(Callback());
+				callbacks.back().swap(conn->req.callback);
+			}
+			delete conn;
+		}
+		connections.clear();
+		idleConnections.clear();
+
+		if (!callbacks.empty()) {
+			Response resp;
+			resp.status = ERROR_IO;
+			resp.errorMessage = "The HTTP client was destroyed before the request was done";
+			std::vector<Callback>::iterator c_it;
+			for (c_it = callbacks.begin(); c_it != callbacks.end(); c_it++) {
+				(*c_it)(resp);
+			}
+		}
+	}
+
+	/**
+	 * Starts making the given request. `req.callback` is called, on
+	 * a later event loop iteration, when the request is done.
+	 */
+	void request(const Request &req) {
+		Connection *conn;
+
+		totalRequests++;
+		conn = checkoutIdleConnection(req.address);
+		if (conn == NULL) {
+			try {
+				conn = createConnection(req.address);
+			} catch (const oxt::tracable_exception &e) {
+				Response resp;
+				resp.status = ERROR_IO;
+				resp.errorMessage = e.what();
+				if (req.callback) {
+					ctx->libev->runLater(boost::bind(req.callback, resp));
+				}
+				return;
+			}
+		}
+		startRequest(conn, req);
+	}
+
+	/** Closes all idle connections. */
+	void closeIdleConnections() {
+		IdleConnectionMap::iterator it, end = idleConnections.end();
+		for (it = idleConnections.begin(); it != end; it++) {
+			ConnectionList::iterator l_it;
+			for (l_it = it->second.begin(); l_it != it->second.end(); l_it++) {
+				destroyConnection(*l_it);
+			}
+		}
+		idleConnections.clear();
+	}
+
+	Json::Value inspectStateAsJson() const {
+		Json::Value doc;
+		unsigned int idle = 0;
+		IdleConnectionMap::const_iterator it, end = idleConnections.end();
+
+		for (it = idleConnections.begin(); it != end; it++) {
+			idle += it->second.size();
+		}
+		doc["connection_count"] = (Json::UInt) connections.size();
+		doc["idle_connection_count"] = idle;
+		doc["total_requests"] = (Json::UInt64) totalRequests;
+		doc["total_connections_created"] = (Json::UInt64) totalConnectionsCreated;
+		doc["total_connections_reused"] = (Json::UInt64) totalConnectionsReused;
+		return doc;
+	}
+};
+
+
+} // namespace ServerKit
+} // namespace Passenger
+
+#endif /* _PASSENGER_SERVER_KIT_ASYNC_HTTP_CLIENT_H_ */
@@ -56,9 +56,13 @@ using namespace std;
  *   file_buffered_channel_auto_truncate_file             boolean            -   default(true)
  *   file_buffered_channel_buffer_dir                     string             -   default
  *   file_buffered_channel_delay_in_file_mode_switching   unsigned integer   -   default(0)
+ *   file_buffered_channel_io_uring                       boolean            -   default(false),read_only
+ *   file_buffered_channel_io_uring_entries               unsigned integer   -   default(64),read_only
  *   file_buffered_channel_max_disk_chunk_read_size       unsigned integer   -   default(0)
+ *   file_buffered_channel_max_disk_chunk_write_size      unsigned integer   -   default(0)
  *   file_buffered_channel_threshold                      unsigned integer   -   default(131072)
  *   mbuf_block_chunk_size                                unsigned integer   -   default(4096),read_only
+ *   mbuf_spare_memory_high_watermark                     unsigned integer   -   default(8388608)
  *   secure_mode_password                                 string             -   secret
  *
  * END
@@ -88,12 +92,18 @@ public:
 			DEFAULT_FILE_BUFFERED_CHANNEL_THRESHOLD);
 		add("file_buffered_channel_delay_in_file_mode_switching", UINT_TYPE, OPTIONAL, 0);
 		add("file_buffered_channel_max_disk_chunk_read_size", UINT_TYPE, OPTIONAL, 0);
+		add("file_buffered_channel_max_disk_chunk_write_size", UINT_TYPE, OPTIONAL, 0);
 		add("file_buffered_channel_auto_truncate_file", BOOL_TYPE, OPTIONAL, true);
+		add("file_buffered_channel_io_uring", BOOL_TYPE, OPTIONAL | READ_ONLY, false);
+		add("file_buffered_channel_io_uring_entries", UINT_TYPE, OPTIONAL | READ_ONLY,
+			DEFAULT_FILE_BUFFERED_CHANNEL_IO_URING_ENTRIES);
 		// For unit testing purposes
 		add("file_buffered_channel_auto_start_mover", BOOL_TYPE, OPTIONAL, true);
 
 		add("mbuf_block_chunk_size", UINT_TYPE, OPTIONAL | READ_ONLY,
 			DEFAULT_MBUF_CHUNK_SIZE);
+		add("mbuf_spare_memory_high_watermark", UINT_TYPE, OPTIONAL,
+			DEFAULT_MBUF_SPARE_MEMORY_HIGH_WATERMARK);
 		add("secure_mode_password", STRING_TYPE, OPTIONAL | SECRET);
 
 		addNormalizer(normalize);
@@ -107,6 +117,7 @@ struct FileBufferedChannelConfig {
 	unsigned int threshold;
 	unsigned int delayInFileModeSwitching;
 	unsigned int maxDiskChunkReadSize;
+	unsigned int maxDiskChunkWriteSize;
 	bool autoTruncateFile;
 	bool autoStartMover;
 
@@ -115,6 +126,7 @@ struct FileBufferedChannelConfig {
 		  threshold(config["file_buffered_channel_threshold"].asUInt()),
 		  delayInFileModeSwitching(config["file_buffered_channel_delay_in_file_mode_switching"].asUInt()),
 		  maxDiskChunkReadSize(config["file_buffered_channel_max_disk_chunk_read_size"].asUInt()),
+		  maxDiskChunkWriteSize(config["file_buffered_channel_max_disk_chunk_write_size"].asUInt()),
 		  autoTruncateFile(config["file_buffered_channel_auto_truncate_file"].asBool()),
 		  autoStartMover(config["file_buffered_channel_auto_start_mover"].asBool())
 		{ }
@@ -124,6 +136,7 @@ struct FileBufferedChannelConfig {
 		std::swap(threshold, other.threshold);
 		std::swap(delayInFileModeSwitching, other.delayInFileModeSwitching);
 		std::swap(maxDiskChunkReadSize, other.maxDiskChunkReadSize);
+		std::swap(maxDiskChunkWriteSize, other.maxDiskChunkWriteSize);
 		std::swap(autoTruncateFile, other.autoTruncateFile);
 		std::swap(autoStartMover, other.autoStartMover);
 	}
@@ -30,6 +30,7 @@
 #include <boost/config.hpp>
 
 #include <ServerKit/Config.h>
+#include <ServerKit/IoUring.h>
 #include <ConfigKit/ConfigKit.h>
 #include <MemoryKit/mbuf.h>
 #include <LoggingKit/Assert.h>
@@ -62,15 +63,29 @@ public:
 	// Others
 	Config config;
 	struct MemoryKit::mbuf_pool mbuf_pool;
+	#ifdef PASSENGER_SUPPORTS_IO_URING
+		/**
+		 * Used by FileBufferedChannel for buffer file I/O instead of libuv.
+		 * NULL unless `file_buffered_channel_io_uring` is enabled and the
+		 * kernel supports it.
+		 */
+		IoUring *ioUring;
+	#endif
 
 	Context(const Schema &schema, const Json::Value &initialConfig = Json::Value(),
 		const ConfigKit::Translator &translator = ConfigKit::DummyTranslator())
 		: configStore(schema, initialConfig, translator),
 		  libuv(NULL),
 		  config(configStore)
+		  #ifdef PASSENGER_SUPPORTS_IO_URING
+		  , ioUring(NULL)
+		  #endif
 		{ }
 
 	~Context() {
+		#ifdef PASSENGER_SUPPORTS_IO_URING
+			delete ioUring;
+		#endif
 		MemoryKit::mbuf_pool_deinit(&mbuf_pool);
 	}
 
@@ -84,6 +99,23 @@ public:
 
 		mbuf_pool.mbuf_block_chunk_size = configStore["mbuf_block_chunk_size"].asUInt();
 		MemoryKit::mbuf_pool_init(&mbuf_pool);
+		mbuf_pool.spare_memory_high_watermark =
+			configStore["mbuf_spare_memory_high_watermark"].asUInt();
+
+		if (configStore["file_buffered_channel_io_uring"].asBool()) {
+			#ifdef PASSENGER_SUPPORTS_IO_URING
+				try {
+					ioUring = new IoUring(libev->getLoop(),
+						configStore["file_buffered_channel_io_uring_entries"].asUInt());
+				} catch (const SystemException &e) {
+					P_WARN("Cannot use io_uring for buffer file I/O, "
+						"falling back to libuv: " << e.what());
+				}
+			#else
+				P_WARN("io_uring is not supported on this platform, "
+					"using libuv for buffer file I/O");
+			#endif
+		}
 	}
 
 	bool configure(const Json::Value &updates, vector<ConfigKit::Error> &errors) {
@@ -108,6 +140,8 @@ public:
 	void commitConfigChange(ConfigChangeRequest &req) BOOST_NOEXCEPT_OR_NOTHROW {
 		configStore.swap(*req.configStore);
 		config.swap(*req.config);
+		mbuf_pool.spare_memory_high_watermark =
+			configStore["mbuf_spare_memory_high_watermark"].asUInt();
 	}
 
 	Json::Value inspectConfig() const {
@@ -117,15 +151,37 @@ public:
 	Json::Value inspectStateAsJson() const {
 		Json::Value doc;
 		Json::Value mbufDoc;
+		Json::Value sizeClassesDoc(Json::arrayValue);
+		size_t activeMemory = 0;
+
+		for (unsigned int i = 0; i < MBUF_POOL_SIZE_CLASSES; i++) {
+			const struct MemoryKit::mbuf_size_class &sizeClass = mbuf_pool.size_classes[i];
+			Json::Value sizeClassDoc;
+
+			sizeClassDoc["chunk_size"] = (Json::UInt) sizeClass.mbuf_block_chunk_size;
+			sizeClassDoc["offset"] = (Json::UInt) sizeClass.mbuf_block_offset;
+			sizeClassDoc["free_blocks"] = (Json::UInt) sizeClass.nfree_mbuf_blockq;
+			sizeClassDoc["active_blocks"] = (Json::UInt) sizeClass.nactive_mbuf_blockq;
+			sizeClassDoc["spare_memory"] = byteSizeToJson(sizeClass.nfree_mbuf_blockq
+				* sizeClass.mbuf_block_chunk_size);
+			sizeClassDoc["active_memory"] = byteSizeToJson(sizeClass.nactive_mbuf_blockq
+				* sizeClass.mbuf_block_chunk_size);
+			sizeClassesDoc.append(sizeClassDoc);
+
+			activeMemory += sizeClass.nactive_mbuf_blockq * sizeClass.mbuf_block_chunk_size;
+		}
 
 		mbufDoc["free_blocks"] = (Json::UInt) mbuf_pool.nfree_mbuf_blockq;
 		mbufDoc["active_blocks"] = (Json::UInt) mbuf_pool.nactive_mbuf_blockq;
 		mbufDoc["chunk_size"] = (Json::UInt) mbuf_pool.mbuf_block_chunk_size;
 		mbufDoc["offset"] = (Json::UInt) mbuf_pool.mbuf_block_offset;
-		mbufDoc["spare_memory"] = byteSizeToJson(mbuf_pool.nfree_mbuf_blockq
-			* mbuf_pool.mbuf_block_chunk_size);
-		mbufDoc["active_memory"] = byteSizeToJson(mbuf_pool.nactive_mbuf_blockq
-			* mbuf_pool.mbuf_block_chunk_size);
+		mbufDoc["spare_memory"] = byteSizeToJson(mbuf_pool.nfree_bytes);
+		// Excludes standalone blocks, whose sizes we don't keep track of.
+		mbufDoc["active_memory"] = byteSizeToJson(activeMemory);
+		mbufDoc["spare_memory_high_watermark"] = byteSizeToJson(
+			mbuf_pool.spare_memory_high_watermark);
+		mbufDoc["automatic_compactions"] = (Json::UInt) mbuf_pool.ncompactions;
+		mbufDoc["size_classes"] = sizeClassesDoc;
 		#ifdef MBUF_ENABLE_DEBUGGING
 			struct MemoryKit::active_mbuf_block_list *list =
 				const_cast<struct MemoryKit::active_mbuf_block_list *>(
@@ -148,6 +204,11 @@ public:
 		#endif
 
 		doc["mbuf_pool"] = mbufDoc;
+		#ifdef PASSENGER_SUPPORTS_IO_URING
+			if (ioUring != NULL) {
+				doc["io_uring"] = ioUring->inspectStateAsJson();
+			}
+		#endif
 
 		return doc;
 	}
@@ -27,7 +27,12 @@
 #define _PASSENGER_SERVER_KIT_FD_SINK_CHANNEL_H_
 
 #include <oxt/macros.hpp>
+#include <boost/move/move.hpp>
+#include <algorithm>
 #include <cerrno>
+#include <cstring>
+#include <climits>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <ev.h>
 #include <jsoncpp/json.h>
@@ -148,6 +153,82 @@ public:
 		return Channel::feedWithoutRefGuard(mbuf);
 	}
 
+	/**
+	 * Writes the given buffers to the file descriptor with writev(),
+	 * without first gathering them into a single buffer. Only the part
+	 * that could not be written immediately is copied into an mbuf, which
+	 * is then fed to the channel as if by `feedWithoutRefGuard()`, so that
+	 * it is written once the file descriptor becomes writable. The buffers
+	 * may be freed as soon as this method returns.
+	 *
+	 * If writing fails, then the error is fed to the channel, and
+	 * `hasError()` will return true.
+	 *
+	 * @pre acceptingInput()
+	 */
+	void feedvWithoutRefGuard(const struct iovec *buffers, unsigned int count) {
+		size_t totalSize = 0;
+		size_t written = 0;
+		unsigned int i;
+
+		for (i = 0; i < count; i++) {
+			totalSize += buffers[i].iov_len;
+		}
+
+		i = 0;
+		while (i < count) {
+			unsigned int n = std::min<unsigned int>(count - i, IOV_MAX);
+			size_t chunkSize = 0;
+			ssize_t ret;
+
+			for (unsigned int j = i; j < i + n; j++) {
+				chunkSize += buffers[j].iov_len;
+			}
+			do {
+				ret = ::writev(watcher.fd, buffers + i, n);
+			} while (ret == -1 && errno == EINTR);
+
+			if (ret == -1) {
+				if (errno == EAGAIN || errno == EWOULDBLOCK) {
+					break;
+				} else {
+					Channel::feedError(errno);
+					return;
+				}
+			}
+			written += ret;
+			if ((size_t) ret < chunkSize) {
+				break;
+			}
+			i += n;
+		}
+
+		if (written == totalSize) {
+			return;
+		}
+
+		MemoryKit::mbuf remainder(MemoryKit::mbuf_get_with_size(&ctx->mbuf_pool,
+			totalSize - written));
+		if (OXT_UNLIKELY(remainder.empty())) {
+			Channel::feedError(ENOMEM);
+			return;
+		}
+		char *pos = remainder.start;
+		size_t skip = written;
+		for (i = 0; i < count; i++) {
+			const char *data = (const char *) buffers[i].iov_base;
+			size_t size = buffers[i].iov_len;
+			if (skip >= size) {
+				skip -= size;
+				continue;
+			}
+			memcpy(pos, data + skip, size - skip);
+			pos += size - skip;
+			skip = 0;
+		}
+		Channel::feedWithoutRefGuard(boost::move(remainder));
+	}
+
 	OXT_FORCE_INLINE
 	void feedError(int errcode) {
 		return Channel::feedError(errcode);
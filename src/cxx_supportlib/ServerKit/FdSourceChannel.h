@@ -28,6 +28,7 @@
 
 #include <oxt/macros.hpp>
 #include <boost/move/move.hpp>
+#include <boost/cstdint.hpp>
 #include <sys/types.h>
 #include <unistd.h>
 #include <ev.h>
@@ -46,6 +47,15 @@ class FdSourceChannel: protected Channel {
 private:
 	ev_io watcher;
 	MemoryKit::mbuf buffer;
+	/**
+	 * The mbuf size class to read into. It adapts to the sizes of
+	 * recent reads: it grows when a read fills an entire block, and
+	 * shrinks when a read would have fit in a block of the next smaller
+	 * size class. This way, a connection that only sends small requests
+	 * doesn't hold on to large blocks, while large transfers need fewer
+	 * read() calls.
+	 */
+	boost::uint8_t readSizeClass;
 
 	static void _onReadable(EV_P_ ev_io *io, int revents) {
 		static_cast<FdSourceChannel *>(io->data)->onReadable(io, revents);
@@ -72,8 +82,10 @@ private:
 		}
 
 		for (i = 0; i < burstReadCount && !done; i++) {
-			if (buffer.empty()) {
-				buffer = MemoryKit::mbuf_get(&ctx->mbuf_pool);
+			bool freshBuffer = buffer.empty();
+			if (freshBuffer) {
+				buffer = MemoryKit::mbuf_get_from_size_class(&ctx->mbuf_pool,
+					readSizeClass);
 			}
 
 			origBufferSize = buffer.size();
@@ -81,6 +93,9 @@ private:
 				ret = ::read(watcher.fd, buffer.start, buffer.size());
 			} while (OXT_UNLIKELY(ret == -1 && errno == EINTR));
 			if (ret > 0) {
+				if (freshBuffer) {
+					adaptReadSizeClass(ret, origBufferSize);
+				}
 				MemoryKit::mbuf buffer2(buffer, 0, ret);
 				if (size_t(ret) == size_t(buffer.size())) {
 					// Unref mbuf_block
@@ -125,6 +140,19 @@ private:
 		}
 	}
 
+	void adaptReadSizeClass(size_t readSize, size_t bufferSize) {
+		if (readSize == bufferSize) {
+			if (readSizeClass < MBUF_POOL_SIZE_CLASSES - 1) {
+				readSizeClass++;
+			}
+		} else if (readSizeClass > 0
+			&& readSize <= MemoryKit::mbuf_pool_size_class_data_size(
+				&ctx->mbuf_pool, readSizeClass - 1))
+		{
+			readSizeClass--;
+		}
+	}
+
 	static void onChannelConsumed(Channel *channel, unsigned int size) {
 		FdSourceChannel *self = static_cast<FdSourceChannel *>(channel);
 		self->consumedCallback = NULL;
@@ -135,6 +163,7 @@ private:
 
 	void initialize() {
 		burstReadCount = 1;
+		readSizeClass = MBUF_POOL_DEFAULT_SIZE_CLASS;
 		watcher.active = false;
 		watcher.fd = -1;
 		watcher.data = this;
@@ -167,6 +196,7 @@ public:
 
 	void reinitialize(int fd) {
 		Channel::reinitialize();
+		readSizeClass = MBUF_POOL_DEFAULT_SIZE_CLASS;
 		ev_io_init(&watcher, _onReadable, fd, EV_READ);
 	}
 
@@ -207,6 +237,17 @@ public:
 		Channel::consumed(size, end);
 	}
 
+	/**
+	 * Drops the unused remainder of the read buffer, so that an idle
+	 * channel does not keep an mbuf block alive. The next read will
+	 * obtain a new buffer. Data that has already been read, but not
+	 * yet consumed, is not affected.
+	 */
+	OXT_FORCE_INLINE
+	void releaseReadBuffer() {
+		buffer = MemoryKit::mbuf();
+	}
+
 	OXT_FORCE_INLINE
 	int getFd() const {
 		return watcher.fd;
@@ -241,6 +282,7 @@ public:
 		Json::Value doc = Channel::inspectAsJson();
 		doc["initialized"] = watcher.fd != -1;
 		doc["io_watcher_active"] = (bool) watcher.active;
+		doc["read_size_class"] = (Json::UInt) readSizeClass;
 		return doc;
 	}
 };
@@ -44,6 +44,7 @@
 #include <LoggingKit/LoggingKit.h>
 #include <ServerKit/Context.h>
 #include <ServerKit/Config.h>
+#include <ServerKit/IoUring.h>
 #include <ServerKit/Errors.h>
 #include <ServerKit/Channel.h>
 #include <Utils/JsonUtils.h>
@@ -206,8 +207,10 @@ public:
 
 private:
 	/**
-	 * A structure containing the details of a libuv asynchronous
-	 * filesystem I/O request.
+	 * A structure containing the details of an asynchronous filesystem
+	 * I/O request. The request is performed through the Context's io_uring
+	 * instance if there is one, otherwise through libuv. Either way, the
+	 * callback receives `req`, with `req.result` set.
 	 *
 	 * The I/O callback is responsible for destroying its corresponding
 	 * FileIOContext object.
@@ -238,6 +241,11 @@ private:
 		uv_loop_t *libuv;
 		/* req.data always refers back to the FileIOContext object itself. */
 		uv_fs_t req;
+		#ifdef PASSENGER_SUPPORTS_IO_URING
+			IoUringOperation uringOp;
+			uv_fs_cb uringCallback;
+			bool usingIoUring;
+		#endif
 
 		/**
 		 * Also a pointer to the FileBufferedChannel, but this is used for
@@ -253,9 +261,19 @@ private:
 			  libuv(_self->ctx->libuv),
 			  logbase(_self)
 		{
+			// Callbacks call uv_fs_req_cleanup() even on requests that
+			// weren't performed by libuv, which is safe on a zeroed request.
+			memset(&req, 0, sizeof(req));
 			req.type = UV_UNKNOWN_REQ;
 			req.result = -1;
 			req.data = this;
+			#ifdef PASSENGER_SUPPORTS_IO_URING
+				uringOp.callback = uringOperationDone;
+				uringOp.userData = this;
+				uringOp.result = -1;
+				uringCallback = NULL;
+				usingIoUring = false;
+			#endif
 		}
 
 		virtual ~FileIOContext() { }
@@ -265,7 +283,16 @@ private:
 				// uv_cancel() fails if the work is already in progress
 				// or completed, so we set self to NULL as an extra
 				// indicator that this I/O operation is canceled.
-				uv_cancel((uv_req_t *) &req);
+				// Individual io_uring operations are not canceled; their
+				// callbacks only see the NULL backpointer. Destroying the
+				// IoUring cancels and waits for everything still in flight.
+				#ifdef PASSENGER_SUPPORTS_IO_URING
+					if (!usingIoUring) {
+						uv_cancel((uv_req_t *) &req);
+					}
+				#else
+					uv_cancel((uv_req_t *) &req);
+				#endif
 				self = NULL;
 			}
 		}
@@ -281,6 +308,14 @@ private:
 		bool isCanceled() const {
 			return self == NULL || req.result == UV_ECANCELED;
 		}
+
+		#ifdef PASSENGER_SUPPORTS_IO_URING
+			static void uringOperationDone(IoUringOperation *op) {
+				FileIOContext *context = static_cast<FileIOContext *>(op->userData);
+				context->req.result = op->result;
+				context->uringCallback(&context->req);
+			}
+		#endif
 	};
 
 	struct ReadContext;
@@ -737,9 +772,14 @@ private:
 		readerState = RS_READING_FROM_FILE;
 		inFileMode->readRequest = readContext;
 
-		uv_fs_read(ctx->libuv, &readContext->req, inFileMode->fd,
-			&readContext->uvBuffer, 1, inFileMode->readOffset,
+		int result = fsRead(readContext, inFileMode->fd,
+			readContext->uvBuffer, inFileMode->readOffset,
 			_nextChunkDoneReading);
+		if (result != 0) {
+			readContext->req.result = result;
+			ctx->libev->runLater(boost::bind(_nextChunkDoneReading,
+				&readContext->req));
+		}
 		verifyInvariants();
 	}
 
@@ -864,31 +904,48 @@ private:
 	/***** File creator *****/
 
 	struct FileCreationContext: public FileIOContext {
+		/**
+		 * The path of the buffer file, or of the buffer directory if
+		 * `anonymous` is true.
+		 */
 		string path;
+		/**
+		 * Whether the file is created with O_TMPFILE. Such a file has
+		 * no name, so it doesn't need to be unlinked.
+		 */
+		bool anonymous;
 
 		FileCreationContext(FileBufferedChannel *self)
-			: FileIOContext(self)
+			: FileIOContext(self),
+			  anonymous(false)
 			{ }
 	};
 
-	void createBufferFile() {
+	void createBufferFile(bool allowAnonymous = true) {
 		P_ASSERT_EQ(mode, IN_FILE_MODE);
 		P_ASSERT_EQ(inFileMode->writerState, WS_INACTIVE);
 		P_ASSERT_EQ(inFileMode->fd, -1);
 
 		FileCreationContext *fcContext = new FileCreationContext(this);
 		fcContext->path = config->bufferDir;
-		fcContext->path.append("/buffer.");
-		fcContext->path.append(toString(rand()));
+		#if defined(PASSENGER_SUPPORTS_IO_URING) && defined(O_TMPFILE)
+			// Only done through io_uring, which requires a kernel that is
+			// recent enough to support O_TMPFILE. The file system may
+			// still not support it though, in which case we fall back
+			// to a named file.
+			fcContext->anonymous = allowAnonymous && ctx->ioUring != NULL;
+		#endif
+		if (!fcContext->anonymous) {
+			fcContext->path.append("/buffer.");
+			fcContext->path.append(toString(rand()));
+		}
 
 		inFileMode->writerState = WS_CREATING_FILE;
 		inFileMode->writerRequest = fcContext;
 
 		if (config->delayInFileModeSwitching == 0) {
 			FBC_DEBUG("Writer: creating file " << fcContext->path);
-			int result = uv_fs_open(ctx->libuv, &fcContext->req,
-				fcContext->path.c_str(), O_RDWR | O_CREAT | O_EXCL,
-				0600, _bufferFileCreated);
+			int result = openBufferFile(fcContext);
 			if (result != 0) {
 				fcContext->req.result = result;
 				ctx->libev->runLater(boost::bind(_bufferFileCreated,
@@ -917,15 +974,28 @@ private:
 	void bufferFileDoneDelaying(FileCreationContext *fcContext) {
 		FBC_DEBUG("Writer: done delaying in-file mode switching. "
 			"Creating file: " << fcContext->path);
-		int result = uv_fs_open(ctx->libuv, &fcContext->req,
-			fcContext->path.c_str(), O_RDWR | O_CREAT | O_EXCL,
-			0600, _bufferFileCreated);
+		int result = openBufferFile(fcContext);
 		if (result != 0) {
 			fcContext->req.result = result;
 			_bufferFileCreated(&fcContext->req);
 		}
 	}
 
+	int openBufferFile(FileCreationContext *fcContext) {
+		int flags;
+		#if defined(PASSENGER_SUPPORTS_IO_URING) && defined(O_TMPFILE)
+			if (fcContext->anonymous) {
+				flags = O_RDWR | O_TMPFILE;
+			} else {
+				flags = O_RDWR | O_CREAT | O_EXCL;
+			}
+		#else
+			flags = O_RDWR | O_CREAT | O_EXCL;
+		#endif
+		return fsOpen(fcContext, fcContext->path.c_str(), flags,
+			_bufferFileCreated);
+	}
+
 	static void _bufferFileCreated(uv_fs_t *req) {
 		FileCreationContext *fcContext = static_cast<FileCreationContext *>(req->data);
 		uv_fs_req_cleanup(req);
@@ -935,8 +1005,12 @@ private:
 					"Writer: creation of file " << fcContext->path <<
 					"canceled. Deleting file in the background");
 				closeBufferFileInBackground(fcContext);
-				// Will take care of deleting fcContext
-				unlinkBufferFileInBackground(fcContext);
+				if (fcContext->anonymous) {
+					delete fcContext;
+				} else {
+					// Will take care of deleting fcContext
+					unlinkBufferFileInBackground(fcContext);
+				}
 			} else {
 				delete fcContext;
 			}
@@ -952,17 +1026,31 @@ private:
 		inFileMode->writerRequest = NULL;
 
 		if (fcContext->req.result >= 0) {
-			FBC_DEBUG("Writer: file created. Deleting file in the background");
 			P_LOG_FILE_DESCRIPTOR_OPEN4(fcContext->req.result, __FILE__, __LINE__,
 				"FileBufferedChannel buffer file");
 			inFileMode->fd = fcContext->req.result;
-			// Will take care of deleting fcContext
-			unlinkBufferFileInBackground(fcContext);
+			if (fcContext->anonymous) {
+				FBC_DEBUG("Writer: anonymous file created");
+				delete fcContext;
+			} else {
+				FBC_DEBUG("Writer: file created. Deleting file in the background");
+				// Will take care of deleting fcContext
+				unlinkBufferFileInBackground(fcContext);
+			}
 			moveNextBufferToFile();
 		} else {
 			int errcode = -fcContext->req.result;
+			bool anonymous = fcContext->anonymous;
 			delete fcContext;
-			if (errcode == EEXIST) {
+			if (anonymous && (errcode == EOPNOTSUPP || errcode == EISDIR
+				|| errcode == EINVAL))
+			{
+				FBC_DEBUG("Writer: file system does not support anonymous files, "
+					"retrying with a named file");
+				inFileMode->writerState = WS_INACTIVE;
+				createBufferFile(false);
+				verifyInvariants();
+			} else if (errcode == EEXIST) {
 				FBC_DEBUG("Writer: file already exists, retrying");
 				inFileMode->writerState = WS_INACTIVE;
 				createBufferFile();
@@ -1091,13 +1179,15 @@ private:
 		moveContext->inFileMode = inFileMode;
 		moveContext->buffer = peekBuffer();
 		moveContext->written = 0;
-		moveContext->uvBuffer = uv_buf_init(moveContext->buffer.start,
-			moveContext->buffer.size());
+		size_t size = moveContext->buffer.size();
+		if (config->maxDiskChunkWriteSize > 0 && size > config->maxDiskChunkWriteSize) {
+			size = config->maxDiskChunkWriteSize;
+		}
+		moveContext->uvBuffer = uv_buf_init(moveContext->buffer.start, size);
 
 		inFileMode->writerState = WS_MOVING;
 		inFileMode->writerRequest = moveContext;
-		int result = uv_fs_write(ctx->libuv, &moveContext->req, inFileMode->fd,
-			&moveContext->uvBuffer, 1,
+		int result = fsWrite(moveContext, inFileMode->fd, moveContext->uvBuffer,
 			inFileMode->readOffset + inFileMode->written,
 			_bufferWrittenToFile);
 		if (result != 0) {
@@ -1152,12 +1242,17 @@ private:
 			} else {
 				FBC_DEBUG("Writer: move incomplete, proceeding " <<
 					"with writing rest of buffer");
+				size_t size = moveContext->buffer.size() - moveContext->written;
+				if (config->maxDiskChunkWriteSize > 0 && size > config->maxDiskChunkWriteSize) {
+					size = config->maxDiskChunkWriteSize;
+				}
 				moveContext->uvBuffer = uv_buf_init(
 					moveContext->buffer.start + moveContext->written,
-					moveContext->buffer.size() - moveContext->written);
-				int result = uv_fs_write(ctx->libuv, &moveContext->req,
-					inFileMode->fd, &moveContext->uvBuffer, 1,
-					inFileMode->readOffset + inFileMode->written,
+					size);
+				int result = fsWrite(moveContext, inFileMode->fd,
+					moveContext->uvBuffer,
+					inFileMode->readOffset + inFileMode->written
+						+ moveContext->written,
 					_bufferWrittenToFile);
 				if (result != 0) {
 					moveContext->req.result = result;
@@ -1177,6 +1272,74 @@ private:
 	}
 
 
+	/***** File I/O dispatching *****/
+
+	/*
+	 * These functions start an asynchronous file I/O operation through the
+	 * Context's io_uring instance, or through libuv if there is none or if
+	 * its queue is full. They return 0 on success or a negative errno
+	 * code, just like the libuv functions. The buffer (and path) must stay
+	 * valid until the callback is called.
+	 */
+
+	int fsRead(FileIOContext *context, int fd, const uv_buf_t &buf,
+		boost::int64_t offset, uv_fs_cb callback)
+	{
+		#ifdef PASSENGER_SUPPORTS_IO_URING
+			if (ctx->ioUring != NULL) {
+				context->uringCallback = callback;
+				if (ctx->ioUring->read(fd, buf.base, buf.len, offset,
+					&context->uringOp))
+				{
+					context->usingIoUring = true;
+					return 0;
+				}
+			}
+			context->usingIoUring = false;
+		#endif
+		return uv_fs_read(ctx->libuv, &context->req, fd, &buf, 1,
+			offset, callback);
+	}
+
+	int fsWrite(FileIOContext *context, int fd, const uv_buf_t &buf,
+		boost::int64_t offset, uv_fs_cb callback)
+	{
+		#ifdef PASSENGER_SUPPORTS_IO_URING
+			if (ctx->ioUring != NULL) {
+				context->uringCallback = callback;
+				if (ctx->ioUring->write(fd, buf.base, buf.len, offset,
+					&context->uringOp))
+				{
+					context->usingIoUring = true;
+					return 0;
+				}
+			}
+			context->usingIoUring = false;
+		#endif
+		return uv_fs_write(ctx->libuv, &context->req, fd, &buf, 1,
+			offset, callback);
+	}
+
+	int fsOpen(FileIOContext *context, const char *path, int flags,
+		uv_fs_cb callback)
+	{
+		#ifdef PASSENGER_SUPPORTS_IO_URING
+			if (ctx->ioUring != NULL) {
+				context->uringCallback = callback;
+				if (ctx->ioUring->openat(AT_FDCWD, path, flags, 0600,
+					&context->uringOp))
+				{
+					context->usingIoUring = true;
+					return 0;
+				}
+			}
+			context->usingIoUring = false;
+		#endif
+		return uv_fs_open(ctx->libuv, &context->req, path, flags, 0600,
+			callback);
+	}
+
+
 	/***** Misc *****/
 
 	void setError(int errcode, const char *file, unsigned int line) {
@@ -1568,6 +1731,11 @@ public:
 		return dataFlushedCallback;
 	}
 
+	OXT_FORCE_INLINE
+	void clearDataFlushedCallback() {
+		dataFlushedCallback = NULL;
+	}
+
 	OXT_FORCE_INLINE
 	void setDataFlushedCallback(Callback callback) {
 		dataFlushedCallback = callback;
@@ -39,6 +39,7 @@ class BaseHttpClient: public BaseClient {
 public:
 	typedef Request RequestType;
 	LIST_HEAD(RequestList, Request);
+	STAILQ_HEAD(PipelinedRequestList, Request);
 
 	/**
 	 * @invariant
@@ -59,21 +60,31 @@ public:
 
 #define SERVER_KIT_BASE_HTTP_CLIENT_INIT() \
 	LIST_INIT(&lingeringRequests); \
-	lingeringRequestCount = 0
+	lingeringRequestCount = 0; \
+	STAILQ_INIT(&pipelinedRequests); \
+	pipelinedRequestCount = 0
 
 #define DEFINE_SERVER_KIT_BASE_HTTP_CLIENT_FOOTER(ClientType, RequestType) \
 	DEFINE_SERVER_KIT_BASE_CLIENT_FOOTER(ClientType); \
 	/* Last field from BASE_CLIENT_FOOTER is an int, so we put an */ \
 	/* unsigned int here first to avoid an alignment hole on x86_64. */ \
 	unsigned int lingeringRequestCount; \
-	Passenger::ServerKit::BaseHttpClient<RequestType>::RequestList lingeringRequests
+	Passenger::ServerKit::BaseHttpClient<RequestType>::RequestList lingeringRequests; \
+	/* Requests that have been received after currentRequest, in the */ \
+	/* order in which they were received. See HttpServer. */ \
+	unsigned int pipelinedRequestCount; \
+	Passenger::ServerKit::BaseHttpClient<RequestType>::PipelinedRequestList pipelinedRequests
 
 #define DEFINE_SERVER_KIT_BASE_HTTP_CLIENT_FOOTER_FOR_TEMPLATE_CLASS(ClientType, RequestType) \
 	DEFINE_SERVER_KIT_BASE_CLIENT_FOOTER(ClientType); \
 	/* Last field from BASE_CLIENT_FOOTER is an int, so we put an */ \
 	/* unsigned int here first to avoid an alignment hole on x86_64. */ \
 	unsigned int lingeringRequestCount; \
-	typename Passenger::ServerKit::BaseHttpClient<RequestType>::RequestList lingeringRequests
+	typename Passenger::ServerKit::BaseHttpClient<RequestType>::RequestList lingeringRequests; \
+	/* Requests that have been received after currentRequest, in the */ \
+	/* order in which they were received. See HttpServer. */ \
+	unsigned int pipelinedRequestCount; \
+	typename Passenger::ServerKit::BaseHttpClient<RequestType>::PipelinedRequestList pipelinedRequests
 
 
 template<typename Request = HttpRequest>
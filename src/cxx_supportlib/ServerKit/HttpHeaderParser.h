@@ -56,6 +56,16 @@ struct HttpParseResponse {};
 template<typename Message, typename MessageType = HttpParseRequest>
 class HttpHeaderParser {
 private:
+	/**
+	 * Header fields and values that arrive spread over multiple read buffers
+	 * consist of multiple LString parts. Those that are no larger than this
+	 * are made contiguous once, upon insertion into the header table, so
+	 * that later psg_lstr_make_contiguous() calls don't copy them again.
+	 * Larger ones are left alone, because most of them are never made
+	 * contiguous.
+	 */
+	static const unsigned int MAX_CONTIGUOUS_HEADER_SIZE = 4096;
+
 	Context *ctx;
 	HttpHeaderParserState *state;
 	Message *message;
@@ -110,7 +120,16 @@ private:
 		return true;
 	}
 
+	void makeContiguous(LString *str) {
+		if (str->size <= MAX_CONTIGUOUS_HEADER_SIZE) {
+			psg_lstr_make_contiguous_in_place(str, pool);
+		}
+	}
+
 	void insertCurrentHeader() {
+		makeContiguous(&state->currentHeader->key);
+		makeContiguous(&state->currentHeader->origKey);
+		makeContiguous(&state->currentHeader->val);
 		if (!state->secureMode) {
 			message->headers.insert(&state->currentHeader, pool);
 		} else {
@@ -265,12 +284,7 @@ private:
 
 	OXT_FORCE_INLINE
 	void indexQueryString(const HttpParseRequest &tag) {
-		LString *contiguousPath = psg_lstr_make_contiguous(&message->path,
-			message->pool);
-		if (contiguousPath != &message->path) {
-			psg_lstr_deinit(&message->path);
-			message->path = *contiguousPath;
-		}
+		psg_lstr_make_contiguous_in_place(&message->path, message->pool);
 
 		const char *pos = (const char *) memchr(message->path.start->data, '?',
 			message->path.size);
@@ -38,6 +38,7 @@
 #include <ServerKit/HttpChunkedBodyParserState.h>
 #include <MemoryKit/palloc.h>
 #include <DataStructures/LString.h>
+#include <SafeLibev.h>
 
 namespace Passenger {
 namespace ServerKit {
@@ -169,6 +170,15 @@ public:
 	 */
 	int nextRequestEarlyReadError;
 
+	/**
+	 * Used for handing this request over to the event loop thread
+	 * without allocating. At most one such hand-off may be in flight
+	 * at any time: a hand-off either happens when the reference count
+	 * has dropped to 0, or it holds a reference to the request until
+	 * the task has run.
+	 */
+	SafeLibev::Task eventLoopThreadTask;
+
 
 	BaseHttpRequest()
 		: refcount(1),
@@ -282,6 +292,7 @@ public:
 	union { \
 		STAILQ_ENTRY(RequestType) freeRequest; \
 		LIST_ENTRY(RequestType) lingeringRequest; \
+		STAILQ_ENTRY(RequestType) pipelinedRequest; \
 	} nextRequest
 
 
@@ -67,6 +67,7 @@ extern const unsigned int DEFAULT_INTERNAL_SERVER_ERROR_RESPONSE_SIZE;
  *
  *   accept_burst_count           unsigned integer   -   default(32)
  *   client_freelist_limit        unsigned integer   -   default(0)
+ *   max_pipelined_requests       unsigned integer   -   default(0)
  *   min_spare_clients            unsigned integer   -   default(0)
  *   request_freelist_limit       unsigned integer   -   default(1024)
  *   start_reading_after_accept   boolean            -   default(true)
@@ -79,6 +80,7 @@ private:
 		using namespace ConfigKit;
 
 		add("request_freelist_limit", UINT_TYPE, OPTIONAL, 1024);
+		add("max_pipelined_requests", UINT_TYPE, OPTIONAL, 0);
 	}
 
 public:
@@ -98,13 +100,16 @@ public:
 
 struct HttpServerConfigRealization {
 	unsigned int requestFreelistLimit;
+	unsigned int maxPipelinedRequests;
 
 	HttpServerConfigRealization(const ConfigKit::Store &config)
-		: requestFreelistLimit(config["request_freelist_limit"].asUInt())
+		: requestFreelistLimit(config["request_freelist_limit"].asUInt()),
+		  maxPipelinedRequests(config["max_pipelined_requests"].asUInt())
 		{ }
 
 	void swap(HttpServerConfigRealization &other) BOOST_NOEXCEPT_OR_NOTHROW {
 		std::swap(requestFreelistLimit, other.requestFreelistLimit);
+		std::swap(maxPipelinedRequests, other.maxPipelinedRequests);
 	}
 };
 
@@ -248,14 +253,19 @@ private:
 		// The shutdown procedure waits until all ACTIVE and DISCONNECTED
 		// clients are gone before destroying a Server, so we know for sure
 		// that this async callback outlives the Server.
-		this->getContext()->libev->runLater(boost::bind(
-			&HttpServer::passRequestToEventLoopThreadCallback,
-			this, RequestRef(request, __FILE__, __LINE__)));
+		//
+		// The request's reference count is 0, so nobody else can be using
+		// its eventLoopThreadTask.
+		request->eventLoopThreadTask.callback = passRequestToEventLoopThreadCallback;
+		request->eventLoopThreadTask.data = request;
+		this->getContext()->libev->runLater(&request->eventLoopThreadTask);
 	}
 
-	void passRequestToEventLoopThreadCallback(RequestRef requestRef) {
-		// Do nothing. Once this method returns, the reference count of the
-		// request drops to 0, and requestReachedZeroRefcount() is called.
+	static void passRequestToEventLoopThreadCallback(SafeLibev::Task *task) {
+		Request *req       = static_cast<Request *>(task->data);
+		Client *client     = static_cast<Client *>(req->client);
+		HttpServer *server = static_cast<HttpServer *>(HttpServer::getServerFromClient(client));
+		server->requestReachedZeroRefcount(req);
 	}
 
 
@@ -289,9 +299,14 @@ private:
 			req->pool = NULL;
 		}
 		unrefRequest(req, __FILE__, __LINE__);
-		if (keepAlive) {
-			SKC_TRACE(c, 3, "Keeping alive connection, handling next request");
-			handleNextRequest(c);
+		if (keepAlive && nextRequestEarlyReadError == 0
+		 && !STAILQ_EMPTY(&c->pipelinedRequests))
+		{
+			SKC_TRACE(c, 3, "Keeping alive connection, handling next pipelined request");
+			handleNextPipelinedRequest(c);
+		} else if (keepAlive) {
+			SKC_TRACE(c, 3, "Keeping alive connection, waiting for next request");
+			parkClient(c);
 			if (nextRequestEarlyReadError != 0) {
 				onClientDataReceived(c, MemoryKit::mbuf(), nextRequestEarlyReadError);
 			}
@@ -301,7 +316,27 @@ private:
 		}
 	}
 
+	/**
+	 * Puts the client in the idle state: it waits for the next request
+	 * without holding a request object, a request pool, a header parser
+	 * or a read buffer. Those are only allocated by `handleNextRequest()`
+	 * once the client sends data. This keeps idle keep-alive connections
+	 * cheap, so that the server can hold a large number of them.
+	 */
+	void parkClient(Client *client) {
+		assert(client->currentRequest == NULL);
+		client->input.start();
+		client->input.releaseReadBuffer();
+		client->output.deinitialize();
+		client->output.reinitialize(client->getFd());
+	}
+
 	void handleNextRequest(Client *client) {
+		assert(client->currentRequest == NULL);
+		client->currentRequest = checkoutRequestObjectForClient(client);
+	}
+
+	Request *checkoutRequestObjectForClient(Client *client) {
 		Request *req;
 
 		// A request object references its client object.
@@ -309,13 +344,215 @@ private:
 		// in requestReachedZeroRefcount().
 		this->refClient(client, __FILE__, __LINE__);
 
-		client->input.start();
+		req = checkoutRequestObject(client);
+		req->client = client;
+		reinitializeRequest(client, req);
+		return req;
+	}
+
+
+	/***** Pipelining *****/
+
+	/**
+	 * Whether we may parse requests that the client sends after `req`
+	 * (the current request) before `req` has ended. This is only the
+	 * case if `req` has been fully received, and if the connection
+	 * will be kept alive afterwards.
+	 */
+	bool canParseAhead(Client *client, Request *req) const {
+		return configRlz.maxPipelinedRequests > 0
+			&& req->wantKeepAlive
+			&& !req->upgraded()
+			&& HttpServer::serverState < HttpServer::SHUTTING_DOWN;
+	}
+
+	Request *lastPipelinedRequest(Client *client) const {
+		Request *req = STAILQ_FIRST(&client->pipelinedRequests);
+		if (req != NULL) {
+			while (STAILQ_NEXT(req, nextRequest.pipelinedRequest) != NULL) {
+				req = STAILQ_NEXT(req, nextRequest.pipelinedRequest);
+			}
+		}
+		return req;
+	}
+
+	/**
+	 * Handles client data that arrives while the current request is
+	 * still being processed, and which therefore belongs to one or more
+	 * pipelined requests. We parse the headers of those requests and
+	 * queue them in `client->pipelinedRequests`, but they only begin
+	 * (i.e. onRequestBegin() is called) once all earlier requests have
+	 * ended. That way responses are always written in order.
+	 *
+	 * We stop reading from the client when the queue is full, or when
+	 * the last queued request has a body, upgrades the connection or
+	 * is malformed. The rest of the data is then processed after that
+	 * request has become the current request.
+	 */
+	Channel::Result processPipelinedClientData(Client *client, const MemoryKit::mbuf &buffer,
+		int errcode)
+	{
+		Request *req = lastPipelinedRequest(client);
+
+		if (buffer.empty()) {
+			onPipelinedClientDataEnd(client, errcode);
+			return Channel::Result(0, false);
+		}
+
+		if (req == NULL || req->httpState != Request::PARSING_HEADERS) {
+			if (client->pipelinedRequestCount >= configRlz.maxPipelinedRequests
+			 || (req != NULL && req->httpState != Request::COMPLETE))
+			{
+				SKC_TRACE(client, 3, "Cannot parse ahead any further; waiting until"
+					" the current request has ended");
+				client->input.stop();
+				return Channel::Result(0, false);
+			}
+
+			client->currentRequest->detectingNextRequestEarlyReadError = false;
+			req = checkoutRequestObjectForClient(client);
+			STAILQ_INSERT_TAIL(&client->pipelinedRequests, req,
+				nextRequest.pipelinedRequest);
+			client->pipelinedRequestCount++;
+		}
+
+		size_t ret;
+		SKC_TRACE(client, 3, "Parsing " << buffer.size() <<
+			" bytes of pipelined HTTP header: \"" << cEscapeString(StaticString(
+				buffer.start, buffer.size())) << "\"");
+		req->lastDataReceiveTime = ev_now(this->getLoop());
+		ret = createRequestHeaderParser(this->getContext(), req).feed(buffer);
+		if (req->httpState == Request::PARSING_HEADERS) {
+			// Not yet done parsing.
+			return Channel::Result(buffer.size(), false);
+		}
+
+		SKC_TRACE(client, 2, "Pipelined request received (" <<
+			client->pipelinedRequestCount << " queued)");
+		headerParserStatePool.destroy(req->parserState.headerParser);
+		req->parserState.headerParser = NULL;
+		if (req->httpState == Request::COMPLETE) {
+			onRequestPipelined(client, req);
+			return Channel::Result(ret, false);
+		} else if (req->httpState == Request::ERROR) {
+			// The error response is written when this request begins.
+			client->input.stop();
+			return Channel::Result(0, false);
+		} else {
+			// The body (or the upgraded connection's data) can only
+			// be processed once this request has begun.
+			onRequestPipelined(client, req);
+			client->input.stop();
+			return Channel::Result(ret, false);
+		}
+	}
+
+	void onPipelinedClientDataEnd(Client *client, int errcode) {
+		Request *req = lastPipelinedRequest(client);
+		int earlyReadError = (errcode == 0) ? (int) EARLY_EOF_DETECTED : errcode;
+
+		client->input.stop();
+
+		if (req != NULL && req->httpState == Request::PARSING_HEADERS) {
+			SKC_TRACE(client, 3, "Discarding incomplete pipelined request");
+			STAILQ_REMOVE(&client->pipelinedRequests, req, Request,
+				nextRequest.pipelinedRequest);
+			client->pipelinedRequestCount--;
+			discardPipelinedRequest(client, req);
+			req = lastPipelinedRequest(client);
+		}
+
+		if (req != NULL) {
+			// Processed after `req` has begun, in handleNextPipelinedRequest().
+			SKC_TRACE(client, 3, "Early read error detected after the last"
+				" pipelined request: " << getErrorDesc(earlyReadError));
+			req->nextRequestEarlyReadError = earlyReadError;
+		} else {
+			req = client->currentRequest;
+			SKC_TRACE(client, 3, "Early read error detected: " <<
+				getErrorDesc(earlyReadError));
+			req->nextRequestEarlyReadError = earlyReadError;
+			if (!req->ended()) {
+				onNextRequestEarlyReadError(client, req, earlyReadError);
+			}
+		}
+	}
+
+	/**
+	 * Makes the oldest pipelined request the current request, and
+	 * begins it.
+	 */
+	void handleNextPipelinedRequest(Client *client) {
+		Request *req = STAILQ_FIRST(&client->pipelinedRequests);
+		int earlyReadError;
+
+		assert(client->currentRequest == NULL);
+		STAILQ_REMOVE_HEAD(&client->pipelinedRequests, nextRequest.pipelinedRequest);
+		client->pipelinedRequestCount--;
+		client->currentRequest = req;
 		client->output.deinitialize();
 		client->output.reinitialize(client->getFd());
 
-		client->currentRequest = req = checkoutRequestObject(client);
-		req->client = client;
-		reinitializeRequest(client, req);
+		if (req->httpState == Request::PARSING_HEADERS) {
+			// The rest of the headers haven't been received yet.
+			client->input.start();
+			return;
+		}
+
+		RequestRef ref(req, __FILE__, __LINE__);
+		earlyReadError = req->nextRequestEarlyReadError;
+		SKC_TRACE(client, 2, "New request received: #" << (totalRequestsBegun + 1));
+
+		// Requests are not kept alive while shutting down, so normally we
+		// don't get here then. Still apply the same check as for newly
+		// parsed requests, so that a queued request never begins after
+		// shutdown has started.
+		if (HttpServer::serverState == HttpServer::SHUTTING_DOWN
+		 && shouldDisconnectClientOnShutdown(client))
+		{
+			endWithErrorResponse(&client, &req, 503, "Server shutting down\n");
+			return;
+		}
+
+		if (beginParsedRequest(client, req, 0).end) {
+			return;
+		}
+		if (req->ended() || client->currentRequest != req) {
+			return;
+		}
+
+		if (earlyReadError != 0) {
+			// The client connection has already been closed, so there
+			// is nothing left to read.
+			req->detectingNextRequestEarlyReadError = false;
+			onNextRequestEarlyReadError(client, req, earlyReadError);
+		} else {
+			client->input.start();
+		}
+	}
+
+	/**
+	 * Releases a pipelined request that will never begin.
+	 */
+	void discardPipelinedRequest(Client *client, Request *req) {
+		deinitializeRequest(client, req);
+		P_ASSERT_EQ(req->httpState, Request::WAITING_FOR_REFERENCES);
+		LIST_INSERT_HEAD(&client->lingeringRequests, req,
+			nextRequest.lingeringRequest);
+		client->lingeringRequestCount++;
+		unrefRequest(req, __FILE__, __LINE__);
+	}
+
+	void discardPipelinedRequests(Client *client) {
+		Request *req;
+
+		while (!STAILQ_EMPTY(&client->pipelinedRequests)) {
+			req = STAILQ_FIRST(&client->pipelinedRequests);
+			STAILQ_REMOVE_HEAD(&client->pipelinedRequests,
+				nextRequest.pipelinedRequest);
+			client->pipelinedRequestCount--;
+			discardPipelinedRequest(client, req);
+		}
 	}
 
 
@@ -350,46 +587,54 @@ private:
 				return Channel::Result(buffer.size(), false);
 			}
 
-			switch (req->httpState) {
-			case Request::COMPLETE:
-				req->detectingNextRequestEarlyReadError = true;
-				onRequestBegin(client, req);
-				return Channel::Result(ret, false);
-			case Request::PARSING_BODY:
-				SKC_TRACE(client, 2, "Expecting a request body");
-				onRequestBegin(client, req);
-				return Channel::Result(ret, false);
-			case Request::PARSING_CHUNKED_BODY:
-				SKC_TRACE(client, 2, "Expecting a chunked request body");
-				prepareChunkedBodyParsing(client, req);
+			return beginParsedRequest(client, req, ret);
+		} else {
+			this->disconnect(&client);
+			return Channel::Result(0, true);
+		}
+	}
+
+	/**
+	 * Begins a request whose headers have been fully parsed. `consumed`
+	 * is the number of client input bytes to report as consumed.
+	 */
+	Channel::Result beginParsedRequest(Client *client, Request *req, size_t consumed) {
+		switch (req->httpState) {
+		case Request::COMPLETE:
+			req->detectingNextRequestEarlyReadError = true;
+			onRequestBegin(client, req);
+			return Channel::Result(consumed, false);
+		case Request::PARSING_BODY:
+			SKC_TRACE(client, 2, "Expecting a request body");
+			onRequestBegin(client, req);
+			return Channel::Result(consumed, false);
+		case Request::PARSING_CHUNKED_BODY:
+			SKC_TRACE(client, 2, "Expecting a chunked request body");
+			prepareChunkedBodyParsing(client, req);
+			onRequestBegin(client, req);
+			return Channel::Result(consumed, false);
+		case Request::UPGRADED:
+			assert(!req->wantKeepAlive);
+			if (supportsUpgrade(client, req)) {
+				SKC_TRACE(client, 2, "Expecting connection upgrade");
 				onRequestBegin(client, req);
-				return Channel::Result(ret, false);
-			case Request::UPGRADED:
-				assert(!req->wantKeepAlive);
-				if (supportsUpgrade(client, req)) {
-					SKC_TRACE(client, 2, "Expecting connection upgrade");
-					onRequestBegin(client, req);
-					return Channel::Result(ret, false);
-				} else {
-					endWithErrorResponse(&client, &req, 422,
-						"Connection upgrading not allowed for this request");
-					return Channel::Result(0, true);
-				}
-			case Request::ERROR:
-				// Change state so that the response body will be written.
-				req->httpState = Request::COMPLETE;
-				if (req->aux.parseError == HTTP_VERSION_NOT_SUPPORTED) {
-					endWithErrorResponse(&client, &req, 505, "HTTP version not supported\n");
-				} else {
-					endAsBadRequest(&client, &req, getErrorDesc(req->aux.parseError));
-				}
-				return Channel::Result(0, true);
-			default:
-				P_BUG("Invalid request HTTP state " << (int) req->httpState);
+				return Channel::Result(consumed, false);
+			} else {
+				endWithErrorResponse(&client, &req, 422,
+					"Connection upgrading not allowed for this request");
 				return Channel::Result(0, true);
 			}
-		} else {
-			this->disconnect(&client);
+		case Request::ERROR:
+			// Change state so that the response body will be written.
+			req->httpState = Request::COMPLETE;
+			if (req->aux.parseError == HTTP_VERSION_NOT_SUPPORTED) {
+				endWithErrorResponse(&client, &req, 505, "HTTP version not supported\n");
+			} else {
+				endAsBadRequest(&client, &req, getErrorDesc(req->aux.parseError));
+			}
+			return Channel::Result(0, true);
+		default:
+			P_BUG("Invalid request HTTP state " << (int) req->httpState);
 			return Channel::Result(0, true);
 		}
 	}
@@ -760,15 +1005,30 @@ protected:
 	virtual void onClientAccepted(Client *client) {
 		SKC_LOG_EVENT(HttpServer, client, "onClientAccepted");
 		ParentClass::onClientAccepted(client);
-		handleNextRequest(client);
+		parkClient(client);
 	}
 
 	virtual Channel::Result onClientDataReceived(Client *client, const MemoryKit::mbuf &buffer,
 		int errcode)
 	{
 		SKC_LOG_EVENT(HttpServer, client, "onClientDataReceived");
-		assert(client->currentRequest != NULL);
+		if (client->currentRequest == NULL) {
+			// The client is idle.
+			if (buffer.empty()) {
+				SKC_TRACE(client, 3, "Idle client closed the connection");
+				this->disconnect(&client);
+				return Channel::Result(0, true);
+			}
+			handleNextRequest(client);
+		}
 		Request *req = client->currentRequest;
+		if (!STAILQ_EMPTY(&client->pipelinedRequests)
+		 || (req->detectingNextRequestEarlyReadError
+		  && !buffer.empty()
+		  && canParseAhead(client, req)))
+		{
+			return processPipelinedClientData(client, buffer, errcode);
+		}
 		RequestRef ref(req, __FILE__, __LINE__);
 		bool ended = req->ended();
 
@@ -819,6 +1079,7 @@ protected:
 
 		// Handle client being disconnect()'ed without endRequest().
 
+		discardPipelinedRequests(client);
 		if (client->currentRequest != NULL) {
 			Request *req = client->currentRequest;
 			deinitializeRequestAndAddToFreelist(client, req);
@@ -832,6 +1093,12 @@ protected:
 		client->currentRequest = NULL;
 	}
 
+	/**
+	 * Clients that are idle between keep-alive requests hold no request
+	 * object (see `parkClient()`), so they are disconnected right away
+	 * when the server shuts down. Clients that have started sending a
+	 * request are allowed to finish it, unless it's an upgraded request.
+	 */
 	virtual bool shouldDisconnectClientOnShutdown(Client *client) {
 		return client->currentRequest == NULL
 			|| client->currentRequest->upgraded();
@@ -889,6 +1156,17 @@ protected:
 		// Do nothing.
 	}
 
+	/**
+	 * Called when the headers of a pipelined request have been parsed,
+	 * while an earlier request on the same connection is still being
+	 * processed. The request only begins (onRequestBegin() is called) once
+	 * all earlier requests have ended, but subclasses may use this hook to
+	 * start preparing for it.
+	 */
+	virtual void onRequestPipelined(Client *client, Request *req) {
+		// Do nothing.
+	}
+
 	virtual bool supportsUpgrade(Client *client, Request *req) {
 		return false;
 	}
@@ -907,6 +1185,7 @@ protected:
 		ParentClass::reinitializeClient(client, fd);
 		client->requestsBegun = 0;
 		assert(client->currentRequest == NULL);
+		assert(STAILQ_EMPTY(&client->pipelinedRequests));
 	}
 
 	virtual void reinitializeRequest(Client *client, Request *req) {
@@ -1005,6 +1284,32 @@ public:
 
 	/***** Server management *****/
 
+	/**
+	 * Frees spare request objects until the freelist fits within
+	 * `request_freelist_limit` again, so that lowering the limit
+	 * takes effect immediately.
+	 */
+	void trimRequestFreelist() {
+		unsigned int count = 0;
+
+		while (freeRequestCount > configRlz.requestFreelistLimit) {
+			Request *request = STAILQ_FIRST(&freeRequests);
+			if (request->pool != NULL) {
+				psg_destroy_pool(request->pool);
+				request->pool = NULL;
+			}
+			P_ASSERT_EQ(request->httpState, Request::IN_FREELIST);
+			freeRequestCount--;
+			STAILQ_REMOVE_HEAD(&freeRequests, nextRequest.freeRequest);
+			delete request;
+			count++;
+		}
+
+		if (count > 0) {
+			SKS_DEBUG("Freed " << count << " spare request objects");
+		}
+	}
+
 	virtual void compact(LoggingKit::Level logLevel = LoggingKit::NOTICE) {
 		ParentClass::compact();
 		unsigned int count = freeRequestCount;
@@ -1255,6 +1560,7 @@ public:
 	{
 		ParentClass::commitConfigChange(req.forParent);
 		configRlz.swap(*req.configRlz);
+		trimRequestFreelist();
 	}
 
 	virtual Json::Value inspectStateAsJson() const {
@@ -1274,6 +1580,16 @@ public:
 		Json::Value doc = ParentClass::inspectClientStateAsJson(client);
 		if (client->currentRequest) {
 			doc["current_request"] = inspectRequestStateAsJson(client->currentRequest);
+		} else if (client->connected()) {
+			doc["idle"] = true;
+		}
+		if (!STAILQ_EMPTY(&client->pipelinedRequests)) {
+			Json::Value pipelinedRequests(Json::arrayValue);
+			const Request *req;
+			STAILQ_FOREACH(req, &client->pipelinedRequests, nextRequest.pipelinedRequest) {
+				pipelinedRequests.append(inspectRequestStateAsJson(req));
+			}
+			doc["pipelined_requests"] = pipelinedRequests;
 		}
 		doc["requests_begun"] = client->requestsBegun;
 		doc["lingering_request_count"] = client->lingeringRequestCount;
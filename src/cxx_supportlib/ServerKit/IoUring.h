@@ -0,0 +1,599 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2018 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_SERVER_KIT_IO_URING_H_
+#define _PASSENGER_SERVER_KIT_IO_URING_H_
+
+#ifdef __linux__
+	#include <sys/syscall.h>
+	#if defined(__NR_io_uring_setup) && defined(__has_include)
+		#if __has_include(<linux/io_uring.h>)
+			#include <linux/io_uring.h>
+			// IORING_OP_READ, IORING_OP_WRITE and IORING_OP_OPENAT were
+			// introduced together with this feature flag, in Linux 5.6.
+			#ifdef IORING_FEAT_RW_CUR_POS
+				#define PASSENGER_SUPPORTS_IO_URING
+			#endif
+		#endif
+	#endif
+#endif
+
+#ifdef PASSENGER_SUPPORTS_IO_URING
+
+#include <boost/cstdint.hpp>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <ev.h>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <jsoncpp/json.h>
+#include <Exceptions.h>
+#include <LoggingKit/LoggingKit.h>
+
+namespace Passenger {
+namespace ServerKit {
+
+using namespace std;
+
+
+/**
+ * An operation submitted to an IoUring. Its owner must keep it, and any memory
+ * that the operation refers to, alive until `callback` has been called.
+ */
+struct IoUringOperation {
+	void (*callback)(IoUringOperation *op);
+	void *userData;
+	/** Set before `callback` is called: >= 0 on success, -errno on failure. */
+	int result;
+
+	/* Links in the IoUring's list of in-flight operations. Managed by IoUring. */
+	IoUringOperation *prevInFlight;
+	IoUringOperation *nextInFlight;
+};
+
+/**
+ * An io_uring instance whose completions are processed by a libev event loop.
+ * If enabled, FileBufferedChannel uses it instead of libuv's thread pool to
+ * create, write and read buffer files.
+ *
+ * Operations aren't submitted right away. They're submitted in a single
+ * `io_uring_enter()` call right before the event loop blocks, so all the
+ * operations started during an event loop iteration cost one system call.
+ * The kernel signals completions through an eventfd that the event loop
+ * watches.
+ *
+ * Starting an operation fails (returns false) if the ring is full. Callers
+ * are expected to fall back to another I/O mechanism in that case. If the
+ * kernel is temporarily short on resources, submission is retried shortly
+ * afterwards. If submission fails otherwise, the operations that couldn't be
+ * submitted complete with the error, in a later event loop iteration.
+ *
+ * While operations are in flight, the IoUring keeps the event loop
+ * referenced, so that `ev_run()` doesn't return before their callbacks
+ * have been called. Destroying the IoUring cancels the operations that are
+ * still in flight, and waits until the kernel is done with them.
+ *
+ * This class is not thread-safe. It must only be used from the thread that
+ * runs the event loop.
+ */
+class IoUring {
+private:
+	struct ev_loop *loop;
+	int ringFd;
+	int eventFd;
+	struct ev_io eventFdWatcher;
+	struct ev_prepare submitWatcher;
+	struct ev_timer retryWatcher;
+
+	void *ring;
+	size_t ringSize;
+	struct io_uring_sqe *sqes;
+	size_t sqesSize;
+
+	unsigned int *sqHead;
+	unsigned int *sqTail;
+	unsigned int *sqArray;
+	unsigned int sqMask;
+	unsigned int sqEntries;
+	unsigned int *cqHead;
+	unsigned int *cqTail;
+	struct io_uring_cqe *cqes;
+	unsigned int cqMask;
+	unsigned int cqEntries;
+
+	/** Number of entries in the submission queue not yet passed to the kernel. */
+	unsigned int unsubmitted;
+	/** Number of operations whose callback hasn't been called yet. */
+	unsigned int inFlight;
+	/** The operations whose callback hasn't been called yet. */
+	IoUringOperation *inFlightHead;
+	/**
+	 * In-flight operations that couldn't be submitted. Their callbacks are
+	 * called by `onRetryTimeout()`.
+	 */
+	vector<IoUringOperation *> failedOperations;
+	bool shuttingDown;
+	boost::uint64_t nSubmitted;
+	boost::uint64_t nSubmitCalls;
+
+	void setup(unsigned int entries) {
+		struct io_uring_params params;
+		int e;
+
+		memset(&params, 0, sizeof(params));
+		ringFd = (int) syscall(__NR_io_uring_setup, entries, &params);
+		if (ringFd == -1) {
+			e = errno;
+			throw SystemException("Cannot create an io_uring instance", e);
+		}
+		P_LOG_FILE_DESCRIPTOR_OPEN4(ringFd, __FILE__, __LINE__, "io_uring");
+
+		const unsigned int requiredFeatures = IORING_FEAT_SINGLE_MMAP
+			| IORING_FEAT_NODROP | IORING_FEAT_RW_CUR_POS;
+		if ((params.features & requiredFeatures) != requiredFeatures) {
+			throw SystemException("Cannot create an io_uring instance: "
+				"the kernel's io_uring implementation is too old", ENOSYS);
+		}
+
+		ringSize = std::max<size_t>(
+			params.sq_off.array + params.sq_entries * sizeof(unsigned int),
+			params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe));
+		ring = mmap(NULL, ringSize, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+		if (ring == MAP_FAILED) {
+			e = errno;
+			ring = NULL;
+			throw SystemException("Cannot map the io_uring queues", e);
+		}
+
+		sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+		sqes = (struct io_uring_sqe *) mmap(NULL, sqesSize, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+		if (sqes == MAP_FAILED) {
+			e = errno;
+			sqes = NULL;
+			throw SystemException("Cannot map the io_uring submission queue entries", e);
+		}
+
+		char *base = (char *) ring;
+		sqHead = (unsigned int *) (base + params.sq_off.head);
+		sqTail = (unsigned int *) (base + params.sq_off.tail);
+		sqArray = (unsigned int *) (base + params.sq_off.array);
+		sqMask = *(unsigned int *) (base + params.sq_off.ring_mask);
+		sqEntries = params.sq_entries;
+		cqHead = (unsigned int *) (base + params.cq_off.head);
+		cqTail = (unsigned int *) (base + params.cq_off.tail);
+		cqes = (struct io_uring_cqe *) (base + params.cq_off.cqes);
+		cqMask = *(unsigned int *) (base + params.cq_off.ring_mask);
+		cqEntries = params.cq_entries;
+
+		eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (eventFd == -1) {
+			e = errno;
+			throw SystemException("Cannot create an eventfd for io_uring", e);
+		}
+		P_LOG_FILE_DESCRIPTOR_OPEN4(eventFd, __FILE__, __LINE__, "io_uring eventfd");
+		if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_EVENTFD,
+			&eventFd, 1) == -1)
+		{
+			e = errno;
+			throw SystemException("Cannot register an eventfd with io_uring", e);
+		}
+
+		ev_io_init(&eventFdWatcher, onEventFdReadable, eventFd, EV_READ);
+		eventFdWatcher.data = this;
+		ev_io_start(loop, &eventFdWatcher);
+		ev_unref(loop);
+		ev_prepare_init(&submitWatcher, onEventLoopPrepare);
+		submitWatcher.data = this;
+		ev_prepare_start(loop, &submitWatcher);
+		ev_unref(loop);
+		retryWatcher.data = this;
+	}
+
+	void cleanup() {
+		if (ev_is_active(&eventFdWatcher)) {
+			ev_ref(loop);
+			ev_io_stop(loop, &eventFdWatcher);
+		}
+		if (ev_is_active(&submitWatcher)) {
+			ev_ref(loop);
+			ev_prepare_stop(loop, &submitWatcher);
+		}
+		ev_timer_stop(loop, &retryWatcher);
+		if (sqes != NULL) {
+			munmap(sqes, sqesSize);
+		}
+		if (ring != NULL) {
+			munmap(ring, ringSize);
+		}
+		if (eventFd != -1) {
+			close(eventFd);
+			P_LOG_FILE_DESCRIPTOR_CLOSE(eventFd);
+		}
+		if (ringFd != -1) {
+			close(ringFd);
+			P_LOG_FILE_DESCRIPTOR_CLOSE(ringFd);
+		}
+	}
+
+	struct io_uring_sqe *allocateSqe() {
+		unsigned int tail = *sqTail;
+		if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+			submit();
+			if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+				return NULL;
+			}
+		}
+
+		unsigned int index = tail & sqMask;
+		struct io_uring_sqe *sqe = &sqes[index];
+		memset(sqe, 0, sizeof(*sqe));
+		sqArray[index] = index;
+		return sqe;
+	}
+
+	struct io_uring_sqe *getSqe(IoUringOperation *op) {
+		if (shuttingDown || inFlight >= cqEntries) {
+			// Make sure that the completion queue can never overflow.
+			return NULL;
+		}
+
+		struct io_uring_sqe *sqe = allocateSqe();
+		if (sqe != NULL) {
+			sqe->user_data = (boost::uint64_t) (uintptr_t) op;
+		}
+		return sqe;
+	}
+
+	void pushSqe() {
+		__atomic_store_n(sqTail, *sqTail + 1, __ATOMIC_RELEASE);
+		unsubmitted++;
+	}
+
+	void push(IoUringOperation *op) {
+		pushSqe();
+		op->prevInFlight = NULL;
+		op->nextInFlight = inFlightHead;
+		if (inFlightHead != NULL) {
+			inFlightHead->prevInFlight = op;
+		}
+		inFlightHead = op;
+		if (inFlight++ == 0) {
+			// Keep the event loop alive until the operation is completed.
+			ev_ref(loop);
+		}
+	}
+
+	void removeFromInFlightList(IoUringOperation *op) {
+		if (op->prevInFlight != NULL) {
+			op->prevInFlight->nextInFlight = op->nextInFlight;
+		} else {
+			inFlightHead = op->nextInFlight;
+		}
+		if (op->nextInFlight != NULL) {
+			op->nextInFlight->prevInFlight = op->prevInFlight;
+		}
+		if (--inFlight == 0) {
+			ev_unref(loop);
+		}
+	}
+
+	static void onEventLoopPrepare(EV_P_ struct ev_prepare *w, int revents) {
+		IoUring *self = static_cast<IoUring *>(w->data);
+		if (self->unsubmitted > 0) {
+			self->submit();
+		}
+	}
+
+	/**
+	 * Wakes up the event loop after `delay` seconds, so that `submit()` is
+	 * retried, or failed operations are completed.
+	 */
+	void scheduleRetry(ev_tstamp delay) {
+		if (ev_is_active(&retryWatcher)) {
+			if (delay > 0) {
+				return;
+			}
+			ev_timer_stop(loop, &retryWatcher);
+		}
+		ev_timer_set(&retryWatcher, delay, 0);
+		ev_timer_start(loop, &retryWatcher);
+	}
+
+	static void onRetryTimeout(EV_P_ struct ev_timer *w, int revents) {
+		IoUring *self = static_cast<IoUring *>(w->data);
+		self->completeFailedOperations();
+		if (self->unsubmitted > 0) {
+			self->submit();
+		}
+	}
+
+	/**
+	 * Takes the entries that the kernel hasn't consumed back out of the
+	 * submission queue, and marks their operations as failed with the given
+	 * errno code.
+	 */
+	void failUnsubmitted(int e) {
+		unsigned int head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+		unsigned int tail = *sqTail;
+
+		for (unsigned int i = head; i != tail; i++) {
+			struct io_uring_sqe *sqe = &sqes[sqArray[i & sqMask]];
+			IoUringOperation *op = (IoUringOperation *) (uintptr_t) sqe->user_data;
+			if (op != NULL) {
+				op->result = -e;
+				failedOperations.push_back(op);
+			}
+		}
+		__atomic_store_n(sqTail, head, __ATOMIC_RELEASE);
+		unsubmitted = 0;
+		scheduleRetry(0);
+	}
+
+	void completeFailedOperations() {
+		while (!failedOperations.empty()) {
+			vector<IoUringOperation *> ops;
+			ops.swap(failedOperations);
+			for (unsigned int i = 0; i < ops.size(); i++) {
+				removeFromInFlightList(ops[i]);
+				ops[i]->callback(ops[i]);
+			}
+		}
+	}
+
+	static void onEventFdReadable(EV_P_ struct ev_io *w, int revents) {
+		IoUring *self = static_cast<IoUring *>(w->data);
+		boost::uint64_t counter;
+		ssize_t ret;
+
+		do {
+			ret = ::read(self->eventFd, &counter, sizeof(counter));
+		} while (ret == -1 && errno == EINTR);
+		self->processCompletions();
+	}
+
+	void processCompletions() {
+		unsigned int head = *cqHead;
+
+		while (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+			struct io_uring_cqe *cqe = &cqes[head & cqMask];
+			IoUringOperation *op = (IoUringOperation *) (uintptr_t) cqe->user_data;
+			int result = cqe->res;
+			head++;
+			// Release the entry before calling the callback, which may
+			// start new operations.
+			__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+			if (op == NULL) {
+				// Completion of a cancelation request.
+				continue;
+			}
+			op->result = result;
+			removeFromInFlightList(op);
+			op->callback(op);
+		}
+	}
+
+	/**
+	 * Asks the kernel to cancel all in-flight operations, and waits until all
+	 * of them are completed. Operations that could be canceled complete with
+	 * -ECANCELED. Afterwards, the kernel no longer uses any memory that the
+	 * operations referred to.
+	 */
+	void cancelAllAndWait() {
+		IoUringOperation *op = inFlightHead;
+
+		shuttingDown = true;
+		while (op != NULL) {
+			struct io_uring_sqe *sqe = allocateSqe();
+			if (sqe == NULL) {
+				// The submission queue is full. Wait until the kernel
+				// has consumed some entries.
+				waitForCompletions();
+				// The completed operations have been removed from the
+				// in-flight list, so start over.
+				op = inFlightHead;
+				continue;
+			}
+			sqe->opcode = IORING_OP_ASYNC_CANCEL;
+			sqe->fd = -1;
+			sqe->addr = (boost::uint64_t) (uintptr_t) op;
+			// user_data 0 marks the completion of a cancelation request.
+			sqe->user_data = 0;
+			pushSqe();
+			op = op->nextInFlight;
+		}
+
+		while (inFlight > 0) {
+			waitForCompletions();
+		}
+	}
+
+	void waitForCompletions() {
+		int ret = (int) syscall(__NR_io_uring_enter, ringFd, unsubmitted, 1,
+			IORING_ENTER_GETEVENTS, NULL, 0);
+		if (ret >= 0) {
+			unsubmitted -= std::min<unsigned int>(ret, unsubmitted);
+		} else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+			int e = errno;
+			P_CRITICAL("Cannot wait for io_uring operations to complete: "
+				<< strerror(e) << " (errno=" << e << ")");
+			// The kernel may still write into the operations' buffers,
+			// so it isn't safe to continue.
+			abort();
+		}
+		processCompletions();
+		completeFailedOperations();
+	}
+
+public:
+	/**
+	 * @throws SystemException The kernel doesn't support io_uring, or
+	 *   doesn't support the operations that we need.
+	 */
+	IoUring(struct ev_loop *_loop, unsigned int entries)
+		: loop(_loop),
+		  ringFd(-1),
+		  eventFd(-1),
+		  ring(NULL),
+		  ringSize(0),
+		  sqes(NULL),
+		  sqesSize(0),
+		  unsubmitted(0),
+		  inFlight(0),
+		  inFlightHead(NULL),
+		  shuttingDown(false),
+		  nSubmitted(0),
+		  nSubmitCalls(0)
+	{
+		ev_io_init(&eventFdWatcher, onEventFdReadable, -1, EV_READ);
+		ev_prepare_init(&submitWatcher, onEventLoopPrepare);
+		ev_timer_init(&retryWatcher, onRetryTimeout, 0, 0);
+		try {
+			setup(entries);
+		} catch (...) {
+			cleanup();
+			throw;
+		}
+	}
+
+	/**
+	 * Cancels and waits for all in-flight operations; see the class
+	 * description. Their callbacks are called, so they must still be
+	 * safe to call.
+	 */
+	~IoUring() {
+		completeFailedOperations();
+		if (inFlight > 0) {
+			P_DEBUG("Canceling " << inFlight << " in-flight io_uring operations");
+			cancelAllAndWait();
+		}
+		cleanup();
+	}
+
+	bool read(int fd, void *buf, unsigned int size, off_t offset, IoUringOperation *op) {
+		struct io_uring_sqe *sqe = getSqe(op);
+		if (sqe == NULL) {
+			return false;
+		}
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = fd;
+		sqe->addr = (boost::uint64_t) (uintptr_t) buf;
+		sqe->len = size;
+		sqe->off = offset;
+		push(op);
+		return true;
+	}
+
+	bool write(int fd, const void *buf, unsigned int size, off_t offset, IoUringOperation *op) {
+		struct io_uring_sqe *sqe = getSqe(op);
+		if (sqe == NULL) {
+			return false;
+		}
+		sqe->opcode = IORING_OP_WRITE;
+		sqe->fd = fd;
+		sqe->addr = (boost::uint64_t) (uintptr_t) buf;
+		sqe->len = size;
+		sqe->off = offset;
+		push(op);
+		return true;
+	}
+
+	/**
+	 * `path` must stay valid until the operation is completed.
+	 */
+	bool openat(int dirfd, const char *path, int flags, mode_t mode, IoUringOperation *op) {
+		struct io_uring_sqe *sqe = getSqe(op);
+		if (sqe == NULL) {
+			return false;
+		}
+		sqe->opcode = IORING_OP_OPENAT;
+		sqe->fd = dirfd;
+		sqe->addr = (boost::uint64_t) (uintptr_t) path;
+		sqe->len = mode;
+		sqe->open_flags = flags | O_CLOEXEC;
+		push(op);
+		return true;
+	}
+
+	/**
+	 * Passes all queued operations to the kernel. This is called automatically
+	 * before the event loop blocks, so you normally don't have to call this.
+	 */
+	void submit() {
+		while (unsubmitted > 0) {
+			int ret = (int) syscall(__NR_io_uring_enter, ringFd, unsubmitted, 0, 0, NULL, 0);
+			if (ret >= 0) {
+				unsubmitted -= std::min<unsigned int>(ret, unsubmitted);
+				nSubmitted += ret;
+				nSubmitCalls++;
+				if (ret == 0) {
+					break;
+				}
+			} else if (errno == EAGAIN || errno == EBUSY) {
+				// The kernel is short on resources. The entries stay in
+				// the submission queue; try again in a moment. Nothing
+				// else may wake up the event loop before then.
+				scheduleRetry(0.001);
+				break;
+			} else if (errno != EINTR) {
+				int e = errno;
+				P_ERROR("Cannot submit io_uring operations: " << strerror(e)
+					<< " (errno=" << e << ")");
+				failUnsubmitted(e);
+				break;
+			}
+		}
+	}
+
+	unsigned int getOperationsInFlight() const {
+		return inFlight;
+	}
+
+	Json::Value inspectStateAsJson() const {
+		Json::Value doc;
+		doc["entries"] = sqEntries;
+		doc["in_flight"] = inFlight;
+		doc["unsubmitted"] = unsubmitted;
+		doc["failed"] = (Json::UInt) failedOperations.size();
+		doc["submitted"] = (Json::UInt64) nSubmitted;
+		doc["submit_calls"] = (Json::UInt64) nSubmitCalls;
+		return doc;
+	}
+};
+
+
+} // namespace ServerKit
+} // namespace Passenger
+
+#endif /* PASSENGER_SUPPORTS_IO_URING */
+
+#endif /* _PASSENGER_SERVER_KIT_IO_URING_H_ */
@@ -35,6 +35,7 @@
 #include <oxt/backtrace.hpp>
 #include <oxt/macros.hpp>
 #include <vector>
+#include <algorithm>
 #include <new>
 #include <ev++.h>
 
@@ -800,12 +801,50 @@ public:
 		}
 		ev_io_init(&endpoints[nEndpoints], _onAcceptable, fd, EV_READ);
 		endpoints[nEndpoints].data = this;
-		ev_io_start(ctx->libev->getLoop(), &endpoints[nEndpoints]);
+		if (serverState == ACTIVE) {
+			ev_io_start(ctx->libev->getLoop(), &endpoints[nEndpoints]);
+		}
 		nEndpoints++;
 
 		#undef EXTENSION_EOPNOTSUPP
 	}
 
+	/**
+	 * Stops accepting clients on the given server socket, which was earlier
+	 * passed to `listen()`. Clients that were already accepted through it
+	 * are not affected. Does not close the socket.
+	 *
+	 * Returns whether the socket was found.
+	 */
+	bool unlisten(int fd) {
+		TRACE_POINT();
+		uint8_t i, j;
+
+		for (i = 0; i < nEndpoints; i++) {
+			if (endpoints[i].fd == fd) {
+				break;
+			}
+		}
+		if (i == nEndpoints) {
+			return false;
+		}
+
+		// libev keeps pointers to active watchers, so we must stop
+		// the ones that we move around.
+		for (j = i; j < nEndpoints; j++) {
+			ev_io_stop(ctx->libev->getLoop(), &endpoints[j]);
+		}
+		for (j = i; j + 1 < nEndpoints; j++) {
+			ev_io_init(&endpoints[j], _onAcceptable, endpoints[j + 1].fd, EV_READ);
+			endpoints[j].data = this;
+			if (serverState == ACTIVE) {
+				ev_io_start(ctx->libev->getLoop(), &endpoints[j]);
+			}
+		}
+		nEndpoints--;
+		return true;
+	}
+
 	void shutdown(bool forceDisconnect = false) {
 		if (serverState != ACTIVE) {
 			return;
@@ -886,6 +925,41 @@ public:
 
 	/***** Server management *****/
 
+	/**
+	 * Brings the client freelist in line with the current
+	 * `client_freelist_limit` and `min_spare_clients` settings, so that
+	 * changing them takes effect immediately instead of only at the next
+	 * restart. Like `createSpareClients()`, spare clients may exceed the
+	 * freelist limit.
+	 */
+	void resizeClientFreelist() {
+		unsigned int max = std::max(configRlz.clientFreelistLimit,
+			configRlz.minSpareClients);
+		unsigned int freed = 0, created = 0;
+
+		while (freeClientCount > max) {
+			Client *client = STAILQ_FIRST(&freeClients);
+			P_ASSERT_EQ(client->getConnState(), Client::IN_FREELIST);
+			client->refcount.store(2, boost::memory_order_relaxed);
+			freeClientCount--;
+			STAILQ_REMOVE_HEAD(&freeClients, nextClient.freeClient);
+			delete client;
+			freed++;
+		}
+		while (freeClientCount < configRlz.minSpareClients) {
+			Client *client = createNewClientObject();
+			client->setConnState(Client::IN_FREELIST);
+			STAILQ_INSERT_HEAD(&freeClients, client, nextClient.freeClient);
+			freeClientCount++;
+			created++;
+		}
+
+		if (freed > 0 || created > 0) {
+			SKS_DEBUG("Client freelist resized: freed " << freed
+				<< " and created " << created << " spare client objects");
+		}
+	}
+
 	virtual void compact(LoggingKit::Level logLevel = LoggingKit::NOTICE) {
 		unsigned int count = freeClientCount;
 
@@ -1118,6 +1192,7 @@ public:
 	{
 		config.swap(*req.config);
 		configRlz.swap(*req.configRlz);
+		resizeClientFreelist();
 	}
 
 	virtual Json::Value inspectConfig() const {
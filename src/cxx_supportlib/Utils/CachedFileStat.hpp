@@ -1,6 +1,6 @@
 /*
  *  Phusion Passenger - https://www.phusionpassenger.com/
- *  Copyright (c) 2010-2017 Phusion Holding B.V.
+ *  Copyright (c) 2010-2018 Phusion Holding B.V.
  *
  *  "Passenger", "Phusion Passenger" and "Union Station" are registered
  *  trademarks of Phusion Holding B.V.
@@ -29,18 +29,23 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <limits.h>
 #include <time.h>
 
 #include <cerrno>
 #include <cassert>
+#include <cstring>
 #include <string>
-#include <boost/shared_ptr.hpp>
-#include <boost/make_shared.hpp>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread.hpp>
+#include <oxt/macros.hpp>
 #include <oxt/system_calls.hpp>
 
 #include <StaticString.h>
 #include <Utils/SystemTime.h>
-#include <Utils/StringMap.h>
+#include <Utils/Hasher.h>
 
 namespace Passenger {
 
@@ -55,106 +60,296 @@ using namespace boost;
  *
  * The cache has a maximum size, which may be altered during runtime. If a
  * file that wasn't in the cache is being stat()ed, and the cache is full,
- * then the oldest cache entry will be removed.
+ * then the least recently used cache entry will be removed.
+ *
+ * CachedFileStat is thread-safe. The cache is split into a number of
+ * stripes, each with its own lock and its own open-addressed hash table,
+ * so that threads that stat different files rarely contend with each other.
+ * The stripe lock is not held while calling stat(). Cache hits do not
+ * allocate memory. With more than one stripe, the maximum size is divided
+ * evenly over the stripes and least recently used entries are evicted per
+ * stripe, so eviction order is only approximately LRU.
  */
-class CachedFileStat {
-public:
-	/** Represents a cached file stat entry. */
-	class Entry {
-	private:
+class CachedFileStat: public boost::noncopyable {
+private:
+	static const boost::uint32_t NONE = 0xFFFFFFFF;
+	static const unsigned int MIN_TABLE_SIZE = 8;
+
+	struct Entry {
+		/** This entry's filename. Its buffer is reused when the slot is reused. */
+		string filename;
+
+		/** The cached stat info. */
+		struct stat info;
+
 		/** The last return value of stat(). */
-		int last_result;
+		int lastResult;
 
 		/** The errno set by the last stat() call. */
-		int last_errno;
+		int lastErrno;
 
 		/** The last time a stat() was performed. */
-		time_t last_time;
+		time_t lastTime;
 
-		/**
-		 * Checks whether `interval` seconds have elapsed since `begin`.
-		 * The current time is returned via the `currentTime` argument,
-		 * so that the caller doesn't have to call time() again if it needs the current
-		 * time.
-		 *
-		 * @pre begin <= time(NULL)
-		 * @return Whether `interval` seconds have elapsed since `begin`.
-		 * @throws TimeRetrievalException Something went wrong while retrieving the time.
-		 * @throws boost::thread_interrupted
-		 */
-		bool expired(time_t begin, unsigned int interval, time_t &currentTime) {
-			currentTime = SystemTime::get();
-			return (unsigned int) (currentTime - begin) >= interval;
+		boost::uint32_t hash;
+		boost::uint32_t lruPrev;
+		boost::uint32_t lruNext;
+		bool used;
+
+		Entry()
+			: lastResult(-1),
+			  lastErrno(0),
+			  lastTime(0),
+			  hash(0),
+			  lruPrev(NONE),
+			  lruNext(NONE),
+			  used(false)
+		{
+			memset(&info, 0, sizeof(struct stat));
 		}
+	};
 
-	public:
-		/** The cached stat info. */
-		struct stat info;
+	/**
+	 * An open-addressed (linear probing) hash table, plus an LRU list that
+	 * is threaded through the table slots by index.
+	 */
+	struct Stripe {
+		boost::mutex syncher;
+		vector<Entry> slots;
+		unsigned int count;
+		/** Maximum number of entries; 0 means unlimited. */
+		unsigned int maxSize;
+		boost::uint32_t lruHead;
+		boost::uint32_t lruTail;
 
-		/** This entry's filename. */
-		string filename;
+		Stripe()
+			: slots(MIN_TABLE_SIZE),
+			  count(0),
+			  maxSize(0),
+			  lruHead(NONE),
+			  lruTail(NONE)
+			{ }
+
+		boost::uint32_t mask() const {
+			return slots.size() - 1;
+		}
+
+		boost::uint32_t find(const StaticString &filename, boost::uint32_t hash) const {
+			boost::uint32_t i = hash & mask();
+			while (slots[i].used) {
+				if (slots[i].hash == hash && filename == slots[i].filename) {
+					return i;
+				}
+				i = (i + 1) & mask();
+			}
+			return NONE;
+		}
+
+		void lruUnlink(boost::uint32_t i) {
+			Entry &entry = slots[i];
+			if (entry.lruPrev == NONE) {
+				lruHead = entry.lruNext;
+			} else {
+				slots[entry.lruPrev].lruNext = entry.lruNext;
+			}
+			if (entry.lruNext == NONE) {
+				lruTail = entry.lruPrev;
+			} else {
+				slots[entry.lruNext].lruPrev = entry.lruPrev;
+			}
+			entry.lruPrev = entry.lruNext = NONE;
+		}
+
+		void lruPushFront(boost::uint32_t i) {
+			Entry &entry = slots[i];
+			entry.lruPrev = NONE;
+			entry.lruNext = lruHead;
+			if (lruHead == NONE) {
+				lruTail = i;
+			} else {
+				slots[lruHead].lruPrev = i;
+			}
+			lruHead = i;
+		}
+
+		/** Marks the given entry as most recently used. */
+		void touch(boost::uint32_t i) {
+			if (lruHead != i) {
+				lruUnlink(i);
+				lruPushFront(i);
+			}
+		}
+
+		/** Moves the entry in slot `from` into the empty slot `to`. */
+		void move(boost::uint32_t from, boost::uint32_t to) {
+			Entry &source = slots[from];
+			Entry &dest = slots[to];
+
+			dest.filename.swap(source.filename);
+			dest.info = source.info;
+			dest.lastResult = source.lastResult;
+			dest.lastErrno = source.lastErrno;
+			dest.lastTime = source.lastTime;
+			dest.hash = source.hash;
+			dest.lruPrev = source.lruPrev;
+			dest.lruNext = source.lruNext;
+			dest.used = true;
+			source.used = false;
+
+			if (dest.lruPrev == NONE) {
+				lruHead = to;
+			} else {
+				slots[dest.lruPrev].lruNext = to;
+			}
+			if (dest.lruNext == NONE) {
+				lruTail = to;
+			} else {
+				slots[dest.lruNext].lruPrev = to;
+			}
+		}
 
 		/**
-		 * Creates a new Entry object. The file will not be
-		 * stat()ted until you call refresh().
-		 *
-		 * @param filename The file to stat.
+		 * Removes the entry in slot `i`, using backward shift deletion
+		 * so that no tombstones are necessary.
 		 */
-		Entry(const string &_filename)
-			: filename(_filename)
-		{
-			memset(&info, 0, sizeof(struct stat));
-			last_result = -1;
-			last_errno = 0;
-			last_time = 0;
+		void remove(boost::uint32_t i) {
+			lruUnlink(i);
+			slots[i].used = false;
+			count--;
+
+			boost::uint32_t j = i;
+			while (true) {
+				j = (j + 1) & mask();
+				if (!slots[j].used) {
+					return;
+				}
+				// Entry j may only move to i if its home slot is not
+				// cyclically within (i, j].
+				boost::uint32_t home = slots[j].hash & mask();
+				if ((j > i && (home <= i || home > j))
+				 || (j < i && (home <= i && home > j)))
+				{
+					move(j, i);
+					i = j;
+				}
+			}
+		}
+
+		void evictExcessEntries() {
+			if (maxSize != 0) {
+				while (count > maxSize) {
+					remove(lruTail);
+				}
+			}
+		}
+
+		/** Resizes the table so that it can hold `capacity` entries at a load factor of at most 0.5. */
+		void reserve(unsigned int capacity) {
+			unsigned int size = MIN_TABLE_SIZE;
+			while (size < capacity * 2) {
+				size *= 2;
+			}
+			if (size <= slots.size()) {
+				return;
+			}
+
+			vector<Entry> oldSlots(size);
+			oldSlots.swap(slots);
+
+			// Reinsert from least to most recently used, so that
+			// the LRU order is preserved.
+			boost::uint32_t i = lruTail;
+			lruHead = lruTail = NONE;
+			while (i != NONE) {
+				Entry &old = oldSlots[i];
+				boost::uint32_t j = old.hash & mask();
+				while (slots[j].used) {
+					j = (j + 1) & mask();
+				}
+				Entry &entry = slots[j];
+				entry.filename.swap(old.filename);
+				entry.info = old.info;
+				entry.lastResult = old.lastResult;
+				entry.lastErrno = old.lastErrno;
+				entry.lastTime = old.lastTime;
+				entry.hash = old.hash;
+				entry.used = true;
+				lruPushFront(j);
+				i = old.lruPrev;
+			}
 		}
 
 		/**
-		 * Re-stat() the file, if necessary. If <tt>throttleRate</tt> seconds have
-		 * passed since the last time stat() was called, then the file will be
-		 * re-stat()ted.
-		 *
-		 * The stat information, which may either be the result of a new stat() call
-		 * or just the old cached information, is be available in the <tt>info</tt>
-		 * member.
-		 *
-		 * @return 0 if the stat() call succeeded or if no stat() was performed,
-		 *         -1 if something went wrong while statting the file. In the latter
-		 *         case, <tt>errno</tt> will be populated with an appropriate error code.
-		 * @throws TimeRetrievalException Something went wrong while retrieving the
-		 *         system time.
-		 * @throws boost::thread_interrupted
+		 * Inserts a new, most recently used entry, evicting the least
+		 * recently used entry if the stripe is full.
 		 */
-		int refresh(unsigned int throttleRate) {
-			time_t currentTime;
-
-			if (expired(last_time, throttleRate, currentTime)) {
-				last_result = syscalls::stat(filename.c_str(), &info);
-				last_errno = errno;
-				last_time = currentTime;
-				return last_result;
-			} else {
-				errno = last_errno;
-				return last_result;
+		boost::uint32_t insert(const StaticString &filename, boost::uint32_t hash) {
+			if (maxSize != 0 && count >= maxSize) {
+				remove(lruTail);
 			}
+			reserve(count + 1);
+
+			boost::uint32_t i = hash & mask();
+			while (slots[i].used) {
+				i = (i + 1) & mask();
+			}
+
+			Entry &entry = slots[i];
+			entry.filename.assign(filename.data(), filename.size());
+			memset(&entry.info, 0, sizeof(struct stat));
+			entry.lastResult = -1;
+			entry.lastErrno = 0;
+			entry.lastTime = 0;
+			entry.hash = hash;
+			entry.used = true;
+			lruPushFront(i);
+			count++;
+			return i;
 		}
 	};
 
-	typedef boost::shared_ptr<Entry> EntryPtr;
-	typedef list<EntryPtr> EntryList;
-	typedef StringMap<EntryList::iterator> EntryMap;
+	Stripe *stripes;
+	unsigned int stripeCount;
 
-	unsigned int maxSize;
-	EntryList entries;
-	EntryMap cache;
+	static boost::uint32_t hashFilename(const StaticString &filename) {
+		Hasher h;
+		h.update(filename.data(), filename.size());
+		return h.finalize();
+	}
 
+	Stripe &getStripe(boost::uint32_t hash) const {
+		// The lower bits select the table slot.
+		return stripes[(hash >> 16) & (stripeCount - 1)];
+	}
+
+	unsigned int getStripeMaxSize(unsigned int maxSize) const {
+		if (maxSize == 0) {
+			return 0;
+		} else {
+			return (maxSize + stripeCount - 1) / stripeCount;
+		}
+	}
+
+public:
 	/**
 	 * Creates a new CachedFileStat object.
 	 *
 	 * @param maxSize The maximum cache size. A size of 0 means unlimited.
+	 * @param concurrency The number of threads that are expected to use
+	 *        this object concurrently. Determines the number of stripes;
+	 *        it is rounded up to a power of 2 and capped at 64.
 	 */
-	CachedFileStat(unsigned int maxSize = 0) {
-		this->maxSize = maxSize;
+	CachedFileStat(unsigned int maxSize = 0, unsigned int concurrency = 1) {
+		stripeCount = 1;
+		while (stripeCount < concurrency && stripeCount < 64) {
+			stripeCount *= 2;
+		}
+		stripes = new Stripe[stripeCount];
+		setMaxSize(maxSize);
+	}
+
+	~CachedFileStat() {
+		delete[] stripes;
 	}
 
 	/**
@@ -176,63 +371,88 @@ public:
 	 * @throws boost::thread_interrupted
 	 */
 	int stat(const StaticString &filename, struct stat *buf, unsigned int throttleRate = 0) {
-		EntryList::iterator it(cache.get(filename, entries.end()));
-		EntryPtr entry;
-		int ret;
-
-		if (it == entries.end()) {
-			// Filename not in cache.
-			// If cache is full, remove the least recently used
-			// cache entry.
-			if (maxSize != 0 && cache.size() == maxSize) {
-				EntryList::iterator listEnd(entries.end());
-				listEnd--;
-				string filename2((*listEnd)->filename);
-				entries.pop_back();
-				cache.remove(filename2);
-			}
-
-			// Add to cache as most recently used.
-			entry = boost::make_shared<Entry>(filename);
-			entries.push_front(entry);
-			cache.set(filename, entries.begin());
+		boost::uint32_t hash = hashFilename(filename);
+		Stripe &stripe = getStripe(hash);
+		time_t currentTime = SystemTime::get();
+		boost::uint32_t i;
+
+		{
+			boost::lock_guard<boost::mutex> l(stripe.syncher);
+			i = stripe.find(filename, hash);
+			if (i == NONE) {
+				stripe.insert(filename, hash);
+			} else {
+				stripe.touch(i);
+				const Entry &entry = stripe.slots[i];
+				if ((unsigned int) (currentTime - entry.lastTime) < throttleRate) {
+					*buf = entry.info;
+					errno = entry.lastErrno;
+					return entry.lastResult;
+				}
+			}
+		}
+
+		// Not cached or expired. Call stat() without holding the lock.
+		char path[PATH_MAX];
+		int ret, e;
+		if (OXT_UNLIKELY(filename.size() >= sizeof(path))) {
+			ret = -1;
+			e = ENAMETOOLONG;
 		} else {
-			// Cache hit.
-			entry = *it;
+			memcpy(path, filename.data(), filename.size());
+			path[filename.size()] = '\0';
+			ret = syscalls::stat(path, buf);
+			e = (ret == -1) ? errno : 0;
+		}
+		if (ret == -1) {
+			memset(buf, 0, sizeof(struct stat));
+		}
 
-			// Mark this cache item as most recently used.
-			entries.splice(entries.begin(), entries, it);
-			cache.set(filename, entries.begin());
+		{
+			// The entry may have been moved or evicted in the meantime.
+			boost::lock_guard<boost::mutex> l(stripe.syncher);
+			i = stripe.find(filename, hash);
+			if (i != NONE) {
+				Entry &entry = stripe.slots[i];
+				entry.info = *buf;
+				entry.lastResult = ret;
+				entry.lastErrno = e;
+				entry.lastTime = currentTime;
+			}
 		}
-		ret = entry->refresh(throttleRate);
-		*buf = entry->info;
+
+		errno = e;
 		return ret;
 	}
 
 	/**
-	 * Change the maximum size of the cache. If the new size is larger
-	 * than the old size, then the oldest entries in the cache are
-	 * removed.
+	 * Change the maximum size of the cache. If the new size is smaller
+	 * than the old size, then the least recently used entries in the
+	 * cache are removed.
 	 *
 	 * A size of 0 means unlimited.
 	 */
 	void setMaxSize(unsigned int maxSize) {
-		if (maxSize != 0) {
-			int toRemove = cache.size() - maxSize;
-			for (int i = 0; i < toRemove; i++) {
-				string filename(entries.back()->filename);
-				entries.pop_back();
-				cache.remove(filename);
-			}
+		unsigned int stripeMaxSize = getStripeMaxSize(maxSize);
+		for (unsigned int i = 0; i < stripeCount; i++) {
+			Stripe &stripe = stripes[i];
+			boost::lock_guard<boost::mutex> l(stripe.syncher);
+			stripe.maxSize = stripeMaxSize;
+			stripe.evictExcessEntries();
+			// Preallocate so that a bounded cache never rehashes
+			// while serving requests.
+			stripe.reserve(stripeMaxSize);
 		}
-		this->maxSize = maxSize;
 	}
 
 	/**
 	 * Returns whether `filename` is in the cache.
 	 */
 	bool knows(const StaticString &filename) const {
-		return cache.has(filename);
+		boost::uint32_t hash = hashFilename(filename);
+		Stripe &stripe = getStripe(hash);
+		boost::lock_guard<boost::mutex> l(stripe.syncher);
+		return stripe.find(filename, hash) != NONE;
 	}
 };
 
@@ -0,0 +1,224 @@
+/*
+ *  Phusion Passenger - https://www.phusionpassenger.com/
+ *  Copyright (c) 2018 Phusion Holding B.V.
+ *
+ *  "Passenger", "Phusion Passenger" and "Union Station" are registered
+ *  trademarks of Phusion Holding B.V.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+#ifndef _PASSENGER_UTILS_CPU_AFFINITY_H_
+#define _PASSENGER_UTILS_CPU_AFFINITY_H_
+
+#ifdef __linux__
+	#define PASSENGER_SUPPORTS_CPU_AFFINITY
+	#include <sched.h>
+	#include <pthread.h>
+#endif
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include <StaticString.h>
+#include <Exceptions.h>
+#include <FileTools/FileManip.h>
+#include <Utils/StrIntUtils.h>
+
+namespace Passenger {
+
+using namespace std;
+
+
+/**
+ * Parses a CPU list in the format used by sysfs and taskset(1), such as
+ * "0-3,8,10-11", into a sorted list of CPU numbers without duplicates.
+ * Returns false if `str` is not a valid CPU list.
+ */
+inline bool
+parseCpuList(const StaticString &str, vector<unsigned int> &cpus) {
+	const char *pos = str.data();
+	const char *end = str.data() + str.size();
+
+	cpus.clear();
+	while (pos < end && (*pos == ' ' || *pos == '\n')) {
+		pos++;
+	}
+	while (end > pos && (end[-1] == ' ' || end[-1] == '\n')) {
+		end--;
+	}
+	if (pos == end) {
+		return false;
+	}
+
+	while (pos < end) {
+		unsigned int first = 0, last;
+		const char *numberStart = pos;
+
+		while (pos < end && *pos >= '0' && *pos <= '9') {
+			first = first * 10 + (*pos - '0');
+			pos++;
+		}
+		if (pos == numberStart || pos - numberStart > 5) {
+			return false;
+		}
+
+		if (pos < end && *pos == '-') {
+			pos++;
+			numberStart = pos;
+			last = 0;
+			while (pos < end && *pos >= '0' && *pos <= '9') {
+				last = last * 10 + (*pos - '0');
+				pos++;
+			}
+			if (pos == numberStart || pos - numberStart > 5 || last < first) {
+				return false;
+			}
+		} else {
+			last = first;
+		}
+
+		for (unsigned int cpu = first; cpu <= last; cpu++) {
+			cpus.push_back(cpu);
+		}
+
+		if (pos < end) {
+			if (*pos != ',' || pos + 1 == end) {
+				return false;
+			}
+			pos++;
+		}
+	}
+
+	std::sort(cpus.begin(), cpus.end());
+	cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+	return true;
+}
+
+/**
+ * Formats a sorted list of CPU numbers as a CPU list, the reverse of
+ * `parseCpuList()`.
+ */
+inline string
+formatCpuList(const vector<unsigned int> &cpus) {
+	string result;
+	unsigned int i = 0;
+
+	while (i < cpus.size()) {
+		unsigned int j = i;
+		while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) {
+			j++;
+		}
+		if (!result.empty()) {
+			result.append(1, ',');
+		}
+		result.append(toString(cpus[i]));
+		if (j > i) {
+			result.append(1, '-');
+			result.append(toString(cpus[j]));
+		}
+		i = j + 1;
+	}
+
+	return result;
+}
+
+/**
+ * Returns the CPUs of each NUMA node, keyed by node number, as reported by
+ * sysfs. Returns an empty map if the NUMA topology cannot be determined,
+ * e.g. on non-Linux systems or if the kernel was built without NUMA support.
+ */
+inline map< unsigned int, vector<unsigned int> >
+getNumaNodeCpus() {
+	map< unsigned int, vector<unsigned int> > result;
+	#ifdef __linux__
+		vector<unsigned int> nodes;
+		vector<unsigned int>::const_iterator it;
+
+		try {
+			if (!parseCpuList(unsafeReadFile("/sys/devices/system/node/online"), nodes)) {
+				return result;
+			}
+			for (it = nodes.begin(); it != nodes.end(); it++) {
+				vector<unsigned int> &cpus = result[*it];
+				// Memory-only nodes have an empty CPU list.
+				parseCpuList(unsafeReadFile("/sys/devices/system/node/node"
+					+ toString(*it) + "/cpulist"), cpus);
+			}
+		} catch (const SystemException &) {
+			result.clear();
+		}
+	#endif
+	return result;
+}
+
+#ifdef PASSENGER_SUPPORTS_CPU_AFFINITY
+	inline void
+	cpuListToCpuSet(const vector<unsigned int> &cpus, cpu_set_t &cpuSet) {
+		vector<unsigned int>::const_iterator it;
+
+		CPU_ZERO(&cpuSet);
+		for (it = cpus.begin(); it != cpus.end(); it++) {
+			if (*it < CPU_SETSIZE) {
+				CPU_SET(*it, &cpuSet);
+			}
+		}
+	}
+
+	inline vector<unsigned int>
+	cpuSetToCpuList(const cpu_set_t &cpuSet) {
+		vector<unsigned int> result;
+		for (unsigned int i = 0; i < CPU_SETSIZE; i++) {
+			if (CPU_ISSET(i, &cpuSet)) {
+				result.push_back(i);
+			}
+		}
+		return result;
+	}
+
+	/**
+	 * Restricts the given thread to the given CPUs. Returns 0 on success,
+	 * or an errno code on failure.
+	 */
+	inline int
+	setThreadCpuAffinity(pthread_t thread, const vector<unsigned int> &cpus) {
+		cpu_set_t cpuSet;
+		cpuListToCpuSet(cpus, cpuSet);
+		return pthread_setaffinity_np(thread, sizeof(cpuSet), &cpuSet);
+	}
+
+	/**
+	 * Returns the CPUs that the calling thread may run on, as a CPU list.
+	 * Returns an empty string if that cannot be determined.
+	 */
+	inline string
+	getCurrentThreadCpuAffinity() {
+		cpu_set_t cpuSet;
+		if (pthread_getaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0) {
+			return formatCpuList(cpuSetToCpuList(cpuSet));
+		} else {
+			return string();
+		}
+	}
+#endif
+
+
+} // namespace Passenger
+
+#endif /* _PASSENGER_UTILS_CPU_AFFINITY_H_ */
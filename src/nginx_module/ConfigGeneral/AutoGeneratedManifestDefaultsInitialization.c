@@ -273,6 +273,13 @@ set_manifest_autogenerated_app_conf_defaults(manifest_gen_ctx_t *ctx, PsgJsonVal
         sizeof("passenger_max_request_queue_size") - 1,
         100);
 
+    add_manifest_options_container_static_default_str(ctx,
+        options_container,
+        "passenger_routing_policy",
+        sizeof("passenger_routing_policy") - 1,
+        "least_busy",
+        sizeof("least_busy") - 1);
+
     add_manifest_options_container_dynamic_default(ctx,
         options_container,
         "passenger_app_type",
@@ -661,6 +661,18 @@ passenger_conf_set_max_request_queue_size(ngx_conf_t *cf, ngx_command_t *cmd, vo
     return ngx_conf_set_num_slot(cf, cmd, conf);
 }
 
+static char *
+passenger_conf_set_routing_policy(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+    passenger_loc_conf_t *passenger_conf = conf;
+
+    passenger_conf->autogenerated.routing_policy_explicitly_set = 1;
+    record_loc_conf_source_location(cf, passenger_conf,
+        &passenger_conf->autogenerated.routing_policy_source_file,
+        &passenger_conf->autogenerated.routing_policy_source_line);
+
+    return ngx_conf_set_str_slot(cf, cmd, conf);
+}
+
 static char *
 passenger_conf_set_app_type(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
     passenger_loc_conf_t *passenger_conf = conf;
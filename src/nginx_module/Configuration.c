@@ -72,6 +72,8 @@ static ngx_int_t merge_string_array(ngx_conf_t *cf, ngx_array_t **prev,
     ngx_array_t **conf);
 static ngx_int_t merge_string_keyval_table(ngx_conf_t *cf, ngx_array_t **prev,
     ngx_array_t **conf);
+static ngx_int_t register_config_profiles(ngx_conf_t *cf, passenger_loc_conf_t *conf,
+    ngx_array_t *registered);
 
 
 #include "LocationConfig/AutoGeneratedMergeFunction.c"
@@ -265,6 +267,8 @@ passenger_create_loc_conf(ngx_conf_t *cf)
     conf->options_cache.len   = 0;
     conf->env_vars_cache.data = NULL;
     conf->env_vars_cache.len  = 0;
+    conf->config_profile.data = NULL;
+    conf->config_profile.len  = 0;
 
     return conf;
 }
@@ -985,12 +989,99 @@ merge_string_array(ngx_conf_t *cf, ngx_array_t **prev, ngx_array_t **conf)
     return NGX_OK;
 }
 
+static ngx_uint_t
+config_profile_matches(passenger_loc_conf_t *a, passenger_loc_conf_t *b)
+{
+    return a->options_cache.len == b->options_cache.len
+        && a->env_vars_cache.len == b->env_vars_cache.len
+        && ngx_memcmp(a->options_cache.data, b->options_cache.data,
+               a->options_cache.len) == 0
+        && (a->env_vars_cache.len == 0
+            || ngx_memcmp(a->env_vars_cache.data, b->env_vars_cache.data,
+                   a->env_vars_cache.len) == 0);
+}
+
+/*
+ * Assigns a config profile ID to the given location configuration and to all
+ * its descendants. Locations with identical options share a profile. The
+ * profiles are handed to the Passenger core on startup through the
+ * `config_profiles` option, so that for each request we only have to send the
+ * profile ID instead of the entire options_cache and env_vars_cache.
+ */
+static ngx_int_t
+register_config_profiles(ngx_conf_t *cf, passenger_loc_conf_t *conf,
+    ngx_array_t *registered)
+{
+    passenger_loc_conf_t **others, **children, **elem;
+    ngx_uint_t             i;
+    u_char                *id, *data, *pos;
+    size_t                 len;
+
+    if (conf->options_cache.data != NULL) {
+        others = registered->elts;
+        for (i = 0; i < registered->nelts; i++) {
+            if (config_profile_matches(others[i], conf)) {
+                conf->config_profile = others[i]->config_profile;
+                break;
+            }
+        }
+
+        if (conf->config_profile.data == NULL) {
+            id = ngx_pnalloc(cf->pool, NGX_INT_T_LEN + 1);
+            if (id == NULL) {
+                return NGX_ERROR;
+            }
+            pos = ngx_snprintf(id, NGX_INT_T_LEN, "%ui", registered->nelts + 1);
+            *pos = '\0';
+            conf->config_profile.data = id;
+            conf->config_profile.len  = pos - id;
+
+            len = conf->options_cache.len;
+            if (conf->env_vars_cache.data != NULL) {
+                len += sizeof("!~PASSENGER_ENV_VARS: \r\n") - 1
+                    + conf->env_vars_cache.len;
+            }
+            data = pos = ngx_pnalloc(cf->temp_pool, len);
+            if (data == NULL) {
+                return NGX_ERROR;
+            }
+            pos = ngx_copy(pos, conf->options_cache.data, conf->options_cache.len);
+            if (conf->env_vars_cache.data != NULL) {
+                pos = ngx_copy(pos, "!~PASSENGER_ENV_VARS: ",
+                    sizeof("!~PASSENGER_ENV_VARS: ") - 1);
+                pos = ngx_copy(pos, conf->env_vars_cache.data,
+                    conf->env_vars_cache.len);
+                pos = ngx_copy(pos, "\r\n", sizeof("\r\n") - 1);
+            }
+            psg_json_value_set_str(passenger_main_conf.config_profiles,
+                (const char *) id, (const char *) data, len);
+
+            elem = ngx_array_push(registered);
+            if (elem == NULL) {
+                return NGX_ERROR;
+            }
+            *elem = conf;
+        }
+    }
+
+    children = conf->children.elts;
+    for (i = 0; i < conf->children.nelts; i++) {
+        if (register_config_profiles(cf, children[i], registered) != NGX_OK) {
+            return NGX_ERROR;
+        }
+    }
+
+    return NGX_OK;
+}
+
 ngx_int_t
 passenger_postprocess_config(ngx_conf_t *cf)
 {
     ngx_http_conf_ctx_t  *http_ctx;
     passenger_loc_conf_t *toplevel_plcf;
     ngx_pool_cleanup_t   *manifest_cleanup;
+    ngx_pool_cleanup_t   *config_profiles_cleanup;
+    ngx_array_t           registered_config_profiles;
     char                 *dump_path, *dump_content;
     FILE                 *dump_file;
     u_char               *end;
@@ -1009,6 +1100,22 @@ passenger_postprocess_config(ngx_conf_t *cf)
     manifest_cleanup->handler = (ngx_pool_cleanup_pt) psg_json_value_free;
     manifest_cleanup->data = passenger_main_conf.manifest;
 
+    passenger_main_conf.config_profiles = psg_json_value_new_with_type(
+        PSG_JSON_VALUE_TYPE_OBJECT);
+    config_profiles_cleanup = ngx_pool_cleanup_add(cf->pool, 0);
+    config_profiles_cleanup->handler = (ngx_pool_cleanup_pt) psg_json_value_free;
+    config_profiles_cleanup->data = passenger_main_conf.config_profiles;
+    if (ngx_array_init(&registered_config_profiles, cf->temp_pool, 16,
+                       sizeof(passenger_loc_conf_t *))
+        != NGX_OK
+     || register_config_profiles(cf, toplevel_plcf, &registered_config_profiles)
+        != NGX_OK)
+    {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "cannot register " PROGRAM_NAME " configuration profiles");
+        return NGX_ERROR;
+    }
+
     if (passenger_main_conf.autogenerated.dump_config_manifest.len != 0) {
         dump_path = (char *) ngx_pnalloc(cf->temp_pool,
             passenger_main_conf.autogenerated.dump_config_manifest.len + 1);
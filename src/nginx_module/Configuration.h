@@ -38,6 +38,7 @@ struct passenger_main_conf_s {
     passenger_autogenerated_main_conf_t autogenerated;
     ngx_str_t     default_ruby;
     PsgJsonValue *manifest;
+    PsgJsonValue *config_profiles;
 };
 
 struct passenger_loc_conf_s {
@@ -63,6 +64,10 @@ struct passenger_loc_conf_s {
     /** Raw HTTP header data for this location are cached here. */
     ngx_str_t    options_cache;
     ngx_str_t    env_vars_cache;
+    /** ID under which the above data is registered with the Passenger core.
+     * See register_config_profiles() in Configuration.c.
+     */
+    ngx_str_t    config_profile;
 };
 
 #ifndef _PASSENGER_NGINX_MODULE_CONF_STRUCT_TYPEDEFS_H_
@@ -757,18 +757,31 @@ construct_request_buffer(ngx_http_request_t *r, passenger_loc_conf_t *slcf,
     total_size += state->app_type.len;
     PUSH_STATIC_STR("\r\n");
 
-    if (b != NULL) {
-        b->last = ngx_copy(b->last, slcf->options_cache.data, slcf->options_cache.len);
-    }
-    total_size += slcf->options_cache.len;
-
-    if (slcf->env_vars_cache.data != NULL) {
-        PUSH_STATIC_STR("!~PASSENGER_ENV_VARS: ");
+    if (slcf->config_profile.data != NULL) {
+        /* The options were registered with the Passenger core at startup,
+         * so we only have to tell it which set of options applies.
+         */
+        PUSH_STATIC_STR("!~PASSENGER_CONFIG_PROFILE: ");
         if (b != NULL) {
-            b->last = ngx_copy(b->last, slcf->env_vars_cache.data, slcf->env_vars_cache.len);
+            b->last = ngx_copy(b->last, slcf->config_profile.data,
+                slcf->config_profile.len);
         }
-        total_size += slcf->env_vars_cache.len;
+        total_size += slcf->config_profile.len;
         PUSH_STATIC_STR("\r\n");
+    } else {
+        if (b != NULL) {
+            b->last = ngx_copy(b->last, slcf->options_cache.data, slcf->options_cache.len);
+        }
+        total_size += slcf->options_cache.len;
+
+        if (slcf->env_vars_cache.data != NULL) {
+            PUSH_STATIC_STR("!~PASSENGER_ENV_VARS: ");
+            if (b != NULL) {
+                b->last = ngx_copy(b->last, slcf->env_vars_cache.data, slcf->env_vars_cache.len);
+            }
+            total_size += slcf->env_vars_cache.len;
+            PUSH_STATIC_STR("\r\n");
+        }
     }
 
     /* D = Dechunk response
@@ -71,6 +71,8 @@ passenger_create_autogenerated_loc_conf(passenger_autogenerated_loc_conf_t  *con
     conf->spawn_method.len  = 0;
     conf->load_shell_envvars = NGX_CONF_UNSET;
     conf->max_request_queue_size = NGX_CONF_UNSET_UINT;
+    conf->routing_policy.data = NULL;
+    conf->routing_policy.len  = 0;
     conf->app_type.data = NULL;
     conf->app_type.len  = 0;
     conf->startup_file.data = NULL;
@@ -175,6 +177,10 @@ passenger_create_autogenerated_loc_conf(passenger_autogenerated_loc_conf_t  *con
     conf->max_request_queue_size_source_file.len = 0;
     conf->max_request_queue_size_source_line = 0;
     conf->max_request_queue_size_explicitly_set = 0;
+    conf->routing_policy_source_file.data = NULL;
+    conf->routing_policy_source_file.len = 0;
+    conf->routing_policy_source_line = 0;
+    conf->routing_policy_explicitly_set = 0;
     conf->app_type_source_file.data = NULL;
     conf->app_type_source_file.len = 0;
     conf->app_type_source_line = 0;
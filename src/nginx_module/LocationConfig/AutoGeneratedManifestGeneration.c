@@ -317,6 +317,20 @@ generate_config_manifest_for_autogenerated_loc_conf(manifest_gen_ctx_t *ctx, pas
         psg_json_value_set_uint(hierarchy_member, "value",
             plcf->autogenerated.max_request_queue_size);
     }
+    if (plcf->autogenerated.routing_policy_explicitly_set) {
+        find_or_create_manifest_app_and_loc_options_containers(ctx,
+            plcf, cscf, clcf, &app_options_container, &loc_options_container);
+        option_container = find_or_create_manifest_option_container(ctx,
+            app_options_container,
+            "passenger_routing_policy",
+            sizeof("passenger_routing_policy") - 1);
+        hierarchy_member = add_manifest_option_container_hierarchy_member(option_container,
+            &plcf->autogenerated.routing_policy_source_file,
+            plcf->autogenerated.routing_policy_source_line);
+        psg_json_value_set_str(hierarchy_member, "value",
+            (const char *) plcf->autogenerated.routing_policy.data,
+            plcf->autogenerated.routing_policy.len);
+    }
     if (plcf->autogenerated.app_type_explicitly_set) {
         find_or_create_manifest_app_and_loc_options_containers(ctx,
             plcf, cscf, clcf, &app_options_container, &loc_options_container);
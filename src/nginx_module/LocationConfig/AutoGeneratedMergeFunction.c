@@ -107,6 +107,9 @@ passenger_merge_autogenerated_loc_conf(passenger_autogenerated_loc_conf_t *conf,
     ngx_conf_merge_uint_value(conf->max_request_queue_size,
         prev->max_request_queue_size,
         100);
+    ngx_conf_merge_str_value(conf->routing_policy,
+        prev->routing_policy,
+        "least_busy");
     ngx_conf_merge_str_value(conf->app_type,
         prev->app_type,
         NULL);
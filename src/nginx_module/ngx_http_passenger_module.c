@@ -359,6 +359,7 @@ start_watchdog(ngx_cycle_t *cycle) {
     psg_json_value_set_bool      (w_config, "multi_app", 1);
     psg_json_value_set_bool      (w_config, "default_load_shell_envvars", 1);
     psg_json_value_set_value     (w_config, "config_manifest", -1, passenger_main_conf.manifest);
+    psg_json_value_set_value     (w_config, "config_profiles", -1, passenger_main_conf.config_profiles);
     psg_json_value_set_ngx_uint  (w_config, "log_level", autogenerated_main_conf->log_level);
     psg_json_value_set_ngx_str_ne(w_config, "file_descriptor_log_target", &autogenerated_main_conf->file_descriptor_log_file);
     psg_json_value_set_ngx_uint  (w_config, "core_file_descriptor_ulimit", autogenerated_main_conf->core_file_descriptor_ulimit);
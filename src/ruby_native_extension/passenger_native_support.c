@@ -146,6 +146,67 @@ split_by_null_into_hash(VALUE self, VALUE data) {
 	return result;
 }
 
+/**
+ * Parse a header that was sent with version 2 of the session protocol into a
+ * hash. _names_ is an array that maps field IDs to names: ID n refers to
+ * element n - 1. Returns nil if the data is malformed.
+ */
+static VALUE
+parse_session2_header(VALUE self, VALUE data, VALUE names) {
+	const unsigned char *cdata = (const unsigned char *) RSTRING_PTR(data);
+	unsigned long len = RSTRING_LEN(data);
+	unsigned long pos = 1;
+	unsigned long name_size, value_size;
+	unsigned int id;
+	VALUE result, key;
+
+	Check_Type(names, T_ARRAY);
+	result = rb_hash_new();
+	while (pos < len) {
+		id = cdata[pos];
+		pos++;
+		if (id == 0) {
+			if (len - pos < 2) {
+				return Qnil;
+			}
+			name_size = ((unsigned long) cdata[pos] << 8) | cdata[pos + 1];
+			pos += 2;
+			if (len - pos < name_size) {
+				return Qnil;
+			}
+			key = rb_str_substr(data, pos, name_size);
+			pos += name_size;
+		} else {
+			if ((long) id > RARRAY_LEN(names)) {
+				return Qnil;
+			}
+			key = rb_ary_entry(names, id - 1);
+		}
+
+		if (len - pos < 2) {
+			return Qnil;
+		}
+		value_size = ((unsigned long) cdata[pos] << 8) | cdata[pos + 1];
+		pos += 2;
+		if (value_size == 0xFFFF) {
+			if (len - pos < 4) {
+				return Qnil;
+			}
+			value_size = ((unsigned long) cdata[pos] << 24)
+				| ((unsigned long) cdata[pos + 1] << 16)
+				| ((unsigned long) cdata[pos + 2] << 8)
+				| cdata[pos + 3];
+			pos += 4;
+		}
+		if (len - pos < value_size) {
+			return Qnil;
+		}
+		rb_hash_aset(result, key, rb_str_substr(data, pos, value_size));
+		pos += value_size;
+	}
+	return result;
+}
+
 typedef struct {
 	/* The IO vectors in this group. */
 	struct iovec *io_vectors;
@@ -977,6 +1038,7 @@ Init_passenger_native_support() {
 
 	rb_define_singleton_method(mNativeSupport, "disable_stdio_buffering", disable_stdio_buffering, 0);
 	rb_define_singleton_method(mNativeSupport, "split_by_null_into_hash", split_by_null_into_hash, 1);
+	rb_define_singleton_method(mNativeSupport, "parse_session2_header", parse_session2_header, 2);
 	rb_define_singleton_method(mNativeSupport, "writev", f_writev, 2);
 	rb_define_singleton_method(mNativeSupport, "writev2", f_writev2, 3);
 	rb_define_singleton_method(mNativeSupport, "writev3", f_writev3, 4);
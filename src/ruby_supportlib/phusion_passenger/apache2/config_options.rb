@@ -390,6 +390,12 @@
     :default_expr => 'DEFAULT_MAX_REQUEST_QUEUE_SIZE',
     :desc      => 'The maximum number of queued requests.'
   },
+  {
+    :name      => 'PassengerRoutingPolicy',
+    :type      => :string,
+    :default   => DEFAULT_ROUTING_POLICY,
+    :desc      => "How to route requests among the application's processes: 'least_busy', 'response_time' or 'two_random_choices'."
+  },
   {
     :name      => 'PassengerMaxPreloaderIdleTime',
     :type      => :integer,
@@ -33,6 +33,7 @@ module Config
       ["restart-app", "RestartAppCommand"],
       ["list-instances", "ListInstancesCommand"],
       ["reopen-logs", "ReopenLogsCommand"],
+      ["restart-core", "RestartCoreCommand"],
       ["api-call", "ApiCallCommand"],
       ["validate-install", "ValidateInstallCommand"],
       ["build-native-support", "BuildNativeSupportCommand"],
@@ -94,6 +95,8 @@ def self.help(all = false)
       puts "  restart-app            Restart an application"
       puts "  reopen-logs            Instruct #{PROGRAM_NAME} agents to reopen their log"
       puts "                         files"
+      puts "  restart-core           Gracefully restart the #{PROGRAM_NAME} core without"
+      puts "                         refusing connections"
       puts "  api-call               Makes an API call to a #{PROGRAM_NAME} agent."
       puts
       puts "Informational commands:"
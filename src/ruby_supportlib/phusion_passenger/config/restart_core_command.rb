@@ -0,0 +1,99 @@
+#  Phusion Passenger - https://www.phusionpassenger.com/
+#  Copyright (c) 2018 Phusion Holding B.V.
+#
+#  "Passenger", "Phusion Passenger" and "Union Station" are registered
+#  trademarks of Phusion Holding B.V.
+#
+#  Permission is hereby granted, free of charge, to any person obtaining a copy
+#  of this software and associated documentation files (the "Software"), to deal
+#  in the Software without restriction, including without limitation the rights
+#  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+#  copies of the Software, and to permit persons to whom the Software is
+#  furnished to do so, subject to the following conditions:
+#
+#  The above copyright notice and this permission notice shall be included in
+#  all copies or substantial portions of the Software.
+#
+#  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+#  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+#  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+#  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+#  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+#  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+#  THE SOFTWARE.
+
+require 'optparse'
+require 'net/http'
+require 'socket'
+PhusionPassenger.require_passenger_lib 'constants'
+PhusionPassenger.require_passenger_lib 'admin_tools/instance_registry'
+PhusionPassenger.require_passenger_lib 'config/command'
+PhusionPassenger.require_passenger_lib 'config/utils'
+PhusionPassenger.require_passenger_lib 'utils/json'
+
+module PhusionPassenger
+  module Config
+
+    class RestartCoreCommand < Command
+      include PhusionPassenger::Config::Utils
+
+      def run
+        parse_options
+        select_passenger_instance
+        perform_restart_core
+      end
+
+    private
+      def self.create_option_parser(options)
+        OptionParser.new do |opts|
+          nl = "\n" + ' ' * 37
+          opts.banner = "Usage: passenger-config restart-core [OPTIONS]\n"
+          opts.separator ""
+          opts.separator "  Gracefully restart the #{PROGRAM_NAME} core, for example to activate an"
+          opts.separator "  upgraded #{PROGRAM_NAME} agent binary. The new core takes over the"
+          opts.separator "  sockets and the application processes of the current one, which"
+          opts.separator "  finishes its requests before exiting, so no connections are refused"
+          opts.separator "  during the restart. This command returns immediately; the restart"
+          opts.separator "  happens in the background."
+          opts.separator ""
+
+          opts.separator "Options:"
+          opts.on("--controller-threads NUMBER", Integer, "Run the new core with the given number#{nl}" +
+            "of controller threads") do |value|
+            if value < 1
+              abort "*** ERROR: the number of controller threads must be at least 1"
+            end
+            options[:controller_threads] = value
+          end
+          opts.on("--instance NAME", String, "The #{PROGRAM_NAME} instance to select") do |value|
+            options[:instance] = value
+          end
+          opts.on("-h", "--help", "Show this help") do
+            options[:help] = true
+          end
+        end
+      end
+
+      def perform_restart_core
+        puts "Gracefully restarting #{PROGRAM_NAME} core"
+        request = Net::HTTP::Post.new("/restart_core.json")
+        try_performing_full_admin_basic_auth(request, @instance)
+        request.content_type = "application/json"
+        if @options[:controller_threads]
+          request.body = PhusionPassenger::Utils::JSON.generate(
+            :controller_threads => @options[:controller_threads])
+        end
+        response = @instance.http_request("agents.s/watchdog_api", request)
+        if response.code.to_i == 401
+          print_full_admin_command_permission_error
+          abort
+        elsif response.code.to_i / 100 != 2
+          STDERR.puts "*** An error occured while communicating with the #{PROGRAM_NAME} watchdog (code #{response.code}):"
+          STDERR.puts response.body
+          abort
+        end
+      end
+    end
+
+  end # module Config
+end # module PhusionPassenger
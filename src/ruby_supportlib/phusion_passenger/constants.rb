@@ -65,6 +65,7 @@ module SharedConstants
     DEFAULT_APP_THREAD_COUNT = 1
     DEFAULT_RESPONSE_BUFFER_HIGH_WATERMARK = 1024 * 1024 * 128
     DEFAULT_MAX_REQUEST_QUEUE_SIZE = 100
+    DEFAULT_ROUTING_POLICY = "least_busy"
     DEFAULT_STAT_THROTTLE_RATE = 10
     DEFAULT_ANALYTICS_LOG_USER = DEFAULT_WEB_APP_USER
     DEFAULT_ANALYTICS_LOG_GROUP = ""
@@ -85,11 +86,18 @@ module SharedConstants
     # also introduce context switching and smaller transfer writes. The size is picked
     # to balance this out.
     DEFAULT_MBUF_CHUNK_SIZE = 1024 * 4
+    # Each thread keeps at most this many bytes worth of free mbuf blocks around
+    # for reuse. Beyond that, free blocks are returned to the OS.
+    DEFAULT_MBUF_SPARE_MEMORY_HIGH_WATERMARK = 1024 * 1024 * 8
     # Affects input and output buffering (between app and client). Threshold is picked
     # such that it fits most output (i.e. html page size, not assets), and allows for
     # high concurrency with low mem overhead. On the upload side there is a penalty
     # but there's no real average upload size anyway so we choose mem safety instead.
     DEFAULT_FILE_BUFFERED_CHANNEL_THRESHOLD = 1024 * 128
+    # Submission queue size of the io_uring instance that FileBufferedChannels
+    # use for buffer file I/O, if enabled. Each channel has at most one
+    # operation in flight.
+    DEFAULT_FILE_BUFFERED_CHANNEL_IO_URING_ENTRIES = 64
     SERVER_KIT_MAX_SERVER_ENDPOINTS = 4
     LOG_MONITORING_MAX_LINES = 200
 
@@ -457,6 +457,12 @@
     :type     => :uinteger,
     :default  => DEFAULT_MAX_REQUEST_QUEUE_SIZE
   },
+  {
+    :name     => 'passenger_routing_policy',
+    :scope    => :application,
+    :type     => :string,
+    :default  => DEFAULT_ROUTING_POLICY
+  },
   {
     :name     => 'passenger_app_type',
     :scope    => :application,
@@ -84,7 +84,13 @@ def initialize(owner_pipe, options = {})
       )
 
       @keepalive = options.fetch("keepalive", true).to_s == "true"
+      # Internal environment variables, for debugging and testing:
+      # - _PASSENGER_FORCE_HTTP_SESSION: speak the "http" protocol on the
+      #   main socket instead of a session protocol.
+      # - _PASSENGER_FORCE_SESSION_V1: use version 1 of the session protocol
+      #   even if the Core supports "session2".
       @force_http_session = ENV["_PASSENGER_FORCE_HTTP_SESSION"] == "true"
+      @force_session_v1 = ENV["_PASSENGER_FORCE_SESSION_V1"] == "true"
       if @force_http_session
         @connect_password = nil
       end
@@ -104,7 +110,7 @@ def initialize(owner_pipe, options = {})
       @server_sockets[:main] = {
         :address     => @main_socket_address,
         :socket      => @main_socket,
-        :protocol    => @force_http_session ? :http : :session,
+        :protocol    => @force_http_session ? :http : preferred_session_protocol(options),
         :concurrency => @concurrency,
         :accept_http_requests => true
       }
@@ -282,6 +288,18 @@ def should_use_unix_sockets?
       return !@force_http_session && ruby_engine != "jruby"
     end
 
+    # Picks the newest version of the session protocol that the Core
+    # advertised during the spawn handshake. Cores that predate the
+    # 'supported_session_protocols' argument only speak "session".
+    def preferred_session_protocol(options)
+      supported = options["supported_session_protocols"] || []
+      if supported.include?("session2") && !@force_session_v1
+        :session2
+      else
+        :session
+      end
+    end
+
     def create_unix_socket_on_filesystem(options)
       if defined?(NativeSupport)
         unix_path_max = NativeSupport::UNIX_PATH_MAX
@@ -373,9 +391,7 @@ def start_threads
       main_socket_options = common_options.merge(
         :server_socket => @main_socket,
         :socket_name => "main socket",
-        :protocol => @server_sockets[:main][:protocol] == :session ?
-          :session :
-          :http
+        :protocol => @server_sockets[:main][:protocol]
       )
       http_socket_options = common_options.merge(
         :server_socket => @http_socket,
@@ -50,6 +50,47 @@ class Interrupted < StandardError
 
       MAX_HEADER_SIZE = 128 * 1024
 
+      # Names of the fields that the "session2" protocol sends as small
+      # integer IDs: ID n refers to element n - 1. Must be kept in sync
+      # with the FieldId enum in Core/Controller/SessionProtocolV2.h.
+      SESSION2_FIELD_NAMES = [
+        'REQUEST_URI',
+        'PATH_INFO',
+        'SCRIPT_NAME',
+        'QUERY_STRING',
+        'REQUEST_METHOD',
+        'SERVER_NAME',
+        'SERVER_PORT',
+        'SERVER_SOFTWARE',
+        'SERVER_PROTOCOL',
+        'REMOTE_ADDR',
+        'REMOTE_PORT',
+        'REMOTE_USER',
+        'CONTENT_TYPE',
+        'CONTENT_LENGTH',
+        'PASSENGER_CONNECT_PASSWORD',
+        'HTTPS',
+        'HTTP_CONNECTION',
+        'HTTP_HOST',
+        'HTTP_USER_AGENT',
+        'HTTP_ACCEPT',
+        'HTTP_ACCEPT_ENCODING',
+        'HTTP_ACCEPT_LANGUAGE',
+        'HTTP_COOKIE',
+        'HTTP_REFERER',
+        'HTTP_CACHE_CONTROL',
+        'HTTP_X_FORWARDED_FOR',
+        'HTTP_X_FORWARDED_PROTO',
+        'HTTP_X_REQUEST_ID',
+        'HTTP_IF_NONE_MATCH',
+        'HTTP_IF_MODIFIED_SINCE',
+        'HTTP_AUTHORIZATION',
+        'HTTP_ORIGIN',
+        'HTTP_UPGRADE',
+        'HTTP_X_REQUESTED_WITH'
+      ].map { |name| name.freeze }.freeze
+      SESSION2_VERSION = 2
+
       OBJECT_SPACE_SUPPORTS_LIVE_OBJECTS      = ObjectSpace.respond_to?(:live_objects)
       OBJECT_SPACE_SUPPORTS_ALLOCATED_OBJECTS = ObjectSpace.respond_to?(:allocated_objects)
       OBJECT_SPACE_SUPPORTS_COUNT_OBJECTS     = ObjectSpace.respond_to?(:count_objects)
@@ -82,6 +123,11 @@ def initialize(request_handler, options = {})
           metaclass.class_eval do
             alias parse_request parse_session_request
           end
+        elsif @protocol == :session2
+          metaclass = class << self; self; end
+          metaclass.class_eval do
+            alias parse_request parse_session2_request
+          end
         elsif @protocol == :http
           metaclass = class << self; self; end
           metaclass.class_eval do
@@ -229,6 +275,40 @@ def parse_session_request(connection, channel, buffer)
         return
       end
 
+      # Like parse_session_request, but parses a header that was sent with
+      # version 2 of the session protocol. Version 1 headers are accepted
+      # as well: the Core still sends those for out-of-band work requests.
+      # A version 1 header never starts with the version byte, because it
+      # starts with a printable variable name.
+      def parse_session2_request(connection, channel, buffer)
+        headers_data = channel.read_scalar(buffer, MAX_HEADER_SIZE)
+        if headers_data.nil?
+          return
+        end
+        if headers_data.getbyte(0) == SESSION2_VERSION
+          headers = Utils::NativeSupportUtils.parse_session2_header(headers_data,
+            SESSION2_FIELD_NAMES)
+          if headers.nil?
+            warn "*** Passenger RequestHandler warning: " <<
+              "received a malformed session protocol header."
+            return
+          end
+        else
+          headers = Utils::NativeSupportUtils.split_by_null_into_hash(headers_data)
+        end
+        if @connect_password && headers[PASSENGER_CONNECT_PASSWORD] != @connect_password
+          warn "*** Passenger RequestHandler warning: " <<
+            "someone tried to connect with an invalid connect password."
+          return
+        else
+          return headers
+        end
+      rescue SecurityError => e
+        warn("*** Passenger RequestHandler warning: " <<
+          "HTTP header size exceeded maximum.")
+        return
+      end
+
       # Like parse_session_request, but parses an HTTP request. This is a very minimalistic
       # HTTP parser and is not intended to be complete, fast or secure, since the HTTP server
       # socket is intended to be used for debugging purposes only.
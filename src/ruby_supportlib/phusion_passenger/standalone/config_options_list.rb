@@ -142,6 +142,28 @@ module Standalone
                       "listening for HTTP on the normal port\n" \
                       '(Nginx engine only)'
       },
+      {
+        :name      => :response_compression,
+        :type      => :boolean,
+        :desc      => "Compress responses with gzip (builtin\n" \
+                      "engine only: the Nginx engine always\n" \
+                      'compresses responses)'
+      },
+      {
+        :name      => :static_file_serving,
+        :type      => :boolean,
+        :cli       => nil
+      },
+      {
+        :type      => :boolean,
+        :cli       => '--disable-static-file-serving',
+        :desc      => "Pass requests for files in the app's\n" \
+                      "public directory to the app instead of\n" \
+                      'serving them directly (builtin engine only)',
+        :cli_parser => lambda do |options, value|
+          options[:static_file_serving] = false
+        end
+      },
       {
         :name      => :daemonize,
         :type      => :boolean,
@@ -415,6 +437,14 @@ module Standalone
         :min       => 0,
         :desc      => "Specify request queue size. Default: #{DEFAULT_MAX_REQUEST_QUEUE_SIZE}"
       },
+      {
+        :name      => :routing_policy,
+        :type_desc => 'NAME',
+        :desc      => "How to route requests among the app's\n" \
+                      "processes: 'least_busy', 'response_time'\n" \
+                      "or 'two_random_choices'.\n" \
+                      "Default: #{DEFAULT_ROUTING_POLICY}"
+      },
       {
         :name      => :sticky_sessions,
         :type      => :boolean,
@@ -161,6 +161,7 @@ def build_daemon_controller_options
           add_param(command, :pool_idle_time, "--pool-idle-time")
           add_param(command, :max_preloader_idle_time, "--max-preloader-idle-time")
           add_param(command, :max_request_queue_size, "--max-request-queue-size")
+          add_param(command, :routing_policy, "--routing-policy")
           add_enterprise_param(command, :concurrency_model, "--concurrency-model")
           add_enterprise_param(command, :thread_count, "--app-thread-count")
           add_param(command, :max_requests, "--max-requests")
@@ -171,6 +172,10 @@ def build_daemon_controller_options
           add_enterprise_flag_param(command, :debugger, "--debugger")
           add_flag_param(command, :sticky_sessions, "--sticky-sessions")
           add_param(command, :vary_turbocache_by_cookie, "--vary-turbocache-by-cookie")
+          add_flag_param(command, :response_compression, "--response-compression")
+          if @options[:static_file_serving] != false
+            command << " --serve-static-files"
+          end
           add_param(command, :sticky_sessions_cookie_name, "--sticky-sessions-cookie-name")
           add_param(command, :ruby, "--ruby")
           add_param(command, :python, "--python")
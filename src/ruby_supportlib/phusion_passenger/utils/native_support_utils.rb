@@ -38,6 +38,17 @@ def split_by_null_into_hash(data)
           return PhusionPassenger::NativeSupport.split_by_null_into_hash(data)
         end
 
+        # Native extensions compiled for an older Passenger version don't
+        # have this function; the Ruby version below is used instead.
+        if PhusionPassenger::NativeSupport.respond_to?(:parse_session2_header)
+          # Parse a header that was sent with version 2 of the session protocol
+          # into a hash. `names` maps field IDs to names. Returns nil if the
+          # data is malformed.
+          def parse_session2_header(data, names)
+            return PhusionPassenger::NativeSupport.parse_session2_header(data, names)
+          end
+        end
+
         # Wrapper for getrusage().
         def process_times
           return PhusionPassenger::NativeSupport.process_times
@@ -60,6 +71,43 @@ def process_times
             (times.stime * 1_000_000).to_i)
         end
       end
+
+      if !method_defined?(:parse_session2_header)
+        # `data` must be a binary string.
+        def parse_session2_header(data, names)
+          result = {}
+          size = data.size
+          pos = 1
+          while pos < size
+            id = data.getbyte(pos)
+            pos += 1
+            if id == 0
+              return nil if pos + 2 > size
+              name_size = (data.getbyte(pos) << 8) | data.getbyte(pos + 1)
+              pos += 2
+              return nil if pos + name_size > size
+              name = data[pos, name_size]
+              pos += name_size
+            else
+              name = names[id - 1]
+              return nil if name.nil?
+            end
+
+            return nil if pos + 2 > size
+            value_size = (data.getbyte(pos) << 8) | data.getbyte(pos + 1)
+            pos += 2
+            if value_size == 0xFFFF
+              return nil if pos + 4 > size
+              value_size = data[pos, 4].unpack('N')[0]
+              pos += 4
+            end
+            return nil if pos + value_size > size
+            result[name] = data[pos, value_size]
+            pos += value_size
+          end
+          return result
+        end
+      end
     end
 
   end # module Utils
@@ -0,0 +1,101 @@
+#include <TestSupport.h>
+#include <Algorithms/LatencyHistogram.h>
+
+using namespace Passenger;
+using namespace std;
+
+namespace tut {
+	struct Algorithms_LatencyHistogramTest {
+		LatencyHistogram histogram;
+	};
+
+	DEFINE_TEST_GROUP(Algorithms_LatencyHistogramTest);
+
+	TEST_METHOD(1) {
+		set_test_name("It is empty upon initialization");
+		ensure_equals(histogram.getTotalCount(), 0u);
+		ensure_equals(histogram.getMin(), 0u);
+		ensure_equals(histogram.getMax(), 0u);
+		ensure_equals(histogram.getMean(), 0.0);
+		ensure_equals(histogram.getValueAtPercentile(50), 0u);
+	}
+
+	TEST_METHOD(2) {
+		set_test_name("Bucket boundaries are contiguous and contain the values that map to them");
+		for (unsigned int i = 0; i < LatencyHistogram::BUCKET_COUNT; i++) {
+			boost::uint64_t lower = LatencyHistogram::bucketLowerBound(i);
+			boost::uint64_t upper = LatencyHistogram::bucketUpperBound(i);
+			ensure("lower <= upper", lower <= upper);
+			ensure_equals(LatencyHistogram::bucketIndexFor(lower), i);
+			ensure_equals(LatencyHistogram::bucketIndexFor(upper), i);
+			if (i > 0) {
+				ensure_equals(LatencyHistogram::bucketUpperBound(i - 1) + 1, lower);
+			}
+		}
+		boost::uint64_t maxValue = LatencyHistogram::MAX_VALUE;
+		ensure_equals(LatencyHistogram::bucketUpperBound(LatencyHistogram::BUCKET_COUNT - 1),
+			maxValue);
+	}
+
+	TEST_METHOD(3) {
+		set_test_name("Small values are recorded exactly");
+		for (unsigned int i = 1; i <= 10; i++) {
+			histogram.record(i);
+		}
+		ensure_equals(histogram.getTotalCount(), 10u);
+		ensure_equals(histogram.getMin(), 1u);
+		ensure_equals(histogram.getMax(), 10u);
+		ensure_equals(histogram.getMean(), 5.5);
+		ensure_equals(histogram.getValueAtPercentile(50), 5u);
+		ensure_equals(histogram.getValueAtPercentile(90), 9u);
+		ensure_equals(histogram.getValueAtPercentile(100), 10u);
+	}
+
+	TEST_METHOD(4) {
+		set_test_name("Large values are recorded with bounded relative error");
+		for (unsigned int i = 1; i <= 1000; i++) {
+			histogram.record(i * 1000);
+		}
+		boost::uint64_t p50 = histogram.getValueAtPercentile(50);
+		boost::uint64_t p99 = histogram.getValueAtPercentile(99);
+		ensure("p50 lower bound", p50 >= 500000);
+		ensure("p50 upper bound", p50 <= 500000 + 500000 / LatencyHistogram::SUB_BUCKET_COUNT);
+		ensure("p99 lower bound", p99 >= 990000);
+		ensure("p99 upper bound", p99 <= 990000 + 990000 / LatencyHistogram::SUB_BUCKET_COUNT);
+		ensure_equals(histogram.getValueAtPercentile(100), 1000000u);
+	}
+
+	TEST_METHOD(5) {
+		set_test_name("Values larger than the maximum are clamped");
+		boost::uint64_t maxValue = LatencyHistogram::MAX_VALUE;
+		histogram.record(maxValue * 4);
+		ensure_equals(histogram.getTotalCount(), 1u);
+		ensure_equals(histogram.getMax(), maxValue);
+	}
+
+	TEST_METHOD(6) {
+		set_test_name("Merging combines counts and extremes");
+		LatencyHistogram other;
+
+		histogram.record(10);
+		histogram.record(20);
+		other.record(5);
+		other.record(5000);
+		histogram.merge(other);
+
+		ensure_equals(histogram.getTotalCount(), 4u);
+		ensure_equals(histogram.getMin(), 5u);
+		ensure_equals(histogram.getMax(), 5000u);
+		ensure_equals(histogram.getMean(), (10 + 20 + 5 + 5000) / 4.0);
+		ensure_equals(histogram.getValueAtPercentile(25), 5u);
+	}
+
+	TEST_METHOD(7) {
+		set_test_name("Resetting empties the histogram");
+		histogram.record(10);
+		histogram.reset();
+		ensure_equals(histogram.getTotalCount(), 0u);
+		ensure_equals(histogram.getMax(), 0u);
+		ensure_equals(histogram.getValueAtPercentile(99), 0u);
+	}
+}
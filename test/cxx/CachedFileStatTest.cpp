@@ -1,6 +1,10 @@
 #include "TestSupport.h"
 #include "Utils/CachedFileStat.hpp"
 #include "Utils/SystemTime.h"
+#include "Utils/StrIntUtils.h"
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <vector>
 #include <sys/types.h>
 #include <utime.h>
 
@@ -399,4 +403,63 @@ namespace tut {
 		ensure("(4)", stat.knows("test4.txt"));
 		ensure("(5)", stat.knows("test5.txt"));
 	}
+	
+	TEST_METHOD(17) {
+		// Evicting many entries keeps the remaining entries reachable.
+		CachedFileStat stat(100);
+		for (int i = 0; i < 300; i++) {
+			stat.stat("test" + toString(i) + ".txt", &buf, 1);
+		}
+		for (int i = 0; i < 200; i++) {
+			ensure("(1) " + toString(i), !stat.knows("test" + toString(i) + ".txt"));
+		}
+		for (int i = 200; i < 300; i++) {
+			ensure("(2) " + toString(i), stat.knows("test" + toString(i) + ".txt"));
+		}
+	}
+	
+	TEST_METHOD(18) {
+		// With multiple stripes, the maximum size is still respected.
+		CachedFileStat stat(64, 8);
+		for (int i = 0; i < 1000; i++) {
+			stat.stat("test" + toString(i) + ".txt", &buf, 1);
+		}
+		unsigned int count = 0;
+		for (int i = 0; i < 1000; i++) {
+			if (stat.knows("test" + toString(i) + ".txt")) {
+				count++;
+			}
+		}
+		ensure("(1)", count > 0);
+		ensure("(2)", count <= 64);
+		ensure("(3)", stat.knows("test999.txt"));
+	}
+	
+	
+	/************ Concurrency ************/
+	
+	static void statManyTimes(CachedFileStat *stat, int base) {
+		struct stat buf;
+		for (int i = 0; i < 2000; i++) {
+			stat->stat("test" + toString(base + i % 50) + ".txt", &buf, 1);
+		}
+	}
+	
+	TEST_METHOD(20) {
+		// It can be used by multiple threads concurrently.
+		SystemTime::force(5);
+		touch("test.txt", 1000);
+		CachedFileStat stat(64, 4);
+		vector<boost::thread *> threads;
+		for (int i = 0; i < 4; i++) {
+			threads.push_back(new boost::thread(boost::bind(statManyTimes,
+				&stat, i * 25)));
+		}
+		for (unsigned int i = 0; i < threads.size(); i++) {
+			threads[i]->join();
+			delete threads[i];
+		}
+		ensure_equals(stat.stat("test.txt", &buf, 1), 0);
+		ensure_equals(buf.st_mtime, (time_t) 1000);
+	}
 }
@@ -1,14 +1,18 @@
 #include <TestSupport.h>
 #include <jsoncpp/json.h>
 #include <Core/ApplicationPool/Pool.h>
+#include <Watchdog/ProcessFdKeeper.h>
 #include <LoggingKit/Context.h>
 #include <FileTools/FileManip.h>
 #include <Utils/StrIntUtils.h>
+#include <Utils/IOUtils.h>
 #include <MessageReadersWriters.h>
 #include <map>
 #include <vector>
 #include <cerrno>
 #include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 using namespace std;
 using namespace Passenger;
@@ -21,6 +25,7 @@ namespace tut {
 		SpawningKit::Context skContext;
 		SpawningKit::FactoryPtr skFactory;
 		Context context;
+		Context context2;
 		PoolPtr pool;
 		Pool::DebugSupportPtr debug;
 		Ticket ticket;
@@ -31,6 +36,8 @@ namespace tut {
 		boost::mutex syncher;
 		list<SessionPtr> sessions;
 		bool retainSessions;
+		PoolPtr pool2;
+		Watchdog::ProcessFdKeeperPtr processFdKeeper;
 
 		Core_ApplicationPool_PoolTest()
 			: skContext(skContextSchema)
@@ -67,9 +74,18 @@ namespace tut {
 			TRACE_POINT();
 			clearAllSessions();
 			UPDATE_TRACE_POINT();
+			if (pool2 != NULL) {
+				pool2->destroy();
+				pool2.reset();
+			}
 			pool->destroy();
 			UPDATE_TRACE_POINT();
 			pool.reset();
+			context.processFdKeeper.reset();
+			processFdKeeper.reset();
+			unlink("tmp.keeper");
+			unlink("tmp.snapshot");
+			unlink("tmp.adopt");
 
 			Json::Value config;
 			vector<ConfigKit::Error> errors;
@@ -86,6 +102,28 @@ namespace tut {
 			SystemTime::releaseAll();
 		}
 
+		unsigned int countSnapshotProcesses() {
+			Json::Value doc;
+			Json::Reader reader;
+			if (!fileExists("tmp.snapshot")
+			 || !reader.parse(unsafeReadFile("tmp.snapshot"), doc))
+			{
+				return 0;
+			}
+			unsigned int result = 0;
+			for (unsigned int i = 0; i < doc["groups"].size(); i++) {
+				result += doc["groups"][i]["processes"].size();
+			}
+			return result;
+		}
+
+		/** Creates a pool like the one that a restarted Core would create. */
+		PoolPtr createSecondPool() {
+			PoolPtr result = boost::make_shared<Pool>(&context);
+			result->initialize();
+			return result;
+		}
+
 		void initPoolDebugging() {
 			pool->initDebugging();
 			debug = pool->debugSupport;
@@ -2032,6 +2070,377 @@ namespace tut {
 		currentSession.reset();
 	}
 
+	TEST_METHOD(80) {
+		// With the 'two_random_choices' routing policy, requests are still
+		// only routed to processes that aren't totally busy, and are only
+		// queued when all processes are totally busy.
+
+		// Spawn 3 processes, each with a concurrency of 1.
+		Options options = createOptions();
+		options.routingPolicy = "two_random_choices";
+		options.minProcesses = 3;
+		pool->setMax(3);
+		GroupPtr group = pool->findOrCreateGroup(options);
+		{
+			LockGuard l(pool->syncher);
+			group->spawn();
+		}
+		EVENTUALLY(5,
+			result = pool->getProcessCount() == 3;
+		);
+
+		SessionPtr session1 = pool->get(options, &ticket);
+		SessionPtr session2 = pool->get(options, &ticket);
+		SessionPtr session3 = pool->get(options, &ticket);
+		ensure("(1)", session1->getPid() != session2->getPid());
+		ensure("(2)", session1->getPid() != session3->getPid());
+		ensure("(3)", session2->getPid() != session3->getPid());
+
+		pool->asyncGet(options, callback);
+		SHOULD_NEVER_HAPPEN(100,
+			result = number > 0;
+		);
+		pid_t pid2 = session2->getPid();
+		session2.reset();
+		EVENTUALLY(1,
+			result = number == 1;
+		);
+		ensure_equals("(4)", currentSession->getPid(), pid2);
+		currentSession.reset();
+	}
+
+	TEST_METHOD(81) {
+		// createSnapshot() describes all groups and processes in such a way
+		// that a restarted Core can find the groups back and re-create the
+		// Process objects.
+		Options options = createOptions();
+		SessionPtr session = pool->get(options, &ticket);
+		ProcessPtr process = session->getProcess()->shared_from_this();
+		session.reset();
+
+		Json::Value doc = pool->createSnapshot();
+		ensure_equals("(1)", doc["groups"].size(), 1u);
+		const Json::Value &groupDoc = doc["groups"][0u];
+		ensure_equals("(2)", groupDoc["uuid"].asString(), process->getGroup()->uuid);
+		ensure_equals("(3)", groupDoc["processes"].size(), 1u);
+		const Json::Value &processDoc = groupDoc["processes"][0u];
+		ensure_equals("(4)", processDoc["pid"].asInt(), (int) process->getPid());
+		ensure_equals("(5)", processDoc["gupid"].asString(),
+			process->getGupid().toString());
+		ensure_equals("(6)", processDoc["sticky_session_id"].asUInt(),
+			process->getStickySessionId());
+
+		Options options2 = Options::createFromSnapshot(groupDoc["options"]);
+		ensure_equals("(7)", options2.getAppGroupName(), options.getAppGroupName());
+		ensure_equals("(8)", options2.appType, options.appType);
+		LockGuard l(pool->syncher);
+		ensure("(9)", pool->findMatchingGroup(options2) == process->getGroup());
+	}
+
+	TEST_METHOD(82) {
+		// toXml() and the admin panel inspection functions render a snapshot
+		// of the groups and processes.
+		Options options = createOptions();
+		SessionPtr session = pool->get(options, &ticket);
+		ProcessPtr process = session->getProcess()->shared_from_this();
+		session.reset();
+
+		string xml = pool->toXml();
+		ensure("(1)", containsSubstring(xml, "<group_count>1</group_count>"));
+		ensure("(2)", containsSubstring(xml, "<name>" + options.getAppGroupName().toString() + "</name>"));
+		ensure("(3)", containsSubstring(xml, "<pid>" + toString(process->getPid()) + "</pid>"));
+		ensure("(4)", containsSubstring(xml, "<gupid>" + process->getGupid().toString() + "</gupid>"));
+		ensure("(5)", containsSubstring(xml, "<enabled>ENABLED</enabled>"));
+		ensure("(6)", containsSubstring(xml, "</info>"));
+
+		Json::Value doc = pool->inspectConfigInAdminPanelFormat();
+		ensure_equals("(7)", doc.size(), 1u);
+		ensure("(8)", doc.isMember(options.getAppGroupName().toString()));
+	}
+
+	TEST_METHOD(83) {
+		// toXml() only includes process sockets if secrets are requested.
+		Options options = createOptions();
+		pool->get(options, &ticket).reset();
+
+		Pool::ToXmlOptions xmlOptions = Pool::ToXmlOptions::makeAuthorized();
+		string xml = pool->toXml(xmlOptions);
+		ensure("(1)", containsSubstring(xml, "<sockets>"));
+		ensure("(2)", containsSubstring(xml, "<address>"));
+
+		xmlOptions.secrets = false;
+		xml = pool->toXml(xmlOptions);
+		ensure("(3)", containsSubstring(xml, "<pid>"));
+		ensure("(4)", !containsSubstring(xml, "<sockets>"));
+		ensure("(5)", !containsSubstring(xml, "<address>"));
+	}
+
+	TEST_METHOD(84) {
+		// With the 'response_time' routing policy, a process that was slow once
+		// gets traffic again later, even though nothing was routed to it in
+		// the mean time, because its response time average decays.
+
+		// Spawn 2 processes, each with a concurrency of 1.
+		Options options = createOptions();
+		options.routingPolicy = "response_time";
+		options.minProcesses = 2;
+		pool->setMax(2);
+		GroupPtr group = pool->findOrCreateGroup(options);
+		{
+			LockGuard l(pool->syncher);
+			group->spawn();
+		}
+		EVENTUALLY(5,
+			result = pool->getProcessCount() == 2;
+		);
+
+		// Make one process respond in 1 ms and the other in 2 seconds.
+		unsigned long long now = SystemTime::getUsec();
+		SystemTime::forceUsec(now);
+		SessionPtr session1 = pool->get(options, &ticket);
+		SessionPtr session2 = pool->get(options, &ticket);
+		pid_t fastPid = session1->getPid();
+		pid_t slowPid = session2->getPid();
+		ensure("(1)", fastPid != slowPid);
+		SystemTime::forceUsec(now + 1000);
+		session1.reset();
+		SystemTime::forceUsec(now + 2000000);
+		session2.reset();
+
+		SystemTime::forceUsec(now + 2200000);
+		for (int i = 0; i < 3; i++) {
+			ensure_equals("(2)", pool->get(options, &ticket)->getPid(), fastPid);
+		}
+
+		// Much later, the fast process has one 50 ms response.
+		SystemTime::forceUsec(now + 20000000);
+		session1 = pool->get(options, &ticket);
+		ensure_equals("(3)", session1->getPid(), fastPid);
+		SystemTime::forceUsec(now + 20050000);
+		session1.reset();
+
+		// By now, the slow process's 2 second response has mostly
+		// been forgotten, so it's preferred.
+		SystemTime::forceUsec(now + 20200000);
+		ensure_equals("(4)", pool->get(options, &ticket)->getPid(), slowPid);
+	}
+
+	TEST_METHOD(86) {
+		// processIsAdoptable() only accepts processes that the keeper knows
+		// under the same PID, that are still alive, and whose sockets still
+		// accept connections.
+		FileDescriptor serverFd(createUnixServer("tmp.adopt"), __FILE__, __LINE__);
+		Json::Value processDoc, socketDoc;
+		ProcessFdKeeperClient::Entry entry;
+
+		processDoc["pid"] = (Json::Int) getpid();
+		socketDoc["address"] = "unix:tmp.adopt";
+		socketDoc["accept_http_requests"] = true;
+		processDoc["sockets"].append(socketDoc);
+		entry.pid = getpid();
+		ensure("(1)", pool->processIsAdoptable(processDoc, entry));
+
+		entry.pid = getpid() + 1;
+		ensure("(2)", !pool->processIsAdoptable(processDoc, entry));
+
+		pid_t pid = fork();
+		if (pid == 0) {
+			_exit(0);
+		}
+		waitpid(pid, NULL, 0);
+		processDoc["pid"] = (Json::Int) pid;
+		entry.pid = pid;
+		ensure("(3)", !pool->processIsAdoptable(processDoc, entry));
+
+		processDoc["pid"] = (Json::Int) getpid();
+		entry.pid = getpid();
+		serverFd.close();
+		unlink("tmp.adopt");
+		ensure("(4)", !pool->processIsAdoptable(processDoc, entry));
+
+		// Sockets that don't accept HTTP requests aren't checked.
+		processDoc["sockets"][0u]["accept_http_requests"] = false;
+		ensure("(5)", pool->processIsAdoptable(processDoc, entry));
+	}
+
+	TEST_METHOD(87) {
+		// adoptProcess() re-creates the group and the process described by
+		// the snapshot, keeping the group's UUID and API key and the process's
+		// sticky session ID.
+		Options options = createOptions();
+		SessionPtr session = pool->get(options, &ticket);
+		ProcessPtr process = session->getProcess()->shared_from_this();
+		session.reset();
+
+		Json::Value doc = pool->createSnapshot();
+		const Json::Value &groupDoc = doc["groups"][0u];
+		const Json::Value &processDoc = groupDoc["processes"][0u];
+		Pipe input = createPipe(__FILE__, __LINE__);
+		Pipe output = createPipe(__FILE__, __LINE__);
+		ProcessFdKeeperClient::Entry entry;
+		entry.gupid = processDoc["gupid"].asString();
+		entry.pid = (pid_t) processDoc["pid"].asInt();
+		entry.input = input.second;
+		entry.output = output.first;
+
+		pool2 = createSecondPool();
+		ensure("(1)", pool2->adoptProcess(groupDoc,
+			Options::createFromSnapshot(groupDoc["options"]), processDoc, entry));
+		ensure_equals("(2)", pool2->getProcessCount(), 1u);
+
+		LockGuard l(pool2->syncher);
+		Group *group = pool2->findMatchingGroup(options);
+		ensure("(3)", group != NULL);
+		ensure_equals("(4)", group->uuid, process->getGroup()->uuid);
+		ensure("(5)", group->getApiKey() == process->getGroup()->getApiKey());
+		ensure_equals("(6)", group->enabledCount, 1);
+		ProcessPtr adopted = group->enabledProcesses[0];
+		ensure_equals("(7)", adopted->getPid(), process->getPid());
+		ensure_equals("(8)", adopted->getGupid(), process->getGupid());
+		ensure_equals("(9)", adopted->getStickySessionId(),
+			process->getStickySessionId());
+	}
+
+	TEST_METHOD(88) {
+		// adoptProcesses() re-adopts the processes that are both in the
+		// snapshot and held by the Watchdog's keeper, and releases the
+		// others so that they exit.
+		Options options = createOptions();
+		pool->get(options, &ticket).reset();
+
+		// Make the dummy process look alive, with a socket that
+		// accepts connections.
+		FileDescriptor serverFd(createUnixServer("tmp.adopt"), __FILE__, __LINE__);
+		Json::Value doc = pool->createSnapshot();
+		Json::Value &processDoc = doc["groups"][0u]["processes"][0u];
+		processDoc["pid"] = (Json::Int) getpid();
+		processDoc["sockets"][0u]["address"] = "unix:tmp.adopt";
+		context.poolSnapshotPath = "tmp.snapshot";
+		pool->writeSnapshot(doc);
+
+		processFdKeeper = boost::make_shared<Watchdog::ProcessFdKeeper>(
+			"unix:tmp.keeper", "secret");
+		ProcessFdKeeperClientPtr keeperClient = boost::make_shared<ProcessFdKeeperClient>(
+			"unix:tmp.keeper", "secret");
+		keeperClient->connect();
+		Pipe input1 = createPipe(__FILE__, __LINE__);
+		Pipe output1 = createPipe(__FILE__, __LINE__);
+		Pipe input2 = createPipe(__FILE__, __LINE__);
+		Pipe output2 = createPipe(__FILE__, __LINE__);
+		keeperClient->keep(processDoc["gupid"].asString(), getpid(),
+			input1.second, output1.first);
+		keeperClient->keep("gupid-unknown", getpid(), input2.second, output2.first);
+		input2.second.close();
+		output2.first.close();
+		keeperClient->flush();
+		context.processFdKeeper = keeperClient;
+
+		pool2 = createSecondPool();
+		ensure_equals("(1)", pool2->adoptProcesses(), 1u);
+		{
+			LockGuard l(pool2->syncher);
+			Group *group = pool2->findMatchingGroup(options);
+			ensure("(2)", group != NULL);
+			ensure_equals("(3)", group->enabledCount, 1);
+			ensure_equals("(4)", group->enabledProcesses[0]->getPid(), getpid());
+		}
+
+		keeperClient->flush();
+		vector<ProcessFdKeeperClient::Entry> entries = keeperClient->fetch();
+		ensure_equals("(5)", entries.size(), 1u);
+		ensure_equals("(6)", entries[0].gupid, processDoc["gupid"].asString());
+
+		setNonBlocking(input2.first);
+		EVENTUALLY(5,
+			char buf[1];
+			result = read(input2.first, buf, 1) == 0;
+		);
+	}
+
+	TEST_METHOD(89) {
+		// prepareForReplacement() writes a final snapshot and stops the
+		// snapshot writer, so that it doesn't overwrite the snapshot of the
+		// Core instance that replaces us. abortReplacement() resumes it.
+		context.poolSnapshotPath = "tmp.snapshot";
+		pool2 = createSecondPool();
+		Options options = createOptions();
+		options.minProcesses = 0;
+		SessionPtr session = pool2->get(options, &ticket);
+		ProcessPtr process = session->getProcess()->shared_from_this();
+		session.reset();
+		EVENTUALLY(5,
+			result = countSnapshotProcesses() == 1;
+		);
+
+		pool2->prepareForReplacement();
+		ensure_equals("(1)", countSnapshotProcesses(), 1u);
+		ensure("(2)", !fileExists("tmp.snapshot." + toString(getpid()) + ".tmp"));
+		pool2->detachProcess(process);
+		SHOULD_NEVER_HAPPEN(300,
+			result = countSnapshotProcesses() != 1;
+		);
+
+		pool2->abortReplacement();
+		EVENTUALLY(5,
+			result = countSnapshotProcesses() == 0;
+		);
+	}
+
+	TEST_METHOD(90) {
+		// During a graceful restart, the new Core adopts the processes that the
+		// old Core handed over, and the old Core leaves them running when it
+		// shuts them down.
+		TempDirCopy dir("stub/wsgi", "tmp.wsgi");
+		Options options = createOptions();
+		options.appRoot = "tmp.wsgi";
+		options.appType = "wsgi";
+		options.startupFile = "passenger_wsgi.py";
+		options.spawnMethod = "direct";
+		options.minProcesses = 0;
+
+		processFdKeeper = boost::make_shared<Watchdog::ProcessFdKeeper>(
+			"unix:tmp.keeper", "secret");
+		ProcessFdKeeperClientPtr keeperClient = boost::make_shared<ProcessFdKeeperClient>(
+			"unix:tmp.keeper", "secret");
+		keeperClient->connect();
+		context.processFdKeeper = keeperClient;
+		context.poolSnapshotPath = "tmp.snapshot";
+
+		SessionPtr session = pool->get(options, &ticket);
+		pid_t pid = session->getPid();
+		session.reset();
+
+		processFdKeeper->beginGracefulRestart();
+		pool->prepareForReplacement();
+		ensure("(1)", processFdKeeper->waitForReplacementPrepared(5000));
+
+		ProcessFdKeeperClientPtr keeperClient2 = boost::make_shared<ProcessFdKeeperClient>(
+			"unix:tmp.keeper", "secret");
+		keeperClient2->connect();
+		context2.spawningKitFactory = context.spawningKitFactory;
+		context2.processFdKeeper = keeperClient2;
+		context2.poolSnapshotPath = "tmp.snapshot";
+		context2.finalize();
+		pool2 = boost::make_shared<Pool>(&context2);
+		pool2->initialize();
+		ensure_equals("(2)", pool2->adoptProcesses(), 1u);
+
+		ensure("(3)", pool->detachProcess(pid));
+		EVENTUALLY(5,
+			LockGuard l(pool->syncher);
+			Group *group = pool->findMatchingGroup(options);
+			result = group->getProcessCount() == 0 && group->detachedProcesses.empty();
+		);
+		SHOULD_NEVER_HAPPEN(300,
+			result = kill(pid, 0) == -1;
+		);
+
+		session = pool2->get(options, &ticket);
+		ensure_equals("(4)", session->getPid(), pid);
+		session->initiate();
+		ensure("(5)", session->fd() != -1);
+	}
+
 	// TODO: Persistent connections.
 	// TODO: If one closes the session before it has reached EOF, and process's maximum concurrency
 	//       has already been reached, then the pool should ping the process so that it can detect
@@ -231,4 +231,39 @@ namespace tut {
 				&& contents.find("stdout and err 4\n") != string::npos;
 		);
 	}
+
+	TEST_METHOD(6) {
+		set_test_name("sessionClosed() tracks the response time, which makes "
+			"responseTimeWeightedBusyness(1500000) prefer fast processes");
+		ProcessPtr fastProcess = createProcess();
+		ProcessPtr slowProcess = createProcess();
+		ensure_equals("Processes without a known response time are equally busy",
+			fastProcess->responseTimeWeightedBusyness(1500000),
+			slowProcess->responseTimeWeightedBusyness(1500000));
+
+		SessionPtr session1 = fastProcess->newSession(1000000);
+		SessionPtr session2 = slowProcess->newSession(1000000);
+		SystemTime::forceUsec(1001000);
+		fastProcess->sessionClosed(session1.get());
+		SystemTime::forceUsec(1500000);
+		slowProcess->sessionClosed(session2.get());
+		SystemTime::releaseUsec();
+
+		ensure(fastProcess->responseTimeAverage.available());
+		ensure(slowProcess->responseTimeAverage.available());
+		ensure(fabs(fastProcess->responseTimeAverage.average() - 1000) < 1);
+		ensure(fabs(slowProcess->responseTimeAverage.average() - 500000) < 1);
+
+		session1 = fastProcess->newSession();
+		ensure("A fast process with a session is preferred over an idle slow process",
+			fastProcess->responseTimeWeightedBusyness(1500000) < slowProcess->responseTimeWeightedBusyness(1500000));
+
+		vector<SessionPtr> sessions;
+		for (int i = 0; i < 8; i++) {
+			sessions.push_back(fastProcess->newSession());
+		}
+		ensure(fastProcess->isTotallyBusy());
+		ensure_equals("A totally busy process has the highest possible value",
+			fastProcess->responseTimeWeightedBusyness(1500000), INT_MAX);
+	}
 }
@@ -1,9 +1,12 @@
 #include <TestSupport.h>
 #include <limits>
+#include <zlib.h>
 #include <Constants.h>
+#include <FileTools/FileManip.h>
 #include <Utils/IOUtils.h>
 #include <Utils/BufferedIO.h>
 #include <Utils/MessageIO.h>
+#include <Utils/StrIntUtils.h>
 #include <Core/ApplicationPool/TestSession.h>
 #include <Core/Controller.h>
 
@@ -19,13 +22,20 @@ namespace tut {
 			virtual void asyncGetFromApplicationPool(Request *req,
 				ApplicationPool2::GetCallback callback)
 			{
+				sessionCheckoutCount++;
 				callback(sessionToReturn, exceptionToReturn);
 				sessionToReturn.reset();
 			}
 
+			virtual bool canRouteImmediately(Request *req) {
+				return canRouteImmediatelyResult;
+			}
+
 		public:
 			ApplicationPool2::AbstractSessionPtr sessionToReturn;
 			ApplicationPool2::ExceptionPtr exceptionToReturn;
+			bool canRouteImmediatelyResult;
+			unsigned int sessionCheckoutCount;
 
 			MyController(ServerKit::Context *context,
 				const Core::ControllerSchema &schema,
@@ -33,7 +43,9 @@ namespace tut {
 				const Core::ControllerSingleAppModeSchema &singleAppModeSchema,
 				const Json::Value &singleAppModeConfig)
 				: Core::Controller(context, schema, initialConfig, ConfigKit::DummyTranslator(),
-					&singleAppModeSchema, &singleAppModeConfig, ConfigKit::DummyTranslator())
+					&singleAppModeSchema, &singleAppModeConfig, ConfigKit::DummyTranslator()),
+				  canRouteImmediatelyResult(false),
+				  sessionCheckoutCount(0)
 				{ }
 		};
 
@@ -50,7 +62,7 @@ namespace tut {
 		PoolPtr appPool;
 		Json::Value config, singleAppModeConfig;
 		int serverSocket;
-		TestSession testSession;
+		TestSession testSession, testSession2;
 		FileDescriptor clientConnection;
 		BufferedIO clientConnectionIO;
 		string peerRequestHeader;
@@ -156,6 +168,25 @@ namespace tut {
 			controller->sessionToReturn.reset(&testSession, false);
 		}
 
+		void useSecondTestSessionObject() {
+			bg.safe->runSync(boost::bind(&Core_ControllerTest::_setSecondTestSessionObject, this));
+		}
+
+		void _setSecondTestSessionObject() {
+			controller->sessionToReturn.reset(&testSession2, false);
+		}
+
+		unsigned int getSessionCheckoutCount() {
+			unsigned int result;
+			bg.safe->runSync(boost::bind(&Core_ControllerTest::_getSessionCheckoutCount,
+				this, &result));
+			return result;
+		}
+
+		void _getSessionCheckoutCount(unsigned int *result) {
+			*result = controller->sessionCheckoutCount;
+		}
+
 		MyController::State getServerState() {
 			Controller::State result;
 			bg.safe->runSync(boost::bind(&Core_ControllerTest::_getServerState,
@@ -182,7 +213,7 @@ namespace tut {
 			if (peerRequestHeader == NULL) {
 				peerRequestHeader = &this->peerRequestHeader;
 			}
-			if (testSession.getProtocol() == "session") {
+			if (isSessionProtocol(testSession.getProtocol())) {
 				*peerRequestHeader = readScalarMessage(testSession.peerFd());
 			} else {
 				*peerRequestHeader = readHeader(testSession.getPeerBufferedIO());
@@ -266,9 +297,74 @@ namespace tut {
 		string readResponseBody() {
 			return clientConnectionIO.readAll();
 		}
+
+		string dechunk(const string &data) {
+			string result;
+			string::size_type pos = 0;
+
+			while (true) {
+				string::size_type lineEnd = data.find("\r\n", pos);
+				ensure("Chunk size line found", lineEnd != string::npos);
+				unsigned int size = hexToUint(data.substr(pos, lineEnd - pos));
+				if (size == 0) {
+					return result;
+				}
+				result.append(data, lineEnd + 2, size);
+				pos = lineEnd + 2 + size + 2;
+			}
+		}
+
+		string gunzip(const string &data) {
+			z_stream stream;
+			char buf[1024];
+			string result;
+			int ret;
+
+			memset(&stream, 0, sizeof(stream));
+			ensure_equals(inflateInit2(&stream, 15 + 16), Z_OK);
+			stream.next_in = (Bytef *) data.data();
+			stream.avail_in = data.size();
+			do {
+				stream.next_out = (Bytef *) buf;
+				stream.avail_out = sizeof(buf);
+				ret = inflate(&stream, Z_NO_FLUSH);
+				ensure("Valid gzip data", ret == Z_OK || ret == Z_STREAM_END);
+				result.append(buf, sizeof(buf) - stream.avail_out);
+			} while (ret != Z_STREAM_END);
+			inflateEnd(&stream);
+			return result;
+		}
+
+		bool changeConfig(const Json::Value &updates) {
+			bool result;
+			bg.safe->runSync(boost::bind(&Core_ControllerTest::_changeConfig,
+				this, updates, &result));
+			return result;
+		}
+
+		void _changeConfig(const Json::Value &updates, bool *result) {
+			vector<ConfigKit::Error> errors;
+			Controller::ConfigChangeRequest req;
+
+			*result = controller->prepareConfigChange(updates, errors, req);
+			if (*result) {
+				controller->commitConfigChange(req);
+			}
+		}
+
+		string sendCacheableRequest(string *header) {
+			connectToServer();
+			sendRequest(
+				"GET /hello HTTP/1.1\r\n"
+				"Host: localhost\r\n"
+				"Connection: close\r\n"
+				"\r\n");
+			*header = readResponseHeader();
+			return readResponseBody();
+		}
 	};
 
-	DEFINE_TEST_GROUP(Core_ControllerTest);
+	DEFINE_TEST_GROUP_WITH_LIMIT(Core_ControllerTest, 100);
 
 
 	/***** Passing request information to the app *****/
@@ -312,6 +408,172 @@ namespace tut {
 			"GET /hello?foo=bar HTTP/1.1\r\n"));
 	}
 
+	TEST_METHOD(3) {
+		set_test_name("Options from a config profile referred to by"
+			" !~PASSENGER_CONFIG_PROFILE are applied to the request");
+
+		// "Rk9PAGJhcgA=" is the base64 encoding of "FOO\0bar\0"
+		config["config_profiles"]["1"] = "!~PASSENGER_ENV_VARS: Rk9PAGJhcgA=\r\n";
+		init();
+		useTestSessionObject();
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"!~: x\r\n"
+			"!~PASSENGER_CONFIG_PROFILE: 1\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+
+		readPeerRequestHeader();
+		ensure(containsSubstring(peerRequestHeader,
+			P_STATIC_STRING("FOO\0bar\0")));
+	}
+
+	TEST_METHOD(4) {
+		set_test_name("Requests referring to an unknown config profile are rejected");
+
+		config["config_profiles"]["1"] = "!~PASSENGER_ENV_VARS: Rk9PAGJhcgA=\r\n";
+		init();
+
+		connectToServer();
+		// Silence the expected error message.
+		LoggingKit::setLevel(LoggingKit::CRIT);
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"!~: x\r\n"
+			"!~PASSENGER_CONFIG_PROFILE: 2\r\n"
+			"\r\n");
+
+		// The connection is closed without a response.
+		ensure_equals(readResponseHeader(), "");
+	}
+
+	TEST_METHOD(5) {
+		set_test_name("Session protocol v2: well-known fields are sent as"
+			" integer IDs");
+
+		init();
+		useTestSessionObject();
+		testSession.setProtocol("session2");
+
+		connectToServer();
+		sendRequest(
+			"GET /hello?foo=bar HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+
+		readPeerRequestHeader();
+		ensure_equals("(1)", peerRequestHeader[0], '\x02');
+		ensure("(2)", containsSubstring(peerRequestHeader,
+			StaticString("\x01\x00\x0E/hello?foo=bar", 17)));
+		ensure("(3)", containsSubstring(peerRequestHeader,
+			StaticString("\x12\x00\x09localhost", 12)));
+		ensure("(4)", !containsSubstring(peerRequestHeader,
+			P_STATIC_STRING("REQUEST_URI")));
+	}
+
+	TEST_METHOD(6) {
+		set_test_name("Session protocol v2: other headers are sent with"
+			" literal names");
+
+		init();
+		useTestSessionObject();
+		testSession.setProtocol("session2");
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"X-Foo: bar\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+
+		readPeerRequestHeader();
+		ensure(containsSubstring(peerRequestHeader,
+			StaticString("\x00\x00\x0AHTTP_X_FOO\x00\x03" "bar", 18)));
+	}
+
+	TEST_METHOD(7) {
+		set_test_name("HTTP protocol: request headers that the app socket doesn't"
+			" accept at once are sent completely, before the request body");
+
+		string value(4 * 1024, 'x');
+		string largeHeaders;
+		unsigned int i;
+		for (i = 0; i < 8; i++) {
+			largeHeaders.append("X-Large-" + toString(i) + ": " + value + "\r\n");
+		}
+
+		init();
+		useTestSessionObject();
+		testSession.setProtocol("http_session");
+		testSession.setSendBufferSize(4096);
+
+		connectToServer();
+		sendRequest(
+			"POST /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"Content-Length: 5\r\n"
+			+ largeHeaders +
+			"\r\n"
+			"hello");
+		waitUntilSessionInitiated();
+
+		readPeerRequestHeader();
+		ensure("(1)", startsWith(peerRequestHeader, "POST /hello HTTP/1.1\r\n"));
+		for (i = 0; i < 8; i++) {
+			ensure("(2)", containsSubstring(peerRequestHeader,
+				"\r\nx-large-" + toString(i) + ": " + value + "\r\n"));
+		}
+		char body[5];
+		ensure_equals("(3)", testSession.getPeerBufferedIO().read(body, sizeof(body)),
+			(unsigned int) sizeof(body));
+		ensure_equals("(4)", string(body, sizeof(body)), "hello");
+	}
+
+	TEST_METHOD(8) {
+		set_test_name("Session protocol: environment variables are sent right"
+			" after the other header fields, and are included in the header size");
+
+		string value(32 * 1024, 'x');
+
+		init();
+		useTestSessionObject();
+		testSession.setSendBufferSize(4096);
+
+		// "Rk9PAGJhcgA=" is the base64 encoding of "FOO\0bar\0"
+		connectToServer();
+		sendRequest(
+			"POST /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"Content-Length: 5\r\n"
+			"X-Large: " + value + "\r\n"
+			"!~: x\r\n"
+			"!~PASSENGER_ENV_VARS: Rk9PAGJhcgA=\r\n"
+			"\r\n"
+			"hello");
+		waitUntilSessionInitiated();
+
+		readPeerRequestHeader();
+		ensure("(1)", containsSubstring(peerRequestHeader,
+			"HTTP_X_LARGE" + string(1, '\0') + value + string(1, '\0')));
+		ensure_equals("(2)", peerRequestHeader.substr(peerRequestHeader.size() - 8),
+			string("FOO\0bar\0", 8));
+		char body[5];
+		readExact(testSession.peerFd(), body, sizeof(body));
+		ensure_equals("(3)", string(body, sizeof(body)), "hello");
+	}
+
 
 	/***** Application response body handling *****/
 
@@ -427,6 +689,36 @@ namespace tut {
 		ensure_equals(body, "hello");
 	}
 
+	TEST_METHOD(14) {
+		set_test_name("The status line and Date header are generated by the Core");
+
+		init();
+		useTestSessionObject();
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+
+		readPeerRequestHeader();
+		sendPeerResponse(
+			"HTTP/1.1 404 Whatever\r\n"
+			"Connection: close\r\n"
+			"Content-Length: 2\r\n\r\n"
+			"ok");
+
+		string header = readResponseHeader();
+		ensure("(1)", startsWith(header,
+			"HTTP/1.1 404 Not Found\r\n"
+			"Status: 404 Not Found\r\n"));
+		ensure("(2)", containsSubstring(header, "\r\nDate: "));
+		ensure("(3)", containsSubstring(header, " GMT\r\n"));
+		ensure_equals("(4)", readResponseBody(), "ok");
+	}
+
 
 	/***** Application connection keep-alive *****/
 
@@ -873,4 +1165,617 @@ namespace tut {
 		string header = readResponseHeader();
 		ensure(containsSubstring(header, "HTTP/1.1 502"));
 	}
+
+
+	/***** Response compression *****/
+
+	TEST_METHOD(50) {
+		set_test_name("Response bodies of a compressible content type are gzipped"
+			" if compression is enabled and the client accepts gzip");
+
+		config["response_compression"] = true;
+		init();
+		useTestSessionObject();
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"Accept-Encoding: deflate, gzip;q=0.5\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+
+		string content;
+		for (int i = 0; i < 100; i++) {
+			content.append("hello world\n");
+		}
+		readPeerRequestHeader();
+		sendPeerResponse(
+			"HTTP/1.1 200 OK\r\n"
+			"Connection: close\r\n"
+			"Content-Type: text/plain; charset=utf-8\r\n"
+			"Content-Length: " + toString(content.size()) + "\r\n\r\n"
+			+ content);
+
+		string header = readResponseHeader();
+		string body = readResponseBody();
+		ensure("(1)", containsSubstring(header, "HTTP/1.1 200 OK\r\n"));
+		ensure("(2)", containsSubstring(header, "Content-Encoding: gzip\r\n"));
+		ensure("(3)", containsSubstring(header, "Vary: Accept-Encoding\r\n"));
+		ensure("(4)", containsSubstring(header, "Transfer-Encoding: chunked\r\n"));
+		ensure("(5)", !containsSubstring(header, "Content-Length"));
+		string compressed = dechunk(body);
+		ensure("(6)", compressed.size() < content.size());
+		ensure_equals("(7)", gunzip(compressed), content);
+	}
+
+	TEST_METHOD(51) {
+		set_test_name("Chunked response bodies are gzipped too");
+
+		config["response_compression"] = true;
+		init();
+		useTestSessionObject();
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"Accept-Encoding: gzip\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+
+		readPeerRequestHeader();
+		sendPeerResponse(
+			"HTTP/1.1 200 OK\r\n"
+			"Connection: close\r\n"
+			"Content-Type: application/json\r\n"
+			"Transfer-Encoding: chunked\r\n\r\n"
+			"8\r\n"
+			"{\"a\": 1,\r\n"
+			"8\r\n"
+			" \"b\": 2}\r\n"
+			"0\r\n\r\n");
+
+		string header = readResponseHeader();
+		string body = readResponseBody();
+		ensure("(1)", containsSubstring(header, "Content-Encoding: gzip\r\n"));
+		ensure("(2)", containsSubstring(header, "Transfer-Encoding: chunked\r\n"));
+		ensure_equals("(3)", gunzip(dechunk(body)), "{\"a\": 1, \"b\": 2}");
+	}
+
+	TEST_METHOD(52) {
+		set_test_name("Response bodies are not compressed if the client"
+			" does not accept gzip");
+
+		config["response_compression"] = true;
+		init();
+		useTestSessionObject();
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"Accept-Encoding: gzip;q=0, *\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+
+		string content(1000, 'x');
+		readPeerRequestHeader();
+		sendPeerResponse(
+			"HTTP/1.1 200 OK\r\n"
+			"Connection: close\r\n"
+			"Content-Type: text/html\r\n"
+			"Content-Length: 1000\r\n\r\n"
+			+ content);
+
+		string header = readResponseHeader();
+		string body = readResponseBody();
+		ensure("(1)", !containsSubstring(header, "Content-Encoding"));
+		ensure("(2)", containsSubstring(header, "Vary: Accept-Encoding\r\n"));
+		ensure("(3)", containsSubstring(header, "Content-Length: 1000\r\n"));
+		ensure_equals("(4)", body, content);
+	}
+
+	TEST_METHOD(53) {
+		set_test_name("Response bodies are not compressed if they are small"
+			" or of a content type that is typically compressed already");
+
+		config["response_compression"] = true;
+		init();
+		useTestSessionObject();
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"Accept-Encoding: gzip\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+
+		string content(1000, 'x');
+		readPeerRequestHeader();
+		sendPeerResponse(
+			"HTTP/1.1 200 OK\r\n"
+			"Connection: close\r\n"
+			"Content-Type: image/png\r\n"
+			"Content-Length: 1000\r\n\r\n"
+			+ content);
+
+		string header = readResponseHeader();
+		string body = readResponseBody();
+		ensure("(1)", !containsSubstring(header, "Content-Encoding"));
+		ensure("(2)", !containsSubstring(header, "Vary"));
+		ensure_equals("(3)", body, content);
+	}
+
+
+	/***** Static file serving *****/
+
+	TEST_METHOD(60) {
+		set_test_name("Files in the app's public directory are served without"
+			" involving the app");
+
+		TempDir tempDir("tmp.static");
+		makeDirTree("tmp.static/public/assets");
+		createFile("tmp.static/public/assets/hello.txt", "hello world\n");
+		singleAppModeConfig["app_root"] = "tmp.static";
+		config["serve_static_files"] = true;
+		init();
+		useTestSessionObject();
+
+		connectToServer();
+		sendRequest(
+			"GET /assets/hello.txt?123 HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"\r\n");
+
+		string header = readResponseHeader();
+		string body = readResponseBody();
+		ensure("(1)", startsWith(header, "HTTP/1.1 200 OK\r\n"));
+		ensure("(2)", containsSubstring(header, "Content-Type: text/plain\r\n"));
+		ensure("(3)", containsSubstring(header, "Content-Length: 12\r\n"));
+		ensure("(4)", containsSubstring(header, "ETag: \""));
+		ensure("(5)", containsSubstring(header, "Last-Modified: "));
+		ensure("(6)", !containsSubstring(header, "Vary"));
+		ensure_equals("(7)", body, "hello world\n");
+		ensure("(8)", testSession.fd() == -1);
+	}
+
+	TEST_METHOD(61) {
+		set_test_name("A matching If-None-Match header results in a 304 response");
+
+		TempDir tempDir("tmp.static");
+		makeDirTree("tmp.static/public");
+		createFile("tmp.static/public/hello.txt", "hello world\n");
+		singleAppModeConfig["app_root"] = "tmp.static";
+		config["serve_static_files"] = true;
+		init();
+
+		connectToServer();
+		sendRequest(
+			"GET /hello.txt HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"\r\n");
+		string header = readResponseHeader();
+		string::size_type etagStart = header.find("ETag: ") + sizeof("ETag: ") - 1;
+		string etag = header.substr(etagStart, header.find("\r\n", etagStart) - etagStart);
+		char body[12];
+		ensure_equals("(1)", clientConnectionIO.read(body, sizeof(body)), 12u);
+		ensure_equals("(2)", string(body, sizeof(body)), "hello world\n");
+
+		sendRequest(
+			"GET /hello.txt HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"If-None-Match: \"foo\", W/" + etag + "\r\n"
+			"\r\n");
+		header = readResponseHeader();
+		ensure("(3)", startsWith(header, "HTTP/1.1 304 Not Modified\r\n"));
+		ensure("(4)", !containsSubstring(header, "Content-Length"));
+		ensure_equals("(5)", readResponseBody(), "");
+	}
+
+	TEST_METHOD(62) {
+		set_test_name("Precompressed variants are served to clients that accept them");
+
+		TempDir tempDir("tmp.static");
+		makeDirTree("tmp.static/public");
+		createFile("tmp.static/public/app.js", "alert(1);\n");
+		createFile("tmp.static/public/app.js.gz", "gzipped");
+		singleAppModeConfig["app_root"] = "tmp.static";
+		config["serve_static_files"] = true;
+		init();
+
+		connectToServer();
+		sendRequest(
+			"GET /app.js HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"Accept-Encoding: br;q=0, gzip\r\n"
+			"\r\n");
+
+		string header = readResponseHeader();
+		string body = readResponseBody();
+		ensure("(1)", containsSubstring(header, "Content-Type: application/javascript\r\n"));
+		ensure("(2)", containsSubstring(header, "Content-Encoding: gzip\r\n"));
+		ensure("(3)", containsSubstring(header, "Vary: Accept-Encoding\r\n"));
+		ensure_equals("(4)", body, "gzipped");
+	}
+
+	TEST_METHOD(63) {
+		set_test_name("Requests for nonexistant files, or for paths outside the"
+			" public directory, are passed to the app");
+
+		TempDir tempDir("tmp.static");
+		makeDirTree("tmp.static/public");
+		createFile("tmp.static/secret.txt", "secret\n");
+		singleAppModeConfig["app_root"] = "tmp.static";
+		config["serve_static_files"] = true;
+		init();
+		useTestSessionObject();
+
+		connectToServer();
+		sendRequest(
+			"GET /%2e%2e/secret.txt HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+
+		readPeerRequestHeader();
+		sendPeerResponse(
+			"HTTP/1.1 404 Not Found\r\n"
+			"Connection: close\r\n"
+			"Content-Length: 2\r\n\r\n"
+			"no");
+		string header = readResponseHeader();
+		ensure("(1)", startsWith(header, "HTTP/1.1 404 Not Found\r\n"));
+		ensure_equals("(2)", readResponseBody(), "no");
+	}
+
+
+	/***** Request body buffering *****/
+
+	TEST_METHOD(70) {
+		set_test_name("Buffered request bodies are passed to the app only"
+			" once the end of the body has been reached");
+
+		init();
+		useTestSessionObject();
+
+		connectToServer();
+		sendRequest(
+			"POST /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"Content-Length: 10\r\n"
+			"!~: x\r\n"
+			"!~FLAGS: B\r\n"
+			"\r\n"
+			"hello");
+		SHOULD_NEVER_HAPPEN(100,
+			result = testSession.fd() != -1;
+		);
+
+		sendRequest("world");
+		waitUntilSessionInitiated();
+		readPeerRequestHeader();
+		char body[10];
+		readExact(testSession.peerFd(), body, sizeof(body));
+		ensure_equals(string(body, sizeof(body)), "helloworld");
+	}
+
+	TEST_METHOD(71) {
+		set_test_name("Once more than max_request_body_buffer_size bytes are"
+			" buffered, the rest of the request body is streamed to the app");
+
+		config["max_request_body_buffer_size"] = 4;
+		init();
+		useTestSessionObject();
+
+		connectToServer();
+		sendRequest(
+			"POST /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"Content-Length: 10\r\n"
+			"!~: x\r\n"
+			"!~FLAGS: B\r\n"
+			"\r\n"
+			"hello");
+		waitUntilSessionInitiated();
+
+		readPeerRequestHeader();
+		char body[5];
+		readExact(testSession.peerFd(), body, sizeof(body));
+		ensure_equals("(1)", string(body, sizeof(body)), "hello");
+
+		sendRequest("world");
+		readExact(testSession.peerFd(), body, sizeof(body));
+		ensure_equals("(2)", string(body, sizeof(body)), "world");
+
+		sendPeerResponse(
+			"HTTP/1.1 200 OK\r\n"
+			"Content-Length: 2\r\n\r\n"
+			"ok");
+		string header = readResponseHeader();
+		ensure("(3)", startsWith(header, "HTTP/1.1 200 OK\r\n"));
+		ensure_equals("(4)", readResponseBody(), "ok");
+	}
+
+	TEST_METHOD(72) {
+		set_test_name("Chunked request bodies are buffered completely and passed"
+			" with a Content-Length, even if more than max_request_body_buffer_size"
+			" bytes are buffered");
+
+		config["max_request_body_buffer_size"] = 4;
+		init();
+		useTestSessionObject();
+
+		connectToServer();
+		sendRequest(
+			"POST /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"Transfer-Encoding: chunked\r\n"
+			"!~: x\r\n"
+			"!~FLAGS: B\r\n"
+			"\r\n"
+			"5\r\nhello\r\n");
+		SHOULD_NEVER_HAPPEN(100,
+			result = testSession.fd() != -1;
+		);
+
+		sendRequest("5\r\nworld\r\n0\r\n\r\n");
+		waitUntilSessionInitiated();
+		readPeerRequestHeader();
+		ensure("(1)", containsSubstring(peerRequestHeader,
+			P_STATIC_STRING("CONTENT_LENGTH\0" "10\0")));
+		ensure("(2)", !containsSubstring(peerRequestHeader,
+			P_STATIC_STRING("HTTP_TRANSFER_ENCODING\0")));
+		char body[10];
+		readExact(testSession.peerFd(), body, sizeof(body));
+		ensure_equals("(3)", string(body, sizeof(body)), "helloworld");
+	}
+
+	TEST_METHOD(73) {
+		set_test_name("If adaptive_request_body_buffering is enabled and a process"
+			" can handle the request right away, then the request body is"
+			" streamed to the app instead of being buffered");
+
+		config["adaptive_request_body_buffering"] = true;
+		init();
+		useTestSessionObject();
+		controller->canRouteImmediatelyResult = true;
+
+		connectToServer();
+		sendRequest(
+			"POST /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"Content-Length: 10\r\n"
+			"!~: x\r\n"
+			"!~FLAGS: B\r\n"
+			"\r\n"
+			"hello");
+		waitUntilSessionInitiated();
+
+		readPeerRequestHeader();
+		char body[5];
+		readExact(testSession.peerFd(), body, sizeof(body));
+		ensure_equals("(1)", string(body, sizeof(body)), "hello");
+
+		sendRequest("world");
+		readExact(testSession.peerFd(), body, sizeof(body));
+		ensure_equals("(2)", string(body, sizeof(body)), "world");
+	}
+
+	TEST_METHOD(74) {
+		set_test_name("If adaptive_request_body_buffering is enabled but no process"
+			" can handle the request right away, then the request body is buffered");
+
+		config["adaptive_request_body_buffering"] = true;
+		init();
+		useTestSessionObject();
+		controller->canRouteImmediatelyResult = false;
+
+		connectToServer();
+		sendRequest(
+			"POST /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"Content-Length: 10\r\n"
+			"!~: x\r\n"
+			"!~FLAGS: B\r\n"
+			"\r\n"
+			"hello");
+		SHOULD_NEVER_HAPPEN(100,
+			result = testSession.fd() != -1;
+		);
+
+		sendRequest("world");
+		waitUntilSessionInitiated();
+		readPeerRequestHeader();
+		char body[10];
+		readExact(testSession.peerFd(), body, sizeof(body));
+		ensure_equals(string(body, sizeof(body)), "helloworld");
+	}
+
+	TEST_METHOD(75) {
+		set_test_name("If adaptive_request_body_buffering is enabled, chunked request"
+			" bodies are still buffered and passed with a Content-Length");
+
+		config["adaptive_request_body_buffering"] = true;
+		init();
+		useTestSessionObject();
+		controller->canRouteImmediatelyResult = true;
+
+		connectToServer();
+		sendRequest(
+			"POST /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"Transfer-Encoding: chunked\r\n"
+			"!~: x\r\n"
+			"!~FLAGS: B\r\n"
+			"\r\n"
+			"5\r\nhello\r\n");
+		SHOULD_NEVER_HAPPEN(100,
+			result = testSession.fd() != -1;
+		);
+
+		sendRequest("5\r\nworld\r\n0\r\n\r\n");
+		waitUntilSessionInitiated();
+		readPeerRequestHeader();
+		ensure("(1)", containsSubstring(peerRequestHeader,
+			P_STATIC_STRING("CONTENT_LENGTH\0" "10\0")));
+		char body[10];
+		readExact(testSession.peerFd(), body, sizeof(body));
+		ensure_equals("(2)", string(body, sizeof(body)), "helloworld");
+	}
+
+
+	/***** Turbocaching *****/
+
+	TEST_METHOD(76) {
+		set_test_name("Turbocaching can be disabled and re-enabled at runtime,"
+			" which clears the cache");
+		string header, body;
+
+		init();
+		useTestSessionObject();
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+		readPeerRequestHeader();
+		sendPeerResponse(
+			"HTTP/1.1 200 OK\r\n"
+			"Cache-Control: public, max-age=3600\r\n"
+			"Content-Length: 5\r\n\r\n"
+			"hello");
+		header = readResponseHeader();
+		body = readResponseBody();
+		ensure("(1)", containsSubstring(header, "HTTP/1.1 200 OK\r\n"));
+		ensure_equals("(2)", body, "hello");
+
+		// Requests that are not served from the cache fail from now on.
+		controller->exceptionToReturn = boost::make_shared<RuntimeException>(
+			"no application processes");
+		body = sendCacheableRequest(&header);
+		ensure("(3)", containsSubstring(header, "HTTP/1.1 200 OK\r\n"));
+		ensure_equals("(4)", body, "hello");
+
+		Json::Value updates;
+		updates["turbocaching"] = false;
+		ensure("(5)", changeConfig(updates));
+		body = sendCacheableRequest(&header);
+		ensure("(6)", !containsSubstring(header, "HTTP/1.1 200 OK\r\n"));
+
+		updates["turbocaching"] = true;
+		ensure("(7)", changeConfig(updates));
+		body = sendCacheableRequest(&header);
+		ensure("(8)", !containsSubstring(header, "HTTP/1.1 200 OK\r\n"));
+	}
+
+
+	/***** Pipelining *****/
+
+	TEST_METHOD(80) {
+		set_test_name("A session is checked out for a pipelined request while"
+			" the request in front of it is still being processed");
+
+		init();
+		useTestSessionObject();
+		controller->canRouteImmediatelyResult = true;
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+		readPeerRequestHeader();
+		useSecondTestSessionObject();
+
+		sendRequest(
+			"GET /world HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"\r\n");
+		EVENTUALLY(5,
+			result = getSessionCheckoutCount() == 2;
+		);
+		// The session is only initiated once the request has begun.
+		ensure_equals("(1)", testSession2.fd(), -1);
+
+		sendPeerResponse(
+			"HTTP/1.1 200 OK\r\n"
+			"Content-Length: 5\r\n\r\n"
+			"hello");
+		EVENTUALLY(5,
+			result = testSession2.fd() != -1;
+		);
+		ensure("(2)", containsSubstring(readScalarMessage(testSession2.peerFd()),
+			P_STATIC_STRING("/world")));
+		writeExact(testSession2.peerFd(),
+			"HTTP/1.1 200 OK\r\n"
+			"Content-Length: 5\r\n\r\n"
+			"world");
+		testSession2.closePeerFd();
+
+		string response = readAll(clientConnection,
+			std::numeric_limits<size_t>::max()).first;
+		string::size_type pos = response.find("hello");
+		ensure("(3)", pos != string::npos);
+		ensure("(4)", response.find("world", pos) != string::npos);
+		ensure_equals("(5)", getSessionCheckoutCount(), 2u);
+	}
+
+	TEST_METHOD(81) {
+		set_test_name("No session is checked out for a pipelined request if"
+			" the app group cannot route it right away");
+
+		init();
+		useTestSessionObject();
+		controller->canRouteImmediatelyResult = false;
+
+		connectToServer();
+		sendRequest(
+			"GET /hello HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"\r\n");
+		waitUntilSessionInitiated();
+		readPeerRequestHeader();
+		useSecondTestSessionObject();
+
+		sendRequest(
+			"GET /world HTTP/1.1\r\n"
+			"Host: localhost\r\n"
+			"Connection: close\r\n"
+			"\r\n");
+		SHOULD_NEVER_HAPPEN(200,
+			result = getSessionCheckoutCount() > 1;
+		);
+
+		sendPeerResponse(
+			"HTTP/1.1 200 OK\r\n"
+			"Content-Length: 5\r\n\r\n"
+			"hello");
+		EVENTUALLY(5,
+			result = testSession2.fd() != -1;
+		);
+		ensure_equals("(1)", getSessionCheckoutCount(), 2u);
+		ensure("(2)", containsSubstring(readScalarMessage(testSession2.peerFd()),
+			P_STATIC_STRING("/world")));
+	}
 }
@@ -64,6 +64,7 @@ namespace tut {
 			req.requestBodyBuffering = false;
 			req.https     = false;
 			req.stickySession = false;
+			req.acceptsGzip = false;
 			req.sessionCheckoutTry = 0;
 			req.halfClosePolicy = Request::HALF_CLOSE_POLICY_UNINITIALIZED;
 			req.appResponseInitialized = false;
@@ -75,6 +76,7 @@ namespace tut {
 			req.cacheControl = NULL;
 			req.varyCookie = NULL;
 			req.envvars = NULL;
+			req.configProfile = NULL;
 
 			req.appResponse.headers.clear();
 			req.appResponse.secureHeaders.clear();
@@ -83,6 +85,8 @@ namespace tut {
 			req.appResponse.httpState  = AppResponse::COMPLETE;
 			req.appResponse.wantKeepAlive = false;
 			req.appResponse.oneHundredContinueSent = false;
+			req.appResponse.compressible = false;
+			req.appResponse.compressed = false;
 			req.appResponse.bodyType   = AppResponse::RBT_NO_BODY;
 			req.appResponse.statusCode = 200;
 			req.appResponse.bodyAlreadyRead = 0;
@@ -94,6 +98,7 @@ namespace tut {
 			req.appResponse.headerCacheBuffers = NULL;
 			req.appResponse.nHeaderCacheBuffers = 0;
 			psg_lstr_init(&req.appResponse.bodyCacheBuffer);
+			req.appResponse.deflateStream = NULL;
 
 			insertAppResponseHeader(createHeader(
 				"date", createTodayString(req.pool)),
@@ -238,6 +243,39 @@ namespace tut {
 	}
 
 
+	TEST_METHOD(12) {
+		set_test_name("Responses to clients that accept gzip are cached separately");
+		string responseHeadersStr =
+			"content-length: 5\r\n"
+			"cache-control: public,max-age=99999\r\n";
+		string responseBodyStr = "hello";
+		initCacheableResponse();
+		initResponseBody(responseBodyStr);
+		req.acceptsGzip = true;
+		ensure("(1)", responseCache.prepareRequest(this, &req));
+		ensure("(2)", responseCache.requestAllowsStoring(&req));
+		ensure("(3)", responseCache.prepareRequestForStoring(&req));
+
+		ResponseCacheType::Entry entry(responseCache.store(&req, time(NULL),
+			responseHeadersStr.size(), responseBodyStr.size()));
+		ensure("(5)", entry.valid());
+
+
+		reset();
+		ensure("(10)", responseCache.prepareRequest(this, &req));
+		ensure("(11)", responseCache.requestAllowsFetching(&req));
+		ResponseCacheType::Entry entry2(responseCache.fetch(&req, time(NULL)));
+		ensure("(12)", !entry2.valid());
+
+		reset();
+		req.acceptsGzip = true;
+		ensure("(20)", responseCache.prepareRequest(this, &req));
+		ensure("(21)", responseCache.requestAllowsFetching(&req));
+		ResponseCacheType::Entry entry3(responseCache.fetch(&req, time(NULL)));
+		ensure("(22)", entry3.valid());
+	}
+
+
 	/***** Checking whether request should be fetched from cache *****/
 
 	TEST_METHOD(15) {
@@ -571,4 +609,39 @@ namespace tut {
 		ResponseCacheType::Entry entry2(responseCache.fetch(&req, time(NULL)));
 		ensure("(22)", !entry2.valid());
 	}
+
+	TEST_METHOD(63) {
+		set_test_name("Invalidation applies to responses for clients that"
+			" accept gzip as well as to those for clients that don't");
+		string responseHeadersStr =
+			"content-length: 5\r\n"
+			"cache-control: public,max-age=99999\r\n";
+		string responseBodyStr = "hello";
+		initCacheableResponse();
+		initResponseBody(responseBodyStr);
+		req.acceptsGzip = true;
+		ensure("(1)", responseCache.prepareRequest(this, &req));
+		ensure("(2)", responseCache.requestAllowsStoring(&req));
+		ensure("(3)", responseCache.prepareRequestForStoring(&req));
+
+		ResponseCacheType::Entry entry(responseCache.store(&req, time(NULL),
+			responseHeadersStr.size(), responseBodyStr.size()));
+		ensure("(5)", entry.valid());
+
+
+		reset();
+		req.method = HTTP_POST;
+		ensure("(10)", responseCache.prepareRequest(this, &req));
+		ensure("(11)", !responseCache.requestAllowsStoring(&req));
+		ensure("(12)", responseCache.requestAllowsInvalidating(&req));
+		responseCache.invalidate(&req);
+
+
+		reset();
+		req.acceptsGzip = true;
+		ensure("(20)", responseCache.prepareRequest(this, &req));
+		ensure("(21)", responseCache.requestAllowsFetching(&req));
+		ResponseCacheType::Entry entry2(responseCache.fetch(&req, time(NULL)));
+		ensure("(22)", !entry2.valid());
+	}
 }
@@ -0,0 +1,129 @@
+#include <TestSupport.h>
+#include <Core/ServerSocketChanges.h>
+#include <boost/bind.hpp>
+#include <Exceptions.h>
+
+using namespace Passenger;
+using namespace Passenger::Core;
+using namespace std;
+
+namespace tut {
+	struct Core_ServerSocketChangesTest {
+		Json::Value oldAddresses, newAddresses;
+		int oldFds[4];
+		int newFds[4];
+		int nextFd;
+		vector<string> created;
+		vector<ServerSocketChange> added, removed;
+		vector<ConfigKit::Error> errors;
+
+		Core_ServerSocketChangesTest()
+			: oldAddresses(Json::arrayValue),
+			  newAddresses(Json::arrayValue),
+			  nextFd(100)
+		{
+			for (unsigned int i = 0; i < 4; i++) {
+				oldFds[i] = 10 + i;
+				newFds[i] = -1;
+			}
+		}
+
+		int createServerSocket(const string &address) {
+			if (address == "tcp://invalid:1") {
+				throw RuntimeException("invalid address");
+			}
+			created.push_back(address);
+			return nextFd++;
+		}
+
+		void prepare() {
+			prepareServerSocketChanges(oldAddresses, oldFds, newAddresses, newFds,
+				boost::bind(&Core_ServerSocketChangesTest::createServerSocket, this,
+					boost::placeholders::_1),
+				"controller_addresses", added, removed, errors);
+		}
+	};
+
+	DEFINE_TEST_GROUP(Core_ServerSocketChangesTest);
+
+	TEST_METHOD(1) {
+		set_test_name("Addresses that stay keep their existing sockets");
+		oldAddresses.append("tcp://127.0.0.1:3000");
+		oldAddresses.append("tcp://127.0.0.1:3001");
+		newAddresses.append("tcp://127.0.0.1:3001");
+		newAddresses.append("tcp://127.0.0.1:3000");
+		prepare();
+
+		ensure_equals("(1)", newFds[0], 11);
+		ensure_equals("(2)", newFds[1], 10);
+		ensure_equals("(3)", created.size(), 0u);
+		ensure_equals("(4)", added.size(), 0u);
+		ensure_equals("(5)", removed.size(), 0u);
+		ensure_equals("(6)", errors.size(), 0u);
+	}
+
+	TEST_METHOD(2) {
+		set_test_name("Sockets are created for added addresses");
+		oldAddresses.append("tcp://127.0.0.1:3000");
+		newAddresses.append("tcp://127.0.0.1:3000");
+		newAddresses.append("tcp://127.0.0.1:3001");
+		prepare();
+
+		ensure_equals("(1)", newFds[0], 10);
+		ensure_equals("(2)", newFds[1], 100);
+		ensure_equals("(3)", created.size(), 1u);
+		ensure_equals("(4)", created[0], "tcp://127.0.0.1:3001");
+		ensure_equals("(5)", added.size(), 1u);
+		ensure_equals("(6)", added[0].address, "tcp://127.0.0.1:3001");
+		ensure_equals("(7)", added[0].fd, 100);
+		ensure_equals("(8)", removed.size(), 0u);
+		ensure_equals("(9)", errors.size(), 0u);
+	}
+
+	TEST_METHOD(3) {
+		set_test_name("Removed addresses are reported along with their old sockets");
+		oldAddresses.append("tcp://127.0.0.1:3000");
+		oldAddresses.append("tcp://127.0.0.1:3001");
+		oldAddresses.append("tcp://127.0.0.1:3002");
+		newAddresses.append("tcp://127.0.0.1:3001");
+		prepare();
+
+		ensure_equals("(1)", newFds[0], 11);
+		ensure_equals("(2)", created.size(), 0u);
+		ensure_equals("(3)", added.size(), 0u);
+		ensure_equals("(4)", removed.size(), 2u);
+		ensure_equals("(5)", removed[0].address, "tcp://127.0.0.1:3000");
+		ensure_equals("(6)", removed[0].fd, 10);
+		ensure_equals("(7)", removed[1].address, "tcp://127.0.0.1:3002");
+		ensure_equals("(8)", removed[1].fd, 12);
+		ensure_equals("(9)", errors.size(), 0u);
+	}
+
+	TEST_METHOD(4) {
+		set_test_name("Addresses can be added and removed at the same time");
+		oldAddresses.append("tcp://127.0.0.1:3000");
+		newAddresses.append("tcp://127.0.0.1:3001");
+		prepare();
+
+		ensure_equals("(1)", newFds[0], 100);
+		ensure_equals("(2)", added.size(), 1u);
+		ensure_equals("(3)", added[0].address, "tcp://127.0.0.1:3001");
+		ensure_equals("(4)", removed.size(), 1u);
+		ensure_equals("(5)", removed[0].address, "tcp://127.0.0.1:3000");
+		ensure_equals("(6)", removed[0].fd, 10);
+	}
+
+	TEST_METHOD(5) {
+		set_test_name("Failing to create a socket results in an error, "
+			"while the sockets that were created are still reported");
+		newAddresses.append("tcp://127.0.0.1:3000");
+		newAddresses.append("tcp://invalid:1");
+		prepare();
+
+		ensure_equals("(1)", added.size(), 1u);
+		ensure_equals("(2)", added[0].fd, 100);
+		ensure_equals("(3)", errors.size(), 1u);
+		ensure_equals("(4)", errors[0].getMessage(),
+			"Cannot listen on tcp://invalid:1 ('controller_addresses'): invalid address");
+	}
+}
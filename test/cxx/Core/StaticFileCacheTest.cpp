@@ -0,0 +1,112 @@
+#include <TestSupport.h>
+#include <Core/Controller/StaticFileCache.h>
+#include <FileTools/FileManip.h>
+#include <FileTools/PathManip.h>
+#include <Utils/StrIntUtils.h>
+
+using namespace Passenger;
+using namespace Passenger::Core;
+using namespace std;
+
+namespace tut {
+	struct Core_StaticFileCacheTest {
+		StaticFileCache cache;
+		string dir;
+		time_t now;
+
+		Core_StaticFileCacheTest()
+			: now(1000)
+		{
+			dir = absolutizePath("tmp.static");
+			removeDirTree(dir);
+			makeDirTree(dir);
+		}
+
+		~Core_StaticFileCacheTest() {
+			removeDirTree(dir);
+		}
+
+		string pathFor(const string &name) {
+			return dir + "/" + name;
+		}
+
+		StaticFileCache::EntryPtr lookup(const string &name) {
+			string path = pathFor(name);
+			return cache.lookup(HashedStaticString(path.c_str(), path.size()), now);
+		}
+
+		void createFiles(unsigned int count) {
+			for (unsigned int i = 0; i < count; i++) {
+				createFile(pathFor("file" + toString(i)), "hello");
+			}
+		}
+	};
+
+	DEFINE_TEST_GROUP(Core_StaticFileCacheTest);
+
+	TEST_METHOD(1) {
+		set_test_name("Existing files and missing paths are cached");
+		createFile(pathFor("file"), "hello");
+
+		StaticFileCache::EntryPtr entry = lookup("file");
+		ensure("(1)", entry->exists());
+		ensure_equals("(2)", entry->size, 5u);
+		ensure("(3)", lookup("file") == entry);
+
+		StaticFileCache::EntryPtr missing = lookup("missing");
+		ensure("(4)", !missing->exists());
+		ensure("(5)", lookup("missing") == missing);
+		ensure_equals("(6)", cache.size(), 2u);
+	}
+
+	TEST_METHOD(2) {
+		set_test_name("Entries are revalidated and replaced when the file changes");
+		StaticFileCache::EntryPtr missing = lookup("file");
+		ensure("(1)", !missing->exists());
+
+		createFile(pathFor("file"), "hello");
+		ensure("(2)", lookup("file") == missing);
+		now += StaticFileCache::REVALIDATION_INTERVAL;
+		StaticFileCache::EntryPtr entry = lookup("file");
+		ensure("(3)", entry->exists());
+		ensure_equals("(4)", cache.size(), 1u);
+
+		unlink(pathFor("file").c_str());
+		now += StaticFileCache::REVALIDATION_INTERVAL;
+		ensure("(5)", !lookup("file")->exists());
+		ensure_equals("(6)", cache.size(), 1u);
+	}
+
+	TEST_METHOD(3) {
+		set_test_name("Looking up many missing paths does not evict existing files");
+		createFiles(10);
+		vector<StaticFileCache::EntryPtr> entries;
+		for (unsigned int i = 0; i < 10; i++) {
+			entries.push_back(lookup("file" + toString(i)));
+		}
+
+		for (unsigned int i = 0; i < 3 * StaticFileCache::MAX_ENTRIES; i++) {
+			lookup("missing" + toString(i));
+		}
+
+		for (unsigned int i = 0; i < 10; i++) {
+			ensure("(1)", lookup("file" + toString(i)) == entries[i]);
+		}
+		ensure("(2)", cache.size() <= 10 + StaticFileCache::MAX_ENTRIES);
+	}
+
+	TEST_METHOD(4) {
+		set_test_name("When the cache is full, the least recently used entries are evicted");
+		StaticFileCache::EntryPtr hot = lookup("hot");
+		for (unsigned int i = 0; i < 2 * StaticFileCache::MAX_ENTRIES; i++) {
+			lookup("missing" + toString(i));
+			lookup("hot");
+		}
+
+		ensure("(1)", lookup("hot") == hot);
+		ensure("(2)", cache.size() <= StaticFileCache::MAX_ENTRIES);
+		StaticFileCache::EntryPtr cold = lookup("missing0");
+		ensure("(3)", cache.size() <= StaticFileCache::MAX_ENTRIES);
+		ensure("(4)", lookup("missing0") == cold);
+	}
+}
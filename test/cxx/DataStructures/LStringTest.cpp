@@ -302,6 +302,33 @@ namespace tut {
 		ensure_equals<void *>(cstr->end, &emptyLStringPart);
 	}
 
+	TEST_METHOD(42) {
+		set_test_name("psg_lstr_make_contiguous_in_place(non-empty string)");
+
+		psg_lstr_append(&str, pool, "hey");
+		psg_lstr_append(&str, pool, "my");
+		psg_lstr_append(&str, pool, "world");
+
+		psg_lstr_make_contiguous_in_place(&str, pool);
+		ensure_equals(str.size, strlen("heymyworld"));
+		ensure_equals<void *>(str.start, str.end);
+		ensure_equals<void *>(str.start->next, NULL);
+		ensure_equals(StaticString(str.start->data, str.size), "heymyworld");
+	}
+
+	TEST_METHOD(43) {
+		set_test_name("psg_lstr_make_contiguous_in_place(contiguous string)");
+		const LString::Part *part;
+
+		psg_lstr_append(&str, pool, "hello");
+		part = str.start;
+
+		psg_lstr_make_contiguous_in_place(&str, pool);
+		ensure_equals(str.size, 5u);
+		ensure_equals(str.start, part);
+		ensure_equals(str.end, part);
+	}
+
 
 	/***** psg_lstr_move_and_append *****/
 
@@ -0,0 +1,107 @@
+#include <TestSupport.h>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <vector>
+#include <DataStructures/MpscQueue.h>
+
+using namespace Passenger;
+using namespace std;
+
+namespace tut {
+	struct DataStructures_MpscQueueTest {
+		struct Item: public MpscQueueNode {
+			unsigned int producer;
+			unsigned int seq;
+
+			Item()
+				: producer(0),
+				  seq(0)
+				{ }
+		};
+
+		MpscQueue queue;
+		Item items[3];
+
+		Item *pop() {
+			return static_cast<Item *>(queue.pop());
+		}
+
+		static void produce(MpscQueue *queue, Item *items, unsigned int count) {
+			for (unsigned int i = 0; i < count; i++) {
+				queue->push(&items[i]);
+			}
+		}
+	};
+
+	DEFINE_TEST_GROUP(DataStructures_MpscQueueTest);
+
+	TEST_METHOD(1) {
+		set_test_name("It is empty upon initialization");
+		ensure(pop() == NULL);
+	}
+
+	TEST_METHOD(2) {
+		set_test_name("Nodes are popped in the order in which they were pushed");
+		queue.push(&items[0]);
+		queue.push(&items[1]);
+		queue.push(&items[2]);
+		ensure_equals(pop(), &items[0]);
+		ensure_equals(pop(), &items[1]);
+		ensure_equals(pop(), &items[2]);
+		ensure(pop() == NULL);
+	}
+
+	TEST_METHOD(3) {
+		set_test_name("Pushing and popping can be interleaved, and nodes can be reused after being popped");
+		queue.push(&items[0]);
+		ensure_equals(pop(), &items[0]);
+		ensure(pop() == NULL);
+
+		queue.push(&items[0]);
+		queue.push(&items[1]);
+		ensure_equals(pop(), &items[0]);
+		queue.push(&items[2]);
+		queue.push(&items[0]);
+		ensure_equals(pop(), &items[1]);
+		ensure_equals(pop(), &items[2]);
+		ensure_equals(pop(), &items[0]);
+		ensure(pop() == NULL);
+	}
+
+	TEST_METHOD(4) {
+		set_test_name("It supports multiple concurrent producers");
+		const unsigned int PRODUCERS = 4;
+		const unsigned int COUNT = 20000;
+		vector<Item> producerItems(PRODUCERS * COUNT);
+		vector<unsigned int> nextSeq(PRODUCERS, 0);
+		boost::thread_group threads;
+		unsigned int i, received = 0;
+
+		for (i = 0; i < producerItems.size(); i++) {
+			producerItems[i].producer = i / COUNT;
+			producerItems[i].seq = i % COUNT;
+		}
+		for (i = 0; i < PRODUCERS; i++) {
+			threads.create_thread(boost::bind(produce, &queue,
+				&producerItems[i * COUNT], COUNT));
+		}
+
+		while (received < PRODUCERS * COUNT) {
+			Item *item = pop();
+			if (item == NULL) {
+				boost::this_thread::yield();
+				continue;
+			}
+			// Nodes from a single producer must come out in order.
+			ensure_equals(item->seq, nextSeq[item->producer]);
+			nextSeq[item->producer]++;
+			received++;
+		}
+		threads.join_all();
+
+		ensure(pop() == NULL);
+		for (i = 0; i < PRODUCERS; i++) {
+			ensure_equals(nextSeq[i], COUNT);
+		}
+	}
+}
@@ -1,5 +1,6 @@
 #include <TestSupport.h>
 #include <boost/move/move.hpp>
+#include <vector>
 #include <Constants.h>
 #include <MemoryKit/mbuf.h>
 
@@ -253,15 +254,110 @@ namespace tut {
 
 	TEST_METHOD(23) {
 		set_test_name("mbuf_get_with_size (large)");
+		size_t size = mbuf_pool_size_class_data_size(&pool, MBUF_POOL_SIZE_CLASSES - 1) + 10;
 		{
-			mbuf buffer(mbuf_get_with_size(&pool, mbuf_pool_data_size(&pool) + 10));
+			mbuf buffer(mbuf_get_with_size(&pool, size));
 			ensure_equals("(1)", pool.nfree_mbuf_blockq, 0u);
 			ensure_equals("(2)", pool.nactive_mbuf_blockq, 1u);
-			ensure_equals("(3)", buffer.size(), mbuf_pool_data_size(&pool) + 10);
+			ensure_equals("(3)", buffer.size(), size);
 			memcpy(buffer.start, "hello", 6);
 			ensure_equals("(4)", string(buffer.start), "hello");
 		}
 		ensure_equals("(5)", pool.nfree_mbuf_blockq, 0u);
 		ensure_equals("(6)", pool.nactive_mbuf_blockq, 0u);
 	}
+
+	TEST_METHOD(24) {
+		set_test_name("mbuf_get_with_size uses the smallest size class that fits");
+		{
+			mbuf buffer(mbuf_get_with_size(&pool, mbuf_pool_data_size(&pool) + 10));
+			ensure_equals("(1)", buffer.mbuf_block->size_class,
+				(boost::uint32_t) MBUF_POOL_DEFAULT_SIZE_CLASS + 1);
+			ensure_equals("(2)", buffer.size(), mbuf_pool_data_size(&pool) + 10);
+			ensure_equals("(3)", pool.size_classes[MBUF_POOL_DEFAULT_SIZE_CLASS + 1].nactive_mbuf_blockq, 1u);
+		}
+		ensure_equals("(4)", pool.nfree_mbuf_blockq, 1u);
+		ensure_equals("(5)", pool.size_classes[MBUF_POOL_DEFAULT_SIZE_CLASS + 1].nfree_mbuf_blockq, 1u);
+
+		mbuf buffer(mbuf_get_with_size(&pool, 6));
+		ensure_equals("(6)", buffer.mbuf_block->size_class, 0u);
+	}
+
+	TEST_METHOD(30) {
+		set_test_name("Size classes are 4 times apart, around the configured chunk size");
+		ensure_equals("(1)", pool.size_classes[MBUF_POOL_DEFAULT_SIZE_CLASS].mbuf_block_chunk_size,
+			(size_t) DEFAULT_MBUF_CHUNK_SIZE);
+		for (unsigned int i = 1; i < MBUF_POOL_SIZE_CLASSES; i++) {
+			ensure_equals("(2)", pool.size_classes[i].mbuf_block_chunk_size,
+				pool.size_classes[i - 1].mbuf_block_chunk_size * 4);
+			ensure_equals("(3)", mbuf_pool_size_class_for(&pool,
+				mbuf_pool_size_class_data_size(&pool, i)), i);
+			ensure_equals("(4)", mbuf_pool_size_class_for(&pool,
+				mbuf_pool_size_class_data_size(&pool, i - 1) + 1), i);
+		}
+		ensure_equals("(5)", mbuf_pool_size_class_for(&pool,
+			mbuf_pool_size_class_data_size(&pool, MBUF_POOL_SIZE_CLASSES - 1) + 1),
+			(unsigned int) MBUF_POOL_SIZE_CLASSES);
+	}
+
+	TEST_METHOD(31) {
+		set_test_name("Blocks are returned to the freelist of their own size class");
+		mbuf small(mbuf_get_from_size_class(&pool, 0));
+		mbuf large(mbuf_get_from_size_class(&pool, MBUF_POOL_SIZE_CLASSES - 1));
+		ensure_equals("(1)", small.size(), mbuf_pool_size_class_data_size(&pool, 0));
+		ensure_equals("(2)", large.size(),
+			mbuf_pool_size_class_data_size(&pool, MBUF_POOL_SIZE_CLASSES - 1));
+		ensure_equals("(3)", pool.nactive_mbuf_blockq, 2u);
+
+		large = mbuf();
+		ensure_equals("(4)", pool.size_classes[MBUF_POOL_SIZE_CLASSES - 1].nfree_mbuf_blockq, 1u);
+		ensure_equals("(5)", pool.size_classes[0].nfree_mbuf_blockq, 0u);
+		ensure_equals("(6)", pool.nfree_bytes,
+			pool.size_classes[MBUF_POOL_SIZE_CLASSES - 1].mbuf_block_chunk_size);
+
+		// Getting a block from another size class does not reuse it.
+		mbuf small2(mbuf_get_from_size_class(&pool, 0));
+		ensure_equals("(7)", pool.size_classes[MBUF_POOL_SIZE_CLASSES - 1].nfree_mbuf_blockq, 1u);
+	}
+
+	TEST_METHOD(32) {
+		set_test_name("mbuf_pool_compact_to() frees blocks of the largest size classes first");
+		mbuf small(mbuf_get_from_size_class(&pool, 0));
+		mbuf large(mbuf_get_from_size_class(&pool, MBUF_POOL_SIZE_CLASSES - 1));
+		small = mbuf();
+		large = mbuf();
+		ensure_equals("(1)", pool.nfree_mbuf_blockq, 2u);
+
+		ensure_equals("(2)", mbuf_pool_compact_to(&pool,
+			pool.size_classes[0].mbuf_block_chunk_size), 1u);
+		ensure_equals("(3)", pool.nfree_mbuf_blockq, 1u);
+		ensure_equals("(4)", pool.size_classes[0].nfree_mbuf_blockq, 1u);
+		ensure_equals("(5)", pool.nfree_bytes, pool.size_classes[0].mbuf_block_chunk_size);
+
+		ensure_equals("(6)", mbuf_pool_compact(&pool), 1u);
+		ensure_equals("(7)", pool.nfree_bytes, (size_t) 0);
+	}
+
+	TEST_METHOD(33) {
+		set_test_name("The pool compacts itself when spare memory exceeds the high watermark");
+		size_t chunkSize = pool.size_classes[MBUF_POOL_DEFAULT_SIZE_CLASS].mbuf_block_chunk_size;
+		vector<mbuf> buffers;
+		unsigned int i;
+
+		pool.spare_memory_high_watermark = 4 * chunkSize;
+		for (i = 0; i < 8; i++) {
+			buffers.push_back(mbuf_get(&pool));
+		}
+		for (i = 0; i < 4; i++) {
+			buffers.pop_back();
+		}
+		ensure_equals("(1)", pool.nfree_mbuf_blockq, 4u);
+		ensure_equals("(2)", pool.ncompactions, 0u);
+
+		// Exceeding the watermark compacts down to half the watermark.
+		buffers.pop_back();
+		ensure_equals("(3)", pool.ncompactions, 1u);
+		ensure_equals("(4)", pool.nfree_mbuf_blockq, 2u);
+		ensure_equals("(5)", pool.nactive_mbuf_blockq, 3u);
+	}
 }
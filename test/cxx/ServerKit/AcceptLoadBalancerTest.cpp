@@ -0,0 +1,191 @@
+#include <TestSupport.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <vector>
+#include <poll.h>
+#include <BackgroundEventLoop.h>
+#include <ServerKit/Context.h>
+#include <ServerKit/AcceptLoadBalancer.h>
+#include <LoggingKit/LoggingKit.h>
+#include <FileDescriptor.h>
+#include <Utils/IOUtils.h>
+
+using namespace Passenger;
+using namespace Passenger::ServerKit;
+using namespace std;
+
+namespace tut {
+	/** Records the client file descriptors that the load balancer feeds it. */
+	class FakeServer {
+	private:
+		ServerKit::Context *context;
+		boost::mutex syncher;
+		vector<int> clients;
+
+	public:
+		FakeServer(ServerKit::Context *_context)
+			: context(_context)
+			{ }
+
+		~FakeServer() {
+			for (unsigned int i = 0; i < clients.size(); i++) {
+				safelyClose(clients[i]);
+			}
+		}
+
+		ServerKit::Context *getContext() {
+			return context;
+		}
+
+		void feedNewClients(const int *fds, unsigned int count) {
+			boost::lock_guard<boost::mutex> l(syncher);
+			clients.insert(clients.end(), fds, fds + count);
+		}
+
+		unsigned int getClientCount() {
+			boost::lock_guard<boost::mutex> l(syncher);
+			return clients.size();
+		}
+	};
+
+	struct ServerKit_AcceptLoadBalancerTest {
+		BackgroundEventLoop bg;
+		ServerKit::Schema skSchema;
+		ServerKit::Context context;
+		FakeServer server1, server2;
+		AcceptLoadBalancer<FakeServer> *loadBalancer;
+		int serverSocket1, serverSocket2;
+		vector<FileDescriptor> connections;
+
+		ServerKit_AcceptLoadBalancerTest()
+			: bg(false, true),
+			  context(skSchema),
+			  server1(&context),
+			  server2(&context)
+		{
+			LoggingKit::setLevel(LoggingKit::CRIT);
+			context.libev = bg.safe;
+			context.libuv = bg.libuv_loop;
+			context.initialize();
+			serverSocket1 = createUnixServer("tmp.server1");
+			serverSocket2 = createUnixServer("tmp.server2");
+			loadBalancer = new AcceptLoadBalancer<FakeServer>();
+			loadBalancer->servers.push_back(&server1);
+			loadBalancer->servers.push_back(&server2);
+			bg.start();
+		}
+
+		~ServerKit_AcceptLoadBalancerTest() {
+			delete loadBalancer;
+			bg.stop();
+			safelyClose(serverSocket1);
+			safelyClose(serverSocket2);
+			unlink("tmp.server1");
+			unlink("tmp.server2");
+			LoggingKit::setLevel(LoggingKit::Level(DEFAULT_LOG_LEVEL));
+		}
+
+		void connect(const char *filename) {
+			connections.push_back(FileDescriptor(
+				connectToUnixServer(filename, __FILE__, __LINE__),
+				NULL, 0));
+		}
+
+		unsigned int getClientCount() {
+			return server1.getClientCount() + server2.getClientCount();
+		}
+	};
+
+	DEFINE_TEST_GROUP(ServerKit_AcceptLoadBalancerTest);
+
+	TEST_METHOD(1) {
+		set_test_name("It distributes clients over the servers in a round-robin manner");
+		loadBalancer->listen(serverSocket1);
+		loadBalancer->start();
+
+		for (unsigned int i = 0; i < 4; i++) {
+			connect("tmp.server1");
+			EVENTUALLY(5,
+				result = getClientCount() == i + 1;
+			);
+		}
+		ensure_equals("(1)", server1.getClientCount(), 2u);
+		ensure_equals("(2)", server2.getClientCount(), 2u);
+	}
+
+	TEST_METHOD(2) {
+		set_test_name("It accepts clients on all server sockets");
+		loadBalancer->listen(serverSocket1);
+		loadBalancer->listen(serverSocket2);
+		loadBalancer->start();
+
+		connect("tmp.server1");
+		connect("tmp.server2");
+		EVENTUALLY(5,
+			result = getClientCount() == 2;
+		);
+	}
+
+	TEST_METHOD(3) {
+		set_test_name("listen() adds a server socket while the load balancer is running");
+		loadBalancer->listen(serverSocket1);
+		loadBalancer->start();
+
+		loadBalancer->listen(serverSocket2);
+		connect("tmp.server2");
+		EVENTUALLY(5,
+			result = getClientCount() == 1;
+		);
+		connect("tmp.server1");
+		EVENTUALLY(5,
+			result = getClientCount() == 2;
+		);
+	}
+
+	TEST_METHOD(4) {
+		set_test_name("unlisten() removes a server socket while the load balancer is running");
+		loadBalancer->listen(serverSocket1);
+		loadBalancer->listen(serverSocket2);
+		loadBalancer->start();
+
+		ensure("(1)", loadBalancer->unlisten(serverSocket2));
+		ensure("(2)", !loadBalancer->unlisten(serverSocket2));
+
+		// The connection is queued by the kernel, but nobody accepts it.
+		connect("tmp.server2");
+		SHOULD_NEVER_HAPPEN(200,
+			result = getClientCount() > 0;
+		);
+
+		// So we can still accept it ourselves.
+		struct pollfd pfd;
+		pfd.fd = serverSocket2;
+		pfd.events = POLLIN;
+		ensure_equals("(3)", poll(&pfd, 1, 1000), 1);
+		FileDescriptor client(accept(serverSocket2, NULL, NULL), NULL, 0);
+		ensure("(4)", client != -1);
+
+		// The other server socket is unaffected.
+		connect("tmp.server1");
+		EVENTUALLY(5,
+			result = getClientCount() == 1;
+		);
+	}
+
+	TEST_METHOD(5) {
+		set_test_name("unlisten() works before the load balancer is started");
+		loadBalancer->listen(serverSocket1);
+		loadBalancer->listen(serverSocket2);
+		ensure("(1)", loadBalancer->unlisten(serverSocket1));
+		loadBalancer->start();
+
+		connect("tmp.server2");
+		EVENTUALLY(5,
+			result = getClientCount() == 1;
+		);
+		connect("tmp.server1");
+		SHOULD_NEVER_HAPPEN(200,
+			result = getClientCount() > 1;
+		);
+	}
+}
@@ -0,0 +1,312 @@
+#include <TestSupport.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+#include <oxt/system_calls.hpp>
+#include <BackgroundEventLoop.h>
+#include <ServerKit/AsyncHttpClient.h>
+#include <LoggingKit/LoggingKit.h>
+#include <FileDescriptor.h>
+#include <Utils/IOUtils.h>
+#include <Utils/MessageIO.h>
+#include <Utils/BufferedIO.h>
+#include <Utils/StrIntUtils.h>
+
+using namespace Passenger;
+using namespace Passenger::ServerKit;
+using namespace std;
+using namespace oxt;
+
+namespace tut {
+	struct ServerKit_AsyncHttpClientTest {
+		BackgroundEventLoop bg;
+		ServerKit::Schema skSchema;
+		ServerKit::Context context;
+		boost::shared_ptr<AsyncHttpClient> client;
+		int serverSocket;
+		boost::shared_ptr<TempThread> serverThread;
+		boost::atomic<unsigned int> connectionsAccepted;
+
+		boost::mutex syncher;
+		bool done;
+		AsyncHttpClient::Response response;
+		string streamedBody;
+		string lastRequestHeaders;
+
+		ServerKit_AsyncHttpClientTest()
+			: bg(false, true),
+			  context(skSchema),
+			  connectionsAccepted(0),
+			  done(false)
+		{
+			context.libev = bg.safe;
+			context.libuv = bg.libuv_loop;
+			context.initialize();
+			client = boost::make_shared<AsyncHttpClient>(&context);
+			serverSocket = createUnixServer("tmp.server");
+			bg.start();
+		}
+
+		~ServerKit_AsyncHttpClientTest() {
+			serverThread.reset();
+			bg.safe->runSync(boost::bind(&ServerKit_AsyncHttpClientTest::destroyClient,
+				this));
+			safelyClose(serverSocket);
+			unlink("tmp.server");
+			bg.stop();
+		}
+
+		void destroyClient() {
+			client.reset();
+		}
+
+		void startServer() {
+			serverThread = boost::make_shared<TempThread>(
+				boost::bind(&ServerKit_AsyncHttpClientTest::serverMain, this));
+		}
+
+		void serverMain() {
+			while (true) {
+				FileDescriptor fd(syscalls::accept(serverSocket, NULL, NULL),
+					__FILE__, __LINE__);
+				connectionsAccepted++;
+				BufferedIO io(fd);
+				while (handleRequest(fd, io)) {
+					// Keep handling requests on this connection.
+				}
+			}
+		}
+
+		bool handleRequest(FileDescriptor &fd, BufferedIO &io) {
+			string requestLine = io.readLine();
+			string line;
+
+			if (requestLine.empty()) {
+				return false;
+			}
+			{
+				boost::lock_guard<boost::mutex> l(syncher);
+				lastRequestHeaders.clear();
+			}
+			do {
+				line = io.readLine();
+				boost::lock_guard<boost::mutex> l(syncher);
+				lastRequestHeaders.append(line);
+			} while (!line.empty() && line != "\r\n");
+
+			if (startsWith(requestLine, "GET /hello ")) {
+				writeExact(fd,
+					"HTTP/1.1 200 OK\r\n"
+					"Content-Length: 5\r\n"
+					"X-Foo: bar\r\n\r\n"
+					"hello");
+				return true;
+			} else if (startsWith(requestLine, "GET /chunked ")) {
+				writeExact(fd,
+					"HTTP/1.1 200 OK\r\n"
+					"Transfer-Encoding: chunked\r\n\r\n"
+					"3\r\nabc\r\n"
+					"4\r\ndefg\r\n"
+					"0\r\n\r\n");
+				return true;
+			} else if (startsWith(requestLine, "GET /fd ")) {
+				Pipe p = createPipe(__FILE__, __LINE__);
+				writeExact(p.second, "hello");
+				writeExact(fd,
+					"HTTP/1.1 200 OK\r\n\r\n");
+				writeFileDescriptorWithNegotiation(fd, p.first);
+				return false;
+			} else if (startsWith(requestLine, "GET /close ")) {
+				writeExact(fd,
+					"HTTP/1.1 404 Not Found\r\n"
+					"Connection: close\r\n\r\n"
+					"not found");
+				return false;
+			} else {
+				// Never respond.
+				syscalls::usleep(60000000);
+				return false;
+			}
+		}
+
+		void makeRequest(const string &uri, unsigned long long timeout = 5000000,
+			bool stream = false, bool receiveFd = false)
+		{
+			AsyncHttpClient::Request req;
+			req.address = "unix:tmp.server";
+			req.uri = uri;
+			req.timeout = timeout;
+			req.receiveFileDescriptor = receiveFd;
+			req.callback = boost::bind(&ServerKit_AsyncHttpClientTest::onResponse,
+				this, boost::placeholders::_1);
+			if (stream) {
+				req.dataCallback = boost::bind(&ServerKit_AsyncHttpClientTest::onData,
+					this, boost::placeholders::_1);
+			}
+			{
+				boost::lock_guard<boost::mutex> l(syncher);
+				done = false;
+			}
+			bg.safe->runLater(boost::bind(&AsyncHttpClient::request, client.get(), req));
+		}
+
+		void onResponse(const AsyncHttpClient::Response &resp) {
+			boost::lock_guard<boost::mutex> l(syncher);
+			response = resp;
+			done = true;
+		}
+
+		void onData(const StaticString &data) {
+			boost::lock_guard<boost::mutex> l(syncher);
+			streamedBody.append(data.data(), data.size());
+		}
+
+		void waitForResponse() {
+			EVENTUALLY(5,
+				boost::lock_guard<boost::mutex> l(syncher);
+				result = done;
+			);
+		}
+
+		Json::Value inspectClient() {
+			Json::Value result;
+			bg.safe->runSync(boost::bind(&ServerKit_AsyncHttpClientTest::_inspectClient,
+				this, &result));
+			return result;
+		}
+
+		void _inspectClient(Json::Value *result) {
+			*result = client->inspectStateAsJson();
+		}
+	};
+
+	DEFINE_TEST_GROUP(ServerKit_AsyncHttpClientTest);
+
+	TEST_METHOD(1) {
+		set_test_name("It parses the status, headers and body of a response");
+		startServer();
+		makeRequest("/hello");
+		waitForResponse();
+		ensure_equals(response.status, 200);
+		ensure_equals(response.headers.lookupCopy("x-foo"), "bar");
+		ensure_equals(response.body, "hello");
+	}
+
+	TEST_METHOD(2) {
+		set_test_name("It supports chunked responses");
+		startServer();
+		makeRequest("/chunked");
+		waitForResponse();
+		ensure_equals(response.status, 200);
+		ensure_equals(response.body, "abcdefg");
+	}
+
+	TEST_METHOD(3) {
+		set_test_name("It supports responses that end when the connection is closed");
+		startServer();
+		makeRequest("/close");
+		waitForResponse();
+		ensure_equals(response.status, 404);
+		ensure_equals(response.body, "not found");
+		ensure_equals(inspectClient()["connection_count"].asUInt(), 0u);
+	}
+
+	TEST_METHOD(4) {
+		set_test_name("It reuses kept-alive connections");
+		startServer();
+		makeRequest("/hello");
+		waitForResponse();
+		ensure_equals("(1)", response.status, 200);
+		ensure_equals("(2)", inspectClient()["idle_connection_count"].asUInt(), 1u);
+
+		makeRequest("/chunked");
+		waitForResponse();
+		ensure_equals("(3)", response.status, 200);
+		ensure_equals("(4)", response.body, "abcdefg");
+		ensure_equals("(5)", connectionsAccepted.load(), 1u);
+		ensure_equals("(6)", inspectClient()["total_connections_reused"].asUInt(), 1u);
+	}
+
+	TEST_METHOD(5) {
+		set_test_name("If the response body is streamed, it is passed to the "
+			"data callback instead of being buffered");
+		startServer();
+		makeRequest("/chunked", 5000000, true);
+		waitForResponse();
+		ensure_equals(response.status, 200);
+		ensure_equals(response.body, "");
+		boost::lock_guard<boost::mutex> l(syncher);
+		ensure_equals(streamedBody, "abcdefg");
+	}
+
+	TEST_METHOD(6) {
+		set_test_name("It fails with ERROR_TIMEOUT if the server does not "
+			"respond in time");
+		startServer();
+		makeRequest("/hang", 20000);
+		waitForResponse();
+		ensure_equals(response.status, (int) AsyncHttpClient::ERROR_TIMEOUT);
+		ensure_equals(inspectClient()["connection_count"].asUInt(), 0u);
+	}
+
+	TEST_METHOD(7) {
+		set_test_name("It fails with ERROR_IO if it cannot connect");
+		unlink("tmp.server");
+		makeRequest("/hello");
+		waitForResponse();
+		ensure_equals(response.status, (int) AsyncHttpClient::ERROR_IO);
+		ensure(!response.errorMessage.empty());
+	}
+
+	TEST_METHOD(8) {
+		set_test_name("It sends a Host header");
+		startServer();
+		makeRequest("/hello");
+		waitForResponse();
+		ensure_equals("(1)", response.status, 200);
+		boost::lock_guard<boost::mutex> l(syncher);
+		ensure("(2)", containsSubstring(lastRequestHeaders, "Host: localhost\r\n"));
+	}
+
+	TEST_METHOD(9) {
+		set_test_name("Destroying the client fails the requests that are "
+			"still in progress");
+		startServer();
+		makeRequest("/hang");
+		EVENTUALLY(5,
+			result = connectionsAccepted.load() == 1;
+		);
+		bg.safe->runSync(boost::bind(&ServerKit_AsyncHttpClientTest::destroyClient,
+			this));
+		boost::lock_guard<boost::mutex> l(syncher);
+		ensure("(1)", done);
+		ensure_equals("(2)", response.status, (int) AsyncHttpClient::ERROR_IO);
+	}
+
+	TEST_METHOD(10) {
+		set_test_name("If receiveFileDescriptor is set, it receives the file descriptor "
+			"that the server passes after the response headers");
+		startServer();
+		makeRequest("/fd", 5000000, false, true);
+		waitForResponse();
+		ensure_equals("(1)", response.status, 200);
+		ensure("(2)", response.fd != -1);
+		ensure_equals("(3)", inspectClient()["connection_count"].asUInt(), 0u);
+
+		char buf[5];
+		unsigned long long timeout = 5000000;
+		ensure_equals("(4)", readExact(response.fd, buf, sizeof(buf), &timeout), 5u);
+		ensure_equals("(5)", StaticString(buf, sizeof(buf)), "hello");
+	}
+
+	TEST_METHOD(11) {
+		set_test_name("If receiveFileDescriptor is set but the response status is not 200, "
+			"it reads the response body instead");
+		startServer();
+		makeRequest("/close", 5000000, false, true);
+		waitForResponse();
+		ensure_equals("(1)", response.status, 404);
+		ensure_equals("(2)", response.body, "not found");
+		ensure("(3)", response.fd == -1);
+	}
+}
@@ -1,6 +1,7 @@
 #include <TestSupport.h>
 #include <boost/thread.hpp>
 #include <string>
+#include <cstdio>
 #include <BackgroundEventLoop.h>
 #include <Constants.h>
 #include <LoggingKit/LoggingKit.h>
@@ -922,6 +923,39 @@ namespace tut {
 		);
 	}
 
+	TEST_METHOD(39) {
+		set_test_name("If a buffer is written to disk with multiple partial writes, "
+			"then each write continues where the previous one left off");
+
+		Json::Value config;
+		vector<ConfigKit::Error> errors;
+		config["file_buffered_channel_threshold"] = 1;
+		config["file_buffered_channel_max_disk_chunk_write_size"] = 2;
+		ensure(context.configure(config, errors));
+
+		toConsume = -1;
+		startLoop();
+
+		feedChannel("hello");
+		feedChannel("world!");
+		feedChannel("foo bar");
+		EVENTUALLY(5,
+			result = getChannelMode() == FileBufferedChannel::IN_FILE_MODE;
+		);
+		EVENTUALLY(5,
+			result = getChannelWriterState() == FileBufferedChannel::WS_INACTIVE;
+		);
+		ensure_equals(getChannelBytesBuffered(), 0u);
+
+		channelConsumed(sizeof("hello") - 1, false);
+		EVENTUALLY(5,
+			LOCK();
+			result = log ==
+				"Data: hello\n"
+				"Data: world!foo bar\n";
+		);
+	}
+
 
 	/***** Switching from in-file mode to in-memory mode *****/
 
@@ -1080,4 +1114,49 @@ namespace tut {
 			ensure_equals(counter, 2u);
 		}
 	}
+
+
+	/***** When using io_uring *****/
+
+	#ifdef PASSENGER_SUPPORTS_IO_URING
+		TEST_METHOD(50) {
+			set_test_name("It moves buffers to disk and reads them back through io_uring");
+
+			try {
+				context.ioUring = new IoUring(bg.safe->getLoop(), 16);
+			} catch (const SystemException &) {
+				fprintf(stderr, "*** Skipping ServerKit_FileBufferedChannelTest 50: "
+					"io_uring is not supported by this kernel\n");
+				return;
+			}
+
+			Json::Value config;
+			vector<ConfigKit::Error> errors;
+			config["file_buffered_channel_threshold"] = 1;
+			ensure(context.configure(config, errors));
+
+			toConsume = -1;
+			startLoop();
+
+			feedChannel("hello");
+			feedChannel("world!");
+			EVENTUALLY(5,
+				result = getChannelMode() == FileBufferedChannel::IN_FILE_MODE;
+			);
+			EVENTUALLY(5,
+				result = getChannelWriterState() == FileBufferedChannel::WS_INACTIVE;
+			);
+			ensure_equals(getChannelBytesBuffered(), 0u);
+
+			channelConsumed(sizeof("hello") - 1, false);
+			EVENTUALLY(5,
+				LOCK();
+				result = log ==
+					"Data: hello\n"
+					"Data: world!\n";
+			);
+			// Creating the file, writing 2 buffers and reading 1 buffer.
+			ensure(context.ioUring->inspectStateAsJson()["submitted"].asUInt64() >= 4);
+		}
+	#endif
 }
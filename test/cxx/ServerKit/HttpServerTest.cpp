@@ -139,11 +139,29 @@ namespace tut {
 			}
 		}
 
+		void testHeader(MyClient *client, MyRequest *req) {
+			const LString *value = req->headers.lookup("foo");
+			if (value != NULL && value->start->next == NULL) {
+				writeSimpleResponse(client, 200, NULL, "Contiguous: 1");
+			} else {
+				writeSimpleResponse(client, 500, NULL, "Contiguous: 0");
+			}
+			if (!req->ended()) {
+				endRequest(&client, &req);
+			}
+		}
+
 		void testHalfClose(MyClient *client, MyRequest *req) {
 			req->testingHalfClose = true;
 			// Continues in onRequestEarlyHalfClose()
 		}
 
+		void testHold(MyClient *client, MyRequest *req) {
+			refRequest(req, __FILE__, __LINE__);
+			heldRequests.push_back(req);
+			// Continues in releaseHeldRequests()
+		}
+
 		void testEarlyReadErrorDetection(MyClient *client, MyRequest *req) {
 			req->nextRequestEarlyReadError = ENOSPC;
 			writeSimpleResponse(client, 200, NULL, "OK");
@@ -171,10 +189,14 @@ namespace tut {
 				testLargeResponse(client, req);
 			} else if (psg_lstr_cmp(&req->path, "/path_test")) {
 				testPath(client, req);
+			} else if (psg_lstr_cmp(&req->path, "/header_test")) {
+				testHeader(client, req);
 			} else if (psg_lstr_cmp(&req->path, "/half_close_test")) {
 				testHalfClose(client, req);
 			} else if (psg_lstr_cmp(&req->path, "/early_read_error_detection_test")) {
 				testEarlyReadErrorDetection(client, req);
+			} else if (psg_lstr_cmp(&req->path, "/hold_test")) {
+				testHold(client, req);
 			} else {
 				testRequest(client, req);
 			}
@@ -217,6 +239,11 @@ namespace tut {
 			}
 		}
 
+		virtual void onRequestPipelined(MyClient *client, MyRequest *req) {
+			ParentClass::onRequestPipelined(client, req);
+			requestsPipelined++;
+		}
+
 		virtual void reinitializeRequest(MyClient *client, MyRequest *req) {
 			ParentClass::reinitializeRequest(client, req);
 			req->body.clear();
@@ -234,6 +261,13 @@ namespace tut {
 					break;
 				}
 			}
+			for (i = 0; i < heldRequests.size(); i++) {
+				if (heldRequests[i] == req) {
+					heldRequests.erase(heldRequests.begin() + i);
+					unrefRequest(req, __FILE__, __LINE__);
+					break;
+				}
+			}
 			ParentClass::deinitializeRequest(client, req);
 		}
 
@@ -245,9 +279,11 @@ namespace tut {
 		bool allowUpgrades;
 
 		vector<MyRequest *> requestsWaitingToStartAcceptingBody;
+		vector<MyRequest *> heldRequests;
 		unsigned int bodyBytesRead;
 		unsigned int halfCloseDetected;
 		unsigned int clientDataErrors;
+		unsigned int requestsPipelined;
 
 		MyServer(Context *context, const HttpServerSchema &schema,
 			const Json::Value &initialConfig = Json::Value())
@@ -255,7 +291,8 @@ namespace tut {
 			  allowUpgrades(true),
 			  bodyBytesRead(0),
 			  halfCloseDetected(0),
-			  clientDataErrors(0)
+			  clientDataErrors(0),
+			  requestsPipelined(0)
 			{ }
 
 		void startAcceptingBody() {
@@ -270,6 +307,23 @@ namespace tut {
 				unrefRequest(req, __FILE__, __LINE__);
 			}
 		}
+
+		void releaseHeldRequests() {
+			MyRequest *req;
+			vector<MyRequest *> heldRequests;
+
+			heldRequests.swap(this->heldRequests);
+
+			foreach (req, heldRequests) {
+				MyClient *client = static_cast<MyClient *>(req->client);
+				MyRequest *req2 = req;
+				if (!req->ended()) {
+					writeSimpleResponse(client, 200, NULL, "held");
+					endRequest(&client, &req2);
+				}
+				unrefRequest(req, __FILE__, __LINE__);
+			}
+		}
 	};
 
 	struct ServerKit_HttpServerTest {
@@ -407,6 +461,55 @@ namespace tut {
 			*result = server->activeClientCount;
 		}
 
+		bool clientIsIdle() {
+			bool result;
+			bg.safe->runSync(boost::bind(&ServerKit_HttpServerTest::_clientIsIdle,
+				this, &result));
+			return result;
+		}
+
+		unsigned int getPipelinedRequestCount() {
+			unsigned int result;
+			bg.safe->runSync(boost::bind(&ServerKit_HttpServerTest::_getPipelinedRequestCount,
+				this, &result));
+			return result;
+		}
+
+		void _getPipelinedRequestCount(unsigned int *result) {
+			MyClient *client = TAILQ_FIRST(&server->activeClients);
+			*result = (client != NULL) ? client->pipelinedRequestCount : 0;
+		}
+
+		unsigned int getRequestsPipelined() {
+			unsigned int result;
+			bg.safe->runSync(boost::bind(&ServerKit_HttpServerTest::_getRequestsPipelined,
+				this, &result));
+			return result;
+		}
+
+		void _getRequestsPipelined(unsigned int *result) {
+			*result = server->requestsPipelined;
+		}
+
+		void releaseHeldRequests() {
+			bg.safe->runSync(boost::bind(&MyServer::releaseHeldRequests, server.get()));
+		}
+
+		void setMaxPipelinedRequests(unsigned int value) {
+			Json::Value config;
+			vector<ConfigKit::Error> errors;
+			HttpServerConfigChangeRequest req;
+
+			config["max_pipelined_requests"] = value;
+			ensure(server->prepareConfigChange(config, errors, req));
+			server->commitConfigChange(req);
+		}
+
+		void _clientIsIdle(bool *result) {
+			MyClient *client = TAILQ_FIRST(&server->activeClients);
+			*result = client != NULL && client->currentRequest == NULL;
+		}
+
 		unsigned int getNumRequestsWaitingToStartAcceptingBody() {
 			unsigned int result;
 			bg.safe->runSync(boost::bind(
@@ -624,6 +727,21 @@ namespace tut {
 		ensure(containsSubstring(response, "Contiguous: 1"));
 	}
 
+	TEST_METHOD(6) {
+		set_test_name("It ensures that small header values are contiguous");
+
+		connectToServer();
+		sendRequestAndWait(
+			"GET /header_test HTTP/1.1\r\n"
+			"Connection: close\r\n"
+			"Fo");
+		sendRequestAndWait("o: b");
+		sendRequestAndWait("ar\r\n\r\n");
+
+		string response = readAll(fd, 1024).first;
+		ensure(containsSubstring(response, "Contiguous: 1"));
+	}
+
 
 	/***** Invalid HTTP header parsing *****/
 
@@ -1449,6 +1567,60 @@ namespace tut {
 		);
 	}
 
+	TEST_METHOD(66) {
+		set_test_name("A kept-alive connection holds no request object while "
+			"it waits for the next request");
+		char buf[7];
+
+		connectToServer();
+		EVENTUALLY(5,
+			result = clientIsIdle();
+		);
+
+		sendRequest(
+			"GET / HTTP/1.1\r\n"
+			"Connection: keep-alive\r\n"
+			"Host: foo\r\n\r\n");
+		string header = readResponseHeader();
+		ensure("(1)", containsSubstring(header, "Connection: keep-alive"));
+		ensure_equals(io.read(buf, 7), 7u);
+		ensure_equals(string(buf, 7), "hello /");
+		EVENTUALLY(5,
+			result = clientIsIdle();
+		);
+
+		sendRequest(
+			"GET /foo HTTP/1.1\r\n"
+			"Connection: close\r\n"
+			"Host: foo\r\n\r\n");
+		string response = io.readAll();
+		ensure_equals(stripHeaders(response), "hello /foo");
+		ensure_equals(getTotalRequestsBegun(), 2u);
+	}
+
+	TEST_METHOD(67) {
+		set_test_name("An idle kept-alive connection is disconnected when the "
+			"client closes it");
+		char buf[7];
+
+		connectToServer();
+		sendRequest(
+			"GET / HTTP/1.1\r\n"
+			"Connection: keep-alive\r\n"
+			"Host: foo\r\n\r\n");
+		readResponseHeader();
+		ensure_equals(io.read(buf, 7), 7u);
+		EVENTUALLY(5,
+			result = clientIsIdle();
+		);
+
+		fd.close();
+		EVENTUALLY(5,
+			result = getActiveClientCount() == 0;
+		);
+		ensure_equals(getTotalRequestsBegun(), 1u);
+	}
+
 
 	/***** Early half-close detection *****/
 
@@ -1527,6 +1699,177 @@ namespace tut {
 	}
 
 
+	/***** Pipelining *****/
+
+	TEST_METHOD(75) {
+		set_test_name("Pipelined requests are parsed while an earlier request is "
+			"being processed, and are responded to in order");
+
+		setMaxPipelinedRequests(8);
+
+		connectToServer();
+		sendRequest(
+			"GET /hold_test HTTP/1.1\r\n"
+			"Connection: keep-alive\r\n\r\n"
+			"GET /a HTTP/1.1\r\n"
+			"Connection: keep-alive\r\n\r\n"
+			"GET /b HTTP/1.1\r\n"
+			"Connection: close\r\n\r\n");
+		EVENTUALLY(5,
+			result = getPipelinedRequestCount() == 2;
+		);
+		ensure_equals("(1)", getTotalRequestsBegun(), 1u);
+		ensure_equals("(2)", getRequestsPipelined(), 2u);
+
+		releaseHeldRequests();
+		string response = readAll(fd, 1024 * 1024).first;
+		string::size_type pos1 = response.find("held");
+		string::size_type pos2 = response.find("hello /a");
+		string::size_type pos3 = response.find("hello /b");
+		ensure("(3)", pos1 != string::npos);
+		ensure("(4)", pos2 != string::npos);
+		ensure("(5)", pos3 != string::npos);
+		ensure("(6)", pos1 < pos2);
+		ensure("(7)", pos2 < pos3);
+		ensure_equals("(8)", getTotalRequestsBegun(), 3u);
+	}
+
+	TEST_METHOD(76) {
+		set_test_name("The number of requests that are parsed ahead is limited "
+			"by max_pipelined_requests");
+
+		setMaxPipelinedRequests(1);
+		connectToServer();
+		sendRequest(
+			"GET /hold_test HTTP/1.1\r\n"
+			"Connection: keep-alive\r\n\r\n"
+			"GET /a HTTP/1.1\r\n"
+			"Connection: keep-alive\r\n\r\n"
+			"GET /b HTTP/1.1\r\n"
+			"Connection: close\r\n\r\n");
+		EVENTUALLY(5,
+			result = getPipelinedRequestCount() == 1;
+		);
+		SHOULD_NEVER_HAPPEN(100,
+			result = getPipelinedRequestCount() > 1;
+		);
+
+		releaseHeldRequests();
+		string response = readAll(fd, 1024 * 1024).first;
+		ensure("(1)", containsSubstring(response, "held"));
+		ensure("(2)", containsSubstring(response, "hello /a"));
+		ensure("(3)", containsSubstring(response, "hello /b"));
+		ensure_equals("(4)", getTotalRequestsBegun(), 3u);
+	}
+
+	TEST_METHOD(77) {
+		set_test_name("Parsing ahead stops after a pipelined request with a body, "
+			"until that request has begun");
+
+		setMaxPipelinedRequests(8);
+
+		connectToServer();
+		sendRequest(
+			"GET /hold_test HTTP/1.1\r\n"
+			"Connection: keep-alive\r\n\r\n"
+			"GET /body_test HTTP/1.1\r\n"
+			"Connection: keep-alive\r\n"
+			"Content-Length: 3\r\n\r\n"
+			"abc"
+			"GET /b HTTP/1.1\r\n"
+			"Connection: close\r\n\r\n");
+		EVENTUALLY(5,
+			result = getPipelinedRequestCount() == 1;
+		);
+		SHOULD_NEVER_HAPPEN(100,
+			result = getPipelinedRequestCount() > 1;
+		);
+		ensure_equals("(1)", getBodyBytesRead(), 0u);
+
+		releaseHeldRequests();
+		string response = readAll(fd, 1024 * 1024).first;
+		string::size_type pos1 = response.find("held");
+		string::size_type pos2 = response.find("3 bytes: abc");
+		string::size_type pos3 = response.find("hello /b");
+		ensure("(2)", pos1 != string::npos);
+		ensure("(3)", pos2 != string::npos);
+		ensure("(4)", pos3 != string::npos);
+		ensure("(5)", pos1 < pos2);
+		ensure("(6)", pos2 < pos3);
+	}
+
+	TEST_METHOD(78) {
+		set_test_name("If the client closes the connection after pipelining requests, "
+			"the complete ones are still responded to");
+
+		setMaxPipelinedRequests(8);
+
+		connectToServer();
+		sendRequest(
+			"GET /hold_test HTTP/1.1\r\n"
+			"Connection: keep-alive\r\n\r\n"
+			"GET /a HTTP/1.1\r\n"
+			"Connection: keep-alive\r\n\r\n"
+			"GET /c HT");
+		shutdown(fd, SHUT_WR);
+		EVENTUALLY(5,
+			result = getPipelinedRequestCount() == 1;
+		);
+
+		releaseHeldRequests();
+		string response = readAll(fd, 1024 * 1024).first;
+		ensure("(1)", containsSubstring(response, "held"));
+		ensure("(2)", containsSubstring(response, "hello /a"));
+		ensure("(3)", !containsSubstring(response, "hello /c"));
+		ensure_equals("(4)", getTotalRequestsBegun(), 2u);
+	}
+
+	TEST_METHOD(79) {
+		set_test_name("Requests are not parsed ahead if max_pipelined_requests is 0");
+
+		setMaxPipelinedRequests(0);
+		connectToServer();
+		sendRequest(
+			"GET /hold_test HTTP/1.1\r\n"
+			"Connection: keep-alive\r\n\r\n"
+			"GET /a HTTP/1.1\r\n"
+			"Connection: close\r\n\r\n");
+		SHOULD_NEVER_HAPPEN(100,
+			result = getPipelinedRequestCount() > 0;
+		);
+
+		releaseHeldRequests();
+		string response = readAll(fd, 1024 * 1024).first;
+		ensure("(1)", containsSubstring(response, "held"));
+		ensure("(2)", containsSubstring(response, "hello /a"));
+		ensure_equals("(3)", getRequestsPipelined(), 0u);
+	}
+
+	TEST_METHOD(98) {
+		set_test_name("Upon shutting down the server, pipelined requests that "
+			"haven't begun yet are not processed");
+
+		setMaxPipelinedRequests(8);
+		connectToServer();
+		sendRequest(
+			"GET /hold_test HTTP/1.1\r\n"
+			"Connection: keep-alive\r\n\r\n"
+			"GET /a HTTP/1.1\r\n"
+			"Connection: keep-alive\r\n\r\n");
+		EVENTUALLY(5,
+			result = getPipelinedRequestCount() == 1;
+		);
+		shutdownServer();
+
+		releaseHeldRequests();
+		string response = readAll(fd, 1024 * 1024).first;
+		ensure("(1)", containsSubstring(response, "held"));
+		ensure("(2)", containsSubstring(response, "Connection: close"));
+		ensure("(3)", !containsSubstring(response, "hello /a"));
+		ensure_equals("(4)", getTotalRequestsBegun(), 1u);
+	}
+
+
 	/***** Miscellaneous *****/
 
 	TEST_METHOD(80) {
@@ -1629,6 +1972,31 @@ namespace tut {
 		ensure_equals(response, "");
 	}
 
+	TEST_METHOD(85) {
+		set_test_name("Upon shutting down the server, idle keep-alive "
+			"connections are disconnected");
+		char buf[7];
+
+		LoggingKit::setLevel(LoggingKit::CRIT);
+		connectToServer();
+		sendRequest(
+			"GET / HTTP/1.1\r\n"
+			"Connection: keep-alive\r\n"
+			"Host: foo\r\n\r\n");
+		readResponseHeader();
+		ensure_equals(io.read(buf, 7), 7u);
+		EVENTUALLY(5,
+			result = clientIsIdle();
+		);
+
+		shutdownServer();
+		EVENTUALLY(5,
+			result = hasResponseData();
+		);
+		string response = readAll(fd, 1024).first;
+		ensure_equals(response, "");
+	}
+
 
 	/***** Miscellaneous *****/
 
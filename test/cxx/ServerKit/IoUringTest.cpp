@@ -0,0 +1,300 @@
+#include <TestSupport.h>
+#include <BackgroundEventLoop.h>
+#include <SafeLibev.h>
+#include <ServerKit/IoUring.h>
+#include <Utils/StrIntUtils.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#ifdef PASSENGER_SUPPORTS_IO_URING
+
+using namespace Passenger;
+using namespace Passenger::ServerKit;
+using namespace std;
+
+namespace tut {
+	struct ServerKit_IoUringTest {
+		BackgroundEventLoop bg;
+		IoUring *ioUring;
+		boost::mutex syncher;
+		IoUringOperation ops[3];
+		unsigned int completed;
+		int fd;
+		char buf[16];
+
+		ServerKit_IoUringTest()
+			: bg(false, false),
+			  ioUring(NULL),
+			  completed(0),
+			  fd(-1)
+		{
+			try {
+				ioUring = new IoUring(bg.safe->getLoop(), 8);
+			} catch (const SystemException &) {
+				// The kernel doesn't support io_uring. The tests
+				// check for this using `skipIfUnsupported()`.
+			}
+			for (unsigned int i = 0; i < 3; i++) {
+				ops[i].callback = operationDone;
+				ops[i].userData = this;
+				ops[i].result = 0;
+			}
+			memset(buf, 0, sizeof(buf));
+		}
+
+		~ServerKit_IoUringTest() {
+			bg.stop();
+			delete ioUring;
+			if (fd != -1) {
+				close(fd);
+			}
+		}
+
+		bool skipIfUnsupported() {
+			if (ioUring == NULL) {
+				fprintf(stderr, "*** Skipping ServerKit_IoUringTest: "
+					"io_uring is not supported by this kernel\n");
+				return true;
+			} else {
+				return false;
+			}
+		}
+
+		static void operationDone(IoUringOperation *op) {
+			ServerKit_IoUringTest *self = static_cast<ServerKit_IoUringTest *>(op->userData);
+			boost::lock_guard<boost::mutex> l(self->syncher);
+			self->completed++;
+		}
+
+		void openTmpFile() {
+			ensure(ioUring->openat(AT_FDCWD, "/tmp", O_RDWR | O_TMPFILE, 0600, &ops[0]));
+		}
+
+		void writeToFile() {
+			ensure(ioUring->write(fd, "hello world", 11, 0, &ops[0]));
+		}
+
+		int findIoUringFd() {
+			for (int i = 3; i < 1024; i++) {
+				char path[64], target[64];
+				snprintf(path, sizeof(path), "/proc/self/fd/%d", i);
+				ssize_t size = readlink(path, target, sizeof(target) - 1);
+				if (size != -1) {
+					target[size] = '\0';
+					if (strstr(target, "io_uring") != NULL) {
+						return i;
+					}
+				}
+			}
+			return -1;
+		}
+
+		void readFromFile() {
+			ensure(ioUring->read(fd, buf, 5, 6, &ops[0]));
+		}
+
+		void startMultipleOperations() {
+			ensure(ioUring->write(fd, "hello", 5, 0, &ops[0]));
+			ensure(ioUring->write(fd, "world", 5, 5, &ops[1]));
+			ensure(ioUring->read(fd, buf, 5, 100, &ops[2]));
+		}
+
+		void readFromInvalidFd() {
+			ensure(ioUring->read(-1, buf, 5, 0, &ops[0]));
+		}
+
+		void readFromFd() {
+			ensure(ioUring->read(fd, buf, 5, -1, &ops[0]));
+		}
+
+		void destroyIoUring() {
+			delete ioUring;
+			ioUring = NULL;
+		}
+
+		void getState(Json::Value *result) {
+			*result = ioUring->inspectStateAsJson();
+		}
+
+		Json::Value getState() {
+			Json::Value result;
+			bg.safe->runSync(boost::bind(&ServerKit_IoUringTest::getState,
+				this, &result));
+			return result;
+		}
+
+		void run(void (ServerKit_IoUringTest::*func)(), unsigned int expectedCompletions) {
+			{
+				boost::lock_guard<boost::mutex> l(syncher);
+				completed = 0;
+			}
+			bg.safe->runLater(boost::bind(func, this));
+			EVENTUALLY(5,
+				boost::lock_guard<boost::mutex> l(syncher);
+				result = completed == expectedCompletions;
+			);
+		}
+	};
+
+	DEFINE_TEST_GROUP(ServerKit_IoUringTest);
+
+	TEST_METHOD(1) {
+		set_test_name("It writes data to a file and reads it back");
+		if (skipIfUnsupported()) {
+			return;
+		}
+
+		fd = open("/tmp", O_RDWR | O_TMPFILE, 0600);
+		ensure(fd != -1);
+		bg.start();
+
+		run(&ServerKit_IoUringTest::writeToFile, 1);
+		ensure_equals(ops[0].result, 11);
+		run(&ServerKit_IoUringTest::readFromFile, 1);
+		ensure_equals(ops[0].result, 5);
+		ensure_equals(string(buf, 5), "world");
+	}
+
+	TEST_METHOD(2) {
+		set_test_name("It can create anonymous files with O_TMPFILE");
+		if (skipIfUnsupported()) {
+			return;
+		}
+
+		struct stat buf;
+		bg.start();
+		run(&ServerKit_IoUringTest::openTmpFile, 1);
+		ensure("(1)", ops[0].result >= 0);
+		fd = ops[0].result;
+		ensure_equals("(2)", fstat(fd, &buf), 0);
+		ensure_equals("(3)", buf.st_nlink, (nlink_t) 0);
+	}
+
+	TEST_METHOD(3) {
+		set_test_name("Operations started in the same event loop iteration are "
+			"submitted with a single system call");
+		if (skipIfUnsupported()) {
+			return;
+		}
+
+		fd = open("/tmp", O_RDWR | O_TMPFILE, 0600);
+		ensure(fd != -1);
+		bg.start();
+
+		run(&ServerKit_IoUringTest::startMultipleOperations, 3);
+		ensure_equals("(1)", ops[0].result, 5);
+		ensure_equals("(2)", ops[1].result, 5);
+		ensure_equals("(3)", ops[2].result, 0);
+
+		Json::Value state = getState();
+		ensure_equals("(4)", state["submitted"].asUInt(), 3u);
+		ensure_equals("(5)", state["submit_calls"].asUInt(), 1u);
+		ensure_equals("(6)", state["in_flight"].asUInt(), 0u);
+	}
+
+	TEST_METHOD(4) {
+		set_test_name("Failed operations report a negative errno code");
+		if (skipIfUnsupported()) {
+			return;
+		}
+
+		bg.start();
+		run(&ServerKit_IoUringTest::readFromInvalidFd, 1);
+		ensure_equals(ops[0].result, -EBADF);
+	}
+
+	TEST_METHOD(5) {
+		set_test_name("The event loop keeps running while operations are in flight");
+		if (skipIfUnsupported()) {
+			return;
+		}
+
+		// Both watchers of the IoUring are unreferenced, so without
+		// in-flight operations ev_run() returns immediately.
+		struct ev_loop *loop = ev_loop_new(EVFLAG_AUTO);
+		delete ioUring;
+		ioUring = new IoUring(loop, 8);
+		ev_run(loop, 0);
+		ensure_equals("(1)", completed, 0u);
+
+		int fds[2];
+		ensure_equals("(2)", pipe(fds), 0);
+		fd = fds[0];
+		ensure("(3)", ioUring->read(fd, buf, 5, -1, &ops[0]));
+		ensure_equals("(4)", write(fds[1], "hello", 5), (ssize_t) 5);
+		close(fds[1]);
+		ev_run(loop, 0);
+		ensure_equals("(5)", completed, 1u);
+		ensure_equals("(6)", ops[0].result, 5);
+		ensure_equals("(7)", string(buf, 5), "hello");
+
+		delete ioUring;
+		ioUring = NULL;
+		ev_loop_destroy(loop);
+	}
+
+	TEST_METHOD(6) {
+		set_test_name("Destroying the IoUring cancels in-flight operations "
+			"and waits for them");
+		if (skipIfUnsupported()) {
+			return;
+		}
+
+		int fds[2];
+		ensure_equals("(1)", pipe(fds), 0);
+		fd = fds[0];
+		bg.start();
+
+		// Nothing is ever written to the pipe, so the read
+		// can only complete by being canceled.
+		bg.safe->runSync(boost::bind(&ServerKit_IoUringTest::readFromFd, this));
+		bg.safe->runSync(boost::bind(&ServerKit_IoUringTest::destroyIoUring, this));
+		close(fds[1]);
+
+		boost::lock_guard<boost::mutex> l(syncher);
+		ensure_equals("(2)", completed, 1u);
+		ensure("(3)", ops[0].result == -ECANCELED || ops[0].result == -EINTR);
+	}
+
+	TEST_METHOD(7) {
+		set_test_name("Operations that cannot be submitted complete with the error");
+		if (skipIfUnsupported()) {
+			return;
+		}
+
+		struct ev_loop *loop = ev_loop_new(EVFLAG_AUTO);
+		delete ioUring;
+		ioUring = new IoUring(loop, 8);
+
+		// Replace the io_uring file descriptor with one that
+		// io_uring_enter() doesn't accept.
+		int ringFd = findIoUringFd();
+		ensure("(1)", ringFd != -1);
+		int devnull = open("/dev/null", O_RDONLY);
+		ensure("(2)", devnull != -1);
+		ensure_equals("(3)", dup2(devnull, ringFd), ringFd);
+		close(devnull);
+
+		int fds[2];
+		ensure_equals("(4)", pipe(fds), 0);
+		fd = fds[0];
+		ensure("(5)", ioUring->read(fd, buf, 5, -1, &ops[0]));
+		LoggingKit::setLevel(LoggingKit::CRIT);
+		ev_run(loop, 0);
+		LoggingKit::setLevel(LoggingKit::Level(DEFAULT_LOG_LEVEL));
+		close(fds[1]);
+		ensure_equals("(6)", completed, 1u);
+		ensure("(7)", ops[0].result < 0);
+		ensure_equals("(8)", ioUring->getOperationsInFlight(), 0u);
+
+		delete ioUring;
+		ioUring = NULL;
+		ev_loop_destroy(loop);
+	}
+}
+
+#endif /* PASSENGER_SUPPORTS_IO_URING */
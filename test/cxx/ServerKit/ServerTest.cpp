@@ -155,6 +155,33 @@ namespace tut {
 		void _clientIsConnected(Client *client, bool *result) {
 			*result = client->connected();
 		}
+
+		bool changeConfig(const Json::Value &updates) {
+			bool result;
+			bg.safe->runSync(boost::bind(&ServerKit_ServerTest::_changeConfig,
+				this, boost::cref(updates), &result));
+			return result;
+		}
+
+		void _changeConfig(const Json::Value &updates, bool *result) {
+			vector<ConfigKit::Error> errors;
+			Server<Client>::ConfigChangeRequest req;
+			*result = server->prepareConfigChange(updates, errors, req);
+			if (*result) {
+				server->commitConfigChange(req);
+			}
+		}
+
+		bool unlisten(int fd) {
+			bool result;
+			bg.safe->runSync(boost::bind(&ServerKit_ServerTest::_unlisten,
+				this, fd, &result));
+			return result;
+		}
+
+		void _unlisten(int fd, bool *result) {
+			*result = server->unlisten(fd);
+		}
 	};
 
 	DEFINE_TEST_GROUP(ServerKit_ServerTest);
@@ -321,6 +348,28 @@ namespace tut {
 		ensure_equals(getFreeClientCount(), 0u);
 	}
 
+	TEST_METHOD(12) {
+		set_test_name("Changing the freelist settings at runtime resizes the freelist");
+
+		config["min_spare_clients"] = 3;
+		config["client_freelist_limit"] = 3;
+		init();
+		server->createSpareClients();
+		startServer();
+		ensure_equals(getFreeClientCount(), 3u);
+
+		Json::Value updates;
+		updates["min_spare_clients"] = 0;
+		updates["client_freelist_limit"] = 1;
+		ensure(changeConfig(updates));
+		ensure_equals(getFreeClientCount(), 1u);
+
+		updates["min_spare_clients"] = 2;
+		updates["client_freelist_limit"] = 2;
+		ensure(changeConfig(updates));
+		ensure_equals(getFreeClientCount(), 2u);
+	}
+
 
 	/****** Multiple listen endpoints *****/
 
@@ -338,6 +387,27 @@ namespace tut {
 		);
 	}
 
+	TEST_METHOD(21) {
+		set_test_name("It can stop listening on an endpoint at runtime");
+
+		init();
+		server->listen(serverSocket2);
+		startServer();
+		ensure(unlisten(serverSocket1));
+		ensure(!unlisten(serverSocket1));
+
+		FileDescriptor fd2 = connectToServer2();
+		EVENTUALLY(5,
+			result = getActiveClientCount() == 1u;
+		);
+		// The kernel still completes the connection, but the
+		// server must not accept it.
+		FileDescriptor fd1 = connectToServer1();
+		SHOULD_NEVER_HAPPEN(100,
+			result = getActiveClientCount() > 1u;
+		);
+	}
+
 
 	/****** Input and output *****/
 
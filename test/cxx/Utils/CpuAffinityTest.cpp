@@ -0,0 +1,57 @@
+#include <TestSupport.h>
+#include <Utils/CpuAffinity.h>
+
+using namespace Passenger;
+using namespace std;
+
+namespace tut {
+	struct Utils_CpuAffinityTest {
+		vector<unsigned int> cpus;
+	};
+
+	DEFINE_TEST_GROUP(Utils_CpuAffinityTest);
+
+	/***** parseCpuList() *****/
+
+	TEST_METHOD(1) {
+		set_test_name("It parses single CPUs and ranges");
+		ensure(parseCpuList("0-3,8,10-11\n", cpus));
+		ensure_equals(cpus.size(), 7u);
+		ensure_equals(cpus[0], 0u);
+		ensure_equals(cpus[3], 3u);
+		ensure_equals(cpus[4], 8u);
+		ensure_equals(cpus[5], 10u);
+		ensure_equals(cpus[6], 11u);
+	}
+
+	TEST_METHOD(2) {
+		set_test_name("It sorts the CPUs and removes duplicates");
+		ensure(parseCpuList("5,1-2,2", cpus));
+		ensure_equals(cpus.size(), 3u);
+		ensure_equals(cpus[0], 1u);
+		ensure_equals(cpus[1], 2u);
+		ensure_equals(cpus[2], 5u);
+	}
+
+	TEST_METHOD(3) {
+		set_test_name("It rejects malformed lists");
+		ensure("(1)", !parseCpuList("", cpus));
+		ensure("(2)", !parseCpuList("1,", cpus));
+		ensure("(3)", !parseCpuList(",1", cpus));
+		ensure("(4)", !parseCpuList("3-1", cpus));
+		ensure("(5)", !parseCpuList("1-", cpus));
+		ensure("(6)", !parseCpuList("a", cpus));
+		ensure("(7)", !parseCpuList("1;2", cpus));
+		ensure("(8)", !parseCpuList("1234567", cpus));
+	}
+
+	/***** formatCpuList() *****/
+
+	TEST_METHOD(10) {
+		set_test_name("It collapses consecutive CPUs into ranges");
+		ensure(parseCpuList("0-3,8,10-11", cpus));
+		ensure_equals(formatCpuList(cpus), "0-3,8,10-11");
+		cpus.clear();
+		ensure_equals(formatCpuList(cpus), "");
+	}
+}
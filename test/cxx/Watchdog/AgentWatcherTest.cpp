@@ -0,0 +1,218 @@
+#include <TestSupport.h>
+#include <Watchdog/AgentWatcher.h>
+#include <FileDescriptor.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+
+using namespace Passenger;
+using namespace Passenger::Watchdog;
+using namespace std;
+
+namespace tut {
+	/**
+	 * Watches a shell script that reports a successful startup through
+	 * the feedback fd and then runs the script passed to setScript().
+	 */
+	class TestAgentWatcher: public AgentWatcher {
+	protected:
+		virtual string getExeFilename() const {
+			return "/bin/sh";
+		}
+
+		virtual void execProgram() const {
+			execl("/bin/sh", "sh", "-c", command.c_str(), (char *) 0);
+		}
+
+		virtual void sendStartupArguments(pid_t pid, FileDescriptor &fd) {
+			// Nothing to send.
+		}
+
+		virtual bool processStartupInfo(pid_t pid, FileDescriptor &fd,
+			const vector<string> &args)
+		{
+			return args[0] == "ok";
+		}
+
+		virtual void prepareForReplacement(pid_t oldPid) {
+			// Records whether the new process was already started.
+			replacementEvents.push_back("prepare " + toString(oldPid)
+				+ " " + toString(pid));
+		}
+
+		virtual void replacementAborted(pid_t oldPid) {
+			replacementEvents.push_back("abort " + toString(oldPid));
+		}
+
+	public:
+		string command;
+		vector<string> replacementEvents;
+
+		TestAgentWatcher(EventFd *errorEvent)
+			: AgentWatcher(errorEvent)
+		{
+			setScript("exec sleep 1000");
+		}
+
+		void setScript(const string &script) {
+			// Writes the array message ["ok"].
+			command = "printf '\\000\\003ok\\000' >&3; " + script;
+		}
+
+		virtual void reportAgentStartupResult(Json::Value &report) {
+			// Nothing to report.
+		}
+
+		virtual const char *name() const {
+			return "test agent";
+		}
+
+		pid_t getPid() {
+			boost::lock_guard<boost::mutex> l(lock);
+			return pid;
+		}
+
+		pid_t getReplacedPid() {
+			boost::lock_guard<boost::mutex> l(lock);
+			return replacedPid;
+		}
+
+		bool replacedFeedbackFdOpen() {
+			boost::lock_guard<boost::mutex> l(lock);
+			return replacedFeedbackFd != -1;
+		}
+	};
+
+	typedef boost::shared_ptr<TestAgentWatcher> TestAgentWatcherPtr;
+
+	struct Watchdog_AgentWatcherTest {
+		EventFd errorEvent;
+		TestAgentWatcherPtr watcher;
+		vector<AgentWatcherPtr> watchers;
+
+		Watchdog_AgentWatcherTest()
+			: errorEvent(__FILE__, __LINE__, "Watchdog_AgentWatcherTest: errorEvent")
+		{
+			watcher = boost::make_shared<TestAgentWatcher>(&errorEvent);
+			watchers.push_back(watcher);
+		}
+
+		~Watchdog_AgentWatcherTest() {
+			AgentWatcher::stopWatching(watchers);
+			watcher->forceShutdown();
+		}
+
+		void startWatching() {
+			watcher->start();
+			watcher->beginWatching();
+		}
+
+		static bool processIsAlive(pid_t pid) {
+			return kill(pid, 0) == 0;
+		}
+	};
+
+	DEFINE_TEST_GROUP(Watchdog_AgentWatcherTest);
+
+	TEST_METHOD(1) {
+		set_test_name("The agent process is restarted when it crashes");
+		startWatching();
+		pid_t pid = watcher->getPid();
+		ensure("(1)", pid > 0);
+
+		kill(pid, SIGKILL);
+		EVENTUALLY(5,
+			pid_t newPid = watcher->getPid();
+			result = newPid != 0 && newPid != pid;
+		);
+		ensure("(2)", processIsAlive(watcher->getPid()));
+	}
+
+	TEST_METHOD(2) {
+		set_test_name("restartGracefully() starts a new process, tells the old one to "
+			"shut down, and keeps the old one's feedback fd open until it has exited");
+		// The old process ignores SIGTERM, as if it is still draining its clients.
+		watcher->setScript("trap '' TERM; exec sleep 1000");
+		startWatching();
+		pid_t oldPid = watcher->getPid();
+		watcher->setScript("exec sleep 1000");
+
+		ensure("(1)", watcher->restartGracefully());
+		pid_t newPid = watcher->getPid();
+		ensure("(2)", newPid != oldPid);
+		ensure("(3)", processIsAlive(newPid));
+		ensure_equals("(4)", watcher->getReplacedPid(), oldPid);
+		ensure("(5)", watcher->replacedFeedbackFdOpen());
+		ensure("(6)", !watcher->restartGracefully());
+		ensure_equals("(7)", watcher->replacementEvents.size(), 1u);
+		ensure_equals("(8)", watcher->replacementEvents[0],
+			"prepare " + toString(oldPid) + " " + toString(oldPid));
+
+		SHOULD_NEVER_HAPPEN(200,
+			result = watcher->getReplacedPid() == 0;
+		);
+		kill(oldPid, SIGKILL);
+		EVENTUALLY(5,
+			result = watcher->getReplacedPid() == 0;
+		);
+		ensure("(9)", !watcher->replacedFeedbackFdOpen());
+		ensure_equals("(10)", watcher->getPid(), newPid);
+
+		// Another graceful restart is possible now.
+		ensure("(11)", watcher->restartGracefully());
+		ensure("(12)", watcher->getPid() != newPid);
+		EVENTUALLY(5,
+			result = watcher->getReplacedPid() == 0;
+		);
+	}
+
+	TEST_METHOD(3) {
+		set_test_name("If the new process crashes while the old one is still "
+			"shutting down, then the new process is restarted");
+		watcher->setScript("trap '' TERM; exec sleep 1000");
+		startWatching();
+		pid_t oldPid = watcher->getPid();
+		watcher->setScript("exec sleep 1000");
+		ensure("(1)", watcher->restartGracefully());
+		pid_t newPid = watcher->getPid();
+
+		kill(newPid, SIGKILL);
+		EVENTUALLY(5,
+			pid_t pid = watcher->getPid();
+			result = pid != 0 && pid != newPid;
+		);
+		ensure("(2)", processIsAlive(watcher->getPid()));
+		ensure_equals("(3)", watcher->getReplacedPid(), oldPid);
+		ensure("(4)", watcher->replacedFeedbackFdOpen());
+
+		kill(oldPid, SIGKILL);
+		EVENTUALLY(5,
+			result = watcher->getReplacedPid() == 0;
+		);
+	}
+
+	TEST_METHOD(4) {
+		set_test_name("If the new process fails to start, then restartGracefully() "
+			"throws and the old process keeps running");
+		startWatching();
+		pid_t oldPid = watcher->getPid();
+		// Exits without reporting a successful startup.
+		watcher->command = "exit 1";
+
+		try {
+			watcher->restartGracefully();
+			fail("Exception expected");
+		} catch (const std::exception &) {
+			// Pass.
+		}
+		ensure_equals("(1)", watcher->getPid(), oldPid);
+		ensure_equals("(2)", watcher->getReplacedPid(), (pid_t) 0);
+		ensure("(3)", processIsAlive(oldPid));
+		ensure_equals("(4)", watcher->replacementEvents.size(), 2u);
+		ensure_equals("(5)", watcher->replacementEvents[1], "abort " + toString(oldPid));
+
+		watcher->setScript("exec sleep 1000");
+		ensure("(6)", watcher->restartGracefully());
+	}
+}
@@ -0,0 +1,351 @@
+#include <TestSupport.h>
+#include <Watchdog/ProcessFdKeeper.h>
+#include <Core/ApplicationPool/ProcessFdKeeperClient.h>
+#include <FileDescriptor.h>
+#include <Utils/IOUtils.h>
+#include <unistd.h>
+#include <cerrno>
+
+using namespace Passenger;
+using namespace Passenger::Watchdog;
+using namespace Passenger::ApplicationPool2;
+using namespace std;
+
+namespace tut {
+	struct Watchdog_ProcessFdKeeperTest {
+		ProcessFdKeeperPtr keeper;
+		ProcessFdKeeperClientPtr client;
+		FileDescriptor stdinReader, stdinWriter;
+		FileDescriptor outputReader, outputWriter;
+
+		Watchdog_ProcessFdKeeperTest() {
+			keeper = boost::make_shared<ProcessFdKeeper>("unix:tmp.keeper", "secret");
+			client = createClient();
+
+			// Simulates the pipes of an application process.
+			Pipe p = createPipe(__FILE__, __LINE__);
+			stdinReader = p.first;
+			stdinWriter = p.second;
+			p = createPipe(__FILE__, __LINE__);
+			outputReader = p.first;
+			outputWriter = p.second;
+		}
+
+		~Watchdog_ProcessFdKeeperTest() {
+			client.reset();
+			keeper.reset();
+			unlink("tmp.keeper");
+		}
+
+		ProcessFdKeeperClientPtr createClient() {
+			ProcessFdKeeperClientPtr result = boost::make_shared<ProcessFdKeeperClient>(
+				"unix:tmp.keeper", "secret");
+			result->connect();
+			return result;
+		}
+
+		/** Waits until the keeper has processed everything that `client` sent. */
+		void sync() {
+			client->flush();
+			client->fetch();
+		}
+
+		void keep(const StaticString &gupid = "gupid-1") {
+			client->keep(gupid, 1234, stdinWriter, outputReader);
+		}
+
+		/**
+		 * Checks whether anybody other than us still holds the writing
+		 * end of the stdin pipe, i.e. whether the process would stay alive
+		 * if we closed our end.
+		 */
+		bool stdinKeptOpenByOthers() {
+			char buf[1];
+			ssize_t ret;
+
+			stdinWriter.close();
+			setNonBlocking(stdinReader);
+			ret = ::read(stdinReader, buf, 1);
+			return ret == -1 && errno == EAGAIN;
+		}
+	};
+
+	DEFINE_TEST_GROUP(Watchdog_ProcessFdKeeperTest);
+
+	TEST_METHOD(1) {
+		set_test_name("Kept pipes can be fetched back by a new client, "
+			"as by a restarted Core");
+		keep();
+		sync();
+
+		ProcessFdKeeperClientPtr client2 = createClient();
+		vector<ProcessFdKeeperClient::Entry> entries = client2->fetch();
+		ensure_equals("(1)", entries.size(), 1u);
+		ensure_equals("(2)", entries[0].gupid, "gupid-1");
+		ensure_equals("(3)", entries[0].pid, (pid_t) 1234);
+
+		writeExact(entries[0].input, "x", 1);
+		char buf;
+		ensure_equals("(4)", readExact(stdinReader, &buf, 1), 1u);
+		ensure_equals("(5)", buf, 'x');
+		writeExact(outputWriter, "y", 1);
+		ensure_equals("(6)", readExact(entries[0].output, &buf, 1), 1u);
+		ensure_equals("(7)", buf, 'y');
+		ensure("(8)", client2->isConnected());
+	}
+
+	TEST_METHOD(2) {
+		set_test_name("The keeper holds the stdin pipe open until it is released");
+		keep();
+		sync();
+		ensure("(1)", stdinKeptOpenByOthers());
+
+		client->release("gupid-1");
+		sync();
+		EVENTUALLY(5,
+			char buf[1];
+			result = ::read(stdinReader, buf, 1) == 0;
+		);
+		ensure_equals("(2)", createClient()->fetch().size(), 0u);
+	}
+
+	TEST_METHOD(3) {
+		set_test_name("keep() and release() are sent in order, and keep() works "
+			"even if the caller closes its pipes right away");
+		keep("gupid-1");
+		keep("gupid-2");
+		client->release("gupid-1");
+		stdinWriter.close();
+		outputReader.close();
+		sync();
+		ensure("(1)", client->isConnected());
+
+		vector<ProcessFdKeeperClient::Entry> entries = createClient()->fetch();
+		ensure_equals("(2)", entries.size(), 1u);
+		ensure_equals("(3)", entries[0].gupid, "gupid-2");
+	}
+
+	TEST_METHOD(4) {
+		set_test_name("During a graceful restart, fetching doesn't return the "
+			"application processes of the replaced Core, but does return its "
+			"server sockets and the application processes of the new Core");
+		FileDescriptor serverFd(createUnixServer("tmp.server"), __FILE__, __LINE__);
+		keep();
+		client->keepServerSocket("unix:tmp.server", serverFd);
+		sync();
+
+		keeper->beginGracefulRestart();
+		ProcessFdKeeperClientPtr client2 = createClient();
+		ensure_equals("(1)", client2->fetch().size(), 0u);
+		ensure_equals("(2)", client2->fetchServerSockets().size(), 1u);
+
+		Pipe p1 = createPipe(__FILE__, __LINE__);
+		Pipe p2 = createPipe(__FILE__, __LINE__);
+		client2->keep("gupid-2", 1235, p1.second, p2.first);
+		client2->flush();
+		client2->fetch();
+		vector<ProcessFdKeeperClient::Entry> entries = createClient()->fetch();
+		ensure_equals("(3)", entries.size(), 1u);
+		ensure_equals("(4)", entries[0].gupid, "gupid-2");
+		ensure("(5)", stdinKeptOpenByOthers());
+		unlink("tmp.server");
+	}
+
+	TEST_METHOD(5) {
+		set_test_name("Server sockets can be kept, fetched and released");
+		FileDescriptor serverFd(createUnixServer("tmp.server"), __FILE__, __LINE__);
+		client->keepServerSocket("unix:tmp.server", serverFd);
+
+		map<string, FileDescriptor> sockets = createClient()->fetchServerSockets();
+		ensure_equals("(1)", sockets.size(), 1u);
+		ensure("(2)", sockets.find("unix:tmp.server") != sockets.end());
+		FileDescriptor conn(connectToUnixServer("tmp.server", __FILE__, __LINE__),
+			NULL, 0);
+		FileDescriptor accepted(::accept(sockets["unix:tmp.server"], NULL, NULL),
+			__FILE__, __LINE__);
+		ensure("(3)", accepted != -1);
+
+		client->releaseServerSocket("unix:tmp.server");
+		ensure_equals("(4)", createClient()->fetchServerSockets().size(), 0u);
+		unlink("tmp.server");
+	}
+
+	TEST_METHOD(6) {
+		set_test_name("After releaseAll(), nothing is kept anymore");
+		keep();
+		sync();
+		keeper->releaseAll();
+		keep("gupid-2");
+		sync();
+		ensure_equals("(1)", createClient()->fetch().size(), 0u);
+		EVENTUALLY(5,
+			result = !stdinKeptOpenByOthers();
+		);
+	}
+
+	TEST_METHOD(7) {
+		set_test_name("Clients must authenticate with the right password");
+		ProcessFdKeeperClient client2("unix:tmp.keeper", "wrong");
+		try {
+			client2.connect();
+			fail("IOException expected");
+		} catch (const IOException &) {
+			// Pass.
+		}
+		ensure("(1)", !client2.isConnected());
+
+		// keep() and release() are no-ops on a client that isn't connected.
+		client2.keep("gupid-1", 1234, stdinWriter, outputReader);
+		client2.release("gupid-1");
+		client2.flush();
+		sync();
+		ensure_equals("(2)", createClient()->fetch().size(), 0u);
+	}
+
+	TEST_METHOD(8) {
+		set_test_name("Once a Core that was replaced by a graceful restart disconnects, "
+			"the application processes that it didn't release are released");
+		keep();
+		sync();
+		keeper->beginGracefulRestart();
+		ensure("(1)", stdinKeptOpenByOthers());
+
+		client.reset();
+		EVENTUALLY(5,
+			char buf[1];
+			result = ::read(stdinReader, buf, 1) == 0;
+		);
+	}
+
+	TEST_METHOD(9) {
+		set_test_name("If a Core that isn't being replaced disconnects, as when it "
+			"crashed, then its application processes are kept");
+		keep();
+		sync();
+		client.reset();
+		client = createClient();
+		ensure_equals("(1)", client->fetch().size(), 1u);
+		ensure("(2)", stdinKeptOpenByOthers());
+	}
+
+	TEST_METHOD(10) {
+		set_test_name("abortGracefulRestart() undoes beginGracefulRestart()");
+		keep();
+		sync();
+		keeper->beginGracefulRestart();
+		keeper->abortGracefulRestart();
+		ensure_equals("(1)", createClient()->fetch().size(), 1u);
+
+		client.reset();
+		client = createClient();
+		ensure_equals("(2)", client->fetch().size(), 1u);
+		ensure("(3)", stdinKeptOpenByOthers());
+	}
+
+	TEST_METHOD(11) {
+		set_test_name("Server addresses that the Core changed at runtime "
+			"are remembered for the next Core");
+		Json::Value controllerAddresses, apiServerAddresses;
+		ensure("(1)", !keeper->getServerAddresses(controllerAddresses, apiServerAddresses));
+		ensure("(2)", controllerAddresses.isNull());
+
+		Json::Value newControllerAddresses(Json::arrayValue);
+		Json::Value newApiServerAddresses(Json::arrayValue);
+		newControllerAddresses.append("tcp://127.0.0.1:3000");
+		newControllerAddresses.append("tcp://127.0.0.1:3001");
+		newApiServerAddresses.append("tcp://127.0.0.1:3002");
+		client->setServerAddresses(newControllerAddresses, newApiServerAddresses);
+		sync();
+
+		ensure("(3)", keeper->getServerAddresses(controllerAddresses, apiServerAddresses));
+		ensure("(4)", controllerAddresses == newControllerAddresses);
+		ensure("(5)", apiServerAddresses == newApiServerAddresses);
+
+		// They outlive the Core that sent them.
+		client.reset();
+		controllerAddresses = Json::Value();
+		ensure("(6)", keeper->getServerAddresses(controllerAddresses, apiServerAddresses));
+		ensure("(7)", controllerAddresses == newControllerAddresses);
+	}
+
+	TEST_METHOD(12) {
+		set_test_name("waitForReplacementPrepared() waits until the replaced Core "
+			"has sent preparedForReplacement(), or has disconnected");
+		ProcessFdKeeperClientPtr client2 = createClient();
+		ensure("(1)", keeper->waitForReplacementPrepared(0));
+
+		keeper->beginGracefulRestart();
+		ensure("(2)", !keeper->waitForReplacementPrepared(10));
+		client->preparedForReplacement();
+		ensure("(3)", !keeper->waitForReplacementPrepared(10));
+		client2->preparedForReplacement();
+		ensure("(4)", keeper->waitForReplacementPrepared(5000));
+
+		keeper->abortGracefulRestart();
+		keeper->beginGracefulRestart();
+		ensure("(5)", !keeper->waitForReplacementPrepared(10));
+		client.reset();
+		client2.reset();
+		ensure("(6)", keeper->waitForReplacementPrepared(5000));
+
+		// Clients that connect later, like the new Core, are not waited for.
+		client = createClient();
+		ensure("(7)", keeper->waitForReplacementPrepared(0));
+	}
+
+	TEST_METHOD(13) {
+		set_test_name("preparedForReplacement() hands the application processes "
+			"that the replaced Core kept until then over to the new Core");
+		keep("gupid-1");
+		sync();
+		keeper->beginGracefulRestart();
+		client->preparedForReplacement();
+		ensure("(1)", keeper->waitForReplacementPrepared(5000));
+		// Processes that the replaced Core spawns while draining remain its own.
+		keep("gupid-2");
+		sync();
+
+		ProcessFdKeeperClientPtr client2 = createClient();
+		vector<ProcessFdKeeperClient::Entry> entries = client2->fetch();
+		ensure_equals("(2)", entries.size(), 1u);
+		ensure_equals("(3)", entries[0].gupid, "gupid-1");
+
+		// The new Core adopts the process. The replaced Core releasing
+		// it afterwards, or exiting, doesn't affect the new Core.
+		client2->keep(entries[0].gupid, entries[0].pid, entries[0].input,
+			entries[0].output);
+		client2->flush();
+		client2->fetch();
+		entries.clear();
+		client->release("gupid-1");
+		sync();
+		client.reset();
+		EVENTUALLY(5,
+			result = createClient()->fetch().size() == 1;
+		);
+		ensure("(4)", stdinKeptOpenByOthers());
+	}
+
+	TEST_METHOD(14) {
+		set_test_name("abortGracefulRestart() takes back the handed over application "
+			"processes, except for those that the replaced Core released meanwhile");
+		keep("gupid-1");
+		keep("gupid-2");
+		sync();
+		keeper->beginGracefulRestart();
+		client->preparedForReplacement();
+		ensure("(1)", keeper->waitForReplacementPrepared(5000));
+		client->release("gupid-2");
+		sync();
+		ensure_equals("(2)", createClient()->fetch().size(), 2u);
+
+		keeper->abortGracefulRestart();
+		vector<ProcessFdKeeperClient::Entry> entries = createClient()->fetch();
+		ensure_equals("(3)", entries.size(), 1u);
+		ensure_equals("(4)", entries[0].gupid, "gupid-1");
+
+		// A later graceful restart hides them again until they're handed over.
+		keeper->beginGracefulRestart();
+		ensure_equals("(5)", createClient()->fetch().size(), 0u);
+	}
+}
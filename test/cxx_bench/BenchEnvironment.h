@@ -0,0 +1,51 @@
+#ifndef _PASSENGER_BENCH_ENVIRONMENT_H_
+#define _PASSENGER_BENCH_ENVIRONMENT_H_
+
+#include <ctime>
+#include <unistd.h>
+#include <sys/utsname.h>
+
+#include <Constants.h>
+#include <jsoncpp/json.h>
+
+namespace Passenger {
+namespace Bench {
+
+
+/**
+ * Describes the machine and build that the benchmarks ran on, so that
+ * results from different runs can be compared sensibly.
+ */
+inline Json::Value
+createEnvironmentDoc() {
+	Json::Value doc;
+	struct utsname uts;
+
+	doc["passenger_version"] = PASSENGER_VERSION;
+	if (uname(&uts) == 0) {
+		doc["os"] = uts.sysname;
+		doc["os_release"] = uts.release;
+		doc["arch"] = uts.machine;
+	}
+	#if defined(__clang__)
+		doc["compiler"] = "clang " __clang_version__;
+	#elif defined(__GNUC__)
+		doc["compiler"] = "gcc " __VERSION__;
+	#endif
+	// Whether the code under test was optimized. The benchmarks themselves
+	// are always compiled with -O2, so __OPTIMIZE__ can't tell us that.
+	#ifdef PASSENGER_BENCH_LIBRARY_OPTIMIZED
+		doc["optimized"] = true;
+	#else
+		doc["optimized"] = false;
+	#endif
+	doc["cpus"] = (Json::Int) sysconf(_SC_NPROCESSORS_ONLN);
+	doc["timestamp"] = (Json::Int64) time(NULL);
+	return doc;
+}
+
+
+} // namespace Bench
+} // namespace Passenger
+
+#endif /* _PASSENGER_BENCH_ENVIRONMENT_H_ */
@@ -0,0 +1,237 @@
+#include <BenchSupport.h>
+#include <BenchEnvironment.h>
+#include <oxt/initialize.hpp>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <LoggingKit/LoggingKit.h>
+#include <LoggingKit/Context.h>
+#include <Utils/StrIntUtils.h>
+#include <jsoncpp/json.h>
+
+using namespace std;
+using namespace Passenger;
+using namespace Passenger::Bench;
+
+
+/** Benchmarks whose "group.name" contains one of these are run. Empty means all. */
+static vector<string> filters;
+/** Each repetition runs for at least this long. */
+static double minTime = 0.2;
+static unsigned int repetitions = 5;
+static const char *outputFile = NULL;
+static bool listOnly = false;
+
+
+vector<Benchmark> &
+Passenger::Bench::getBenchmarks() {
+	static vector<Benchmark> benchmarks;
+	return benchmarks;
+}
+
+boost::uint64_t
+Passenger::Bench::State::getTimeNsec() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (boost::uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static void
+usage(int exitCode) {
+	printf("Usage: ./main [options]\n");
+	printf("Runs the C++ microbenchmarks and prints the results as JSON.\n\n");
+	printf("Options:\n");
+	printf("  -f SUBSTRING    Only run benchmarks whose name (GROUP.NAME) contains\n");
+	printf("                  SUBSTRING. May be specified multiple times.\n");
+	printf("  -t SECONDS      Minimum duration of each repetition. Default: %.1f\n", minTime);
+	printf("  -r NUMBER       Number of repetitions. Default: %u\n", repetitions);
+	printf("  -o FILENAME     Write the JSON results to FILENAME instead of stdout.\n");
+	printf("  -l              List the available benchmarks and exit.\n");
+	printf("  -h              Print this usage information.\n");
+	exit(exitCode);
+}
+
+static const char *
+requireArgument(int argc, char *argv[], int i) {
+	if (i + 1 >= argc) {
+		fprintf(stderr, "*** ERROR: option %s requires an argument.\n", argv[i]);
+		exit(1);
+	}
+	return argv[i + 1];
+}
+
+static void
+parseOptions(int argc, char *argv[]) {
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-h") == 0) {
+			usage(0);
+		} else if (strcmp(argv[i], "-f") == 0) {
+			filters.push_back(requireArgument(argc, argv, i));
+			i++;
+		} else if (strcmp(argv[i], "-t") == 0) {
+			minTime = atof(requireArgument(argc, argv, i));
+			i++;
+		} else if (strcmp(argv[i], "-r") == 0) {
+			repetitions = std::max(1, atoi(requireArgument(argc, argv, i)));
+			i++;
+		} else if (strcmp(argv[i], "-o") == 0) {
+			outputFile = requireArgument(argc, argv, i);
+			i++;
+		} else if (strcmp(argv[i], "-l") == 0) {
+			listOnly = true;
+		} else {
+			fprintf(stderr, "*** ERROR: Unknown option: %s\n", argv[i]);
+			fprintf(stderr, "Please pass -h for a list of valid options.\n");
+			exit(1);
+		}
+	}
+}
+
+static string
+getFullName(const Benchmark &benchmark) {
+	return benchmark.group + "." + benchmark.name;
+}
+
+static bool
+shouldRun(const Benchmark &benchmark) {
+	if (filters.empty()) {
+		return true;
+	}
+	string name = getFullName(benchmark);
+	for (unsigned int i = 0; i < filters.size(); i++) {
+		if (name.find(filters[i]) != string::npos) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static boost::uint64_t
+runOnce(const Benchmark &benchmark, boost::uint64_t iterations, boost::uint64_t &bytesPerIteration) {
+	State state(iterations);
+	boost::uint64_t startTime = State::getTimeNsec();
+	benchmark.function(state);
+	boost::uint64_t endTime = State::getTimeNsec();
+	state.stopTimer();
+	bytesPerIteration = state.bytesPerIteration;
+	if (state.timerWasUsed()) {
+		return state.getElapsedNsec();
+	} else {
+		return endTime - startTime;
+	}
+}
+
+/**
+ * Finds the number of iterations that takes at least `minTime` seconds.
+ */
+static boost::uint64_t
+calibrate(const Benchmark &benchmark) {
+	boost::uint64_t minTimeNsec = (boost::uint64_t) (minTime * 1000000000);
+	boost::uint64_t iterations = 1;
+	boost::uint64_t bytesPerIteration;
+
+	while (true) {
+		boost::uint64_t elapsed = runOnce(benchmark, iterations, bytesPerIteration);
+		if (elapsed >= minTimeNsec || iterations >= 1000000000) {
+			return iterations;
+		} else if (elapsed < minTimeNsec / 100) {
+			iterations *= 10;
+		} else {
+			// Aim a little higher so that we don't end up just below minTime.
+			return std::max<boost::uint64_t>(iterations + 1,
+				(boost::uint64_t) (iterations * 1.2 * minTimeNsec / std::max<boost::uint64_t>(elapsed, 1)));
+		}
+	}
+}
+
+static Json::Value
+runBenchmark(const Benchmark &benchmark) {
+	boost::uint64_t iterations = calibrate(benchmark);
+	boost::uint64_t bytesPerIteration = 0;
+	vector<double> nsPerOp;
+	Json::Value samples(Json::arrayValue);
+
+	for (unsigned int i = 0; i < repetitions; i++) {
+		boost::uint64_t elapsed = runOnce(benchmark, iterations, bytesPerIteration);
+		double value = (double) elapsed / iterations;
+		nsPerOp.push_back(value);
+		samples.append(value);
+	}
+
+	std::sort(nsPerOp.begin(), nsPerOp.end());
+	double sum = 0;
+	for (unsigned int i = 0; i < nsPerOp.size(); i++) {
+		sum += nsPerOp[i];
+	}
+	double median = nsPerOp[nsPerOp.size() / 2];
+
+	Json::Value doc;
+	doc["group"] = benchmark.group;
+	doc["name"] = benchmark.name;
+	doc["iterations"] = (Json::UInt64) iterations;
+	doc["repetitions"] = repetitions;
+	doc["ns_per_op"]["min"] = nsPerOp.front();
+	doc["ns_per_op"]["median"] = median;
+	doc["ns_per_op"]["mean"] = sum / nsPerOp.size();
+	doc["ns_per_op"]["max"] = nsPerOp.back();
+	doc["ns_per_op"]["samples"] = samples;
+	doc["ops_per_sec"] = 1000000000.0 / median;
+	if (bytesPerIteration > 0) {
+		doc["bytes_per_op"] = (Json::UInt64) bytesPerIteration;
+		doc["bytes_per_sec"] = bytesPerIteration * 1000000000.0 / median;
+	}
+
+	fprintf(stderr, "%-50s %12.1f ns/op %14.0f ops/s\n",
+		getFullName(benchmark).c_str(), median, 1000000000.0 / median);
+	return doc;
+}
+
+int
+main(int argc, char *argv[]) {
+	oxt::initialize();
+	LoggingKit::initialize();
+	parseOptions(argc, argv);
+
+	const vector<Benchmark> &benchmarks = getBenchmarks();
+	if (listOnly) {
+		for (unsigned int i = 0; i < benchmarks.size(); i++) {
+			printf("%s\n", getFullName(benchmarks[i]).c_str());
+		}
+		return 0;
+	}
+
+	Json::Value doc;
+	doc["environment"] = createEnvironmentDoc();
+	doc["environment"]["min_time"] = minTime;
+	doc["benchmarks"] = Json::Value(Json::arrayValue);
+	for (unsigned int i = 0; i < benchmarks.size(); i++) {
+		if (shouldRun(benchmarks[i])) {
+			doc["benchmarks"].append(runBenchmark(benchmarks[i]));
+		}
+	}
+
+	string output = doc.toStyledString();
+	if (outputFile == NULL) {
+		fwrite(output.data(), 1, output.size(), stdout);
+	} else {
+		FILE *f = fopen(outputFile, "w");
+		if (f == NULL) {
+			int e = errno;
+			fprintf(stderr, "*** ERROR: cannot open %s for writing: %s\n",
+				outputFile, strerror(e));
+			return 1;
+		}
+		fwrite(output.data(), 1, output.size(), f);
+		fclose(f);
+	}
+
+	oxt::shutdown();
+	return 0;
+}
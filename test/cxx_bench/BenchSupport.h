@@ -0,0 +1,120 @@
+#ifndef _PASSENGER_BENCH_SUPPORT_H_
+#define _PASSENGER_BENCH_SUPPORT_H_
+
+#include <boost/cstdint.hpp>
+#include <string>
+#include <vector>
+
+/**
+ * A minimal microbenchmark framework. Benchmarks are defined with the
+ * BENCHMARK macro:
+ *
+ *   BENCHMARK(MemoryKit_Palloc, allocate_small) {
+ *       psg_pool_t *pool = psg_create_pool(PSG_DEFAULT_POOL_SIZE);
+ *       state.startTimer();
+ *       for (boost::uint64_t i = 0; i < state.iterations; i++) {
+ *           Bench::doNotOptimize(psg_palloc(pool, 32));
+ *       }
+ *       state.stopTimer();
+ *       psg_destroy_pool(pool);
+ *   }
+ *
+ * The runner (BenchMain.cpp) calls each benchmark with an increasing
+ * number of iterations until the measurement is long enough, and then
+ * repeats it a number of times. Only the time between startTimer() and
+ * stopTimer() is measured; if they're not called, the entire function
+ * call is measured.
+ */
+
+namespace Passenger {
+namespace Bench {
+
+using namespace std;
+
+
+class State {
+private:
+	boost::uint64_t startTime;
+	boost::uint64_t elapsed;
+	bool timerStarted;
+	bool timerUsed;
+
+public:
+	/** The number of operations the benchmark must perform. */
+	boost::uint64_t iterations;
+	/** If set, the runner also reports throughput in bytes per second. */
+	boost::uint64_t bytesPerIteration;
+
+	State(boost::uint64_t _iterations)
+		: startTime(0),
+		  elapsed(0),
+		  timerStarted(false),
+		  timerUsed(false),
+		  iterations(_iterations),
+		  bytesPerIteration(0)
+		{ }
+
+	static boost::uint64_t getTimeNsec();
+
+	void startTimer() {
+		timerUsed = true;
+		timerStarted = true;
+		startTime = getTimeNsec();
+	}
+
+	void stopTimer() {
+		if (timerStarted) {
+			elapsed += getTimeNsec() - startTime;
+			timerStarted = false;
+		}
+	}
+
+	bool timerWasUsed() const {
+		return timerUsed;
+	}
+
+	boost::uint64_t getElapsedNsec() const {
+		return elapsed;
+	}
+};
+
+typedef void (*Function)(State &state);
+
+struct Benchmark {
+	string group;
+	string name;
+	Function function;
+};
+
+vector<Benchmark> &getBenchmarks();
+
+struct Registration {
+	Registration(const char *group, const char *name, Function function) {
+		Benchmark benchmark;
+		benchmark.group = group;
+		benchmark.name = name;
+		benchmark.function = function;
+		getBenchmarks().push_back(benchmark);
+	}
+};
+
+/**
+ * Prevents the compiler from optimizing away the computation of `value`.
+ */
+template<typename T>
+inline void
+doNotOptimize(const T &value) {
+	__asm__ __volatile__("" : : "g"(&value) : "memory");
+}
+
+
+} // namespace Bench
+} // namespace Passenger
+
+#define BENCHMARK(group, name) \
+	static void bench_ ## group ## _ ## name(Passenger::Bench::State &state); \
+	static Passenger::Bench::Registration bench_ ## group ## _ ## name ## _registration( \
+		#group, #name, bench_ ## group ## _ ## name); \
+	static void bench_ ## group ## _ ## name(Passenger::Bench::State &state)
+
+#endif /* _PASSENGER_BENCH_SUPPORT_H_ */
@@ -0,0 +1,249 @@
+#include <BenchSupport.h>
+#include <time.h>
+#include <ServerKit/HttpRequest.h>
+#include <MemoryKit/palloc.h>
+#include <Core/Controller/Request.h>
+#include <Core/Controller/AppResponse.h>
+#include <Core/ResponseCache.h>
+
+using namespace std;
+using namespace Passenger;
+using namespace Passenger::Core;
+using namespace Passenger::ServerKit;
+using namespace Passenger::Bench;
+
+namespace {
+	typedef ResponseCache<Request> ResponseCacheType;
+
+	const char RESPONSE_HEADERS[] =
+		"content-length: 5\r\n"
+		"cache-control: public,max-age=99999\r\n";
+
+	/**
+	 * Sets up a Request the same way test/cxx/Core/ResponseCacheTest.cpp does.
+	 * prepareRequest() allocates the cache key from the request pool, so the
+	 * benchmarks periodically call reset() (outside the timer) to keep
+	 * the pool from growing without bound.
+	 */
+	struct ResponseCacheFixture {
+		ResponseCacheType responseCache;
+		Request req;
+		Core::ControllerSchema schema;
+		ConfigKit::Store config;
+		unsigned int pathNumber;
+
+		ResponseCacheFixture()
+			: config(schema),
+			  pathNumber(0)
+		{
+			req.pool = psg_create_pool(PSG_DEFAULT_POOL_SIZE);
+			config["multi_app"] = false;
+			config["default_server_name"] = "localhost";
+			config["default_server_port"] = "80";
+			req.config.reset(new ControllerRequestConfig(config));
+			reset();
+		}
+
+		~ResponseCacheFixture() {
+			psg_destroy_pool(req.pool);
+		}
+
+		void reset() {
+			psg_reset_pool(req.pool, PSG_DEFAULT_POOL_SIZE);
+			req.headers.clear();
+			req.secureHeaders.clear();
+			req.httpMajor = 1;
+			req.httpMinor = 1;
+			req.httpState = Request::COMPLETE;
+			req.bodyType  = Request::RBT_NO_BODY;
+			req.method    = HTTP_GET;
+			req.wantKeepAlive = false;
+			req.detectingNextRequestEarlyReadError = false;
+			req.responseBegun = false;
+			req.client    = NULL;
+			req.hooks.impl     = NULL;
+			req.hooks.userData = NULL;
+			psg_lstr_init(&req.path);
+			psg_lstr_append(&req.path, req.pool, "/");
+			req.bodyAlreadyRead = 0;
+			req.lastDataReceiveTime = 0;
+			req.lastDataSendTime = 0;
+			req.queryStringIndex = -1;
+			req.bodyError = 0;
+			req.nextRequestEarlyReadError = 0;
+
+			req.startedAt = 0;
+			req.state     = Request::ANALYZING_REQUEST;
+			req.dechunkResponse = false;
+			req.requestBodyBuffering = false;
+			req.https     = false;
+			req.stickySession = false;
+			req.acceptsGzip = false;
+			req.sessionCheckoutTry = 0;
+			req.halfClosePolicy = Request::HALF_CLOSE_POLICY_UNINITIALIZED;
+			req.appResponseInitialized = false;
+			req.strip100ContinueHeader = false;
+			req.hasPragmaHeader = false;
+			req.host = createHostString();
+			req.bodyBytesBuffered = 0;
+			req.cacheKey = HashedStaticString();
+			req.cacheControl = NULL;
+			req.varyCookie = NULL;
+			req.envvars = NULL;
+			req.configProfile = NULL;
+
+			req.appResponse.headers.clear();
+			req.appResponse.secureHeaders.clear();
+			req.appResponse.httpMajor  = 1;
+			req.appResponse.httpMinor  = 1;
+			req.appResponse.httpState  = AppResponse::COMPLETE;
+			req.appResponse.wantKeepAlive = false;
+			req.appResponse.oneHundredContinueSent = false;
+			req.appResponse.compressible = false;
+			req.appResponse.compressed = false;
+			req.appResponse.bodyType   = AppResponse::RBT_CONTENT_LENGTH;
+			req.appResponse.aux.bodyInfo.contentLength = 5;
+			req.appResponse.statusCode = 200;
+			req.appResponse.bodyAlreadyRead = 0;
+			req.appResponse.date       = NULL;
+			req.appResponse.setCookie  = NULL;
+			req.appResponse.cacheControl  = NULL;
+			req.appResponse.expiresHeader = NULL;
+			req.appResponse.lastModifiedHeader = NULL;
+			req.appResponse.headerCacheBuffers = NULL;
+			req.appResponse.nHeaderCacheBuffers = 0;
+			psg_lstr_init(&req.appResponse.bodyCacheBuffer);
+			req.appResponse.deflateStream = NULL;
+
+			insertAppResponseHeader(createHeader("date", createTodayString()));
+			insertAppResponseHeader(createHeader("cache-control",
+				"public,max-age=99999"));
+		}
+
+		void setPath(unsigned int number) {
+			char buf[32];
+			int size = snprintf(buf, sizeof(buf), "/products/%u", number);
+			psg_lstr_deinit(&req.path);
+			psg_lstr_init(&req.path);
+			psg_lstr_append(&req.path, req.pool, buf, size);
+		}
+
+		LString *createHostString() {
+			LString *str = (LString *) psg_palloc(req.pool, sizeof(LString));
+			psg_lstr_init(str);
+			psg_lstr_append(str, req.pool, "foo.com");
+			return str;
+		}
+
+		StaticString createTodayString() {
+			time_t the_time = time(NULL);
+			struct tm the_tm;
+			gmtime_r(&the_time, &the_tm);
+			char *buf = (char *) psg_pnalloc(req.pool, 64);
+			size_t size = strftime(buf, 64, "%a, %d %b %Y %H:%M:%S GMT", &the_tm);
+			return StaticString(buf, size);
+		}
+
+		Header *createHeader(const HashedStaticString &key, const StaticString &val) {
+			Header *header = (Header *) psg_palloc(req.pool, sizeof(Header));
+			psg_lstr_init(&header->key);
+			psg_lstr_init(&header->origKey);
+			psg_lstr_init(&header->val);
+			psg_lstr_append(&header->key, req.pool, key.data(), key.size());
+			psg_lstr_append(&header->origKey, req.pool, key.data(), key.size());
+			psg_lstr_append(&header->val, req.pool, val.data(), val.size());
+			header->hash = key.hash();
+			return header;
+		}
+
+		void insertAppResponseHeader(Header *header) {
+			req.appResponse.headers.insert(&header, req.pool);
+		}
+
+		void store(time_t now) {
+			req.cacheControl = NULL;
+			req.appResponse.cacheControl = NULL;
+			req.appResponse.expiresHeader = NULL;
+			req.appResponse.lastModifiedHeader = NULL;
+			if (!responseCache.prepareRequest(this, &req)
+			 || !responseCache.requestAllowsStoring(&req)
+			 || !responseCache.prepareRequestForStoring(&req))
+			{
+				fprintf(stderr, "*** ERROR: benchmark response is not cacheable\n");
+				abort();
+			}
+			doNotOptimize(responseCache.store(&req, now,
+				sizeof(RESPONSE_HEADERS) - 1, 5));
+		}
+	};
+
+	// Keeps the request pool small; see ResponseCacheFixture.
+	const unsigned int RESET_INTERVAL = 1024;
+}
+
+
+BENCHMARK(Core_ResponseCache, fetch_hit) {
+	ResponseCacheFixture fixture;
+	time_t now = time(NULL);
+	fixture.store(now);
+
+	state.startTimer();
+	for (boost::uint64_t i = 0; i < state.iterations; i++) {
+		if (i % RESET_INTERVAL == RESET_INTERVAL - 1) {
+			state.stopTimer();
+			fixture.reset();
+			state.startTimer();
+		}
+		fixture.req.cacheControl = NULL;
+		fixture.responseCache.prepareRequest(&fixture, &fixture.req);
+		if (fixture.responseCache.requestAllowsFetching(&fixture.req)) {
+			ResponseCacheType::Entry entry(fixture.responseCache.fetch(&fixture.req, now));
+			doNotOptimize(entry);
+		}
+	}
+	state.stopTimer();
+}
+
+BENCHMARK(Core_ResponseCache, fetch_miss) {
+	ResponseCacheFixture fixture;
+	time_t now = time(NULL);
+	fixture.setPath(1);
+	fixture.store(now);
+	fixture.setPath(2);
+
+	state.startTimer();
+	for (boost::uint64_t i = 0; i < state.iterations; i++) {
+		if (i % RESET_INTERVAL == RESET_INTERVAL - 1) {
+			state.stopTimer();
+			fixture.reset();
+			fixture.setPath(2);
+			state.startTimer();
+		}
+		fixture.req.cacheControl = NULL;
+		fixture.responseCache.prepareRequest(&fixture, &fixture.req);
+		if (fixture.responseCache.requestAllowsFetching(&fixture.req)) {
+			ResponseCacheType::Entry entry(fixture.responseCache.fetch(&fixture.req, now));
+			doNotOptimize(entry);
+		}
+	}
+	state.stopTimer();
+}
+
+BENCHMARK(Core_ResponseCache, store) {
+	ResponseCacheFixture fixture;
+	time_t now = time(NULL);
+
+	state.startTimer();
+	for (boost::uint64_t i = 0; i < state.iterations; i++) {
+		if (i % RESET_INTERVAL == RESET_INTERVAL - 1) {
+			state.stopTimer();
+			fixture.reset();
+			state.startTimer();
+		}
+		// Cycle through more paths than the cache can hold, so that
+		// stores also exercise eviction.
+		fixture.setPath(fixture.pathNumber++ % 64);
+		fixture.store(now);
+	}
+	state.stopTimer();
+}
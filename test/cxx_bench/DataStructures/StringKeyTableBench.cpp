@@ -0,0 +1,92 @@
+#include <BenchSupport.h>
+#include <string>
+#include <vector>
+#include <DataStructures/StringKeyTable.h>
+#include <DataStructures/HashedStaticString.h>
+#include <Utils/StrIntUtils.h>
+
+using namespace std;
+using namespace Passenger;
+using namespace Passenger::Bench;
+
+namespace {
+	vector<string> createKeys(unsigned int count, const string &prefix) {
+		vector<string> keys;
+		for (unsigned int i = 0; i < count; i++) {
+			keys.push_back(prefix + toString(i));
+		}
+		return keys;
+	}
+}
+
+
+/***** HashedStaticString *****/
+
+BENCHMARK(DataStructures_HashedStaticString, hash_header_name) {
+	StaticString name("content-type");
+	state.bytesPerIteration = name.size();
+	for (boost::uint64_t i = 0; i < state.iterations; i++) {
+		HashedStaticString hashed(name);
+		doNotOptimize(hashed);
+	}
+}
+
+BENCHMARK(DataStructures_HashedStaticString, hash_url_path) {
+	StaticString path("/assets/application-4f2c8b0c1e9d7a6b5e3f1d2c.js?version=1234");
+	state.bytesPerIteration = path.size();
+	for (boost::uint64_t i = 0; i < state.iterations; i++) {
+		HashedStaticString hashed(path);
+		doNotOptimize(hashed);
+	}
+}
+
+
+/***** StringKeyTable *****/
+
+BENCHMARK(DataStructures_StringKeyTable, insert_64) {
+	vector<string> strings = createKeys(64, "/var/www/app/public/file");
+	vector<HashedStaticString> keys(strings.begin(), strings.end());
+
+	state.startTimer();
+	for (boost::uint64_t i = 0; i < state.iterations; i += keys.size()) {
+		StringKeyTable<int> table;
+		for (unsigned int j = 0; j < keys.size(); j++) {
+			table.insert(keys[j], (int) j);
+		}
+		doNotOptimize(table);
+	}
+	state.stopTimer();
+}
+
+BENCHMARK(DataStructures_StringKeyTable, lookup_hit) {
+	vector<string> strings = createKeys(64, "/var/www/app/public/file");
+	vector<HashedStaticString> keys(strings.begin(), strings.end());
+	StringKeyTable<int> table;
+	for (unsigned int i = 0; i < keys.size(); i++) {
+		table.insert(keys[i], (int) i);
+	}
+
+	state.startTimer();
+	for (boost::uint64_t i = 0; i < state.iterations; i++) {
+		int *value;
+		doNotOptimize(table.lookup(keys[i % keys.size()], &value));
+	}
+	state.stopTimer();
+}
+
+BENCHMARK(DataStructures_StringKeyTable, lookup_miss) {
+	vector<string> strings = createKeys(64, "/var/www/app/public/file");
+	vector<string> otherStrings = createKeys(64, "/var/www/app/public/other");
+	vector<HashedStaticString> otherKeys(otherStrings.begin(), otherStrings.end());
+	StringKeyTable<int> table;
+	for (unsigned int i = 0; i < strings.size(); i++) {
+		table.insert(strings[i], (int) i);
+	}
+
+	state.startTimer();
+	for (boost::uint64_t i = 0; i < state.iterations; i++) {
+		int *value;
+		doNotOptimize(table.lookup(otherKeys[i % otherKeys.size()], &value));
+	}
+	state.stopTimer();
+}
@@ -0,0 +1,527 @@
+#include <oxt/initialize.hpp>
+#include <oxt/system_calls.hpp>
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread.hpp>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <BackgroundEventLoop.h>
+#include <ResourceLocator.h>
+#include <FileDescriptor.h>
+#include <LoggingKit/LoggingKit.h>
+#include <LoggingKit/Context.h>
+#include <FileTools/FileManip.h>
+#include <ServerKit/Server.h>
+#include <ServerKit/AcceptLoadBalancer.h>
+#include <Utils/IOUtils.h>
+#include <Utils/StrIntUtils.h>
+#include <Core/ApplicationPool/Pool.h>
+#include <Core/SpawningKit/Factory.h>
+#include <Core/Controller.h>
+#include <jsoncpp/json.h>
+
+#include <BenchEnvironment.h>
+#include <LoadBench/StubApp.h>
+#include <LoadBench/LoadGenerator.h>
+
+/*
+ * An end-to-end load benchmark for the Core. It boots the Core's controller
+ * threads in-process, with an application pool whose (dummy) processes all
+ * point to a stub application on a Unix domain socket. An embedded load
+ * generator then sends requests to the controllers over TCP loopback.
+ *
+ * Every scenario is run once for each selected controller benchmark mode
+ * (see ControllerBenchmarkMode), which makes it possible to tell which part
+ * of the request path a regression is in.
+ */
+
+using namespace std;
+using namespace Passenger;
+using namespace Passenger::Core;
+using namespace Passenger::ApplicationPool2;
+using namespace Passenger::LoadBench;
+
+
+struct LoadBenchOptions {
+	vector<string> modes;
+	vector<string> scenarios;
+	string protocol;
+	string passengerRoot;
+	const char *outputFile;
+	unsigned int threads;
+	unsigned int concurrency;
+	unsigned int appConcurrency;
+	unsigned int largeBodySize;
+	unsigned int responseBodySize;
+	double duration;
+	double warmup;
+
+	LoadBenchOptions()
+		: protocol("session"),
+		  outputFile(NULL),
+		  threads(boost::thread::hardware_concurrency()),
+		  concurrency(16),
+		  appConcurrency(0),
+		  largeBodySize(1024 * 1024),
+		  responseBodySize(1024),
+		  duration(3),
+		  warmup(0.5)
+	{
+		if (threads == 0) {
+			threads = 1;
+		}
+	}
+};
+
+static LoadBenchOptions options;
+
+
+/**
+ * The parts of the Core that are involved in handling requests, set up
+ * the same way as in CoreMain.cpp.
+ */
+class CoreInstance {
+private:
+	struct ThreadWorkingObjects {
+		BackgroundEventLoop *bgloop;
+		ServerKit::Context *serverKitContext;
+		Controller *controller;
+	};
+
+	ServerKit::Schema serverKitSchema;
+	ControllerSchema controllerSchema;
+	ControllerSingleAppModeSchema singleAppModeSchema;
+	SpawningKit::Context::Schema spawningKitContextSchema;
+	SpawningKit::Context::DebugSupport spawningKitDebugSupport;
+	SpawningKit::Context spawningKitContext;
+	ApplicationPool2::Context appPoolContext;
+	PoolPtr appPool;
+	ResourceLocator *resourceLocator;
+	Json::Value singleAppModeConfig;
+	vector<ThreadWorkingObjects> threadWorkingObjects;
+	ServerKit::AcceptLoadBalancer<Controller> loadBalancer;
+	FileDescriptor serverFd;
+	unsigned short port;
+
+	static void getServerState(Controller *controller, Controller::State *result) {
+		*result = controller->serverState;
+	}
+
+	static void deleteController(Controller *controller) {
+		delete controller;
+	}
+
+public:
+	CoreInstance(ResourceLocator *_resourceLocator, const string &appRoot,
+		const StubApp &app, const string &benchmarkMode)
+		: spawningKitContext(spawningKitContextSchema),
+		  resourceLocator(_resourceLocator),
+		  port(0)
+	{
+		spawningKitDebugSupport.dummySocketAddress = app.getAddress();
+		spawningKitDebugSupport.dummySocketProtocol = app.getProtocol();
+		spawningKitDebugSupport.dummyConcurrency = options.appConcurrency;
+		spawningKitContext.resourceLocator = resourceLocator;
+		spawningKitContext.integrationMode = "standalone";
+		spawningKitContext.debugSupport = &spawningKitDebugSupport;
+		spawningKitContext.finalize();
+
+		appPoolContext.spawningKitFactory = boost::make_shared<SpawningKit::Factory>(
+			&spawningKitContext);
+		appPoolContext.finalize();
+		appPool = boost::make_shared<Pool>(&appPoolContext);
+		appPool->initialize();
+
+		singleAppModeConfig["app_root"] = appRoot;
+		singleAppModeConfig["app_type"] = "rack";
+		singleAppModeConfig["startup_file"] = "config.ru";
+
+		serverFd.assign(createTcpServer("127.0.0.1", 0, 1024, __FILE__, __LINE__),
+			NULL, 0);
+		struct sockaddr_in addr;
+		socklen_t len = sizeof(addr);
+		if (getsockname(serverFd, (struct sockaddr *) &addr, &len) == -1) {
+			int e = errno;
+			throw SystemException("getsockname() failed", e);
+		}
+		port = ntohs(addr.sin_port);
+
+		for (unsigned int i = 0; i < options.threads; i++) {
+			ThreadWorkingObjects two;
+			Json::Value controllerConfig;
+
+			controllerConfig["thread_number"] = i + 1;
+			controllerConfig["multi_app"] = false;
+			controllerConfig["default_server_name"] = "localhost";
+			controllerConfig["default_server_port"] = port;
+			controllerConfig["user_switching"] = false;
+			controllerConfig["default_spawn_method"] = "dummy";
+			controllerConfig["benchmark_mode"] = benchmarkMode;
+
+			two.bgloop = new BackgroundEventLoop(true, true);
+			two.serverKitContext = new ServerKit::Context(serverKitSchema);
+			two.serverKitContext->libev = two.bgloop->safe;
+			two.serverKitContext->libuv = two.bgloop->libuv_loop;
+			two.serverKitContext->initialize();
+
+			two.controller = new Controller(two.serverKitContext,
+				controllerSchema, controllerConfig, ConfigKit::DummyTranslator(),
+				&singleAppModeSchema, &singleAppModeConfig,
+				ConfigKit::DummyTranslator());
+			two.controller->resourceLocator = resourceLocator;
+			two.controller->appPool = appPool;
+			two.controller->initialize();
+			threadWorkingObjects.push_back(two);
+		}
+
+		if (threadWorkingObjects.size() == 1) {
+			threadWorkingObjects[0].controller->listen(serverFd);
+		} else {
+			loadBalancer.listen(serverFd);
+			for (unsigned int i = 0; i < threadWorkingObjects.size(); i++) {
+				loadBalancer.servers.push_back(threadWorkingObjects[i].controller);
+			}
+		}
+		for (unsigned int i = 0; i < threadWorkingObjects.size(); i++) {
+			threadWorkingObjects[i].controller->createSpareClients();
+		}
+	}
+
+	~CoreInstance() {
+		loadBalancer.shutdown();
+		for (unsigned int i = 0; i < threadWorkingObjects.size(); i++) {
+			ThreadWorkingObjects &two = threadWorkingObjects[i];
+			two.bgloop->safe->runSync(boost::bind(&Controller::shutdown,
+				two.controller, true));
+			while (true) {
+				Controller::State state;
+				two.bgloop->safe->runSync(boost::bind(getServerState,
+					two.controller, &state));
+				if (state == Controller::FINISHED_SHUTDOWN) {
+					break;
+				}
+				usleep(10000);
+			}
+		}
+
+		appPool->destroy();
+		for (unsigned int i = 0; i < threadWorkingObjects.size(); i++) {
+			ThreadWorkingObjects &two = threadWorkingObjects[i];
+			two.bgloop->safe->runSync(boost::bind(deleteController,
+				two.controller));
+			two.bgloop->stop();
+			delete two.serverKitContext;
+			delete two.bgloop;
+		}
+		appPool.reset();
+	}
+
+	void start() {
+		for (unsigned int i = 0; i < threadWorkingObjects.size(); i++) {
+			threadWorkingObjects[i].bgloop->start("Main event loop: thread "
+				+ toString(i + 1), 0);
+		}
+		if (threadWorkingObjects.size() > 1) {
+			loadBalancer.start();
+		}
+	}
+
+	unsigned short getPort() const {
+		return port;
+	}
+};
+
+
+static vector<Scenario>
+createScenarios() {
+	vector<Scenario> result;
+	Scenario scenario;
+
+	scenario.name = "keepalive";
+	scenario.concurrency = options.concurrency;
+	result.push_back(scenario);
+
+	scenario = Scenario();
+	scenario.name = "no_keepalive";
+	scenario.concurrency = options.concurrency;
+	scenario.keepAlive = false;
+	result.push_back(scenario);
+
+	scenario = Scenario();
+	scenario.name = "pipelining";
+	scenario.concurrency = options.concurrency;
+	scenario.pipelineDepth = 8;
+	result.push_back(scenario);
+
+	scenario = Scenario();
+	scenario.name = "large_body";
+	scenario.concurrency = std::max(1u, options.concurrency / 4);
+	scenario.requestBodySize = options.largeBodySize;
+	result.push_back(scenario);
+
+	scenario = Scenario();
+	scenario.name = "slow_clients";
+	scenario.concurrency = options.concurrency;
+	scenario.slowClients = options.concurrency * 4;
+	result.push_back(scenario);
+
+	return result;
+}
+
+static const char * const ALL_MODES[] = {
+	// The empty mode is the full request path, including the stub app.
+	"", "after_accept", "before_checkout", "after_checkout", "response_begin"
+};
+
+static bool
+isSelected(const vector<string> &selection, const string &name) {
+	if (selection.empty()) {
+		return true;
+	}
+	for (unsigned int i = 0; i < selection.size(); i++) {
+		if (selection[i] == name) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static Json::Value
+createResultDoc(const string &mode, const Scenario &scenario, const LoadResult &result) {
+	Json::Value doc;
+	doc["mode"] = mode.empty() ? "none" : mode;
+	doc["scenario"] = scenario.name;
+	doc["concurrency"] = scenario.concurrency;
+	doc["pipeline_depth"] = scenario.pipelineDepth;
+	doc["request_body_size"] = scenario.requestBodySize;
+	doc["keep_alive"] = scenario.keepAlive;
+	doc["slow_clients"] = scenario.slowClients;
+	doc["requests"] = (Json::UInt64) result.requests;
+	doc["errors"] = (Json::UInt64) result.errors;
+	doc["duration"] = result.duration;
+	doc["requests_per_sec"] = result.getRequestsPerSecond();
+	doc["response_bytes_per_sec"] = result.bytesReceived / result.duration;
+	doc["latency_usec"]["p50"] = result.getLatencyPercentile(50) / 1000;
+	doc["latency_usec"]["p90"] = result.getLatencyPercentile(90) / 1000;
+	doc["latency_usec"]["p99"] = result.getLatencyPercentile(99) / 1000;
+	doc["latency_usec"]["p99.9"] = result.getLatencyPercentile(99.9) / 1000;
+	doc["latency_usec"]["max"] = result.getLatencyPercentile(100) / 1000;
+	return doc;
+}
+
+static Json::Value
+runBenchmarks(ResourceLocator *resourceLocator, const string &workDir) {
+	Json::Value results(Json::arrayValue);
+	vector<Scenario> scenarios = createScenarios();
+	string appRoot = workDir + "/app";
+
+	makeDirTree(appRoot + "/public");
+	createFile(appRoot + "/config.ru", "");
+
+	fprintf(stderr, "%-16s %-14s %12s %10s %10s %10s %10s %8s\n",
+		"Mode", "Scenario", "Req/s", "p50 (us)", "p99 (us)", "p99.9 (us)",
+		"max (us)", "Errors");
+
+	for (unsigned int i = 0; i < sizeof(ALL_MODES) / sizeof(ALL_MODES[0]); i++) {
+		string mode = ALL_MODES[i];
+		string modeName = mode.empty() ? "none" : mode;
+		if (!isSelected(options.modes, modeName)) {
+			continue;
+		}
+
+		for (unsigned int j = 0; j < scenarios.size(); j++) {
+			const Scenario &scenario = scenarios[j];
+			if (!isSelected(options.scenarios, scenario.name)) {
+				continue;
+			}
+
+			StubApp app(workDir + "/app.sock", options.protocol,
+				options.responseBodySize);
+			app.start();
+
+			LoadResult result;
+			{
+				CoreInstance core(resourceLocator, appRoot, app, mode);
+				core.start();
+				LoadGenerator generator("127.0.0.1", core.getPort(), scenario);
+				result = generator.run(options.warmup, options.duration);
+			}
+			app.stop();
+
+			results.append(createResultDoc(mode, scenario, result));
+			fprintf(stderr, "%-16s %-14s %12.0f %10.0f %10.0f %10.0f %10.0f %8llu\n",
+				modeName.c_str(), scenario.name.c_str(),
+				result.getRequestsPerSecond(),
+				result.getLatencyPercentile(50) / 1000,
+				result.getLatencyPercentile(99) / 1000,
+				result.getLatencyPercentile(99.9) / 1000,
+				result.getLatencyPercentile(100) / 1000,
+				result.errors);
+		}
+	}
+
+	return results;
+}
+
+
+static void
+usage(int exitCode) {
+	printf("Usage: ./load_bench [options]\n");
+	printf("Runs an end-to-end load benchmark against in-process Core controller threads\n");
+	printf("and a stub application, and prints the results as JSON.\n\n");
+	printf("Options:\n");
+	printf("  -m MODES        Comma-separated list of benchmark modes to run. Valid modes:\n");
+	printf("                  none, after_accept, before_checkout, after_checkout,\n");
+	printf("                  response_begin. Default: all\n");
+	printf("  -s SCENARIOS    Comma-separated list of scenarios to run. Valid scenarios:\n");
+	printf("                  keepalive, no_keepalive, pipelining, large_body,\n");
+	printf("                  slow_clients. Default: all\n");
+	printf("  -p PROTOCOL     Protocol that the stub app speaks: session or http.\n");
+	printf("                  Default: %s\n", options.protocol.c_str());
+	printf("  -T NUMBER       Number of controller threads. Default: %u\n", options.threads);
+	printf("  -c NUMBER       Number of concurrent client connections. Default: %u\n",
+		options.concurrency);
+	printf("  -a NUMBER       Concurrency of each stub app process, 0 for unlimited.\n");
+	printf("                  Default: %u\n", options.appConcurrency);
+	printf("  -b BYTES        Request body size in the large_body scenario. Default: %u\n",
+		options.largeBodySize);
+	printf("  -B BYTES        Response body size. Default: %u\n", options.responseBodySize);
+	printf("  -d SECONDS      Duration of each run. Default: %.1f\n", options.duration);
+	printf("  -w SECONDS      Warmup time before each run. Default: %.1f\n", options.warmup);
+	printf("  -R DIR          " PROGRAM_NAME " root directory. Default: current directory\n");
+	printf("  -o FILENAME     Write the JSON results to FILENAME instead of stdout.\n");
+	printf("  -h              Print this usage information.\n");
+	exit(exitCode);
+}
+
+static const char *
+requireArgument(int argc, char *argv[], int i) {
+	if (i + 1 >= argc) {
+		fprintf(stderr, "*** ERROR: option %s requires an argument.\n", argv[i]);
+		exit(1);
+	}
+	return argv[i + 1];
+}
+
+static void
+parseOptions(int argc, char *argv[]) {
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-h") == 0) {
+			usage(0);
+		} else if (strcmp(argv[i], "-m") == 0) {
+			split(requireArgument(argc, argv, i), ',', options.modes);
+			i++;
+		} else if (strcmp(argv[i], "-s") == 0) {
+			split(requireArgument(argc, argv, i), ',', options.scenarios);
+			i++;
+		} else if (strcmp(argv[i], "-p") == 0) {
+			options.protocol = requireArgument(argc, argv, i);
+			if (options.protocol != "session" && options.protocol != "http") {
+				fprintf(stderr, "*** ERROR: the protocol must be 'session' or 'http'.\n");
+				exit(1);
+			}
+			i++;
+		} else if (strcmp(argv[i], "-T") == 0) {
+			options.threads = std::max(1, atoi(requireArgument(argc, argv, i)));
+			i++;
+		} else if (strcmp(argv[i], "-c") == 0) {
+			options.concurrency = std::max(1, atoi(requireArgument(argc, argv, i)));
+			i++;
+		} else if (strcmp(argv[i], "-a") == 0) {
+			options.appConcurrency = std::max(0, atoi(requireArgument(argc, argv, i)));
+			i++;
+		} else if (strcmp(argv[i], "-b") == 0) {
+			options.largeBodySize = std::max(1, atoi(requireArgument(argc, argv, i)));
+			i++;
+		} else if (strcmp(argv[i], "-B") == 0) {
+			options.responseBodySize = std::max(0, atoi(requireArgument(argc, argv, i)));
+			i++;
+		} else if (strcmp(argv[i], "-d") == 0) {
+			options.duration = atof(requireArgument(argc, argv, i));
+			i++;
+		} else if (strcmp(argv[i], "-w") == 0) {
+			options.warmup = atof(requireArgument(argc, argv, i));
+			i++;
+		} else if (strcmp(argv[i], "-R") == 0) {
+			options.passengerRoot = requireArgument(argc, argv, i);
+			i++;
+		} else if (strcmp(argv[i], "-o") == 0) {
+			options.outputFile = requireArgument(argc, argv, i);
+			i++;
+		} else {
+			fprintf(stderr, "*** ERROR: Unknown option: %s\n", argv[i]);
+			fprintf(stderr, "Please pass -h for a list of valid options.\n");
+			exit(1);
+		}
+	}
+}
+
+int
+main(int argc, char *argv[]) {
+	oxt::initialize();
+	// The pool interrupts its background threads with a signal.
+	oxt::setup_syscall_interruption_support();
+	LoggingKit::initialize();
+	LoggingKit::setLevel(LoggingKit::ERROR);
+	parseOptions(argc, argv);
+
+	if (options.passengerRoot.empty()) {
+		char buf[PATH_MAX];
+		if (getcwd(buf, sizeof(buf)) == NULL) {
+			int e = errno;
+			fprintf(stderr, "*** ERROR: cannot determine the current directory: %s\n",
+				strerror(e));
+			return 1;
+		}
+		options.passengerRoot = buf;
+	}
+	ResourceLocator resourceLocator(options.passengerRoot);
+
+	char workDir[] = "/tmp/passenger-load-bench.XXXXXX";
+	if (mkdtemp(workDir) == NULL) {
+		int e = errno;
+		fprintf(stderr, "*** ERROR: cannot create a temporary directory: %s\n",
+			strerror(e));
+		return 1;
+	}
+
+	Json::Value doc;
+	doc["environment"] = Bench::createEnvironmentDoc();
+	doc["environment"]["controller_threads"] = options.threads;
+	doc["environment"]["protocol"] = options.protocol;
+	doc["environment"]["duration"] = options.duration;
+	try {
+		doc["results"] = runBenchmarks(&resourceLocator, workDir);
+	} catch (const std::exception &e) {
+		fprintf(stderr, "*** ERROR: %s\n", e.what());
+		removeDirTree(workDir);
+		return 1;
+	}
+	removeDirTree(workDir);
+
+	string output = doc.toStyledString();
+	if (options.outputFile == NULL) {
+		fwrite(output.data(), 1, output.size(), stdout);
+	} else {
+		FILE *f = fopen(options.outputFile, "w");
+		if (f == NULL) {
+			int e = errno;
+			fprintf(stderr, "*** ERROR: cannot open %s for writing: %s\n",
+				options.outputFile, strerror(e));
+			return 1;
+		}
+		fwrite(output.data(), 1, output.size(), f);
+		fclose(f);
+	}
+
+	oxt::shutdown();
+	return 0;
+}
@@ -0,0 +1,388 @@
+#ifndef _PASSENGER_LOAD_BENCH_LOAD_GENERATOR_H_
+#define _PASSENGER_LOAD_BENCH_LOAD_GENERATOR_H_
+
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+
+#include <FileDescriptor.h>
+#include <StaticString.h>
+#include <Utils/IOUtils.h>
+#include <Utils/StrIntUtils.h>
+
+namespace Passenger {
+namespace LoadBench {
+
+using namespace std;
+
+
+struct Scenario {
+	string name;
+	/** Number of connections that send requests as fast as possible. */
+	unsigned int concurrency;
+	/** Number of requests that are written before reading the responses. */
+	unsigned int pipelineDepth;
+	unsigned int requestBodySize;
+	bool keepAlive;
+	/**
+	 * Number of additional connections that send their request headers
+	 * one byte at a time. They're not measured; they exist to find out
+	 * how they affect the other connections.
+	 */
+	unsigned int slowClients;
+
+	Scenario()
+		: concurrency(1),
+		  pipelineDepth(1),
+		  requestBodySize(0),
+		  keepAlive(true),
+		  slowClients(0)
+		{ }
+};
+
+struct LoadResult {
+	unsigned long long requests;
+	unsigned long long errors;
+	unsigned long long bytesReceived;
+	double duration;
+	// Latencies in nanoseconds, sorted.
+	vector<boost::uint64_t> latencies;
+
+	LoadResult()
+		: requests(0),
+		  errors(0),
+		  bytesReceived(0),
+		  duration(0)
+		{ }
+
+	double getRequestsPerSecond() const {
+		return requests / duration;
+	}
+
+	double getLatencyPercentile(double percentile) const {
+		if (latencies.empty()) {
+			return 0;
+		}
+		size_t index = (size_t) (percentile / 100.0 * (latencies.size() - 1) + 0.5);
+		return (double) latencies[std::min(index, latencies.size() - 1)];
+	}
+};
+
+
+/**
+ * An HTTP load generator with one blocking thread per connection. Each
+ * connection sends a request (or a batch of pipelined requests), waits
+ * for the response(s), and repeats that until the duration has passed.
+ */
+class LoadGenerator {
+private:
+	struct Worker {
+		LoadResult result;
+		boost::thread *thread;
+
+		Worker()
+			: thread(NULL)
+			{ }
+	};
+
+	string host;
+	unsigned short port;
+	Scenario scenario;
+	string request;
+	boost::atomic<bool> measuring;
+	boost::atomic<bool> quit;
+
+	static boost::uint64_t getTimeNsec() {
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (boost::uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+	}
+
+	FileDescriptor connect() {
+		FileDescriptor fd(connectToTcpServer(host, port, __FILE__, __LINE__),
+			NULL, 0);
+		int flag = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+		// Don't let a stuck Core hang the benchmark forever.
+		struct timeval tv;
+		tv.tv_sec = 10;
+		tv.tv_usec = 0;
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+		return fd;
+	}
+
+	static bool sendAll(int fd, const char *data, size_t size) {
+		while (size > 0) {
+			ssize_t ret = send(fd, data, size, MSG_NOSIGNAL);
+			if (ret == -1) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return false;
+			}
+			data += ret;
+			size -= ret;
+		}
+		return true;
+	}
+
+	static bool lookupContentLength(const StaticString &header,
+		unsigned long long &contentLength, bool &keepAlive)
+	{
+		bool found = false;
+		string::size_type pos = header.find("\r\n") + 2;
+		keepAlive = true;
+		while (pos < header.size()) {
+			string::size_type lineEnd = header.find("\r\n", pos);
+			if (lineEnd == string::npos) {
+				break;
+			}
+			StaticString line = header.substr(pos, lineEnd - pos);
+			if (line.size() > 15 && strncasecmp(line.data(), "content-length:", 15) == 0) {
+				contentLength = stringToULL(line.substr(15));
+				found = true;
+			} else if (line.size() >= 17 && strncasecmp(line.data(), "connection: close", 17) == 0) {
+				keepAlive = false;
+			}
+			pos = lineEnd + 2;
+		}
+		return found;
+	}
+
+	/**
+	 * Reads one response from `fd`, using `buffer` for data that has been
+	 * read but not yet consumed. Returns whether a complete, successful
+	 * response was read.
+	 */
+	static bool readResponse(int fd, string &buffer, unsigned long long &bytesReceived,
+		bool &keepAlive)
+	{
+		char buf[1024 * 16];
+		string::size_type headerEnd;
+		unsigned long long contentLength = 0;
+
+		while ((headerEnd = buffer.find("\r\n\r\n")) == string::npos) {
+			ssize_t ret = read(fd, buf, sizeof(buf));
+			if (ret == -1 && errno == EINTR) {
+				continue;
+			} else if (ret <= 0) {
+				return false;
+			}
+			buffer.append(buf, ret);
+		}
+
+		StaticString header(buffer.data(), headerEnd + 2);
+		if (!startsWith(header, P_STATIC_STRING("HTTP/1.1 200 "))
+		 || !lookupContentLength(header, contentLength, keepAlive))
+		{
+			return false;
+		}
+
+		size_t responseSize = headerEnd + 4 + contentLength;
+		while (buffer.size() < responseSize) {
+			ssize_t ret = read(fd, buf, sizeof(buf));
+			if (ret == -1 && errno == EINTR) {
+				continue;
+			} else if (ret <= 0) {
+				return false;
+			}
+			buffer.append(buf, ret);
+		}
+
+		bytesReceived += responseSize;
+		buffer.erase(0, responseSize);
+		return true;
+	}
+
+	void runFastClient(LoadResult *result) {
+		FileDescriptor fd;
+		string buffer;
+		string batch;
+		vector<boost::uint64_t> latencies;
+
+		for (unsigned int i = 0; i < scenario.pipelineDepth; i++) {
+			batch.append(request);
+		}
+		latencies.reserve(1024 * 64);
+
+		while (!quit.load(boost::memory_order_relaxed)) {
+			// Connection setup counts towards the latency of the first request.
+			boost::uint64_t startTime = getTimeNsec();
+			if (fd == -1) {
+				try {
+					fd = connect();
+				} catch (const SystemException &) {
+					if (measuring.load(boost::memory_order_relaxed)) {
+						result->errors++;
+					}
+					usleep(1000);
+					continue;
+				}
+				buffer.clear();
+			}
+
+			bool ok = sendAll(fd, batch.data(), batch.size());
+			bool keepAlive = true;
+
+			// If the Core closes the connection, then the remaining
+			// pipelined requests won't be answered.
+			for (unsigned int i = 0; ok && keepAlive && i < scenario.pipelineDepth; i++) {
+				unsigned long long bytesReceived = 0;
+				ok = readResponse(fd, buffer, bytesReceived, keepAlive);
+				if (ok && measuring.load(boost::memory_order_relaxed)) {
+					result->requests++;
+					result->bytesReceived += bytesReceived;
+					latencies.push_back(getTimeNsec() - startTime);
+				}
+			}
+
+			if (!ok) {
+				if (measuring.load(boost::memory_order_relaxed)) {
+					result->errors++;
+				}
+				fd.close();
+			} else if (!keepAlive || !scenario.keepAlive) {
+				fd.close();
+			}
+		}
+
+		result->latencies.swap(latencies);
+	}
+
+	/**
+	 * Trickles requests into the Core one byte at a time, to see how
+	 * much slow clients (e.g. mobile clients) hurt everybody else.
+	 */
+	void runSlowClient() {
+		FileDescriptor fd;
+		string buffer;
+
+		while (!quit.load(boost::memory_order_relaxed)) {
+			if (fd == -1) {
+				try {
+					fd = connect();
+				} catch (const SystemException &) {
+					usleep(10000);
+					continue;
+				}
+				buffer.clear();
+			}
+
+			bool ok = true;
+			for (size_t i = 0; ok && i < request.size(); i++) {
+				ok = sendAll(fd, request.data() + i, 1);
+				if (quit.load(boost::memory_order_relaxed)) {
+					return;
+				}
+				usleep(1000);
+			}
+
+			unsigned long long bytesReceived = 0;
+			bool keepAlive;
+			if (!ok || !readResponse(fd, buffer, bytesReceived, keepAlive) || !keepAlive) {
+				fd.close();
+			}
+		}
+	}
+
+public:
+	LoadGenerator(const string &_host, unsigned short _port, const Scenario &_scenario)
+		: host(_host),
+		  port(_port),
+		  scenario(_scenario),
+		  measuring(false),
+		  quit(false)
+	{
+		if (scenario.requestBodySize == 0) {
+			request = "GET /products/index?page=2 HTTP/1.1\r\n";
+		} else {
+			request = "POST /products HTTP/1.1\r\n";
+		}
+		request.append("Host: localhost\r\n"
+			"User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+				"(KHTML, like Gecko) Chrome/67.0.3396.99 Safari/537.36\r\n"
+			"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+			"Accept-Language: en-US,en;q=0.9\r\n"
+			"Cookie: _session_id=7f3c2a1b9d8e4f6a5b3c2d1e0f9a8b7c\r\n");
+		if (!scenario.keepAlive) {
+			request.append("Connection: close\r\n");
+		}
+		if (scenario.requestBodySize > 0) {
+			request.append("Content-Type: application/octet-stream\r\n");
+			request.append("Content-Length: " + toString(scenario.requestBodySize) + "\r\n");
+		}
+		request.append("\r\n");
+		request.append(string(scenario.requestBodySize, 'x'));
+	}
+
+	/**
+	 * Runs the scenario: first for `warmup` seconds without measuring,
+	 * and then for `duration` seconds.
+	 */
+	LoadResult run(double warmup, double duration) {
+		vector<Worker> workers(scenario.concurrency);
+		vector<boost::thread *> slowClients;
+		unsigned int i;
+
+		measuring.store(false);
+		quit.store(false);
+
+		for (i = 0; i < scenario.slowClients; i++) {
+			slowClients.push_back(new boost::thread(
+				boost::bind(&LoadGenerator::runSlowClient, this)));
+		}
+		for (i = 0; i < workers.size(); i++) {
+			workers[i].thread = new boost::thread(boost::bind(
+				&LoadGenerator::runFastClient, this, &workers[i].result));
+		}
+
+		usleep((useconds_t) (warmup * 1000000));
+		boost::uint64_t startTime = getTimeNsec();
+		measuring.store(true);
+		usleep((useconds_t) (duration * 1000000));
+		measuring.store(false);
+		boost::uint64_t endTime = getTimeNsec();
+		quit.store(true);
+
+		LoadResult total;
+		total.duration = (endTime - startTime) / 1000000000.0;
+		for (i = 0; i < workers.size(); i++) {
+			workers[i].thread->join();
+			delete workers[i].thread;
+
+			LoadResult &result = workers[i].result;
+			total.requests += result.requests;
+			total.errors += result.errors;
+			total.bytesReceived += result.bytesReceived;
+			total.latencies.insert(total.latencies.end(),
+				result.latencies.begin(), result.latencies.end());
+		}
+		for (i = 0; i < slowClients.size(); i++) {
+			slowClients[i]->join();
+			delete slowClients[i];
+		}
+
+		std::sort(total.latencies.begin(), total.latencies.end());
+		return total;
+	}
+};
+
+
+} // namespace LoadBench
+} // namespace Passenger
+
+#endif /* _PASSENGER_LOAD_BENCH_LOAD_GENERATOR_H_ */
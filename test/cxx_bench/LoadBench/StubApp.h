@@ -0,0 +1,296 @@
+#ifndef _PASSENGER_LOAD_BENCH_STUB_APP_H_
+#define _PASSENGER_LOAD_BENCH_STUB_APP_H_
+
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/atomic.hpp>
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <FileDescriptor.h>
+#include <StaticString.h>
+#include <Exceptions.h>
+#include <Utils/IOUtils.h>
+#include <Utils/MessageIO.h>
+#include <Utils/StrIntUtils.h>
+
+namespace Passenger {
+namespace LoadBench {
+
+using namespace std;
+
+
+/**
+ * A minimal application that the Core forwards requests to. It listens on
+ * a Unix domain socket and speaks either the "session" protocol (a scalar
+ * message containing NUL-separated CGI headers, followed by the body) or
+ * the "http" protocol. Every request is answered with a fixed response.
+ *
+ * There is one thread per connection, so that the stub app is never the
+ * bottleneck for a reasonable number of concurrent requests.
+ */
+class StubApp {
+private:
+	struct Shared {
+		string protocol;
+		string response;
+		boost::atomic<unsigned long long> requestsHandled;
+
+		Shared()
+			: requestsHandled(0)
+			{ }
+	};
+
+	typedef boost::shared_ptr<Shared> SharedPtr;
+
+	string socketFilename;
+	FileDescriptor serverFd;
+	Pipe exitPipe;
+	SharedPtr shared;
+	boost::thread *acceptThread;
+
+	static void readRemainder(int fd, unsigned long long size) {
+		char buf[1024 * 16];
+		while (size > 0) {
+			unsigned int ret = readExact(fd, buf,
+				(unsigned int) std::min<unsigned long long>(size, sizeof(buf)));
+			if (ret == 0) {
+				throw EOFException("Unexpected EOF while reading the request body");
+			}
+			size -= ret;
+		}
+	}
+
+	/**
+	 * Handles exactly one request. The Core opens a new connection for
+	 * every request with the session protocol.
+	 */
+	static void handleSessionConnection(const SharedPtr &shared, int fd) {
+		string header;
+		if (!readScalarMessage(fd, header)) {
+			return;
+		}
+
+		// The header consists of "NAME\0VALUE\0" pairs.
+		unsigned long long contentLength = 0;
+		const char *pos = header.data();
+		const char *end = header.data() + header.size();
+		while (pos < end) {
+			const char *nameEnd = (const char *) memchr(pos, '\0', end - pos);
+			if (nameEnd == NULL) {
+				break;
+			}
+			const char *valueEnd = (const char *) memchr(nameEnd + 1, '\0',
+				end - nameEnd - 1);
+			if (valueEnd == NULL) {
+				break;
+			}
+			if (StaticString(pos, nameEnd - pos) == P_STATIC_STRING("CONTENT_LENGTH")) {
+				contentLength = stringToULL(StaticString(nameEnd + 1,
+					valueEnd - nameEnd - 1));
+			}
+			pos = valueEnd + 1;
+		}
+
+		readRemainder(fd, contentLength);
+		writeExact(fd, shared->response);
+		shared->requestsHandled.fetch_add(1, boost::memory_order_relaxed);
+	}
+
+	static bool lookupHeader(const StaticString &header, const StaticString &name,
+		StaticString &value)
+	{
+		string::size_type pos = 0;
+		while (true) {
+			string::size_type lineEnd = header.find("\r\n", pos);
+			if (lineEnd == string::npos) {
+				return false;
+			}
+			StaticString line = header.substr(pos, lineEnd - pos);
+			if (line.size() > name.size() + 1
+			 && line[name.size()] == ':'
+			 && strncasecmp(line.data(), name.data(), name.size()) == 0)
+			{
+				value = line.substr(name.size() + 1);
+				while (!value.empty() && value[0] == ' ') {
+					value = value.substr(1);
+				}
+				return true;
+			}
+			pos = lineEnd + 2;
+		}
+	}
+
+	/**
+	 * Handles requests until the Core closes the connection, or until
+	 * the Core sends "Connection: close".
+	 */
+	static void handleHttpConnection(const SharedPtr &shared, int fd) {
+		string buffer;
+		char buf[1024 * 16];
+
+		while (true) {
+			string::size_type headerEnd;
+			while ((headerEnd = buffer.find("\r\n\r\n")) == string::npos) {
+				ssize_t ret;
+				do {
+					ret = read(fd, buf, sizeof(buf));
+				} while (ret == -1 && errno == EINTR);
+				if (ret == -1) {
+					int e = errno;
+					throw SystemException("Cannot read from the Core", e);
+				} else if (ret == 0) {
+					return;
+				}
+				buffer.append(buf, ret);
+			}
+
+			StaticString header(buffer.data(), headerEnd + 2);
+			StaticString value;
+			unsigned long long contentLength = 0;
+			bool keepAlive = true;
+			if (lookupHeader(header, P_STATIC_STRING("Content-Length"), value)) {
+				contentLength = stringToULL(value);
+			}
+			if (lookupHeader(header, P_STATIC_STRING("Connection"), value)
+			 && value.size() == 5
+			 && strncasecmp(value.data(), "close", 5) == 0)
+			{
+				keepAlive = false;
+			}
+
+			buffer.erase(0, headerEnd + 4);
+			if (buffer.size() >= contentLength) {
+				buffer.erase(0, contentLength);
+			} else {
+				readRemainder(fd, contentLength - buffer.size());
+				buffer.clear();
+			}
+
+			writeExact(fd, shared->response);
+			shared->requestsHandled.fetch_add(1, boost::memory_order_relaxed);
+			if (!keepAlive) {
+				return;
+			}
+		}
+	}
+
+	static void handleConnection(SharedPtr shared, int fd) {
+		FileDescriptor guard(fd, __FILE__, __LINE__);
+		try {
+			if (shared->protocol == "http") {
+				handleHttpConnection(shared, fd);
+			} else {
+				handleSessionConnection(shared, fd);
+			}
+		} catch (const std::exception &e) {
+			// The Core may disconnect at any time, e.g. in benchmark modes
+			// that respond before the request reaches the app.
+		}
+	}
+
+	static void acceptConnections(SharedPtr shared, int serverFd, int exitFd) {
+		struct pollfd fds[2];
+		fds[0].fd = serverFd;
+		fds[0].events = POLLIN;
+		fds[1].fd = exitFd;
+		fds[1].events = POLLIN;
+
+		while (true) {
+			fds[0].revents = fds[1].revents = 0;
+			if (poll(fds, 2, -1) == -1) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return;
+			}
+			if (fds[1].revents != 0) {
+				return;
+			}
+
+			int fd;
+			do {
+				fd = accept(serverFd, NULL, NULL);
+			} while (fd == -1 && errno == EINTR);
+			if (fd == -1) {
+				continue;
+			}
+
+			try {
+				boost::thread(boost::bind(handleConnection, shared, fd)).detach();
+			} catch (const boost::thread_resource_error &) {
+				close(fd);
+			}
+		}
+	}
+
+public:
+	StubApp(const string &_socketFilename, const string &protocol,
+		unsigned int responseBodySize)
+		: socketFilename(_socketFilename),
+		  shared(boost::make_shared<Shared>()),
+		  acceptThread(NULL)
+	{
+		shared->protocol = protocol;
+		shared->response =
+			"HTTP/1.1 200 OK\r\n"
+			"Content-Type: text/plain\r\n"
+			"Content-Length: " + toString(responseBodySize) + "\r\n"
+			"\r\n"
+			+ string(responseBodySize, 'x');
+	}
+
+	~StubApp() {
+		stop();
+	}
+
+	void start() {
+		serverFd.assign(createUnixServer(socketFilename, 1024, true,
+			__FILE__, __LINE__), NULL, 0);
+		exitPipe = createPipe(__FILE__, __LINE__);
+		acceptThread = new boost::thread(boost::bind(acceptConnections,
+			shared, (int) serverFd, (int) exitPipe.first));
+	}
+
+	/**
+	 * Stops accepting new connections. Connections that are still open
+	 * are handled until the Core closes them.
+	 */
+	void stop() {
+		if (acceptThread != NULL) {
+			writeExact(exitPipe.second, "x", 1);
+			acceptThread->join();
+			delete acceptThread;
+			acceptThread = NULL;
+			serverFd.close();
+			exitPipe.first.close();
+			exitPipe.second.close();
+			unlink(socketFilename.c_str());
+		}
+	}
+
+	string getAddress() const {
+		return "unix:" + socketFilename;
+	}
+
+	const string &getProtocol() const {
+		return shared->protocol;
+	}
+
+	unsigned long long getRequestsHandled() const {
+		return shared->requestsHandled.load(boost::memory_order_relaxed);
+	}
+};
+
+
+} // namespace LoadBench
+} // namespace Passenger
+
+#endif /* _PASSENGER_LOAD_BENCH_STUB_APP_H_ */
@@ -0,0 +1,59 @@
+#include <BenchSupport.h>
+#include <Constants.h>
+#include <MemoryKit/mbuf.h>
+
+using namespace Passenger;
+using namespace Passenger::MemoryKit;
+using namespace Passenger::Bench;
+
+
+BENCHMARK(MemoryKit_Mbuf, block_get_put) {
+	struct mbuf_pool pool;
+	pool.mbuf_block_chunk_size = DEFAULT_MBUF_CHUNK_SIZE;
+	mbuf_pool_init(&pool);
+
+	state.startTimer();
+	for (boost::uint64_t i = 0; i < state.iterations; i++) {
+		struct mbuf_block *block = mbuf_block_get(&pool);
+		doNotOptimize(block);
+		block->refcount = 0;
+		mbuf_block_put(block);
+	}
+	state.stopTimer();
+
+	mbuf_pool_deinit(&pool);
+}
+
+BENCHMARK(MemoryKit_Mbuf, get_slice_release) {
+	// Gets an mbuf, creates a slice of it (as the channels do when passing
+	// data on) and releases both.
+	struct mbuf_pool pool;
+	pool.mbuf_block_chunk_size = DEFAULT_MBUF_CHUNK_SIZE;
+	mbuf_pool_init(&pool);
+
+	state.startTimer();
+	for (boost::uint64_t i = 0; i < state.iterations; i++) {
+		mbuf buffer(mbuf_get(&pool));
+		mbuf slice(buffer, 0, 128);
+		doNotOptimize(slice);
+	}
+	state.stopTimer();
+
+	mbuf_pool_deinit(&pool);
+}
+
+BENCHMARK(MemoryKit_Mbuf, get_with_size) {
+	struct mbuf_pool pool;
+	pool.mbuf_block_chunk_size = DEFAULT_MBUF_CHUNK_SIZE;
+	mbuf_pool_init(&pool);
+	static const size_t sizes[] = { 200, 1500, 9000, 40000 };
+
+	state.startTimer();
+	for (boost::uint64_t i = 0; i < state.iterations; i++) {
+		mbuf buffer(mbuf_get_with_size(&pool, sizes[i % 4]));
+		doNotOptimize(buffer);
+	}
+	state.stopTimer();
+
+	mbuf_pool_deinit(&pool);
+}
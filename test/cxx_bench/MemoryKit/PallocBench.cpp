@@ -0,0 +1,46 @@
+#include <BenchSupport.h>
+#include <MemoryKit/palloc.h>
+
+using namespace Passenger;
+using namespace Passenger::Bench;
+
+
+BENCHMARK(MemoryKit_Palloc, palloc_small) {
+	psg_pool_t *pool = psg_create_pool(PSG_DEFAULT_POOL_SIZE);
+
+	state.startTimer();
+	for (boost::uint64_t i = 0; i < state.iterations; i++) {
+		doNotOptimize(psg_palloc(pool, 48));
+		if (i % 1024 == 1023) {
+			psg_reset_pool(pool, PSG_DEFAULT_POOL_SIZE);
+		}
+	}
+	state.stopTimer();
+
+	psg_destroy_pool(pool);
+}
+
+BENCHMARK(MemoryKit_Palloc, request_cycle) {
+	// Simulates the allocations of a typical request: a few dozen small
+	// allocations, followed by resetting the pool for the next request.
+	psg_pool_t *pool = psg_create_pool(PSG_DEFAULT_POOL_SIZE);
+
+	state.startTimer();
+	for (boost::uint64_t i = 0; i < state.iterations; i++) {
+		for (unsigned int j = 0; j < 32; j++) {
+			doNotOptimize(psg_pnalloc(pool, 16 + j * 8));
+		}
+		psg_reset_pool(pool, PSG_DEFAULT_POOL_SIZE);
+	}
+	state.stopTimer();
+
+	psg_destroy_pool(pool);
+}
+
+BENCHMARK(MemoryKit_Palloc, create_and_destroy_pool) {
+	for (boost::uint64_t i = 0; i < state.iterations; i++) {
+		psg_pool_t *pool = psg_create_pool(PSG_DEFAULT_POOL_SIZE);
+		doNotOptimize(psg_palloc(pool, 64));
+		psg_destroy_pool(pool);
+	}
+}
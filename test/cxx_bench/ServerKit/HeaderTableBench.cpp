@@ -0,0 +1,86 @@
+#include <BenchSupport.h>
+#include <MemoryKit/palloc.h>
+#include <ServerKit/HeaderTable.h>
+
+using namespace Passenger;
+using namespace Passenger::ServerKit;
+using namespace Passenger::Bench;
+
+namespace {
+	// Request headers as sent by a typical desktop browser.
+	const char * const BROWSER_HEADERS[][2] = {
+		{ "Host", "www.example.com" },
+		{ "Connection", "keep-alive" },
+		{ "Cache-Control", "max-age=0" },
+		{ "Upgrade-Insecure-Requests", "1" },
+		{ "User-Agent", "Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+			"(KHTML, like Gecko) Chrome/67.0.3396.99 Safari/537.36" },
+		{ "Accept", "text/html,application/xhtml+xml,application/xml;q=0.9,"
+			"image/webp,image/apng,*/*;q=0.8" },
+		{ "Referer", "https://www.example.com/products/index" },
+		{ "Accept-Encoding", "gzip, deflate, br" },
+		{ "Accept-Language", "en-US,en;q=0.9,nl;q=0.8" },
+		{ "Cookie", "_session_id=7f3c2a1b9d8e4f6a5b3c2d1e0f9a8b7c; locale=en" },
+		{ "If-None-Match", "W/\"5b3c2d1e0f9a8b7c\"" },
+		{ "X-Forwarded-For", "203.0.113.195" }
+	};
+	const unsigned int NUM_BROWSER_HEADERS =
+		sizeof(BROWSER_HEADERS) / sizeof(BROWSER_HEADERS[0]);
+
+	void insertBrowserHeaders(HeaderTable &table, psg_pool_t *pool) {
+		for (unsigned int i = 0; i < NUM_BROWSER_HEADERS; i++) {
+			table.insert(pool, BROWSER_HEADERS[i][0], BROWSER_HEADERS[i][1]);
+		}
+	}
+}
+
+
+BENCHMARK(ServerKit_HeaderTable, insert_browser_headers) {
+	psg_pool_t *pool = psg_create_pool(PSG_DEFAULT_POOL_SIZE);
+	HeaderTable table;
+
+	state.startTimer();
+	for (boost::uint64_t i = 0; i < state.iterations; i++) {
+		insertBrowserHeaders(table, pool);
+		doNotOptimize(table);
+		table.clear();
+		psg_reset_pool(pool, PSG_DEFAULT_POOL_SIZE);
+	}
+	state.stopTimer();
+
+	psg_destroy_pool(pool);
+}
+
+BENCHMARK(ServerKit_HeaderTable, lookup_hit) {
+	psg_pool_t *pool = psg_create_pool(PSG_DEFAULT_POOL_SIZE);
+	HeaderTable table;
+	insertBrowserHeaders(table, pool);
+	HashedStaticString keys[] = {
+		"host", "accept-encoding", "cookie", "if-none-match", "x-forwarded-for"
+	};
+
+	state.startTimer();
+	for (boost::uint64_t i = 0; i < state.iterations; i++) {
+		doNotOptimize(table.lookup(keys[i % 5]));
+	}
+	state.stopTimer();
+
+	psg_destroy_pool(pool);
+}
+
+BENCHMARK(ServerKit_HeaderTable, lookup_miss) {
+	psg_pool_t *pool = psg_create_pool(PSG_DEFAULT_POOL_SIZE);
+	HeaderTable table;
+	insertBrowserHeaders(table, pool);
+	HashedStaticString keys[] = {
+		"authorization", "content-type", "content-length", "expect", "pragma"
+	};
+
+	state.startTimer();
+	for (boost::uint64_t i = 0; i < state.iterations; i++) {
+		doNotOptimize(table.lookup(keys[i % 5]));
+	}
+	state.stopTimer();
+
+	psg_destroy_pool(pool);
+}
@@ -145,6 +145,42 @@ def send_binary_request(socket, env)
     end
   end
 
+  describe "if the Core supports version 2 of the session protocol" do
+    def preinitialize
+      @options = { "supported_session_protocols" => ["session2", "session"] }
+    end
+
+    it "uses it on the main socket" do
+      @request_handler.server_sockets[:main][:protocol].should == :session2
+    end
+
+    it "accepts pings with binary headers" do
+      @request_handler.start_main_loop_thread
+      client = connect
+      begin
+        channel = MessageChannel.new(client)
+        # Version 2, field 5 (REQUEST_METHOD), then a literal name.
+        channel.write_scalar([2, 5, 4].pack("CCn") + "PING" +
+          [0, 3].pack("Cn") + "FOO" + [3].pack("n") + "bar")
+        client.read.should == "pong"
+      ensure
+        client.close
+      end
+    end
+
+    it "still accepts headers in the version 1 format" do
+      @request_handler.start_main_loop_thread
+      client = connect
+      begin
+        channel = MessageChannel.new(client)
+        channel.write_scalar("REQUEST_METHOD\0PING\0")
+        client.read.should == "pong"
+      ensure
+        client.close
+      end
+    end
+  end
+
   specify "the HTTP socket rejects headers that are too large" do
     stderr = StringIO.new
     DebugLogging.log_level = DEFAULT_LOG_LEVEL